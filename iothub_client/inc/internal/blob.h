@@ -61,6 +61,26 @@ DEFINE_ENUM(BLOB_RESULT, BLOB_RESULT_VALUES)
 */
 MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadMultipleBlocksFromSasUri, const char*, SASURI, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, getDataCallbackEx, void*, context, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse, const char*, certificates, HTTP_PROXY_OPTIONS*, proxyOptions)
 
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/**
+* @brief  Synchronously uploads a byte array to blob storage, keeping several blocks on the wire at the same time
+*
+* @param  SASURI              The URI to use to upload data
+* @param  getDataCallbackEx   A callback to be invoked to acquire the file chunks to be uploaded. It is called on the calling thread only, and
+*                             ahead of the uploads: the data it returns is copied before the next call.
+* @param  context             Any data provided by the user to serve as context on getDataCallback.
+* @param  httpStatus          A pointer to an out argument receiving the HTTP status (available only when the return value is BLOB_OK)
+* @param  httpResponse        A BUFFER_HANDLE that receives the HTTP response from the server (available only when the return value is BLOB_OK)
+* @param  certificates        A null terminated string containing CA certificates to be used
+* @param  proxyOptions        A structure that contains optional web proxy information
+* @param  maxConcurrentBlocks The number of connections to storage, each uploading one block at a time. Up to twice as many blocks are read ahead.
+* @param  blockSize           The size up to which consecutive chunks are put in the same block (at most 4MB). 0 makes every chunk a block.
+*
+* @return	A @c BLOB_RESULT. BLOB_OK means the blob has been uploaded successfully. Any other value indicates an error
+*/
+MOCKABLE_FUNCTION(, BLOB_RESULT, Blob_UploadMultipleBlocksInParallelFromSasUri, const char*, SASURI, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, getDataCallbackEx, void*, context, unsigned int*, httpStatus, BUFFER_HANDLE, httpResponse, const char*, certificates, HTTP_PROXY_OPTIONS*, proxyOptions, size_t, maxConcurrentBlocks, size_t, blockSize)
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
 /**
 * @brief  Synchronously uploads a byte array as a new block to blob storage
 *
@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_ingestion_queue.h
+*    @brief Bounded multi-producer/single-consumer queue of pointers.
+*
+*    @details Any number of threads can call ingestion_queue_push concurrently without taking a lock.
+*             ingestion_queue_pop and ingestion_queue_is_empty are only to be called by one thread
+*             at a time (the consumer). The consumer raises ingestion_queue_set_consumer_waiting
+*             before it checks for items and goes to sleep; producers that see it raised after a
+*             push are the ones that have to wake it up.
+*/
+
+#ifndef IOTHUB_CLIENT_INGESTION_QUEUE_H
+#define IOTHUB_CLIENT_INGESTION_QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct INGESTION_QUEUE_TAG* INGESTION_QUEUE_HANDLE;
+
+MOCKABLE_FUNCTION(, INGESTION_QUEUE_HANDLE, ingestion_queue_create, size_t, capacity);
+MOCKABLE_FUNCTION(, int, ingestion_queue_push, INGESTION_QUEUE_HANDLE, queue, void*, item);
+MOCKABLE_FUNCTION(, void*, ingestion_queue_pop, INGESTION_QUEUE_HANDLE, queue);
+MOCKABLE_FUNCTION(, bool, ingestion_queue_is_empty, INGESTION_QUEUE_HANDLE, queue);
+MOCKABLE_FUNCTION(, void, ingestion_queue_set_consumer_waiting, INGESTION_QUEUE_HANDLE, queue, bool, waiting);
+MOCKABLE_FUNCTION(, bool, ingestion_queue_is_consumer_waiting, INGESTION_QUEUE_HANDLE, queue);
+MOCKABLE_FUNCTION(, void, ingestion_queue_destroy, INGESTION_QUEUE_HANDLE, queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_INGESTION_QUEUE_H
@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_mqtt_topic.h
+*    @brief Encoding and parsing of the IoT Hub MQTT topics.
+*
+*    @details Outbound, mqtt_topic_encode_event writes the event topic and the message properties into
+*             a buffer the transport keeps from one publish to the next, sized up front from the length
+*             of the properties, so steady-state publishing allocates nothing for topics. Values made of
+*             characters that never need escaping are written as they are, only the others go through
+*             URL encoding.
+*             Inbound, mqtt_topic_parse classifies a topic and points into it for the request id, the
+*             status, the method name and the property bag in a single pass without allocating;
+*             mqtt_topic_get_next_property then walks the property bag, one name/value view at a time.
+*/
+
+#ifndef IOTHUB_CLIENT_MQTT_TOPIC_H
+#define IOTHUB_CLIENT_MQTT_TOPIC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MQTT_TOPIC_KIND_VALUES       \
+    MQTT_TOPIC_KIND_TELEMETRY,       \
+    MQTT_TOPIC_KIND_TWIN_RESPONSE,   \
+    MQTT_TOPIC_KIND_TWIN_PATCH,      \
+    MQTT_TOPIC_KIND_METHOD_REQUEST
+
+DEFINE_ENUM(MQTT_TOPIC_KIND, MQTT_TOPIC_KIND_VALUES);
+
+/*characters of a topic, not NULL terminated*/
+typedef struct MQTT_TOPIC_VIEW_TAG
+{
+    const char* start;
+    size_t length;
+} MQTT_TOPIC_VIEW;
+
+typedef struct MQTT_TOPIC_INFO_TAG
+{
+    MQTT_TOPIC_KIND kind;
+    int status_code; /*MQTT_TOPIC_KIND_TWIN_RESPONSE*/
+    MQTT_TOPIC_VIEW request_id; /*MQTT_TOPIC_KIND_TWIN_RESPONSE and MQTT_TOPIC_KIND_METHOD_REQUEST*/
+    MQTT_TOPIC_VIEW method_name; /*MQTT_TOPIC_KIND_METHOD_REQUEST*/
+    MQTT_TOPIC_VIEW properties; /*MQTT_TOPIC_KIND_TELEMETRY, the '&' separated name=value pairs*/
+} MQTT_TOPIC_INFO;
+
+/*a buffer owned by the transport and reused for every topic, it only grows*/
+typedef struct MQTT_TOPIC_BUFFER_TAG
+{
+    char* buffer;
+    size_t capacity;
+} MQTT_TOPIC_BUFFER;
+
+MOCKABLE_FUNCTION(, const char*, mqtt_topic_encode_event, MQTT_TOPIC_BUFFER*, topic_buffer, const char*, event_topic, IOTHUB_MESSAGE_HANDLE, message, bool, urlencode);
+MOCKABLE_FUNCTION(, int, mqtt_topic_parse, const char*, topic, MQTT_TOPIC_INFO*, topic_info);
+MOCKABLE_FUNCTION(, bool, mqtt_topic_get_next_property, MQTT_TOPIC_VIEW*, properties, MQTT_TOPIC_VIEW*, name, MQTT_TOPIC_VIEW*, value);
+MOCKABLE_FUNCTION(, char*, mqtt_topic_buffer_reserve, MQTT_TOPIC_BUFFER*, topic_buffer, size_t, size);
+MOCKABLE_FUNCTION(, void, mqtt_topic_buffer_deinit, MQTT_TOPIC_BUFFER*, topic_buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_MQTT_TOPIC_H
@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_object_pool.h
+*    @brief Fixed-size objects carved out of slabs.
+*
+*    @details Released objects go back on a free list instead of to the heap, so once the pool has grown to the
+*             peak number of objects in use, acquiring and releasing them costs no heap call. The pool only
+*             goes back to the heap for a new slab as big as everything it owns so far.
+*             The pool does not lock, it shall be used under the lock of its owner.
+*/
+
+#ifndef IOTHUB_CLIENT_OBJECT_POOL_H
+#define IOTHUB_CLIENT_OBJECT_POOL_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct OBJECT_POOL_TAG* OBJECT_POOL_HANDLE;
+
+MOCKABLE_FUNCTION(, OBJECT_POOL_HANDLE, object_pool_create, size_t, object_size, size_t, reserved_count);
+MOCKABLE_FUNCTION(, void*, object_pool_acquire, OBJECT_POOL_HANDLE, pool);
+MOCKABLE_FUNCTION(, void, object_pool_release, OBJECT_POOL_HANDLE, pool, void*, object);
+MOCKABLE_FUNCTION(, void, object_pool_destroy, OBJECT_POOL_HANDLE, pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_OBJECT_POOL_H
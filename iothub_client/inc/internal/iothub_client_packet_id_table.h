@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_packet_id_table.h
+*    @brief In-flight items indexed by their MQTT packet id.
+*
+*    @details An open-addressing hash table from 16-bit packet id to the owner's item, so the
+*             acknowledgement of a packet finds what it acknowledges in constant time however many
+*             packets are in flight. The table only indexes the items, keeping them in send order
+*             is up to the owner. The table does not lock, it shall be used under the lock of its owner.
+*/
+
+#ifndef IOTHUB_CLIENT_PACKET_ID_TABLE_H
+#define IOTHUB_CLIENT_PACKET_ID_TABLE_H
+
+#include <stdint.h>
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct PACKET_ID_TABLE_TAG* PACKET_ID_TABLE_HANDLE;
+
+MOCKABLE_FUNCTION(, PACKET_ID_TABLE_HANDLE, packet_id_table_create);
+MOCKABLE_FUNCTION(, int, packet_id_table_add, PACKET_ID_TABLE_HANDLE, packet_id_table, uint16_t, packet_id, void*, item);
+MOCKABLE_FUNCTION(, void*, packet_id_table_remove, PACKET_ID_TABLE_HANDLE, packet_id_table, uint16_t, packet_id);
+MOCKABLE_FUNCTION(, void, packet_id_table_destroy, PACKET_ID_TABLE_HANDLE, packet_id_table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_PACKET_ID_TABLE_H
@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_client_timer_queue.h
+*    @brief Deadlines ordered in a binary min-heap.
+*
+*    @details The owner of a timer embeds a TIMER_QUEUE_ENTRY in its own structure and gets it back
+*             (containingRecord) from timer_queue_pop_expired once the deadline is due. Adding and
+*             removing a timer costs O(log n), finding out whether anything is due costs O(1), so a
+*             DoWork that only looks at what expired no longer depends on how many timers are armed.
+*             The queue does not lock, it shall be used under the lock of its owner.
+*/
+
+#ifndef IOTHUB_CLIENT_TIMER_QUEUE_H
+#define IOTHUB_CLIENT_TIMER_QUEUE_H
+
+#include <stddef.h>
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct TIMER_QUEUE_TAG* TIMER_QUEUE_HANDLE;
+
+typedef struct TIMER_QUEUE_ENTRY_TAG
+{
+    tickcounter_ms_t deadline;
+    size_t index; /*position in the heap, only meaningful to the timer queue*/
+} TIMER_QUEUE_ENTRY;
+
+MOCKABLE_FUNCTION(, TIMER_QUEUE_HANDLE, timer_queue_create);
+MOCKABLE_FUNCTION(, void, timer_queue_entry_init, TIMER_QUEUE_ENTRY*, entry);
+MOCKABLE_FUNCTION(, int, timer_queue_add, TIMER_QUEUE_HANDLE, timer_queue, TIMER_QUEUE_ENTRY*, entry, tickcounter_ms_t, deadline);
+MOCKABLE_FUNCTION(, void, timer_queue_remove, TIMER_QUEUE_HANDLE, timer_queue, TIMER_QUEUE_ENTRY*, entry);
+MOCKABLE_FUNCTION(, TIMER_QUEUE_ENTRY*, timer_queue_pop_expired, TIMER_QUEUE_HANDLE, timer_queue, tickcounter_ms_t, now);
+MOCKABLE_FUNCTION(, int, timer_queue_get_next_deadline, TIMER_QUEUE_HANDLE, timer_queue, tickcounter_ms_t*, deadline);
+MOCKABLE_FUNCTION(, void, timer_queue_destroy, TIMER_QUEUE_HANDLE, timer_queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTHUB_CLIENT_TIMER_QUEUE_H
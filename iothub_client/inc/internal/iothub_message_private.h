@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file iothub_message_private.h
+*    @brief Message functions reserved to the client and its transports.
+*
+*    @details A message created from a borrowed byte array points at the caller's bytes instead of
+*             copying them, so a transport can hand a received payload to a message view callback
+*             straight out of its receive buffer. The bytes shall stay valid and unchanged until the
+*             message is destroyed or IoTHubMessage_OwnContent copies them.
+*/
+
+#ifndef IOTHUB_MESSAGE_PRIVATE_H
+#define IOTHUB_MESSAGE_PRIVATE_H
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+#include "iothub_message.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stddef.h>
+#endif
+
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromBorrowedByteArray, const unsigned char*, byteArray, size_t, size);
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_OwnContent, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOTHUB_MESSAGE_PRIVATE_H */
@@ -13,6 +13,7 @@ typedef union IOTHUB_IDENTITY_INFO_TAG IOTHUB_IDENTITY_INFO;
 
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "iothub_message.h"
 #include "internal/iothub_client_authorization.h"
 
@@ -64,6 +65,8 @@ extern "C"
     typedef int(*pfIoTHubTransport_Subscribe_DeviceMethod)(IOTHUB_DEVICE_HANDLE handle);
     typedef void(*pfIoTHubTransport_Unsubscribe_DeviceMethod)(IOTHUB_DEVICE_HANDLE handle);
     typedef int(*pfIoTHubTransport_DeviceMethod_Response)(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response);
+    /*optional, returns 0 and the ms left until the transport's next deadline (0 when it is already due) or non-zero when no deadline is armed*/
+    typedef int(*pfIoTHubTransport_GetTimeToNextDeadline)(TRANSPORT_LL_HANDLE handle, tickcounter_ms_t* msToNextDeadline);
 
 #define TRANSPORT_PROVIDER_FIELDS                                                   \
 pfIotHubTransport_SendMessageDisposition IoTHubTransport_SendMessageDisposition;  \
@@ -83,7 +86,8 @@ pfIoTHubTransport_Subscribe IoTHubTransport_Subscribe;
 pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;                          \
 pfIoTHubTransport_DoWork IoTHubTransport_DoWork;                                    \
 pfIoTHubTransport_SetRetryPolicy IoTHubTransport_SetRetryPolicy;                    \
-pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus  /*there's an intentional missing ; on this line*/
+pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus;                     \
+pfIoTHubTransport_GetTimeToNextDeadline IoTHubTransport_GetTimeToNextDeadline  /*there's an intentional missing ; on this line*/
 
     struct TRANSPORT_PROVIDER_TAG
     {
@@ -36,6 +36,13 @@ extern "C"
         AUTHENTICATION_ERROR_SAS_REFRESH_FAILED
     } AUTHENTICATION_ERROR_CODE;
 
+    // @brief    Limits how many SAS token refreshes can be in progress at once; shared by the devices of a transport.
+    typedef struct AUTHENTICATION_REFRESH_LIMIT_TAG
+    {
+        size_t max_refreshes_in_progress;
+        size_t refreshes_in_progress;
+    } AUTHENTICATION_REFRESH_LIMIT;
+
     typedef void(*ON_AUTHENTICATION_STATE_CHANGED_CALLBACK)(void* context, AUTHENTICATION_STATE previous_state, AUTHENTICATION_STATE new_state);
     typedef void(*ON_AUTHENTICATION_ERROR_CALLBACK)(void* context, AUTHENTICATION_ERROR_CODE error_code);
 
@@ -52,6 +59,8 @@ extern "C"
 
         IOTHUB_AUTHORIZATION_HANDLE authorization_module;                   // with either SAS Token, x509 Certs, and Device SAS Token
 
+        AUTHENTICATION_REFRESH_LIMIT* sas_token_refresh_limit;              // optional
+
     } AUTHENTICATION_CONFIG;
 
     typedef struct AUTHENTICATION_INSTANCE* AUTHENTICATION_HANDLE;
@@ -23,6 +23,10 @@ typedef struct AMQP_TRANSPORT_PROXY_OPTIONS_TAG
 
 typedef XIO_HANDLE(*AMQP_GET_IO_TRANSPORT)(const char* target_fqdn, const AMQP_TRANSPORT_PROXY_OPTIONS* amqp_transport_proxy_options);
 static const char* OPTION_EVENT_SEND_TIMEOUT_SECS = "event_send_timeout_secs";
+static const char* OPTION_EVENT_SENDER_LINK_COUNT = "event_sender_link_count";
+static const char* OPTION_EVENT_SEND_IN_ORDER = "event_send_in_order";
+static const char* OPTION_C2D_PREFETCH_COUNT = "c2d_prefetch_count";
+static const char* OPTION_C2D_ADAPTIVE_PREFETCH = "c2d_adaptive_prefetch";
 
 MOCKABLE_FUNCTION(, TRANSPORT_LL_HANDLE, IoTHubTransport_AMQP_Common_Create, const IOTHUBTRANSPORT_CONFIG*, config, AMQP_GET_IO_TRANSPORT, get_io_transport);
 MOCKABLE_FUNCTION(, void, IoTHubTransport_AMQP_Common_Destroy, TRANSPORT_LL_HANDLE, handle);
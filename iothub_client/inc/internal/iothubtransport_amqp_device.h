@@ -20,6 +20,10 @@ extern "C"
 // @brief    name of option to apply the instance obtained using device_retrieve_options
 static const char* DEVICE_OPTION_SAVED_OPTIONS = "saved_device_options";
 static const char* DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS = "event_send_timeout_secs";
+static const char* DEVICE_OPTION_EVENT_SENDER_LINK_COUNT = "event_sender_link_count";
+static const char* DEVICE_OPTION_EVENT_SEND_IN_ORDER = "event_send_in_order";
+static const char* DEVICE_OPTION_C2D_PREFETCH_COUNT = "c2d_prefetch_count";
+static const char* DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH = "c2d_adaptive_prefetch";
 static const char* DEVICE_OPTION_CBS_REQUEST_TIMEOUT_SECS = "cbs_request_timeout_secs";
 static const char* DEVICE_OPTION_SAS_TOKEN_REFRESH_TIME_SECS = "sas_token_refresh_time_secs";
 static const char* DEVICE_OPTION_SAS_TOKEN_LIFETIME_SECS = "sas_token_lifetime_secs";
@@ -101,6 +105,9 @@ typedef struct DEVICE_CONFIG_TAG
     // Auth module used to generating handle authorization
     // with either SAS Token, x509 Certs, and Device SAS Token
     IOTHUB_AUTHORIZATION_HANDLE authorization_module;
+
+    // Optional; shared by the devices of a transport to limit how many SAS token refreshes they do at once.
+    struct AUTHENTICATION_REFRESH_LIMIT_TAG* sas_token_refresh_limit;
 } DEVICE_CONFIG;
 
 typedef struct AMQP_DEVICE_INSTANCE* AMQP_DEVICE_HANDLE;
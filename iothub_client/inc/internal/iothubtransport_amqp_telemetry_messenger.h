@@ -20,6 +20,10 @@ extern "C"
 
 
 static const char* TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS = "telemetry_event_send_timeout_secs";
+static const char* TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT = "telemetry_event_sender_link_count";
+static const char* TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER = "telemetry_event_send_in_order";
+static const char* TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT = "telemetry_c2d_prefetch_count";
+static const char* TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH = "telemetry_c2d_adaptive_prefetch";
 static const char* TELEMETRY_MESSENGER_OPTION_SAVED_OPTIONS = "saved_telemetry_messenger_options";
 
 typedef struct TELEMETRY_MESSENGER_INSTANCE* TELEMETRY_MESSENGER_HANDLE;
@@ -75,6 +79,7 @@ typedef struct TELEMETRY_MESSENGER_CONFIG_TAG
 } TELEMETRY_MESSENGER_CONFIG;
 
 #define AMQP_BATCHING_RESERVE_SIZE              (1024)
+#define TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT   (8)
 
 MOCKABLE_FUNCTION(, TELEMETRY_MESSENGER_HANDLE, telemetry_messenger_create, const TELEMETRY_MESSENGER_CONFIG*, messenger_config, const char*, product_info);
 MOCKABLE_FUNCTION(, int, telemetry_messenger_send_async, TELEMETRY_MESSENGER_HANDLE, messenger_handle, IOTHUB_MESSAGE_LIST*, message, ON_TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE, on_messenger_event_send_complete_callback, void*, context);
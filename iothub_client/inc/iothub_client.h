@@ -126,6 +126,24 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Queues the @p eventMessageCount messages of @p eventMessageHandles for sending in one call.
+    *			Each message is cloned as by ::IoTHubClient_SendEventAsync and the whole batch is queued
+    *			at once and in order, so that transports that send several messages per request
+    *			pick it up together. If queuing any of the messages fails none of them is queued.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandles		   	Array of @p eventMessageCount IoT Hub message handles.
+    * @param	eventMessageCount		   	Number of messages in @p eventMessageHandles, at least 1.
+    * @param	eventConfirmationCallback  	The callback invoked once for every message of the batch,
+    * 										with the confirmation result of that message. This can be @c NULL.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_SendEventBatchAsync, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE*, eventMessageHandles, size_t, eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief	This function returns the current sending status for IoTHubClient.
     *
@@ -346,6 +364,17 @@ extern "C"
     */
     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_DeviceMethodResponse, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, METHOD_HANDLE, methodId, const unsigned char*, response, size_t, response_size, int, statusCode);
 
+    /**
+    * @brief	Retrieves the counters of the callback dispatch threads enabled with OPTION_CALLBACK_DISPATCH_THREADS.
+    *
+    * @param	iotHubClientHandle      The handle created by a call to the create function.
+    * @param	statistics              Receives the queue depth and application callback latency. All zero when the
+    *                                   callbacks are dispatched from the worker thread.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+    MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_GetCallbackDispatchStatistics, IOTHUB_CLIENT_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS*, statistics);
+
 #ifndef DONT_USE_UPLOADTOBLOB
     /**
     * @brief	IoTHubClient_UploadToBlobAsync uploads data from memory to a file in Azure Blob Storage.
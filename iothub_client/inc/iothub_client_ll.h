@@ -128,6 +128,42 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_CLIENT_LL_HANDLE;
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Same as ::IoTHubClient_LL_SendEventAsync, except that the message is not cloned: on success
+    *			@p eventMessageHandle is queued as is and belongs to the client, which destroys
+    *			it once it has been sent or has failed. The caller shall not use nor destroy the
+    *			handle afterwards. On failure the handle still belongs to the caller.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandle		   	The handle to an IoT Hub message.
+    * @param	eventConfirmationCallback  	The callback specified by the device for receiving
+    * 										confirmation of the delivery of the IoT Hub message.
+    * 										The message handle is no longer available to the callback.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventAsync_TakeOwnership, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE, eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
+    /**
+    * @brief	Queues the @p eventMessageCount messages of @p eventMessageHandles for sending in one call.
+    *			Each message is cloned as by ::IoTHubClient_LL_SendEventAsync and the whole batch is queued
+    *			at once and in order, so that transports that send several messages per request
+    *			pick it up together. If queuing any of the messages fails none of them is queued.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	eventMessageHandles		   	Array of @p eventMessageCount IoT Hub message handles.
+    * @param	eventMessageCount		   	Number of messages in @p eventMessageHandles, at least 1.
+    * @param	eventConfirmationCallback  	The callback invoked once for every message of the batch,
+    * 										with the confirmation result of that message. This can be @c NULL.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SendEventBatchAsync, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_MESSAGE_HANDLE*, eventMessageHandles, size_t, eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, eventConfirmationCallback, void*, userContextCallback);
+
     /**
     * @brief	This function returns the current sending status for IoTHubClient.
     *
@@ -159,6 +195,47 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG* IOTHUB_CLIENT_LL_HANDLE;
     */
      MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback);
 
+    /**
+    * @brief	Same as ::IoTHubClient_LL_SetMessageCallback, except that the message passed to
+    *			@p messageCallback borrows its payload from the transport instead of copying it.
+    *			The message is read-only and only valid until the callback returns. To keep it
+    *			longer, call ::IoTHubMessage_Retain from within the callback and
+    *			::IoTHubMessage_Destroy once done with it. Use the same function with a @c NULL
+    *			@p messageCallback to unsubscribe.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	messageCallback     	   	The callback specified by the device for receiving
+    * 										messages from IoT Hub.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubClient_LL_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageViewCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC, messageCallback, void*, userContextCallback);
+
+    /**
+    * @brief	Sets up the callback told the outcome of the dispositions the transport sends
+    *			after completing them. Only the HTTP transport with "http_disposition_batch_size"
+    *			set defers dispositions; the callback then gets every message whose disposition
+    *			was queued, once its request is done with, and @p result tells whether it
+    *			reached the service. The message is only valid until the callback returns.
+    *			When no callback is set, the dispositions that fail are logged.
+    *
+    * @param	iotHubClientHandle		   	The handle created by a call to the create function.
+    * @param	dispositionCallback			The callback, or @c NULL to remove it.
+    * @param	userContextCallback			User specified context that will be provided to the
+    * 										callback. This can be @c NULL.
+    *
+    *			@b NOTE: The application behavior is undefined if the user calls
+    *			the ::IoTHubClient_LL_Destroy function from within any callback.
+    *
+    * @return	IOTHUB_CLIENT_OK upon success or an error code upon failure.
+    */
+     MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, IoTHubClient_LL_SetMessageDispositionCallback, IOTHUB_CLIENT_LL_HANDLE, iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_DISPOSITION_CALLBACK, dispositionCallback, void*, userContextCallback);
+
     /**
     * @brief	Sets up the connection status callback to be invoked representing the status of
     * the connection to IOT Hub. This is a blocking call.
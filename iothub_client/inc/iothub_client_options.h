@@ -66,6 +66,100 @@ extern "C"
     //diagnostic sampling percentage value, [0-100]
     static STATIC_VAR_UNUSED const char* OPTION_DIAGNOSTIC_SAMPLING_PERCENTAGE = "diag_sampling_percentage";
 
+    /*
+    * @brief    Maximum time, in milliseconds, the convenience layer worker thread stays idle between two calls to DoWork when
+    *           there is nothing queued or in flight. Sending an event, a reported state, a method response or a message
+    *           disposition wakes the thread immediately regardless of this value; it bounds how late inbound traffic is noticed
+    *           by an idle client (C2D messages, direct methods, desired properties, connection status). Keep it well below
+    *           the transport keep-alive interval.
+    *           The default value is 1 ms. Only valid for use with the convenience layer (IoTHubClient_SetOption).
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_DO_WORK_FREQUENCY_IN_MS = "do_work_freq_ms";
+
+    /*
+    * @brief    Number of threads (size_t) that run the application callbacks instead of the thread calling DoWork, so a slow
+    *           message or method handler does not hold up the transport. Callbacks of the same kind are still delivered in
+    *           order, one at a time. Can only be set once per client; 0 keeps dispatching on the worker thread (default).
+    *           Only valid for use with the convenience layer (IoTHubClient_SetOption).
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_CALLBACK_DISPATCH_THREADS = "callback_dispatch_threads";
+
+    /*
+    * @brief    Most callbacks (size_t) waiting for a dispatch thread. Once reached, further callbacks stay with the client
+    *           and are handed over as the queue drains. The default value is 128.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_CALLBACK_DISPATCH_QUEUE_SIZE = "callback_dispatch_queue_size";
+
+    /*
+    * @brief    Capacity (size_t, rounded up to a power of 2) of a lock-free queue in front of the device client. When set,
+    *           IoTHubClient_SendEventAsync clones the message into the queue without taking the client lock and the worker
+    *           thread moves the queued events to the transport at the start of every DoWork; when the queue is full the
+    *           call falls back to the lock. Can only be set once per client, before sending; 0 (default) disables the queue.
+    *           Only valid for use with the convenience layer (IoTHubClient_SetOption).
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_EVENT_INGESTION_QUEUE_SIZE = "event_ingestion_queue_size";
+
+    /*
+    * @brief    Number of messages (size_t) the client reserves room for up front. Queued messages, and the MQTT transport's
+    *           in-flight records, are then taken from per-client pools that grow in slabs and never give memory back to the
+    *           heap, so steady-state sending makes no heap call for them. 0 (default) allocates every record with malloc.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MESSAGE_POOL_SIZE = "message_pool_size";
+
+    /*
+    * @brief    Flow control of the MQTT telemetry publishes waiting for their PUBACK. "max_inflight_messages" (size_t) and
+    *           "max_inflight_bytes" (size_t) cap the number and the payload bytes of those publishes; the messages beyond
+    *           the window stay queued, in order, until PUBACKs make room. 0 (default) means no limit.
+    *           "adaptive_inflight" (bool) sizes the window from the PUBACK round trips instead: it grows while acks come
+    *           back as fast as the fastest seen on the connection and halves when they slow down or time out,
+    *           never going over "max_inflight_messages" when that is set. Only used by the MQTT transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_INFLIGHT_MESSAGES = "max_inflight_messages";
+    static STATIC_VAR_UNUSED const char* OPTION_MAX_INFLIGHT_BYTES = "max_inflight_bytes";
+    static STATIC_VAR_UNUSED const char* OPTION_ADAPTIVE_INFLIGHT = "adaptive_inflight";
+
+    /*
+    * @brief    Number of HTTP requests (size_t) the HTTP transport has on the wire at the same time. With more than 1, every
+    *           DoWork prepares the event post and C2D poll of all the registered devices, runs them over that many keep-alive
+    *           connections, then delivers the outcomes on the DoWork thread. 1 (default) sends them one after the other.
+    *           Can only be set once, before any other option that goes down to the HTTP layer (e.g. "TrustedCerts").
+    *           Only used by the HTTP transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_MAX_CONCURRENT_REQUESTS = "http_max_concurrent_requests";
+
+    /*
+    * @brief    Adaptive C2D polling of the HTTP transport. "http_adaptive_polling_min_time" (unsigned int, seconds) is the
+    *           shortest interval between two polls of a device: a device is polled again that soon after receiving a
+    *           message, and every empty poll doubles its interval, with random jitter, up to "MinimumPollingTime".
+    *           0 (default) polls every "MinimumPollingTime" seconds. "http_poll_now" (bool) set to true polls all the
+    *           devices of the transport on the next DoWork and restarts their backoff. Only used by the HTTP transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_ADAPTIVE_POLLING_MIN_TIME = "http_adaptive_polling_min_time";
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_POLL_NOW = "http_poll_now";
+
+    /*
+    * @brief    Deferred C2D dispositions of the HTTP transport. With "http_disposition_batch_size" (size_t) not 0, completing,
+    *           abandoning or rejecting a message only queues the request; the queue is sent at the end of DoWork once it
+    *           holds that many dispositions, or once the oldest has waited "http_disposition_batch_window_ms" (size_t)
+    *           milliseconds, over "http_max_concurrent_requests" connections. Failures are logged per message. Keep the
+    *           window well below the message lock timeout of the hub. 0 (default) sends every disposition as it comes.
+    *           Only used by the HTTP transport.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_DISPOSITION_BATCH_SIZE = "http_disposition_batch_size";
+    static STATIC_VAR_UNUSED const char* OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS = "http_disposition_batch_window_ms";
+
+    /*
+    * @brief    Parallel upload to blob. "blob_upload_concurrency" (size_t) is the number of blocks put to storage at the same
+    *           time, each over its own connection, while up to twice as many are read ahead from the get data callback; a
+    *           block that fails is retried on its own and the block list is committed in order once all are uploaded.
+    *           "blob_upload_block_size" (size_t, at most 4MB) is the size of the blocks: IoTHubClient_LL_UploadToBlob splits
+    *           the source in blocks of that size, and the chunks returned by the get data callback are put together up to it.
+    *           1 and 0 (defaults) upload the chunks one after the other, as they come. Built with DONT_USE_HTTP_WORKER_THREADS,
+    *           "blob_upload_concurrency" cannot be more than 1 and "blob_upload_block_size" only splits the source.
+    */
+    static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_CONCURRENCY = "blob_upload_concurrency";
+    static STATIC_VAR_UNUSED const char* OPTION_BLOB_UPLOAD_BLOCK_SIZE = "blob_upload_block_size";
+
 #ifdef __cplusplus
 }
 #endif
@@ -88,6 +88,21 @@ MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_CreateFromString, const
 */
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_HANDLE, IoTHubMessage_Clone, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
 
+/**
+* @brief   Keeps a message alive past the callback it was received in. A
+*          message passed to a message view callback borrows its payload
+*          from the transport and is only valid until the callback returns;
+*          retaining it copies the payload once and adds a reference to the
+*          same handle, which the caller releases with ::IoTHubMessage_Destroy.
+*          Retaining any other message only adds the reference.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @return  Returns IOTHUB_MESSAGE_OK if the message was retained or an error
+*          code otherwise.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_Retain, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle);
+
 /**
 * @brief   Fetches a pointer and size for the data associated with the IoT
 *          hub message handle. If the content type of the message is not
@@ -202,6 +217,26 @@ MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetProperty, IOTHUB_MES
 */
 MOCKABLE_FUNCTION(, const char*, IoTHubMessage_GetProperty, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char*, key);
 
+/**
+* @brief   Gets all the properties of a IotHub Message at once, without copying them.
+*
+* @param   iotHubMessageHandle Handle to the message.
+*
+* @param   keys receives the names of the properties.
+*
+* @param   values receives the values of the properties, in the same order as @p keys.
+*
+* @param   count receives the number of properties.
+*
+* @param   keysAndValuesLength if not NULL, receives the length of all the names and values, terminators not included.
+*
+* @remarks The arrays belong to the message and are only valid until its properties are next modified or it is destroyed.
+*          Unlike IoTHubMessage_Properties, this does not give the message its own copy of properties it shares with a clone.
+*
+* @return  An @c IOTHUB_MESSAGE_RESULT value indicating the result of getting the properties.
+*/
+MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_GetProperties, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const char* const**, keys, const char* const**, values, size_t*, count, size_t*, keysAndValuesLength);
+
 /**
 * @brief   Gets the MessageId from the IOTHUB_MESSAGE_HANDLE.
 *
@@ -263,7 +298,8 @@ MOCKABLE_FUNCTION(, const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA*, IoTHubMessag
 MOCKABLE_FUNCTION(, IOTHUB_MESSAGE_RESULT, IoTHubMessage_SetDiagnosticPropertyData, IOTHUB_MESSAGE_HANDLE, iotHubMessageHandle, const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA*, diagnosticData);
 
 /**
-* @brief   Frees all resources associated with the given message handle.
+* @brief   Frees all resources associated with the given message handle,
+*          once every reference added by ::IoTHubMessage_Retain is released.
 *
 * @param   iotHubMessageHandle Handle to the message.
 */
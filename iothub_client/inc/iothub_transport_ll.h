@@ -33,6 +33,16 @@ MOCKABLE_FUNCTION(, TRANSPORT_HANDLE, IoTHubTransport_Create, IOTHUB_CLIENT_TRAN
 MOCKABLE_FUNCTION(, void, IoTHubTransport_Destroy, TRANSPORT_HANDLE, transportHandle);
 MOCKABLE_FUNCTION(, TRANSPORT_LL_HANDLE, IoTHubTransport_GetLLTransport, TRANSPORT_HANDLE, transportHandle);
 
+/**
+* @brief    Sets the number of threads servicing the clients sharing @p transportHandle. With 0 (the default) the transport
+*           worker thread services every client after each DoWork. With N > 0 the clients are sharded across N threads
+*           (idle threads steal clients from busy shards) and the transport worker thread only runs the transport DoWork.
+*           Needs to be called before the first client starts using the transport.
+*
+* @return   0 on success, non-zero otherwise.
+*/
+MOCKABLE_FUNCTION(, int, IoTHubTransport_SetClientWorkerThreadCount, TRANSPORT_HANDLE, transportHandle, size_t, workerThreadCount);
+
 #ifdef __cplusplus
 }
 #endif
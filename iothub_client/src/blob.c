@@ -11,6 +11,61 @@
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/strings.h"
+
+/*DONT_USE_HTTP_WORKER_THREADS leaves out Blob_UploadMultipleBlocksInParallelFromSasUri, the only user of threads and conditions here*/
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+/*a block that cannot be uploaded because of the network or a 5xx from storage is tried this many times in total*/
+#define BLOB_BLOCK_UPLOAD_ATTEMPTS 3
+#define BLOB_BLOCK_RETRY_DELAY_MS 1000
+
+typedef struct BLOB_BLOCK_TAG
+{
+    BUFFER_HANDLE content;      /*NULL once a worker has taken the block, the worker then owns the content*/
+    STRING_HANDLE blockIDXml;   /*the <Latest> element of the block in the block list*/
+} BLOB_BLOCK;
+
+typedef struct BLOB_UPLOAD_WORKER_TAG
+{
+    struct BLOB_PARALLEL_UPLOAD_TAG* upload;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*a HTTPAPIEX_HANDLE is not shared between threads, so every worker keeps its own connection*/
+    BUFFER_HANDLE httpResponse;
+    THREAD_HANDLE thread;
+} BLOB_UPLOAD_WORKER;
+
+typedef struct BLOB_PARALLEL_UPLOAD_TAG
+{
+    const char* relativePath;
+    LOCK_HANDLE lock;
+    COND_HANDLE blockQueued;
+    COND_HANDLE blockUploaded;
+    VECTOR_HANDLE blocks;       /*of BLOB_BLOCK, the index of a block is its block ID*/
+    size_t nextBlock;           /*first block not taken by a worker yet*/
+    size_t uploadedBlocks;      /*blocks taken by a worker and done with, successfully or not*/
+    int cancelled;              /*no more block is taken once a block failed or the reading stopped*/
+    int blockFailed;
+    BLOB_RESULT failureResult;
+    unsigned int* httpStatus;
+    BUFFER_HANDLE httpResponse;
+    BLOB_UPLOAD_WORKER* workers; /*workers[0] is the calling thread, the others run their own thread*/
+    size_t workerCount;
+    int stop;
+} BLOB_PARALLEL_UPLOAD;
+
+typedef struct BLOB_BLOCK_READER_TAG
+{
+    IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx;
+    void* context;
+    size_t blockSize;
+    BUFFER_HANDLE partialBlock; /*data read from getDataCallbackEx that does not make a full block yet*/
+    int endOfData;
+} BLOB_BLOCK_READER;
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
 
 BLOB_RESULT Blob_UploadBlock(
         HTTPAPIEX_HANDLE httpApiExHandle,
@@ -379,3 +434,631 @@ BLOB_RESULT Blob_UploadMultipleBlocksFromSasUri(const char* SASURI, IOTHUB_CLIEN
     }
     return result;
 }
+
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/*splits SASURI in a copy of its hostname, to be freed by the caller, and the relative path of the requests*/
+static BLOB_RESULT get_sas_uri_hostname(const char* SASURI, char** hostname, const char** relativePath)
+{
+    BLOB_RESULT result;
+    const char* hostnameBegin = strstr(SASURI, "://");
+    const char* hostnameEnd = (hostnameBegin == NULL) ? NULL : strchr(hostnameBegin + 3, '/');
+
+    if (hostnameEnd == NULL)
+    {
+        /*Codes_SRS_BLOB_31_002: [ If the hostname cannot be determined, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+        LogError("hostname cannot be determined");
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        size_t hostnameSize;
+        hostnameBegin += 3; /*have to skip 3 characters which are "://"*/
+        hostnameSize = hostnameEnd - hostnameBegin;
+        if ((*hostname = (char*)malloc(hostnameSize + 1)) == NULL)
+        {
+            LogError("oom - out of memory");
+            result = BLOB_ERROR;
+        }
+        else
+        {
+            (void)memcpy(*hostname, hostnameBegin, hostnameSize);
+            (*hostname)[hostnameSize] = '\0';
+            *relativePath = hostnameEnd;
+            result = BLOB_OK;
+        }
+    }
+    return result;
+}
+
+static HTTPAPIEX_HANDLE create_storage_connection(const char* hostname, const char* certificates, HTTP_PROXY_OPTIONS* proxyOptions)
+{
+    HTTPAPIEX_HANDLE result = HTTPAPIEX_Create(hostname);
+    if (result == NULL)
+    {
+        LogError("unable to create a HTTPAPIEX_HANDLE");
+    }
+    else if ((certificates != NULL) && (HTTPAPIEX_SetOption(result, "TrustedCerts", certificates) == HTTPAPIEX_ERROR))
+    {
+        LogError("failure in setting trusted certificates");
+        HTTPAPIEX_Destroy(result);
+        result = NULL;
+    }
+    else if ((proxyOptions != NULL && proxyOptions->host_address != NULL) && HTTPAPIEX_SetOption(result, OPTION_HTTP_PROXY, proxyOptions) == HTTPAPIEX_ERROR)
+    {
+        LogError("failure in setting proxy options");
+        HTTPAPIEX_Destroy(result);
+        result = NULL;
+    }
+    return result;
+}
+
+/*reads the next block to upload, made of the chunks returned by getDataCallbackEx for as long as they fit in blockSize. *block is NULL once all the data has been read*/
+static BLOB_RESULT read_next_block(BLOB_BLOCK_READER* reader, BUFFER_HANDLE* block)
+{
+    BLOB_RESULT result = BLOB_OK;
+    *block = NULL;
+
+    while ((result == BLOB_OK) && (*block == NULL) && !(reader->endOfData && (reader->partialBlock == NULL)))
+    {
+        if (reader->endOfData)
+        {
+            *block = reader->partialBlock;
+            reader->partialBlock = NULL;
+        }
+        else
+        {
+            unsigned char const * source;
+            size_t size;
+
+            if (reader->getDataCallbackEx(FILE_UPLOAD_OK, &source, &size, reader->context) == IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_ABORT)
+            {
+                /*Codes_SRS_BLOB_31_006: [ If getDataCallbackEx returns IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_ABORT then Blob_UploadMultipleBlocksInParallelFromSasUri shall stop reading and return BLOB_ABORTED once the blocks on the wire are done with. ]*/
+                LogInfo("Upload to blob has been aborted by the user");
+                result = BLOB_ABORTED;
+            }
+            else if ((source == NULL) || (size == 0))
+            {
+                /*Codes_SRS_BLOB_31_007: [ If the size of the data returned by getDataCallbackEx is 0 or if the data is NULL, then Blob_UploadMultipleBlocksInParallelFromSasUri shall stop reading, the data already read making the last block. ]*/
+                reader->endOfData = 1;
+            }
+            else if (size > BLOCK_SIZE)
+            {
+                /*Codes_SRS_BLOB_31_008: [ If the size of the data returned by getDataCallbackEx is bigger than 4MB, or if there are more than 50000 blocks, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+                LogError("tried to upload block of size %zu, max allowed size is %d", size, BLOCK_SIZE);
+                result = BLOB_INVALID_ARG;
+            }
+            else if ((reader->partialBlock != NULL) && (BUFFER_length(reader->partialBlock) + size <= reader->blockSize))
+            {
+                size_t length = BUFFER_length(reader->partialBlock);
+                if (BUFFER_enlarge(reader->partialBlock, size) != 0)
+                {
+                    LogError("unable to BUFFER_enlarge");
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    (void)memcpy(BUFFER_u_char(reader->partialBlock) + length, source, size);
+                }
+            }
+            else
+            {
+                /*the data is copied right away, getDataCallbackEx does not have to keep it past the next call*/
+                BUFFER_HANDLE chunk = BUFFER_create(source, size);
+                if (chunk == NULL)
+                {
+                    LogError("unable to BUFFER_create");
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    /*the chunk does not fit in the partial block, which is then complete*/
+                    *block = reader->partialBlock;
+                    reader->partialBlock = chunk;
+                }
+            }
+
+            if ((result == BLOB_OK) && (*block == NULL) && (reader->partialBlock != NULL) && (BUFFER_length(reader->partialBlock) >= reader->blockSize))
+            {
+                *block = reader->partialBlock;
+                reader->partialBlock = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+/*uploads one block over the connection of the worker, trying again when the request could not be executed or when storage answered with a 5xx*/
+static BLOB_RESULT upload_block(BLOB_UPLOAD_WORKER* worker, unsigned int blockID, BUFFER_HANDLE content, STRING_HANDLE blockIDXml, unsigned int* httpStatus)
+{
+    BLOB_RESULT result = BLOB_ERROR;
+    size_t attempt;
+
+    for (attempt = 1; attempt <= BLOB_BLOCK_UPLOAD_ATTEMPTS; attempt++)
+    {
+        /*Blob_UploadBlock appends the <Latest> element of the block, a failed attempt may have left part of it*/
+        if ((attempt > 1) && (STRING_empty(blockIDXml) != 0))
+        {
+            LogError("unable to STRING_empty");
+            result = BLOB_ERROR;
+            break;
+        }
+
+        /*Codes_SRS_BLOB_31_010: [ Every block shall be uploaded by calling Blob_UploadBlock with the connection of the worker that took it. ]*/
+        result = Blob_UploadBlock(worker->httpApiExHandle, worker->upload->relativePath, content, blockID, blockIDXml, httpStatus, worker->httpResponse);
+        if ((result != BLOB_HTTP_ERROR) && !((result == BLOB_OK) && (*httpStatus >= 500)))
+        {
+            break;
+        }
+        else if (attempt < BLOB_BLOCK_UPLOAD_ATTEMPTS)
+        {
+            /*Codes_SRS_BLOB_31_011: [ If Blob_UploadBlock returns BLOB_HTTP_ERROR, or an HTTP status of 500 or more, the block shall be uploaded again, up to 3 attempts in total, waiting longer after each attempt. ]*/
+            LogError("upload of block %u failed (result=%d, httpStatus=%u), trying again", blockID, result, *httpStatus);
+            ThreadAPI_Sleep((unsigned int)(BLOB_BLOCK_RETRY_DELAY_MS * attempt));
+        }
+    }
+    return result;
+}
+
+/*takes the next queued block and uploads it. Called with the lock taken, returns with it taken. Returns 0 when there was no block to take.*/
+static int upload_next_block(BLOB_UPLOAD_WORKER* worker)
+{
+    BLOB_PARALLEL_UPLOAD* upload = worker->upload;
+    int result;
+
+    if ((upload->cancelled) || (upload->nextBlock >= VECTOR_size(upload->blocks)))
+    {
+        result = 0;
+    }
+    else
+    {
+        unsigned int blockID = (unsigned int)upload->nextBlock;
+        BLOB_BLOCK* block = (BLOB_BLOCK*)VECTOR_element(upload->blocks, upload->nextBlock);
+        BUFFER_HANDLE content = block->content;
+        STRING_HANDLE blockIDXml = block->blockIDXml;
+        unsigned int httpStatus = 0;
+        BLOB_RESULT blockResult;
+
+        block->content = NULL;
+        upload->nextBlock++;
+        (void)Unlock(upload->lock);
+
+        blockResult = upload_block(worker, blockID, content, blockIDXml, &httpStatus);
+        BUFFER_delete(content);
+
+        while (Lock(upload->lock) != LOCK_OK)
+        {
+            LogError("failed locking the blob upload, retrying");
+            ThreadAPI_Sleep(1);
+        }
+
+        if (((blockResult != BLOB_OK) || (httpStatus >= 300)) && !upload->blockFailed)
+        {
+            /*Codes_SRS_BLOB_31_012: [ If a block still fails, no further block shall be taken and, once the blocks on the wire are done with, Blob_UploadMultipleBlocksInParallelFromSasUri shall return BLOB_OK with the HTTP status and response of that block when storage answered it, the result of Blob_UploadBlock otherwise. ]*/
+            LogError("unable to upload block %u. Returned value=%d, httpStatus=%u", blockID, blockResult, httpStatus);
+            upload->blockFailed = 1;
+            upload->cancelled = 1;
+            upload->failureResult = blockResult;
+            *(upload->httpStatus) = httpStatus;
+            if ((blockResult == BLOB_OK) && (BUFFER_build(upload->httpResponse, BUFFER_u_char(worker->httpResponse), BUFFER_length(worker->httpResponse)) != 0))
+            {
+                LogError("unable to BUFFER_build");
+            }
+        }
+        upload->uploadedBlocks++;
+        (void)Condition_Post(upload->blockUploaded);
+        result = 1;
+    }
+    return result;
+}
+
+static int blob_upload_worker_thread(void* threadArgument)
+{
+    BLOB_UPLOAD_WORKER* worker = (BLOB_UPLOAD_WORKER*)threadArgument;
+    BLOB_PARALLEL_UPLOAD* upload = worker->upload;
+
+    if (Lock(upload->lock) != LOCK_OK)
+    {
+        LogError("failed locking for blob_upload_worker_thread");
+    }
+    else
+    {
+        while (upload->stop == 0)
+        {
+            if ((upload_next_block(worker) == 0) && (upload->stop == 0) && (Condition_Wait(upload->blockQueued, upload->lock, 0) == COND_ERROR))
+            {
+                LogError("Condition_Wait failed");
+            }
+        }
+        (void)Unlock(upload->lock);
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+/*stops and joins the worker threads, then releases the connections and the blocks that were not uploaded*/
+static void destroy_parallel_upload(BLOB_PARALLEL_UPLOAD* upload)
+{
+    size_t index;
+
+    if (upload->workerCount > 1)
+    {
+        if (Lock(upload->lock) != LOCK_OK)
+        {
+            LogError("unable to Lock - - will still proceed to try to end the threads without locking");
+        }
+        upload->stop = 1;
+        for (index = 1; index < upload->workerCount; index++)
+        {
+            (void)Condition_Post(upload->blockQueued);
+        }
+        (void)Unlock(upload->lock);
+
+        for (index = 1; index < upload->workerCount; index++)
+        {
+            int res;
+            if (ThreadAPI_Join(upload->workers[index].thread, &res) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Join failed");
+            }
+        }
+    }
+
+    for (index = 0; index < upload->workerCount; index++)
+    {
+        HTTPAPIEX_Destroy(upload->workers[index].httpApiExHandle);
+        BUFFER_delete(upload->workers[index].httpResponse);
+    }
+
+    for (index = 0; index < VECTOR_size(upload->blocks); index++)
+    {
+        BLOB_BLOCK* block = (BLOB_BLOCK*)VECTOR_element(upload->blocks, index);
+        if (block->content != NULL)
+        {
+            BUFFER_delete(block->content);
+        }
+        STRING_delete(block->blockIDXml);
+    }
+
+    VECTOR_destroy(upload->blocks);
+    free(upload->workers);
+    Condition_Deinit(upload->blockUploaded);
+    Condition_Deinit(upload->blockQueued);
+    Lock_Deinit(upload->lock);
+    free(upload);
+}
+
+static BLOB_PARALLEL_UPLOAD* create_parallel_upload(const char* hostname, const char* relativePath, const char* certificates, HTTP_PROXY_OPTIONS* proxyOptions, size_t workerCount, unsigned int* httpStatus, BUFFER_HANDLE httpResponse)
+{
+    BLOB_PARALLEL_UPLOAD* result;
+
+    if ((result = (BLOB_PARALLEL_UPLOAD*)malloc(sizeof(BLOB_PARALLEL_UPLOAD))) == NULL)
+    {
+        LogError("failed allocating the blob upload");
+    }
+    else
+    {
+        (void)memset(result, 0, sizeof(BLOB_PARALLEL_UPLOAD));
+        result->relativePath = relativePath;
+        result->httpStatus = httpStatus;
+        result->httpResponse = httpResponse;
+
+        if (((result->lock = Lock_Init()) == NULL) ||
+            ((result->blockQueued = Condition_Init()) == NULL) ||
+            ((result->blockUploaded = Condition_Init()) == NULL) ||
+            ((result->blocks = VECTOR_create(sizeof(BLOB_BLOCK))) == NULL) ||
+            ((result->workers = (BLOB_UPLOAD_WORKER*)malloc(workerCount * sizeof(BLOB_UPLOAD_WORKER))) == NULL))
+        {
+            LogError("failed creating the blob upload resources");
+            if (result->blocks != NULL)
+            {
+                VECTOR_destroy(result->blocks);
+            }
+            if (result->blockUploaded != NULL)
+            {
+                Condition_Deinit(result->blockUploaded);
+            }
+            if (result->blockQueued != NULL)
+            {
+                Condition_Deinit(result->blockQueued);
+            }
+            if (result->lock != NULL)
+            {
+                Lock_Deinit(result->lock);
+            }
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            size_t index;
+            for (index = 0; index < workerCount; index++)
+            {
+                BLOB_UPLOAD_WORKER* worker = &(result->workers[index]);
+                worker->upload = result;
+                /*Codes_SRS_BLOB_31_003: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall create maxConcurrentBlocks connections to the hostname by calling HTTPAPIEX_Create, passing them certificates and proxyOptions, and start maxConcurrentBlocks - 1 worker threads, the calling thread being the last worker. ]*/
+                if ((worker->httpApiExHandle = create_storage_connection(hostname, certificates, proxyOptions)) == NULL)
+                {
+                    LogError("failed creating the connection of blob upload worker %lu", (unsigned long)index);
+                    break;
+                }
+                else if ((worker->httpResponse = BUFFER_new()) == NULL)
+                {
+                    LogError("failed creating the response buffer of blob upload worker %lu", (unsigned long)index);
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                    break;
+                }
+                else if ((index > 0) && (ThreadAPI_Create(&(worker->thread), blob_upload_worker_thread, worker) != THREADAPI_OK))
+                {
+                    LogError("failed creating blob upload worker thread %lu", (unsigned long)index);
+                    BUFFER_delete(worker->httpResponse);
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                    break;
+                }
+            }
+            result->workerCount = index;
+
+            if (index < workerCount)
+            {
+                destroy_parallel_upload(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*reads the blocks on the calling thread and queues them for the workers, the calling thread uploading blocks itself whenever the read-ahead window is full.
+Returns once every block taken by a worker is done with. Called with the lock taken, returns with it taken.*/
+static BLOB_RESULT queue_and_upload_blocks(BLOB_PARALLEL_UPLOAD* upload, BLOB_BLOCK_READER* reader, size_t maxPendingBlocks)
+{
+    BLOB_RESULT result = BLOB_OK;
+    int allBlocksRead = 0;
+
+    while ((result == BLOB_OK) && !allBlocksRead && !upload->cancelled)
+    {
+        /*Codes_SRS_BLOB_31_009: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall read ahead at most 2 * maxConcurrentBlocks blocks that are not uploaded yet; when that many are pending, the calling thread shall upload the next queued block, or wait for a worker to finish one. ]*/
+        if (VECTOR_size(upload->blocks) - upload->uploadedBlocks >= maxPendingBlocks)
+        {
+            if ((upload_next_block(&(upload->workers[0])) == 0) && (Condition_Wait(upload->blockUploaded, upload->lock, 0) == COND_ERROR))
+            {
+                LogError("Condition_Wait failed");
+            }
+        }
+        else
+        {
+            BUFFER_HANDLE content;
+
+            /*Codes_SRS_BLOB_31_005: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall read the data from getDataCallbackEx on the calling thread, appending it to the current block for as long as the block does not exceed blockSize; with blockSize 0 every piece of data returned by getDataCallbackEx is a block. ]*/
+            (void)Unlock(upload->lock);
+            result = read_next_block(reader, &content);
+            while (Lock(upload->lock) != LOCK_OK)
+            {
+                LogError("failed locking the blob upload, retrying");
+                ThreadAPI_Sleep(1);
+            }
+
+            if (result != BLOB_OK)
+            {
+                upload->cancelled = 1;
+            }
+            else if (content == NULL)
+            {
+                allBlocksRead = 1;
+            }
+            else if (VECTOR_size(upload->blocks) >= MAX_BLOCK_COUNT)
+            {
+                /*Codes_SRS_BLOB_31_008: [ If the size of the data returned by getDataCallbackEx is bigger than 4MB, or if there are more than 50000 blocks, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+                LogError("unable to upload more than %d blocks in one blob", MAX_BLOCK_COUNT);
+                BUFFER_delete(content);
+                upload->cancelled = 1;
+                result = BLOB_INVALID_ARG;
+            }
+            else
+            {
+                BLOB_BLOCK block;
+                block.content = content;
+                if ((block.blockIDXml = STRING_new()) == NULL)
+                {
+                    LogError("unable to STRING_new");
+                    BUFFER_delete(content);
+                    upload->cancelled = 1;
+                    result = BLOB_ERROR;
+                }
+                else if (VECTOR_push_back(upload->blocks, &block, 1) != 0)
+                {
+                    LogError("unable to VECTOR_push_back");
+                    STRING_delete(block.blockIDXml);
+                    BUFFER_delete(content);
+                    upload->cancelled = 1;
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    (void)Condition_Post(upload->blockQueued);
+                }
+            }
+        }
+    }
+
+    /*the calling thread takes its share of the blocks left, then waits for the ones still on the wire*/
+    while ((upload->uploadedBlocks < upload->nextBlock) || (!upload->cancelled && (upload->nextBlock < VECTOR_size(upload->blocks))))
+    {
+        if ((upload_next_block(&(upload->workers[0])) == 0) && (Condition_Wait(upload->blockUploaded, upload->lock, 0) == COND_ERROR))
+        {
+            LogError("Condition_Wait failed");
+        }
+    }
+
+    return result;
+}
+
+/*commits the uploaded blocks, in the order of their block IDs, with a Put Block List request*/
+static BLOB_RESULT put_block_list(BLOB_PARALLEL_UPLOAD* upload)
+{
+    BLOB_RESULT result;
+    /*Codes_SRS_BLOB_31_013: [ Once all the blocks are uploaded, Blob_UploadMultipleBlocksInParallelFromSasUri shall construct the XML block list with the block IDs in ascending order and PUT it to base relativePath + "&comp=blocklist" over the connection of the calling thread, passing httpStatus and httpResponse. ]*/
+    STRING_HANDLE blockIDList = STRING_construct("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n<BlockList>");
+    if (blockIDList == NULL)
+    {
+        /*Codes_SRS_BLOB_31_015: [ If any other operation fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+        LogError("failed to STRING_construct");
+        result = BLOB_ERROR;
+    }
+    else
+    {
+        size_t blockCount = VECTOR_size(upload->blocks);
+        size_t index;
+        for (index = 0; index < blockCount; index++)
+        {
+            BLOB_BLOCK* block = (BLOB_BLOCK*)VECTOR_element(upload->blocks, index);
+            if (STRING_concat_with_STRING(blockIDList, block->blockIDXml) != 0)
+            {
+                break;
+            }
+        }
+
+        if ((index < blockCount) || (STRING_concat(blockIDList, "</BlockList>") != 0))
+        {
+            /*Codes_SRS_BLOB_31_015: [ If any other operation fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+            LogError("failed to STRING_concat");
+            result = BLOB_ERROR;
+        }
+        else
+        {
+            STRING_HANDLE newRelativePath = STRING_construct(upload->relativePath);
+            if (newRelativePath == NULL)
+            {
+                /*Codes_SRS_BLOB_31_015: [ If any other operation fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+                LogError("failed to STRING_construct");
+                result = BLOB_ERROR;
+            }
+            else
+            {
+                const char* s = STRING_c_str(blockIDList);
+                BUFFER_HANDLE blockIDListAsBuffer;
+                if (STRING_concat(newRelativePath, "&comp=blocklist") != 0)
+                {
+                    /*Codes_SRS_BLOB_31_015: [ If any other operation fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+                    LogError("failed to STRING_concat");
+                    result = BLOB_ERROR;
+                }
+                else if ((blockIDListAsBuffer = BUFFER_create((const unsigned char*)s, strlen(s))) == NULL)
+                {
+                    /*Codes_SRS_BLOB_31_015: [ If any other operation fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+                    LogError("failed to BUFFER_create");
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    if (HTTPAPIEX_ExecuteRequest(
+                        upload->workers[0].httpApiExHandle,
+                        HTTPAPI_REQUEST_PUT,
+                        STRING_c_str(newRelativePath),
+                        NULL,
+                        blockIDListAsBuffer,
+                        upload->httpStatus,
+                        NULL,
+                        upload->httpResponse
+                    ) != HTTPAPIEX_OK)
+                    {
+                        /*Codes_SRS_BLOB_31_014: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_HTTP_ERROR, otherwise it shall succeed and return BLOB_OK. ]*/
+                        LogError("unable to HTTPAPIEX_ExecuteRequest");
+                        result = BLOB_HTTP_ERROR;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_BLOB_31_014: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_HTTP_ERROR, otherwise it shall succeed and return BLOB_OK. ]*/
+                        result = BLOB_OK;
+                    }
+                    BUFFER_delete(blockIDListAsBuffer);
+                }
+                STRING_delete(newRelativePath);
+            }
+        }
+        STRING_delete(blockIDList);
+    }
+    return result;
+}
+
+BLOB_RESULT Blob_UploadMultipleBlocksInParallelFromSasUri(const char* SASURI, IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX getDataCallbackEx, void* context, unsigned int* httpStatus, BUFFER_HANDLE httpResponse, const char* certificates, HTTP_PROXY_OPTIONS *proxyOptions, size_t maxConcurrentBlocks, size_t blockSize)
+{
+    BLOB_RESULT result;
+
+    /*Codes_SRS_BLOB_31_001: [ If SASURI, getDataCallbackEx, httpStatus or httpResponse is NULL, if maxConcurrentBlocks is 0 or more than 50000, or if blockSize is bigger than 4MB, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+    if ((SASURI == NULL) ||
+        (getDataCallbackEx == NULL) ||
+        (httpStatus == NULL) ||
+        (httpResponse == NULL) ||
+        (maxConcurrentBlocks == 0) ||
+        (maxConcurrentBlocks > MAX_BLOCK_COUNT) ||
+        (blockSize > BLOCK_SIZE))
+    {
+        LogError("invalid argument detected SASURI=%p getDataCallbackEx=%p httpStatus=%p httpResponse=%p maxConcurrentBlocks=%lu blockSize=%lu",
+            SASURI, getDataCallbackEx, httpStatus, httpResponse, (unsigned long)maxConcurrentBlocks, (unsigned long)blockSize);
+        result = BLOB_INVALID_ARG;
+    }
+    else
+    {
+        char* hostname;
+        const char* relativePath;
+
+        if ((result = get_sas_uri_hostname(SASURI, &hostname, &relativePath)) != BLOB_OK)
+        {
+            LogError("unable to get the hostname of the SAS URI");
+        }
+        else
+        {
+            BLOB_PARALLEL_UPLOAD* upload = create_parallel_upload(hostname, relativePath, certificates, proxyOptions, maxConcurrentBlocks, httpStatus, httpResponse);
+            if (upload == NULL)
+            {
+                /*Codes_SRS_BLOB_31_004: [ If creating a connection or a worker thread fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+                LogError("unable to create the blob upload");
+                result = BLOB_ERROR;
+            }
+            else
+            {
+                BLOB_BLOCK_READER reader;
+                reader.getDataCallbackEx = getDataCallbackEx;
+                reader.context = context;
+                reader.blockSize = blockSize;
+                reader.partialBlock = NULL;
+                reader.endOfData = 0;
+
+                if (Lock(upload->lock) != LOCK_OK)
+                {
+                    LogError("unable to Lock");
+                    result = BLOB_ERROR;
+                }
+                else
+                {
+                    result = queue_and_upload_blocks(upload, &reader, 2 * maxConcurrentBlocks);
+                    (void)Unlock(upload->lock);
+
+                    if (result != BLOB_OK)
+                    {
+                        /*do nothing, it will be reported "as is"*/
+                    }
+                    else if (upload->blockFailed)
+                    {
+                        result = upload->failureResult;
+                    }
+                    else
+                    {
+                        result = put_block_list(upload);
+                    }
+                }
+
+                if (reader.partialBlock != NULL)
+                {
+                    BUFFER_delete(reader.partialBlock);
+                }
+                destroy_parallel_upload(upload);
+            }
+            free(hostname);
+        }
+    }
+    return result;
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
@@ -38,6 +38,11 @@ IOTHUB_CLIENT_RESULT IoTHubClient_SendEventAsync(IOTHUB_CLIENT_HANDLE iotHubClie
     return IoTHubClientCore_SendEventAsync((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_SendEventBatchAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return IoTHubClientCore_SendEventBatchAsync((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, eventMessageHandles, eventMessageCount, eventConfirmationCallback, userContextCallback);
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClient_GetSendStatus(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     return IoTHubClientCore_GetSendStatus((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, iotHubClientStatus);
@@ -98,6 +103,11 @@ IOTHUB_CLIENT_RESULT IoTHubClient_DeviceMethodResponse(IOTHUB_CLIENT_HANDLE iotH
     return IoTHubClientCore_DeviceMethodResponse((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, methodId, response, respSize, statusCode);
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClient_GetCallbackDispatchStatistics(IOTHUB_CLIENT_HANDLE iotHubClientHandle, IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS* statistics)
+{
+    return IoTHubClientCore_GetCallbackDispatchStatistics((IOTHUB_CLIENT_CORE_HANDLE)iotHubClientHandle, statistics);
+}
+
 #ifndef DONT_USE_UPLOADTOBLOB
 
 IOTHUB_CLIENT_RESULT IoTHubClient_UploadToBlobAsync(IOTHUB_CLIENT_HANDLE iotHubClientHandle, const char* destinationFileName, const unsigned char* source, size_t size, IOTHUB_CLIENT_FILE_UPLOAD_CALLBACK iotHubClientFileUploadCallback, void* context)
@@ -2,25 +2,97 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h> 
+#include <string.h>
 #include "azure_c_shared_utility/umock_c_prod.h"
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <signal.h>
 #include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_core.h"
 #include "iothub_client_core_ll.h"
 #include "internal/iothubtransport.h"
 #include "internal/iothub_client_private.h"
+#include "internal/iothub_client_ingestion_queue.h"
 #include "internal/iothubtransport.h"
+#include "iothub_client_options.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 
+/*inbound traffic is only found by polling the transport, so idle clients keep the 1 ms cadence unless told otherwise*/
+#define DO_WORK_FREQ_DEFAULT_MS 1
+#define CALLBACK_DISPATCH_QUEUE_SIZE_DEFAULT 128
+
+/*EventIngestionQueue is created by SetOption under LockHandle and read by SendEventAsync without it. It is published and read
+with the same atomics selection as the ingestion queue itself; where there are none ingestion_queue_create fails and it stays NULL.*/
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef INGESTION_QUEUE_HANDLE _Atomic PUBLISHED_INGESTION_QUEUE;
+
+static void publish_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published, INGESTION_QUEUE_HANDLE queue)
+{
+    atomic_store_explicit(published, queue, memory_order_release);
+}
+
+static INGESTION_QUEUE_HANDLE acquire_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published)
+{
+    return atomic_load_explicit(published, memory_order_acquire);
+}
+#elif defined(WIN32)
+#include "windows.h"
+typedef INGESTION_QUEUE_HANDLE volatile PUBLISHED_INGESTION_QUEUE;
+
+static void publish_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published, INGESTION_QUEUE_HANDLE queue)
+{
+    MemoryBarrier();
+    *published = queue;
+}
+
+static INGESTION_QUEUE_HANDLE acquire_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published)
+{
+    INGESTION_QUEUE_HANDLE queue = *published;
+    MemoryBarrier();
+    return queue;
+}
+#elif defined(__GNUC__)
+typedef INGESTION_QUEUE_HANDLE volatile PUBLISHED_INGESTION_QUEUE;
+
+static void publish_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published, INGESTION_QUEUE_HANDLE queue)
+{
+    __sync_synchronize();
+    *published = queue;
+}
+
+static INGESTION_QUEUE_HANDLE acquire_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published)
+{
+    INGESTION_QUEUE_HANDLE queue = *published;
+    __sync_synchronize();
+    return queue;
+}
+#else
+typedef INGESTION_QUEUE_HANDLE PUBLISHED_INGESTION_QUEUE;
+
+static void publish_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published, INGESTION_QUEUE_HANDLE queue)
+{
+    *published = queue;
+}
+
+static INGESTION_QUEUE_HANDLE acquire_ingestion_queue(PUBLISHED_INGESTION_QUEUE* published)
+{
+    return *published;
+}
+#endif
+
 struct IOTHUB_QUEUE_CONTEXT_TAG;
+struct CALLBACK_DISPATCHER_TAG;
 
 typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
 {
@@ -29,6 +101,12 @@ typedef struct IOTHUB_CLIENT_CORE_INSTANCE_TAG
     THREAD_HANDLE ThreadHandle;
     LOCK_HANDLE LockHandle;
     sig_atomic_t StopThread;
+    COND_HANDLE WorkCondition; /*owned by ScheduleWork_Thread, only valid while WorkerWaiting is set*/
+    int WorkerWaiting; /*set (under LockHandle) while ScheduleWork_Thread is parked in Condition_Wait*/
+    unsigned int DoWorkFrequencyInMs; /*longest idle wait between two DoWork calls*/
+    struct CALLBACK_DISPATCHER_TAG* CallbackDispatcher; /*NULL when user callbacks are dispatched on the worker thread*/
+    size_t CallbackQueueSize; /*most callbacks CallbackDispatcher holds, the rest stay in saved_user_callback_list*/
+    PUBLISHED_INGESTION_QUEUE EventIngestionQueue; /*NULL unless OPTION_EVENT_INGESTION_QUEUE_SIZE was set, SendEventAsync then pushes here without LockHandle*/
 #ifndef DONT_USE_UPLOADTOBLOB
     SINGLYLINKEDLIST_HANDLE savedDataToBeCleaned; /*list containing UPLOADTOBLOB_SAVED_DATA*/
 #endif
@@ -138,6 +216,53 @@ typedef struct IOTHUB_QUEUE_CONTEXT_TAG
     void* userContextCallback;
 } IOTHUB_QUEUE_CONTEXT;
 
+/*shared by all the messages of one IoTHubClientCore_SendEventBatchAsync call, freed with the last confirmation*/
+typedef struct IOTHUB_BATCH_QUEUE_CONTEXT_TAG
+{
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientHandle;
+    void* userContextCallback;
+    size_t pendingConfirmations;
+} IOTHUB_BATCH_QUEUE_CONTEXT;
+
+typedef struct INGESTED_EVENT_TAG
+{
+    IOTHUB_MESSAGE_HANDLE message; /*clone owned by the event*/
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback;
+    void* userContextCallback;
+} INGESTED_EVENT;
+
+#define CALLBACK_DISPATCH_LANE_COUNT ((size_t)CALLBACK_TYPE_MESSAGE + 1)
+
+typedef struct CALLBACK_DISPATCHER_TAG
+{
+    IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance;
+    LOCK_HANDLE lock;
+    COND_HANDLE condition;
+    TICK_COUNTER_HANDLE tickCounter;
+    THREAD_HANDLE* threads;
+    size_t threadCount;
+    VECTOR_HANDLE lanes[CALLBACK_DISPATCH_LANE_COUNT]; /*one FIFO of USER_CALLBACK_INFO per callback type*/
+    int laneBusy[CALLBACK_DISPATCH_LANE_COUNT]; /*a lane is drained by one thread at a time, that keeps callbacks of one type in order*/
+    int stop;
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
+} CALLBACK_DISPATCHER;
+
+/*used by unittests only*/
+const size_t IoTHubClientCore_CallbackDispatcherStopOffset = offsetof(CALLBACK_DISPATCHER, stop);
+
+typedef struct CALLBACK_DISPATCH_TARGETS_TAG
+{
+    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback;
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback;
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback;
+    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback;
+    IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback;
+    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback;
+    IOTHUB_CLIENT_CORE_HANDLE message_user_context_handle;
+    IOTHUB_CLIENT_CORE_HANDLE method_user_context_handle;
+} CALLBACK_DISPATCH_TARGETS;
+
 /*used by unittests only*/
 const size_t IoTHubClientCore_ThreadTerminationOffset = offsetof(IOTHUB_CLIENT_CORE_INSTANCE, StopThread);
 
@@ -349,6 +474,28 @@ static void iothub_ll_event_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT r
     }
 }
 
+static void iothub_ll_event_batch_confirm_callback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    IOTHUB_BATCH_QUEUE_CONTEXT* batch_context = (IOTHUB_BATCH_QUEUE_CONTEXT*)userContextCallback;
+    if (batch_context != NULL)
+    {
+        USER_CALLBACK_INFO queue_cb_info;
+        queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
+        queue_cb_info.userContextCallback = batch_context->userContextCallback;
+        queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = result;
+        if (VECTOR_push_back(batch_context->iotHubClientHandle->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        {
+            LogError("event confirm callback vector push failed.");
+        }
+
+        /*the LL layer calls this with LockHandle taken, so the counter needs no further protection*/
+        if (--batch_context->pendingConfirmations == 0)
+        {
+            free(batch_context);
+        }
+    }
+}
+
 static void iothub_ll_reported_state_callback(int status_code, void* userContextCallback)
 {
     IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)userContextCallback;
@@ -417,47 +564,164 @@ static void iothub_ll_device_twin_callback(DEVICE_TWIN_UPDATE_STATE update_state
     }
 }
 
-static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, VECTOR_HANDLE call_backs)
+/*makes a local copy of the user callbacks, as dispatching does not run with a lock held and iotHubClientInstance may change mid-run*/
+static void get_dispatch_targets(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, CALLBACK_DISPATCH_TARGETS* targets)
 {
-    size_t callbacks_length = VECTOR_size(call_backs);
-    size_t index;
+    (void)memset(targets, 0, sizeof(CALLBACK_DISPATCH_TARGETS));
 
-    IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK desired_state_callback = NULL;
-    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK event_confirm_callback = NULL;
-    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK reported_state_callback = NULL;
-    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connection_status_callback = NULL;
-    IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC device_method_callback = NULL;
-    IOTHUB_CLIENT_INBOUND_DEVICE_METHOD_CALLBACK inbound_device_method_callback = NULL;
-    IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC message_callback = NULL;
-    IOTHUB_CLIENT_CORE_HANDLE message_user_context_handle = NULL;
-    IOTHUB_CLIENT_CORE_HANDLE method_user_context_handle = NULL;
-
-    // Make a local copy of these callbacks, as we don't run with a lock held and iotHubClientInstance may change mid-run.
     if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
     {
         LogError("failed locking for dispatch_user_callbacks");
     }
     else
     {
-        desired_state_callback = iotHubClientInstance->desired_state_callback;
-        event_confirm_callback = iotHubClientInstance->event_confirm_callback;
-        reported_state_callback = iotHubClientInstance->reported_state_callback;
-        connection_status_callback = iotHubClientInstance->connection_status_callback;
-        device_method_callback = iotHubClientInstance->device_method_callback;
-        inbound_device_method_callback = iotHubClientInstance->inbound_device_method_callback;
-        message_callback = iotHubClientInstance->message_callback;
+        targets->desired_state_callback = iotHubClientInstance->desired_state_callback;
+        targets->event_confirm_callback = iotHubClientInstance->event_confirm_callback;
+        targets->reported_state_callback = iotHubClientInstance->reported_state_callback;
+        targets->connection_status_callback = iotHubClientInstance->connection_status_callback;
+        targets->device_method_callback = iotHubClientInstance->device_method_callback;
+        targets->inbound_device_method_callback = iotHubClientInstance->inbound_device_method_callback;
+        targets->message_callback = iotHubClientInstance->message_callback;
         if (iotHubClientInstance->method_user_context)
         {
-            method_user_context_handle = iotHubClientInstance->method_user_context->iotHubClientHandle;
+            targets->method_user_context_handle = iotHubClientInstance->method_user_context->iotHubClientHandle;
         }
         if (iotHubClientInstance->message_user_context)
         {
-            message_user_context_handle = iotHubClientInstance->message_user_context->iotHubClientHandle;
+            targets->message_user_context_handle = iotHubClientInstance->message_user_context->iotHubClientHandle;
         }
 
         (void)Unlock(iotHubClientInstance->LockHandle);
     }
+}
+
+/*wakes up ScheduleWork_Thread if it is waiting for work. Needs to be called with LockHandle taken.*/
+static void signal_worker_thread(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    if (iotHubClientInstance->WorkerWaiting != 0)
+    {
+        if (Condition_Post(iotHubClientInstance->WorkCondition) != COND_OK)
+        {
+            LogError("unable to Condition_Post, worker thread will wake up at its next deadline");
+        }
+    }
+}
+
+static void dispatch_user_callback(const CALLBACK_DISPATCH_TARGETS* targets, USER_CALLBACK_INFO* queued_cb)
+{
+    switch (queued_cb->type)
+    {
+    case CALLBACK_TYPE_DEVICE_TWIN:
+    {
+        if (targets->desired_state_callback)
+        {
+            targets->desired_state_callback(queued_cb->iothub_callback.dev_twin_cb_info.update_state, queued_cb->iothub_callback.dev_twin_cb_info.payLoad, queued_cb->iothub_callback.dev_twin_cb_info.size, queued_cb->userContextCallback);
+        }
+
+        if (queued_cb->iothub_callback.dev_twin_cb_info.payLoad)
+        {
+            free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
+        }
+        break;
+    }
+    case CALLBACK_TYPE_EVENT_CONFIRM:
+        if (targets->event_confirm_callback)
+        {
+            targets->event_confirm_callback(queued_cb->iothub_callback.event_confirm_cb_info.confirm_result, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_REPORTED_STATE:
+        if (targets->reported_state_callback)
+        {
+            targets->reported_state_callback(queued_cb->iothub_callback.reported_state_cb_info.status_code, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_CONNECTION_STATUS:
+        if (targets->connection_status_callback)
+        {
+            targets->connection_status_callback(queued_cb->iothub_callback.connection_status_cb_info.connection_status, queued_cb->iothub_callback.connection_status_cb_info.status_reason, queued_cb->userContextCallback);
+        }
+        break;
+    case CALLBACK_TYPE_DEVICE_METHOD:
+        if (targets->device_method_callback)
+        {
+            const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
+            const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
+            size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+
+            unsigned char* payload_resp = NULL;
+            size_t response_size = 0;
+            int status = targets->device_method_callback(method_name, payload, payload_len, &payload_resp, &response_size, queued_cb->userContextCallback);
+
+            if (payload_resp && (response_size > 0))
+            {
+                IOTHUB_CLIENT_RESULT result = IoTHubClientCore_DeviceMethodResponse(targets->method_user_context_handle, queued_cb->iothub_callback.method_cb_info.method_id, (const unsigned char*)payload_resp, response_size, status);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
+                }
+            }
 
+            BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
+            STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+
+            if (payload_resp)
+            {
+                free(payload_resp);
+            }
+        }
+        break;
+    case CALLBACK_TYPE_INBOUD_DEVICE_METHOD:
+        if (targets->inbound_device_method_callback)
+        {
+            const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
+            const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
+            size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+
+            targets->inbound_device_method_callback(method_name, payload, payload_len, queued_cb->iothub_callback.method_cb_info.method_id, queued_cb->userContextCallback);
+
+            BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
+            STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+        }
+        break;
+    case CALLBACK_TYPE_MESSAGE:
+        if (targets->message_callback)
+        {
+            IOTHUBMESSAGE_DISPOSITION_RESULT disposition = targets->message_callback(queued_cb->iothub_callback.message_cb_info->messageHandle, queued_cb->userContextCallback);
+
+            if (Lock(targets->message_user_context_handle->LockHandle) == LOCK_OK)
+            {
+                IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(targets->message_user_context_handle->IoTHubClientLLHandle, queued_cb->iothub_callback.message_cb_info, disposition);
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    /*the disposition is sent by the next DoWork*/
+                    signal_worker_thread(targets->message_user_context_handle);
+                }
+                (void)Unlock(targets->message_user_context_handle->LockHandle);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_SendMessageDisposition failed");
+                }
+            }
+            else
+            {
+                LogError("Lock failed");
+            }
+        }
+        break;
+    default:
+        LogError("Invalid callback type '%s'", ENUM_TO_STRING(USER_CALLBACK_TYPE, queued_cb->type));
+        break;
+    }
+}
+
+static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, VECTOR_HANDLE call_backs)
+{
+    size_t callbacks_length = VECTOR_size(call_backs);
+    size_t index;
+    CALLBACK_DISPATCH_TARGETS targets;
+
+    get_dispatch_targets(iotHubClientInstance, &targets);
 
     for (index = 0; index < callbacks_length; index++)
     {
@@ -468,108 +732,425 @@ static void dispatch_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientIns
         }
         else
         {
-            switch (queued_cb->type)
-            {
-            case CALLBACK_TYPE_DEVICE_TWIN:
+            dispatch_user_callback(&targets, queued_cb);
+        }
+    }
+    VECTOR_destroy(call_backs);
+}
+
+/*releases a callback that is not going to be dispatched because the client is being destroyed*/
+static void free_undispatched_user_callback(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, USER_CALLBACK_INFO* queue_cb_info)
+{
+    if ((queue_cb_info->type == CALLBACK_TYPE_DEVICE_METHOD) || (queue_cb_info->type == CALLBACK_TYPE_INBOUD_DEVICE_METHOD))
+    {
+        STRING_delete(queue_cb_info->iothub_callback.method_cb_info.method_name);
+        BUFFER_delete(queue_cb_info->iothub_callback.method_cb_info.payload);
+    }
+    else if (queue_cb_info->type == CALLBACK_TYPE_DEVICE_TWIN)
+    {
+        if (queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad != NULL)
+        {
+            free(queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad);
+        }
+    }
+    else if (queue_cb_info->type == CALLBACK_TYPE_EVENT_CONFIRM)
+    {
+        if (iotHubClientInstance->event_confirm_callback)
+        {
+            iotHubClientInstance->event_confirm_callback(queue_cb_info->iothub_callback.event_confirm_cb_info.confirm_result, queue_cb_info->userContextCallback);
+        }
+    }
+}
+
+/*needs to be called with dispatcher->lock taken. Returns CALLBACK_DISPATCH_LANE_COUNT when no lane can be drained.*/
+static size_t find_ready_lane(CALLBACK_DISPATCHER* dispatcher)
+{
+    size_t lane;
+    for (lane = 0; lane < CALLBACK_DISPATCH_LANE_COUNT; lane++)
+    {
+        if ((dispatcher->laneBusy[lane] == 0) && (VECTOR_size(dispatcher->lanes[lane]) > 0))
+        {
+            break;
+        }
+    }
+    return lane;
+}
+
+/*runs the callbacks of one lane in order, without any lock held. Handler time is added to the statistics by the caller.*/
+static void dispatch_lane(CALLBACK_DISPATCHER* dispatcher, VECTOR_HANDLE call_backs, uint64_t* handlerTimeInMs, uint64_t* maxHandlerTimeInMs)
+{
+    size_t callbacks_length = VECTOR_size(call_backs);
+    size_t index;
+    CALLBACK_DISPATCH_TARGETS targets;
+
+    get_dispatch_targets(dispatcher->iotHubClientInstance, &targets);
+
+    for (index = 0; index < callbacks_length; index++)
+    {
+        USER_CALLBACK_INFO* queued_cb = (USER_CALLBACK_INFO*)VECTOR_element(call_backs, index);
+        if (queued_cb == NULL)
+        {
+            LogError("VECTOR_element at index %zd is NULL.", index);
+        }
+        else
+        {
+            tickcounter_ms_t start_ms;
+            tickcounter_ms_t end_ms;
+            int timed = (tickcounter_get_current_ms(dispatcher->tickCounter, &start_ms) == 0);
+
+            dispatch_user_callback(&targets, queued_cb);
+
+            if (timed && (tickcounter_get_current_ms(dispatcher->tickCounter, &end_ms) == 0))
             {
-                if (desired_state_callback)
+                uint64_t elapsed = (uint64_t)(end_ms - start_ms);
+                *handlerTimeInMs += elapsed;
+                if (elapsed > *maxHandlerTimeInMs)
                 {
-                    desired_state_callback(queued_cb->iothub_callback.dev_twin_cb_info.update_state, queued_cb->iothub_callback.dev_twin_cb_info.payLoad, queued_cb->iothub_callback.dev_twin_cb_info.size, queued_cb->userContextCallback);
+                    *maxHandlerTimeInMs = elapsed;
                 }
+            }
+        }
+    }
+    VECTOR_destroy(call_backs);
+}
 
-                if (queued_cb->iothub_callback.dev_twin_cb_info.payLoad)
+static int callback_dispatch_thread(void* threadArgument)
+{
+    CALLBACK_DISPATCHER* dispatcher = (CALLBACK_DISPATCHER*)threadArgument;
+
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("failed locking for callback_dispatch_thread");
+    }
+    else
+    {
+        while (dispatcher->stop == 0)
+        {
+            size_t lane = find_ready_lane(dispatcher);
+            if (lane == CALLBACK_DISPATCH_LANE_COUNT)
+            {
+                if (Condition_Wait(dispatcher->condition, dispatcher->lock, 0) == COND_ERROR)
                 {
-                    free(queued_cb->iothub_callback.dev_twin_cb_info.payLoad);
+                    LogError("Condition_Wait failed");
                 }
-                break;
             }
-            case CALLBACK_TYPE_EVENT_CONFIRM:
-                if (event_confirm_callback)
-                {
-                    event_confirm_callback(queued_cb->iothub_callback.event_confirm_cb_info.confirm_result, queued_cb->userContextCallback);
-                }
-                break;
-            case CALLBACK_TYPE_REPORTED_STATE:
-                if (reported_state_callback)
-                {
-                    reported_state_callback(queued_cb->iothub_callback.reported_state_cb_info.status_code, queued_cb->userContextCallback);
-                }
-                break;
-            case CALLBACK_TYPE_CONNECTION_STATUS:
-                if (connection_status_callback)
+            else
+            {
+                VECTOR_HANDLE call_backs = VECTOR_move(dispatcher->lanes[lane]);
+                if (call_backs == NULL)
                 {
-                    connection_status_callback(queued_cb->iothub_callback.connection_status_cb_info.connection_status, queued_cb->iothub_callback.connection_status_cb_info.status_reason, queued_cb->userContextCallback);
+                    LogError("VECTOR_move failed, retrying");
+                    (void)Condition_Wait(dispatcher->condition, dispatcher->lock, 1);
                 }
-                break;
-            case CALLBACK_TYPE_DEVICE_METHOD:
-                if (device_method_callback)
+                else
                 {
-                    const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
-                    const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
-                    size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+                    uint64_t handlerTimeInMs = 0;
+                    uint64_t maxHandlerTimeInMs = 0;
+                    size_t callbacks_length = VECTOR_size(call_backs);
+
+                    dispatcher->laneBusy[lane] = 1;
+                    dispatcher->statistics.queueDepth -= callbacks_length;
+                    (void)Unlock(dispatcher->lock);
 
-                    unsigned char* payload_resp = NULL;
-                    size_t response_size = 0;
-                    int status = device_method_callback(method_name, payload, payload_len, &payload_resp, &response_size, queued_cb->userContextCallback);
+                    dispatch_lane(dispatcher, call_backs, &handlerTimeInMs, &maxHandlerTimeInMs);
 
-                    if (payload_resp && (response_size > 0))
+                    while (Lock(dispatcher->lock) != LOCK_OK)
                     {
-                        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_DeviceMethodResponse(method_user_context_handle, queued_cb->iothub_callback.method_cb_info.method_id, (const unsigned char*)payload_resp, response_size, status);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
-                        }
+                        LogError("failed locking for callback_dispatch_thread, retrying");
+                        ThreadAPI_Sleep(1);
                     }
-
-                    BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
-                    STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
-
-                    if (payload_resp)
+                    dispatcher->laneBusy[lane] = 0;
+                    dispatcher->statistics.dispatchedCount += callbacks_length;
+                    dispatcher->statistics.totalHandlerTimeInMs += handlerTimeInMs;
+                    if (maxHandlerTimeInMs > dispatcher->statistics.maxHandlerTimeInMs)
                     {
-                        free(payload_resp);
+                        dispatcher->statistics.maxHandlerTimeInMs = maxHandlerTimeInMs;
                     }
                 }
-                break;
-            case CALLBACK_TYPE_INBOUD_DEVICE_METHOD:
-                if (inbound_device_method_callback)
-                {
-                    const char* method_name = STRING_c_str(queued_cb->iothub_callback.method_cb_info.method_name);
-                    const unsigned char* payload = BUFFER_u_char(queued_cb->iothub_callback.method_cb_info.payload);
-                    size_t payload_len = BUFFER_length(queued_cb->iothub_callback.method_cb_info.payload);
+            }
+        }
+        (void)Unlock(dispatcher->lock);
+    }
 
-                    inbound_device_method_callback(method_name, payload, payload_len, queued_cb->iothub_callback.method_cb_info.method_id, queued_cb->userContextCallback);
+    ThreadAPI_Exit(0);
+    return 0;
+}
 
-                    BUFFER_delete(queued_cb->iothub_callback.method_cb_info.payload);
-                    STRING_delete(queued_cb->iothub_callback.method_cb_info.method_name);
+/*stops and joins the dispatch threads. Callbacks that were not dispatched yet are released like the ones left in saved_user_callback_list*/
+static void destroy_callback_dispatcher(CALLBACK_DISPATCHER* dispatcher)
+{
+    size_t index;
+
+    if (Lock(dispatcher->lock) != LOCK_OK)
+    {
+        LogError("unable to Lock - - will still proceed to try to end the threads without locking");
+    }
+    dispatcher->stop = 1;
+    for (index = 0; index < dispatcher->threadCount; index++)
+    {
+        (void)Condition_Post(dispatcher->condition);
+    }
+    (void)Unlock(dispatcher->lock);
+
+    for (index = 0; index < dispatcher->threadCount; index++)
+    {
+        int res;
+        if (ThreadAPI_Join(dispatcher->threads[index], &res) != THREADAPI_OK)
+        {
+            LogError("ThreadAPI_Join failed");
+        }
+    }
+
+    for (index = 0; index < CALLBACK_DISPATCH_LANE_COUNT; index++)
+    {
+        if (dispatcher->lanes[index] != NULL)
+        {
+            size_t callbacks_length = VECTOR_size(dispatcher->lanes[index]);
+            size_t position;
+            for (position = 0; position < callbacks_length; position++)
+            {
+                USER_CALLBACK_INFO* queue_cb_info = (USER_CALLBACK_INFO*)VECTOR_element(dispatcher->lanes[index], position);
+                if (queue_cb_info != NULL)
+                {
+                    free_undispatched_user_callback(dispatcher->iotHubClientInstance, queue_cb_info);
                 }
+            }
+            VECTOR_destroy(dispatcher->lanes[index]);
+        }
+    }
+
+    free(dispatcher->threads);
+    tickcounter_destroy(dispatcher->tickCounter);
+    Condition_Deinit(dispatcher->condition);
+    Lock_Deinit(dispatcher->lock);
+    free(dispatcher);
+}
+
+static CALLBACK_DISPATCHER* create_callback_dispatcher(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, size_t threadCount)
+{
+    CALLBACK_DISPATCHER* result;
+
+    if (threadCount > SIZE_MAX / sizeof(THREAD_HANDLE))
+    {
+        LogError("invalid number of callback dispatch threads");
+        result = NULL;
+    }
+    else if ((result = (CALLBACK_DISPATCHER*)malloc(sizeof(CALLBACK_DISPATCHER))) == NULL)
+    {
+        LogError("failed allocating callback dispatcher");
+    }
+    else
+    {
+        size_t index;
+        bool lanes_created = true;
+
+        (void)memset(result, 0, sizeof(CALLBACK_DISPATCHER));
+        result->iotHubClientInstance = iotHubClientInstance;
+
+        for (index = 0; index < CALLBACK_DISPATCH_LANE_COUNT; index++)
+        {
+            if ((result->lanes[index] = VECTOR_create(sizeof(USER_CALLBACK_INFO))) == NULL)
+            {
+                lanes_created = false;
                 break;
-            case CALLBACK_TYPE_MESSAGE:
-                if (message_callback)
+            }
+        }
+
+        if (!lanes_created ||
+            ((result->lock = Lock_Init()) == NULL) ||
+            ((result->condition = Condition_Init()) == NULL) ||
+            ((result->tickCounter = tickcounter_create()) == NULL) ||
+            ((result->threads = (THREAD_HANDLE*)malloc(threadCount * sizeof(THREAD_HANDLE))) == NULL))
+        {
+            LogError("failed creating callback dispatcher resources");
+            for (index = 0; index < CALLBACK_DISPATCH_LANE_COUNT; index++)
+            {
+                if (result->lanes[index] != NULL)
                 {
-                    IOTHUBMESSAGE_DISPOSITION_RESULT disposition = message_callback(queued_cb->iothub_callback.message_cb_info->messageHandle, queued_cb->userContextCallback);
+                    VECTOR_destroy(result->lanes[index]);
+                }
+            }
+            if (result->tickCounter != NULL)
+            {
+                tickcounter_destroy(result->tickCounter);
+            }
+            if (result->condition != NULL)
+            {
+                Condition_Deinit(result->condition);
+            }
+            if (result->lock != NULL)
+            {
+                Lock_Deinit(result->lock);
+            }
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            for (index = 0; index < threadCount; index++)
+            {
+                if (ThreadAPI_Create(&result->threads[index], callback_dispatch_thread, result) != THREADAPI_OK)
+                {
+                    LogError("failed creating callback dispatch thread %lu", (unsigned long)index);
+                    break;
+                }
+            }
+            result->threadCount = index;
 
-                    if (Lock(message_user_context_handle->LockHandle) == LOCK_OK)
-                    {
-                        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendMessageDisposition(message_user_context_handle->IoTHubClientLLHandle, queued_cb->iothub_callback.message_cb_info, disposition);
-                        (void)Unlock(message_user_context_handle->LockHandle);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_SendMessageDisposition failed");
-                        }
-                    }
-                    else
-                    {
-                        LogError("Lock failed");
-                    }
+            if (index < threadCount)
+            {
+                destroy_callback_dispatcher(result);
+                result = NULL;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*hands the queued user callbacks over to the dispatcher, as many as fit. Needs to be called with LockHandle taken; it never waits on user code.*/
+static void enqueue_user_callbacks(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    CALLBACK_DISPATCHER* dispatcher = iotHubClientInstance->CallbackDispatcher;
+    size_t pending = VECTOR_size(iotHubClientInstance->saved_user_callback_list);
+
+    if (pending > 0)
+    {
+        if (Lock(dispatcher->lock) != LOCK_OK)
+        {
+            LogError("failed locking for enqueue_user_callbacks, callbacks stay queued");
+        }
+        else
+        {
+            size_t moved = 0;
+            while ((moved < pending) && (dispatcher->statistics.queueDepth < iotHubClientInstance->CallbackQueueSize))
+            {
+                USER_CALLBACK_INFO* queued_cb = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, moved);
+                size_t lane = (size_t)queued_cb->type;
+                if ((lane >= CALLBACK_DISPATCH_LANE_COUNT) || (VECTOR_push_back(dispatcher->lanes[lane], queued_cb, 1) != 0))
+                {
+                    LogError("unable to queue callback '%s', it stays queued", ENUM_TO_STRING(USER_CALLBACK_TYPE, queued_cb->type));
+                    break;
                 }
-                break;
-            default:
-                LogError("Invalid callback type '%s'", ENUM_TO_STRING(USER_CALLBACK_TYPE, queued_cb->type));
-                break;
+                if (dispatcher->laneBusy[lane] == 0)
+                {
+                    (void)Condition_Post(dispatcher->condition);
+                }
+                dispatcher->statistics.queueDepth++;
+                moved++;
+            }
+
+            if (moved > 0)
+            {
+                VECTOR_erase(iotHubClientInstance->saved_user_callback_list, VECTOR_front(iotHubClientInstance->saved_user_callback_list), moved);
+            }
+
+            if (dispatcher->statistics.queueDepth > dispatcher->statistics.maxQueueDepth)
+            {
+                dispatcher->statistics.maxQueueDepth = dispatcher->statistics.queueDepth;
             }
+            dispatcher->statistics.heldBackCount = pending - moved;
+
+            (void)Unlock(dispatcher->lock);
+        }
+    }
+}
+
+/*hands an event to the LL layer. Needs to be called with LockHandle taken. With takeOwnership the LL layer keeps eventMessageHandle itself when IOTHUB_CLIENT_OK is returned.*/
+static IOTHUB_CLIENT_RESULT send_event_locked(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
+{
+    IOTHUB_CLIENT_RESULT result;
+    IOTHUB_CLIENT_RESULT (*ll_send_event_async)(IOTHUB_CLIENT_CORE_LL_HANDLE, IOTHUB_MESSAGE_HANDLE, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK, void*) = takeOwnership ? IoTHubClientCore_LL_SendEventAsync_TakeOwnership : IoTHubClientCore_LL_SendEventAsync;
+
+    if (iotHubClientInstance->created_with_transport_handle == 0)
+    {
+        iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+    }
+
+    if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+    {
+        result = ll_send_event_async(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUBCLIENT_07_001: [ IoTHubClient_SendEventAsync shall allocate a IOTHUB_QUEUE_CONTEXT object to be sent to the IoTHubClientCore_LL_SendEventAsync function as a user context. ] */
+        IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
+        if (queue_context == NULL)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Failed allocating QUEUE_CONTEXT");
+        }
+        else
+        {
+            queue_context->iotHubClientHandle = iotHubClientInstance;
+            queue_context->userContextCallback = userContextCallback;
+            /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
+            /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
+            result = ll_send_event_async(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                LogError("IoTHubClientCore_LL_SendEventAsync failed");
+                free(queue_context);
+            }
+        }
+    }
+
+    return result;
+}
+
+static void destroy_ingested_event(INGESTED_EVENT* ingested_event)
+{
+    IoTHubMessage_Destroy(ingested_event->message);
+    free(ingested_event);
+}
+
+/*events that fail to reach the LL layer after SendEventAsync already returned are reported through their confirmation callback*/
+static void report_ingested_event_failure(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    if (eventConfirmationCallback == NULL)
+    {
+        /*nobody to tell*/
+    }
+    else if (iotHubClientInstance->created_with_transport_handle != 0)
+    {
+        /*the LL layer calls these directly from DoWork as well*/
+        eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_ERROR, userContextCallback);
+    }
+    else
+    {
+        USER_CALLBACK_INFO queue_cb_info;
+        queue_cb_info.type = CALLBACK_TYPE_EVENT_CONFIRM;
+        queue_cb_info.userContextCallback = userContextCallback;
+        queue_cb_info.iothub_callback.event_confirm_cb_info.confirm_result = IOTHUB_CLIENT_CONFIRMATION_ERROR;
+        if (VECTOR_push_back(iotHubClientInstance->saved_user_callback_list, &queue_cb_info, 1) != 0)
+        {
+            LogError("event confirm callback vector push failed.");
+        }
+    }
+}
+
+/*moves everything producers pushed to EventIngestionQueue into the LL layer, in order. Needs to be called with LockHandle taken, which also makes this the only consumer.*/
+static void drain_ingested_events(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance)
+{
+    INGESTED_EVENT* ingested_event;
+
+    while ((ingested_event = (INGESTED_EVENT*)ingestion_queue_pop(iotHubClientInstance->EventIngestionQueue)) != NULL)
+    {
+        IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback = ingested_event->eventConfirmationCallback;
+        void* userContextCallback = ingested_event->userContextCallback;
+
+        /*the message is already a private clone, so the LL layer can take it as is*/
+        if (send_event_locked(iotHubClientInstance, ingested_event->message, eventConfirmationCallback, userContextCallback, true) != IOTHUB_CLIENT_OK)
+        {
+            LogError("unable to hand an ingested event to the LL layer");
+            report_ingested_event_failure(iotHubClientInstance, eventConfirmationCallback, userContextCallback);
+            destroy_ingested_event(ingested_event);
+        }
+        else
+        {
+            free(ingested_event);
         }
     }
-    VECTOR_destroy(call_backs);
 }
 
 static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
@@ -581,27 +1162,111 @@ static void ScheduleWork_Thread_ForMultiplexing(void* iotHubClientHandle)
 #endif
     if (Lock(iotHubClientInstance->LockHandle) == LOCK_OK)
     {
-        VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
-        (void)Unlock(iotHubClientInstance->LockHandle);
+        if (iotHubClientInstance->EventIngestionQueue != NULL)
+        {
+            /*picked up by the next transport DoWork*/
+            drain_ingested_events(iotHubClientInstance);
+        }
+
+        if (iotHubClientInstance->CallbackDispatcher != NULL)
+        {
+            enqueue_user_callbacks(iotHubClientInstance);
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+        else
+        {
+            VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
+            (void)Unlock(iotHubClientInstance->LockHandle);
+
+            if (call_backs == NULL)
+            {
+                LogError("Failed moving user callbacks");
+            }
+            else
+            {
+                dispatch_user_callbacks(iotHubClientInstance, call_backs);
+            }
+        }
+    }
+    else
+    {
+        LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
+    }
+}
+
+/*wakes up ScheduleWork_Thread after a push to EventIngestionQueue, from a producer that does not hold LockHandle.
+wait_for_work raises the consumer waiting flag of the queue before it looks for events, so a producer that does not see the flag
+raised is guaranteed that the worker will see its event. LockHandle is only taken when the worker is parked or about to be.*/
+static void signal_worker_thread_unlocked(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, INGESTION_QUEUE_HANDLE event_ingestion_queue)
+{
+    if (ingestion_queue_is_consumer_waiting(event_ingestion_queue))
+    {
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("unable to Lock, worker thread will wake up at its next deadline");
+        }
+        else
+        {
+            signal_worker_thread(iotHubClientInstance);
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+}
+
+/*parks ScheduleWork_Thread until either new work is signaled or the lower layer needs DoWork to be called again*/
+static void wait_for_work(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, COND_HANDLE work_condition)
+{
+    if (work_condition == NULL)
+    {
+        (void)ThreadAPI_Sleep(1);
+    }
+    else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+    {
+        LogError("unable to Lock, polling instead");
+        (void)ThreadAPI_Sleep(1);
+    }
+    else
+    {
+        if (iotHubClientInstance->EventIngestionQueue != NULL)
+        {
+            /*raised before looking at the queue, see signal_worker_thread_unlocked*/
+            ingestion_queue_set_consumer_waiting(iotHubClientInstance->EventIngestionQueue, true);
+        }
 
-        if (call_backs == NULL)
+        if ((iotHubClientInstance->EventIngestionQueue != NULL) && !ingestion_queue_is_empty(iotHubClientInstance->EventIngestionQueue))
         {
-            LogError("Failed moving user callbacks");
+            /*events were pushed since the last DoWork*/
         }
-        else
+        else if (iotHubClientInstance->StopThread == 0)
         {
-            dispatch_user_callbacks(iotHubClientInstance, call_backs);
+            unsigned int delay = IoTHubClientCore_LL_GetNextDoWorkDelay(iotHubClientInstance->IoTHubClientLLHandle, iotHubClientInstance->DoWorkFrequencyInMs);
+
+            iotHubClientInstance->WorkerWaiting = 1;
+            if (Condition_Wait(work_condition, iotHubClientInstance->LockHandle, (int)delay) == COND_ERROR)
+            {
+                LogError("Condition_Wait failed");
+            }
+            iotHubClientInstance->WorkerWaiting = 0;
         }
-    }
-    else
-    {
-        LogError("failed locking for ScheduleWork_Thread_ForMultiplexing");
+
+        if (iotHubClientInstance->EventIngestionQueue != NULL)
+        {
+            ingestion_queue_set_consumer_waiting(iotHubClientInstance->EventIngestionQueue, false);
+        }
+        (void)Unlock(iotHubClientInstance->LockHandle);
     }
 }
 
 static int ScheduleWork_Thread(void* threadArgument)
 {
     IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)threadArgument;
+    COND_HANDLE work_condition;
+
+    if ((work_condition = Condition_Init()) == NULL)
+    {
+        LogError("unable to Condition_Init, worker thread will poll every 1 ms");
+    }
+    iotHubClientInstance->WorkCondition = work_condition;
 
     while (1)
     {
@@ -617,20 +1282,32 @@ static int ScheduleWork_Thread(void* threadArgument)
             {
                 /* Codes_SRS_IOTHUBCLIENT_01_037: [The thread created by IoTHubClient_SendEvent or IoTHubClient_SetMessageCallback shall call IoTHubClientCore_LL_DoWork every 1 ms.] */
                 /* Codes_SRS_IOTHUBCLIENT_01_039: [All calls to IoTHubClientCore_LL_DoWork shall be protected by the lock created in IotHubClient_Create.] */
+                if (iotHubClientInstance->EventIngestionQueue != NULL)
+                {
+                    drain_ingested_events(iotHubClientInstance);
+                }
                 IoTHubClientCore_LL_DoWork(iotHubClientInstance->IoTHubClientLLHandle);
 
 #ifndef DONT_USE_UPLOADTOBLOB
                 garbageCollectorImpl(iotHubClientInstance);
 #endif
-                VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
-                (void)Unlock(iotHubClientInstance->LockHandle);
-                if (call_backs == NULL)
+                if (iotHubClientInstance->CallbackDispatcher != NULL)
                 {
-                    LogError("VECTOR_move failed");
+                    enqueue_user_callbacks(iotHubClientInstance);
+                    (void)Unlock(iotHubClientInstance->LockHandle);
                 }
                 else
                 {
-                    dispatch_user_callbacks(iotHubClientInstance, call_backs);
+                    VECTOR_HANDLE call_backs = VECTOR_move(iotHubClientInstance->saved_user_callback_list);
+                    (void)Unlock(iotHubClientInstance->LockHandle);
+                    if (call_backs == NULL)
+                    {
+                        LogError("VECTOR_move failed");
+                    }
+                    else
+                    {
+                        dispatch_user_callbacks(iotHubClientInstance, call_backs);
+                    }
                 }
             }
         }
@@ -639,7 +1316,12 @@ static int ScheduleWork_Thread(void* threadArgument)
             /*Codes_SRS_IOTHUBCLIENT_01_040: [If acquiring the lock fails, IoTHubClientCore_LL_DoWork shall not be called.]*/
             /*no code, shall retry*/
         }
-        (void)ThreadAPI_Sleep(1);
+        wait_for_work(iotHubClientInstance, work_condition);
+    }
+
+    if (work_condition != NULL)
+    {
+        Condition_Deinit(work_condition);
     }
 
     ThreadAPI_Exit(0);
@@ -834,6 +1516,12 @@ static IOTHUB_CLIENT_CORE_INSTANCE* create_iothub_instance(const IOTHUB_CLIENT_C
                 else
                 {
                     result->ThreadHandle = NULL;
+                    result->WorkCondition = NULL;
+                    result->WorkerWaiting = 0;
+                    result->DoWorkFrequencyInMs = DO_WORK_FREQ_DEFAULT_MS;
+                    result->CallbackDispatcher = NULL;
+                    result->CallbackQueueSize = CALLBACK_DISPATCH_QUEUE_SIZE_DEFAULT;
+                    result->EventIngestionQueue = NULL;
                     result->desired_state_callback = NULL;
                     result->event_confirm_callback = NULL;
                     result->reported_state_callback = NULL;
@@ -967,6 +1655,7 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         if (iotHubClientInstance->ThreadHandle != NULL)
         {
             iotHubClientInstance->StopThread = 1;
+            signal_worker_thread(iotHubClientInstance);
             joinClientThread = true;
         }
         else
@@ -996,6 +1685,13 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             IoTHubTransport_JoinWorkerThread(iotHubClientInstance->TransportHandle, iotHubClientHandle);
         }
 
+        if (iotHubClientInstance->CallbackDispatcher != NULL)
+        {
+            /*handlers may still be answering methods or settling messages, so this happens before the LL handle goes away*/
+            destroy_callback_dispatcher(iotHubClientInstance->CallbackDispatcher);
+            iotHubClientInstance->CallbackDispatcher = NULL;
+        }
+
         if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             LogError("unable to Lock - - will still proceed to try to end the thread without locking");
@@ -1015,6 +1711,14 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
         }
 #endif
 
+        if (iotHubClientInstance->EventIngestionQueue != NULL)
+        {
+            /*events nobody drained yet are handed to the LL layer, which reports them as IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY*/
+            drain_ingested_events(iotHubClientInstance);
+            ingestion_queue_destroy(iotHubClientInstance->EventIngestionQueue);
+            iotHubClientInstance->EventIngestionQueue = NULL;
+        }
+
         /* Codes_SRS_IOTHUBCLIENT_01_006: [That includes destroying the IoTHubClientCore_LL instance by calling IoTHubClientCore_LL_Destroy.] */
         IoTHubClientCore_LL_Destroy(iotHubClientInstance->IoTHubClientLLHandle);
 
@@ -1031,25 +1735,7 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
             USER_CALLBACK_INFO* queue_cb_info = (USER_CALLBACK_INFO*)VECTOR_element(iotHubClientInstance->saved_user_callback_list, index);
             if (queue_cb_info != NULL)
             {
-                if ((queue_cb_info->type == CALLBACK_TYPE_DEVICE_METHOD) || (queue_cb_info->type == CALLBACK_TYPE_INBOUD_DEVICE_METHOD))
-                {
-                    STRING_delete(queue_cb_info->iothub_callback.method_cb_info.method_name);
-                    BUFFER_delete(queue_cb_info->iothub_callback.method_cb_info.payload);
-                }
-                else if (queue_cb_info->type == CALLBACK_TYPE_DEVICE_TWIN)
-                {
-                    if (queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad != NULL)
-                    {
-                        free(queue_cb_info->iothub_callback.dev_twin_cb_info.payLoad);
-                    }
-                }
-                else if (queue_cb_info->type == CALLBACK_TYPE_EVENT_CONFIRM)
-                {
-                    if (iotHubClientInstance->event_confirm_callback)
-                    {
-                        iotHubClientInstance->event_confirm_callback(queue_cb_info->iothub_callback.event_confirm_cb_info.confirm_result, queue_cb_info->userContextCallback);
-                    }
-                }
+                free_undispatched_user_callback(iotHubClientInstance, queue_cb_info);
             }
         }
         VECTOR_destroy(iotHubClientInstance->saved_user_callback_list);
@@ -1079,6 +1765,66 @@ void IoTHubClientCore_Destroy(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle)
     }
 }
 
+/*SendEventAsync when EventIngestionQueue exists: the worker thread is already running and LockHandle is only taken when the queue is full*/
+static IOTHUB_CLIENT_RESULT ingest_event(IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance, INGESTION_QUEUE_HANDLE event_ingestion_queue, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    INGESTED_EVENT* ingested_event;
+
+    if (eventMessageHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL eventMessageHandle");
+    }
+    else if ((ingested_event = (INGESTED_EVENT*)malloc(sizeof(INGESTED_EVENT))) == NULL)
+    {
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("Failed allocating INGESTED_EVENT");
+    }
+    else if ((ingested_event->message = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+    {
+        free(ingested_event);
+        result = IOTHUB_CLIENT_ERROR;
+        LogError("IoTHubMessage_Clone failed");
+    }
+    else
+    {
+        ingested_event->eventConfirmationCallback = eventConfirmationCallback;
+        ingested_event->userContextCallback = userContextCallback;
+
+        if (ingestion_queue_push(event_ingestion_queue, ingested_event) == 0)
+        {
+            signal_worker_thread_unlocked(iotHubClientInstance, event_ingestion_queue);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            destroy_ingested_event(ingested_event);
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            /*the queue is full: what is already queued goes to the LL layer first so the events keep their order*/
+            drain_ingested_events(iotHubClientInstance);
+            result = send_event_locked(iotHubClientInstance, ingested_event->message, eventConfirmationCallback, userContextCallback, true);
+
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                free(ingested_event);
+                signal_worker_thread(iotHubClientInstance);
+            }
+            else
+            {
+                destroy_ingested_event(ingested_event);
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1092,9 +1838,14 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
     else
     {
         IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+        INGESTION_QUEUE_HANDLE event_ingestion_queue = acquire_ingestion_queue(&iotHubClientInstance->EventIngestionQueue);
 
+        if (event_ingestion_queue != NULL)
+        {
+            result = ingest_event(iotHubClientInstance, event_ingestion_queue, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+        }
         /* Codes_SRS_IOTHUBCLIENT_01_009: [IoTHubClient_SendEventAsync shall start the worker thread if it was not previously started.] */
-        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+        else if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_010: [If starting the thread fails, IoTHubClient_SendEventAsync shall return IOTHUB_CLIENT_ERROR.] */
             result = IOTHUB_CLIENT_ERROR;
@@ -1111,42 +1862,96 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventAsync(IOTHUB_CLIENT_CORE_HANDLE i
             }
             else
             {
-                if (iotHubClientInstance->created_with_transport_handle == 0)
+                result = send_event_locked(iotHubClientInstance, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+
+                if (result == IOTHUB_CLIENT_OK)
                 {
-                    iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+                    signal_worker_thread(iotHubClientInstance);
                 }
 
-                if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+                /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
+                (void)Unlock(iotHubClientInstance->LockHandle);
+            }
+        }
+    }
+
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_SendEventBatchAsync(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        /* Codes_SRS_IOTHUBCLIENT_31_001: [ If iotHubClientHandle is NULL, IoTHubClient_SendEventBatchAsync shall return IOTHUB_CLIENT_INVALID_ARG. ] */
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LogError("NULL iothubClientHandle");
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        /* Codes_SRS_IOTHUBCLIENT_31_002: [ IoTHubClient_SendEventBatchAsync shall start the worker thread if it was not previously started. ] */
+        if ((result = StartWorkerThreadIfNeeded(iotHubClientInstance)) != IOTHUB_CLIENT_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
+        /* Codes_SRS_IOTHUBCLIENT_31_003: [ IoTHubClient_SendEventBatchAsync shall take the lock created in IoTHubClient_Create once for the whole batch. ] */
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not acquire lock");
+        }
+        else
+        {
+            if (iotHubClientInstance->EventIngestionQueue != NULL)
+            {
+                /* Codes_SRS_IOTHUBCLIENT_31_004: [ If the client has an event ingestion queue, the events already in it shall be handed to the LL layer before the batch. ] */
+                drain_ingested_events(iotHubClientInstance);
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle == 0)
+            {
+                iotHubClientInstance->event_confirm_callback = eventConfirmationCallback;
+            }
+
+            if (iotHubClientInstance->created_with_transport_handle != 0 || eventConfirmationCallback == NULL)
+            {
+                result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, eventConfirmationCallback, userContextCallback);
+            }
+            else
+            {
+                /* Codes_SRS_IOTHUBCLIENT_31_005: [ IoTHubClient_SendEventBatchAsync shall allocate one context for the whole batch, released once every message of the batch has been confirmed. ] */
+                IOTHUB_BATCH_QUEUE_CONTEXT* batch_context = (IOTHUB_BATCH_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_BATCH_QUEUE_CONTEXT));
+                if (batch_context == NULL)
                 {
-                    result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback);
+                    result = IOTHUB_CLIENT_ERROR;
+                    LogError("Failed allocating IOTHUB_BATCH_QUEUE_CONTEXT");
                 }
                 else
                 {
-                    /* Codes_SRS_IOTHUBCLIENT_07_001: [ IoTHubClient_SendEventAsync shall allocate a IOTHUB_QUEUE_CONTEXT object to be sent to the IoTHubClientCore_LL_SendEventAsync function as a user context. ] */
-                    IOTHUB_QUEUE_CONTEXT* queue_context = (IOTHUB_QUEUE_CONTEXT*)malloc(sizeof(IOTHUB_QUEUE_CONTEXT));
-                    if (queue_context == NULL)
-                    {
-                        result = IOTHUB_CLIENT_ERROR;
-                        LogError("Failed allocating QUEUE_CONTEXT");
-                    }
-                    else
+                    batch_context->iotHubClientHandle = iotHubClientInstance;
+                    batch_context->userContextCallback = userContextCallback;
+                    batch_context->pendingConfirmations = eventMessageCount;
+
+                    /* Codes_SRS_IOTHUBCLIENT_31_006: [ IoTHubClient_SendEventBatchAsync shall call IoTHubClientCore_LL_SendEventBatchAsync and return its result. ] */
+                    result = IoTHubClientCore_LL_SendEventBatchAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandles, eventMessageCount, iothub_ll_event_batch_confirm_callback, batch_context);
+                    if (result != IOTHUB_CLIENT_OK)
                     {
-                        queue_context->iotHubClientHandle = iotHubClientInstance;
-                        queue_context->userContextCallback = userContextCallback;
-                        /* Codes_SRS_IOTHUBCLIENT_01_012: [IoTHubClient_SendEventAsync shall call IoTHubClientCore_LL_SendEventAsync, while passing the IoTHubClientCore_LL handle created by IoTHubClient_Create and the parameters eventMessageHandle, eventConfirmationCallback and userContextCallback.] */
-                        /* Codes_SRS_IOTHUBCLIENT_01_013: [When IoTHubClientCore_LL_SendEventAsync is called, IoTHubClient_SendEventAsync shall return the result of IoTHubClientCore_LL_SendEventAsync.] */
-                        result = IoTHubClientCore_LL_SendEventAsync(iotHubClientInstance->IoTHubClientLLHandle, eventMessageHandle, iothub_ll_event_confirm_callback, queue_context);
-                        if (result != IOTHUB_CLIENT_OK)
-                        {
-                            LogError("IoTHubClientCore_LL_SendEventAsync failed");
-                            free(queue_context);
-                        }
+                        LogError("IoTHubClientCore_LL_SendEventBatchAsync failed");
+                        free(batch_context);
                     }
                 }
+            }
 
-                /* Codes_SRS_IOTHUBCLIENT_01_025: [IoTHubClient_SendEventAsync shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
-                (void)Unlock(iotHubClientInstance->LockHandle);
+            if (result == IOTHUB_CLIENT_OK)
+            {
+                signal_worker_thread(iotHubClientInstance);
             }
+
+            (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
 
@@ -1262,6 +2067,12 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetMessageCallback(IOTHUB_CLIENT_CORE_HAND
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    /*the transport subscribes (or unsubscribes) in its next DoWork*/
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 /* Codes_SRS_IOTHUBCLIENT_01_027: [IoTHubClient_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClient_Create.] */
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
@@ -1486,8 +2297,17 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
     {
         IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
 
+        /*producers never start the worker thread themselves once the ingestion queue exists. Like in SendEventAsync this happens
+        before taking LockHandle, the shared transport takes its own locks in the opposite order.*/
+        if ((strcmp(optionName, OPTION_EVENT_INGESTION_QUEUE_SIZE) == 0) &&
+            (*(const size_t*)value != 0) &&
+            (StartWorkerThreadIfNeeded(iotHubClientInstance) != IOTHUB_CLIENT_OK))
+        {
+            result = IOTHUB_CLIENT_ERROR;
+            LogError("Could not start worker thread");
+        }
         /* Codes_SRS_IOTHUBCLIENT_01_041: [ IoTHubClient_SetOption shall be made thread-safe by using the lock created in IoTHubClient_Create. ]*/
-        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        else if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
         {
             /* Codes_SRS_IOTHUBCLIENT_01_042: [ If acquiring the lock fails, IoTHubClient_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
             result = IOTHUB_CLIENT_ERROR;
@@ -1495,11 +2315,97 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetOption(IOTHUB_CLIENT_CORE_HANDLE iotHub
         }
         else
         {
-            /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
-            result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
-            if (result != IOTHUB_CLIENT_OK)
+            if (strcmp(optionName, OPTION_DO_WORK_FREQUENCY_IN_MS) == 0)
+            {
+                tickcounter_ms_t do_work_freq_ms = *(const tickcounter_ms_t*)value;
+                if ((do_work_freq_ms == 0) || (do_work_freq_ms > INT_MAX))
+                {
+                    LogError("invalid value for %s: it has to be between 1 and INT_MAX", OPTION_DO_WORK_FREQUENCY_IN_MS);
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                }
+                else
+                {
+                    iotHubClientInstance->DoWorkFrequencyInMs = (unsigned int)do_work_freq_ms;
+                    signal_worker_thread(iotHubClientInstance);
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(optionName, OPTION_CALLBACK_DISPATCH_THREADS) == 0)
+            {
+                size_t thread_count = *(const size_t*)value;
+                if (iotHubClientInstance->CallbackDispatcher != NULL)
+                {
+                    LogError("%s cannot be changed once the callback dispatch threads are running", OPTION_CALLBACK_DISPATCH_THREADS);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else if (thread_count == 0)
+                {
+                    /*callbacks keep being dispatched from the worker thread*/
+                    result = IOTHUB_CLIENT_OK;
+                }
+                else if ((iotHubClientInstance->CallbackDispatcher = create_callback_dispatcher(iotHubClientInstance, thread_count)) == NULL)
+                {
+                    LogError("unable to create the callback dispatcher");
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(optionName, OPTION_CALLBACK_DISPATCH_QUEUE_SIZE) == 0)
+            {
+                size_t queue_size = *(const size_t*)value;
+                if (queue_size == 0)
+                {
+                    LogError("invalid value for %s: it has to be greater than 0", OPTION_CALLBACK_DISPATCH_QUEUE_SIZE);
+                    result = IOTHUB_CLIENT_INVALID_ARG;
+                }
+                else
+                {
+                    iotHubClientInstance->CallbackQueueSize = queue_size;
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else if (strcmp(optionName, OPTION_EVENT_INGESTION_QUEUE_SIZE) == 0)
+            {
+                size_t queue_size = *(const size_t*)value;
+                INGESTION_QUEUE_HANDLE event_ingestion_queue;
+                if (iotHubClientInstance->EventIngestionQueue != NULL)
+                {
+                    LogError("%s cannot be changed once the ingestion queue exists", OPTION_EVENT_INGESTION_QUEUE_SIZE);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else if (queue_size == 0)
+                {
+                    /*events keep going to the LL layer under LockHandle*/
+                    result = IOTHUB_CLIENT_OK;
+                }
+                else if ((event_ingestion_queue = ingestion_queue_create(queue_size)) == NULL)
+                {
+                    LogError("unable to create the event ingestion queue");
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+                else
+                {
+                    /*the queue has to be fully built before producers that do not take LockHandle can see it*/
+                    publish_ingestion_queue(&iotHubClientInstance->EventIngestionQueue, event_ingestion_queue);
+                    result = IOTHUB_CLIENT_OK;
+                }
+            }
+            else
             {
-                LogError("IoTHubClientCore_LL_SetOption failed");
+                /*Codes_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClient_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
+                result = IoTHubClientCore_LL_SetOption(iotHubClientInstance->IoTHubClientLLHandle, optionName, value);
+                if (result != IOTHUB_CLIENT_OK)
+                {
+                    LogError("IoTHubClientCore_LL_SetOption failed");
+                }
+                else
+                {
+                    /*some options (retry interval, keep alive, ...) change when the next DoWork is due*/
+                    signal_worker_thread(iotHubClientInstance);
+                }
             }
 
             (void)Unlock(iotHubClientInstance->LockHandle);
@@ -1579,6 +2485,12 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetDeviceTwinCallback(IOTHUB_CLIENT_CORE_H
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    /*the transport subscribes and requests the full twin in its next DoWork*/
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -1653,6 +2565,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SendReportedState(IOTHUB_CLIENT_CORE_HANDL
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -1735,6 +2652,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetDeviceMethodCallback(IOTHUB_CLIENT_CORE
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
 
@@ -1819,6 +2741,11 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_SetDeviceMethodCallback_Ex(IOTHUB_CLIENT_C
                     }
                 }
 
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    signal_worker_thread(iotHubClientInstance);
+                }
+
                 (void)Unlock(iotHubClientInstance->LockHandle);
             }
         }
@@ -1854,9 +2781,59 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_DeviceMethodResponse(IOTHUB_CLIENT_CORE_HA
             {
                 LogError("IoTHubClientCore_LL_DeviceMethodResponse failed");
             }
+            else
+            {
+                signal_worker_thread(iotHubClientInstance);
+            }
+            (void)Unlock(iotHubClientInstance->LockHandle);
+        }
+    }
+    return result;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_GetCallbackDispatchStatistics(IOTHUB_CLIENT_CORE_HANDLE iotHubClientHandle, IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS* statistics)
+{
+    IOTHUB_CLIENT_RESULT result;
+
+    if ((iotHubClientHandle == NULL) || (statistics == NULL))
+    {
+        LogError("invalid arg (NULL)");
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_INSTANCE* iotHubClientInstance = (IOTHUB_CLIENT_CORE_INSTANCE*)iotHubClientHandle;
+
+        if (Lock(iotHubClientInstance->LockHandle) != LOCK_OK)
+        {
+            LogError("Could not acquire lock");
+            result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            CALLBACK_DISPATCHER* dispatcher = iotHubClientInstance->CallbackDispatcher;
+            if (dispatcher == NULL)
+            {
+                /*callbacks are dispatched from the worker thread, nothing is measured*/
+                (void)memset(statistics, 0, sizeof(IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS));
+                result = IOTHUB_CLIENT_OK;
+            }
+            else if (Lock(dispatcher->lock) != LOCK_OK)
+            {
+                LogError("Could not acquire dispatcher lock");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                *statistics = dispatcher->statistics;
+                (void)Unlock(dispatcher->lock);
+                result = IOTHUB_CLIENT_OK;
+            }
+
             (void)Unlock(iotHubClientInstance->LockHandle);
         }
     }
+
     return result;
 }
 
@@ -21,6 +21,8 @@
 #include "iothub_client_version.h"
 #include "internal/iothub_client_diagnostic.h"
 #include "internal/iothubtransport.h"
+#include "internal/iothub_client_object_pool.h"
+#include "internal/iothub_message_private.h"
 
 #ifndef DONT_USE_UPLOADTOBLOB
 #include "internal/iothub_client_ll_uploadtoblob.h"
@@ -67,6 +69,7 @@ typedef struct IOTHUB_MESSAGE_CALLBACK_DATA_TAG
     IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC callbackSync;
     IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC_EX callbackAsync;
     void* userContextCallback;
+    bool borrowsMessages; /*callbackSync was set with IoTHubClientCore_LL_SetMessageViewCallback and takes messages whose payload is still the transport's*/
 }IOTHUB_MESSAGE_CALLBACK_DATA;
 
 typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
@@ -82,9 +85,14 @@ typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG
     IOTHUB_METHOD_CALLBACK_DATA methodCallback;
     IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK conStatusCallback;
     void* conStatusUserContextCallback;
+    IOTHUB_CLIENT_MESSAGE_DISPOSITION_CALLBACK dispositionCallback;
+    void* dispositionUserContextCallback;
     time_t lastMessageReceiveTime;
     TICK_COUNTER_HANDLE tickCounter; /*shared tickcounter used to track message timeouts in waitingToSend list*/
     tickcounter_ms_t currentMessageTimeout;
+    tickcounter_ms_t latestQueuedTimeout; /*latest ms_timesOutAfter in waitingToSend, 0 when no message there can time out*/
+    bool queuedTimeoutsOutOfOrder; /*set when a message was queued with an earlier timeout than one already in waitingToSend*/
+    OBJECT_POOL_HANDLE messagePool; /*NULL unless OPTION_MESSAGE_POOL_SIZE was set, then IOTHUB_MESSAGE_LIST entries come from it*/
     uint64_t current_device_twin_timeout;
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
     void* deviceTwinContextCallback;
@@ -124,6 +132,7 @@ static void setTransportProtocol(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData,
     handleData->IoTHubTransport_DoWork = protocol->IoTHubTransport_DoWork;
     handleData->IoTHubTransport_SetRetryPolicy = protocol->IoTHubTransport_SetRetryPolicy;
     handleData->IoTHubTransport_GetSendStatus = protocol->IoTHubTransport_GetSendStatus;
+    handleData->IoTHubTransport_GetTimeToNextDeadline = protocol->IoTHubTransport_GetTimeToNextDeadline;
     handleData->IoTHubTransport_ProcessItem = protocol->IoTHubTransport_ProcessItem;
     handleData->IoTHubTransport_Subscribe_DeviceTwin = protocol->IoTHubTransport_Subscribe_DeviceTwin;
     handleData->IoTHubTransport_Unsubscribe_DeviceTwin = protocol->IoTHubTransport_Unsubscribe_DeviceTwin;
@@ -953,6 +962,38 @@ IOTHUB_CLIENT_CORE_LL_HANDLE IoTHubClientCore_LL_CreateWithTransport(const IOTHU
     return result;
 }
 
+static IOTHUB_MESSAGE_LIST* allocate_message_list_entry(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
+{
+    IOTHUB_MESSAGE_LIST* result;
+
+    if (handleData->messagePool == NULL)
+    {
+        if ((result = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST))) != NULL)
+        {
+            result->pool = NULL;
+        }
+    }
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_012: [ When a message pool is set, the IOTHUB_MESSAGE_LIST entries shall be acquired from it instead of the heap and given back to it when the message completes. ]*/
+    else if ((result = (IOTHUB_MESSAGE_LIST*)object_pool_acquire(handleData->messagePool)) != NULL)
+    {
+        result->pool = handleData->messagePool;
+    }
+
+    return result;
+}
+
+static void free_message_list_entry(IOTHUB_MESSAGE_LIST* entry)
+{
+    if (entry->pool == NULL)
+    {
+        free(entry);
+    }
+    else
+    {
+        object_pool_release(entry->pool, entry);
+    }
+}
+
 void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
     /*Codes_SRS_IOTHUBCLIENT_LL_02_009: [IoTHubClientCore_LL_Destroy shall do nothing if parameter iotHubClientHandle is NULL.]*/
@@ -977,7 +1018,7 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
                 temp->callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, temp->context);
             }
             IoTHubMessage_Destroy(temp->messageHandle);
-            free(temp);
+            free_message_list_entry(temp);
         }
 
         /* Codes_SRS_IOTHUBCLIENT_LL_07_007: [ IoTHubClientCore_LL_Destroy shall iterate the device twin queues and destroy any remaining items. ] */
@@ -999,6 +1040,8 @@ void IoTHubClientCore_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle
         IoTHubClient_LL_UploadToBlob_Destroy(handleData->uploadToBlobHandle);
 #endif
         STRING_delete(handleData->product_info);
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_015: [ IoTHubClientCore_LL_Destroy shall destroy the message pool, which is only freed once a transport still holding entries gives them back. ]*/
+        object_pool_destroy(handleData->messagePool);
         free(handleData);
     }
 }
@@ -1031,7 +1074,30 @@ static int attach_ms_timesOutAfter(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+/*queues eventMessageHandle for sending. With takeOwnership the handle itself is queued instead of a clone, it then belongs to the LL layer once IOTHUB_CLIENT_OK is returned.*/
+static void track_queued_timeout(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, bool wasEmpty, tickcounter_ms_t ms_timesOutAfter)
+{
+    /*transports take messages out of waitingToSend without telling, what they leave behind keeps its order. Messages put back at the head go through IoTHubClientCore_LL_MessagesPutBack*/
+    if (wasEmpty)
+    {
+        handleData->latestQueuedTimeout = 0;
+        handleData->queuedTimeoutsOutOfOrder = false;
+    }
+
+    if (ms_timesOutAfter != 0)
+    {
+        if (ms_timesOutAfter < handleData->latestQueuedTimeout)
+        {
+            handleData->queuedTimeoutsOutOfOrder = true;
+        }
+        else
+        {
+            handleData->latestQueuedTimeout = ms_timesOutAfter;
+        }
+    }
+}
+
+static IOTHUB_CLIENT_RESULT queue_event(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback, bool takeOwnership)
 {
     IOTHUB_CLIENT_RESULT result;
     /*Codes_SRS_IOTHUBCLIENT_LL_02_011: [IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle or eventMessageHandle is NULL.]*/
@@ -1047,7 +1113,8 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
     }
     else
     {
-        IOTHUB_MESSAGE_LIST *newEntry = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST));
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        IOTHUB_MESSAGE_LIST *newEntry = allocate_message_list_entry(handleData);
         if (newEntry == NULL)
         {
             result = IOTHUB_CLIENT_ERROR;
@@ -1055,29 +1122,42 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
         }
         else
         {
-            IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
 
             if (attach_ms_timesOutAfter(handleData, newEntry) != 0)
             {
                 result = IOTHUB_CLIENT_ERROR;
                 LOG_ERROR_RESULT;
-                free(newEntry);
+                free_message_list_entry(newEntry);
             }
             else
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
-                if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle)) == NULL)
+                if (takeOwnership)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_31_002: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add eventMessageHandle itself to the DLIST waitingToSend, without cloning it. ]*/
+                    newEntry->messageHandle = eventMessageHandle;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
+                    newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandle);
+                }
+
+                if (newEntry->messageHandle == NULL)
                 {
                     result = IOTHUB_CLIENT_ERROR;
-                    free(newEntry);
+                    free_message_list_entry(newEntry);
                     LOG_ERROR_RESULT;
                 }
                 else if (IoTHubClient_Diagnostic_AddIfNecessary(&handleData->diagnostic_setting, newEntry->messageHandle) != 0)
                 {
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_014: [If cloning and/or adding the information/diagnostic fails for any reason, IoTHubClientCore_LL_SendEventAsync shall fail and return IOTHUB_CLIENT_ERROR.] */
                     result = IOTHUB_CLIENT_ERROR;
-                    IoTHubMessage_Destroy(newEntry->messageHandle);
-                    free(newEntry);
+                    if (!takeOwnership)
+                    {
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                    }
+                    /*Codes_SRS_IOTHUBCLIENT_LL_31_003: [ If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, eventMessageHandle shall still belong to the caller. ]*/
+                    free_message_list_entry(newEntry);
                     LOG_ERROR_RESULT;
                 }
                 else
@@ -1085,6 +1165,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_013: [IoTHubClientCore_LL_SendEventAsync shall add the DLIST waitingToSend a new record cloning the information from eventMessageHandle, eventConfirmationCallback, userContextCallback.]*/
                     newEntry->callback = eventConfirmationCallback;
                     newEntry->context = userContextCallback;
+                    track_queued_timeout(handleData, handleData->waitingToSend.Flink == &(handleData->waitingToSend), newEntry->ms_timesOutAfter);
                     DList_InsertTailList(&(iotHubClientHandle->waitingToSend), &(newEntry->entry));
                     /*Codes_SRS_IOTHUBCLIENT_LL_02_015: [Otherwise IoTHubClientCore_LL_SendEventAsync shall succeed and return IOTHUB_CLIENT_OK.] */
                     result = IOTHUB_CLIENT_OK;
@@ -1095,7 +1176,123 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HA
     return result;
 }
 
-IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    return queue_event(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, false);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventAsync_TakeOwnership(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE eventMessageHandle, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_001: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall validate its arguments like IoTHubClientCore_LL_SendEventAsync. ]*/
+    return queue_event(iotHubClientHandle, eventMessageHandle, eventConfirmationCallback, userContextCallback, true);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SendEventBatchAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    size_t index;
+
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0 or if any of the messages is NULL. ]*/
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_005: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+    if (
+        (iotHubClientHandle == NULL) ||
+        (eventMessageHandles == NULL) ||
+        (eventMessageCount == 0) ||
+        ((eventConfirmationCallback == NULL) && (userContextCallback != NULL))
+        )
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        for (index = 0; index < eventMessageCount; index++)
+        {
+            if (eventMessageHandles[index] == NULL)
+            {
+                break;
+            }
+        }
+
+        if (index < eventMessageCount)
+        {
+            result = IOTHUB_CLIENT_INVALID_ARG;
+            LogError("NULL message at index %lu of the batch", (unsigned long)index);
+        }
+        else
+        {
+            IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+            IOTHUB_MESSAGE_LIST timeout;
+
+            /*Codes_SRS_IOTHUBCLIENT_LL_31_006: [ IoTHubClientCore_LL_SendEventBatchAsync shall read the tick counter once and give all the messages of the batch the same timeout. ]*/
+            if (attach_ms_timesOutAfter(handleData, &timeout) != 0)
+            {
+                result = IOTHUB_CLIENT_ERROR;
+                LOG_ERROR_RESULT;
+            }
+            else
+            {
+                DLIST_ENTRY batch;
+                DList_InitializeListHead(&batch);
+                result = IOTHUB_CLIENT_OK;
+
+                for (index = 0; index < eventMessageCount; index++)
+                {
+                    IOTHUB_MESSAGE_LIST *newEntry = allocate_message_list_entry(handleData);
+                    if (newEntry == NULL)
+                    {
+                        result = IOTHUB_CLIENT_ERROR;
+                        LOG_ERROR_RESULT;
+                        break;
+                    }
+                    else if ((newEntry->messageHandle = IoTHubMessage_Clone(eventMessageHandles[index])) == NULL)
+                    {
+                        result = IOTHUB_CLIENT_ERROR;
+                        free_message_list_entry(newEntry);
+                        LOG_ERROR_RESULT;
+                        break;
+                    }
+                    else if (IoTHubClient_Diagnostic_AddIfNecessary(&handleData->diagnostic_setting, newEntry->messageHandle) != 0)
+                    {
+                        result = IOTHUB_CLIENT_ERROR;
+                        IoTHubMessage_Destroy(newEntry->messageHandle);
+                        free_message_list_entry(newEntry);
+                        LOG_ERROR_RESULT;
+                        break;
+                    }
+                    else
+                    {
+                        newEntry->ms_timesOutAfter = timeout.ms_timesOutAfter;
+                        newEntry->callback = eventConfirmationCallback;
+                        newEntry->context = userContextCallback;
+                        DList_InsertTailList(&batch, &(newEntry->entry));
+                    }
+                }
+
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_31_007: [ IoTHubClientCore_LL_SendEventBatchAsync shall append all the messages to waitingToSend at once and in order, so that they reach the transport together. ]*/
+                    track_queued_timeout(handleData, handleData->waitingToSend.Flink == &(handleData->waitingToSend), timeout.ms_timesOutAfter);
+                    DList_AppendTailList(&(handleData->waitingToSend), &batch);
+                    (void)DList_RemoveEntryList(&batch);
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_31_008: [ If queuing any of the messages fails, IoTHubClientCore_LL_SendEventBatchAsync shall queue none of them and return IOTHUB_CLIENT_ERROR. ]*/
+                    while (!DList_IsListEmpty(&batch))
+                    {
+                        IOTHUB_MESSAGE_LIST* queued = containingRecord(DList_RemoveHeadList(&batch), IOTHUB_MESSAGE_LIST, entry);
+                        IoTHubMessage_Destroy(queued->messageHandle);
+                        free_message_list_entry(queued);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static IOTHUB_CLIENT_RESULT set_message_callback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback, bool borrowsMessages)
 {
     IOTHUB_CLIENT_RESULT result;
     if (iotHubClientHandle == NULL)
@@ -1129,6 +1326,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_L
                 handleData->messageCallback.callbackSync = NULL;
                 handleData->messageCallback.callbackAsync = NULL;
                 handleData->messageCallback.userContextCallback = NULL;
+                handleData->messageCallback.borrowsMessages = false;
                 result = IOTHUB_CLIENT_OK;
             }
         }
@@ -1148,6 +1346,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_L
                     handleData->messageCallback.type = CALLBACK_TYPE_SYNC;
                     handleData->messageCallback.callbackSync = messageCallback;
                     handleData->messageCallback.userContextCallback = userContextCallback;
+                    handleData->messageCallback.borrowsMessages = borrowsMessages;
                     result = IOTHUB_CLIENT_OK;
                 }
                 else
@@ -1158,6 +1357,7 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_L
                     handleData->messageCallback.callbackSync = NULL;
                     handleData->messageCallback.callbackAsync = NULL;
                     handleData->messageCallback.userContextCallback = NULL;
+                    handleData->messageCallback.borrowsMessages = false;
                     result = IOTHUB_CLIENT_ERROR;
                 }
             }
@@ -1166,6 +1366,17 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_L
     return result;
 }
 
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
+{
+    return set_message_callback(iotHubClientHandle, messageCallback, userContextCallback, false);
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageViewCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC messageCallback, void* userContextCallback)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_016: [IoTHubClientCore_LL_SetMessageViewCallback shall subscribe and unsubscribe like IoTHubClientCore_LL_SetMessageCallback, the messages it receives borrowing their payload from the transport until the callback returns.] */
+    return set_message_callback(iotHubClientHandle, messageCallback, userContextCallback, true);
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageCallback_Ex(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC_EX messageCallback, void* userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1264,26 +1475,60 @@ static void DoTimeouts(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData)
     }
     else
     {
-        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
-        while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+        if (handleData->waitingToSend.Flink == &(handleData->waitingToSend))
         {
-            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
-            /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
-            if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
-            {
-                PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
-                DList_RemoveEntryList(currentItemInWaitingToSend);
-                if (fullEntry->callback != NULL)
+            handleData->latestQueuedTimeout = 0;
+            handleData->queuedTimeoutsOutOfOrder = false;
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_009: [ If none of the messages in waitingToSend can time out, DoTimeouts shall not walk the list. ]*/
+        else if (handleData->latestQueuedTimeout != 0)
+        {
+            tickcounter_ms_t latestTimeout = 0;
+            bool outOfOrder = false;
+            DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+            while (currentItemInWaitingToSend != &(handleData->waitingToSend)) /*while we are not at the end of the list*/
+            {
+                IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+                /*Codes_SRS_IOTHUBCLIENT_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
+                if ((fullEntry->ms_timesOutAfter != 0) && (fullEntry->ms_timesOutAfter < nowTick))
                 {
-                    fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
+                    PDLIST_ENTRY theNext = currentItemInWaitingToSend->Flink; /*need to save the next item, because the below operations are destructive*/
+                    DList_RemoveEntryList(currentItemInWaitingToSend);
+                    if (fullEntry->callback != NULL)
+                    {
+                        fullEntry->callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, fullEntry->context);
+                    }
+                    IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
+                    free_message_list_entry(fullEntry);
+                    currentItemInWaitingToSend = theNext;
+                }
+                else
+                {
+                    if (fullEntry->ms_timesOutAfter != 0)
+                    {
+                        /*Codes_SRS_IOTHUBCLIENT_LL_31_010: [ When the messages were queued in the order of their timeouts, DoTimeouts shall stop at the first message that has not timed out. ]*/
+                        if (!handleData->queuedTimeoutsOutOfOrder)
+                        {
+                            break;
+                        }
+                        else if (fullEntry->ms_timesOutAfter < latestTimeout)
+                        {
+                            outOfOrder = true;
+                        }
+                        else
+                        {
+                            latestTimeout = fullEntry->ms_timesOutAfter;
+                        }
+                    }
+                    currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
                 }
-                IoTHubMessage_Destroy(fullEntry->messageHandle); /*because it has been cloned*/
-                free(fullEntry);
-                currentItemInWaitingToSend = theNext;
             }
-            else
+
+            if (currentItemInWaitingToSend == &(handleData->waitingToSend))
             {
-                currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+                /*Codes_SRS_IOTHUBCLIENT_LL_31_011: [ After walking the whole list DoTimeouts shall remember whether the messages left in waitingToSend are in the order of their timeouts. ]*/
+                handleData->latestQueuedTimeout = latestTimeout;
+                handleData->queuedTimeoutsOutOfOrder = outOfOrder;
             }
         }
     }
@@ -1358,6 +1603,100 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_GetSendStatus(IOTHUB_CLIENT_CORE_LL_HAN
     return result;
 }
 
+/*returns 0 and the ms left until the earliest timeout of the messages in waitingToSend, non-zero when none of them can time out*/
+static int get_time_to_next_queued_timeout(IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData, tickcounter_ms_t* msToTimeout)
+{
+    int result = __FAILURE__;
+
+    if (handleData->latestQueuedTimeout != 0)
+    {
+        tickcounter_ms_t earliestTimeout = 0;
+        tickcounter_ms_t nowTick;
+        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+        while (currentItemInWaitingToSend != &(handleData->waitingToSend))
+        {
+            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+            if ((fullEntry->ms_timesOutAfter != 0) && ((earliestTimeout == 0) || (fullEntry->ms_timesOutAfter < earliestTimeout)))
+            {
+                earliestTimeout = fullEntry->ms_timesOutAfter;
+                /*same shortcut as DoTimeouts, in order the first message that can time out is the earliest*/
+                if (!handleData->queuedTimeoutsOutOfOrder)
+                {
+                    break;
+                }
+            }
+            currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
+        }
+
+        if ((earliestTimeout != 0) && (tickcounter_get_current_ms(handleData->tickCounter, &nowTick) == 0))
+        {
+            *msToTimeout = (earliestTimeout > nowTick) ? (earliestTimeout - nowTick) : 0;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+unsigned int IoTHubClientCore_LL_GetNextDoWorkDelay(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, unsigned int idleDelayInMs)
+{
+    unsigned int result;
+
+    if (iotHubClientHandle == NULL)
+    {
+        LogError("invalid arg (NULL)");
+        result = 1;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        IOTHUB_CLIENT_STATUS sendStatus;
+        bool hasEventsQueued = !DList_IsListEmpty(&(handleData->waitingToSend));
+
+        /*twin requests and reported states awaiting a response need DoWork to keep pumping at the 1 ms cadence*/
+        if (!DList_IsListEmpty(&(handleData->iot_msg_queue)) ||
+            !DList_IsListEmpty(&(handleData->iot_ack_queue)))
+        {
+            result = 1;
+        }
+        else if (handleData->IoTHubTransport_GetSendStatus(handleData->deviceHandle, &sendStatus) != IOTHUB_CLIENT_OK)
+        {
+            result = 1;
+        }
+        else
+        {
+            tickcounter_ms_t delay = (idleDelayInMs == 0) ? 1 : idleDelayInMs;
+
+            if (hasEventsQueued || (sendStatus == IOTHUB_CLIENT_SEND_STATUS_BUSY))
+            {
+                tickcounter_ms_t msToDeadline;
+
+                if (handleData->IoTHubTransport_GetTimeToNextDeadline == NULL)
+                {
+                    /*the transport cannot tell when it needs DoWork again*/
+                    delay = 1;
+                }
+                else
+                {
+                    /*sleep no longer than until the earliest of the transport's deadlines and the message timeouts DoTimeouts enforces*/
+                    if ((handleData->IoTHubTransport_GetTimeToNextDeadline(handleData->transportHandle, &msToDeadline) == 0) && (msToDeadline < delay))
+                    {
+                        delay = msToDeadline;
+                    }
+                    if ((get_time_to_next_queued_timeout(handleData, &msToDeadline) == 0) && (msToDeadline < delay))
+                    {
+                        delay = msToDeadline;
+                    }
+                }
+            }
+
+            result = (delay == 0) ? 1 : (unsigned int)delay;
+        }
+    }
+
+    return result;
+}
+
 void IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
 {
     /*Codes_SRS_IOTHUBCLIENT_LL_02_022: [If parameter completed is NULL, or parameter handle is NULL then IoTHubClientCore_LL_SendBatch shall return.]*/
@@ -1383,8 +1722,43 @@ void IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIS
                 messageList->callback(result, messageList->context);
             }
             IoTHubMessage_Destroy(messageList->messageHandle);
-            free(messageList);
+            free_message_list_entry(messageList);
+        }
+    }
+}
+
+void IoTHubClientCore_LL_MessagesPutBack(IOTHUB_CLIENT_CORE_LL_HANDLE handle)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_029: [ If parameter handle is NULL then IoTHubClientCore_LL_MessagesPutBack shall return. ]*/
+    if (handle == NULL)
+    {
+        LogError("invalid arg");
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_030: [ IoTHubClientCore_LL_MessagesPutBack shall walk waitingToSend and remember the latest timeout of its messages and whether they are in the order of their timeouts. ]*/
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)handle;
+        tickcounter_ms_t latestTimeout = 0;
+        bool outOfOrder = false;
+        DLIST_ENTRY* currentItemInWaitingToSend = handleData->waitingToSend.Flink;
+        while (currentItemInWaitingToSend != &(handleData->waitingToSend))
+        {
+            IOTHUB_MESSAGE_LIST* fullEntry = containingRecord(currentItemInWaitingToSend, IOTHUB_MESSAGE_LIST, entry);
+            if (fullEntry->ms_timesOutAfter != 0)
+            {
+                if (fullEntry->ms_timesOutAfter < latestTimeout)
+                {
+                    outOfOrder = true;
+                }
+                else
+                {
+                    latestTimeout = fullEntry->ms_timesOutAfter;
+                }
+            }
+            currentItemInWaitingToSend = currentItemInWaitingToSend->Flink;
         }
+        handleData->latestQueuedTimeout = latestTimeout;
+        handleData->queuedTimeoutsOutOfOrder = outOfOrder;
     }
 }
 
@@ -1528,24 +1902,42 @@ bool IoTHubClientCore_LL_MessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE handle, ME
             }
             case CALLBACK_TYPE_SYNC:
             {
-                /*Codes_SRS_IOTHUBCLIENT_LL_02_030: [If messageCallbackType is LEGACY then IoTHubClientCore_LL_MessageCallback shall invoke the last callback function (the parameter messageCallback to IoTHubClientCore_LL_SetMessageCallback) passing the message and the passed userContextCallback.]*/
-                IOTHUBMESSAGE_DISPOSITION_RESULT cb_result = handleData->messageCallback.callbackSync(messageData->messageHandle, handleData->messageCallback.userContextCallback);
-
-                /*Codes_SRS_IOTHUBCLIENT_LL_10_007: [If messageCallbackType is LEGACY then IoTHubClientCore_LL_MessageCallback shall send the message disposition as returned by the client to the underlying layer.] */
-                if (handleData->IoTHubTransport_SendMessageDisposition(messageData, cb_result) != IOTHUB_CLIENT_OK)
+                /*Codes_SRS_IOTHUBCLIENT_LL_31_017: [Unless the callback was set with IoTHubClientCore_LL_SetMessageViewCallback, IoTHubClientCore_LL_MessageCallback shall make the message own its payload with IoTHubMessage_OwnContent before invoking the callback, and return false if that fails.] */
+                if (!handleData->messageCallback.borrowsMessages && (IoTHubMessage_OwnContent(messageData->messageHandle) != IOTHUB_MESSAGE_OK))
                 {
-                    LogError("IoTHubTransport_SendMessageDisposition failed");
+                    LogError("unable to copy the payload of the received message");
+                    result = false;
+                }
+                else
+                {
+                    /*Codes_SRS_IOTHUBCLIENT_LL_02_030: [If messageCallbackType is LEGACY then IoTHubClientCore_LL_MessageCallback shall invoke the last callback function (the parameter messageCallback to IoTHubClientCore_LL_SetMessageCallback) passing the message and the passed userContextCallback.]*/
+                    IOTHUBMESSAGE_DISPOSITION_RESULT cb_result = handleData->messageCallback.callbackSync(messageData->messageHandle, handleData->messageCallback.userContextCallback);
+
+                    /*Codes_SRS_IOTHUBCLIENT_LL_10_007: [If messageCallbackType is LEGACY then IoTHubClientCore_LL_MessageCallback shall send the message disposition as returned by the client to the underlying layer.] */
+                    if (handleData->IoTHubTransport_SendMessageDisposition(messageData, cb_result) != IOTHUB_CLIENT_OK)
+                    {
+                        LogError("IoTHubTransport_SendMessageDisposition failed");
+                    }
+                    result = true;
                 }
-                result = true;
                 break;
             }
             case CALLBACK_TYPE_ASYNC:
             {
-                /* Codes_SRS_IOTHUBCLIENT_LL_10_009: [If messageCallbackType is ASYNC then IoTHubClientCore_LL_MessageCallback shall return what messageCallbacEx returns.] */
-                result = handleData->messageCallback.callbackAsync(messageData, handleData->messageCallback.userContextCallback);
-                if (!result)
+                /*Codes_SRS_IOTHUBCLIENT_LL_31_018: [If messageCallbackType is ASYNC, IoTHubClientCore_LL_MessageCallback shall make the message own its payload with IoTHubMessage_OwnContent before handing it over, since the message outlives the call, and return false if that fails.] */
+                if (IoTHubMessage_OwnContent(messageData->messageHandle) != IOTHUB_MESSAGE_OK)
                 {
-                    LogError("messageCallbackEx failed");
+                    LogError("unable to copy the payload of the received message");
+                    result = false;
+                }
+                else
+                {
+                    /* Codes_SRS_IOTHUBCLIENT_LL_10_009: [If messageCallbackType is ASYNC then IoTHubClientCore_LL_MessageCallback shall return what messageCallbacEx returns.] */
+                    result = handleData->messageCallback.callbackAsync(messageData, handleData->messageCallback.userContextCallback);
+                    if (!result)
+                    {
+                        LogError("messageCallbackEx failed");
+                    }
                 }
                 break;
             }
@@ -1581,6 +1973,51 @@ void IoTHubClientCore_LL_ConnectionStatusCallBack(IOTHUB_CLIENT_CORE_LL_HANDLE h
 
 }
 
+void IoTHubClientCore_LL_MessageDispositionComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition, IOTHUB_CLIENT_RESULT result)
+{
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_024: [ If parameter handle or message is NULL then IoTHubClientCore_LL_MessageDispositionComplete shall return. ]*/
+    if ((handle == NULL) || (message == NULL))
+    {
+        LogError("invalid arg handle=%p, message=%p", handle, message);
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)handle;
+
+        if (handleData->dispositionCallback != NULL)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_31_025: [ IoTHubClientCore_LL_MessageDispositionComplete shall call the callback set with IoTHubClientCore_LL_SetMessageDispositionCallback passing the message, disposition, result and the saved userContextCallback. ]*/
+            handleData->dispositionCallback(message, disposition, result, handleData->dispositionUserContextCallback);
+        }
+        else if (result != IOTHUB_CLIENT_OK)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_31_026: [ If no callback is set and result is not IOTHUB_CLIENT_OK, IoTHubClientCore_LL_MessageDispositionComplete shall log the failure. ]*/
+            LogError("IoTHubTransport_SendMessageDisposition failed (disposition=%d)", (int)disposition);
+        }
+    }
+}
+
+IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetMessageDispositionCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_MESSAGE_DISPOSITION_CALLBACK dispositionCallback, void* userContextCallback)
+{
+    IOTHUB_CLIENT_RESULT result;
+    /*Codes_SRS_IOTHUBCLIENT_LL_31_027: [ IoTHubClientCore_LL_SetMessageDispositionCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle. ]*/
+    if (iotHubClientHandle == NULL)
+    {
+        result = IOTHUB_CLIENT_INVALID_ARG;
+        LOG_ERROR_RESULT;
+    }
+    else
+    {
+        IOTHUB_CLIENT_CORE_LL_HANDLE_DATA* handleData = (IOTHUB_CLIENT_CORE_LL_HANDLE_DATA*)iotHubClientHandle;
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_028: [ IoTHubClientCore_LL_SetMessageDispositionCallback shall return IOTHUB_CLIENT_OK and save the callback and userContext as a member of the handle. ]*/
+        handleData->dispositionCallback = dispositionCallback;
+        handleData->dispositionUserContextCallback = userContextCallback;
+        result = IOTHUB_CLIENT_OK;
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetConnectionStatusCallback(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback, void * userContextCallback)
 {
     IOTHUB_CLIENT_RESULT result;
@@ -1759,18 +2196,52 @@ IOTHUB_CLIENT_RESULT IoTHubClientCore_LL_SetOption(IOTHUB_CLIENT_CORE_LL_HANDLE
                 result = IOTHUB_CLIENT_OK;
             }
         }
-        else if (strcmp(optionName, OPTION_BLOB_UPLOAD_TIMEOUT_SECS) == 0)
+        else if (strcmp(optionName, OPTION_MESSAGE_POOL_SIZE) == 0)
+        {
+            /*Codes_SRS_IOTHUBCLIENT_LL_31_013: [ "message_pool_size" - IoTHubClientCore_LL_SetOption shall first pass the option to Transport_SetOption and return its failure code if it fails. ]*/
+            result = handleData->IoTHubTransport_SetOption(handleData->transportHandle, optionName, value);
+            if (result != IOTHUB_CLIENT_OK)
+            {
+                LogError("unable to IoTHubTransport_SetOption");
+            }
+            else
+            {
+                size_t reservedCount = *(const size_t*)value;
+                OBJECT_POOL_HANDLE newPool;
+
+                /*Codes_SRS_IOTHUBCLIENT_LL_31_014: [ IoTHubClientCore_LL_SetOption shall replace the message pool by one reserving value entries, or by none when value is 0; entries already queued go back to the pool they came from. ]*/
+                if (reservedCount == 0)
+                {
+                    newPool = NULL;
+                }
+                else if ((newPool = object_pool_create(sizeof(IOTHUB_MESSAGE_LIST), reservedCount)) == NULL)
+                {
+                    LogError("unable to create a message pool of %lu entries", (unsigned long)reservedCount);
+                    result = IOTHUB_CLIENT_ERROR;
+                }
+
+                if (result == IOTHUB_CLIENT_OK)
+                {
+                    object_pool_destroy(handleData->messagePool);
+                    handleData->messagePool = newPool;
+                }
+            }
+        }
+        else if ((strcmp(optionName, OPTION_BLOB_UPLOAD_TIMEOUT_SECS) == 0) ||
+            (strcmp(optionName, OPTION_BLOB_UPLOAD_CONCURRENCY) == 0) ||
+            (strcmp(optionName, OPTION_BLOB_UPLOAD_BLOCK_SIZE) == 0))
         {
 #ifndef DONT_USE_UPLOADTOBLOB
             // This option just gets passed down into IoTHubClientCore_LL_UploadToBlob
             /*Codes_SRS_IOTHUBCLIENT_LL_30_010: [ blob_xfr_timeout - IoTHubClientCore_LL_SetOption shall pass this option to IoTHubClient_UploadToBlob_SetOption and return its result. ]*/
+            /*Codes_SRS_IOTHUBCLIENT_LL_31_023: [ blob_upload_concurrency and blob_upload_block_size - IoTHubClientCore_LL_SetOption shall pass these options to IoTHubClient_UploadToBlob_SetOption and return its result. ]*/
             result = IoTHubClient_LL_UploadToBlob_SetOption(handleData->uploadToBlobHandle, optionName, value);
             if(result != IOTHUB_CLIENT_OK)
             {
                 LogError("unable to IoTHubClientCore_LL_UploadToBlob_SetOption");
             }
 #else
-            LogError("OPTION_BLOB_TRANSFER_TIMEOUT option being set with DONT_USE_UPLOADTOBLOB compiler switch");
+            LogError("%s option being set with DONT_USE_UPLOADTOBLOB compiler switch", optionName);
             result = IOTHUB_CLIENT_ERROR;
 #endif /*DONT_USE_UPLOADTOBLOB*/
         }
@@ -0,0 +1,377 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_ingestion_queue.h"
+
+/*same selection as azure_c_shared_utility/refcount.h: C11 atomics when available, then the platform intrinsics*/
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+typedef size_t INGESTION_INDEX;
+typedef intptr_t INGESTION_DISTANCE;
+typedef atomic_size_t INGESTION_COUNTER;
+#define INGESTION_QUEUE_HAS_ATOMICS 1
+#elif defined(WIN32)
+#include "windows.h"
+/*the Interlocked functions work on a signed LONG, the indexes are kept unsigned so that they wrap around without overflowing*/
+typedef ULONG INGESTION_INDEX;
+typedef LONG INGESTION_DISTANCE;
+typedef volatile LONG INGESTION_COUNTER;
+#define INGESTION_QUEUE_HAS_ATOMICS 1
+#elif defined(__GNUC__)
+typedef size_t INGESTION_INDEX;
+typedef intptr_t INGESTION_DISTANCE;
+typedef volatile size_t INGESTION_COUNTER;
+#define INGESTION_QUEUE_HAS_ATOMICS 1
+#else
+typedef size_t INGESTION_INDEX;
+typedef intptr_t INGESTION_DISTANCE;
+typedef size_t INGESTION_COUNTER;
+#endif
+
+/*keeps the indexes far enough from the wrap around for the signed distance between them to be meaningful*/
+#define INGESTION_QUEUE_MAX_CAPACITY ((size_t)1 << 30)
+#define INGESTION_QUEUE_CACHE_LINE_SIZE 64
+
+typedef struct INGESTION_CELL_TAG
+{
+    INGESTION_COUNTER sequence; /*equal to the index of the push that may write the cell, that index + 1 once the item can be popped*/
+    void* item;
+} INGESTION_CELL;
+
+typedef struct INGESTION_QUEUE_TAG
+{
+    INGESTION_CELL* cells;
+    INGESTION_INDEX mask;
+    char pad_producer[INGESTION_QUEUE_CACHE_LINE_SIZE];
+    INGESTION_COUNTER push_index; /*shared by all producers*/
+    char pad_consumer[INGESTION_QUEUE_CACHE_LINE_SIZE];
+    INGESTION_INDEX pop_index; /*only touched by the consumer*/
+    INGESTION_COUNTER consumer_waiting; /*1 while the consumer is about to sleep or sleeping*/
+} INGESTION_QUEUE;
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_ATOMICS__)
+static void counter_init(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    atomic_init(counter, value);
+}
+
+static INGESTION_INDEX counter_load(INGESTION_COUNTER* counter)
+{
+    return atomic_load_explicit(counter, memory_order_acquire);
+}
+
+static void counter_store(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    atomic_store_explicit(counter, value, memory_order_release);
+}
+
+static bool counter_compare_exchange(INGESTION_COUNTER* counter, INGESTION_INDEX expected, INGESTION_INDEX desired)
+{
+    return atomic_compare_exchange_strong_explicit(counter, &expected, desired, memory_order_relaxed, memory_order_relaxed);
+}
+
+static void full_fence(void)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+}
+#elif defined(WIN32)
+static void counter_init(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    *counter = (LONG)value;
+}
+
+static INGESTION_INDEX counter_load(INGESTION_COUNTER* counter)
+{
+    INGESTION_INDEX value = (INGESTION_INDEX)*counter;
+    MemoryBarrier();
+    return value;
+}
+
+static void counter_store(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    MemoryBarrier();
+    *counter = (LONG)value;
+}
+
+static bool counter_compare_exchange(INGESTION_COUNTER* counter, INGESTION_INDEX expected, INGESTION_INDEX desired)
+{
+    return InterlockedCompareExchange(counter, (LONG)desired, (LONG)expected) == (LONG)expected;
+}
+
+static void full_fence(void)
+{
+    MemoryBarrier();
+}
+#elif defined(__GNUC__)
+static void counter_init(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    *counter = value;
+}
+
+static INGESTION_INDEX counter_load(INGESTION_COUNTER* counter)
+{
+    INGESTION_INDEX value = *counter;
+    __sync_synchronize();
+    return value;
+}
+
+static void counter_store(INGESTION_COUNTER* counter, INGESTION_INDEX value)
+{
+    __sync_synchronize();
+    *counter = value;
+}
+
+static bool counter_compare_exchange(INGESTION_COUNTER* counter, INGESTION_INDEX expected, INGESTION_INDEX desired)
+{
+    return __sync_bool_compare_and_swap(counter, expected, desired);
+}
+
+static void full_fence(void)
+{
+    __sync_synchronize();
+}
+#endif
+
+INGESTION_QUEUE_HANDLE ingestion_queue_create(size_t capacity)
+{
+    INGESTION_QUEUE* result;
+
+#ifndef INGESTION_QUEUE_HAS_ATOMICS
+    (void)capacity;
+    /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_001: [ If the platform offers no atomic operations, ingestion_queue_create shall fail and return NULL. ]*/
+    LogError("no atomic operations available on this platform");
+    result = NULL;
+#else
+    if ((capacity == 0) || (capacity > INGESTION_QUEUE_MAX_CAPACITY))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_002: [ If capacity is 0 or greater than 2^30, ingestion_queue_create shall fail and return NULL. ]*/
+        LogError("invalid capacity %lu", (unsigned long)capacity);
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_003: [ ingestion_queue_create shall allocate the queue and an array of cells whose size is capacity rounded up to the next power of 2. ]*/
+    else if ((result = (INGESTION_QUEUE*)malloc(sizeof(INGESTION_QUEUE))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_004: [ If any allocation fails, ingestion_queue_create shall fail and return NULL. ]*/
+        LogError("failed allocating INGESTION_QUEUE");
+    }
+    else
+    {
+        size_t cell_count = 2;
+        while (cell_count < capacity)
+        {
+            cell_count <<= 1;
+        }
+
+        if ((result->cells = (INGESTION_CELL*)malloc(cell_count * sizeof(INGESTION_CELL))) == NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_004: [ If any allocation fails, ingestion_queue_create shall fail and return NULL. ]*/
+            LogError("failed allocating %lu ingestion cells", (unsigned long)cell_count);
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            size_t index;
+            for (index = 0; index < cell_count; index++)
+            {
+                counter_init(&result->cells[index].sequence, (INGESTION_INDEX)index);
+                result->cells[index].item = NULL;
+            }
+            result->mask = (INGESTION_INDEX)(cell_count - 1);
+            counter_init(&result->push_index, 0);
+            result->pop_index = 0;
+            counter_init(&result->consumer_waiting, 0);
+        }
+    }
+#endif
+
+    return result;
+}
+
+int ingestion_queue_push(INGESTION_QUEUE_HANDLE queue, void* item)
+{
+    int result;
+
+    if ((queue == NULL) || (item == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_005: [ If queue or item is NULL, ingestion_queue_push shall fail and return a non-zero value. ]*/
+        LogError("invalid argument (queue=%p, item=%p)", queue, item);
+        result = __FAILURE__;
+    }
+    else
+    {
+#ifndef INGESTION_QUEUE_HAS_ATOMICS
+        result = __FAILURE__;
+#else
+        INGESTION_INDEX position = counter_load(&queue->push_index);
+        INGESTION_CELL* cell = NULL;
+        bool is_full = false;
+
+        while (cell == NULL)
+        {
+            INGESTION_CELL* candidate = &queue->cells[position & queue->mask];
+            INGESTION_DISTANCE distance = (INGESTION_DISTANCE)(counter_load(&candidate->sequence) - position);
+
+            if (distance == 0)
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_006: [ ingestion_queue_push shall claim the next cell by atomically advancing the push index, without taking any lock. ]*/
+                if (counter_compare_exchange(&queue->push_index, position, position + 1))
+                {
+                    cell = candidate;
+                }
+                else
+                {
+                    position = counter_load(&queue->push_index);
+                }
+            }
+            else if (distance < 0)
+            {
+                /*the consumer has not yet released the cell from the previous lap*/
+                is_full = true;
+                break;
+            }
+            else
+            {
+                /*another producer claimed this cell first*/
+                position = counter_load(&queue->push_index);
+            }
+        }
+
+        if (is_full)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_007: [ If the queue is full, ingestion_queue_push shall fail and return a non-zero value. ]*/
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_008: [ ingestion_queue_push shall store item in the cell and then publish it to the consumer. ]*/
+            cell->item = item;
+            counter_store(&cell->sequence, position + 1);
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_009: [ On success ingestion_queue_push shall return 0. ]*/
+            result = 0;
+        }
+#endif
+    }
+
+    return result;
+}
+
+void* ingestion_queue_pop(INGESTION_QUEUE_HANDLE queue)
+{
+    void* result;
+
+    if (queue == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_010: [ If queue is NULL, ingestion_queue_pop shall return NULL. ]*/
+        LogError("invalid argument (queue is NULL)");
+        result = NULL;
+    }
+    else
+    {
+#ifndef INGESTION_QUEUE_HAS_ATOMICS
+        result = NULL;
+#else
+        INGESTION_INDEX position = queue->pop_index;
+        INGESTION_CELL* cell = &queue->cells[position & queue->mask];
+
+        if ((INGESTION_DISTANCE)(counter_load(&cell->sequence) - (position + 1)) != 0)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_011: [ If the oldest cell has not been published yet, ingestion_queue_pop shall return NULL. ]*/
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_012: [ Otherwise ingestion_queue_pop shall return the oldest item and hand its cell back to the producers. ]*/
+            result = cell->item;
+            cell->item = NULL;
+            counter_store(&cell->sequence, position + queue->mask + 1);
+            queue->pop_index = position + 1;
+        }
+#endif
+    }
+
+    return result;
+}
+
+bool ingestion_queue_is_empty(INGESTION_QUEUE_HANDLE queue)
+{
+    bool result;
+
+    if (queue == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_013: [ If queue is NULL, ingestion_queue_is_empty shall return true. ]*/
+        result = true;
+    }
+    else
+    {
+#ifndef INGESTION_QUEUE_HAS_ATOMICS
+        result = true;
+#else
+        INGESTION_INDEX position = queue->pop_index;
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_014: [ ingestion_queue_is_empty shall return false if ingestion_queue_pop would return an item, true otherwise. ]*/
+        result = ((INGESTION_DISTANCE)(counter_load(&queue->cells[position & queue->mask].sequence) - (position + 1)) != 0);
+#endif
+    }
+
+    return result;
+}
+
+/*a producer publishes its item and then reads the flag, the consumer raises the flag and then looks for items: with a full fence
+between the store and the load on both sides at least one of them sees the other, so a wake-up is never lost*/
+void ingestion_queue_set_consumer_waiting(INGESTION_QUEUE_HANDLE queue, bool waiting)
+{
+    if (queue == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_017: [ If queue is NULL, ingestion_queue_set_consumer_waiting shall return. ]*/
+        LogError("invalid argument (queue is NULL)");
+    }
+    else
+    {
+#ifdef INGESTION_QUEUE_HAS_ATOMICS
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_018: [ ingestion_queue_set_consumer_waiting shall store waiting and then issue a full memory fence. ]*/
+        counter_store(&queue->consumer_waiting, waiting ? 1 : 0);
+        full_fence();
+#else
+        (void)waiting;
+#endif
+    }
+}
+
+bool ingestion_queue_is_consumer_waiting(INGESTION_QUEUE_HANDLE queue)
+{
+    bool result;
+
+    if (queue == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_019: [ If queue is NULL, ingestion_queue_is_consumer_waiting shall return false. ]*/
+        result = false;
+    }
+    else
+    {
+#ifndef INGESTION_QUEUE_HAS_ATOMICS
+        result = false;
+#else
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_020: [ ingestion_queue_is_consumer_waiting shall issue a full memory fence and then return the last value stored by ingestion_queue_set_consumer_waiting. ]*/
+        full_fence();
+        result = (counter_load(&queue->consumer_waiting) != 0);
+#endif
+    }
+
+    return result;
+}
+
+void ingestion_queue_destroy(INGESTION_QUEUE_HANDLE queue)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_015: [ If queue is NULL, ingestion_queue_destroy shall return. ]*/
+    if (queue != NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_016: [ ingestion_queue_destroy shall free the cells and the queue. Items still queued are not touched. ]*/
+        free(queue->cells);
+        free(queue);
+    }
+}
@@ -71,6 +71,8 @@ typedef struct IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA_TAG
     HTTP_PROXY_OPTIONS http_proxy_options;
     size_t curl_verbose;
     size_t blob_upload_timeout_secs;
+    size_t blob_upload_concurrency;             /*blocks on the wire at the same time*/
+    size_t blob_upload_block_size;              /*0 when the blocks are the chunks returned by the getDataCallback*/
 }IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA;
 
 typedef struct BLOB_UPLOAD_CONTEXT_TAG
@@ -78,6 +80,7 @@ typedef struct BLOB_UPLOAD_CONTEXT_TAG
     const unsigned char* blobSource; /* source to upload */
     size_t blobSourceSize; /* size of the source */
     size_t remainingSizeToUpload; /* size not yet uploaded */
+    size_t blockSize; /* size of the blocks the source is split in */
 }BLOB_UPLOAD_CONTEXT;
 
 IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const IOTHUB_CLIENT_CONFIG* config)
@@ -124,6 +127,8 @@ IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE IoTHubClient_LL_UploadToBlob_Create(const I
                 memset(&(handleData->http_proxy_options), 0, sizeof(HTTP_PROXY_OPTIONS));
                 handleData->curl_verbose = 0;
                 handleData->blob_upload_timeout_secs = 0;
+                handleData->blob_upload_concurrency = 1;
+                handleData->blob_upload_block_size = 0;
 
                 if ((config->deviceSasToken != NULL) && (config->deviceKey == NULL))
                 {
@@ -796,7 +801,7 @@ static IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT FileUpload_GetData_Callback(IOT
     else
     {
         // Upload next block
-        size_t thisBlockSize = (uploadContext->remainingSizeToUpload > BLOCK_SIZE) ? BLOCK_SIZE : uploadContext->remainingSizeToUpload;
+        size_t thisBlockSize = (uploadContext->remainingSizeToUpload > uploadContext->blockSize) ? uploadContext->blockSize : uploadContext->remainingSizeToUpload;
         *data = (unsigned char*)uploadContext->blobSource + (uploadContext->blobSourceSize - uploadContext->remainingSizeToUpload);
         *size = thisBlockSize;
         uploadContext->remainingSizeToUpload -= thisBlockSize;
@@ -952,8 +957,20 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadMultipleBlocksToBlob_Impl(IOTHUB_CLIE
                                         }
                                         else
                                         {
-                                            /*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadMultipleBlocksToBlob(Ex) shall call Blob_UploadFromSasUri and capture the HTTP return code and HTTP body. ]*/
-                                            BLOB_RESULT uploadMultipleBlocksResult = Blob_UploadMultipleBlocksFromSasUri(STRING_c_str(sasUri), getDataCallbackEx, context, &httpResponse, responseToIoTHub, handleData->certificates, &(handleData->http_proxy_options));
+                                            BLOB_RESULT uploadMultipleBlocksResult;
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+                                            if ((handleData->blob_upload_concurrency > 1) || (handleData->blob_upload_block_size != 0))
+                                            {
+                                                /*Codes_SRS_IOTHUBCLIENT_LL_31_021: [ If blob_upload_concurrency is more than 1 or blob_upload_block_size is not 0, IoTHubClient_LL_UploadMultipleBlocksToBlob(Ex) shall call Blob_UploadMultipleBlocksInParallelFromSasUri with both values instead of Blob_UploadMultipleBlocksFromSasUri. ]*/
+                                                uploadMultipleBlocksResult = Blob_UploadMultipleBlocksInParallelFromSasUri(STRING_c_str(sasUri), getDataCallbackEx, context, &httpResponse, responseToIoTHub, handleData->certificates, &(handleData->http_proxy_options), handleData->blob_upload_concurrency, handleData->blob_upload_block_size);
+                                            }
+                                            else
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+                                            {
+                                                /*Codes_SRS_IOTHUBCLIENT_LL_02_083: [ IoTHubClient_LL_UploadMultipleBlocksToBlob(Ex) shall call Blob_UploadFromSasUri and capture the HTTP return code and HTTP body. ]*/
+                                                /*Codes_SRS_IOTHUBCLIENT_LL_31_032: [ If the SDK was built with DONT_USE_HTTP_WORKER_THREADS, IoTHubClient_LL_UploadMultipleBlocksToBlob(Ex) shall always call Blob_UploadMultipleBlocksFromSasUri. ]*/
+                                                uploadMultipleBlocksResult = Blob_UploadMultipleBlocksFromSasUri(STRING_c_str(sasUri), getDataCallbackEx, context, &httpResponse, responseToIoTHub, handleData->certificates, &(handleData->http_proxy_options));
+                                            }
                                             if (uploadMultipleBlocksResult == BLOB_ABORTED)
                                             {
                                                 /*Codes_SRS_IOTHUBCLIENT_LL_99_008: [ If step 2 is aborted by the client, then the HTTP message body shall look like:  ]*/
@@ -1066,13 +1083,22 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_Impl(IOTHUB_CLIENT_LL_UPLOADTO
         LogError("invalid source and size combination: source=%p size=%zu", source, size);
         result = IOTHUB_CLIENT_INVALID_ARG;
     }
+    else if (handle == NULL)
+    {
+        LogError("invalid argument detected handle=%p", handle);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
     else
     {
+        IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA* handleData = (IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE_DATA*)handle;
+
         /*Codes_SRS_IOTHUBCLIENT_LL_99_001: [ `IoTHubClient_LL_UploadToBlob` shall create a struct containing the `source`, the `size`, and the remaining size to upload.]*/
         BLOB_UPLOAD_CONTEXT context;
         context.blobSource = source;
         context.blobSourceSize = size;
         context.remainingSizeToUpload = size;
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_022: [ IoTHubClient_LL_UploadToBlob shall split source in blocks of blob_upload_block_size bytes, or of 4MB when blob_upload_block_size is 0. ]*/
+        context.blockSize = (handleData->blob_upload_block_size != 0) ? handleData->blob_upload_block_size : BLOCK_SIZE;
 
         /*Codes_SRS_IOTHUBCLIENT_LL_99_002: [ `IoTHubClient_LL_UploadToBlob` shall call `IoTHubClient_LL_UploadMultipleBlocksToBlob_Impl` with `FileUpload_GetData_Callback` as `getDataCallbackEx` and pass the struct created at step SRS_IOTHUBCLIENT_LL_99_001 as `context` ]*/
         result = IoTHubClient_LL_UploadMultipleBlocksToBlob_Impl(handle, destinationFileName, FileUpload_GetData_Callback, &context);
@@ -1313,6 +1339,42 @@ IOTHUB_CLIENT_RESULT IoTHubClient_LL_UploadToBlob_SetOption(IOTHUB_CLIENT_LL_UPL
             handleData->blob_upload_timeout_secs = *(size_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_019: [ blob_upload_concurrency - value is a pointer to a size_t, the number of blocks uploaded at the same time. If it is 0 then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        else if (strcmp(optionName, OPTION_BLOB_UPLOAD_CONCURRENCY) == 0)
+        {
+            if (*(size_t*)value == 0)
+            {
+                LogError("invalid value for %s", OPTION_BLOB_UPLOAD_CONCURRENCY);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+#ifdef DONT_USE_HTTP_WORKER_THREADS
+            else if (*(size_t*)value > 1)
+            {
+                /*Codes_SRS_IOTHUBCLIENT_LL_31_031: [ If the SDK was built with DONT_USE_HTTP_WORKER_THREADS, a blob_upload_concurrency above 1 shall make IoTHubClient_LL_UploadToBlob_SetOption return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("%s cannot be more than 1 when built with DONT_USE_HTTP_WORKER_THREADS", OPTION_BLOB_UPLOAD_CONCURRENCY);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+            else
+            {
+                handleData->blob_upload_concurrency = *(size_t*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBCLIENT_LL_31_020: [ blob_upload_block_size - value is a pointer to a size_t, the size of the blocks. If it is bigger than 4MB then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+        else if (strcmp(optionName, OPTION_BLOB_UPLOAD_BLOCK_SIZE) == 0)
+        {
+            if (*(size_t*)value > BLOCK_SIZE)
+            {
+                LogError("invalid value for %s, the blocks are at most %d bytes", OPTION_BLOB_UPLOAD_BLOCK_SIZE, BLOCK_SIZE);
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+            else
+            {
+                handleData->blob_upload_block_size = *(size_t*)value;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
         else
         {
             /*Codes_SRS_IOTHUBCLIENT_LL_02_102: [ If an unknown option is presented then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
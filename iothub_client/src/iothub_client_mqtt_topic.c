@@ -0,0 +1,516 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/urlencode.h"
+#include "internal/iothub_client_mqtt_topic.h"
+
+#define TOPIC_BUFFER_INITIAL_CAPACITY 128
+
+static const char TOPIC_DEVICE_TWIN_PREFIX[] = "$iothub/twin";
+static const char TOPIC_DEVICE_METHOD_PREFIX[] = "$iothub/methods";
+static const char TOPIC_DEVICE_BOUND_SEGMENT[] = "/messages/devicebound/";
+static const char TWIN_PATCH_SEGMENT[] = "PATCH";
+static const char REQUEST_ID_PROPERTY[] = "?$rid=";
+
+static const char PROPERTY_SEPARATOR[] = "&";
+static const char SYSTEM_PROPERTY_PREFIX[] = "%24.";
+static const char CORRELATION_ID_PROPERTY[] = "cid";
+static const char MESSAGE_ID_PROPERTY[] = "mid";
+static const char CONTENT_TYPE_PROPERTY[] = "ct";
+static const char CONTENT_ENCODING_PROPERTY[] = "ce";
+static const char DIAGNOSTIC_ID_PROPERTY[] = "diagid";
+static const char DIAGNOSTIC_CONTEXT_PROPERTY[] = "diagctx";
+/*the diagnostic context is the URL encoded "creationtimeutc=<time>"*/
+static const char DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PREFIX[] = "creationtimeutc%3d";
+
+#define SYSTEM_PROPERTY_COUNT 4
+
+typedef struct TOPIC_WRITER_TAG
+{
+    MQTT_TOPIC_BUFFER* topic_buffer;
+    size_t length;
+    size_t property_count;
+} TOPIC_WRITER;
+
+static int ensure_capacity(MQTT_TOPIC_BUFFER* topic_buffer, size_t size)
+{
+    int result;
+
+    if (size <= topic_buffer->capacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t new_capacity = (topic_buffer->capacity == 0) ? TOPIC_BUFFER_INITIAL_CAPACITY : topic_buffer->capacity;
+        char* new_buffer;
+
+        while ((new_capacity < size) && (new_capacity <= SIZE_MAX / 2))
+        {
+            new_capacity *= 2;
+        }
+
+        if (new_capacity < size)
+        {
+            LogError("A topic of %lu bytes is too large", (unsigned long)size);
+            result = __FAILURE__;
+        }
+        else if ((new_buffer = (char*)realloc(topic_buffer->buffer, new_capacity)) == NULL)
+        {
+            LogError("Failed growing the topic buffer to %lu bytes", (unsigned long)new_capacity);
+            result = __FAILURE__;
+        }
+        else
+        {
+            topic_buffer->buffer = new_buffer;
+            topic_buffer->capacity = new_capacity;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int append(TOPIC_WRITER* writer, const char* text, size_t length)
+{
+    int result;
+
+    if (ensure_capacity(writer->topic_buffer, writer->length + length + 1) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        (void)memcpy(writer->topic_buffer->buffer + writer->length, text, length);
+        writer->length += length;
+        writer->topic_buffer->buffer[writer->length] = '\0';
+        result = 0;
+    }
+
+    return result;
+}
+
+/*characters URL encoding leaves as they are, whatever the encoder*/
+static bool is_url_safe(const char* text)
+{
+    while ((*text != '\0') &&
+        (((*text >= 'a') && (*text <= 'z')) || ((*text >= 'A') && (*text <= 'Z')) || ((*text >= '0') && (*text <= '9')) ||
+        (*text == '-') || (*text == '.') || (*text == '_')))
+    {
+        text++;
+    }
+    return (*text == '\0');
+}
+
+static int append_value(TOPIC_WRITER* writer, const char* value, bool urlencode)
+{
+    int result;
+
+    if (!urlencode || is_url_safe(value))
+    {
+        result = append(writer, value, strlen(value));
+    }
+    else
+    {
+        STRING_HANDLE encoded_value = URL_EncodeString(value);
+        if (encoded_value == NULL)
+        {
+            LogError("Failed URL encoding a property of the topic");
+            result = __FAILURE__;
+        }
+        else
+        {
+            const char* encoded_text = STRING_c_str(encoded_value);
+            result = append(writer, encoded_text, strlen(encoded_text));
+            STRING_delete(encoded_value);
+        }
+    }
+
+    return result;
+}
+
+static int append_property(TOPIC_WRITER* writer, const char* prefix, const char* name, bool urlencode_name, const char* value, bool urlencode_value)
+{
+    int result;
+
+    if (((writer->property_count != 0) && (append(writer, PROPERTY_SEPARATOR, sizeof(PROPERTY_SEPARATOR) - 1) != 0)) ||
+        (append(writer, prefix, strlen(prefix)) != 0) ||
+        (append_value(writer, name, urlencode_name) != 0) ||
+        (append(writer, "=", 1) != 0) ||
+        (append_value(writer, value, urlencode_value) != 0))
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        writer->property_count++;
+        result = 0;
+    }
+
+    return result;
+}
+
+static bool has_prefix_case_insensitive(const char* text, const char* prefix)
+{
+    while ((*prefix != '\0') && (toupper((unsigned char)*prefix) == toupper((unsigned char)*text)))
+    {
+        prefix++;
+        text++;
+    }
+    return (*prefix == '\0');
+}
+
+/*points segment at the characters up to the next '/', returns where the segment after it starts or NULL at the end of the topic*/
+static const char* next_segment(const char* position, MQTT_TOPIC_VIEW* segment)
+{
+    const char* result;
+    const char* end = strchr(position, '/');
+
+    segment->start = position;
+    if (end == NULL)
+    {
+        segment->length = strlen(position);
+        result = NULL;
+    }
+    else
+    {
+        segment->length = (size_t)(end - position);
+        result = end + 1;
+    }
+    return result;
+}
+
+static bool view_equals(const MQTT_TOPIC_VIEW* view, const char* text, size_t length)
+{
+    return (view->length == length) && (memcmp(view->start, text, length) == 0);
+}
+
+static bool view_has_prefix(const MQTT_TOPIC_VIEW* view, const char* prefix, size_t length)
+{
+    return (view->length >= length) && (memcmp(view->start, prefix, length) == 0);
+}
+
+static int parse_twin_topic(const char* topic, MQTT_TOPIC_INFO* topic_info)
+{
+    int result = __FAILURE__;
+    MQTT_TOPIC_VIEW segment;
+    const char* position = topic;
+    size_t segment_index;
+
+    /*$iothub/twin/PATCH/properties/desired/?$version=<n> or $iothub/twin/res/<status>/?$rid=<request id>*/
+    for (segment_index = 0; (position != NULL) && (segment_index <= 3); segment_index++)
+    {
+        position = next_segment(position, &segment);
+        if ((segment_index == 2) && view_equals(&segment, TWIN_PATCH_SEGMENT, sizeof(TWIN_PATCH_SEGMENT) - 1))
+        {
+            topic_info->kind = MQTT_TOPIC_KIND_TWIN_PATCH;
+            result = 0;
+            break;
+        }
+        else if (segment_index == 3)
+        {
+            const char* request_id = (position == NULL) ? NULL : strstr(position, REQUEST_ID_PROPERTY);
+            size_t index;
+
+            topic_info->kind = MQTT_TOPIC_KIND_TWIN_RESPONSE;
+            topic_info->status_code = 0;
+            for (index = 0; (index < segment.length) && (segment.start[index] >= '0') && (segment.start[index] <= '9'); index++)
+            {
+                topic_info->status_code = (topic_info->status_code * 10) + (segment.start[index] - '0');
+            }
+            if (request_id != NULL)
+            {
+                topic_info->request_id.start = request_id + sizeof(REQUEST_ID_PROPERTY) - 1;
+                topic_info->request_id.length = strcspn(topic_info->request_id.start, "&/");
+            }
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int parse_method_topic(const char* topic, MQTT_TOPIC_INFO* topic_info)
+{
+    int result = __FAILURE__;
+    MQTT_TOPIC_VIEW segment;
+    const char* position = topic;
+    size_t segment_index;
+
+    /*$iothub/methods/POST/<method name>/?$rid=<request id>*/
+    for (segment_index = 0; (position != NULL) && (segment_index <= 4); segment_index++)
+    {
+        position = next_segment(position, &segment);
+        if (segment_index == 3)
+        {
+            topic_info->method_name = segment;
+        }
+        else if ((segment_index == 4) && view_has_prefix(&segment, REQUEST_ID_PROPERTY, sizeof(REQUEST_ID_PROPERTY) - 1))
+        {
+            topic_info->kind = MQTT_TOPIC_KIND_METHOD_REQUEST;
+            topic_info->request_id.start = segment.start + sizeof(REQUEST_ID_PROPERTY) - 1;
+            topic_info->request_id.length = segment.length - (sizeof(REQUEST_ID_PROPERTY) - 1);
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+const char* mqtt_topic_encode_event(MQTT_TOPIC_BUFFER* topic_buffer, const char* event_topic, IOTHUB_MESSAGE_HANDLE message, bool urlencode)
+{
+    const char* result;
+    const char* const* property_keys;
+    const char* const* property_values;
+    size_t property_count;
+    size_t keys_and_values_length;
+
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_001: [ If topic_buffer, event_topic or message is NULL, mqtt_topic_encode_event shall fail and return NULL. ]*/
+    if ((topic_buffer == NULL) || (event_topic == NULL) || (message == NULL))
+    {
+        LogError("invalid arg MQTT_TOPIC_BUFFER* topic_buffer=%p, const char* event_topic=%p, IOTHUB_MESSAGE_HANDLE message=%p", topic_buffer, event_topic, message);
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_002: [ mqtt_topic_encode_event shall read the application properties with IoTHubMessage_GetProperties, which copies nothing, and fail if that fails. ]*/
+    else if (IoTHubMessage_GetProperties(message, &property_keys, &property_values, &property_count, &keys_and_values_length) != IOTHUB_MESSAGE_OK)
+    {
+        LogError("Failed to get the message properties.");
+        result = NULL;
+    }
+    else
+    {
+        const char* system_names[SYSTEM_PROPERTY_COUNT] = { CORRELATION_ID_PROPERTY, MESSAGE_ID_PROPERTY, CONTENT_TYPE_PROPERTY, CONTENT_ENCODING_PROPERTY };
+        const char* system_values[SYSTEM_PROPERTY_COUNT];
+        const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* diagnostic_data;
+        const char* diagnostic_id = NULL;
+        const char* diagnostic_creation_time = NULL;
+
+        system_values[0] = IoTHubMessage_GetCorrelationId(message);
+        system_values[1] = IoTHubMessage_GetMessageId(message);
+        system_values[2] = IoTHubMessage_GetContentTypeSystemProperty(message);
+        system_values[3] = IoTHubMessage_GetContentEncodingSystemProperty(message);
+        if ((diagnostic_data = IoTHubMessage_GetDiagnosticPropertyData(message)) != NULL)
+        {
+            diagnostic_id = diagnostic_data->diagnosticId;
+            diagnostic_creation_time = diagnostic_data->diagnosticCreationTimeUtc;
+        }
+
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_003: [ If only one of the diagnostic id and the diagnostic creation time is set, mqtt_topic_encode_event shall fail and return NULL. ]*/
+        if ((diagnostic_id == NULL) != (diagnostic_creation_time == NULL))
+        {
+            LogError("diagid and diagcreationtimeutc must be present simultaneously.");
+            result = NULL;
+        }
+        else
+        {
+            TOPIC_WRITER writer;
+            /*the topic, an '=' and a '&' per application property, and the terminator*/
+            size_t topic_length = strlen(event_topic) + keys_and_values_length + (2 * property_count) + 1;
+            size_t index;
+            int write_result = 0;
+
+            for (index = 0; index < SYSTEM_PROPERTY_COUNT; index++)
+            {
+                if (system_values[index] != NULL)
+                {
+                    topic_length += (sizeof(PROPERTY_SEPARATOR) - 1) + (sizeof(SYSTEM_PROPERTY_PREFIX) - 1) + strlen(system_names[index]) + 1 + strlen(system_values[index]);
+                }
+            }
+            if (diagnostic_id != NULL)
+            {
+                topic_length += (2 * ((sizeof(PROPERTY_SEPARATOR) - 1) + (sizeof(SYSTEM_PROPERTY_PREFIX) - 1) + 1)) +
+                    (sizeof(DIAGNOSTIC_ID_PROPERTY) - 1) + strlen(diagnostic_id) +
+                    (sizeof(DIAGNOSTIC_CONTEXT_PROPERTY) - 1) + (sizeof(DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PREFIX) - 1) + strlen(diagnostic_creation_time);
+            }
+
+            writer.topic_buffer = topic_buffer;
+            writer.length = 0;
+            writer.property_count = 0;
+
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_004: [ mqtt_topic_encode_event shall size topic_buffer once from the length of the topic and of the properties, reusing it as it is when it is large enough, and only grow it again for the characters URL encoding adds. ]*/
+            if ((ensure_capacity(topic_buffer, topic_length) != 0) ||
+                (append(&writer, event_topic, strlen(event_topic)) != 0))
+            {
+                write_result = __FAILURE__;
+            }
+
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_005: [ mqtt_topic_encode_event shall append the application properties as name=value pairs separated by '&', then $.cid, $.mid, $.ct and $.ce for the system properties that are set, then $.diagid and $.diagctx when the diagnostic data is set. ]*/
+            for (index = 0; (write_result == 0) && (index < property_count); index++)
+            {
+                write_result = append_property(&writer, "", property_keys[index], urlencode, property_values[index], urlencode);
+            }
+            for (index = 0; (write_result == 0) && (index < SYSTEM_PROPERTY_COUNT); index++)
+            {
+                if (system_values[index] != NULL)
+                {
+                    write_result = append_property(&writer, SYSTEM_PROPERTY_PREFIX, system_names[index], false, system_values[index], urlencode);
+                }
+            }
+            if ((write_result == 0) && (diagnostic_id != NULL))
+            {
+                if ((append_property(&writer, SYSTEM_PROPERTY_PREFIX, DIAGNOSTIC_ID_PROPERTY, false, diagnostic_id, false) != 0) ||
+                    (append_property(&writer, SYSTEM_PROPERTY_PREFIX, DIAGNOSTIC_CONTEXT_PROPERTY, false, DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PREFIX, false) != 0) ||
+                    (append_value(&writer, diagnostic_creation_time, true) != 0))
+                {
+                    write_result = __FAILURE__;
+                }
+            }
+
+            if (write_result != 0)
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_007: [ If growing topic_buffer or URL encoding fails, mqtt_topic_encode_event shall fail and return NULL. ]*/
+                LogError("Failed writing the properties to the topic");
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_006: [ When urlencode is true, mqtt_topic_encode_event shall URL encode the names and values with URL_EncodeString, except for the ones only made of letters, digits, '-', '.' and '_', which are written as they are. ]*/
+                /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_008: [ Otherwise mqtt_topic_encode_event shall return the NULL terminated topic in topic_buffer. ]*/
+                result = topic_buffer->buffer;
+            }
+        }
+    }
+
+    return result;
+}
+
+int mqtt_topic_parse(const char* topic, MQTT_TOPIC_INFO* topic_info)
+{
+    int result;
+
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_009: [ If topic or topic_info is NULL, mqtt_topic_parse shall fail and return a non-zero value. ]*/
+    if ((topic == NULL) || (topic_info == NULL))
+    {
+        LogError("invalid arg const char* topic=%p, MQTT_TOPIC_INFO* topic_info=%p", topic, topic_info);
+        result = __FAILURE__;
+    }
+    else
+    {
+        (void)memset(topic_info, 0, sizeof(MQTT_TOPIC_INFO));
+
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_010: [ mqtt_topic_parse shall classify the topic from its prefix, $iothub/twin and $iothub/methods compared without regard to case, in a single pass and without allocating. ]*/
+        if (has_prefix_case_insensitive(topic, TOPIC_DEVICE_TWIN_PREFIX))
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_011: [ For a twin topic whose third segment is PATCH, mqtt_topic_parse shall return MQTT_TOPIC_KIND_TWIN_PATCH; otherwise it shall return MQTT_TOPIC_KIND_TWIN_RESPONSE with the status of the fourth segment and the request id following ?$rid=, and fail when there is no fourth segment. ]*/
+            result = parse_twin_topic(topic, topic_info);
+        }
+        else if (has_prefix_case_insensitive(topic, TOPIC_DEVICE_METHOD_PREFIX))
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_012: [ For a method topic, mqtt_topic_parse shall return MQTT_TOPIC_KIND_METHOD_REQUEST with the method name of the fourth segment and the request id of the fifth, and fail unless the fifth segment starts with ?$rid=. ]*/
+            result = parse_method_topic(topic, topic_info);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_013: [ Any other topic shall be MQTT_TOPIC_KIND_TELEMETRY, its properties being what follows /messages/devicebound/, or the last '/' when that is missing. ]*/
+            const char* properties = strstr(topic, TOPIC_DEVICE_BOUND_SEGMENT);
+            if (properties != NULL)
+            {
+                properties += sizeof(TOPIC_DEVICE_BOUND_SEGMENT) - 1;
+            }
+            else if ((properties = strrchr(topic, '/')) != NULL)
+            {
+                properties++;
+            }
+            else
+            {
+                properties = topic;
+            }
+
+            topic_info->kind = MQTT_TOPIC_KIND_TELEMETRY;
+            topic_info->properties.start = properties;
+            topic_info->properties.length = strlen(properties);
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            LogError("Failed parsing the topic %s", topic);
+        }
+    }
+
+    return result;
+}
+
+bool mqtt_topic_get_next_property(MQTT_TOPIC_VIEW* properties, MQTT_TOPIC_VIEW* name, MQTT_TOPIC_VIEW* value)
+{
+    bool result = false;
+
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_014: [ If properties, name or value is NULL, mqtt_topic_get_next_property shall return false. ]*/
+    if ((properties == NULL) || (name == NULL) || (value == NULL))
+    {
+        LogError("invalid arg MQTT_TOPIC_VIEW* properties=%p, MQTT_TOPIC_VIEW* name=%p, MQTT_TOPIC_VIEW* value=%p", properties, name, value);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_015: [ mqtt_topic_get_next_property shall point name and value at the next '&' separated name=value pair, move properties past it and return true, skipping the pairs without an '='. ]*/
+        while (!result && (properties->length > 0))
+        {
+            const char* pair = properties->start;
+            const char* separator = (const char*)memchr(pair, PROPERTY_SEPARATOR[0], properties->length);
+            size_t pair_length = (separator == NULL) ? properties->length : (size_t)(separator - pair);
+            const char* equals = (const char*)memchr(pair, '=', pair_length);
+
+            properties->start += pair_length;
+            properties->length -= pair_length;
+            if (separator != NULL)
+            {
+                properties->start++;
+                properties->length--;
+            }
+
+            if (equals != NULL)
+            {
+                name->start = pair;
+                name->length = (size_t)(equals - pair);
+                value->start = equals + 1;
+                value->length = pair_length - name->length - 1;
+                result = true;
+            }
+        }
+        /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_016: [ Once no pair is left, mqtt_topic_get_next_property shall return false. ]*/
+    }
+
+    return result;
+}
+
+char* mqtt_topic_buffer_reserve(MQTT_TOPIC_BUFFER* topic_buffer, size_t size)
+{
+    char* result;
+
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_017: [ If topic_buffer is NULL, mqtt_topic_buffer_reserve shall fail and return NULL. ]*/
+    if (topic_buffer == NULL)
+    {
+        LogError("invalid arg MQTT_TOPIC_BUFFER* topic_buffer=NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_018: [ mqtt_topic_buffer_reserve shall grow topic_buffer to hold at least size bytes, only when it is smaller, and return its memory, or NULL if growing fails. ]*/
+    else if (ensure_capacity(topic_buffer, size) != 0)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = topic_buffer->buffer;
+    }
+
+    return result;
+}
+
+void mqtt_topic_buffer_deinit(MQTT_TOPIC_BUFFER* topic_buffer)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_019: [ mqtt_topic_buffer_deinit shall free the memory of topic_buffer and leave it empty. ]*/
+    if (topic_buffer != NULL)
+    {
+        free(topic_buffer->buffer);
+        topic_buffer->buffer = NULL;
+        topic_buffer->capacity = 0;
+    }
+}
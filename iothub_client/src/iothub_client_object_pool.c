@@ -0,0 +1,195 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_object_pool.h"
+
+#define OBJECT_POOL_MIN_SLAB_COUNT 8
+
+typedef struct FREE_OBJECT_TAG
+{
+    struct FREE_OBJECT_TAG* next;
+} FREE_OBJECT;
+
+/*the objects follow the header, which is sized so that they are suitably aligned for any type*/
+typedef union SLAB_HEADER_TAG
+{
+    union SLAB_HEADER_TAG* next;
+    long double align_long_double;
+    uint64_t align_uint64;
+    void* align_pointer;
+} SLAB_HEADER;
+
+typedef struct OBJECT_POOL_TAG
+{
+    size_t object_size;
+    SLAB_HEADER* slabs;
+    FREE_OBJECT* free_objects;
+    size_t object_count;
+    size_t acquired_count;
+    bool destroy_pending;
+} OBJECT_POOL;
+
+static int add_slab(OBJECT_POOL* pool, size_t count)
+{
+    int result;
+
+    if (count > (SIZE_MAX - sizeof(SLAB_HEADER)) / pool->object_size)
+    {
+        LogError("A slab of %lu objects would be too large", (unsigned long)count);
+        result = __FAILURE__;
+    }
+    else
+    {
+        SLAB_HEADER* slab = (SLAB_HEADER*)malloc(sizeof(SLAB_HEADER) + (count * pool->object_size));
+        if (slab == NULL)
+        {
+            LogError("Failed allocating a slab of %lu objects", (unsigned long)count);
+            result = __FAILURE__;
+        }
+        else
+        {
+            unsigned char* objects = (unsigned char*)(slab + 1);
+            size_t index;
+
+            for (index = count; index > 0; index--)
+            {
+                FREE_OBJECT* free_object = (FREE_OBJECT*)(void*)(objects + ((index - 1) * pool->object_size));
+                free_object->next = pool->free_objects;
+                pool->free_objects = free_object;
+            }
+
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->object_count += count;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static void free_pool(OBJECT_POOL* pool)
+{
+    while (pool->slabs != NULL)
+    {
+        SLAB_HEADER* next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    free(pool);
+}
+
+OBJECT_POOL_HANDLE object_pool_create(size_t object_size, size_t reserved_count)
+{
+    OBJECT_POOL* result;
+
+    if (object_size == 0)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_001: [ If object_size is 0, object_pool_create shall fail and return NULL. ]*/
+        LogError("invalid arg size_t object_size=0");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_002: [ object_pool_create shall allocate the pool and, if reserved_count is not 0, one slab of reserved_count objects. ]*/
+    else if ((result = (OBJECT_POOL*)malloc(sizeof(OBJECT_POOL))) == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_003: [ If any allocation fails, object_pool_create shall fail and return NULL. ]*/
+        LogError("Failed allocating OBJECT_POOL");
+    }
+    else
+    {
+        /*every object is at least as big as a free list link and a multiple of the slab header, so they all stay aligned*/
+        if (object_size < sizeof(FREE_OBJECT))
+        {
+            object_size = sizeof(FREE_OBJECT);
+        }
+        result->object_size = ((object_size + sizeof(SLAB_HEADER) - 1) / sizeof(SLAB_HEADER)) * sizeof(SLAB_HEADER);
+        result->slabs = NULL;
+        result->free_objects = NULL;
+        result->object_count = 0;
+        result->acquired_count = 0;
+        result->destroy_pending = false;
+
+        if ((reserved_count > 0) && (add_slab(result, reserved_count) != 0))
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_003: [ If any allocation fails, object_pool_create shall fail and return NULL. ]*/
+            free(result);
+            result = NULL;
+        }
+    }
+
+    return result;
+}
+
+void* object_pool_acquire(OBJECT_POOL_HANDLE pool)
+{
+    void* result;
+
+    if (pool == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_004: [ If pool is NULL, object_pool_acquire shall return NULL. ]*/
+        LogError("invalid arg OBJECT_POOL_HANDLE pool=NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_005: [ If no object is free, object_pool_acquire shall allocate a new slab holding as many objects as the pool already owns (8 for the first slab), and return NULL if that fails. ]*/
+    else if ((pool->free_objects == NULL) &&
+        (add_slab(pool, (pool->object_count == 0) ? OBJECT_POOL_MIN_SLAB_COUNT : pool->object_count) != 0))
+    {
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_006: [ object_pool_acquire shall take an object off the free list and return it. ]*/
+        result = pool->free_objects;
+        pool->free_objects = pool->free_objects->next;
+        pool->acquired_count++;
+    }
+
+    return result;
+}
+
+void object_pool_release(OBJECT_POOL_HANDLE pool, void* object)
+{
+    if ((pool == NULL) || (object == NULL))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_007: [ If pool or object is NULL, object_pool_release shall do nothing. ]*/
+        LogError("invalid arg OBJECT_POOL_HANDLE pool=%p, void* object=%p", pool, object);
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_008: [ object_pool_release shall put object back on the free list, without giving it back to the heap. ]*/
+        FREE_OBJECT* free_object = (FREE_OBJECT*)object;
+        free_object->next = pool->free_objects;
+        pool->free_objects = free_object;
+        pool->acquired_count--;
+
+        if (pool->destroy_pending && (pool->acquired_count == 0))
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_010: [ If objects are still acquired, object_pool_destroy shall only free the pool once the last of them is released. ]*/
+            free_pool(pool);
+        }
+    }
+}
+
+void object_pool_destroy(OBJECT_POOL_HANDLE pool)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_009: [ If pool is NULL, object_pool_destroy shall return. ]*/
+    if (pool != NULL)
+    {
+        if (pool->acquired_count == 0)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_011: [ object_pool_destroy shall free all the slabs and the pool. ]*/
+            free_pool(pool);
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_010: [ If objects are still acquired, object_pool_destroy shall only free the pool once the last of them is released. ]*/
+            pool->destroy_pending = true;
+        }
+    }
+}
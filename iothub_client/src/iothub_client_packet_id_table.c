@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_packet_id_table.h"
+
+#define PACKET_ID_TABLE_INITIAL_CAPACITY 16
+
+typedef struct PACKET_ID_SLOT_TAG
+{
+    void* item; /*NULL for a free slot*/
+    uint16_t packet_id;
+} PACKET_ID_SLOT;
+
+typedef struct PACKET_ID_TABLE_TAG
+{
+    PACKET_ID_SLOT* slots;
+    size_t count;
+    size_t capacity; /*a power of 2*/
+} PACKET_ID_TABLE;
+
+/*packet ids are handed out in sequence, so the low bits alone spread them over consecutive slots*/
+static size_t home_slot(const PACKET_ID_TABLE* packet_id_table, uint16_t packet_id)
+{
+    return (size_t)packet_id & (packet_id_table->capacity - 1);
+}
+
+static size_t find_slot(const PACKET_ID_TABLE* packet_id_table, uint16_t packet_id)
+{
+    size_t index = home_slot(packet_id_table, packet_id);
+    while ((packet_id_table->slots[index].item != NULL) && (packet_id_table->slots[index].packet_id != packet_id))
+    {
+        index = (index + 1) & (packet_id_table->capacity - 1);
+    }
+    return index;
+}
+
+static int grow(PACKET_ID_TABLE* packet_id_table)
+{
+    int result;
+    size_t new_capacity = (packet_id_table->capacity == 0) ? PACKET_ID_TABLE_INITIAL_CAPACITY : (packet_id_table->capacity * 2);
+    PACKET_ID_SLOT* new_slots;
+
+    if ((new_capacity < packet_id_table->capacity) || (new_capacity > SIZE_MAX / sizeof(PACKET_ID_SLOT)))
+    {
+        LogError("A packet id table of %lu slots would be too large", (unsigned long)new_capacity);
+        result = __FAILURE__;
+    }
+    else if ((new_slots = (PACKET_ID_SLOT*)malloc(new_capacity * sizeof(PACKET_ID_SLOT))) == NULL)
+    {
+        LogError("Failed growing the packet id table to %lu slots", (unsigned long)new_capacity);
+        result = __FAILURE__;
+    }
+    else
+    {
+        PACKET_ID_SLOT* old_slots = packet_id_table->slots;
+        size_t old_capacity = packet_id_table->capacity;
+        size_t index;
+
+        (void)memset(new_slots, 0, new_capacity * sizeof(PACKET_ID_SLOT));
+        packet_id_table->slots = new_slots;
+        packet_id_table->capacity = new_capacity;
+        for (index = 0; index < old_capacity; index++)
+        {
+            if (old_slots[index].item != NULL)
+            {
+                packet_id_table->slots[find_slot(packet_id_table, old_slots[index].packet_id)] = old_slots[index];
+            }
+        }
+        free(old_slots);
+        result = 0;
+    }
+
+    return result;
+}
+
+/*empties the slot at index and moves back the items probed past it, so that no lookup ever has to skip a deleted slot*/
+static void remove_at(PACKET_ID_TABLE* packet_id_table, size_t index)
+{
+    size_t mask = packet_id_table->capacity - 1;
+    size_t next = (index + 1) & mask;
+
+    while (packet_id_table->slots[next].item != NULL)
+    {
+        size_t home = home_slot(packet_id_table, packet_id_table->slots[next].packet_id);
+        /*the item at next can fill the hole if its home slot is not cyclically within (index, next]*/
+        if (((next - home) & mask) >= ((next - index) & mask))
+        {
+            packet_id_table->slots[index] = packet_id_table->slots[next];
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+    packet_id_table->slots[index].item = NULL;
+    packet_id_table->count--;
+}
+
+PACKET_ID_TABLE_HANDLE packet_id_table_create(void)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_001: [ packet_id_table_create shall allocate an empty packet id table, without any slot. ]*/
+    PACKET_ID_TABLE* result = (PACKET_ID_TABLE*)malloc(sizeof(PACKET_ID_TABLE));
+    if (result == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_002: [ If the allocation fails, packet_id_table_create shall fail and return NULL. ]*/
+        LogError("Failed allocating PACKET_ID_TABLE");
+    }
+    else
+    {
+        result->slots = NULL;
+        result->count = 0;
+        result->capacity = 0;
+    }
+    return result;
+}
+
+int packet_id_table_add(PACKET_ID_TABLE_HANDLE packet_id_table, uint16_t packet_id, void* item)
+{
+    int result;
+
+    /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_003: [ If packet_id_table or item is NULL, packet_id_table_add shall fail and return a non-zero value. ]*/
+    if ((packet_id_table == NULL) || (item == NULL))
+    {
+        LogError("invalid arg PACKET_ID_TABLE_HANDLE packet_id_table=%p, void* item=%p", packet_id_table, item);
+        result = __FAILURE__;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_005: [ When adding an item would fill more than 3/4 of the slots, packet_id_table_add shall double the number of slots, starting at 16. ]*/
+    /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_006: [ If growing the table fails, packet_id_table_add shall fail and return a non-zero value, leaving the table unchanged. ]*/
+    else if (((packet_id_table->count + 1) * 4 > packet_id_table->capacity * 3) && (grow(packet_id_table) != 0))
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index = find_slot(packet_id_table, packet_id);
+        if (packet_id_table->slots[index].item != NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_004: [ If an item is already stored under packet_id, packet_id_table_add shall fail and return a non-zero value, leaving the table unchanged. ]*/
+            LogError("packet id %u is already in flight", (unsigned int)packet_id);
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_007: [ packet_id_table_add shall store item under packet_id and return 0. ]*/
+            packet_id_table->slots[index].item = item;
+            packet_id_table->slots[index].packet_id = packet_id;
+            packet_id_table->count++;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+void* packet_id_table_remove(PACKET_ID_TABLE_HANDLE packet_id_table, uint16_t packet_id)
+{
+    void* result;
+
+    if (packet_id_table == NULL)
+    {
+        LogError("invalid arg PACKET_ID_TABLE_HANDLE packet_id_table=NULL");
+        result = NULL;
+    }
+    else if (packet_id_table->count == 0)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_008: [ If no item is stored under packet_id, packet_id_table_remove shall return NULL. ]*/
+        result = NULL;
+    }
+    else
+    {
+        size_t index = find_slot(packet_id_table, packet_id);
+
+        /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_008: [ If no item is stored under packet_id, packet_id_table_remove shall return NULL. ]*/
+        result = packet_id_table->slots[index].item;
+        if (result != NULL)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_009: [ Otherwise packet_id_table_remove shall remove the item stored under packet_id and return it, without leaving a deleted slot behind. ]*/
+            remove_at(packet_id_table, index);
+        }
+    }
+
+    return result;
+}
+
+void packet_id_table_destroy(PACKET_ID_TABLE_HANDLE packet_id_table)
+{
+    if (packet_id_table != NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_010: [ packet_id_table_destroy shall free the slots and the table, the items themselves belong to their owners. ]*/
+        free(packet_id_table->slots);
+        free(packet_id_table);
+    }
+}
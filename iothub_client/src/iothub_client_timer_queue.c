@@ -0,0 +1,251 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "internal/iothub_client_timer_queue.h"
+
+#define TIMER_QUEUE_NOT_QUEUED SIZE_MAX
+#define TIMER_QUEUE_INITIAL_CAPACITY 16
+
+typedef struct TIMER_QUEUE_TAG
+{
+    TIMER_QUEUE_ENTRY** heap;
+    size_t count;
+    size_t capacity;
+} TIMER_QUEUE;
+
+static void place_entry(TIMER_QUEUE* timer_queue, TIMER_QUEUE_ENTRY* entry, size_t index)
+{
+    timer_queue->heap[index] = entry;
+    entry->index = index;
+}
+
+static void sift_up(TIMER_QUEUE* timer_queue, size_t index)
+{
+    TIMER_QUEUE_ENTRY* entry = timer_queue->heap[index];
+
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (timer_queue->heap[parent]->deadline <= entry->deadline)
+        {
+            break;
+        }
+        place_entry(timer_queue, timer_queue->heap[parent], index);
+        index = parent;
+    }
+    place_entry(timer_queue, entry, index);
+}
+
+static void sift_down(TIMER_QUEUE* timer_queue, size_t index)
+{
+    TIMER_QUEUE_ENTRY* entry = timer_queue->heap[index];
+
+    while (1)
+    {
+        size_t child = (2 * index) + 1;
+        if (child >= timer_queue->count)
+        {
+            break;
+        }
+        if ((child + 1 < timer_queue->count) && (timer_queue->heap[child + 1]->deadline < timer_queue->heap[child]->deadline))
+        {
+            child++;
+        }
+        if (entry->deadline <= timer_queue->heap[child]->deadline)
+        {
+            break;
+        }
+        place_entry(timer_queue, timer_queue->heap[child], index);
+        index = child;
+    }
+    place_entry(timer_queue, entry, index);
+}
+
+static void remove_at(TIMER_QUEUE* timer_queue, size_t index)
+{
+    TIMER_QUEUE_ENTRY* removed = timer_queue->heap[index];
+
+    timer_queue->count--;
+    if (index < timer_queue->count)
+    {
+        /*the last entry fills the hole and moves to wherever its deadline belongs*/
+        place_entry(timer_queue, timer_queue->heap[timer_queue->count], index);
+        if ((index > 0) && (timer_queue->heap[index]->deadline < timer_queue->heap[(index - 1) / 2]->deadline))
+        {
+            sift_up(timer_queue, index);
+        }
+        else
+        {
+            sift_down(timer_queue, index);
+        }
+    }
+    removed->index = TIMER_QUEUE_NOT_QUEUED;
+}
+
+TIMER_QUEUE_HANDLE timer_queue_create(void)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_001: [ timer_queue_create shall allocate an empty timer queue. ]*/
+    TIMER_QUEUE* result = (TIMER_QUEUE*)malloc(sizeof(TIMER_QUEUE));
+    if (result == NULL)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_002: [ If the allocation fails, timer_queue_create shall fail and return NULL. ]*/
+        LogError("Failed allocating TIMER_QUEUE");
+    }
+    else
+    {
+        result->heap = NULL;
+        result->count = 0;
+        result->capacity = 0;
+    }
+    return result;
+}
+
+void timer_queue_entry_init(TIMER_QUEUE_ENTRY* entry)
+{
+    /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_003: [ timer_queue_entry_init shall mark entry as not queued. ]*/
+    if (entry != NULL)
+    {
+        entry->deadline = 0;
+        entry->index = TIMER_QUEUE_NOT_QUEUED;
+    }
+}
+
+int timer_queue_add(TIMER_QUEUE_HANDLE timer_queue, TIMER_QUEUE_ENTRY* entry, tickcounter_ms_t deadline)
+{
+    int result;
+
+    /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_004: [ If timer_queue or entry is NULL, or if entry is already queued, timer_queue_add shall fail and return a non-zero value. ]*/
+    if ((timer_queue == NULL) || (entry == NULL) || (entry->index != TIMER_QUEUE_NOT_QUEUED))
+    {
+        LogError("invalid arg TIMER_QUEUE_HANDLE timer_queue=%p, TIMER_QUEUE_ENTRY* entry=%p", timer_queue, entry);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (timer_queue->count == timer_queue->capacity)
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_005: [ When the heap is full, timer_queue_add shall double its capacity, starting at 16 entries. ]*/
+            size_t new_capacity = (timer_queue->capacity == 0) ? TIMER_QUEUE_INITIAL_CAPACITY : (timer_queue->capacity * 2);
+            TIMER_QUEUE_ENTRY** new_heap;
+
+            if ((new_capacity < timer_queue->capacity) || (new_capacity > SIZE_MAX / sizeof(TIMER_QUEUE_ENTRY*)))
+            {
+                new_heap = NULL;
+            }
+            else
+            {
+                new_heap = (TIMER_QUEUE_ENTRY**)realloc(timer_queue->heap, new_capacity * sizeof(TIMER_QUEUE_ENTRY*));
+            }
+
+            if (new_heap == NULL)
+            {
+                /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_006: [ If growing the heap fails, timer_queue_add shall fail and return a non-zero value, leaving the queue unchanged. ]*/
+                LogError("Failed growing the timer queue to %lu entries", (unsigned long)new_capacity);
+            }
+            else
+            {
+                timer_queue->heap = new_heap;
+                timer_queue->capacity = new_capacity;
+            }
+        }
+
+        if (timer_queue->count == timer_queue->capacity)
+        {
+            result = __FAILURE__;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_007: [ timer_queue_add shall store deadline in entry and insert entry in the heap in O(log n). ]*/
+            entry->deadline = deadline;
+            timer_queue->heap[timer_queue->count] = entry;
+            timer_queue->count++;
+            sift_up(timer_queue, timer_queue->count - 1);
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+void timer_queue_remove(TIMER_QUEUE_HANDLE timer_queue, TIMER_QUEUE_ENTRY* entry)
+{
+    if ((timer_queue == NULL) || (entry == NULL))
+    {
+        LogError("invalid arg TIMER_QUEUE_HANDLE timer_queue=%p, TIMER_QUEUE_ENTRY* entry=%p", timer_queue, entry);
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_008: [ If entry is not queued, timer_queue_remove shall do nothing. ]*/
+    else if ((entry->index < timer_queue->count) && (timer_queue->heap[entry->index] == entry))
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_009: [ timer_queue_remove shall remove entry from the heap in O(log n) and mark it as not queued. ]*/
+        remove_at(timer_queue, entry->index);
+    }
+}
+
+TIMER_QUEUE_ENTRY* timer_queue_pop_expired(TIMER_QUEUE_HANDLE timer_queue, tickcounter_ms_t now)
+{
+    TIMER_QUEUE_ENTRY* result;
+
+    if (timer_queue == NULL)
+    {
+        LogError("invalid arg TIMER_QUEUE_HANDLE timer_queue=NULL");
+        result = NULL;
+    }
+    /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_010: [ If the earliest deadline is greater than now, or if the queue is empty, timer_queue_pop_expired shall return NULL without looking at any other entry. ]*/
+    else if ((timer_queue->count == 0) || (timer_queue->heap[0]->deadline > now))
+    {
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_011: [ Otherwise timer_queue_pop_expired shall remove the entry with the earliest deadline, mark it as not queued and return it. ]*/
+        result = timer_queue->heap[0];
+        remove_at(timer_queue, 0);
+    }
+
+    return result;
+}
+
+int timer_queue_get_next_deadline(TIMER_QUEUE_HANDLE timer_queue, tickcounter_ms_t* deadline)
+{
+    int result;
+
+    if ((timer_queue == NULL) || (deadline == NULL))
+    {
+        LogError("invalid arg TIMER_QUEUE_HANDLE timer_queue=%p, tickcounter_ms_t* deadline=%p", timer_queue, deadline);
+        result = __FAILURE__;
+    }
+    else if (timer_queue->count == 0)
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_012: [ If the queue is empty, timer_queue_get_next_deadline shall return a non-zero value. ]*/
+        result = __FAILURE__;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_013: [ Otherwise timer_queue_get_next_deadline shall set deadline to the earliest deadline and return 0. ]*/
+        *deadline = timer_queue->heap[0]->deadline;
+        result = 0;
+    }
+
+    return result;
+}
+
+void timer_queue_destroy(TIMER_QUEUE_HANDLE timer_queue)
+{
+    if (timer_queue != NULL)
+    {
+        size_t index;
+
+        /*Codes_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_014: [ timer_queue_destroy shall mark the entries still queued as not queued and free the queue, the entries themselves belong to their owners. ]*/
+        for (index = 0; index < timer_queue->count; index++)
+        {
+            timer_queue->heap[index]->index = TIMER_QUEUE_NOT_QUEUED;
+        }
+        free(timer_queue->heap);
+        free(timer_queue);
+    }
+}
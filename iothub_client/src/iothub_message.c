@@ -2,12 +2,16 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/constbuffer.h"
+#include "azure_c_shared_utility/refcount.h"
 
 #include "iothub_message.h"
+#include "internal/iothub_message_private.h"
 
 DEFINE_ENUM_STRINGS(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_RESULT_VALUES);
 DEFINE_ENUM_STRINGS(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUES);
@@ -15,15 +19,45 @@ DEFINE_ENUM_STRINGS(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_CONTENT_TYPE_VALUE
 #define LOG_IOTHUB_MESSAGE_ERROR() \
     LogError("(result = %s)", ENUM_TO_STRING(IOTHUB_MESSAGE_RESULT, result));
 
+/*the first MESSAGE_PROPERTIES_INLINE_COUNT properties are indexed without any allocation*/
+#define MESSAGE_PROPERTIES_INLINE_COUNT 12
+#define MESSAGE_PROPERTIES_MIN_STRINGS_SIZE 128
+
+/*a size_t with every byte set to 0x01, and to 0x80*/
+#define EVERY_BYTE_0x01 (~(size_t)0 / 0xFF)
+#define EVERY_BYTE_0x80 (EVERY_BYTE_0x01 * 0x80)
+
+/*properties are shared between a message and its clones until one of them needs to modify them.
+keys and values point into a single block of strings. A replaced value that does not fit where the old one was is appended, and the block is compacted when it has to grow.
+Once IoTHubMessage_Properties has handed out a map, the application can change it at any time, so from then on the map holds the properties and the arrays stay empty*/
+typedef struct MESSAGE_PROPERTIES_TAG
+{
+    MAP_HANDLE map;
+    const char** keys;
+    const char** values;
+    size_t count;
+    size_t capacity;
+    char* strings;
+    size_t stringsUsed;
+    size_t stringsSize;
+    /*the length of all the keys and values, terminators not included*/
+    size_t keysAndValuesLength;
+    const char* inlineKeys[MESSAGE_PROPERTIES_INLINE_COUNT];
+    const char* inlineValues[MESSAGE_PROPERTIES_INLINE_COUNT];
+} MESSAGE_PROPERTIES;
+
+DEFINE_REFCOUNT_TYPE(MESSAGE_PROPERTIES);
+
 typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
 {
     IOTHUBMESSAGE_CONTENT_TYPE contentType;
-    union
-    {
-        BUFFER_HANDLE byteArray;
-        STRING_HANDLE string;
-    } value;
-    MAP_HANDLE properties;
+    /*immutable and shared with the clones. STRING messages keep the '\0' terminator in it*/
+    CONSTBUFFER_HANDLE value;
+    /*set instead of value while the payload still belongs to the transport that received the message*/
+    bool isBorrowed;
+    const unsigned char* borrowedContent;
+    size_t borrowedSize;
+    MESSAGE_PROPERTIES* properties;
     char* messageId;
     char* correlationId;
     char* userDefinedContentType;
@@ -31,23 +65,43 @@ typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
     IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA_HANDLE diagnosticData;
 }IOTHUB_MESSAGE_HANDLE_DATA;
 
-static bool ContainsOnlyUsAscii(const char* asciiValue)
+DEFINE_REFCOUNT_TYPE(IOTHUB_MESSAGE_HANDLE_DATA);
+
+/*Allow only printable ascii chars. A word has a byte under ' ' when subtracting ' ' from every byte borrows into the high bit of a byte that did not have it, and one over '~' when adding 1 sets it*/
+static bool IsPrintableUsAscii(const char* text, size_t length)
 {
     bool result = true;
-    const char* iterator = asciiValue;
-    while (iterator != NULL && *iterator != '\0')
+    size_t index = 0;
+
+    while ((index + sizeof(size_t)) <= length)
     {
-        // Allow only printable ascii char 
-        if (*iterator < ' ' || *iterator > '~')
+        size_t word;
+        (void)memcpy(&word, text + index, sizeof(size_t));
+        if ((((word - (EVERY_BYTE_0x01 * ' ')) & ~word) | (word + EVERY_BYTE_0x01) | word) & EVERY_BYTE_0x80)
         {
             result = false;
             break;
         }
-        iterator++;
+        index += sizeof(size_t);
     }
+
+    while (result && (index < length))
+    {
+        if ((text[index] < ' ') || (text[index] > '~'))
+        {
+            result = false;
+        }
+        index++;
+    }
+
     return result;
 }
 
+static bool ContainsOnlyUsAscii(const char* asciiValue)
+{
+    return (asciiValue == NULL) || IsPrintableUsAscii(asciiValue, strlen(asciiValue));
+}
+
 /* Codes_SRS_IOTHUBMESSAGE_07_008: [ValidateAsciiCharactersFilter shall loop through the mapKey and mapValue strings to ensure that they only contain valid US-Ascii characters Ascii value 32 - 126.] */
 static int ValidateAsciiCharactersFilter(const char* mapKey, const char* mapValue)
 {
@@ -73,18 +127,343 @@ static void DestroyDiagnosticPropertyData(IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DAT
     free(diagnosticHandle);
 }
 
-static void DestroyMessageData(IOTHUB_MESSAGE_HANDLE_DATA* handleData)
+static void ResetPropertyStore(MESSAGE_PROPERTIES* properties)
+{
+    properties->keys = properties->inlineKeys;
+    properties->values = properties->inlineValues;
+    properties->count = 0;
+    properties->capacity = MESSAGE_PROPERTIES_INLINE_COUNT;
+    properties->strings = NULL;
+    properties->stringsUsed = 0;
+    properties->stringsSize = 0;
+    properties->keysAndValuesLength = 0;
+}
+
+static void FreePropertyStore(MESSAGE_PROPERTIES* properties)
+{
+    /*keys and values share one allocation once they outgrow the inline arrays*/
+    if (properties->keys != properties->inlineKeys)
+    {
+        free((void*)properties->keys);
+    }
+    if (properties->strings != NULL)
+    {
+        free(properties->strings);
+    }
+}
+
+static MESSAGE_PROPERTIES* CreateMessageProperties(void)
+{
+    MESSAGE_PROPERTIES* result;
+    if ((result = REFCOUNT_TYPE_CREATE(MESSAGE_PROPERTIES)) == NULL)
+    {
+        LogError("unable to allocate MESSAGE_PROPERTIES");
+    }
+    else
+    {
+        result->map = NULL;
+        ResetPropertyStore(result);
+    }
+    return result;
+}
+
+static void ReleaseMessageProperties(MESSAGE_PROPERTIES* properties)
+{
+    if ((properties != NULL) && (DEC_REF(MESSAGE_PROPERTIES, properties) == DEC_RETURN_ZERO))
+    {
+        if (properties->map != NULL)
+        {
+            Map_Destroy(properties->map);
+        }
+        FreePropertyStore(properties);
+        free(properties);
+    }
+}
+
+static int GrowPropertyIndex(MESSAGE_PROPERTIES* properties, size_t minimumCapacity)
+{
+    int result;
+    size_t newCapacity = (properties->capacity * 2 > minimumCapacity) ? properties->capacity * 2 : minimumCapacity;
+    const char** newKeys;
+
+    if (newCapacity > SIZE_MAX / (2 * sizeof(const char*)))
+    {
+        LogError("too many properties");
+        result = __FAILURE__;
+    }
+    else if ((newKeys = (const char**)malloc(2 * newCapacity * sizeof(const char*))) == NULL)
+    {
+        LogError("unable to grow the property index to %lu properties", (unsigned long)newCapacity);
+        result = __FAILURE__;
+    }
+    else
+    {
+        if (properties->count > 0)
+        {
+            (void)memcpy((void*)newKeys, (void*)properties->keys, properties->count * sizeof(const char*));
+            (void)memcpy((void*)(newKeys + newCapacity), (void*)properties->values, properties->count * sizeof(const char*));
+        }
+        if (properties->keys != properties->inlineKeys)
+        {
+            free((void*)properties->keys);
+        }
+        properties->keys = newKeys;
+        properties->values = newKeys + newCapacity;
+        properties->capacity = newCapacity;
+        result = 0;
+    }
+    return result;
+}
+
+static char* MoveString(char* destination, const char** string)
+{
+    size_t size = strlen(*string) + 1;
+    (void)memcpy(destination, *string, size);
+    *string = destination;
+    return destination + size;
+}
+
+/*copies the live strings, leaving out the value at skippedIndex, to a new block with at least neededSize bytes to spare. The old block is returned in oldStrings rather than freed, since the strings about to be stored can point into it*/
+static int GrowPropertyStrings(MESSAGE_PROPERTIES* properties, size_t skippedIndex, size_t neededSize, char** oldStrings)
+{
+    int result;
+    size_t liveSize = properties->keysAndValuesLength + (2 * properties->count);
+    size_t newSize;
+    char* newStrings;
+
+    if (skippedIndex < properties->count)
+    {
+        liveSize -= strlen(properties->values[skippedIndex]) + 1;
+    }
+    newSize = 2 * (liveSize + neededSize);
+    if (newSize < MESSAGE_PROPERTIES_MIN_STRINGS_SIZE)
+    {
+        newSize = MESSAGE_PROPERTIES_MIN_STRINGS_SIZE;
+    }
+
+    if ((newStrings = (char*)malloc(newSize)) == NULL)
+    {
+        LogError("unable to allocate %lu bytes for the properties", (unsigned long)newSize);
+        result = __FAILURE__;
+    }
+    else
+    {
+        char* next = newStrings;
+        size_t index;
+        for (index = 0; index < properties->count; index++)
+        {
+            next = MoveString(next, &properties->keys[index]);
+            if (index != skippedIndex)
+            {
+                next = MoveString(next, &properties->values[index]);
+            }
+        }
+
+        *oldStrings = properties->strings;
+        properties->strings = newStrings;
+        properties->stringsUsed = (size_t)(next - newStrings);
+        properties->stringsSize = newSize;
+        result = 0;
+    }
+    return result;
+}
+
+static size_t FindProperty(const MESSAGE_PROPERTIES* properties, const char* key)
+{
+    size_t index;
+    for (index = 0; index < properties->count; index++)
+    {
+        if (strcmp(properties->keys[index], key) == 0)
+        {
+            break;
+        }
+    }
+    return index;
+}
+
+/*sets the value of the property at index, properties->count standing for a new key. key and value can point into the block of strings*/
+static int StoreProperty(MESSAGE_PROPERTIES* properties, size_t index, const char* key, size_t keyLength, const char* value, size_t valueLength)
+{
+    int result;
+    bool isNewKey = (index == properties->count);
+    size_t oldValueLength = isNewKey ? 0 : strlen(properties->values[index]);
+    size_t neededSize = (isNewKey ? (keyLength + 1) : 0) + valueLength + 1;
+    char* oldStrings = NULL;
+
+    if (isNewKey && (properties->count == properties->capacity) && (GrowPropertyIndex(properties, properties->count + 1) != 0))
+    {
+        result = __FAILURE__;
+    }
+    else if (!isNewKey && (valueLength <= oldValueLength))
+    {
+        /*the new value fits where the old one was*/
+        (void)memmove((char*)properties->values[index], value, valueLength + 1);
+        result = 0;
+    }
+    else if (((properties->stringsSize - properties->stringsUsed) < neededSize) &&
+        (GrowPropertyStrings(properties, index, neededSize, &oldStrings) != 0))
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        char* next = properties->strings + properties->stringsUsed;
+        if (isNewKey)
+        {
+            (void)memcpy(next, key, keyLength + 1);
+            properties->keys[index] = next;
+            next += keyLength + 1;
+            properties->count++;
+        }
+        (void)memcpy(next, value, valueLength + 1);
+        properties->values[index] = next;
+        properties->stringsUsed += neededSize;
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        properties->keysAndValuesLength = properties->keysAndValuesLength - oldValueLength + valueLength + (isNewKey ? keyLength : 0);
+    }
+
+    if (oldStrings != NULL)
+    {
+        free(oldStrings);
+    }
+
+    return result;
+}
+
+/*creates properties holding a copy of the given ones, sized so that they are stored with one allocation for the strings*/
+static MESSAGE_PROPERTIES* CopyMessageProperties(const char* const* keys, const char* const* values, size_t count)
+{
+    MESSAGE_PROPERTIES* result = CreateMessageProperties();
+    if ((result != NULL) && (count > 0))
+    {
+        size_t stringsSize = 0;
+        size_t index;
+        for (index = 0; index < count; index++)
+        {
+            stringsSize += strlen(keys[index]) + strlen(values[index]) + 2;
+        }
+
+        if ((count > result->capacity) && (GrowPropertyIndex(result, count) != 0))
+        {
+            ReleaseMessageProperties(result);
+            result = NULL;
+        }
+        else if ((result->strings = (char*)malloc(stringsSize)) == NULL)
+        {
+            LogError("unable to allocate %lu bytes for the properties", (unsigned long)stringsSize);
+            ReleaseMessageProperties(result);
+            result = NULL;
+        }
+        else
+        {
+            result->stringsSize = stringsSize;
+            for (index = 0; index < count; index++)
+            {
+                /*there is room for all of them, so this cannot fail*/
+                (void)StoreProperty(result, index, keys[index], strlen(keys[index]), values[index], strlen(values[index]));
+            }
+        }
+    }
+    return result;
+}
+
+static MESSAGE_PROPERTIES* CopyMessagePropertiesFromMap(MAP_HANDLE map)
+{
+    MESSAGE_PROPERTIES* result;
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+
+    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
+    {
+        LogError("unable to read the properties map");
+        result = NULL;
+    }
+    else
+    {
+        result = CopyMessageProperties(keys, values, count);
+    }
+    return result;
+}
+
+/*hands the properties over to a new map, which holds them from then on*/
+static int MovePropertiesToMap(MESSAGE_PROPERTIES* properties)
+{
+    int result;
+    MAP_HANDLE map;
+
+    if ((map = Map_Create(ValidateAsciiCharactersFilter)) == NULL)
+    {
+        LogError("Map_Create for properties failed");
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+        result = 0;
+        for (index = 0; index < properties->count; index++)
+        {
+            if (Map_Add(map, properties->keys[index], properties->values[index]) != MAP_OK)
+            {
+                LogError("unable to add property %s to the map", properties->keys[index]);
+                result = __FAILURE__;
+                break;
+            }
+        }
+
+        if (result != 0)
+        {
+            Map_Destroy(map);
+        }
+        else
+        {
+            FreePropertyStore(properties);
+            ResetPropertyStore(properties);
+            properties->map = map;
+        }
+    }
+    return result;
+}
+
+/*gives handleData a private copy of the properties if they are still shared with other messages. Needs to be called before they get modified or handed out.*/
+static int OwnMessageProperties(IOTHUB_MESSAGE_HANDLE_DATA* handleData)
 {
-    if (handleData->contentType == IOTHUBMESSAGE_BYTEARRAY)
+    int result;
+    /*only this message can add references to its properties, so seeing a count of 1 means no other message can see them. Properties held in a map are never shared*/
+    if (((REFCOUNT_TYPE(MESSAGE_PROPERTIES)*)handleData->properties)->count == 1)
     {
-        BUFFER_delete(handleData->value.byteArray);
+        result = 0;
+    }
+    else
+    {
+        MESSAGE_PROPERTIES* ownProperties = CopyMessageProperties(handleData->properties->keys, handleData->properties->values, handleData->properties->count);
+        if (ownProperties == NULL)
+        {
+            LogError("unable to copy the shared message properties");
+            result = __FAILURE__;
+        }
+        else
+        {
+            ReleaseMessageProperties(handleData->properties);
+            handleData->properties = ownProperties;
+            result = 0;
+        }
     }
-    else if (handleData->contentType == IOTHUBMESSAGE_STRING)
+    return result;
+}
+
+static void DestroyMessageData(IOTHUB_MESSAGE_HANDLE_DATA* handleData)
+{
+    if (handleData->value != NULL)
     {
-        STRING_delete(handleData->value.string);
+        CONSTBUFFER_Destroy(handleData->value);
     }
 
-    Map_Destroy(handleData->properties);
+    ReleaseMessageProperties(handleData->properties);
     free(handleData->messageId);
     handleData->messageId = NULL;
     free(handleData->correlationId);
@@ -131,6 +510,13 @@ static IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA_HANDLE CloneDiagnosticPropertyDat
     return result;
 }
 
+/*copies a borrowed payload into a buffer of the message's own*/
+static CONSTBUFFER_HANDLE CopyBorrowedContent(const IOTHUB_MESSAGE_HANDLE_DATA* handleData)
+{
+    unsigned char temp = 0x00;
+    return CONSTBUFFER_Create((handleData->borrowedSize == 0) ? &temp : handleData->borrowedContent, handleData->borrowedSize);
+}
+
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray, size_t size)
 {
     IOTHUB_MESSAGE_HANDLE_DATA* result;
@@ -141,7 +527,7 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
     }
     else
     {
-        result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+        result = REFCOUNT_TYPE_CREATE(IOTHUB_MESSAGE_HANDLE_DATA);
         if (result == NULL)
         {
             LogError("unable to malloc");
@@ -179,18 +565,18 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
             }
             if (result != NULL)
             {
-                /*Codes_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call BUFFER_create passing byteArray and size as parameters.] */
-                if ((result->value.byteArray = BUFFER_create(source, size)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call CONSTBUFFER_Create passing byteArray and size as parameters.] */
+                if ((result->value = CONSTBUFFER_Create(source, size)) == NULL)
                 {
-                    LogError("BUFFER_create failed");
+                    LogError("CONSTBUFFER_Create failed");
                     /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
                     DestroyMessageData(result);
                     result = NULL;
                 }
-                /*Codes_SRS_IOTHUBMESSAGE_02_023: [IoTHubMessage_CreateFromByteArray shall call Map_Create to create the message properties.] */
-                else if ((result->properties = Map_Create(ValidateAsciiCharactersFilter)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_02_023: [IoTHubMessage_CreateFromByteArray shall create an empty property store for the message properties, without creating a map.] */
+                else if ((result->properties = CreateMessageProperties()) == NULL)
                 {
-                    LogError("Map_Create for properties failed");
+                    LogError("unable to create the message properties");
                     /*Codes_SRS_IOTHUBMESSAGE_02_024: [If there are any errors then IoTHubMessage_CreateFromByteArray shall return NULL.] */
                     DestroyMessageData(result);
                     result = NULL;
@@ -202,6 +588,40 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char* byt
     return result;
 }
 
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromBorrowedByteArray(const unsigned char* byteArray, size_t size)
+{
+    IOTHUB_MESSAGE_HANDLE_DATA* result;
+    /*Codes_SRS_IOTHUBMESSAGE_31_016: [If byteArray is NULL and size is not 0, IoTHubMessage_CreateFromBorrowedByteArray shall fail and return NULL.] */
+    if ((byteArray == NULL) && (size != 0))
+    {
+        LogError("Invalid argument - byteArray is NULL");
+        result = NULL;
+    }
+    else if ((result = REFCOUNT_TYPE_CREATE(IOTHUB_MESSAGE_HANDLE_DATA)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_018: [If there are any errors then IoTHubMessage_CreateFromBorrowedByteArray shall return NULL.] */
+        LogError("unable to malloc");
+    }
+    else
+    {
+        memset(result, 0, sizeof(*result));
+        result->contentType = IOTHUBMESSAGE_BYTEARRAY;
+
+        /*Codes_SRS_IOTHUBMESSAGE_31_017: [IoTHubMessage_CreateFromBorrowedByteArray shall create a IOTHUBMESSAGE_BYTEARRAY message pointing at byteArray, without copying it, and an empty property store.] */
+        result->isBorrowed = true;
+        result->borrowedContent = byteArray;
+        result->borrowedSize = size;
+        if ((result->properties = CreateMessageProperties()) == NULL)
+        {
+            LogError("unable to create the message properties");
+            /*Codes_SRS_IOTHUBMESSAGE_31_018: [If there are any errors then IoTHubMessage_CreateFromBorrowedByteArray shall return NULL.] */
+            DestroyMessageData(result);
+            result = NULL;
+        }
+    }
+    return result;
+}
+
 IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
 {
     IOTHUB_MESSAGE_HANDLE_DATA* result;
@@ -212,7 +632,7 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
     }
     else
     {
-        result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+        result = REFCOUNT_TYPE_CREATE(IOTHUB_MESSAGE_HANDLE_DATA);
         if (result == NULL)
         {
             LogError("malloc failed");
@@ -225,18 +645,18 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromString(const char* source)
             /*Codes_SRS_IOTHUBMESSAGE_02_032: [The type of the new message shall be IOTHUBMESSAGE_STRING.] */
             result->contentType = IOTHUBMESSAGE_STRING;
             
-            /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
-            if ((result->value.string = STRING_construct(source)) == NULL)
+            /*Codes_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call CONSTBUFFER_Create passing source and its length including the null terminator as parameters.] */
+            if ((result->value = CONSTBUFFER_Create((const unsigned char*)source, strlen(source) + 1)) == NULL)
             {
-                LogError("STRING_construct failed");
+                LogError("CONSTBUFFER_Create failed");
                 /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
                 DestroyMessageData(result);
                 result = NULL;
             }
-            /*Codes_SRS_IOTHUBMESSAGE_02_028: [IoTHubMessage_CreateFromString shall call Map_Create to create the message properties.] */
-            else if ((result->properties = Map_Create(ValidateAsciiCharactersFilter)) == NULL)
+            /*Codes_SRS_IOTHUBMESSAGE_02_028: [IoTHubMessage_CreateFromString shall create an empty property store for the message properties, without creating a map.] */
+            else if ((result->properties = CreateMessageProperties()) == NULL)
             {
-                LogError("Map_Create for properties failed");
+                LogError("unable to create the message properties");
                 /*Codes_SRS_IOTHUBMESSAGE_02_029: [If there are any encountered in the execution of IoTHubMessage_CreateFromString then IoTHubMessage_CreateFromString shall return NULL.] */
                 DestroyMessageData(result);
                 result = NULL;
@@ -260,7 +680,7 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
     }
     else
     {
-        result = (IOTHUB_MESSAGE_HANDLE_DATA*)malloc(sizeof(IOTHUB_MESSAGE_HANDLE_DATA));
+        result = REFCOUNT_TYPE_CREATE(IOTHUB_MESSAGE_HANDLE_DATA);
         /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
         if (result == NULL)
         {
@@ -303,44 +723,32 @@ IOTHUB_MESSAGE_HANDLE IoTHubMessage_Clone(IOTHUB_MESSAGE_HANDLE iotHubMessageHan
                 DestroyMessageData(result);
                 result = NULL;
             }
-            else if (source->contentType == IOTHUBMESSAGE_BYTEARRAY)
+            /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall share the content with iotHubMessageHandle by a call to CONSTBUFFER_Clone.] */
+            /*Codes_SRS_IOTHUBMESSAGE_31_019: [If the content of iotHubMessageHandle is borrowed, IoTHubMessage_Clone shall copy it with CONSTBUFFER_Create instead.] */
+            else if ((result->value = (source->isBorrowed ? CopyBorrowedContent(source) : CONSTBUFFER_Clone(source->value))) == NULL)
             {
-                /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone to content by a call to BUFFER_clone] */
-                if ((result->value.byteArray = BUFFER_clone(source->value.byteArray)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to BUFFER_clone");
-                    DestroyMessageData(result);
-                    result = NULL;
-                }
-                /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
-                else if ((result->properties = Map_Clone(source->properties)) == NULL)
+                /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+                LogError("unable to copy the message content");
+                DestroyMessageData(result);
+                result = NULL;
+            }
+            else if (source->properties->map != NULL)
+            {
+                /*Codes_SRS_IOTHUBMESSAGE_02_005: [If the properties map of iotHubMessageHandle has been returned by IoTHubMessage_Properties, IoTHubMessage_Clone shall copy the properties out of it into a property store of its own.] */
+                if ((result->properties = CopyMessagePropertiesFromMap(source->properties->map)) == NULL)
                 {
                     /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to Map_Clone");
+                    LogError("unable to copy the message properties");
                     DestroyMessageData(result);
                     result = NULL;
                 }
                 /*Codes_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
             }
-            else /*can only be STRING*/
+            else
             {
-                /*Codes_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
-                if ((result->value.string = STRING_clone(source->value.string)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("failed to STRING_clone");
-                    DestroyMessageData(result);
-                    result = NULL;
-                }
-                /*Codes_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
-                else if ((result->properties = Map_Clone(source->properties)) == NULL)
-                {
-                    /*Codes_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
-                    LogError("unable to Map_Clone");
-                    DestroyMessageData(result);
-                    result = NULL;
-                }
+                /*Codes_SRS_IOTHUBMESSAGE_31_001: [Otherwise IoTHubMessage_Clone shall share the properties with iotHubMessageHandle until either message modifies them.] */
+                INC_REF(MESSAGE_PROPERTIES, source->properties);
+                result->properties = source->properties;
             }
         }
     }
@@ -369,12 +777,20 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE iotHubMes
             result = IOTHUB_MESSAGE_INVALID_ARG;
             LogError("invalid type of message %s", ENUM_TO_STRING(IOTHUBMESSAGE_CONTENT_TYPE, handleData->contentType));
         }
+        else if (handleData->isBorrowed)
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_31_020: [If the content of iotHubMessageHandle is borrowed, IoTHubMessage_GetByteArray shall return the borrowed byte array.] */
+            *buffer = handleData->borrowedContent;
+            *size = handleData->borrowedSize;
+            result = IOTHUB_MESSAGE_OK;
+        }
         else
         {
-            /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
-            *buffer = BUFFER_u_char(handleData->value.byteArray);
-            /*Codes_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using BUFFER_length and it shall be copied to the size argument.]*/
-            *size = BUFFER_length(handleData->value.byteArray);
+            const CONSTBUFFER* content = CONSTBUFFER_GetContent(handleData->value);
+            /*Codes_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using CONSTBUFFER_GetContent and it shall be copied in the buffer argument.]*/
+            *buffer = content->buffer;
+            /*Codes_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using CONSTBUFFER_GetContent and it shall be copied to the size argument.]*/
+            *size = content->size;
             result = IOTHUB_MESSAGE_OK;
         }
     }
@@ -400,7 +816,7 @@ const char* IoTHubMessage_GetString(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
         else
         {
             /*Codes_SRS_IOTHUBMESSAGE_02_018: [IoTHubMessage_GetStringData shall return the currently stored null terminated string.] */
-            result = STRING_c_str(handleData->value.string);
+            result = (const char*)CONSTBUFFER_GetContent(handleData->value)->buffer;
         }
     }
     return result;
@@ -434,9 +850,26 @@ MAP_HANDLE IoTHubMessage_Properties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
     }
     else
     {
-        /*Codes_SRS_IOTHUBMESSAGE_02_002: [Otherwise, for any non-NULL iotHubMessageHandle it shall return a non-NULL MAP_HANDLE.]*/
         IOTHUB_MESSAGE_HANDLE_DATA* handleData = (IOTHUB_MESSAGE_HANDLE_DATA*)iotHubMessageHandle;
-        result = handleData->properties;
+        /*Codes_SRS_IOTHUBMESSAGE_31_002: [If the properties are shared with a clone, IoTHubMessage_Properties shall first make a private copy of them.] */
+        if (OwnMessageProperties(handleData) != 0)
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_31_003: [If making the private copy fails, IoTHubMessage_Properties shall return NULL.] */
+            LogError("unable to get the message properties");
+            result = NULL;
+        }
+        /*Codes_SRS_IOTHUBMESSAGE_31_005: [The first time it is called, IoTHubMessage_Properties shall create a map with Map_Create and move the properties into it with Map_Add; from then on the map holds the message properties.] */
+        else if ((handleData->properties->map == NULL) && (MovePropertiesToMap(handleData->properties) != 0))
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_31_006: [If creating or filling the map fails, IoTHubMessage_Properties shall return NULL and leave the properties unchanged.] */
+            LogError("unable to create the properties map");
+            result = NULL;
+        }
+        else
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_02_002: [Otherwise, for any non-NULL iotHubMessageHandle it shall return a non-NULL MAP_HANDLE.]*/
+            result = handleData->properties->map;
+        }
     }
     return result;
 }
@@ -451,9 +884,39 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_SetProperty(IOTHUB_MESSAGE_HANDLE msg_handle
     }
     else
     {
-        if (Map_AddOrUpdate(msg_handle->properties, key, value) != MAP_OK)
+        size_t keyLength = strlen(key);
+        size_t valueLength = strlen(value);
+
+        /*Codes_SRS_IOTHUBMESSAGE_31_007: [If key or value contains a character outside of Ascii value 32 - 126, IoTHubMessage_SetProperty shall return IOTHUB_MESSAGE_ERROR. The check shall be done once, a machine word at a time.] */
+        if (!IsPrintableUsAscii(key, keyLength) || !IsPrintableUsAscii(value, valueLength))
+        {
+            LogError("property key and value can only contain printable US-Ascii characters");
+            result = IOTHUB_MESSAGE_ERROR;
+        }
+        /*Codes_SRS_IOTHUBMESSAGE_31_004: [If the properties are shared with a clone, IoTHubMessage_SetProperty shall first make a private copy of them.] */
+        else if (OwnMessageProperties(msg_handle) != 0)
+        {
+            LogError("unable to get the message properties");
+            result = IOTHUB_MESSAGE_ERROR;
+        }
+        else if (msg_handle->properties->map != NULL)
+        {
+            /*Codes_SRS_IOTHUBMESSAGE_31_008: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_SetProperty shall call Map_AddOrUpdate on it.] */
+            if (Map_AddOrUpdate(msg_handle->properties->map, key, value) != MAP_OK)
+            {
+                LogError("Failure adding property to internal map");
+                result = IOTHUB_MESSAGE_ERROR;
+            }
+            else
+            {
+                result = IOTHUB_MESSAGE_OK;
+            }
+        }
+        /*Codes_SRS_IOTHUBMESSAGE_31_009: [Otherwise IoTHubMessage_SetProperty shall copy key and value in the property store, replacing the value if key is already there.] */
+        else if (StoreProperty(msg_handle->properties, FindProperty(msg_handle->properties, key), key, keyLength, value, valueLength) != 0)
         {
-            LogError("Failure adding property to internal map");
+            /*Codes_SRS_IOTHUBMESSAGE_31_010: [If storing the property fails, IoTHubMessage_SetProperty shall return IOTHUB_MESSAGE_ERROR and leave the properties unchanged.] */
+            LogError("Failure storing property %s", key);
             result = IOTHUB_MESSAGE_ERROR;
         }
         else
@@ -472,19 +935,72 @@ const char* IoTHubMessage_GetProperty(IOTHUB_MESSAGE_HANDLE msg_handle, const ch
         LogError("invalid parameter (NULL) to IoTHubMessage_GetProperty iotHubMessageHandle=%p, key=%p", msg_handle, key);
         result = NULL;
     }
-    else
+    else if (msg_handle->properties->map != NULL)
     {
         bool key_exists = false;
         // The return value is not neccessary, just check the key_exist variable
-        if ((Map_ContainsKey(msg_handle->properties, key, &key_exists) == MAP_OK) && key_exists)
+        if ((Map_ContainsKey(msg_handle->properties->map, key, &key_exists) == MAP_OK) && key_exists)
         {
-            result = Map_GetValueFromKey(msg_handle->properties, key);
+            result = Map_GetValueFromKey(msg_handle->properties->map, key);
         }
         else
         {
             result = NULL;
         }
     }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_011: [IoTHubMessage_GetProperty shall return the value of key in the property store, or NULL if there is none.] */
+        size_t index = FindProperty(msg_handle->properties, key);
+        result = (index < msg_handle->properties->count) ? msg_handle->properties->values[index] : NULL;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_GetProperties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* const** keys, const char* const** values, size_t* count, size_t* keysAndValuesLength)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    if ((iotHubMessageHandle == NULL) || (keys == NULL) || (values == NULL) || (count == NULL))
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_012: [If iotHubMessageHandle, keys, values or count is NULL, IoTHubMessage_GetProperties shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+        LogError("invalid parameter (NULL) to IoTHubMessage_GetProperties iotHubMessageHandle=%p, keys=%p, values=%p, count=%p", iotHubMessageHandle, keys, values, count);
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else if (iotHubMessageHandle->properties->map != NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_015: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_GetProperties shall read it with Map_GetInternals and return IOTHUB_MESSAGE_ERROR if that fails.] */
+        if (Map_GetInternals(iotHubMessageHandle->properties->map, keys, values, count) != MAP_OK)
+        {
+            LogError("unable to read the properties map");
+            result = IOTHUB_MESSAGE_ERROR;
+        }
+        else
+        {
+            if (keysAndValuesLength != NULL)
+            {
+                size_t index;
+                *keysAndValuesLength = 0;
+                for (index = 0; index < *count; index++)
+                {
+                    *keysAndValuesLength += strlen((*keys)[index]) + strlen((*values)[index]);
+                }
+            }
+            result = IOTHUB_MESSAGE_OK;
+        }
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_013: [IoTHubMessage_GetProperties shall return the keys and values held by the property store without copying them, and without making a private copy of properties shared with a clone.] */
+        *keys = iotHubMessageHandle->properties->keys;
+        *values = iotHubMessageHandle->properties->values;
+        *count = iotHubMessageHandle->properties->count;
+        /*Codes_SRS_IOTHUBMESSAGE_31_014: [If keysAndValuesLength is not NULL, IoTHubMessage_GetProperties shall set it to the length of all the keys and values, terminators not included.] */
+        if (keysAndValuesLength != NULL)
+        {
+            *keysAndValuesLength = iotHubMessageHandle->properties->keysAndValuesLength;
+        }
+        result = IOTHUB_MESSAGE_OK;
+    }
     return result;
 }
 
@@ -761,10 +1277,65 @@ IOTHUB_MESSAGE_RESULT IoTHubMessage_SetDiagnosticPropertyData(IOTHUB_MESSAGE_HAN
     return result;
 }
 
+IOTHUB_MESSAGE_RESULT IoTHubMessage_OwnContent(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    if (iotHubMessageHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_021: [If iotHubMessageHandle is NULL, IoTHubMessage_OwnContent shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+        LogError("invalid parameter (NULL) to IoTHubMessage_OwnContent");
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    else if (!iotHubMessageHandle->isBorrowed)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_022: [If the content of iotHubMessageHandle is not borrowed, IoTHubMessage_OwnContent shall do nothing and return IOTHUB_MESSAGE_OK.] */
+        result = IOTHUB_MESSAGE_OK;
+    }
+    /*Codes_SRS_IOTHUBMESSAGE_31_023: [Otherwise IoTHubMessage_OwnContent shall copy the borrowed content with CONSTBUFFER_Create, so the message no longer refers to it, and return IOTHUB_MESSAGE_OK.] */
+    else if ((iotHubMessageHandle->value = CopyBorrowedContent(iotHubMessageHandle)) == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_024: [If copying the content fails, IoTHubMessage_OwnContent shall return IOTHUB_MESSAGE_ERROR and the content shall stay borrowed.] */
+        LogError("unable to copy the borrowed message content");
+        result = IOTHUB_MESSAGE_ERROR;
+    }
+    else
+    {
+        iotHubMessageHandle->isBorrowed = false;
+        iotHubMessageHandle->borrowedContent = NULL;
+        iotHubMessageHandle->borrowedSize = 0;
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_Retain(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    IOTHUB_MESSAGE_RESULT result;
+    if (iotHubMessageHandle == NULL)
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_025: [If iotHubMessageHandle is NULL, IoTHubMessage_Retain shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+        LogError("invalid parameter (NULL) to IoTHubMessage_Retain");
+        result = IOTHUB_MESSAGE_INVALID_ARG;
+    }
+    /*Codes_SRS_IOTHUBMESSAGE_31_026: [IoTHubMessage_Retain shall make the message own its content as IoTHubMessage_OwnContent does, and return IOTHUB_MESSAGE_ERROR if that fails.] */
+    else if (IoTHubMessage_OwnContent(iotHubMessageHandle) != IOTHUB_MESSAGE_OK)
+    {
+        result = IOTHUB_MESSAGE_ERROR;
+    }
+    else
+    {
+        /*Codes_SRS_IOTHUBMESSAGE_31_027: [IoTHubMessage_Retain shall add a reference to iotHubMessageHandle, released by one more call to IoTHubMessage_Destroy, and return IOTHUB_MESSAGE_OK.] */
+        INC_REF(IOTHUB_MESSAGE_HANDLE_DATA, iotHubMessageHandle);
+        result = IOTHUB_MESSAGE_OK;
+    }
+    return result;
+}
+
 void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
     /*Codes_SRS_IOTHUBMESSAGE_01_004: [If iotHubMessageHandle is NULL, IoTHubMessage_Destroy shall do nothing.] */
-    if (iotHubMessageHandle != NULL)
+    /*Codes_SRS_IOTHUBMESSAGE_31_028: [IoTHubMessage_Destroy shall only release a reference while references added by IoTHubMessage_Retain remain.] */
+    if ((iotHubMessageHandle != NULL) && (DEC_REF(IOTHUB_MESSAGE_HANDLE_DATA, iotHubMessageHandle) == DEC_RETURN_ZERO))
     {
         /*Codes_SRS_IOTHUBMESSAGE_01_003: [IoTHubMessage_Destroy shall free all resources associated with iotHubMessageHandle.]  */
         DestroyMessageData((IOTHUB_MESSAGE_HANDLE_DATA* )iotHubMessageHandle);
@@ -4,10 +4,13 @@
 #include <stdlib.h> 
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 
@@ -16,6 +19,20 @@
 #include "iothub_transport_ll.h"
 #include "iothub_client_core.h"
 
+/*how long a client that ends waits for a client worker before looking again, in case the worker's post woke another ending client*/
+#define CLIENT_IDLE_WAIT_MS 10
+
+struct TRANSPORT_HANDLE_DATA_TAG;
+
+typedef struct TRANSPORT_CLIENT_WORKER_TAG
+{
+    struct TRANSPORT_HANDLE_DATA_TAG* transportData;
+    THREAD_HANDLE threadHandle;
+    size_t index;
+    size_t nextClient; /*next position in clients belonging to this worker's shard, advances by clientWorkerCount*/
+    IOTHUB_CLIENT_CORE_HANDLE currentClient; /*client whose clientDoWork is running on this worker, NULL when none*/
+} TRANSPORT_CLIENT_WORKER;
+
 typedef struct TRANSPORT_HANDLE_DATA_TAG
 {
     TRANSPORT_LL_HANDLE transportLLHandle;
@@ -26,6 +43,9 @@ typedef struct TRANSPORT_HANDLE_DATA_TAG
     VECTOR_HANDLE clients;
     LOCK_HANDLE clientsLockHandle;
     IOTHUB_CLIENT_MULTIPLEXED_DO_WORK clientDoWork;
+    size_t clientWorkerCount; /*0 means the transport worker thread also services the clients*/
+    TRANSPORT_CLIENT_WORKER* clientWorkers; /*set and freed under clientsLockHandle*/
+    COND_HANDLE clientIdleCondition; /*posted under clientsLockHandle each time a client worker is done with a client*/
 } TRANSPORT_HANDLE_DATA;
 
 /* Used for Unit test */
@@ -117,6 +137,9 @@ TRANSPORT_HANDLE IoTHubTransport_Create(IOTHUB_CLIENT_TRANSPORT_PROVIDER protoco
                         /*Codes_SRS_IOTHUBTRANSPORT_17_001: [ IoTHubTransport_Create shall return a non-NULL handle on success.]*/
                         result->stopThread = 1;
                         result->clientDoWork = NULL;
+                        result->clientWorkerCount = 0;
+                        result->clientWorkers = NULL;
+                        result->clientIdleCondition = NULL;
                         result->workerThreadHandle = NULL; /* create thread when work needs to be done */
                         result->IoTHubTransport_GetHostname = transportProtocol->IoTHubTransport_GetHostname;
                         result->IoTHubTransport_SetOption = transportProtocol->IoTHubTransport_SetOption;
@@ -191,7 +214,10 @@ static int transport_worker_thread(void* threadArgument)
             }
         }
 
-        multiplexed_client_do_work(transportData);
+        if (transportData->clientWorkers == NULL)
+        {
+            multiplexed_client_do_work(transportData);
+        }
 
         /*Codes_SRS_IOTHUBTRANSPORT_17_029: [ The thread shall call lower layer transport DoWork every 1 ms. ]*/
         ThreadAPI_Sleep(1);
@@ -201,6 +227,229 @@ static int transport_worker_thread(void* threadArgument)
     return 0;
 }
 
+/*needs to be called with clientsLockHandle taken*/
+static bool is_client_in_progress(TRANSPORT_HANDLE_DATA* transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
+{
+    bool result = false;
+    size_t index;
+    for (index = 0; (transportData->clientWorkers != NULL) && (index < transportData->clientWorkerCount); index++)
+    {
+        if (transportData->clientWorkers[index].currentClient == clientHandle)
+        {
+            result = true;
+            break;
+        }
+    }
+    return result;
+}
+
+/*hands the next client to the worker: first from its own shard, then stolen from the shard with the most clients left in this pass.
+Needs to be called with clientsLockHandle taken*/
+static IOTHUB_CLIENT_CORE_HANDLE claim_next_client(TRANSPORT_HANDLE_DATA* transportData, TRANSPORT_CLIENT_WORKER* worker)
+{
+    IOTHUB_CLIENT_CORE_HANDLE result = NULL;
+    size_t numberOfClients = VECTOR_size(transportData->clients);
+
+    while (result == NULL)
+    {
+        TRANSPORT_CLIENT_WORKER* owner = worker;
+
+        if (worker->nextClient >= numberOfClients)
+        {
+            size_t mostRemaining = 0;
+            size_t index;
+            for (index = 0; index < transportData->clientWorkerCount; index++)
+            {
+                TRANSPORT_CLIENT_WORKER* victim = &transportData->clientWorkers[index];
+                if ((victim->nextClient < numberOfClients) &&
+                    (numberOfClients - victim->nextClient > mostRemaining))
+                {
+                    mostRemaining = numberOfClients - victim->nextClient;
+                    owner = victim;
+                }
+            }
+        }
+
+        if (owner->nextClient >= numberOfClients)
+        {
+            /*every shard is done for this pass*/
+            break;
+        }
+        else
+        {
+            IOTHUB_CLIENT_CORE_HANDLE* clientHandle = (IOTHUB_CLIENT_CORE_HANDLE*)VECTOR_element(transportData->clients, owner->nextClient);
+            owner->nextClient += transportData->clientWorkerCount;
+
+            /*clients shift when one is removed, so the same client can show up in two shards in that pass*/
+            if ((clientHandle != NULL) && !is_client_in_progress(transportData, *clientHandle))
+            {
+                result = *clientHandle;
+                worker->currentClient = result;
+            }
+        }
+    }
+
+    return result;
+}
+
+static int transport_client_worker_thread(void* threadArgument)
+{
+    TRANSPORT_CLIENT_WORKER* worker = (TRANSPORT_CLIENT_WORKER*)threadArgument;
+    TRANSPORT_HANDLE_DATA* transportData = worker->transportData;
+
+    while (1)
+    {
+        IOTHUB_CLIENT_CORE_HANDLE clientHandle;
+
+        if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for transport_client_worker_thread");
+            clientHandle = NULL;
+        }
+        else
+        {
+            if (transportData->stopThread)
+            {
+                (void)Unlock(transportData->clientsLockHandle);
+                break;
+            }
+
+            if ((clientHandle = claim_next_client(transportData, worker)) == NULL)
+            {
+                /*start the next pass over this worker's shard*/
+                worker->nextClient = worker->index;
+            }
+
+            (void)Unlock(transportData->clientsLockHandle);
+        }
+
+        if (clientHandle != NULL)
+        {
+            transportData->clientDoWork(clientHandle);
+
+            if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+            {
+                LogError("failed to lock for transport_client_worker_thread, releasing client anyway");
+                worker->currentClient = NULL;
+                (void)Condition_Post(transportData->clientIdleCondition);
+            }
+            else
+            {
+                worker->currentClient = NULL;
+                (void)Condition_Post(transportData->clientIdleCondition);
+                (void)Unlock(transportData->clientsLockHandle);
+            }
+        }
+        else
+        {
+            ThreadAPI_Sleep(1);
+        }
+    }
+
+    ThreadAPI_Exit(0);
+    return 0;
+}
+
+/*only the thread joining the transport frees the client workers, so it can look at them without the lock until then*/
+static void wait_client_workers(TRANSPORT_HANDLE_DATA* transportData)
+{
+    if (transportData->clientWorkers != NULL)
+    {
+        TRANSPORT_CLIENT_WORKER* clientWorkers = transportData->clientWorkers;
+        size_t index;
+        for (index = 0; index < transportData->clientWorkerCount; index++)
+        {
+            if (clientWorkers[index].threadHandle != NULL)
+            {
+                int res;
+                if (ThreadAPI_Join(clientWorkers[index].threadHandle, &res) != THREADAPI_OK)
+                {
+                    LogError("ThreadAPI_Join failed for client worker %lu", (unsigned long)index);
+                }
+            }
+        }
+
+        /*a client that is ending might still be looking at the workers from wait_client_idle*/
+        if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for wait_client_workers, freeing the client workers anyway");
+            transportData->clientWorkers = NULL;
+        }
+        else
+        {
+            transportData->clientWorkers = NULL;
+            (void)Unlock(transportData->clientsLockHandle);
+        }
+        free(clientWorkers);
+    }
+}
+
+/*needs to be called with stopThread cleared; on failure the workers already started are stopped and joined*/
+static int start_client_workers(TRANSPORT_HANDLE_DATA* transportData)
+{
+    int result;
+
+    TRANSPORT_CLIENT_WORKER* clientWorkers;
+
+    if (transportData->clientWorkerCount == 0)
+    {
+        result = 0;
+    }
+    else if ((clientWorkers = (TRANSPORT_CLIENT_WORKER*)malloc(transportData->clientWorkerCount * sizeof(TRANSPORT_CLIENT_WORKER))) == NULL)
+    {
+        LogError("failed allocating client workers");
+        result = __FAILURE__;
+    }
+    else if ((transportData->clientIdleCondition == NULL) &&
+        ((transportData->clientIdleCondition = Condition_Init()) == NULL))
+    {
+        LogError("failed creating the client idle condition");
+        free(clientWorkers);
+        result = __FAILURE__;
+    }
+    else if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+    {
+        LogError("failed to lock for start_client_workers");
+        free(clientWorkers);
+        result = __FAILURE__;
+    }
+    else
+    {
+        size_t index;
+
+        for (index = 0; index < transportData->clientWorkerCount; index++)
+        {
+            clientWorkers[index].transportData = transportData;
+            clientWorkers[index].threadHandle = NULL;
+            clientWorkers[index].index = index;
+            clientWorkers[index].nextClient = index;
+            clientWorkers[index].currentClient = NULL;
+        }
+        transportData->clientWorkers = clientWorkers;
+        (void)Unlock(transportData->clientsLockHandle);
+
+        result = 0;
+        for (index = 0; index < transportData->clientWorkerCount; index++)
+        {
+            if (ThreadAPI_Create(&transportData->clientWorkers[index].threadHandle, transport_client_worker_thread, &transportData->clientWorkers[index]) != THREADAPI_OK)
+            {
+                LogError("failed creating client worker %lu", (unsigned long)index);
+                transportData->clientWorkers[index].threadHandle = NULL;
+                result = __FAILURE__;
+                break;
+            }
+        }
+
+        if (result != 0)
+        {
+            transportData->stopThread = 1;
+            wait_client_workers(transportData);
+        }
+    }
+
+    return result;
+}
+
 static bool find_by_handle(const void* element, const void* value)
 {
     /* data stored at element is device handle */
@@ -216,9 +465,18 @@ static IOTHUB_CLIENT_RESULT start_worker_if_needed(TRANSPORT_HANDLE_DATA * trans
     {
         /*Codes_SRS_IOTHUBTRANSPORT_17_018: [ If the worker thread does not exist, IoTHubTransport_StartWorkerThread shall start the thread using ThreadAPI_Create. ]*/
         transportData->stopThread = 0;
-        if (ThreadAPI_Create(&transportData->workerThreadHandle, transport_worker_thread, transportData) != THREADAPI_OK)
+        if (start_client_workers(transportData) != 0)
+        {
+            LogError("unable to start client workers");
+        }
+        else if (ThreadAPI_Create(&transportData->workerThreadHandle, transport_worker_thread, transportData) != THREADAPI_OK)
         {
             transportData->workerThreadHandle = NULL;
+            if (transportData->clientWorkers != NULL)
+            {
+                transportData->stopThread = 1;
+                wait_client_workers(transportData);
+            }
         }
     }
     if (transportData->workerThreadHandle != NULL)
@@ -285,6 +543,21 @@ static void wait_worker_thread(TRANSPORT_HANDLE_DATA * transportData)
             transportData->workerThreadHandle = NULL;
         }
     }
+    wait_client_workers(transportData);
+}
+
+/*with client workers the client might be serviced right now; it is no longer in clients so it cannot be picked up again.
+Needs to be called with clientsLockHandle taken, which Condition_Wait gives up while waiting*/
+static void wait_client_idle(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
+{
+    while (is_client_in_progress(transportData, clientHandle))
+    {
+        if (Condition_Wait(transportData->clientIdleCondition, transportData->clientsLockHandle, CLIENT_IDLE_WAIT_MS) == COND_ERROR)
+        {
+            LogError("Condition_Wait failed for wait_client_idle");
+            break;
+        }
+    }
 }
 
 static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTHUB_CLIENT_CORE_HANDLE clientHandle)
@@ -322,6 +595,8 @@ static bool signal_end_worker_thread(TRANSPORT_HANDLE_DATA * transportData, IOTH
             okToJoin = false;
         }
 
+        wait_client_idle(transportData, clientHandle);
+
         if (Unlock(transportData->clientsLockHandle) != LOCK_OK)
         {
             LogError("failed to unlock on signal_end_worker_thread");
@@ -352,6 +627,10 @@ void IoTHubTransport_Destroy(TRANSPORT_HANDLE transportHandle)
         Lock_Deinit(transportData->lockHandle);
         (transportData->IoTHubTransport_Destroy)(transportData->transportLLHandle);
         VECTOR_destroy(transportData->clients);
+        if (transportData->clientIdleCondition != NULL)
+        {
+            Condition_Deinit(transportData->clientIdleCondition);
+        }
         Lock_Deinit(transportData->clientsLockHandle);
         free(transportHandle);
     }
@@ -451,3 +730,43 @@ void IoTHubTransport_JoinWorkerThread(TRANSPORT_HANDLE transportHandle, IOTHUB_C
         wait_worker_thread(transportData);
     }
 }
+
+int IoTHubTransport_SetClientWorkerThreadCount(TRANSPORT_HANDLE transportHandle, size_t workerThreadCount)
+{
+    int result;
+    if (transportHandle == NULL)
+    {
+        LogError("Invalid NULL argument transportHandle");
+        result = __FAILURE__;
+    }
+    else if (workerThreadCount > SIZE_MAX / sizeof(TRANSPORT_CLIENT_WORKER))
+    {
+        LogError("Invalid workerThreadCount %lu", (unsigned long)workerThreadCount);
+        result = __FAILURE__;
+    }
+    else
+    {
+        TRANSPORT_HANDLE_DATA * transportData = (TRANSPORT_HANDLE_DATA*)transportHandle;
+        if (Lock(transportData->clientsLockHandle) != LOCK_OK)
+        {
+            LogError("failed to lock for IoTHubTransport_SetClientWorkerThreadCount");
+            result = __FAILURE__;
+        }
+        else
+        {
+            if (transportData->workerThreadHandle != NULL)
+            {
+                LogError("the number of client worker threads cannot be changed while the transport worker thread is running");
+                result = __FAILURE__;
+            }
+            else
+            {
+                transportData->clientWorkerCount = workerThreadCount;
+                result = 0;
+            }
+
+            (void)Unlock(transportData->clientsLockHandle);
+        }
+    }
+    return result;
+}
@@ -16,6 +16,13 @@
 #define DEFAULT_CBS_REQUEST_TIMEOUT_SECS          UINT32_MAX
 #define DEFAULT_SAS_TOKEN_LIFETIME_SECS           3600
 #define DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS       1800
+// Up to this much of the refresh time is taken off each device's refresh, so devices that authenticated together do not all refresh together.
+#define SAS_TOKEN_REFRESH_MAX_JITTER_PERCENT      10
+// How early, in percent of the refresh time, the next SAS token gets created (capped to MAX_SAS_TOKEN_PRECOMPUTE_LEAD_SECS).
+#define SAS_TOKEN_PRECOMPUTE_LEAD_PERCENT         5
+#define MAX_SAS_TOKEN_PRECOMPUTE_LEAD_SECS        60
+// A precomputed SAS token older than this, in percent of its lifetime, is discarded instead of being put to CBS.
+#define SAS_TOKEN_PRECOMPUTED_MAX_AGE_PERCENT     10
 
 typedef struct AUTHENTICATION_INSTANCE_TAG 
 {
@@ -40,6 +47,13 @@ typedef struct AUTHENTICATION_INSTANCE_TAG
 
     time_t current_sas_token_put_time;
 
+    size_t sas_token_refresh_jitter_secs;
+    char* precomputed_sas_token;
+    time_t precomputed_sas_token_time;
+
+    AUTHENTICATION_REFRESH_LIMIT* sas_token_refresh_limit;
+    bool is_holding_sas_token_refresh_slot;
+
     // Auth module used to generating handle authorization
     // with either SAS Token, x509 Certs, and Device SAS Token
     IOTHUB_AUTHORIZATION_HANDLE authorization_module;
@@ -104,7 +118,20 @@ static int verify_cbs_put_token_timeout(AUTHENTICATION_INSTANCE* instance, bool*
     return result;
 }
 
-static int verify_sas_token_refresh_timeout(AUTHENTICATION_INSTANCE* instance, bool* is_timed_out)
+static size_t get_sas_token_refresh_time_secs(AUTHENTICATION_INSTANCE* instance)
+{
+    return (instance->sas_token_refresh_time_secs > instance->sas_token_refresh_jitter_secs ?
+        instance->sas_token_refresh_time_secs - instance->sas_token_refresh_jitter_secs : 0);
+}
+
+static size_t get_sas_token_precompute_lead_secs(AUTHENTICATION_INSTANCE* instance)
+{
+    size_t lead_secs = instance->sas_token_refresh_time_secs / 100 * SAS_TOKEN_PRECOMPUTE_LEAD_PERCENT;
+
+    return (lead_secs > MAX_SAS_TOKEN_PRECOMPUTE_LEAD_SECS ? MAX_SAS_TOKEN_PRECOMPUTE_LEAD_SECS : lead_secs);
+}
+
+static int verify_sas_token_refresh_timeout(AUTHENTICATION_INSTANCE* instance, time_t current_time, bool* is_timed_out, bool* is_close_to_timeout)
 {
     int result;
 
@@ -115,28 +142,68 @@ static int verify_sas_token_refresh_timeout(AUTHENTICATION_INSTANCE* instance, b
     }
     else
     {
-        time_t current_time;
+        size_t refresh_time_secs = get_sas_token_refresh_time_secs(instance);
+        uint32_t elapsed_secs = (uint32_t)get_difftime(current_time, instance->current_sas_token_put_time);
 
-        if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
-        {
-            result = __FAILURE__;
-            LogError("Failed verifying if SAS token refresh timed out (get_time failed)");
-        }
-        else if ((uint32_t)get_difftime(current_time, instance->current_sas_token_put_time) >= instance->sas_token_refresh_time_secs)
-        {
-            *is_timed_out = true;
-            result = RESULT_OK;
-        }
-        else
-        {
-            *is_timed_out = false;
-            result = RESULT_OK;
-        }
+        *is_timed_out = (elapsed_secs >= refresh_time_secs);
+        *is_close_to_timeout = (elapsed_secs + get_sas_token_precompute_lead_secs(instance) >= refresh_time_secs);
+        result = RESULT_OK;
     }
 
     return result;
 }
 
+// @brief
+//     Takes one of the SAS token refreshes allowed by `instance->sas_token_refresh_limit`, if any is left.
+static bool acquire_sas_token_refresh_slot(AUTHENTICATION_INSTANCE* instance)
+{
+    bool result;
+
+    if (instance->sas_token_refresh_limit == NULL)
+    {
+        result = true;
+    }
+    else if (instance->sas_token_refresh_limit->refreshes_in_progress >= instance->sas_token_refresh_limit->max_refreshes_in_progress)
+    {
+        result = false;
+    }
+    else
+    {
+        instance->sas_token_refresh_limit->refreshes_in_progress++;
+        instance->is_holding_sas_token_refresh_slot = true;
+        result = true;
+    }
+
+    return result;
+}
+
+static void release_sas_token_refresh_slot(AUTHENTICATION_INSTANCE* instance)
+{
+    if (instance->is_holding_sas_token_refresh_slot)
+    {
+        instance->sas_token_refresh_limit->refreshes_in_progress--;
+        instance->is_holding_sas_token_refresh_slot = false;
+    }
+}
+
+static void destroy_precomputed_sas_token(AUTHENTICATION_INSTANCE* instance)
+{
+    if (instance->precomputed_sas_token != NULL)
+    {
+        free(instance->precomputed_sas_token);
+        instance->precomputed_sas_token = NULL;
+    }
+}
+
+static void discard_stale_precomputed_sas_token(AUTHENTICATION_INSTANCE* instance, time_t current_time)
+{
+    if (instance->precomputed_sas_token != NULL &&
+        get_difftime(current_time, instance->precomputed_sas_token_time) >= (double)(instance->sas_token_lifetime_secs / 100 * SAS_TOKEN_PRECOMPUTED_MAX_AGE_PERCENT))
+    {
+        destroy_precomputed_sas_token(instance);
+    }
+}
+
 static STRING_HANDLE create_devices_path(STRING_HANDLE iothub_host_fqdn, const char* device_id)
 {
     STRING_HANDLE devices_path;
@@ -183,6 +250,9 @@ static void on_cbs_put_token_complete_callback(void* context, CBS_OPERATION_RESU
     }
 
     instance->is_sas_token_refresh_in_progress = false;
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_006: [The SAS token refresh taken from `instance->sas_token_refresh_limit` shall be given back when the refresh completes, fails or times out]
+    release_sas_token_refresh_slot(instance);
 }
 
 static int put_SAS_token_to_cbs(AUTHENTICATION_INSTANCE* instance, STRING_HANDLE cbs_audience, char* sas_token)
@@ -221,39 +291,58 @@ static int put_SAS_token_to_cbs(AUTHENTICATION_INSTANCE* instance, STRING_HANDLE
 
         instance->current_sas_token_put_time = current_time; // If it failed, fear not. `current_sas_token_put_time` shall be checked for INDEFINITE_TIME wherever it is used.
 
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_001: [If cbs_put_token() succeeds, the next SAS token refresh shall happen a random amount of time, up to SAS_TOKEN_REFRESH_MAX_JITTER_PERCENT of `instance->sas_token_refresh_time_secs`, earlier]
+        instance->sas_token_refresh_jitter_secs = (size_t)rand() % (instance->sas_token_refresh_time_secs / 100 * SAS_TOKEN_REFRESH_MAX_JITTER_PERCENT + 1);
+
         result = RESULT_OK;
     }
 
     return result;
 }
 
-static int create_and_put_SAS_token_to_cbs(AUTHENTICATION_INSTANCE* instance)
+static int create_SAS_token(AUTHENTICATION_INSTANCE* instance, STRING_HANDLE devices_path, char** sas_token)
 {
     int result;
-    char* sas_token;
-    STRING_HANDLE devices_path;
 
-    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_053: [A STRING_HANDLE, referred to as `devices_path`, shall be created from the following parts: iothub_host_fqdn + "/devices/" + device_id]
-    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_071: [A STRING_HANDLE, referred to as `devices_path`, shall be created from the following parts: iothub_host_fqdn + "/devices/" + device_id]
-    if ((devices_path = create_devices_path(instance->iothub_host_fqdn, instance->device_id)) == NULL)
+    /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_07_001: [ authentication_do_work() shall determine what credential type is used SAS_TOKEN or DEVICE_KEY by calling IoTHubClient_Auth_Get_Credential_Type ] */
+    IOTHUB_CREDENTIAL_TYPE cred_type = IoTHubClient_Auth_Get_Credential_Type(instance->authorization_module);
+    if (cred_type == IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY || cred_type == IOTHUB_CREDENTIAL_TYPE_DEVICE_AUTH)
     {
-        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_054: [If `devices_path` failed to be created, authentication_do_work() shall fail and return]
-        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_072: [If `devices_path` failed to be created, authentication_do_work() shall fail and return]
-        result = __FAILURE__;
-        sas_token = NULL;
-        LogError("Failed creating a SAS token (create_devices_path() failed)");
+        /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_049: [authentication_do_work() shall create a SAS token using IoTHubClient_Auth_Get_SasToken, unless it has failed previously] */
+        *sas_token = IoTHubClient_Auth_Get_SasToken(instance->authorization_module, STRING_c_str(devices_path), instance->sas_token_lifetime_secs, NULL);
+        if (*sas_token == NULL)
+        {
+            LogError("failure getting sas token.");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = RESULT_OK;
+        }
     }
-    else
+    else if (cred_type == IOTHUB_CREDENTIAL_TYPE_SAS_TOKEN)
     {
-        /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_07_001: [ authentication_do_work() shall determine what credential type is used SAS_TOKEN or DEVICE_KEY by calling IoTHubClient_Auth_Get_Credential_Type ] */
-        IOTHUB_CREDENTIAL_TYPE cred_type = IoTHubClient_Auth_Get_Credential_Type(instance->authorization_module);
-        if (cred_type == IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY || cred_type == IOTHUB_CREDENTIAL_TYPE_DEVICE_AUTH)
+        /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_07_002: [ If credential Type is SAS_TOKEN authentication_do_work() shall validate the sas_token, and fail if it's not valid. ] */
+        SAS_TOKEN_STATUS token_status = IoTHubClient_Auth_Is_SasToken_Valid(instance->authorization_module);
+        if (token_status == SAS_TOKEN_STATUS_INVALID)
+        {
+            LogError("sas token is invalid.");
+            *sas_token = NULL;
+            result = __FAILURE__;
+        }
+        else if (token_status == SAS_TOKEN_STATUS_FAILED)
+        {
+            LogError("testing Sas Token failed.");
+            *sas_token = NULL;
+            result = __FAILURE__;
+        }
+        else
         {
             /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_049: [authentication_do_work() shall create a SAS token using IoTHubClient_Auth_Get_SasToken, unless it has failed previously] */
-            sas_token = IoTHubClient_Auth_Get_SasToken(instance->authorization_module, STRING_c_str(devices_path), instance->sas_token_lifetime_secs, NULL);
-            if (sas_token == NULL)
+            *sas_token = IoTHubClient_Auth_Get_SasToken(instance->authorization_module, NULL, 0, NULL);
+            if (*sas_token == NULL)
             {
-                LogError("failure getting sas token.");
+                LogError("failure getting sas Token.");
                 result = __FAILURE__;
             }
             else
@@ -261,50 +350,83 @@ static int create_and_put_SAS_token_to_cbs(AUTHENTICATION_INSTANCE* instance)
                 result = RESULT_OK;
             }
         }
-        else if (cred_type == IOTHUB_CREDENTIAL_TYPE_SAS_TOKEN)
+    }
+    else if (cred_type == IOTHUB_CREDENTIAL_TYPE_X509 || cred_type == IOTHUB_CREDENTIAL_TYPE_X509_ECC)
+    {
+        *sas_token = NULL;
+        result = RESULT_OK;
+    }
+    else
+    {
+        LogError("failure unknown credential type found.");
+        *sas_token = NULL;
+        result = __FAILURE__;
+    }
+
+    return result;
+}
+
+// @brief
+//     Creates the SAS token for the next refresh ahead of time, so the refresh itself only needs to put it to CBS.
+static int precompute_SAS_token(AUTHENTICATION_INSTANCE* instance, time_t current_time)
+{
+    int result;
+    STRING_HANDLE devices_path;
+
+    if ((devices_path = create_devices_path(instance->iothub_host_fqdn, instance->device_id)) == NULL)
+    {
+        result = __FAILURE__;
+        LogError("Failed precomputing a SAS token (create_devices_path() failed)");
+    }
+    else
+    {
+        if (create_SAS_token(instance, devices_path, &instance->precomputed_sas_token) != RESULT_OK)
         {
-            /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_07_002: [ If credential Type is SAS_TOKEN authentication_do_work() shall validate the sas_token, and fail if it's not valid. ] */
-            SAS_TOKEN_STATUS token_status = IoTHubClient_Auth_Is_SasToken_Valid(instance->authorization_module);
-            if (token_status == SAS_TOKEN_STATUS_INVALID)
-            {
-                LogError("sas token is invalid.");
-                sas_token = NULL;
-                result = __FAILURE__;
-            }
-            else if (token_status == SAS_TOKEN_STATUS_FAILED)
-            {
-                LogError("testing Sas Token failed.");
-                sas_token = NULL;
-                result = __FAILURE__;
-            }
-            else
-            {
-                /* Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_049: [authentication_do_work() shall create a SAS token using IoTHubClient_Auth_Get_SasToken, unless it has failed previously] */
-                sas_token = IoTHubClient_Auth_Get_SasToken(instance->authorization_module, NULL, 0, NULL);
-                if (sas_token == NULL)
-                {
-                    LogError("failure getting sas Token.");
-                    result = __FAILURE__;
-                }
-                else
-                {
-                    result = RESULT_OK;
-                }
-            }
+            result = __FAILURE__;
+            LogError("Failed precomputing a SAS token (create_SAS_token() failed)");
         }
-        else if (cred_type == IOTHUB_CREDENTIAL_TYPE_X509 || cred_type == IOTHUB_CREDENTIAL_TYPE_X509_ECC)
+        else
         {
-            sas_token = NULL;
+            instance->precomputed_sas_token_time = current_time;
+            result = RESULT_OK;
+        }
+
+        STRING_delete(devices_path);
+    }
+
+    return result;
+}
+
+static int create_and_put_SAS_token_to_cbs(AUTHENTICATION_INSTANCE* instance)
+{
+    int result;
+    char* sas_token;
+    STRING_HANDLE devices_path;
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_053: [A STRING_HANDLE, referred to as `devices_path`, shall be created from the following parts: iothub_host_fqdn + "/devices/" + device_id]
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_071: [A STRING_HANDLE, referred to as `devices_path`, shall be created from the following parts: iothub_host_fqdn + "/devices/" + device_id]
+    if ((devices_path = create_devices_path(instance->iothub_host_fqdn, instance->device_id)) == NULL)
+    {
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_054: [If `devices_path` failed to be created, authentication_do_work() shall fail and return]
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_072: [If `devices_path` failed to be created, authentication_do_work() shall fail and return]
+        result = __FAILURE__;
+        sas_token = NULL;
+        LogError("Failed creating a SAS token (create_devices_path() failed)");
+    }
+    else
+    {
+        if (instance->precomputed_sas_token != NULL)
+        {
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_004: [If a SAS token was precomputed, it shall be put to CBS instead of creating a new one]
+            sas_token = instance->precomputed_sas_token;
+            instance->precomputed_sas_token = NULL;
             result = RESULT_OK;
         }
         else
         {
-            LogError("failure unknown credential type found.");
-            sas_token = NULL;
-            result = __FAILURE__;
+            result = create_SAS_token(instance, devices_path, &sas_token);
         }
 
-
         if (sas_token != NULL)
         {
             if (put_SAS_token_to_cbs(instance, devices_path, sas_token) != RESULT_OK)
@@ -446,6 +568,10 @@ int authentication_stop(AUTHENTICATION_HANDLE authentication_handle)
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_033: [`instance->cbs_handle` shall be set to NULL]
             instance->cbs_handle = NULL;
 
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_005: [authentication_stop() shall give back the SAS token refresh taken from `instance->sas_token_refresh_limit`, if any, and destroy `instance->precomputed_sas_token`]
+            release_sas_token_refresh_slot(instance);
+            destroy_precomputed_sas_token(instance);
+
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_034: [`instance->state` shall be set to AUTHENTICATION_STATE_STOPPED and `instance->on_state_changed_callback` invoked]
             update_state(instance, AUTHENTICATION_STATE_STOPPED);
 
@@ -477,6 +603,8 @@ void authentication_destroy(AUTHENTICATION_HANDLE authentication_handle)
         if (instance->iothub_host_fqdn != NULL)
             STRING_delete(instance->iothub_host_fqdn);
 
+        destroy_precomputed_sas_token(instance);
+
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_108: [authentication_destroy() shall destroy all resouces used by this module]
         free(instance);
     }
@@ -559,6 +687,7 @@ AUTHENTICATION_HANDLE authentication_create(const AUTHENTICATION_CONFIG* config)
                 instance->sas_token_refresh_time_secs = DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS;
 
                 instance->authorization_module = config->authorization_module;
+                instance->sas_token_refresh_limit = config->sas_token_refresh_limit;
 
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_024: [If no failure occurs, authentication_create() shall return a reference to the AUTHENTICATION_INSTANCE handle]
                 result = (AUTHENTICATION_HANDLE)instance;
@@ -613,6 +742,7 @@ void authentication_do_work(AUTHENTICATION_HANDLE authentication_handle)
 
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_089: [`instance->is_sas_token_refresh_in_progress` shall be set to FALSE]
                 instance->is_sas_token_refresh_in_progress = false;
+                release_sas_token_refresh_slot(instance);
             }
         }
         else if (instance->state == AUTHENTICATION_STATE_STARTED)
@@ -623,30 +753,52 @@ void authentication_do_work(AUTHENTICATION_HANDLE authentication_handle)
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_039: [If `instance->state` is AUTHENTICATION_STATE_STARTED and device keys were used, authentication_do_work() shall only verify the SAS token refresh time]
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_065: [The SAS token shall be refreshed if the current time minus `instance->current_sas_token_put_time` equals or exceeds `instance->sas_token_refresh_time_secs`]
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_066: [If SAS token does not need to be refreshed, authentication_do_work() shall return]
+                time_t current_time;
                 bool is_timed_out;
-                if (verify_sas_token_refresh_timeout(instance, &is_timed_out) == RESULT_OK && is_timed_out)
+                bool is_close_to_timeout;
+
+                if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
                 {
-                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_119: [authentication_do_work() shall set `instance->is_sas_token_refresh_in_progress` to TRUE]
-                    instance->is_sas_token_refresh_in_progress = true;
+                    LogError("Failed verifying if SAS token refresh timed out (get_time failed)");
+                }
+                else if (verify_sas_token_refresh_timeout(instance, current_time, &is_timed_out, &is_close_to_timeout) == RESULT_OK)
+                {
+                    discard_stale_precomputed_sas_token(instance, current_time);
 
-                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_067: [authentication_do_work() shall create a SAS token using `instance->device_primary_key`, unless it has failed previously]
-                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_069: [If using `instance->device_primary_key` has failed previously, a SAS token shall be created using `instance->device_secondary_key`]
-                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_068: [If using `instance->device_primary_key` has failed previously and `instance->device_secondary_key` is not provided,  authentication_do_work() shall fail and return]
-                    if (create_and_put_SAS_token_to_cbs(instance) != RESULT_OK)
+                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_002: [If `instance->sas_token_refresh_limit` is set and has no refreshes left, the SAS token refresh shall be postponed to a later authentication_do_work() call]
+                    if (is_timed_out && acquire_sas_token_refresh_slot(instance))
                     {
-                        LogError("Failed refreshing SAS token '%'", instance->device_id);
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_119: [authentication_do_work() shall set `instance->is_sas_token_refresh_in_progress` to TRUE]
+                        instance->is_sas_token_refresh_in_progress = true;
+
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_067: [authentication_do_work() shall create a SAS token using `instance->device_primary_key`, unless it has failed previously]
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_069: [If using `instance->device_primary_key` has failed previously, a SAS token shall be created using `instance->device_secondary_key`]
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_068: [If using `instance->device_primary_key` has failed previously and `instance->device_secondary_key` is not provided,  authentication_do_work() shall fail and return]
+                        if (create_and_put_SAS_token_to_cbs(instance) != RESULT_OK)
+                        {
+                            LogError("Failed refreshing SAS token '%'", instance->device_id);
+                        }
+
+                        if (!instance->is_cbs_put_token_in_progress)
+                        {
+                            // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_120: [If cbs_put_token() fails, `instance->is_sas_token_refresh_in_progress` shall be set to FALSE]
+                            instance->is_sas_token_refresh_in_progress = false;
+                            release_sas_token_refresh_slot(instance);
+
+                            // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_079: [If cbs_put_token() fails, `instance->state` shall be updated to AUTHENTICATION_STATE_ERROR and `instance->on_state_changed_callback` invoked]
+                            update_state(instance, AUTHENTICATION_STATE_ERROR);
+
+                            // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_080: [If cbs_put_token() fails, `instance->on_error_callback` shall be invoked with AUTHENTICATION_ERROR_SAS_REFRESH_FAILED]
+                            notify_error(instance, AUTHENTICATION_ERROR_SAS_REFRESH_FAILED);
+                        }
                     }
-
-                    if (!instance->is_cbs_put_token_in_progress)
+                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_003: [If the SAS token refresh is postponed or due in less than the precompute lead time, the next SAS token shall be created and saved in `instance->precomputed_sas_token`]
+                    else if (is_close_to_timeout && instance->precomputed_sas_token == NULL)
                     {
-                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_120: [If cbs_put_token() fails, `instance->is_sas_token_refresh_in_progress` shall be set to FALSE]
-                        instance->is_sas_token_refresh_in_progress = false;
-
-                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_079: [If cbs_put_token() fails, `instance->state` shall be updated to AUTHENTICATION_STATE_ERROR and `instance->on_state_changed_callback` invoked]
-                        update_state(instance, AUTHENTICATION_STATE_ERROR);
-
-                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_080: [If cbs_put_token() fails, `instance->on_error_callback` shall be invoked with AUTHENTICATION_ERROR_SAS_REFRESH_FAILED]
-                        notify_error(instance, AUTHENTICATION_ERROR_SAS_REFRESH_FAILED);
+                        if (precompute_SAS_token(instance, current_time) != RESULT_OK)
+                        {
+                            LogError("Failed precomputing the SAS token of device '%s'; it will be created when refreshed", instance->device_id);
+                        }
                     }
                 }
             }
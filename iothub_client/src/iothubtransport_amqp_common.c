@@ -30,11 +30,14 @@
 #include "iothub_client_core_ll.h"
 #include "iothub_client_options.h"
 #include "internal/iothub_client_private.h"
+#include "internal/iothub_client_object_pool.h"
 #include "internal/iothubtransportamqp_methods.h"
 #include "internal/iothub_client_retry_control.h"
 #include "internal/iothubtransport_amqp_common.h"
 #include "internal/iothubtransport_amqp_connection.h"
+#include "internal/iothubtransport_amqp_cbs_auth.h"
 #include "internal/iothubtransport_amqp_device.h"
+#include "internal/iothubtransport_amqp_telemetry_messenger.h"
 #include "internal/iothubtransport.h"
 #include "iothub_client_version.h"
 
@@ -43,8 +46,10 @@
 #define DEFAULT_CBS_REQUEST_TIMEOUT_SECS          30
 #define DEFAULT_DEVICE_STATE_CHANGE_TIMEOUT_SECS  60
 #define DEFAULT_EVENT_SEND_TIMEOUT_SECS           300
+#define DEFAULT_EVENT_SENDER_LINK_COUNT           1
 #define DEFAULT_SAS_TOKEN_LIFETIME_SECS           3600
 #define DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS       1800
+#define MAX_SAS_TOKEN_REFRESHES_IN_PROGRESS       10
 #define MAX_NUMBER_OF_DEVICE_FAILURES             5
 #define DEFAULT_SERVICE_KEEP_ALIVE_FREQ_SECS      240
 #define DEFAULT_REMOTE_IDLE_PING_RATIO            0.50
@@ -52,6 +57,11 @@
 // DEFAULT_MAX_RETRY_TIME_IN_SECS = 0 means infinite retry.
 #define DEFAULT_MAX_RETRY_TIME_IN_SECS            0
 #define MAX_SERVICE_KEEP_ALIVE_RATIO              0.9
+#define DEVICE_INDEX_INITIAL_SIZE                 16
+// Devices without pending work still get a DoWork this often, for their token refresh and timeouts (tracked in seconds).
+#define DEVICE_IDLE_WORK_INTERVAL_SECS            1
+// How long a device stays on the ready list after its last activity; 2 since time_t may only have 1 second resolution.
+#define DEVICE_ACTIVITY_GRACE_PERIOD_SECS         2
 
 // ---------- Data Definitions ---------- //
 
@@ -104,6 +114,13 @@ typedef struct AMQP_TRANSPORT_INSTANCE_TAG
     AMQP_CONNECTION_STATE amqp_connection_state;                        // Current state of the amqp_connection.
     AMQP_TRANSPORT_AUTHENTICATION_MODE preferred_authentication_mode;   // Used to avoid registered devices using different authentication modes.
     SINGLYLINKEDLIST_HANDLE registered_devices;                         // List of devices currently registered in this transport.
+    struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG** devices_by_id;          // Hash index of `registered_devices` by device id.
+    struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG** devices_by_client;      // Hash index of `registered_devices` by IoTHub client handle (same allocation as `devices_by_id`).
+    size_t device_index_size;                                           // Number of buckets in each index (power of 2).
+    size_t number_of_registered_devices;                                // Number of devices in `registered_devices`.
+    DLIST_ENTRY ready_devices;                                          // Registered devices with pending work; these get a DoWork on every call.
+    DLIST_ENTRY idle_devices;                                           // Registered devices with nothing to do, oldest activity first.
+    AUTHENTICATION_REFRESH_LIMIT sas_token_refresh_limit;               // Shared by the registered devices, so they do not all refresh their SAS tokens at once.
     bool is_trace_on;                                                   // Turns logging on and off.
     OPTIONHANDLER_HANDLE saved_tls_options;                             // Here are the options from the xio layer if any is saved.
     AMQP_TRANSPORT_STATE state;                                         // Current state of the transport.
@@ -120,6 +137,10 @@ typedef struct AMQP_TRANSPORT_INSTANCE_TAG
     size_t option_sas_token_refresh_time_secs;                          // Device-specific option.
     size_t option_cbs_request_timeout_secs;                             // Device-specific option.
     size_t option_send_event_timeout_secs;                              // Device-specific option.
+    size_t option_event_sender_link_count;                              // Device-specific option.
+    bool option_event_send_in_order;                                    // Device-specific option.
+    size_t option_c2d_prefetch_count;                                   // Device-specific option.
+    bool option_c2d_adaptive_prefetch;                                  // Device-specific option.
 
                                                                         // Auth module used to generating handle authorization
     IOTHUB_AUTHORIZATION_HANDLE authorization_module;                   // with either SAS Token, x509 Certs, and Device SAS Token
@@ -143,6 +164,16 @@ typedef struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG
     bool subscribe_methods_needed;                                       // Indicates if should subscribe for device methods.
     // is the transport subscribed for methods?
     bool subscribed_for_methods;                                         // Indicates if device is subscribed for device methods.
+    // the scheduling portion
+    LIST_ITEM_HANDLE list_item;                                         // Item of this device in `transport_instance->registered_devices`.
+    size_t device_id_hash;                                              // Hash of `device_id`, computed once on registration.
+    struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG* next_by_device_id;       // Next device in the same `devices_by_id` bucket.
+    struct AMQP_TRANSPORT_DEVICE_INSTANCE_TAG* next_by_client_handle;   // Next device in the same `devices_by_client` bucket.
+    DLIST_ENTRY work_list_entry;                                        // Entry in either `ready_devices` or `idle_devices` of the transport.
+    bool is_ready;                                                      // Indicates if `work_list_entry` is in `ready_devices`.
+    bool has_new_activity;                                              // Set when something happened to the device since its last DoWork.
+    time_t time_of_last_activity;                                       // Time the device last had pending work.
+    time_t time_of_last_idle_work;                                      // Time the device last got a DoWork while idle; orders `idle_devices`.
 } AMQP_TRANSPORT_DEVICE_INSTANCE;
 
 typedef struct MESSAGE_DISPOSITION_CONTEXT_TAG
@@ -212,6 +243,299 @@ static void reset_retry_control(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_devic
 }
 
 
+// ---------- Device Index Helpers ---------- //
+
+static size_t get_device_id_hash(const char* device_id)
+{
+    size_t hash = 5381;
+
+    while (*device_id != '\0')
+    {
+        hash = ((hash << 5) + hash) ^ (unsigned char)*device_id;
+        device_id++;
+    }
+
+    return hash;
+}
+
+static size_t get_client_handle_bucket(size_t index_size, IOTHUB_CLIENT_CORE_LL_HANDLE client_handle)
+{
+    uintptr_t key = (uintptr_t)client_handle;
+
+    // Client handles are heap pointers, so the lowest bits carry no information.
+    key = (key >> 4) ^ (key >> 12);
+
+    return (size_t)key & (index_size - 1);
+}
+
+static void index_device(AMQP_TRANSPORT_DEVICE_INSTANCE** devices_by_id, AMQP_TRANSPORT_DEVICE_INSTANCE** devices_by_client, size_t index_size, AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device)
+{
+    size_t id_bucket = registered_device->device_id_hash & (index_size - 1);
+    size_t client_bucket = get_client_handle_bucket(index_size, registered_device->iothub_client_handle);
+
+    registered_device->next_by_device_id = devices_by_id[id_bucket];
+    devices_by_id[id_bucket] = registered_device;
+
+    registered_device->next_by_client_handle = devices_by_client[client_bucket];
+    devices_by_client[client_bucket] = registered_device;
+}
+
+static void grow_device_index(AMQP_TRANSPORT_INSTANCE* transport_instance)
+{
+    size_t new_size = transport_instance->device_index_size * 2;
+    AMQP_TRANSPORT_DEVICE_INSTANCE** new_index;
+
+    if ((new_index = (AMQP_TRANSPORT_DEVICE_INSTANCE**)malloc(sizeof(AMQP_TRANSPORT_DEVICE_INSTANCE*) * new_size * 2)) == NULL)
+    {
+        // Not fatal; the buckets just get longer.
+        LogError("Failed growing the registered devices index (malloc failed)");
+    }
+    else
+    {
+        size_t i;
+
+        memset(new_index, 0, sizeof(AMQP_TRANSPORT_DEVICE_INSTANCE*) * new_size * 2);
+
+        // Each device is in exactly one `devices_by_id` bucket, so walking those rebuilds both indexes.
+        for (i = 0; i < transport_instance->device_index_size; i++)
+        {
+            AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = transport_instance->devices_by_id[i];
+
+            while (registered_device != NULL)
+            {
+                AMQP_TRANSPORT_DEVICE_INSTANCE* next_device = registered_device->next_by_device_id;
+                index_device(new_index, new_index + new_size, new_size, registered_device);
+                registered_device = next_device;
+            }
+        }
+
+        free(transport_instance->devices_by_id);
+        transport_instance->devices_by_id = new_index;
+        transport_instance->devices_by_client = new_index + new_size;
+        transport_instance->device_index_size = new_size;
+    }
+}
+
+static void add_to_device_index(AMQP_TRANSPORT_INSTANCE* transport_instance, AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device)
+{
+    index_device(transport_instance->devices_by_id, transport_instance->devices_by_client, transport_instance->device_index_size, registered_device);
+    transport_instance->number_of_registered_devices++;
+
+    if (transport_instance->number_of_registered_devices > transport_instance->device_index_size)
+    {
+        grow_device_index(transport_instance);
+    }
+}
+
+static void remove_from_device_index(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device)
+{
+    AMQP_TRANSPORT_INSTANCE* transport_instance = registered_device->transport_instance;
+    AMQP_TRANSPORT_DEVICE_INSTANCE** slot = &transport_instance->devices_by_id[registered_device->device_id_hash & (transport_instance->device_index_size - 1)];
+
+    while (*slot != NULL && *slot != registered_device)
+    {
+        slot = &(*slot)->next_by_device_id;
+    }
+
+    if (*slot != NULL)
+    {
+        *slot = registered_device->next_by_device_id;
+    }
+
+    slot = &transport_instance->devices_by_client[get_client_handle_bucket(transport_instance->device_index_size, registered_device->iothub_client_handle)];
+
+    while (*slot != NULL && *slot != registered_device)
+    {
+        slot = &(*slot)->next_by_client_handle;
+    }
+
+    if (*slot != NULL)
+    {
+        *slot = registered_device->next_by_client_handle;
+    }
+
+    registered_device->next_by_device_id = NULL;
+    registered_device->next_by_client_handle = NULL;
+    transport_instance->number_of_registered_devices--;
+}
+
+// @brief       Looks up the device registered in the transport with the given id.
+// @returns     The registered device, or NULL if no device with that id is registered.
+static AMQP_TRANSPORT_DEVICE_INSTANCE* find_registered_device(AMQP_TRANSPORT_INSTANCE* transport_instance, const char* device_id)
+{
+    size_t hash = get_device_id_hash(device_id);
+    AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = transport_instance->devices_by_id[hash & (transport_instance->device_index_size - 1)];
+
+    while (registered_device != NULL)
+    {
+        if (registered_device->device_id_hash == hash)
+        {
+            const char* registered_device_id = STRING_c_str(registered_device->device_id);
+
+            if (registered_device_id != NULL && strcmp(registered_device_id, device_id) == 0)
+            {
+                break;
+            }
+        }
+
+        registered_device = registered_device->next_by_device_id;
+    }
+
+    return registered_device;
+}
+
+static AMQP_TRANSPORT_DEVICE_INSTANCE* find_device_by_client_handle(AMQP_TRANSPORT_INSTANCE* transport_instance, IOTHUB_CLIENT_CORE_LL_HANDLE client_handle)
+{
+    AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = transport_instance->devices_by_client[get_client_handle_bucket(transport_instance->device_index_size, client_handle)];
+
+    while (registered_device != NULL && registered_device->iothub_client_handle != client_handle)
+    {
+        registered_device = registered_device->next_by_client_handle;
+    }
+
+    return registered_device;
+}
+
+// @brief       Verifies if a device is registered under `device_id` within the transport it points to.
+// @returns     true if the device is in the transport index, false otherwise.
+static bool is_device_registered_ex(AMQP_TRANSPORT_DEVICE_INSTANCE* amqp_device_instance, const char* device_id)
+{
+    AMQP_TRANSPORT_INSTANCE* transport_instance = amqp_device_instance->transport_instance;
+    size_t hash = get_device_id_hash(device_id);
+    AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = transport_instance->devices_by_id[hash & (transport_instance->device_index_size - 1)];
+
+    while (registered_device != NULL && registered_device != amqp_device_instance)
+    {
+        registered_device = registered_device->next_by_device_id;
+    }
+
+    return (registered_device != NULL && registered_device->device_id_hash == hash);
+}
+
+// @brief       Verifies if a device is registered within the transport it points to.
+// @returns     true if the device is in the transport index, false otherwise.
+static bool is_device_registered(AMQP_TRANSPORT_DEVICE_INSTANCE* amqp_device_instance)
+{
+    const char* device_id = STRING_c_str(amqp_device_instance->device_id);
+    return (device_id != NULL && is_device_registered_ex(amqp_device_instance, device_id));
+}
+
+static size_t get_number_of_registered_devices(AMQP_TRANSPORT_INSTANCE* transport)
+{
+    return transport->number_of_registered_devices;
+}
+
+
+// ---------- Scheduling Helpers ---------- //
+
+// @brief
+//     Moves the device to `ready_devices`, so it gets a DoWork on every call until it runs out of work.
+static void mark_device_ready(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device)
+{
+    if (!registered_device->is_ready)
+    {
+        (void)DList_RemoveEntryList(&registered_device->work_list_entry);
+        DList_InsertTailList(&registered_device->transport_instance->ready_devices, &registered_device->work_list_entry);
+        registered_device->is_ready = true;
+    }
+
+    registered_device->has_new_activity = true;
+}
+
+static void mark_device_idle(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device, time_t current_time)
+{
+    (void)DList_RemoveEntryList(&registered_device->work_list_entry);
+    DList_InsertTailList(&registered_device->transport_instance->idle_devices, &registered_device->work_list_entry);
+    registered_device->is_ready = false;
+    registered_device->time_of_last_idle_work = current_time;
+}
+
+// @brief
+//     Tells if the device has work that cannot wait for DEVICE_IDLE_WORK_INTERVAL_SECS: a state change still going on, 
+//     a subscription to make or events queued or in flight.
+static bool has_pending_work(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device)
+{
+    bool result;
+    DEVICE_SEND_STATUS send_status;
+
+    if (registered_device->device_state != DEVICE_STATE_STARTED ||
+        (registered_device->subscribe_methods_needed && !registered_device->subscribed_for_methods) ||
+        !DList_IsListEmpty(registered_device->waiting_to_send))
+    {
+        result = true;
+    }
+    else if (device_get_send_status(registered_device->device_handle, &send_status) != RESULT_OK)
+    {
+        result = true;
+    }
+    else
+    {
+        result = (send_status == DEVICE_SEND_STATUS_BUSY);
+    }
+
+    return result;
+}
+
+// @brief
+//     Called after the device DoWork; moves it to `idle_devices` once it has had no pending work for DEVICE_ACTIVITY_GRACE_PERIOD_SECS.
+static void update_device_schedule(AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device, time_t current_time)
+{
+    if (current_time == INDEFINITE_TIME)
+    {
+        // Without the time the device cannot be tracked, so it is kept ready.
+    }
+    else if (has_pending_work(registered_device) || registered_device->has_new_activity)
+    {
+        registered_device->time_of_last_activity = current_time;
+        registered_device->has_new_activity = false;
+    }
+    else if (get_difftime(current_time, registered_device->time_of_last_activity) >= DEVICE_ACTIVITY_GRACE_PERIOD_SECS)
+    {
+        mark_device_idle(registered_device, current_time);
+    }
+}
+
+// @brief
+//     Moves to `ready_devices` the idle devices that have not had a DoWork for DEVICE_IDLE_WORK_INTERVAL_SECS.
+//     `idle_devices` is ordered by time, so only its head needs to be checked.
+static void wake_up_idle_devices(AMQP_TRANSPORT_INSTANCE* transport_instance, time_t current_time)
+{
+    while (!DList_IsListEmpty(&transport_instance->idle_devices))
+    {
+        AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = containingRecord(transport_instance->idle_devices.Flink, AMQP_TRANSPORT_DEVICE_INSTANCE, work_list_entry);
+
+        // If time cannot be obtained, it is safer to work on all of them.
+        if (current_time != INDEFINITE_TIME &&
+            get_difftime(current_time, registered_device->time_of_last_idle_work) < DEVICE_IDLE_WORK_INTERVAL_SECS)
+        {
+            break;
+        }
+
+        mark_device_ready(registered_device);
+        registered_device->has_new_activity = false;
+    }
+}
+
+// @brief
+//     Moves to `ready_devices` the idle devices with events queued by their clients, which is otherwise only
+//     noticed through the client handle passed to DoWork.
+static void wake_up_idle_devices_with_events(AMQP_TRANSPORT_INSTANCE* transport_instance)
+{
+    PDLIST_ENTRY entry = transport_instance->idle_devices.Flink;
+
+    while (entry != &transport_instance->idle_devices)
+    {
+        AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = containingRecord(entry, AMQP_TRANSPORT_DEVICE_INSTANCE, work_list_entry);
+        entry = entry->Flink;
+
+        if (!DList_IsListEmpty(registered_device->waiting_to_send))
+        {
+            mark_device_ready(registered_device);
+        }
+    }
+}
+
+
 // ---------- Register/Unregister Helpers ---------- //
 
 static void internal_destroy_amqp_device_instance(AMQP_TRANSPORT_DEVICE_INSTANCE *trdev_inst)
@@ -277,6 +601,9 @@ static void on_device_state_changed_callback(void* context, DEVICE_STATE previou
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_063: [If `registered_device->time_of_last_state_change` shall be set using get_time()]
         registered_device->time_of_last_state_change = get_time(NULL);
 
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_013: [The device shall be moved to `instance->ready_devices` when its state changes, it receives a C2D message, it is subscribed or unsubscribed, it reports twin properties or settles a C2D message]
+        mark_device_ready(registered_device);
+
         if (new_state == DEVICE_STATE_STARTED)
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_127: [If `new_state` is DEVICE_STATE_STARTED, retry_control_reset() shall be invoked passing `instance->connection_retry_control`]
@@ -313,68 +640,6 @@ static void on_device_state_changed_callback(void* context, DEVICE_STATE previou
     }
 }
 
-// @brief    Auxiliary function to be used to find a device in the registered_devices list.
-// @returns  true if the device ids match, false otherwise.
-static bool find_device_by_id_callback(LIST_ITEM_HANDLE list_item, const void* match_context)
-{
-    bool result;
-
-    if (match_context == NULL)
-    {
-        result = false;
-    }
-    else
-    {
-        AMQP_TRANSPORT_DEVICE_INSTANCE* device_instance = (AMQP_TRANSPORT_DEVICE_INSTANCE*)singlylinkedlist_item_get_value(list_item);
-
-        if (device_instance == NULL || 
-            device_instance->device_id == NULL || 
-            STRING_c_str(device_instance->device_id) != match_context)
-        {
-            result = false;
-        }
-        else
-        {
-            result = true;
-        }
-    }
-
-    return result;
-}
-
-// @brief       Verifies if a device is already registered within the transport that owns the list of registered devices.
-// @remarks     Returns the correspoding LIST_ITEM_HANDLE in registered_devices, if found.
-// @returns     true if the device is already in the list, false otherwise.
-static bool is_device_registered_ex(SINGLYLINKEDLIST_HANDLE registered_devices, const char* device_id, LIST_ITEM_HANDLE *list_item)
-{
-    return ((*list_item = singlylinkedlist_find(registered_devices, find_device_by_id_callback, device_id)) != NULL ? 1 : 0);
-}
-
-// @brief       Verifies if a device is already registered within the transport that owns the list of registered devices.
-// @returns     true if the device is already in the list, false otherwise.
-static bool is_device_registered(AMQP_TRANSPORT_DEVICE_INSTANCE* amqp_device_instance)
-{
-    LIST_ITEM_HANDLE list_item;
-    const char* device_id = STRING_c_str(amqp_device_instance->device_id);
-    return is_device_registered_ex(amqp_device_instance->transport_instance->registered_devices, device_id, &list_item);
-}
-
-static size_t get_number_of_registered_devices(AMQP_TRANSPORT_INSTANCE* transport)
-{
-    size_t result = 0;
-
-    LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(transport->registered_devices);
-
-    while (list_item != NULL)
-    {
-        result++;
-        list_item = singlylinkedlist_get_next_item(list_item);
-    }
-
-    return result;
-}
-
-
 // ---------- Callbacks ---------- //
 
 static MESSAGE_CALLBACK_INFO* MESSAGE_CALLBACK_INFO_Create(IOTHUB_MESSAGE_HANDLE message, DEVICE_MESSAGE_DISPOSITION_INFO* disposition_info, AMQP_TRANSPORT_DEVICE_INSTANCE* device_state)
@@ -461,6 +726,8 @@ static DEVICE_MESSAGE_DISPOSITION_RESULT on_message_received(IOTHUB_MESSAGE_HAND
     DEVICE_MESSAGE_DISPOSITION_RESULT device_disposition_result;
     MESSAGE_CALLBACK_INFO* message_data;
 
+    mark_device_ready(amqp_device_instance);
+
     if ((message_data = MESSAGE_CALLBACK_INFO_Create(message, disposition_info, amqp_device_instance)) == NULL)
     {
         LogError("Failed processing message received (failed to assemble callback info)");
@@ -500,6 +767,7 @@ static void on_methods_unsubscribed(void* context)
 
     iothubtransportamqp_methods_unsubscribe(device_state->methods_handle);
     device_state->subscribed_for_methods = false;
+    mark_device_ready(device_state);
 }
 
 static int on_method_request_received(void* context, const char* method_name, const unsigned char* request, size_t request_size, IOTHUBTRANSPORT_AMQP_METHOD_HANDLE method_handle)
@@ -868,6 +1136,9 @@ static void prepare_device_for_connection_retry(AMQP_TRANSPORT_DEVICE_INSTANCE*
 
     registered_device->number_of_previous_failures = 0;
     registered_device->number_of_send_event_complete_failures = 0;
+
+    // Needs to be started again once the connection is back.
+    mark_device_ready(registered_device);
 }
 
 static void prepare_for_connection_retry(AMQP_TRANSPORT_INSTANCE* transport_instance)
@@ -1027,7 +1298,15 @@ static void on_event_send_complete(IOTHUB_MESSAGE_LIST* message, D2C_EVENT_SEND_
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_057: [`message->messageHandle` shall be destroyed using IoTHubMessage_Destroy]
     IoTHubMessage_Destroy(message->messageHandle);
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_058: [`message` shall be destroyed using free]
-    free(message);
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_001: [If `message` was taken from a message pool, it shall be given back to that pool using object_pool_release instead]
+    if (message->pool != NULL)
+    {
+        object_pool_release(message->pool, message);
+    }
+    else
+    {
+        free(message);
+    }
 }
 
 // @brief
@@ -1200,6 +1479,38 @@ static int replicate_device_options_to(AMQP_TRANSPORT_DEVICE_INSTANCE* dev_insta
         LogError("Failed to apply option DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS to device '%s' (device_set_option failed)", STRING_c_str(dev_instance->device_id));
         result = __FAILURE__;
     }
+    else if (device_set_option(
+        dev_instance->device_handle,
+        DEVICE_OPTION_EVENT_SENDER_LINK_COUNT,
+        &dev_instance->transport_instance->option_event_sender_link_count) != RESULT_OK)
+    {
+        LogError("Failed to apply option DEVICE_OPTION_EVENT_SENDER_LINK_COUNT to device '%s' (device_set_option failed)", STRING_c_str(dev_instance->device_id));
+        result = __FAILURE__;
+    }
+    else if (device_set_option(
+        dev_instance->device_handle,
+        DEVICE_OPTION_EVENT_SEND_IN_ORDER,
+        &dev_instance->transport_instance->option_event_send_in_order) != RESULT_OK)
+    {
+        LogError("Failed to apply option DEVICE_OPTION_EVENT_SEND_IN_ORDER to device '%s' (device_set_option failed)", STRING_c_str(dev_instance->device_id));
+        result = __FAILURE__;
+    }
+    else if (device_set_option(
+        dev_instance->device_handle,
+        DEVICE_OPTION_C2D_PREFETCH_COUNT,
+        &dev_instance->transport_instance->option_c2d_prefetch_count) != RESULT_OK)
+    {
+        LogError("Failed to apply option DEVICE_OPTION_C2D_PREFETCH_COUNT to device '%s' (device_set_option failed)", STRING_c_str(dev_instance->device_id));
+        result = __FAILURE__;
+    }
+    else if (device_set_option(
+        dev_instance->device_handle,
+        DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH,
+        &dev_instance->transport_instance->option_c2d_adaptive_prefetch) != RESULT_OK)
+    {
+        LogError("Failed to apply option DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH to device '%s' (device_set_option failed)", STRING_c_str(dev_instance->device_id));
+        result = __FAILURE__;
+    }
     else if (auth_mode == DEVICE_AUTH_MODE_CBS)
     {
         if (device_set_option(
@@ -1261,6 +1572,22 @@ static const char* get_device_option_name_from(const char* iothubclient_option_n
     {
         device_option_name = DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS;
     }
+    else if (strcmp(OPTION_EVENT_SENDER_LINK_COUNT, iothubclient_option_name) == 0)
+    {
+        device_option_name = DEVICE_OPTION_EVENT_SENDER_LINK_COUNT;
+    }
+    else if (strcmp(OPTION_EVENT_SEND_IN_ORDER, iothubclient_option_name) == 0)
+    {
+        device_option_name = DEVICE_OPTION_EVENT_SEND_IN_ORDER;
+    }
+    else if (strcmp(OPTION_C2D_PREFETCH_COUNT, iothubclient_option_name) == 0)
+    {
+        device_option_name = DEVICE_OPTION_C2D_PREFETCH_COUNT;
+    }
+    else if (strcmp(OPTION_C2D_ADAPTIVE_PREFETCH, iothubclient_option_name) == 0)
+    {
+        device_option_name = DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH;
+    }
     else
     {
         device_option_name = NULL;
@@ -1335,6 +1662,11 @@ static void internal_destroy_instance(AMQP_TRANSPORT_INSTANCE* instance)
             singlylinkedlist_destroy(instance->registered_devices);
         }
 
+        if (instance->devices_by_id != NULL)
+        {
+            free(instance->devices_by_id);
+        }
+
         if (instance->amqp_connection != NULL)
         {
             amqp_connection_destroy(instance->amqp_connection);
@@ -1444,8 +1776,24 @@ TRANSPORT_LL_HANDLE IoTHubTransport_AMQP_Common_Create(const IOTHUBTRANSPORT_CON
                 LogError("Failed to initialize the internal list of registered devices (singlylinkedlist_create failed)");
                 result = NULL;
             }
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_004: [`instance->devices_by_id` and `instance->devices_by_client` shall be allocated with DEVICE_INDEX_INITIAL_SIZE buckets each]
+            else if ((instance->devices_by_id = (AMQP_TRANSPORT_DEVICE_INSTANCE**)malloc(sizeof(AMQP_TRANSPORT_DEVICE_INSTANCE*) * DEVICE_INDEX_INITIAL_SIZE * 2)) == NULL)
+            {
+                // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_005: [If the device indexes fail to be allocated, IoTHubTransport_AMQP_Common_Create shall fail and return NULL]
+                LogError("Failed to initialize the index of registered devices (malloc failed)");
+                result = NULL;
+            }
             else
             {
+                memset(instance->devices_by_id, 0, sizeof(AMQP_TRANSPORT_DEVICE_INSTANCE*) * DEVICE_INDEX_INITIAL_SIZE * 2);
+                instance->devices_by_client = instance->devices_by_id + DEVICE_INDEX_INITIAL_SIZE;
+                instance->device_index_size = DEVICE_INDEX_INITIAL_SIZE;
+                instance->number_of_registered_devices = 0;
+                DList_InitializeListHead(&instance->ready_devices);
+                DList_InitializeListHead(&instance->idle_devices);
+                instance->sas_token_refresh_limit.max_refreshes_in_progress = MAX_SAS_TOKEN_REFRESHES_IN_PROGRESS;
+                instance->sas_token_refresh_limit.refreshes_in_progress = 0;
+
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_010: [`get_io_transport` shall be saved on `instance->underlying_io_transport_provider`]
                 instance->underlying_io_transport_provider = get_io_transport;
                 instance->is_trace_on = false;
@@ -1453,6 +1801,10 @@ TRANSPORT_LL_HANDLE IoTHubTransport_AMQP_Common_Create(const IOTHUBTRANSPORT_CON
                 instance->option_sas_token_refresh_time_secs = DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS;
                 instance->option_cbs_request_timeout_secs = DEFAULT_CBS_REQUEST_TIMEOUT_SECS;
                 instance->option_send_event_timeout_secs = DEFAULT_EVENT_SEND_TIMEOUT_SECS;
+                instance->option_event_sender_link_count = DEFAULT_EVENT_SENDER_LINK_COUNT;
+                instance->option_event_send_in_order = false;
+                instance->option_c2d_prefetch_count = 0;
+                instance->option_c2d_adaptive_prefetch = false;
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_12_002: [The connection idle timeout parameter default value shall be set to 240000 milliseconds using connection_set_idle_timeout()]
                 instance->svc2cl_keep_alive_timeout_secs = DEFAULT_SERVICE_KEEP_ALIVE_FREQ_SECS;
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_99_001: [The remote idle timeout ratio shall be set to 0.5 using connection_set_remote_idle_timeout_empty_frame_send_ratio()]
@@ -1514,6 +1866,8 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_AMQP_Common_ProcessItem(TRANSPORT_LL_
                 }
                 else
                 {
+                    mark_device_ready(registered_device);
+
                     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_150: [If no errors occur, `IoTHubTransport_AMQP_Common_ProcessItem` shall return IOTHUB_PROCESS_OK.]
                     result = IOTHUB_PROCESS_OK;
                 }
@@ -1532,8 +1886,6 @@ IOTHUB_PROCESS_ITEM_RESULT IoTHubTransport_AMQP_Common_ProcessItem(TRANSPORT_LL_
 
 void IoTHubTransport_AMQP_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
-    (void)iotHubClientHandle; // unused as of now.
-
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_016: [If `handle` is NULL, IoTHubTransport_AMQP_Common_DoWork shall return without doing any work]
     if (handle == NULL)
     {
@@ -1542,7 +1894,6 @@ void IoTHubTransport_AMQP_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
     else
     {
         AMQP_TRANSPORT_INSTANCE* transport_instance = (AMQP_TRANSPORT_INSTANCE*)handle;
-        LIST_ITEM_HANDLE list_item;
 
         if (transport_instance->state == AMQP_TRANSPORT_STATE_NOT_CONNECTED_NO_MORE_RETRIES)
         {
@@ -1574,7 +1925,7 @@ void IoTHubTransport_AMQP_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
         else
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_018: [If there are no devices registered on the transport, IoTHubTransport_AMQP_Common_DoWork shall skip do_work for devices]
-            if ((list_item = singlylinkedlist_get_head_item(transport_instance->registered_devices)) != NULL)
+            if (get_number_of_registered_devices(transport_instance) > 0)
             {
                 // We need to check if there are devices, otherwise the amqp_connection won't be able to be created since
                 // there is not a preferred authentication mode set yet on the transport.
@@ -1590,15 +1941,39 @@ void IoTHubTransport_AMQP_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_020: [If the amqp_connection is OPENED, the transport shall iterate through each registered device and perform a device-specific do_work on each]
                 else if (transport_instance->amqp_connection_state == AMQP_CONNECTION_STATE_OPENED)
                 {
-                    while (list_item != NULL)
+                    time_t current_time = get_time(NULL);
+                    PDLIST_ENTRY entry;
+
+                    if (iotHubClientHandle != NULL)
                     {
-                        AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device;
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_009: [If `iotHubClientHandle` is not NULL and its device is in `instance->idle_devices` with events in `waiting_to_send`, the device shall be moved to `instance->ready_devices`]
+                        AMQP_TRANSPORT_DEVICE_INSTANCE* client_device = find_device_by_client_handle(transport_instance, iotHubClientHandle);
 
-                        if ((registered_device = (AMQP_TRANSPORT_DEVICE_INSTANCE*)singlylinkedlist_item_get_value(list_item)) == NULL)
+                        if (client_device != NULL && !client_device->is_ready && !DList_IsListEmpty(client_device->waiting_to_send))
                         {
-                            LogError("Transport had an unexpected failure during DoWork (failed to fetch a registered_devices list item value)");
+                            mark_device_ready(client_device);
                         }
-                        else if (registered_device->number_of_send_event_complete_failures >= MAX_NUMBER_OF_DEVICE_FAILURES)
+                    }
+                    else
+                    {
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_010: [If `iotHubClientHandle` is NULL, all devices in `instance->idle_devices` with events in `waiting_to_send` shall be moved to `instance->ready_devices`]
+                        wake_up_idle_devices_with_events(transport_instance);
+                    }
+
+                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_011: [Devices in `instance->idle_devices` that have not had a device-specific do_work for DEVICE_IDLE_WORK_INTERVAL_SECS shall be moved to `instance->ready_devices`]
+                    wake_up_idle_devices(transport_instance, current_time);
+
+                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_012: [The device-specific do_work shall only be performed on the devices in `instance->ready_devices`]
+                    entry = transport_instance->ready_devices.Flink;
+
+                    while (entry != &transport_instance->ready_devices)
+                    {
+                        AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = containingRecord(entry, AMQP_TRANSPORT_DEVICE_INSTANCE, work_list_entry);
+
+                        // Saved first, as the device may be moved to `idle_devices` below.
+                        entry = entry->Flink;
+
+                        if (registered_device->number_of_send_event_complete_failures >= MAX_NUMBER_OF_DEVICE_FAILURES)
                         {
                             LogError("Device '%s' reported a critical failure (events completed sending with failures); connection retry will be triggered.", STRING_c_str(registered_device->device_id));
 
@@ -1615,7 +1990,8 @@ void IoTHubTransport_AMQP_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                             }
                         }
 
-                        list_item = singlylinkedlist_get_next_item(list_item);
+                        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_014: [A device without pending work and without any activity for DEVICE_ACTIVITY_GRACE_PERIOD_SECS shall be moved to `instance->idle_devices`]
+                        update_device_schedule(registered_device, current_time);
                     }
                 }
             }
@@ -1658,6 +2034,8 @@ int IoTHubTransport_AMQP_Common_Subscribe(IOTHUB_DEVICE_HANDLE handle)
         }
         else
         {
+            mark_device_ready(amqp_device_instance);
+
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_088: [If no failures occur, IoTHubTransport_AMQP_Common_Subscribe shall return 0]
             result = RESULT_OK;
         }
@@ -1687,6 +2065,10 @@ void IoTHubTransport_AMQP_Common_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
         {
             LogError("Device '%s' failed unsubscribing to cloud-to-device messages (device_unsubscribe_message failed)", STRING_c_str(amqp_device_instance->device_id));
         }
+        else
+        {
+            mark_device_ready(amqp_device_instance);
+        }
     }
 }
 
@@ -1734,6 +2116,10 @@ int IoTHubTransport_AMQP_Common_Subscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle
                     result = __FAILURE__;
                     break;
                 }
+                else
+                {
+                    mark_device_ready(registered_device);
+                }
 
                 list_item = singlylinkedlist_get_next_item(list_item);
             }
@@ -1778,6 +2164,10 @@ void IoTHubTransport_AMQP_Common_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE han
                     LogError("Failed unsubscribing for device Twin updates");
                     break;
                 }
+                else
+                {
+                    mark_device_ready(registered_device);
+                }
 
                 list_item = singlylinkedlist_get_next_item(list_item);
             }
@@ -1802,6 +2192,7 @@ int IoTHubTransport_AMQP_Common_Subscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE hand
         /* Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_01_005: [ If the transport is already subscribed to receive C2D method requests, `IoTHubTransport_AMQP_Common_Subscribe_DeviceMethod` shall perform no additional action and return 0. ]*/
         device_state->subscribe_methods_needed = true;
         device_state->subscribed_for_methods = false;
+        mark_device_ready(device_state);
         result = 0;
     }
 
@@ -1913,6 +2304,13 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_AMQP_Common_SetOption(TRANSPORT_LL_HANDLE h
         LogError("Invalid parameter (NULL) passed to AMQP transport SetOption (handle=%p, options=%p, value=%p)", handle, option, value);
         result = IOTHUB_CLIENT_INVALID_ARG;
     }
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_003: [If `option` is `event_sender_link_count` and `value` is 0 or greater than TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT, IoTHubTransport_AMQP_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
+    else if (strcmp(OPTION_EVENT_SENDER_LINK_COUNT, option) == 0 &&
+        (*(size_t*)value == 0 || *(size_t*)value > TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT))
+    {
+        LogError("Invalid event sender link count %lu (must be between 1 and %d)", (unsigned long)*(size_t*)value, TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT);
+        result = IOTHUB_CLIENT_INVALID_ARG;
+    }
     else
     {
         AMQP_TRANSPORT_INSTANCE* transport_instance = (AMQP_TRANSPORT_INSTANCE*)handle;
@@ -1939,6 +2337,26 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_AMQP_Common_SetOption(TRANSPORT_LL_HANDLE h
             is_device_specific_option = true;
             transport_instance->option_send_event_timeout_secs = *(size_t*)value;
         }
+        else if (strcmp(OPTION_EVENT_SENDER_LINK_COUNT, option) == 0)
+        {
+            is_device_specific_option = true;
+            transport_instance->option_event_sender_link_count = *(size_t*)value;
+        }
+        else if (strcmp(OPTION_EVENT_SEND_IN_ORDER, option) == 0)
+        {
+            is_device_specific_option = true;
+            transport_instance->option_event_send_in_order = *(bool*)value;
+        }
+        else if (strcmp(OPTION_C2D_PREFETCH_COUNT, option) == 0)
+        {
+            is_device_specific_option = true;
+            transport_instance->option_c2d_prefetch_count = *(size_t*)value;
+        }
+        else if (strcmp(OPTION_C2D_ADAPTIVE_PREFETCH, option) == 0)
+        {
+            is_device_specific_option = true;
+            transport_instance->option_c2d_adaptive_prefetch = *(bool*)value;
+        }
         else
         {
             is_device_specific_option = false;
@@ -1962,6 +2380,11 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_AMQP_Common_SetOption(TRANSPORT_LL_HANDLE h
             transport_instance->svc2cl_keep_alive_timeout_secs = *(size_t*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        else if (strcmp(OPTION_MESSAGE_POOL_SIZE, option) == 0)
+        {
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_002: [If `option` is `message_pool_size`, IoTHubTransport_AMQP_Common_SetOption shall return IOTHUB_CLIENT_OK, the transport keeps no records of its own to pool]
+            result = IOTHUB_CLIENT_OK;
+        }
         else if (strcmp(OPTION_REMOTE_IDLE_TIMEOUT_RATIO, option) == 0)
         {
             
@@ -2146,11 +2569,11 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
     }
     else
     {
-        LIST_ITEM_HANDLE list_item;
         AMQP_TRANSPORT_INSTANCE* transport_instance = (AMQP_TRANSPORT_INSTANCE*)handle;
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_064: [If the device is already registered, IoTHubTransport_AMQP_Common_Register shall fail and return NULL.]
-        if (is_device_registered_ex(transport_instance->registered_devices, device->deviceId, &list_item))
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_006: [The device id shall be looked up in `instance->devices_by_id`, without scanning `instance->registered_devices`]
+        if (find_registered_device(transport_instance, device->deviceId) != NULL)
         {
             LogError("IoTHubTransport_AMQP_Common_Register failed (device '%s' already registered on this transport instance)", device->deviceId);
             result = NULL;
@@ -2195,6 +2618,7 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
                 amqp_device_instance->max_state_change_timeout_secs = DEFAULT_DEVICE_STATE_CHANGE_TIMEOUT_SECS;
                 amqp_device_instance->subscribe_methods_needed = false;
                 amqp_device_instance->subscribed_for_methods = false;
+                amqp_device_instance->device_id_hash = get_device_id_hash(device->deviceId);
 
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_069: [A copy of `config->deviceId` shall be saved into `device_state->device_id`]
                 if ((amqp_device_instance->device_id = STRING_construct(device->deviceId)) == NULL)
@@ -2215,6 +2639,8 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
                     device_config.on_state_changed_callback = on_device_state_changed_callback;
                     device_config.on_state_changed_context = amqp_device_instance;
                     device_config.product_info = local_product_info;
+                    // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_015: [The device shall be created with `instance->sas_token_refresh_limit`, shared by all devices registered on the transport]
+                    device_config.sas_token_refresh_limit = &transport_instance->sas_token_refresh_limit;
 
                     // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_071: [`amqp_device_instance->device_handle` shall be set using device_create()]
                     if ((amqp_device_instance->device_handle = device_create(&device_config)) == NULL)
@@ -2225,7 +2651,7 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
                     }
                     else
                     {
-                        bool is_first_device_being_registered = (singlylinkedlist_get_head_item(transport_instance->registered_devices) == NULL);
+                        bool is_first_device_being_registered = (get_number_of_registered_devices(transport_instance) == 0);
 
                         /* Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_01_010: [ `IoTHubTransport_AMQP_Common_Create` shall create a new iothubtransportamqp_methods instance by calling `iothubtransportamqp_methods_create` while passing to it the the fully qualified domain name and the device Id. ]*/
                         amqp_device_instance->methods_handle = iothubtransportamqp_methods_create(STRING_c_str(transport_instance->iothub_host_fqdn), device->deviceId);
@@ -2243,7 +2669,7 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
                                 result = NULL;
                             }
                             // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_074: [IoTHubTransport_AMQP_Common_Register shall add the `amqp_device_instance` to `instance->registered_devices`]
-                            else if (singlylinkedlist_add(transport_instance->registered_devices, amqp_device_instance) == NULL)
+                            else if ((amqp_device_instance->list_item = singlylinkedlist_add(transport_instance->registered_devices, amqp_device_instance)) == NULL)
                             {
                                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_075: [If it fails to add `amqp_device_instance`, IoTHubTransport_AMQP_Common_Register shall fail and return NULL]
                                 LogError("Transport failed to register device '%s' (singlylinkedlist_add failed)", device->deviceId);
@@ -2265,6 +2691,12 @@ IOTHUB_DEVICE_HANDLE IoTHubTransport_AMQP_Common_Register(TRANSPORT_LL_HANDLE ha
                                     }
                                 }
 
+                                // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_007: [IoTHubTransport_AMQP_Common_Register shall add `amqp_device_instance` to `instance->devices_by_id`, `instance->devices_by_client` and `instance->ready_devices`]
+                                add_to_device_index(transport_instance, amqp_device_instance);
+                                DList_InsertTailList(&transport_instance->ready_devices, &amqp_device_instance->work_list_entry);
+                                amqp_device_instance->is_ready = true;
+                                amqp_device_instance->has_new_activity = true;
+
                                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_078: [IoTHubTransport_AMQP_Common_Register shall return a handle to `amqp_device_instance` as a IOTHUB_DEVICE_HANDLE]
                                 result = (IOTHUB_DEVICE_HANDLE)amqp_device_instance;
                             }
@@ -2296,7 +2728,6 @@ void IoTHubTransport_AMQP_Common_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
     {
         AMQP_TRANSPORT_DEVICE_INSTANCE* registered_device = (AMQP_TRANSPORT_DEVICE_INSTANCE*)deviceHandle;
         const char* device_id;
-        LIST_ITEM_HANDLE list_item;
 
         if ((device_id = STRING_c_str(registered_device->device_id)) == NULL)
         {
@@ -2308,14 +2739,20 @@ void IoTHubTransport_AMQP_Common_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
             LogError("Failed to unregister device '%s' (deviceHandle does not have a transport state associated to).", device_id);
         }
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_081: [If the device is not registered with this transport, IoTHubTransport_AMQP_Common_Unregister shall return]
-        else if (!is_device_registered_ex(registered_device->transport_instance->registered_devices, device_id, &list_item))
+        else if (!is_device_registered_ex(registered_device, device_id))
         {
             LogError("Failed to unregister device '%s' (device is not registered within this transport).", device_id);
         }
         else
         {
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_008: [IoTHubTransport_AMQP_Common_Unregister shall remove the device from the device indexes and from `instance->ready_devices` or `instance->idle_devices`]
+            remove_from_device_index(registered_device);
+            (void)DList_RemoveEntryList(&registered_device->work_list_entry);
+            // Keeps mark_device_ready() from linking it back while device_destroy() stops it.
+            registered_device->is_ready = true;
+
             // Removing it first so the race hazzard is reduced between this function and DoWork. Best would be to use locks.
-            if (singlylinkedlist_remove(registered_device->transport_instance->registered_devices, list_item) != RESULT_OK)
+            if (singlylinkedlist_remove(registered_device->transport_instance->registered_devices, registered_device->list_item) != RESULT_OK)
             {
                 LogError("Failed to unregister device '%s' (singlylinkedlist_remove failed).", device_id);
             }
@@ -2448,6 +2885,7 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_AMQP_Common_SendMessageDisposition(MESSAGE_
                 }
                 else
                 {
+                    mark_device_ready(message_data->transportContext->device_state);
                     IoTHubMessage_Destroy(message_data->messageHandle);
                     result = IOTHUB_CLIENT_OK;
                 }
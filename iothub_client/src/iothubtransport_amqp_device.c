@@ -492,6 +492,7 @@ static DEVICE_CONFIG* clone_device_config(DEVICE_CONFIG *config)
         else
         {
             new_config->authorization_module = config->authorization_module;
+            new_config->sas_token_refresh_limit = config->sas_token_refresh_limit;
             new_config->authentication_mode = config->authentication_mode;
             new_config->on_state_changed_callback = config->on_state_changed_callback;
             new_config->on_state_changed_context = config->on_state_changed_context;
@@ -520,6 +521,7 @@ static void set_authentication_config(AMQP_DEVICE_INSTANCE* device_instance, AUT
     auth_config->on_state_changed_callback = on_authentication_state_changed_callback;
     auth_config->on_state_changed_callback_context = device_instance;
     auth_config->authorization_module = device_config->authorization_module;
+    auth_config->sas_token_refresh_limit = device_config->sas_token_refresh_limit;
 }
 
 // Create and Destroy Helpers
@@ -1400,10 +1402,37 @@ int device_set_option(AMQP_DEVICE_HANDLE handle, const char* name, void* value)
                 result = RESULT_OK;
             }
         }
-        else if (strcmp(DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS, name) == 0)
+        else if (strcmp(DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS, name) == 0 ||
+                 strcmp(DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, name) == 0 ||
+                 strcmp(DEVICE_OPTION_EVENT_SEND_IN_ORDER, name) == 0 ||
+                 strcmp(DEVICE_OPTION_C2D_PREFETCH_COUNT, name) == 0 ||
+                 strcmp(DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH, name) == 0)
         {
+            const char* messenger_option_name;
+
+            if (strcmp(DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS, name) == 0)
+            {
+                messenger_option_name = TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS;
+            }
+            else if (strcmp(DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, name) == 0)
+            {
+                messenger_option_name = TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT;
+            }
+            else if (strcmp(DEVICE_OPTION_EVENT_SEND_IN_ORDER, name) == 0)
+            {
+                messenger_option_name = TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER;
+            }
+            else if (strcmp(DEVICE_OPTION_C2D_PREFETCH_COUNT, name) == 0)
+            {
+                messenger_option_name = TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT;
+            }
+            else
+            {
+                messenger_option_name = TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH;
+            }
+
             // Codes_SRS_DEVICE_09_086: [If `name` refers to messenger module, it shall be passed along with `value` to telemetry_messenger_set_option]
-            if (telemetry_messenger_set_option(instance->messenger_handle, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS, value) != RESULT_OK)
+            if (telemetry_messenger_set_option(instance->messenger_handle, messenger_option_name, value) != RESULT_OK)
             {
                 // Codes_SRS_DEVICE_09_087: [If telemetry_messenger_set_option fails, device_set_option shall return a non-zero result]
                 LogError("failed setting option for device '%s' (failed setting messenger option '%s')", instance->config->device_id, name);
@@ -29,14 +29,32 @@
 #define MESSAGE_SENDER_MAX_LINK_SIZE                    UINT64_MAX
 #define MESSAGE_RECEIVER_LINK_NAME_PREFIX               "link-rcv"
 #define MESSAGE_RECEIVER_MAX_LINK_SIZE                  65536
+#define C2D_ADAPTIVE_CREDIT_SAMPLE_SECS                 5
+#define C2D_ADAPTIVE_CREDIT_BUFFER_SECS                 2
+#define C2D_ADAPTIVE_CREDIT_MIN                         16
+#define C2D_ADAPTIVE_CREDIT_MAX                         10000
 #define DEFAULT_EVENT_SEND_RETRY_LIMIT                  10
 #define DEFAULT_EVENT_SEND_TIMEOUT_SECS                 600
+#define DEFAULT_EVENT_SENDER_LINK_COUNT                 1
 #define MAX_MESSAGE_SENDER_STATE_CHANGE_TIMEOUT_SECS    300
 #define MAX_MESSAGE_RECEIVER_STATE_CHANGE_TIMEOUT_SECS  300
 #define UNIQUE_ID_BUFFER_SIZE                           37
 #define STRING_NULL_TERMINATOR                          '\0'
 
 #define AMQP_BATCHING_FORMAT_CODE 0x80013700
+
+// EVENT_SENDER_LINK is one of the AMQP sender links the messenger opens on its session for telemetry.
+// in_flight counts the batched messages handed to this link whose send-complete callback has not fired yet.
+typedef struct EVENT_SENDER_LINK_TAG
+{
+    struct TELEMETRY_MESSENGER_INSTANCE_TAG* messenger;
+    LINK_HANDLE link;
+    MESSAGE_SENDER_HANDLE message_sender;
+    MESSAGE_SENDER_STATE current_state;
+    MESSAGE_SENDER_STATE previous_state;
+    time_t last_state_change_time;
+    size_t in_flight;
+} EVENT_SENDER_LINK;
  
 typedef struct TELEMETRY_MESSENGER_INSTANCE_TAG
 {
@@ -55,29 +73,38 @@ typedef struct TELEMETRY_MESSENGER_INSTANCE_TAG
     void* on_message_received_context;
 
     SESSION_HANDLE session_handle;
-    LINK_HANDLE sender_link;
-    MESSAGE_SENDER_HANDLE message_sender;
-    MESSAGE_SENDER_STATE message_sender_current_state;
-    MESSAGE_SENDER_STATE message_sender_previous_state;
+    EVENT_SENDER_LINK event_senders[TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT];
+    size_t event_sender_count;                 // Number of links in event_senders created for the current start.
+    size_t next_event_sender;                  // Where the round-robin search for the next link to send on starts.
+    size_t event_sender_link_count;            // Number of links to create on the next start.
+    bool event_send_in_order;
     LINK_HANDLE receiver_link;
     MESSAGE_RECEIVER_HANDLE message_receiver;
     MESSAGE_RECEIVER_STATE message_receiver_current_state;
     MESSAGE_RECEIVER_STATE message_receiver_previous_state;
 
+    size_t c2d_prefetch_count;                 // Link credit of receiver_link; 0 leaves it to uAMQP.
+    bool c2d_adaptive_prefetch;
+    uint32_t c2d_link_credit;                  // Credit last set on receiver_link, 0 if never set.
+    size_t c2d_settled_count;                  // C2D messages settled since c2d_credit_sample_time.
+    time_t c2d_credit_sample_time;
+
     size_t event_send_retry_limit;
     size_t event_send_error_count;
     size_t event_send_timeout_secs;
-    time_t last_message_sender_state_change_time;
     time_t last_message_receiver_state_change_time;
 } TELEMETRY_MESSENGER_INSTANCE;
 
 // MESSENGER_SEND_EVENT_CALLER_INFORMATION corresponds to a message sent from the API, including
 // the message and callback information to alert caller about what happened.
+// The AMQP encoding of the message is kept with it once made, so that a message put back on
+// waiting_to_send after a link failure is not encoded again when it is retried.
 typedef struct MESSENGER_SEND_EVENT_CALLER_INFORMATION_TAG
 {
     IOTHUB_MESSAGE_LIST* message;
     ON_TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE on_event_send_complete_callback;
     void* context;
+    BINARY_DATA encoded_message;
 } MESSENGER_SEND_EVENT_CALLER_INFORMATION;
 
 // MESSENGER_SEND_EVENT_TASK interfaces with underlying uAMQP layer.  It receives the callback
@@ -87,7 +114,10 @@ typedef struct MESSENGER_SEND_EVENT_TASK_TAG
     SINGLYLINKEDLIST_HANDLE callback_list;  // List of MESSENGER_SEND_EVENT_CALLER_INFORMATION's
     time_t send_time;
     TELEMETRY_MESSENGER_INSTANCE *messenger;
+    EVENT_SENDER_LINK* sender;              // Link the task was sent on.
     bool is_timed_out;
+    bool is_completed;                      // Set when completion is held back to keep callbacks in order.
+    MESSAGE_SEND_RESULT send_result;
 } MESSENGER_SEND_EVENT_TASK;
 
 
@@ -336,25 +366,40 @@ static void attach_device_client_type_to_link(LINK_HANDLE link, STRING_HANDLE pr
     }
 }
 
-static void destroy_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+static void destroy_event_sender_link(EVENT_SENDER_LINK* sender)
 {
-    if (instance->message_sender != NULL)
+    if (sender->message_sender != NULL)
     {
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_060: [`instance->message_sender` shall be destroyed using messagesender_destroy()]
-        messagesender_destroy(instance->message_sender);
-        instance->message_sender = NULL;
+        messagesender_destroy(sender->message_sender);
+        sender->message_sender = NULL;
     }
 
-    instance->message_sender_current_state = MESSAGE_SENDER_STATE_IDLE;
-    instance->message_sender_previous_state = MESSAGE_SENDER_STATE_IDLE;
-    instance->last_message_sender_state_change_time = INDEFINITE_TIME;
+    sender->current_state = MESSAGE_SENDER_STATE_IDLE;
+    sender->previous_state = MESSAGE_SENDER_STATE_IDLE;
+    sender->last_state_change_time = INDEFINITE_TIME;
+    sender->in_flight = 0;
 
-    if (instance->sender_link != NULL)
+    if (sender->link != NULL)
     {
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_063: [`instance->sender_link` shall be destroyed using link_destroy()]
-        link_destroy(instance->sender_link);
-        instance->sender_link = NULL;
+        link_destroy(sender->link);
+        sender->link = NULL;
+    }
+}
+
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_205: [All the event sender links of `instance` shall be destroyed]
+static void destroy_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    size_t i;
+
+    for (i = 0; i < TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT; i++)
+    {
+        destroy_event_sender_link(&instance->event_senders[i]);
     }
+
+    instance->event_sender_count = 0;
+    instance->next_event_sender = 0;
 }
 
 static void on_event_sender_state_changed_callback(void* context, MESSAGE_SENDER_STATE new_state, MESSAGE_SENDER_STATE previous_state)
@@ -367,15 +412,15 @@ static void on_event_sender_state_changed_callback(void* context, MESSAGE_SENDER
     {
         if (new_state != previous_state)
         {
-            TELEMETRY_MESSENGER_INSTANCE* instance = (TELEMETRY_MESSENGER_INSTANCE*)context;
-            instance->message_sender_current_state = new_state;
-            instance->message_sender_previous_state = previous_state;
-            instance->last_message_sender_state_change_time = get_time(NULL);
+            EVENT_SENDER_LINK* sender = (EVENT_SENDER_LINK*)context;
+            sender->current_state = new_state;
+            sender->previous_state = previous_state;
+            sender->last_state_change_time = get_time(NULL);
         }
     }
 }
 
-static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+static int create_event_sender_link(TELEMETRY_MESSENGER_INSTANCE* instance, EVENT_SENDER_LINK* sender, STRING_HANDLE event_send_address)
 {
     int result;
 
@@ -383,25 +428,9 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
     STRING_HANDLE source_name = NULL;
     AMQP_VALUE source = NULL;
     AMQP_VALUE target = NULL;
-    STRING_HANDLE devices_path = NULL;
-    STRING_HANDLE event_send_address = NULL;
 
-    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_033: [A variable, named `devices_path`, shall be created concatenating `instance->iothub_host_fqdn`, "/devices/" and `instance->device_id`]
-    if ((devices_path = create_devices_path(instance->iothub_host_fqdn, instance->device_id)) == NULL)
-    {
-        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_034: [If `devices_path` fails to be created, telemetry_messenger_do_work() shall fail and return]
-        result = __FAILURE__;
-        LogError("Failed creating the message sender (failed creating the 'devices_path')");
-    }
-    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_035: [A variable, named `event_send_address`, shall be created concatenating "amqps://", `devices_path` and "/messages/events"]
-    else if ((event_send_address = create_event_send_address(devices_path)) == NULL)
-    {
-        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_036: [If `event_send_address` fails to be created, telemetry_messenger_do_work() shall fail and return]
-        result = __FAILURE__;
-        LogError("Failed creating the message sender (failed creating the 'event_send_address')");
-    }
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_037: [A `link_name` variable shall be created using an unique string label per AMQP session]
-    else if ((link_name = create_link_name(MESSAGE_SENDER_LINK_NAME_PREFIX, STRING_c_str(instance->device_id))) == NULL)
+    if ((link_name = create_link_name(MESSAGE_SENDER_LINK_NAME_PREFIX, STRING_c_str(instance->device_id))) == NULL)
     {
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_038: [If `link_name` fails to be created, telemetry_messenger_do_work() shall fail and return]
         result = __FAILURE__;
@@ -427,7 +456,7 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
         LogError("Failed creating the message sender (messaging_create_target failed)");
     }
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_043: [`instance->sender_link` shall be set using link_create(), passing `instance->session_handle`, `link_name`, "role_sender", `source` and `target` as parameters]
-    else if ((instance->sender_link = link_create(instance->session_handle, STRING_c_str(link_name), role_sender, source, target)) == NULL)
+    else if ((sender->link = link_create(instance->session_handle, STRING_c_str(link_name), role_sender, source, target)) == NULL)
     {
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_044: [If link_create() fails, telemetry_messenger_do_work() shall fail and return]
         result = __FAILURE__;
@@ -436,7 +465,7 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
     else
     {
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_047: [`instance->sender_link` maximum message size shall be set to UINT64_MAX using link_set_max_message_size()]
-        if (link_set_max_message_size(instance->sender_link, MESSAGE_SENDER_MAX_LINK_SIZE) != RESULT_OK)
+        if (link_set_max_message_size(sender->link, MESSAGE_SENDER_MAX_LINK_SIZE) != RESULT_OK)
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_048: [If link_set_max_message_size() fails, it shall be logged and ignored.]
             LogError("Failed setting message sender link max message size.");
@@ -444,24 +473,24 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_049: [`instance->sender_link` should have a property "com.microsoft:client-version" set as `CLIENT_DEVICE_TYPE_PREFIX/IOTHUB_SDK_VERSION`, using amqpvalue_set_map_value() and link_set_attach_properties()]
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_050: [If amqpvalue_set_map_value() or link_set_attach_properties() fail, the failure shall be ignored]
-        attach_device_client_type_to_link(instance->sender_link, instance->product_info);
+        attach_device_client_type_to_link(sender->link, instance->product_info);
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_051: [`instance->message_sender` shall be created using messagesender_create(), passing the `instance->sender_link` and `on_event_sender_state_changed_callback`]
-        if ((instance->message_sender = messagesender_create(instance->sender_link, on_event_sender_state_changed_callback, (void*)instance)) == NULL)
+        if ((sender->message_sender = messagesender_create(sender->link, on_event_sender_state_changed_callback, (void*)sender)) == NULL)
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_052: [If messagesender_create() fails, telemetry_messenger_do_work() shall fail and return]
             LogError("Failed creating the message sender (messagesender_create failed)");
-            destroy_event_sender(instance);
+            destroy_event_sender_link(sender);
             result = __FAILURE__;
         }
         else
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_053: [`instance->message_sender` shall be opened using messagesender_open()]
-            if (messagesender_open(instance->message_sender) != RESULT_OK)
+            if (messagesender_open(sender->message_sender) != RESULT_OK)
             {
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_054: [If messagesender_open() fails, telemetry_messenger_do_work() shall fail and return]
                 LogError("Failed opening the AMQP message sender.");
-                destroy_event_sender(instance);
+                destroy_event_sender_link(sender);
                 result = __FAILURE__;
             }
             else
@@ -471,7 +500,6 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
         }
     }
 
-    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_055: [Before returning, telemetry_messenger_do_work() shall release all the temporary memory it has allocated]
     if (link_name != NULL)
         STRING_delete(link_name);
     if (source_name != NULL)
@@ -480,6 +508,60 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
         amqpvalue_destroy(source);
     if (target != NULL)
         amqpvalue_destroy(target);
+
+    return result;
+}
+
+static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    int result;
+
+    STRING_HANDLE devices_path = NULL;
+    STRING_HANDLE event_send_address = NULL;
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_033: [A variable, named `devices_path`, shall be created concatenating `instance->iothub_host_fqdn`, "/devices/" and `instance->device_id`]
+    if ((devices_path = create_devices_path(instance->iothub_host_fqdn, instance->device_id)) == NULL)
+    {
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_034: [If `devices_path` fails to be created, telemetry_messenger_do_work() shall fail and return]
+        result = __FAILURE__;
+        LogError("Failed creating the message sender (failed creating the 'devices_path')");
+    }
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_035: [A variable, named `event_send_address`, shall be created concatenating "amqps://", `devices_path` and "/messages/events"]
+    else if ((event_send_address = create_event_send_address(devices_path)) == NULL)
+    {
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_036: [If `event_send_address` fails to be created, telemetry_messenger_do_work() shall fail and return]
+        result = __FAILURE__;
+        LogError("Failed creating the message sender (failed creating the 'event_send_address')");
+    }
+    else
+    {
+        size_t i;
+
+        result = RESULT_OK;
+
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_206: [`instance->event_sender_link_count` sender links shall be created and opened on `instance->session_handle`, each with its own unique link name]
+        for (i = 0; i < instance->event_sender_link_count; i++)
+        {
+            instance->event_senders[i].messenger = instance;
+
+            if (create_event_sender_link(instance, &instance->event_senders[i], event_send_address) != RESULT_OK)
+            {
+                // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_207: [If any of the sender links fails to be created, all the sender links already created shall be destroyed and telemetry_messenger_do_work() shall fail and return]
+                LogError("Failed creating event sender link %lu of %lu", (unsigned long)(i + 1), (unsigned long)instance->event_sender_link_count);
+                destroy_event_sender(instance);
+                result = __FAILURE__;
+                break;
+            }
+        }
+
+        if (result == RESULT_OK)
+        {
+            instance->event_sender_count = instance->event_sender_link_count;
+            instance->next_event_sender = 0;
+        }
+    }
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_055: [Before returning, telemetry_messenger_do_work() shall release all the temporary memory it has allocated]
     if (devices_path != NULL)
         STRING_delete(devices_path);
     if (event_send_address != NULL)
@@ -488,6 +570,73 @@ static int create_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
     return result;
 }
 
+// @brief
+//     Picks the link the messenger state follows while starting or started: a link in a failed state
+//     (ERROR, CLOSING, or IDLE after being created) first, then a link still OPENING, then any OPEN link.
+// @returns
+//     NULL if no event sender links are created.
+static EVENT_SENDER_LINK* get_least_ready_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    EVENT_SENDER_LINK* result = NULL;
+    int result_rank = -1;
+    size_t i;
+
+    for (i = 0; i < instance->event_sender_count; i++)
+    {
+        EVENT_SENDER_LINK* sender = &instance->event_senders[i];
+        int rank;
+
+        if (sender->current_state == MESSAGE_SENDER_STATE_OPEN)
+        {
+            rank = 0;
+        }
+        else if (sender->current_state == MESSAGE_SENDER_STATE_OPENING)
+        {
+            rank = 1;
+        }
+        else
+        {
+            rank = 2;
+        }
+
+        if (rank > result_rank)
+        {
+            result = sender;
+            result_rank = rank;
+        }
+    }
+
+    return result;
+}
+
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_208: [Each batched message shall be sent on the open sender link with the fewest messages in flight, ties broken round-robin starting after the link used last]
+static EVENT_SENDER_LINK* get_next_event_sender(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    EVENT_SENDER_LINK* result = NULL;
+    size_t result_index = 0;
+    size_t i;
+
+    for (i = 0; i < instance->event_sender_count; i++)
+    {
+        size_t index = (instance->next_event_sender + i) % instance->event_sender_count;
+        EVENT_SENDER_LINK* sender = &instance->event_senders[index];
+
+        if (sender->current_state == MESSAGE_SENDER_STATE_OPEN &&
+            (result == NULL || sender->in_flight < result->in_flight))
+        {
+            result = sender;
+            result_index = index;
+        }
+    }
+
+    if (result != NULL)
+    {
+        instance->next_event_sender = (result_index + 1) % instance->event_sender_count;
+    }
+
+    return result;
+}
+
 static void destroy_message_receiver(TELEMETRY_MESSENGER_INSTANCE* instance)
 {
     if (instance->message_receiver != NULL)
@@ -511,6 +660,9 @@ static void destroy_message_receiver(TELEMETRY_MESSENGER_INSTANCE* instance)
     instance->message_receiver_current_state = MESSAGE_RECEIVER_STATE_IDLE;
     instance->message_receiver_previous_state = MESSAGE_RECEIVER_STATE_IDLE;
     instance->last_message_receiver_state_change_time = INDEFINITE_TIME;
+    instance->c2d_link_credit = 0;
+    instance->c2d_settled_count = 0;
+    instance->c2d_credit_sample_time = INDEFINITE_TIME;
 
     if (instance->receiver_link != NULL)
     {
@@ -522,6 +674,77 @@ static void destroy_message_receiver(TELEMETRY_MESSENGER_INSTANCE* instance)
     }
 }
 
+// @brief
+//     Sets the credit uAMQP grants the service on `instance->receiver_link` when it attaches and every time the
+//     previous credit is used up, so the C2D messages in a burst are requested one window at a time.
+static void set_c2d_link_credit(TELEMETRY_MESSENGER_INSTANCE* instance, size_t link_credit)
+{
+    uint32_t credit = (link_credit > UINT32_MAX ? UINT32_MAX : (uint32_t)link_credit);
+
+    if (link_set_max_link_credit(instance->receiver_link, credit) != RESULT_OK)
+    {
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_218: [If link_set_max_link_credit() fails, it shall be logged and ignored]
+        LogError("Failed setting message receiver link credit to %lu.", (unsigned long)credit);
+    }
+    else
+    {
+        instance->c2d_link_credit = credit;
+    }
+}
+
+static size_t get_max_c2d_link_credit(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    return (instance->c2d_prefetch_count > 0 ? instance->c2d_prefetch_count : C2D_ADAPTIVE_CREDIT_MAX);
+}
+
+// @brief
+//     Resizes the C2D link credit to what the upper layer settled over the last C2D_ADAPTIVE_CREDIT_SAMPLE_SECS,
+//     scaled to C2D_ADAPTIVE_CREDIT_BUFFER_SECS worth of messages. A consumer that keeps up lets the credit grow
+//     each sample; a slow one shrinks it so fewer messages wait unsettled on the device.
+static void update_adaptive_c2d_link_credit(TELEMETRY_MESSENGER_INSTANCE* instance)
+{
+    time_t current_time;
+
+    if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
+    {
+        LogError("Failed sampling C2D consumer speed (get_time failed)");
+    }
+    else if (instance->c2d_credit_sample_time == INDEFINITE_TIME)
+    {
+        instance->c2d_credit_sample_time = current_time;
+        instance->c2d_settled_count = 0;
+    }
+    else
+    {
+        double elapsed_secs = get_difftime(current_time, instance->c2d_credit_sample_time);
+
+        if (elapsed_secs >= C2D_ADAPTIVE_CREDIT_SAMPLE_SECS)
+        {
+            size_t max_credit = get_max_c2d_link_credit(instance);
+            size_t link_credit = (size_t)((instance->c2d_settled_count / elapsed_secs) * C2D_ADAPTIVE_CREDIT_BUFFER_SECS);
+
+            if (link_credit < C2D_ADAPTIVE_CREDIT_MIN)
+            {
+                link_credit = C2D_ADAPTIVE_CREDIT_MIN;
+            }
+
+            if (link_credit > max_credit)
+            {
+                link_credit = max_credit;
+            }
+
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_219: [If `instance->c2d_adaptive_prefetch` is true, the link credit shall be resized every C2D_ADAPTIVE_CREDIT_SAMPLE_SECS to the rate C2D messages were settled at, times C2D_ADAPTIVE_CREDIT_BUFFER_SECS, kept between C2D_ADAPTIVE_CREDIT_MIN and the prefetch count (or C2D_ADAPTIVE_CREDIT_MAX if not set)]
+            if (link_credit != instance->c2d_link_credit)
+            {
+                set_c2d_link_credit(instance, link_credit);
+            }
+
+            instance->c2d_credit_sample_time = current_time;
+            instance->c2d_settled_count = 0;
+        }
+    }
+}
+
 static void on_message_receiver_state_changed_callback(const void* context, MESSAGE_RECEIVER_STATE new_state, MESSAGE_RECEIVER_STATE previous_state)
 {
     if (context == NULL)
@@ -658,6 +881,11 @@ static AMQP_VALUE on_message_received_internal_callback(const void* context, MES
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_126: [If `instance->on_message_received_callback` returns TELEMETRY_MESSENGER_DISPOSITION_RESULT_RELEASED, on_message_received_internal_callback shall return the result of messaging_delivery_released()]
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_127: [If `instance->on_message_received_callback` returns TELEMETRY_MESSENGER_DISPOSITION_RESULT_REJECTED, on_message_received_internal_callback shall return the result of messaging_delivery_rejected()]
             result = create_uamqp_disposition_result_from(disposition_result);
+
+            if (result != NULL)
+            {
+                instance->c2d_settled_count++;
+            }
         }
     }
 
@@ -738,6 +966,12 @@ static int create_message_receiver(TELEMETRY_MESSENGER_INSTANCE* instance)
             LogError("Failed setting message receiver link max message size.");
         }
 
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_217: [If `instance->c2d_prefetch_count` is not 0 or `instance->c2d_adaptive_prefetch` is true, `instance->receiver_link` link credit shall be set to the prefetch count (or C2D_ADAPTIVE_CREDIT_MAX if not set) using link_set_max_link_credit()]
+        if (instance->c2d_prefetch_count > 0 || instance->c2d_adaptive_prefetch)
+        {
+            set_c2d_link_credit(instance, get_max_c2d_link_credit(instance));
+        }
+
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_084: [`instance->receiver_link` should have a property "com.microsoft:client-version" set as `CLIENT_DEVICE_TYPE_PREFIX/IOTHUB_SDK_VERSION`, using amqpvalue_set_map_value() and link_set_attach_properties()]
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_085: [If amqpvalue_set_map_value() or link_set_attach_properties() fail, the failure shall be ignored]
         attach_device_client_type_to_link(instance->receiver_link, instance->product_info);
@@ -818,6 +1052,17 @@ static void remove_event_from_in_progress_list(MESSENGER_SEND_EVENT_TASK *task)
     }
 }
 
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_202: [Freeing a caller information shall free the AMQP encoding cached with it, if any]
+static void free_caller_info(MESSENGER_SEND_EVENT_CALLER_INFORMATION* caller_info)
+{
+    if (caller_info->encoded_message.bytes != NULL)
+    {
+        free((unsigned char*)caller_info->encoded_message.bytes);
+    }
+
+    free(caller_info);
+}
+
 // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_201: [Freeing a `task` will free callback items associated with it and free the data itself]
 static void free_task(MESSENGER_SEND_EVENT_TASK* task)
 {
@@ -829,7 +1074,7 @@ static void free_task(MESSENGER_SEND_EVENT_TASK* task)
         {
             MESSENGER_SEND_EVENT_CALLER_INFORMATION* caller_info = (MESSENGER_SEND_EVENT_CALLER_INFORMATION*)singlylinkedlist_item_get_value(list_node);
             (void)singlylinkedlist_remove(task->callback_list, list_node);
-            free(caller_info);
+            free_caller_info(caller_info);
         }
         singlylinkedlist_destroy(task->callback_list);
     }
@@ -1009,42 +1254,90 @@ static void invoke_callback(const void* item, const void* action_context, bool*
     *continue_processing = true;
 }
 
+static void complete_task(MESSENGER_SEND_EVENT_TASK* task)
+{
+    if (task->is_timed_out == false)
+    {
+        TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT messenger_send_result;
+
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_189: [If no failure occurs, `on_event_send_complete_callback` shall be invoked with result TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_OK for all callers associated with this task]
+        if (task->send_result == MESSAGE_SEND_OK)
+        {
+            messenger_send_result = TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_190: [If a failure occured, `on_event_send_complete_callback` shall be invoked with result TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING for all callers associated with this task]
+        else
+        {
+            messenger_send_result = TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING;
+        }
+
+        // Initially typecast to a size_t to avoid 64 bit compiler warnings on casting of void* to larger type.
+        singlylinkedlist_foreach(task->callback_list, invoke_callback, (void*)((size_t)messenger_send_result));
+    }
+    else
+    {
+        LogInfo("messenger on_event_send_complete_callback invoked for timed out event %p; not firing upper layer callback.", task);
+    }
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_128: [`task` shall be removed from `instance->in_progress_list`]  
+    remove_event_from_in_progress_list(task);
+
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_130: [`task` shall be destroyed()]
+    free_task(task);
+}
+
+// @brief
+//     Completes the tasks on in_progress_list whose send-complete callback has already fired.
+// @param stop_at_pending
+//     If true, stops at the first task still waiting on its callback, so callers are called back in the
+//     order the events were batched. Tasks already reported as timed out do not hold the others back.
+static void release_completed_events(TELEMETRY_MESSENGER_INSTANCE* instance, bool stop_at_pending)
+{
+    LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(instance->in_progress_list);
+
+    while (list_item != NULL)
+    {
+        MESSENGER_SEND_EVENT_TASK* task = (MESSENGER_SEND_EVENT_TASK*)singlylinkedlist_item_get_value(list_item);
+        LIST_ITEM_HANDLE next_list_item = singlylinkedlist_get_next_item(list_item);
+
+        if (task->is_completed)
+        {
+            complete_task(task);
+        }
+        else if (stop_at_pending && task->is_timed_out == false)
+        {
+            break;
+        }
+
+        list_item = next_list_item;
+    }
+}
+
 static void internal_on_event_send_complete_callback(void* context, MESSAGE_SEND_RESULT send_result)
 { 
     if (context != NULL)
     {
         MESSENGER_SEND_EVENT_TASK* task = (MESSENGER_SEND_EVENT_TASK*)context;
 
-        if (task->messenger->message_sender_current_state != MESSAGE_SENDER_STATE_ERROR)
+        if (task->sender->in_flight > 0)
         {
-            if (task->is_timed_out == false)
-            {
-                TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT messenger_send_result;
+            task->sender->in_flight--;
+        }
 
-                // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_189: [If no failure occurs, `on_event_send_complete_callback` shall be invoked with result TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_OK for all callers associated with this task]
-                if (send_result == MESSAGE_SEND_OK)
-                {
-                    messenger_send_result = TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_OK;
-                }
-                // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_190: [If a failure occured, `on_event_send_complete_callback` shall be invoked with result TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING for all callers associated with this task]
-                else
-                {
-                    messenger_send_result = TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING;
-                }
+        if (task->sender->current_state != MESSAGE_SENDER_STATE_ERROR)
+        {
+            task->send_result = send_result;
 
-                // Initially typecast to a size_t to avoid 64 bit compiler warnings on casting of void* to larger type.
-                singlylinkedlist_foreach(task->callback_list, invoke_callback, (void*)((size_t)messenger_send_result));
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_209: [If `instance->event_send_in_order` is true, the callers of `task` shall only be called back once all the tasks batched before it have completed]
+            if (task->messenger->event_send_in_order)
+            {
+                task->is_completed = true;
+                release_completed_events(task->messenger, true);
             }
             else
             {
-                LogInfo("messenger on_event_send_complete_callback invoked for timed out event %p; not firing upper layer callback.", task);
+                complete_task(task);
             }
-
-            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_128: [`task` shall be removed from `instance->in_progress_list`]  
-            remove_event_from_in_progress_list(task);
-
-            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_130: [`task` shall be destroyed()]
-            free_task(task);
         }
     }
 }
@@ -1118,15 +1411,28 @@ static int send_batched_message_and_reset_state(TELEMETRY_MESSENGER_INSTANCE* in
 {
     int result;
 
-    if (messagesender_send_async(instance->message_sender, send_pending_events_state->message_batch_container, internal_on_event_send_complete_callback, send_pending_events_state->task, 0) == NULL)
+    EVENT_SENDER_LINK* sender;
+
+    if ((sender = get_next_event_sender(instance)) == NULL)
     {
-        LogError("messagesender_send failed");
+        LogError("no event sender link is open");
         result = __FAILURE__;
     }
     else
     {
-        send_pending_events_state->task->send_time = get_time(NULL);
-        result = RESULT_OK;
+        send_pending_events_state->task->sender = sender;
+
+        if (messagesender_send_async(sender->message_sender, send_pending_events_state->message_batch_container, internal_on_event_send_complete_callback, send_pending_events_state->task, 0) == NULL)
+        {
+            LogError("messagesender_send failed");
+            result = __FAILURE__;
+        }
+        else
+        {
+            send_pending_events_state->task->send_time = get_time(NULL);
+            sender->in_flight++;
+            result = RESULT_OK;
+        }
     }
 
     message_destroy(send_pending_events_state->message_batch_container);
@@ -1136,11 +1442,30 @@ static int send_batched_message_and_reset_state(TELEMETRY_MESSENGER_INSTANCE* in
 }
 
 // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_196: [Determine the maximum message size we can send over this link from AMQP, then remove AMQP_BATCHING_RESERVE_SIZE (1024) bytes as reserve buffer.]          
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_210: [With more than one sender link, the smallest maximum message size among them shall be used, so a batch fits whichever link it is sent on.]
 static int get_max_message_size_for_batching(TELEMETRY_MESSENGER_INSTANCE* instance, uint64_t* max_messagesize)
 {
-    int result;
+    int result = RESULT_OK;
+    size_t i;
+
+    *max_messagesize = 0;
+
+    for (i = 0; i < instance->event_sender_count; i++)
+    {
+        uint64_t link_max_messagesize;
+
+        if (link_get_peer_max_message_size(instance->event_senders[i].link, &link_max_messagesize) != 0)
+        {
+            result = __FAILURE__;
+            break;
+        }
+        else if (i == 0 || link_max_messagesize < *max_messagesize)
+        {
+            *max_messagesize = link_max_messagesize;
+        }
+    }
 
-    if (link_get_peer_max_message_size(instance->sender_link, max_messagesize) != 0)
+    if (result != RESULT_OK || instance->event_sender_count == 0)
     {
         LogError("link_get_peer_max_message_size failed");
         result = __FAILURE__;
@@ -1160,16 +1485,38 @@ static int get_max_message_size_for_batching(TELEMETRY_MESSENGER_INSTANCE* insta
     return result;
 }
 
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_203: [The AMQP encoding of a message shall be reused from the previous attempt to send it, unless its fault injection properties have to be applied to the batch container again.]
+// Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_204: [Otherwise the message shall be encoded with message_create_uamqp_encoding_from_iothub_message and the encoding kept with the caller information until it is freed.]
+static int get_encoded_message(MESSAGE_HANDLE message_batch_container, MESSENGER_SEND_EVENT_CALLER_INFORMATION* caller_info)
+{
+    int result;
+
+    if ((caller_info->encoded_message.bytes != NULL) && !message_has_fault_injection_properties(caller_info->message->messageHandle))
+    {
+        result = RESULT_OK;
+    }
+    else
+    {
+        if (caller_info->encoded_message.bytes != NULL)
+        {
+            free((unsigned char*)caller_info->encoded_message.bytes);
+            memset(&caller_info->encoded_message, 0, sizeof(caller_info->encoded_message));
+        }
+
+        result = message_create_uamqp_encoding_from_iothub_message(message_batch_container, caller_info->message->messageHandle, &caller_info->encoded_message);
+    }
+
+    return result;
+}
+
 static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
 {
     int result = RESULT_OK;
 
     MESSENGER_SEND_EVENT_CALLER_INFORMATION* caller_info;
-    BINARY_DATA body_binary_data;
 
     SEND_PENDING_EVENTS_STATE send_pending_events_state;
     memset(&send_pending_events_state, 0, sizeof(send_pending_events_state));
-    memset(&body_binary_data, 0, sizeof(body_binary_data));
 
     uint64_t max_messagesize = 0;
 
@@ -1178,18 +1525,11 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
     // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_199: [Errors specific to a message (e.g. failure to encode) are NOT fatal but we'll keep processing.  More general errors (e.g. out of memory) will stop processing.]
     while ((caller_info = get_next_caller_message_to_send(instance)) != NULL)
     {
-        if (body_binary_data.bytes != NULL)
-        {
-            // Free here as this may have been set during previous run through loop.
-            free((unsigned char*)body_binary_data.bytes);
-        }
-        memset(&body_binary_data, 0, sizeof(body_binary_data));
-    
         if ((0 == max_messagesize) && (get_max_message_size_for_batching(instance, &max_messagesize)) != 0)
         {
             LogError("get_max_message_size_for_batching failed");
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING);
-            free(caller_info);
+            free_caller_info(caller_info);
             result = __FAILURE__;
             break;
         }
@@ -1197,32 +1537,32 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
         {
             LogError("create_send_pending_events_state failed");
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING);
-            free(caller_info);
+            free_caller_info(caller_info);
             result = __FAILURE__;
             break;
         }
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_200: [Retrieve an AMQP encoded representation of this message for later appending to main batched message.  On error, invoke callback but continue send loop; this is NOT a fatal error.]
-        else if (message_create_uamqp_encoding_from_iothub_message(send_pending_events_state.message_batch_container, caller_info->message->messageHandle, &body_binary_data) != RESULT_OK)
+        else if (get_encoded_message(send_pending_events_state.message_batch_container, caller_info) != RESULT_OK)
         {
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_201: [If message_create_uamqp_encoding_from_iothub_message fails, invoke callback with TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_CANNOT_PARSE]
             LogError("message_create_uamqp_encoding_from_iothub_message() failed.  Will continue to try to process messages, result");
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_CANNOT_PARSE);
-            free(caller_info);
+            free_caller_info(caller_info);
             continue;
         }
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_197: [If a single message is greater than our maximum AMQP send size, ignore the message.  Invoke the callback but continue send loop; this is NOT a fatal error.]
-        else if (body_binary_data.length > (int)max_messagesize)
+        else if (caller_info->encoded_message.length > (int)max_messagesize)
         {
-            LogError("a single message will encode to be %d bytes, larger than max we will send the link %lld.  Will continue to try to process messages", body_binary_data.length, max_messagesize);
+            LogError("a single message will encode to be %d bytes, larger than max we will send the link %lld.  Will continue to try to process messages", caller_info->encoded_message.length, max_messagesize);
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING);
-            free(caller_info);
+            free_caller_info(caller_info);
             continue;
         }
         else if (singlylinkedlist_add(send_pending_events_state.task->callback_list, (void*)caller_info) == NULL)
         {
             LogError("singlylinkedlist_add failed");
             invoke_callback_on_error(caller_info, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_ERROR_FAIL_SENDING);
-            free(caller_info);
+            free_caller_info(caller_info);
             result = __FAILURE__;
             break;
         }
@@ -1232,7 +1572,7 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
         // Similarly, responsibility for freeing this memory falls on the 'task' cleanup also.
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_193: [If (length of current user AMQP message) + (length of user messages pending for this batched message) + (1KB reserve buffer) > maximum link send, send pending messages and create new batched message.]
-        if (body_binary_data.length + send_pending_events_state.bytes_pending > max_messagesize)
+        if (caller_info->encoded_message.length + send_pending_events_state.bytes_pending > max_messagesize)
         {
             // If we tried to add the current message, we would overflow.  Send what we've queued immediately.
             if (send_batched_message_and_reset_state(instance, &send_pending_events_state) != RESULT_OK)
@@ -1252,14 +1592,15 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
         }
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_195: [Append the current message's encoded data to the batched message tracked by uAMQP layer.]
-        if (message_add_body_amqp_data(send_pending_events_state.message_batch_container, body_binary_data) != 0)
+        // uAMQP copies the data section, so the encoding stays with caller_info for a retry.
+        if (message_add_body_amqp_data(send_pending_events_state.message_batch_container, caller_info->encoded_message) != 0)
         {
             LogError("message_add_body_amqp_data failed");
             result = __FAILURE__;
             break;
         }
 
-        send_pending_events_state.bytes_pending += body_binary_data.length;
+        send_pending_events_state.bytes_pending += caller_info->encoded_message.length;
     }
 
     if ((result == 0) && (send_pending_events_state.bytes_pending != 0))
@@ -1271,11 +1612,6 @@ static int send_pending_events(TELEMETRY_MESSENGER_INSTANCE* instance)
         }
     }
 
-    if (body_binary_data.bytes != NULL)
-    {
-        free((unsigned char*)body_binary_data.bytes);
-    }
-
     // A non-NULL task indicates error, since otherwise send_batched_message_and_reset_state would've sent off messages and reset send_pending_events_state
     if (send_pending_events_state.task != NULL)
     {
@@ -1377,6 +1713,10 @@ static void* telemetry_messenger_clone_option(const char* name, const void* valu
     else
     {
         if (strcmp(TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS, name) == 0 ||
+            strcmp(TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, name) == 0 ||
+            strcmp(TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, name) == 0 ||
+            strcmp(TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, name) == 0 ||
+            strcmp(TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, name) == 0 ||
             strcmp(TELEMETRY_MESSENGER_OPTION_SAVED_OPTIONS, name) == 0)
         {
             result = (void*)value;
@@ -1541,6 +1881,8 @@ int telemetry_messenger_send_message_disposition(TELEMETRY_MESSENGER_HANDLE mess
                 }
                 else
                 {
+                    messenger->c2d_settled_count++;
+
                     // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_185: [If no failures occurr, telemetry_messenger_send_message_disposition() shall return 0]  
                     result = RESULT_OK;
                 }
@@ -1726,6 +2068,12 @@ int telemetry_messenger_stop(TELEMETRY_MESSENGER_HANDLE messenger_handle)
 
             remove_timed_out_events(instance);
 
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_212: [If `instance->event_send_in_order` is true, telemetry_messenger_stop() shall first call back the callers of the tasks already completed but held back for ordering]
+            if (instance->event_send_in_order)
+            {
+                release_completed_events(instance, false);
+            }
+
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_162: [telemetry_messenger_stop() shall move all items from `instance->in_progress_list` to the beginning of `instance->wait_to_send_list`]
             if (move_events_to_wait_to_send_list(instance) != RESULT_OK)
             {
@@ -1754,11 +2102,15 @@ static void process_state_changes(TELEMETRY_MESSENGER_INSTANCE* instance)
     // Note: messagesender and messagereceiver are still not created or already destroyed 
     //       when state is TELEMETRY_MESSENGER_STATE_STOPPED, so no checking is needed there.
 
+    // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_211: [With more than one sender link, the messenger state shall follow the least ready of them]
+    EVENT_SENDER_LINK* sender = get_least_ready_event_sender(instance);
+    MESSAGE_SENDER_STATE sender_state = (sender == NULL ? MESSAGE_SENDER_STATE_IDLE : sender->current_state);
+
     if (instance->state == TELEMETRY_MESSENGER_STATE_STARTED)
     {
-        if (instance->message_sender_current_state != MESSAGE_SENDER_STATE_OPEN)
+        if (sender_state != MESSAGE_SENDER_STATE_OPEN)
         {
-            LogError("messagesender reported unexpected state %d while messenger was started", instance->message_sender_current_state);
+            LogError("messagesender reported unexpected state %d while messenger was started", sender_state);
             update_messenger_state(instance, TELEMETRY_MESSENGER_STATE_ERROR);
         }
         else if (instance->message_receiver != NULL && instance->message_receiver_current_state != MESSAGE_RECEIVER_STATE_OPEN)
@@ -1789,14 +2141,14 @@ static void process_state_changes(TELEMETRY_MESSENGER_INSTANCE* instance)
     {
         if (instance->state == TELEMETRY_MESSENGER_STATE_STARTING)
         {
-            if (instance->message_sender_current_state == MESSAGE_SENDER_STATE_OPEN)
+            if (sender_state == MESSAGE_SENDER_STATE_OPEN)
             {
                 update_messenger_state(instance, TELEMETRY_MESSENGER_STATE_STARTED);
             }
-            else if (instance->message_sender_current_state == MESSAGE_SENDER_STATE_OPENING)
+            else if (sender_state == MESSAGE_SENDER_STATE_OPENING)
             {
                 int is_timed_out;
-                if (is_timeout_reached(instance->last_message_sender_state_change_time, MAX_MESSAGE_SENDER_STATE_CHANGE_TIMEOUT_SECS, &is_timed_out) != RESULT_OK)
+                if (is_timeout_reached(sender->last_state_change_time, MAX_MESSAGE_SENDER_STATE_CHANGE_TIMEOUT_SECS, &is_timed_out) != RESULT_OK)
                 {
                     LogError("messenger failed to start (failed to verify messagesender start timeout)");
                     update_messenger_state(instance, TELEMETRY_MESSENGER_STATE_ERROR);
@@ -1809,11 +2161,11 @@ static void process_state_changes(TELEMETRY_MESSENGER_INSTANCE* instance)
             }
             // For this module, the only valid scenario where messagesender state is IDLE is if 
             // the messagesender hasn't been created yet or already destroyed.
-            else if ((instance->message_sender_current_state == MESSAGE_SENDER_STATE_ERROR) ||
-                (instance->message_sender_current_state == MESSAGE_SENDER_STATE_CLOSING) ||
-                (instance->message_sender_current_state == MESSAGE_SENDER_STATE_IDLE && instance->message_sender != NULL))
+            else if ((sender_state == MESSAGE_SENDER_STATE_ERROR) ||
+                (sender_state == MESSAGE_SENDER_STATE_CLOSING) ||
+                (sender_state == MESSAGE_SENDER_STATE_IDLE && sender != NULL))
             {
-                LogError("messagesender reported unexpected state %d while messenger is starting", instance->message_sender_current_state);
+                LogError("messagesender reported unexpected state %d while messenger is starting", sender_state);
                 update_messenger_state(instance, TELEMETRY_MESSENGER_STATE_ERROR);
             }
         }
@@ -1837,7 +2189,7 @@ void telemetry_messenger_do_work(TELEMETRY_MESSENGER_HANDLE messenger_handle)
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_151: [If `instance->state` is TELEMETRY_MESSENGER_STATE_STARTING, telemetry_messenger_do_work() shall create and open `instance->message_sender`]
         if (instance->state == TELEMETRY_MESSENGER_STATE_STARTING)
         {
-            if (instance->message_sender == NULL)
+            if (instance->event_sender_count == 0)
             {
                 if (create_event_sender(instance) != RESULT_OK)
                 {
@@ -1861,6 +2213,11 @@ void telemetry_messenger_do_work(TELEMETRY_MESSENGER_HANDLE messenger_handle)
                 destroy_message_receiver(instance);
             }
 
+            if (instance->c2d_adaptive_prefetch && instance->message_receiver != NULL)
+            {
+                update_adaptive_c2d_link_credit(instance);
+            }
+
             if (process_event_send_timeouts(instance) != RESULT_OK)
             {
                 update_messenger_state(instance, TELEMETRY_MESSENGER_STATE_ERROR);
@@ -1928,7 +2285,7 @@ void telemetry_messenger_destroy(TELEMETRY_MESSENGER_HANDLE messenger_handle)
             if (caller_info != NULL)
             {
                 caller_info->on_event_send_complete_callback(caller_info->message, TELEMETRY_MESSENGER_EVENT_SEND_COMPLETE_RESULT_MESSENGER_DESTROYED, (void*)caller_info->context);
-                free(caller_info);
+                free_caller_info(caller_info);
             }
         }
 
@@ -1974,6 +2331,7 @@ TELEMETRY_MESSENGER_HANDLE telemetry_messenger_create(const TELEMETRY_MESSENGER_
     else
     {
         TELEMETRY_MESSENGER_INSTANCE* instance;
+        size_t i;
 
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_006: [telemetry_messenger_create() shall allocate memory for the messenger instance structure (aka `instance`)]
         if ((instance = (TELEMETRY_MESSENGER_INSTANCE*)malloc(sizeof(TELEMETRY_MESSENGER_INSTANCE))) == NULL)
@@ -1986,14 +2344,21 @@ TELEMETRY_MESSENGER_HANDLE telemetry_messenger_create(const TELEMETRY_MESSENGER_
         {
             memset(instance, 0, sizeof(TELEMETRY_MESSENGER_INSTANCE));
             instance->state = TELEMETRY_MESSENGER_STATE_STOPPED;
-            instance->message_sender_current_state = MESSAGE_SENDER_STATE_IDLE;
-            instance->message_sender_previous_state = MESSAGE_SENDER_STATE_IDLE;
             instance->message_receiver_current_state = MESSAGE_RECEIVER_STATE_IDLE;
             instance->message_receiver_previous_state = MESSAGE_RECEIVER_STATE_IDLE;
             instance->event_send_retry_limit = DEFAULT_EVENT_SEND_RETRY_LIMIT;
             instance->event_send_timeout_secs = DEFAULT_EVENT_SEND_TIMEOUT_SECS;
-            instance->last_message_sender_state_change_time = INDEFINITE_TIME;
+            instance->event_sender_link_count = DEFAULT_EVENT_SENDER_LINK_COUNT;
+            instance->event_send_in_order = false;
             instance->last_message_receiver_state_change_time = INDEFINITE_TIME;
+            instance->c2d_credit_sample_time = INDEFINITE_TIME;
+
+            for (i = 0; i < TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT; i++)
+            {
+                instance->event_senders[i].current_state = MESSAGE_SENDER_STATE_IDLE;
+                instance->event_senders[i].previous_state = MESSAGE_SENDER_STATE_IDLE;
+                instance->event_senders[i].last_state_change_time = INDEFINITE_TIME;
+            }
 
             // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_008: [telemetry_messenger_create() shall save a copy of `messenger_config->device_id` into `instance->device_id`]
             if ((instance->device_id = STRING_construct(messenger_config->device_id)) == NULL)
@@ -2071,6 +2436,57 @@ int telemetry_messenger_set_option(TELEMETRY_MESSENGER_HANDLE messenger_handle,
             instance->event_send_timeout_secs = *((size_t*)value);
             result = RESULT_OK;
         }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_213: [If name matches TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, `value` shall be saved on `instance->event_sender_link_count`, to be used the next time the sender links are created]
+        else if (strcmp(TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, name) == 0)
+        {
+            size_t link_count = *((size_t*)value);
+
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_214: [If `value` is 0 or greater than TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT, telemetry_messenger_set_option shall fail and return a non-zero value]
+            if (link_count == 0 || link_count > TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT)
+            {
+                LogError("telemetry_messenger_set_option failed (%lu is not a valid event sender link count; must be between 1 and %d)", (unsigned long)link_count, TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT);
+                result = __FAILURE__;
+            }
+            else
+            {
+                instance->event_sender_link_count = link_count;
+                result = RESULT_OK;
+            }
+        }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_215: [If name matches TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, `value` shall be saved on `instance->event_send_in_order`]
+        else if (strcmp(TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, name) == 0)
+        {
+            instance->event_send_in_order = *((bool*)value);
+
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_216: [If `instance->event_send_in_order` is set to false, the tasks held back for ordering shall be completed]
+            if (!instance->event_send_in_order)
+            {
+                release_completed_events(instance, false);
+            }
+
+            result = RESULT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_220: [If name matches TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, `value` shall be saved on `instance->c2d_prefetch_count`]
+        else if (strcmp(TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, name) == 0)
+        {
+            instance->c2d_prefetch_count = *((size_t*)value);
+
+            // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_221: [If `instance->receiver_link` exists and `value` is not 0, it shall be applied to the link using link_set_max_link_credit(), taking effect the next time the link credit is replenished]
+            if (instance->receiver_link != NULL && instance->c2d_prefetch_count > 0)
+            {
+                set_c2d_link_credit(instance, instance->c2d_prefetch_count);
+            }
+
+            result = RESULT_OK;
+        }
+        // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_222: [If name matches TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, `value` shall be saved on `instance->c2d_adaptive_prefetch`]
+        else if (strcmp(TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, name) == 0)
+        {
+            instance->c2d_adaptive_prefetch = *((bool*)value);
+            instance->c2d_settled_count = 0;
+            instance->c2d_credit_sample_time = INDEFINITE_TIME;
+            result = RESULT_OK;
+        }
         // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_169: [If name matches TELEMETRY_MESSENGER_OPTION_SAVED_OPTIONS, `value` shall be applied using OptionHandler_FeedOptions]
         else if (strcmp(TELEMETRY_MESSENGER_OPTION_SAVED_OPTIONS, name) == 0)
         {
@@ -2129,6 +2545,26 @@ OPTIONHANDLER_HANDLE telemetry_messenger_retrieve_options(TELEMETRY_MESSENGER_HA
                 LogError("Failed to retrieve options from messenger instance (OptionHandler_Create failed for option '%s')", TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS);
                 result = NULL;
             }
+            else if (OptionHandler_AddOption(options, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, (void*)&instance->event_sender_link_count) != OPTIONHANDLER_OK)
+            {
+                LogError("Failed to retrieve options from messenger instance (OptionHandler_Create failed for option '%s')", TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT);
+                result = NULL;
+            }
+            else if (OptionHandler_AddOption(options, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, (void*)&instance->event_send_in_order) != OPTIONHANDLER_OK)
+            {
+                LogError("Failed to retrieve options from messenger instance (OptionHandler_Create failed for option '%s')", TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER);
+                result = NULL;
+            }
+            else if (OptionHandler_AddOption(options, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, (void*)&instance->c2d_prefetch_count) != OPTIONHANDLER_OK)
+            {
+                LogError("Failed to retrieve options from messenger instance (OptionHandler_Create failed for option '%s')", TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT);
+                result = NULL;
+            }
+            else if (OptionHandler_AddOption(options, TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, (void*)&instance->c2d_adaptive_prefetch) != OPTIONHANDLER_OK)
+            {
+                LogError("Failed to retrieve options from messenger instance (OptionHandler_Create failed for option '%s')", TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH);
+                result = NULL;
+            }
             else
             {
                 // Codes_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_179: [If no failures occur, telemetry_messenger_retrieve_options shall return the OPTIONHANDLER_HANDLE instance]
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/gballoc.h"
@@ -21,11 +22,15 @@
 #include "azure_c_shared_utility/tlsio.h"
 #include "azure_c_shared_utility/platform.h"
 
-#include "azure_c_shared_utility/string_tokenizer.h"
 #include "azure_c_shared_utility/shared_util_options.h"
 #include "azure_c_shared_utility/urlencode.h"
 #include "iothub_client_version.h"
 #include "internal/iothub_client_retry_control.h"
+#include "internal/iothub_client_timer_queue.h"
+#include "internal/iothub_client_object_pool.h"
+#include "internal/iothub_client_packet_id_table.h"
+#include "internal/iothub_client_mqtt_topic.h"
+#include "internal/iothub_message_private.h"
 
 #include "internal/iothubtransport_mqtt_common.h"
 
@@ -44,6 +49,9 @@
 #define SAS_TOKEN_DEFAULT_LEN               10
 #define RESEND_TIMEOUT_VALUE_MIN            1*60
 #define MAX_SEND_RECOUNT_LIMIT              2
+#define INFLIGHT_INITIAL_WINDOW             4
+#define INFLIGHT_RTT_QUEUEING_FACTOR        2
+#define INFLIGHT_RTT_TOLERANCE_MS           50
 #define DEFAULT_CONNECTION_INTERVAL         30
 #define FAILED_CONN_BACKOFF_VALUE           5
 #define STATUS_CODE_FAILURE_VALUE           500
@@ -52,9 +60,6 @@
 #define DEFAULT_RETRY_POLICY                IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER
 #define DEFAULT_RETRY_TIMEOUT_IN_SECONDS    0
 
-static const char TOPIC_DEVICE_TWIN_PREFIX[] = "$iothub/twin";
-static const char TOPIC_DEVICE_METHOD_PREFIX[] = "$iothub/methods";
-
 static const char* TOPIC_GET_DESIRED_STATE = "$iothub/twin/res/#";
 static const char* TOPIC_NOTIFICATION_STATE = "$iothub/twin/PATCH/properties/desired/#";
 
@@ -65,21 +70,14 @@ static const char* TOPIC_DEVICE_METHOD_SUBSCRIBE = "$iothub/methods/POST/#";
 
 static const char* IOTHUB_API_VERSION = "2016-11-14";
 
-static const char* PROPERTY_SEPARATOR = "&";
 static const char* REPORTED_PROPERTIES_TOPIC = "$iothub/twin/PATCH/properties/reported/?$rid=%"PRIu16;
 static const char* GET_PROPERTIES_TOPIC = "$iothub/twin/GET/?$rid=%"PRIu16;
 static const char* DEVICE_METHOD_RESPONSE_TOPIC = "$iothub/methods/res/%d/?$rid=%s";
 
-static const char* REQUEST_ID_PROPERTY = "?$rid=";
-
 static const char* MESSAGE_ID_PROPERTY = "mid";
 static const char* CORRELATION_ID_PROPERTY = "cid";
 static const char* CONTENT_TYPE_PROPERTY = "ct";
 static const char* CONTENT_ENCODING_PROPERTY = "ce";
-static const char* DIAGNOSTIC_ID_PROPERTY = "diagid";
-static const char* DIAGNOSTIC_CONTEXT_PROPERTY = "diagctx";
-
-static const char* DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY = "creationtimeutc";
 
 #define UNSUBSCRIBE_FROM_TOPIC                  0x0000
 #define SUBSCRIBE_GET_REPORTED_STATE_TOPIC      0x0001
@@ -105,7 +103,6 @@ static SYSTEM_PROPERTY_INFO sysPropList[] = {
     { "%24.cid", 7 },
     { "%24.ct", 6 },
     { "%24.ce", 6 },
-    { "devices/", 8 },
     { "iothub-operation", 16 },
     { "iothub-ack", 10 }
 };
@@ -196,7 +193,25 @@ typedef struct MQTTTRANSPORT_HANDLE_DATA_TAG
 
     // Telemetry specific
     DLIST_ENTRY telemetry_waitingForAck;
+    PACKET_ID_TABLE_HANDLE telemetry_in_flight;
+    TIMER_QUEUE_HANDLE telemetry_resend_timers;
+    OBJECT_POOL_HANDLE message_details_pool;
     bool auto_url_encode_decode;
+    MQTT_TOPIC_BUFFER topic_buffer; // reused by every outbound and inbound topic
+
+    // Flow control of the telemetry messages waiting for their PUBACK
+    size_t inflight_count;
+    size_t inflight_bytes;
+    size_t max_inflight_messages; // 0 for no limit
+    size_t max_inflight_bytes; // 0 for no limit
+    bool adaptive_inflight;
+    bool inflight_window_limited;
+    size_t congestion_window;
+    size_t slow_start_threshold;
+    size_t acks_in_window;
+    bool has_ack_rtt;
+    tickcounter_ms_t min_ack_rtt;
+    tickcounter_ms_t smoothed_ack_rtt;
 
     // Controls frequency of reconnection logic.
     RETRY_CONTROL_HANDLE retry_control_handle;
@@ -231,6 +246,10 @@ typedef struct MQTT_MESSAGE_DETAILS_LIST_TAG
     IOTHUB_MESSAGE_LIST* iotHubMessageEntry;
     void* context;
     uint16_t packet_id;
+    size_t payload_length;
+    bool inflight; // counted in the in-flight window of the connection
+    TIMER_QUEUE_ENTRY resend_timer;
+    OBJECT_POOL_HANDLE pool;
     DLIST_ENTRY entry;
 } MQTT_MESSAGE_DETAILS_LIST, *PMQTT_MESSAGE_DETAILS_LIST;
 
@@ -269,6 +288,179 @@ static void set_saved_tls_options(PMQTTTRANSPORT_HANDLE_DATA transport, OPTIONHA
     transport->saved_tls_options = new_options;
 }
 
+static MQTT_MESSAGE_DETAILS_LIST* allocate_message_details(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    MQTT_MESSAGE_DETAILS_LIST* result;
+
+    if (transport_data->message_details_pool == NULL)
+    {
+        result = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+    }
+    else
+    {
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_006: [ When a message pool is set, the MQTT_MESSAGE_DETAILS_LIST records shall be acquired from it instead of the heap and given back to it once the message completes. ] */
+        result = (MQTT_MESSAGE_DETAILS_LIST*)object_pool_acquire(transport_data->message_details_pool);
+    }
+
+    if (result != NULL)
+    {
+        result->pool = transport_data->message_details_pool;
+    }
+    return result;
+}
+
+static void free_message_details(MQTT_MESSAGE_DETAILS_LIST* message_details)
+{
+    if (message_details->pool == NULL)
+    {
+        free(message_details);
+    }
+    else
+    {
+        object_pool_release(message_details->pool, message_details);
+    }
+}
+
+static size_t get_inflight_window(const MQTTTRANSPORT_HANDLE_DATA* transport_data)
+{
+    size_t result = transport_data->max_inflight_messages;
+    if (transport_data->adaptive_inflight && ((result == 0) || (transport_data->congestion_window < result)))
+    {
+        result = transport_data->congestion_window;
+    }
+    return result;
+}
+
+static bool is_inflight_window_open(const MQTTTRANSPORT_HANDLE_DATA* transport_data, size_t payload_length)
+{
+    bool result;
+    size_t window = get_inflight_window(transport_data);
+
+    if (transport_data->inflight_count == 0)
+    {
+        // a single message always goes, so one larger than the byte limit cannot stall the queue
+        result = true;
+    }
+    else if ((window != 0) && (transport_data->inflight_count >= window))
+    {
+        result = false;
+    }
+    else if ((transport_data->max_inflight_bytes != 0) &&
+        ((transport_data->inflight_bytes >= transport_data->max_inflight_bytes) || (payload_length > transport_data->max_inflight_bytes - transport_data->inflight_bytes)))
+    {
+        result = false;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+static void track_inflight_message(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* message_details)
+{
+    if (!message_details->inflight)
+    {
+        message_details->inflight = true;
+        transport_data->inflight_count++;
+        transport_data->inflight_bytes += message_details->payload_length;
+    }
+}
+
+static void untrack_inflight_message(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* message_details)
+{
+    if (message_details->inflight)
+    {
+        message_details->inflight = false;
+        transport_data->inflight_count--;
+        transport_data->inflight_bytes -= message_details->payload_length;
+    }
+}
+
+static void release_inflight_window(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    // the messages still waiting for a PUBACK died with the connection, they count again once resent
+    PDLIST_ENTRY current_entry = transport_data->telemetry_waitingForAck.Flink;
+    while (current_entry != &transport_data->telemetry_waitingForAck)
+    {
+        MQTT_MESSAGE_DETAILS_LIST* message_details = containingRecord(current_entry, MQTT_MESSAGE_DETAILS_LIST, entry);
+        message_details->inflight = false;
+        current_entry = current_entry->Flink;
+    }
+    transport_data->inflight_count = 0;
+    transport_data->inflight_bytes = 0;
+}
+
+static void shrink_inflight_window(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    transport_data->congestion_window = (transport_data->congestion_window > 1) ? (transport_data->congestion_window / 2) : 1;
+    transport_data->slow_start_threshold = transport_data->congestion_window;
+    transport_data->acks_in_window = 0;
+}
+
+static void grow_inflight_window(PMQTTTRANSPORT_HANDLE_DATA transport_data)
+{
+    // the window only grows while it is what holds messages back
+    if (transport_data->inflight_window_limited &&
+        ((transport_data->max_inflight_messages == 0) || (transport_data->congestion_window < transport_data->max_inflight_messages)))
+    {
+        transport_data->congestion_window++;
+    }
+}
+
+static void on_inflight_message_acked(PMQTTTRANSPORT_HANDLE_DATA transport_data, const MQTT_MESSAGE_DETAILS_LIST* message_details)
+{
+    tickcounter_ms_t current_ms;
+    bool queueing = false;
+
+    // only a message published once tells how long an ack takes
+    if ((message_details->retryCount == 1) && (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) == 0))
+    {
+        tickcounter_ms_t rtt = current_ms - message_details->msgPublishTime;
+        if (!transport_data->has_ack_rtt)
+        {
+            transport_data->min_ack_rtt = rtt;
+            transport_data->smoothed_ack_rtt = rtt;
+            transport_data->has_ack_rtt = true;
+        }
+        else
+        {
+            if (rtt < transport_data->min_ack_rtt)
+            {
+                transport_data->min_ack_rtt = rtt;
+            }
+            transport_data->smoothed_ack_rtt = ((7 * transport_data->smoothed_ack_rtt) + rtt) / 8;
+        }
+        queueing = (transport_data->smoothed_ack_rtt > (INFLIGHT_RTT_QUEUEING_FACTOR * transport_data->min_ack_rtt) + INFLIGHT_RTT_TOLERANCE_MS);
+    }
+
+    if (transport_data->congestion_window < transport_data->slow_start_threshold)
+    {
+        // slow start, one more message per ack until the first sign of congestion
+        if (queueing)
+        {
+            shrink_inflight_window(transport_data);
+        }
+        else
+        {
+            grow_inflight_window(transport_data);
+        }
+    }
+    else if (++transport_data->acks_in_window >= transport_data->congestion_window)
+    {
+        // congestion avoidance, one more message per window of acks
+        transport_data->acks_in_window = 0;
+        if (queueing)
+        {
+            shrink_inflight_window(transport_data);
+        }
+        else
+        {
+            grow_inflight_window(transport_data);
+        }
+    }
+}
+
 static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data)
 {
     if (transport_data->mqttClient != NULL)
@@ -284,7 +476,11 @@ static void free_transport_handle_data(MQTTTRANSPORT_HANDLE_DATA* transport_data
     set_saved_tls_options(transport_data, NULL);
 
     tickcounter_destroy(transport_data->msgTickCounter);
-    
+    timer_queue_destroy(transport_data->telemetry_resend_timers);
+    packet_id_table_destroy(transport_data->telemetry_in_flight);
+    mqtt_topic_buffer_deinit(&transport_data->topic_buffer);
+    object_pool_destroy(transport_data->message_details_pool);
+
     free_proxy_data(transport_data);
 
     STRING_delete(transport_data->devicesPath);
@@ -372,205 +568,6 @@ static const char* retrieve_mqtt_return_codes(CONNECT_RETURN_CODE rtn_code)
     }
 }
 
-static int retrieve_device_method_rid_info(const char* resp_topic, STRING_HANDLE method_name, STRING_HANDLE request_id)
-{
-    int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
-    {
-        LogError("Failed creating token from device twin topic.");
-        result = __FAILURE__;
-    }
-    else
-    {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = __FAILURE__;
-        }
-        else
-        {
-            size_t token_index = 0;
-            size_t request_id_length = strlen(REQUEST_ID_PROPERTY);
-            result = __FAILURE__;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_index == 3)
-                {
-                    if (STRING_concat_with_STRING(method_name, token_value) != 0)
-                    {
-                        LogError("Failed STRING_concat_with_STRING.");
-                        result = __FAILURE__;
-                        break;
-                    }
-                }
-                else if (token_index == 4)
-                {
-                    if (STRING_length(token_value) >= request_id_length)
-                    {
-                        const char* request_id_value = STRING_c_str(token_value);
-                        if (memcmp(request_id_value, REQUEST_ID_PROPERTY, request_id_length) == 0)
-                        {
-                            if (STRING_concat(request_id, request_id_value+request_id_length) != 0)
-                            {
-                                LogError("Failed STRING_concat failed.");
-                                result = __FAILURE__;
-                            }
-                            else
-                            {
-                                result = 0;
-                            }
-                            break;
-                        }
-                    }
-                }
-                token_index++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
-    }
-    return result;
-}
-
-static int parse_device_twin_topic_info(const char* resp_topic, bool* patch_msg, size_t* request_id, int* status_code)
-{
-    int result;
-    STRING_TOKENIZER_HANDLE token_handle = STRING_TOKENIZER_create_from_char(resp_topic);
-    if (token_handle == NULL)
-    {
-        LogError("Failed creating token from device twin topic.");
-        result = __FAILURE__;
-        *status_code = 0;
-        *request_id = 0;
-        *patch_msg = false;
-    }
-    else
-    {
-        STRING_HANDLE token_value;
-        if ((token_value = STRING_new()) == NULL)
-        {
-            LogError("Failed allocating new string .");
-            result = __FAILURE__;
-            *status_code = 0;
-            *request_id = 0;
-            *patch_msg = false;
-        }
-        else
-        {
-            result = __FAILURE__;
-            size_t token_count = 0;
-            while (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/") == 0)
-            {
-                if (token_count == 2)
-                {
-                    if (strcmp(STRING_c_str(token_value), "PATCH") == 0)
-                    {
-                        *patch_msg = true;
-                        *status_code = 0;
-                        *request_id = 0;
-                        result = 0;
-                        break;
-                    }
-                    else
-                    {
-                        *patch_msg = false;
-                    }
-                }
-                else if (token_count == 3)
-                {
-                    *status_code = (int)atol(STRING_c_str(token_value));
-                    if (STRING_TOKENIZER_get_next_token(token_handle, token_value, "/?$rid=") == 0)
-                    {
-                        *request_id = (size_t)atol(STRING_c_str(token_value));
-                    }
-                    *patch_msg = false;
-                    result = 0;
-                    break;
-                }
-                token_count++;
-            }
-            STRING_delete(token_value);
-        }
-        STRING_TOKENIZER_destroy(token_handle);
-    }
-    return result;
-}
-
-static IOTHUB_IDENTITY_TYPE retrieve_topic_type(const char* topic_resp)
-{
-    IOTHUB_IDENTITY_TYPE type;
-    size_t dev_twin_topic_len = sizeof(TOPIC_DEVICE_TWIN_PREFIX)-1;
-    size_t dev_method_topic_len = sizeof(TOPIC_DEVICE_METHOD_PREFIX)-1;
-    size_t topic_len = strlen(topic_resp);
-    size_t len_to_use = (dev_twin_topic_len > dev_method_topic_len) ? dev_twin_topic_len : dev_method_topic_len;
-
-    bool search_device_twin = true;
-    bool search_device_method = true;
-    if (topic_len < len_to_use)
-    {
-        search_device_twin = false;
-        search_device_method = false;
-    }
-    else
-    {
-        size_t index = 0;
-        for (index = 0; index < len_to_use && (search_device_twin || search_device_method); index++)
-        {
-            if (search_device_twin)
-            {
-                if (index > dev_twin_topic_len)
-                {
-                    search_device_twin = false;
-                }
-                else
-                {
-                    if (index == dev_twin_topic_len)
-                    {
-                        break;
-                    }
-                    else if (TOUPPER(TOPIC_DEVICE_TWIN_PREFIX[index]) != TOUPPER(topic_resp[index]))
-                    {
-                        search_device_twin = false;
-                    }
-                }
-            }
-            if (search_device_method)
-            {
-                if (index > dev_method_topic_len)
-                {
-                    search_device_method = false;
-                }
-                else
-                {
-                    if (index == dev_method_topic_len)
-                    {
-                        break;
-                    }
-                    else if (TOUPPER(TOPIC_DEVICE_METHOD_PREFIX[index]) != TOUPPER(topic_resp[index]))
-                    {
-                        search_device_method = false;
-                    }
-                }
-            }
-        }
-    }
-    if (search_device_twin)
-    {
-        type = IOTHUB_TYPE_DEVICE_TWIN;
-    }
-    else if (search_device_method)
-    {
-        type = IOTHUB_TYPE_DEVICE_METHODS;
-    }
-    else
-    {
-        type = IOTHUB_TYPE_TELEMETRY;
-    }
-    return type;
-}
-
 static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_CLIENT_CONFIRMATION_RESULT confirmResult)
 {
     DLIST_ENTRY messageCompleted;
@@ -579,239 +576,11 @@ static void sendMsgComplete(IOTHUB_MESSAGE_LIST* iothubMsgList, PMQTTTRANSPORT_H
     IoTHubClientCore_LL_SendComplete(transport_data->llClientHandle, &messageCompleted, confirmResult);
 }
 
-static int addUserPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
-{
-    int result = 0;
-    const char* const* propertyKeys;
-    const char* const* propertyValues;
-    size_t propertyCount;
-    size_t index = *index_ptr;
-    MAP_HANDLE properties_map = IoTHubMessage_Properties(iothub_message_handle);
-    if (properties_map != NULL)
-    {
-        if (Map_GetInternals(properties_map, &propertyKeys, &propertyValues, &propertyCount) != MAP_OK)
-        {
-            LogError("Failed to get the internals of the property map.");
-            result = __FAILURE__;
-        }
-        else
-        {
-            if (propertyCount != 0)
-            {
-                for (index = 0; index < propertyCount && result == 0; index++)
-                {
-                    if (urlencode)
-                    {
-                        STRING_HANDLE property_key = URL_EncodeString(propertyKeys[index]);
-                        STRING_HANDLE property_value = URL_EncodeString(propertyValues[index]);
-                        if ((property_key == NULL) || (property_value == NULL))
-                        {
-                            LogError("Failed URL Encoding properties");
-                            result = __FAILURE__;
-                        }
-                        else if (STRING_sprintf(topic_string, "%s=%s%s", STRING_c_str(property_key), STRING_c_str(property_value), propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
-                        {
-                            LogError("Failed constructing property string.");
-                            result = __FAILURE__;
-                        }
-                        STRING_delete(property_key);
-                        STRING_delete(property_value);
-                    }
-                    else
-                    {
-                        if (STRING_sprintf(topic_string, "%s=%s%s", propertyKeys[index], propertyValues[index], propertyCount - 1 == index ? "" : PROPERTY_SEPARATOR) != 0)
-                        {
-                            LogError("Failed constructing property string.");
-                            result = __FAILURE__;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    *index_ptr = index;
-    return result;
-}
-
-static int addSystemPropertyToTopicString(STRING_HANDLE topic_string, size_t index, const char* property_key, const char* property_value, bool urlencode)
-{
-    int result = 0;
-
-    if (urlencode)
-    {
-        STRING_HANDLE encoded_property_value = URL_EncodeString(property_value);
-        if (encoded_property_value == NULL)
-        {
-            LogError("Failed URL encoding %s.", property_key);
-            result = __FAILURE__;
-        }
-        else if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, STRING_c_str(encoded_property_value)) != 0)
-        {
-            LogError("Failed setting %s.", property_key);
-            result = __FAILURE__;
-        }
-        STRING_delete(encoded_property_value);
-    }
-    else
-    {
-        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, property_key, property_value) != 0)
-        {
-            LogError("Failed setting %s.", property_key);
-            result = __FAILURE__;
-        }
-    }
-    return result;
-}
-
-static int addSystemPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr, bool urlencode)
-{
-    (void)urlencode;
-    int result = 0;
-    size_t index = *index_ptr;
-
-    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_052: [ IoTHubTransport_MQTT_Common_DoWork shall check for the CorrelationId property and if found add the value as a system property in the format of $.cid=<id> ] */
-    const char* correlation_id = IoTHubMessage_GetCorrelationId(iothub_message_handle);
-    if (correlation_id != NULL)
-    {
-        result = addSystemPropertyToTopicString(topic_string, index, CORRELATION_ID_PROPERTY, correlation_id, urlencode);
-        index++;
-    }
-    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_053: [ IoTHubTransport_MQTT_Common_DoWork shall check for the MessageId property and if found add the value as a system property in the format of $.mid=<id> ] */
-    if (result == 0)
-    {
-        const char* msg_id = IoTHubMessage_GetMessageId(iothub_message_handle);
-        if (msg_id != NULL)
-        {
-            result = addSystemPropertyToTopicString(topic_string, index, MESSAGE_ID_PROPERTY, msg_id, urlencode);
-            index++;
-        }
-    }
-    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_010: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the ContentType property and if found add the `value` as a system property in the format of `$.ct=<value>` ]
-    if (result == 0)
-    {
-        const char* content_type = IoTHubMessage_GetContentTypeSystemProperty(iothub_message_handle);
-        if (content_type != NULL)
-        {
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_TYPE_PROPERTY, content_type, urlencode);
-            index++;
-        }
-    }
-    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_011: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the ContentEncoding property and if found add the `value` as a system property in the format of `$.ce=<value>` ]
-    if (result == 0)
-    {
-        const char* content_encoding = IoTHubMessage_GetContentEncodingSystemProperty(iothub_message_handle);
-        if (content_encoding != NULL)
-        {
-            result = addSystemPropertyToTopicString(topic_string, index, CONTENT_ENCODING_PROPERTY, content_encoding, urlencode);
-            index++;
-        }
-    }
-    *index_ptr = index;
-    return result;
-}
-
-static int addDiagnosticPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, STRING_HANDLE topic_string, size_t* index_ptr)
-{
-    int result = 0;
-    size_t index = *index_ptr;
-
-    // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_014: [ `IoTHubTransport_MQTT_Common_DoWork` shall check for the diagnostic properties including diagid and diagCreationTimeUtc and if found both add them as system property in the format of `$.diagid` and `$.diagctx` respectively]
-    const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* diagnosticData = IoTHubMessage_GetDiagnosticPropertyData(iothub_message_handle);
-    if (diagnosticData != NULL)
-    {
-        const char* diag_id = diagnosticData->diagnosticId;
-        const char* creation_time_utc = diagnosticData->diagnosticCreationTimeUtc;
-        //diagid and creationtimeutc must be present/unpresent simultaneously
-        if (diag_id != NULL && creation_time_utc != NULL)
-        {
-            if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_ID_PROPERTY, diag_id) != 0)
-            {
-                LogError("Failed setting diagnostic id");
-                result = __FAILURE__;
-            }
-            index++;
-
-            if (result == 0)
-            {
-                //construct diagnostic context, it should be urlencode(key1=value1,key2=value2)
-                STRING_HANDLE diagContextHandle = STRING_construct_sprintf("%s=%s", DIAGNOSTIC_CONTEXT_CREATION_TIME_UTC_PROPERTY, creation_time_utc);
-                if (diagContextHandle == NULL)
-                {
-                    LogError("Failed constructing diagnostic context");
-                    result = __FAILURE__;
-                }
-                else
-                {
-                    //Add other diagnostic context properties here if have more
-                    STRING_HANDLE encodedContextValueHandle = URL_Encode(diagContextHandle);
-                    const char* encodedContextValueString = NULL;
-                    if (encodedContextValueHandle != NULL &&
-                        (encodedContextValueString = STRING_c_str(encodedContextValueHandle)) != NULL)
-                    {
-                        if (STRING_sprintf(topic_string, "%s%%24.%s=%s", index == 0 ? "" : PROPERTY_SEPARATOR, DIAGNOSTIC_CONTEXT_PROPERTY, encodedContextValueString) != 0)
-                        {
-                            LogError("Failed setting diagnostic context");
-                            result = __FAILURE__;
-                        }
-                        STRING_delete(encodedContextValueHandle);
-                        encodedContextValueHandle = NULL;
-                    }
-                    else
-                    {
-                        LogError("Failed encoding diagnostic context value");
-                        result = __FAILURE__;
-                    }
-                    STRING_delete(diagContextHandle);
-                    diagContextHandle = NULL;
-                    index++;
-                }
-            }
-        }
-        else if (diag_id != NULL || creation_time_utc != NULL)
-        {
-            // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_015: [ `IoTHubTransport_MQTT_Common_DoWork` shall check whether diagid and diagCreationTimeUtc be present simultaneously, treat as error if not]
-            LogError("diagid and diagcreationtimeutc must be present simultaneously.");
-            result = __FAILURE__;
-        }
-    }
-    return result;
-}
-
-
-static STRING_HANDLE addPropertiesTouMqttMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, const char* eventTopic, bool urlencode)
-{
-    size_t index = 0;
-    STRING_HANDLE result = STRING_construct(eventTopic);
-    if (result == NULL)
-    {
-        LogError("Failed to create event topic string handle");
-    }
-    else if (addUserPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
-    {
-        LogError("Failed adding Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
-    }
-    else if (addSystemPropertiesTouMqttMessage(iothub_message_handle, result, &index, urlencode) != 0)
-    {
-        LogError("Failed adding System Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
-    }
-    else if (addDiagnosticPropertiesTouMqttMessage(iothub_message_handle, result, &index) != 0)
-    {
-        LogError("Failed adding Diagnostic Properties to uMQTT Message");
-        STRING_delete(result);
-        result = NULL;
-    }
-
-    return result;
-}
-
 static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data, MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry, const unsigned char* payload, size_t len)
 {
     int result;
-    STRING_HANDLE msgTopic = addPropertiesTouMqttMessage(mqttMsgEntry->iotHubMessageEntry->messageHandle, STRING_c_str(transport_data->topic_MqttEvent), transport_data->auto_url_encode_decode);
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_015: [ IoTHubTransport_MQTT_Common_DoWork shall write the event topic and the message properties with mqtt_topic_encode_event into the topic buffer of the transport, reused from one publish to the next. ] */
+    const char* msgTopic = mqtt_topic_encode_event(&transport_data->topic_buffer, STRING_c_str(transport_data->topic_MqttEvent), mqttMsgEntry->iotHubMessageEntry->messageHandle, transport_data->auto_url_encode_decode);
     if (msgTopic == NULL)
     {
         LogError("Failed adding properties to mqtt message");
@@ -819,7 +588,7 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
     }
     else
     {
-        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->packet_id, STRING_c_str(msgTopic), DELIVER_AT_LEAST_ONCE, payload, len);
+        MQTT_MESSAGE_HANDLE mqttMsg = mqttmessage_create(mqttMsgEntry->packet_id, msgTopic, DELIVER_AT_LEAST_ONCE, payload, len);
         if (mqttMsg == NULL)
         {
             LogError("Failed creating mqtt message");
@@ -832,11 +601,18 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
                 LogError("Failed retrieving tickcounter info");
                 result = __FAILURE__;
             }
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_001: [ Before publishing a telemetry message the transport shall arm its resend timer to expire once the message has waited longer than RESEND_TIMEOUT_VALUE_MIN seconds. ]*/
+            else if (timer_queue_add(transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer, mqttMsgEntry->msgPublishTime + ((RESEND_TIMEOUT_VALUE_MIN + 1) * 1000)) != 0)
+            {
+                LogError("Failed arming the resend timer of the mqtt message");
+                result = __FAILURE__;
+            }
             else
             {
                 if (mqtt_client_publish(transport_data->mqttClient, mqttMsg) != 0)
                 {
                     LogError("Failed attempting to publish mqtt message");
+                    timer_queue_remove(transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer);
                     result = __FAILURE__;
                 }
                 else
@@ -847,7 +623,6 @@ static int publish_mqtt_telemetry_msg(PMQTTTRANSPORT_HANDLE_DATA transport_data,
             }
             mqttmessage_destroy(mqttMsg);
         }
-        STRING_delete(msgTopic);
     }
     return result;
 }
@@ -998,7 +773,7 @@ static bool isSystemProperty(const char* tokenData)
     size_t index = 0;
     for (index = 0; index < propCount; index++)
     {
-        if (memcmp(tokenData, sysPropList[index].propName, sysPropList[index].propLength) == 0)
+        if (strncmp(tokenData, sysPropList[index].propName, sysPropList[index].propLength) == 0)
         {
             result = true;
             break;
@@ -1057,178 +832,95 @@ static int setMqttMessagePropertyIfPossible(IOTHUB_MESSAGE_HANDLE IoTHubMessage,
     return result;
 }
 
-static int extractMqttProperties(IOTHUB_MESSAGE_HANDLE IoTHubMessage, const char* topic_name, bool urldecode)
+static bool needs_url_decode(const char* text)
 {
-    int result;
-    STRING_HANDLE mqttTopic = STRING_construct(topic_name);
-    if (mqttTopic == NULL)
-    {
-        LogError("Failure constructing string topic name.");
-        result = __FAILURE__;
-    }
-    else
+    return (strpbrk(text, "%+") != NULL);
+}
+
+static int extractMqttProperties(PMQTTTRANSPORT_HANDLE_DATA transport_data, IOTHUB_MESSAGE_HANDLE IoTHubMessage, MQTT_TOPIC_VIEW* properties)
+{
+    int result = 0;
+    MQTT_TOPIC_VIEW name;
+    MQTT_TOPIC_VIEW value;
+    bool urldecode = transport_data->auto_url_encode_decode;
+
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_017: [ mqtt_notification_callback shall walk the property bag of a telemetry topic with mqtt_topic_get_next_property and copy each name and value into the topic buffer of the transport, without allocating. ] */
+    while (result == 0 && mqtt_topic_get_next_property(properties, &name, &value))
     {
-        STRING_TOKENIZER_HANDLE token = STRING_TOKENIZER_create(mqttTopic);
-        if (token != NULL)
+        char* property = mqtt_topic_buffer_reserve(&transport_data->topic_buffer, name.length + value.length + 2);
+        if (property == NULL)
+        {
+            LogError("Failed reserving room for the property");
+            result = __FAILURE__;
+        }
+        else
         {
-            MAP_HANDLE propertyMap = IoTHubMessage_Properties(IoTHubMessage);
-            if (propertyMap == NULL)
+            const char* propName = property;
+            const char* propValue = property + name.length + 1;
+            bool systemProperty;
+            STRING_HANDLE propName_decoded = NULL;
+            STRING_HANDLE propValue_decoded = NULL;
+
+            (void)memcpy(property, name.start, name.length);
+            property[name.length] = '\0';
+            (void)memcpy(property + name.length + 1, value.start, value.length);
+            property[name.length + 1 + value.length] = '\0';
+            systemProperty = isSystemProperty(propName);
+
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_018: [ When auto URL decoding is on, only the names and values containing '%' or '+' shall go through URL_DecodeString, the names of system properties never do. ] */
+            if (urldecode && !systemProperty && needs_url_decode(propName))
             {
-                LogError("Failure to retrieve IoTHubMessage_properties.");
-                result = __FAILURE__;
+                if ((propName_decoded = URL_DecodeString(propName)) == NULL)
+                {
+                    LogError("Failed to URL decode property name");
+                    result = __FAILURE__;
+                }
+                else
+                {
+                    propName = STRING_c_str(propName_decoded);
+                }
             }
-            else
+            if (result == 0 && urldecode && needs_url_decode(propValue))
             {
-                STRING_HANDLE output = STRING_new();
-                if (output == NULL)
+                if ((propValue_decoded = URL_DecodeString(propValue)) == NULL)
                 {
-                    LogError("Failure to allocate STRING_new.");
+                    LogError("Failed to URL decode property value");
                     result = __FAILURE__;
                 }
                 else
                 {
-                    result = 0;
+                    propValue = STRING_c_str(propValue_decoded);
+                }
+            }
 
-                    while (STRING_TOKENIZER_get_next_token(token, output, PROPERTY_SEPARATOR) == 0 && result == 0)
-                    {
-                        const char* tokenData = STRING_c_str(output);
-                        size_t tokenLen = strlen(tokenData);
-                        if (tokenData == NULL || tokenLen == 0)
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            if (isSystemProperty(tokenData))
-                            {
-                                const char* iterator = tokenData;
-                                while (iterator != NULL && *iterator != '\0' && result == 0)
-                                {
-                                    if (*iterator == '=')
-                                    {
-                                        size_t nameLen = iterator - tokenData;
-                                        char* propName = malloc(nameLen + 1);
-
-                                        size_t valLen = tokenLen - (nameLen + 1) + 1;
-                                        char* propValue = malloc(valLen + 1);
-
-                                        if (propName == NULL || propValue == NULL)
-                                        {
-                                            LogError("Failed allocating property name (%p) and/or value (%p)", propName, propValue);
-                                            result = __FAILURE__;
-                                        }
-                                        else
-                                        {
-                                            strncpy(propName, tokenData, nameLen);
-                                            propName[nameLen] = '\0';
-
-                                            strncpy(propValue, iterator + 1, valLen);
-                                            propValue[valLen] = '\0';
-
-                                            if (urldecode)
-                                            {
-                                                STRING_HANDLE propValue_decoded;
-                                                if ((propValue_decoded = URL_DecodeString(propValue)) == NULL)
-                                                {
-                                                    LogError("Failed to URL decode property value");
-                                                    result = __FAILURE__;
-                                                }
-                                                else if (setMqttMessagePropertyIfPossible(IoTHubMessage, propName, STRING_c_str(propValue_decoded), nameLen) != 0)
-                                                {
-                                                    LogError("Unable to set message property");
-                                                    result = __FAILURE__;
-                                                }
-                                                STRING_delete(propValue_decoded);
-                                            }
-                                            else
-                                            {
-                                                if (setMqttMessagePropertyIfPossible(IoTHubMessage, propName, propValue, nameLen) != 0)
-                                                {
-                                                    LogError("Unable to set message property");
-                                                    result = __FAILURE__;
-                                                }
-                                            }
-                                        }
-                                        free(propName);
-                                        free(propValue);
-
-                                        break;
-                                    }
-                                    iterator++;
-                                }
-                            }
-                            else //User Properties
-                            {
-                                const char* iterator = tokenData;
-                                while (iterator != NULL && *iterator != '\0' && result == 0)
-                                {
-                                    if (*iterator == '=')
-                                    {
-                                        size_t nameLen = iterator - tokenData;
-                                        char* propName = malloc(nameLen + 1);
-
-                                        size_t valLen = tokenLen - (nameLen + 1) + 1;
-                                        char* propValue = malloc(valLen + 1);
-
-                                        if (propName == NULL || propValue == NULL)
-                                        {
-                                            result = __FAILURE__;
-                                        }
-                                        else
-                                        {
-                                            strncpy(propName, tokenData, nameLen);
-                                            propName[nameLen] = '\0';
-
-                                            strncpy(propValue, iterator + 1, valLen);
-                                            propValue[valLen] = '\0';
-
-                                            if (urldecode)
-                                            {
-                                                STRING_HANDLE propName_decoded = URL_DecodeString(propName);
-                                                STRING_HANDLE propValue_decoded = URL_DecodeString(propValue);
-                                                if (propName_decoded == NULL || propValue_decoded == NULL)
-                                                {
-                                                    LogError("Failed to URL decode property");
-                                                    result = __FAILURE__;
-                                                }
-                                                else if (Map_AddOrUpdate(propertyMap, STRING_c_str(propName_decoded), STRING_c_str(propValue_decoded)) != MAP_OK)
-                                                {
-                                                    LogError("Map_AddOrUpdate failed.");
-                                                    result = __FAILURE__;
-                                                }
-                                                STRING_delete(propName_decoded);
-                                                STRING_delete(propValue_decoded);
-                                            }
-                                            else
-                                            {
-                                                if (Map_AddOrUpdate(propertyMap, propName, propValue) != MAP_OK)
-                                                {
-                                                    LogError("Map_AddOrUpdate failed.");
-                                                    result = __FAILURE__;
-                                                }
-                                            }
-                                        }
-                                        free(propName);
-                                        free(propValue);
-
-                                        break;
-                                    }
-                                    iterator++;
-                                }
-                            }
-                        }
-                    }
-                    STRING_delete(output);
+            if (result != 0)
+            {
+                // already logged
+            }
+            else if (systemProperty)
+            {
+                if (setMqttMessagePropertyIfPossible(IoTHubMessage, propName, propValue, strlen(propName)) != 0)
+                {
+                    LogError("Unable to set message property");
+                    result = __FAILURE__;
                 }
             }
-            STRING_TOKENIZER_destroy(token);
-        }
-        else
-        {
-            LogError("Unable to create Tokenizer object.");
-            result = __FAILURE__;
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_025: [ Application properties shall be added with IoTHubMessage_SetProperty, so they stay in the message's property store instead of a MAP_HANDLE. ] */
+            else if (IoTHubMessage_SetProperty(IoTHubMessage, propName, propValue) != IOTHUB_MESSAGE_OK)
+            {
+                LogError("IoTHubMessage_SetProperty failed.");
+                result = __FAILURE__;
+            }
+
+            if (propName_decoded != NULL)
+            {
+                STRING_delete(propName_decoded);
+            }
+            if (propValue_decoded != NULL)
+            {
+                STRING_delete(propValue_decoded);
+            }
         }
-        STRING_delete(mqttTopic);
     }
     return result;
 }
@@ -1247,100 +939,98 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
         else
         {
             PMQTTTRANSPORT_HANDLE_DATA transportData = (PMQTTTRANSPORT_HANDLE_DATA)callbackCtx;
+            MQTT_TOPIC_INFO topic_info;
 
-            IOTHUB_IDENTITY_TYPE type = retrieve_topic_type(topic_resp);
-            if (type == IOTHUB_TYPE_DEVICE_TWIN)
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_016: [ mqtt_notification_callback shall classify the topic and find its request id, status, method name or property bag with mqtt_topic_parse, and drop the message if that fails. ] */
+            if (mqtt_topic_parse(topic_resp, &topic_info) != 0)
             {
-                size_t request_id;
-                int status_code;
-                bool notification_msg;
-                if (parse_device_twin_topic_info(topic_resp, &notification_msg, &request_id, &status_code) != 0)
+                LogError("Failure: parsing topic %s", topic_resp);
+            }
+            else if (topic_info.kind == MQTT_TOPIC_KIND_TWIN_RESPONSE || topic_info.kind == MQTT_TOPIC_KIND_TWIN_PATCH)
+            {
+                size_t request_id = 0;
+                int status_code = topic_info.status_code;
+                size_t index;
+                for (index = 0; index < topic_info.request_id.length && topic_info.request_id.start[index] >= '0' && topic_info.request_id.start[index] <= '9'; index++)
                 {
-                    LogError("Failure: parsing device topic info");
+                    request_id = (request_id * 10) + (size_t)(topic_info.request_id.start[index] - '0');
+                }
+
+                const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+                if (topic_info.kind == MQTT_TOPIC_KIND_TWIN_PATCH)
+                {
+                    IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length);
                 }
                 else
                 {
-                    const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                    if (notification_msg)
-                    {
-                        IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_PARTIAL, payload->message, payload->length);
-                    }
-                    else
+                    PDLIST_ENTRY dev_twin_item = transportData->ack_waiting_queue.Flink;
+                    while (dev_twin_item != &transportData->ack_waiting_queue)
                     {
-                        PDLIST_ENTRY dev_twin_item = transportData->ack_waiting_queue.Flink;
-                        while (dev_twin_item != &transportData->ack_waiting_queue)
+                        DLIST_ENTRY saveListEntry;
+                        saveListEntry.Flink = dev_twin_item->Flink;
+                        MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(dev_twin_item, MQTT_DEVICE_TWIN_ITEM, entry);
+                        if (request_id == msg_entry->packet_id)
                         {
-                            DLIST_ENTRY saveListEntry;
-                            saveListEntry.Flink = dev_twin_item->Flink;
-                            MQTT_DEVICE_TWIN_ITEM* msg_entry = containingRecord(dev_twin_item, MQTT_DEVICE_TWIN_ITEM, entry);
-                            if (request_id == msg_entry->packet_id)
+                            (void)DList_RemoveEntryList(dev_twin_item);
+                            if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
                             {
-                                (void)DList_RemoveEntryList(dev_twin_item);
-                                if (msg_entry->device_twin_msg_type == RETRIEVE_PROPERTIES)
-                                {
-                                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
-                                    IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
-                                }
-                                else
-                                {
-                                    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
-                                    IoTHubClientCore_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, status_code);
-                                }
-                                free(msg_entry);
-                                break;
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_054: [ If type is IOTHUB_TYPE_DEVICE_TWIN, then on success if msg_type is RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_RetrievePropertyComplete... ] */
+                                IoTHubClientCore_LL_RetrievePropertyComplete(transportData->llClientHandle, DEVICE_TWIN_UPDATE_COMPLETE, payload->message, payload->length);
                             }
-                            dev_twin_item = saveListEntry.Flink;
+                            else
+                            {
+                                /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_055: [ if device_twin_msg_type is not RETRIEVE_PROPERTIES then mqtt_notification_callback shall call IoTHubClientCore_LL_ReportedStateComplete ] */
+                                IoTHubClientCore_LL_ReportedStateComplete(transportData->llClientHandle, msg_entry->iothub_msg_id, status_code);
+                            }
+                            free(msg_entry);
+                            break;
                         }
+                        dev_twin_item = saveListEntry.Flink;
                     }
                 }
             }
-            else if (type == IOTHUB_TYPE_DEVICE_METHODS)
+            else if (topic_info.kind == MQTT_TOPIC_KIND_METHOD_REQUEST)
             {
-                STRING_HANDLE method_name = STRING_new();
+                char* method_name = mqtt_topic_buffer_reserve(&transportData->topic_buffer, topic_info.method_name.length + 1);
                 if (method_name == NULL)
                 {
-                    LogError("Failure: allocating method_name string value");
+                    LogError("Failure: reserving room for the method name");
                 }
                 else
                 {
                     DEVICE_METHOD_INFO* dev_method_info = malloc(sizeof(DEVICE_METHOD_INFO) );
+
+                    (void)memcpy(method_name, topic_info.method_name.start, topic_info.method_name.length);
+                    method_name[topic_info.method_name.length] = '\0';
+
                     if (dev_method_info == NULL)
                     {
                         LogError("Failure: allocating DEVICE_METHOD_INFO object");
                     }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_019: [ The request id of a method request shall be the only string mqtt_notification_callback allocates, since it outlives the call until the response is sent. ] */
+                    else if ((dev_method_info->request_id = STRING_construct_n(topic_info.request_id.start, topic_info.request_id.length)) == NULL)
+                    {
+                        LogError("Failure constructing request_id string");
+                        free(dev_method_info);
+                    }
                     else
                     {
-                        dev_method_info->request_id = STRING_new();
-                        if (dev_method_info->request_id == NULL)
+                        /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
+                        const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
+                        if (IoTHubClientCore_LL_DeviceMethodComplete(transportData->llClientHandle, method_name, payload->message, payload->length, (void*)dev_method_info) != 0)
                         {
-                            LogError("Failure constructing request_id string");
-                            free(dev_method_info);
-                        }
-                        else if (retrieve_device_method_rid_info(topic_resp, method_name, dev_method_info->request_id) != 0)
-                        {
-                            LogError("Failure: retrieve device topic info");
+                            LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
                             STRING_delete(dev_method_info->request_id);
                             free(dev_method_info);
                         }
-                        else
-                        {
-                            /* CodesSRS_IOTHUB_MQTT_TRANSPORT_07_053: [ If type is IOTHUB_TYPE_DEVICE_METHODS, then on success mqtt_notification_callback shall call IoTHubClientCore_LL_DeviceMethodComplete. ] */
-                            const APP_PAYLOAD* payload = mqttmessage_getApplicationMsg(msgHandle);
-                            if (IoTHubClientCore_LL_DeviceMethodComplete(transportData->llClientHandle, STRING_c_str(method_name), payload->message, payload->length, (void*)dev_method_info) != 0)
-                            {
-                                LogError("Failure: IoTHubClientCore_LL_DeviceMethodComplete");
-                                STRING_delete(dev_method_info->request_id);
-                                free(dev_method_info);
-                            }
-                        }
                     }
-                    STRING_delete(method_name);
                 }
             }
             else
             {
                 const APP_PAYLOAD* appPayload = mqttmessage_getApplicationMsg(msgHandle);
-                IOTHUB_MESSAGE_HANDLE IoTHubMessage = IoTHubMessage_CreateFromByteArray(appPayload->message, appPayload->length);
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_020: [ mqtt_notification_callback shall create the message of a telemetry topic with IoTHubMessage_CreateFromBorrowedByteArray, pointing at the payload of the MQTT message, which stays valid until the callback returns. ] */
+                IOTHUB_MESSAGE_HANDLE IoTHubMessage = IoTHubMessage_CreateFromBorrowedByteArray(appPayload->message, appPayload->length);
                 if (IoTHubMessage == NULL)
                 {
                     LogError("Failure: IotHub Message creation has failed.");
@@ -1348,7 +1038,7 @@ static void mqtt_notification_callback(MQTT_MESSAGE_HANDLE msgHandle, void* call
                 else
                 {
                     // Will need to update this when the service has messages that can be rejected
-                    if (extractMqttProperties(IoTHubMessage, topic_resp, transportData->auto_url_encode_decode) != 0)
+                    if (extractMqttProperties(transportData, IoTHubMessage, &topic_info.properties) != 0)
                     {
                         LogError("failure extracting mqtt properties.");
                     }
@@ -1395,20 +1085,21 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                 const PUBLISH_ACK* puback = (const PUBLISH_ACK*)msgInfo;
                 if (puback != NULL)
                 {
-                    PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                    while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_010: [ When a PUBACK arrives, the telemetry message it acknowledges shall be found by its packet id in the in-flight table, without walking the messages waiting for acknowledgement. ]*/
+                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)packet_id_table_remove(transport_data->telemetry_in_flight, puback->packetId);
+                    if (mqttMsgEntry != NULL)
                     {
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                        DLIST_ENTRY saveListEntry;
-                        saveListEntry.Flink = currentListEntry->Flink;
-
-                        if (puback->packetId == mqttMsgEntry->packet_id)
+                        (void)DList_RemoveEntryList(&mqttMsgEntry->entry); //First remove the item from Waiting for Ack List.
+                        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_002: [ When a telemetry message is acknowledged its resend timer shall be disarmed. ]*/
+                        timer_queue_remove(transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer);
+                        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_013: [ When a telemetry message is acknowledged it shall leave the in-flight window; in adaptive mode, the time the acknowledgement took shall grow the window while it stays close to the fastest one seen on the connection, and halve it once per window otherwise. ]*/
+                        untrack_inflight_message(transport_data, mqttMsgEntry);
+                        if (transport_data->adaptive_inflight)
                         {
-                            (void)DList_RemoveEntryList(currentListEntry); //First remove the item from Waiting for Ack List.
-                            sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
-                            free(mqttMsgEntry);
+                            on_inflight_message_acked(transport_data, mqttMsgEntry);
                         }
-                        currentListEntry = saveListEntry.Flink;
+                        sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_OK);
+                        free_message_details(mqttMsgEntry);
                     }
                 }
                 else
@@ -1428,6 +1119,8 @@ static void mqtt_operation_complete_callback(MQTT_CLIENT_HANDLE handle, MQTT_CLI
                         transport_data->currPacketState = CONNACK_TYPE;
                         transport_data->isRecoverableError = true;
                         transport_data->mqttClientStatus = MQTT_CLIENT_STATUS_CONNECTED;
+                        // a new connection may take a different path, the fastest ack has to be measured again
+                        transport_data->has_ack_rtt = false;
 
                         // Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_09_008: [ Upon successful connection the retry control shall be reset using retry_control_reset() ]
                         retry_control_reset(transport_data->retry_control_handle);
@@ -1536,6 +1229,9 @@ static void DisconnectFromClient(PMQTTTRANSPORT_HANDLE_DATA transport_data)
     xio_destroy(transport_data->xioTransport);
     transport_data->xioTransport = NULL;
 
+    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_021: [ When the connection is reset, the telemetry messages still waiting for their PUBACK shall leave the in-flight window, and enter it again when they are resent. ]*/
+    release_inflight_window(transport_data);
+
     transport_data->mqttClientStatus = MQTT_CLIENT_STATUS_NOT_CONNECTED;
     transport_data->currPacketState = DISCONNECT_TYPE;
 }
@@ -2092,6 +1788,18 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                         free_transport_handle_data(state);
                         state = NULL;
                     }
+                    else if ((state->telemetry_resend_timers = timer_queue_create()) == NULL)
+                    {
+                        LogError("failure creating the telemetry resend timers.");
+                        free_transport_handle_data(state);
+                        state = NULL;
+                    }
+                    else if ((state->telemetry_in_flight = packet_id_table_create()) == NULL)
+                    {
+                        LogError("failure creating the telemetry in-flight table.");
+                        free_transport_handle_data(state);
+                        state = NULL;
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_010: [IoTHubTransport_MQTT_Common_Create shall allocate memory to save its internal state where all topics, hostname, device_id, device_key, sasTokenSr and client handle shall be saved.] */
@@ -2123,6 +1831,8 @@ static PMQTTTRANSPORT_HANDLE_DATA InitializeTransportHandleData(const IOTHUB_CLI
                         state->isProductInfoSet = false;
                         state->option_sas_token_lifetime_secs = SAS_TOKEN_DEFAULT_LIFETIME;
                         state->auto_url_encode_decode = false;
+                        state->congestion_window = INFLIGHT_INITIAL_WINDOW;
+                        state->slow_start_threshold = SIZE_MAX;
                     }
                 }
             }
@@ -2224,8 +1934,11 @@ void IoTHubTransport_MQTT_Common_Destroy(TRANSPORT_LL_HANDLE handle)
         {
             PDLIST_ENTRY currentEntry = DList_RemoveHeadList(&transport_data->telemetry_waitingForAck);
             MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
+            (void)packet_id_table_remove(transport_data->telemetry_in_flight, mqttMsgEntry->packet_id);
+            untrack_inflight_message(transport_data, mqttMsgEntry);
+            timer_queue_remove(transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer);
             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
-            free(mqttMsgEntry);
+            free_message_details(mqttMsgEntry);
         }
         while (!DList_IsListEmpty(&transport_data->ack_waiting_queue))
         {
@@ -2617,25 +2330,38 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
             }
             else if (transport_data->currPacketState == PUBLISH_TYPE)
             {
-                PDLIST_ENTRY currentListEntry = transport_data->telemetry_waitingForAck.Flink;
-                while (currentListEntry != &transport_data->telemetry_waitingForAck)
+                PDLIST_ENTRY currentListEntry;
+                tickcounter_ms_t next_deadline;
+
+                /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_003: [ IoTHubTransport_MQTT_Common_DoWork shall only look at the telemetry messages whose resend timer expired, reading the tick counter once and not at all when no timer is armed. ]*/
+                if (timer_queue_get_next_deadline(transport_data->telemetry_resend_timers, &next_deadline) == 0)
                 {
                     tickcounter_ms_t current_ms;
-                    MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(currentListEntry, MQTT_MESSAGE_DETAILS_LIST, entry);
-                    DLIST_ENTRY nextListEntry;
-                    nextListEntry.Flink = currentListEntry->Flink;
+                    TIMER_QUEUE_ENTRY* expired;
+                    bool window_shrunk = false;
 
                     (void)tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms);
                     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_033: [IoTHubTransport_MQTT_Common_DoWork shall iterate through the Waiting Acknowledge messages looking for any message that has been waiting longer than 2 min.]*/
-                    if (((current_ms - mqttMsgEntry->msgPublishTime) / 1000) > RESEND_TIMEOUT_VALUE_MIN)
+                    while ((expired = timer_queue_pop_expired(transport_data->telemetry_resend_timers, current_ms)) != NULL)
                     {
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = containingRecord(expired, MQTT_MESSAGE_DETAILS_LIST, resend_timer);
+
+                        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_014: [ In adaptive mode, telemetry messages waiting too long for their PUBACK shall halve the in-flight window, at most once per call. ]*/
+                        if (transport_data->adaptive_inflight && !window_shrunk)
+                        {
+                            shrink_inflight_window(transport_data);
+                            window_shrunk = true;
+                        }
+
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_034: [If IoTHubTransport_MQTT_Common_DoWork has resent the message two times then it shall fail the message and reconnect to IoTHub ... ] */
                         if (mqttMsgEntry->retryCount >= MAX_SEND_RECOUNT_LIMIT)
                         {
                             PDLIST_ENTRY current_entry;
-                            (void)DList_RemoveEntryList(currentListEntry);
+                            (void)packet_id_table_remove(transport_data->telemetry_in_flight, mqttMsgEntry->packet_id);
+                            (void)DList_RemoveEntryList(&mqttMsgEntry->entry);
+                            untrack_inflight_message(transport_data, mqttMsgEntry);
                             sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
-                            free(mqttMsgEntry);
+                            free_message_details(mqttMsgEntry);
 
                             transport_data->currPacketState = PACKET_TYPE_ERROR;
                             transport_data->device_twin_get_sent = false;
@@ -2650,6 +2376,9 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                                 msg_reset_entry->retryCount = 0;
                                 current_entry = current_entry->Flink;
                             }
+
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_004: [ Once disconnected, the messages still waiting for acknowledgement keep their resend timers and are resent after the transport reconnects. ]*/
+                            break;
                         }
                         else
                         {
@@ -2658,19 +2387,25 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                             if (messageLength == 0 || messagePayload == NULL)
                             {
                                 LogError("Failure from creating Message IoTHubMessage_GetData");
+                                (void)timer_queue_add(transport_data->telemetry_resend_timers, &mqttMsgEntry->resend_timer, current_ms + ((RESEND_TIMEOUT_VALUE_MIN + 1) * 1000));
                             }
                             else
                             {
                                 if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
                                 {
-                                    (void)DList_RemoveEntryList(currentListEntry);
+                                    (void)packet_id_table_remove(transport_data->telemetry_in_flight, mqttMsgEntry->packet_id);
+                                    (void)DList_RemoveEntryList(&mqttMsgEntry->entry);
+                                    untrack_inflight_message(transport_data, mqttMsgEntry);
                                     sendMsgComplete(mqttMsgEntry->iotHubMessageEntry, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                    free(mqttMsgEntry);
+                                    free_message_details(mqttMsgEntry);
+                                }
+                                else
+                                {
+                                    track_inflight_message(transport_data, mqttMsgEntry);
                                 }
                             }
                         }
                     }
-                    currentListEntry = nextListEntry.Flink;
                 }
 
                 currentListEntry = transport_data->waitingToSend->Flink;
@@ -2688,34 +2423,62 @@ void IoTHubTransport_MQTT_Common_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIEN
                     {
                         LogError("Failure result from IoTHubMessage_GetData");
                     }
+                    /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_012: [ IoTHubTransport_MQTT_Common_DoWork shall stop publishing from waitingToSend, keeping the rest of the messages in order for a later call, once the messages waiting for their PUBACK reach the in-flight window or publishing the next one would exceed "max_inflight_bytes"; a message shall always be published when none is in flight. ]*/
+                    else if (!is_inflight_window_open(transport_data, messageLength))
+                    {
+                        size_t window = get_inflight_window(transport_data);
+                        transport_data->inflight_window_limited = (window != 0) && (transport_data->inflight_count >= window);
+                        break;
+                    }
                     else
                     {
                         /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_029: [IoTHubTransport_MQTT_Common_DoWork shall create a MQTT_MESSAGE_HANDLE and pass this to a call to mqtt_client_publish.] */
-                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = (MQTT_MESSAGE_DETAILS_LIST*)malloc(sizeof(MQTT_MESSAGE_DETAILS_LIST));
+                        MQTT_MESSAGE_DETAILS_LIST* mqttMsgEntry = allocate_message_details(transport_data);
                         if (mqttMsgEntry == NULL)
                         {
                             LogError("Allocation Error: Failure allocating MQTT Message Detail List.");
+                            // publishing the messages behind this one would reorder them
+                            transport_data->inflight_window_limited = false;
+                            break;
                         }
                         else
                         {
                             mqttMsgEntry->retryCount = 0;
+                            timer_queue_entry_init(&mqttMsgEntry->resend_timer);
                             mqttMsgEntry->iotHubMessageEntry = iothubMsgList;
                             mqttMsgEntry->packet_id = get_next_packet_id(transport_data);
-                            if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            mqttMsgEntry->payload_length = messageLength;
+                            mqttMsgEntry->inflight = false;
+                            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_009: [ Before publishing a telemetry message the transport shall index it by its packet id in the in-flight table; if that fails the message, and every message queued after it, shall stay in waitingToSend until the next call. ]*/
+                            if (packet_id_table_add(transport_data->telemetry_in_flight, mqttMsgEntry->packet_id, mqttMsgEntry) != 0)
                             {
+                                LogError("Failure indexing the MQTT message by its packet id.");
+                                free_message_details(mqttMsgEntry);
+                                transport_data->inflight_window_limited = false;
+                                break;
+                            }
+                            else if (publish_mqtt_telemetry_msg(transport_data, mqttMsgEntry, messagePayload, messageLength) != 0)
+                            {
+                                (void)packet_id_table_remove(transport_data->telemetry_in_flight, mqttMsgEntry->packet_id);
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 sendMsgComplete(iothubMsgList, transport_data, IOTHUB_CLIENT_CONFIRMATION_ERROR);
-                                free(mqttMsgEntry);
+                                free_message_details(mqttMsgEntry);
                             }
                             else
                             {
                                 (void)(DList_RemoveEntryList(currentListEntry));
                                 DList_InsertTailList(&(transport_data->telemetry_waitingForAck), &(mqttMsgEntry->entry));
+                                track_inflight_message(transport_data, mqttMsgEntry);
                             }
                         }
                     }
                     currentListEntry = savedFromCurrentListEntry.Flink;
                 }
+                if (currentListEntry == transport_data->waitingToSend)
+                {
+                    // everything queued went out, the window is not what holds messages back
+                    transport_data->inflight_window_limited = false;
+                }
             }
             /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_030: [IoTHubTransport_MQTT_Common_DoWork shall call mqtt_client_dowork everytime it is called if it is connected.] */
             mqtt_client_dowork(transport_data->mqttClient);
@@ -2751,6 +2514,43 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_GetSendStatus(IOTHUB_DEVICE_HAN
     return result;
 }
 
+int IoTHubTransport_MQTT_Common_GetTimeToNextDeadline(TRANSPORT_LL_HANDLE handle, tickcounter_ms_t* msToNextDeadline)
+{
+    int result;
+
+    if (handle == NULL || msToNextDeadline == NULL)
+    {
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_022: [ If handle or msToNextDeadline is NULL, IoTHubTransport_MQTT_Common_GetTimeToNextDeadline shall fail and return a non-zero value. ]*/
+        LogError("invalid argument TRANSPORT_LL_HANDLE handle=%p, tickcounter_ms_t* msToNextDeadline=%p", handle, msToNextDeadline);
+        result = __FAILURE__;
+    }
+    else
+    {
+        MQTTTRANSPORT_HANDLE_DATA* transport_data = (MQTTTRANSPORT_HANDLE_DATA*)handle;
+        tickcounter_ms_t next_deadline;
+        tickcounter_ms_t current_ms;
+
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_023: [ If no telemetry message waits for its PUBACK, IoTHubTransport_MQTT_Common_GetTimeToNextDeadline shall return a non-zero value without reading the tick counter. ]*/
+        if (timer_queue_get_next_deadline(transport_data->telemetry_resend_timers, &next_deadline) != 0)
+        {
+            result = __FAILURE__;
+        }
+        else if (tickcounter_get_current_ms(transport_data->msgTickCounter, &current_ms) != 0)
+        {
+            LogError("unable to get the current ms");
+            result = __FAILURE__;
+        }
+        else
+        {
+            /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_024: [ Otherwise IoTHubTransport_MQTT_Common_GetTimeToNextDeadline shall set msToNextDeadline to the ms left until the earliest resend timer expires, 0 when it already has, and return 0. ]*/
+            *msToNextDeadline = (next_deadline > current_ms) ? (next_deadline - current_ms) : 0;
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
 IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_021: [If any parameter is NULL then IoTHubTransport_MQTT_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
@@ -2788,6 +2588,41 @@ IOTHUB_CLIENT_RESULT IoTHubTransport_MQTT_Common_SetOption(TRANSPORT_LL_HANDLE h
             transport_data->auto_url_encode_decode = *((bool*)value);
             result = IOTHUB_CLIENT_OK;
         }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_005: [ If the option parameter is set to "message_pool_size" then the value shall be a size_t_ptr; the transport shall replace its pool of MQTT_MESSAGE_DETAILS_LIST records by one reserving that many records, or by none when it is 0, and return IOTHUB_CLIENT_ERROR if the pool cannot be created. ] */
+        else if (strcmp(OPTION_MESSAGE_POOL_SIZE, option) == 0)
+        {
+            size_t reserved_count = *((size_t*)value);
+            OBJECT_POOL_HANDLE new_pool = NULL;
+
+            if ((reserved_count > 0) && ((new_pool = object_pool_create(sizeof(MQTT_MESSAGE_DETAILS_LIST), reserved_count)) == NULL))
+            {
+                LogError("failure creating a pool of %lu message details", (unsigned long)reserved_count);
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                /* records already waiting for their PUBACK go back to the pool they came from */
+                object_pool_destroy(transport_data->message_details_pool);
+                transport_data->message_details_pool = new_pool;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_31_011: [ If the option parameter is set to "max_inflight_messages", "max_inflight_bytes" or "adaptive_inflight" then the value shall be a size_t_ptr, a size_t_ptr and a bool_ptr respectively, and shall set the limits of the in-flight window, 0 meaning no limit. ] */
+        else if (strcmp(OPTION_MAX_INFLIGHT_MESSAGES, option) == 0)
+        {
+            transport_data->max_inflight_messages = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(OPTION_MAX_INFLIGHT_BYTES, option) == 0)
+        {
+            transport_data->max_inflight_bytes = *((size_t*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
+        else if (strcmp(OPTION_ADAPTIVE_INFLIGHT, option) == 0)
+        {
+            transport_data->adaptive_inflight = *((bool*)value);
+            result = IOTHUB_CLIENT_OK;
+        }
         /* Codes_SRS_IOTHUB_TRANSPORT_MQTT_COMMON_07_052: [ If the option parameter is set to "sas_token_lifetime" then the value shall be a size_t_ptr and the value will determine the mqtt sas token lifetime.] */
         else if (strcmp(OPTION_SAS_TOKEN_LIFETIME, option) == 0)
         {
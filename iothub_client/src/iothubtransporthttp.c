@@ -2,6 +2,8 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include "azure_c_shared_utility/gballoc.h"
 
 #include <time.h>
@@ -19,11 +21,17 @@
 #include "azure_c_shared_utility/httpapiex.h"
 #include "azure_c_shared_utility/httpapiexsas.h"
 #include "azure_c_shared_utility/strings.h"
-#include "azure_c_shared_utility/base64.h"
 #include "azure_c_shared_utility/doublylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+#include "azure_c_shared_utility/optionhandler.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
 
 #define IOTHUB_APP_PREFIX "iothub-app-"
 static const char* IOTHUB_MESSAGE_ID = "iothub-messageid";
@@ -45,8 +53,10 @@ static const char* IOTHUB_CONTENT_ENCODING_C2D = "ContentEncoding";
 #define MAXIMUM_PAYLOAD_OVERHEAD 384
 #define MAXIMUM_PROPERTY_OVERHEAD 16
 
-/*forward declaration*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count);
+/*DONT_USE_HTTP_WORKER_THREADS leaves out "http_max_concurrent_requests" and with it the only use of threads and conditions in the transport*/
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+struct HTTP_WORKER_POOL_TAG;
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
 
 typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
 {
@@ -54,9 +64,48 @@ typedef struct HTTPTRANSPORT_HANDLE_DATA_TAG
     HTTPAPIEX_HANDLE httpApiExHandle;
     bool doBatchedTransfers;
     unsigned int getMinimumPollingTime;
+    unsigned int adaptivePollingMinTime; /*0 when C2D is polled every getMinimumPollingTime, otherwise the shortest adaptive interval*/
     VECTOR_HANDLE perDeviceList;
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+    struct HTTP_WORKER_POOL_TAG* workerPool; /*NULL when all the requests are executed one by one on httpApiExHandle*/
+    OPTIONHANDLER_HANDLE httpApiExOptions; /*copies of the options handed to httpApiExHandle before there is a pool, for the connections of its workers. NULL until the first one*/
+    bool wereHttpOptionsLost; /*an option handed to httpApiExHandle could not be copied, a pool created later would miss it*/
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+    size_t dispositionBatchSize;
+    size_t dispositionBatchWindowMs;
+    VECTOR_HANDLE pendingDispositions; /*of HTTP_PENDING_DISPOSITION, NULL when dispositions are sent as they come*/
+    TICK_COUNTER_HANDLE dispositionTickCounter; /*NULL when there is no batching window*/
+    tickcounter_ms_t firstDispositionTime; /*when the oldest of pendingDispositions was queued*/
 }HTTPTRANSPORT_HANDLE_DATA;
 
+/*one HTTP request of a device, from the moment it is prepared until its outcome is processed*/
+typedef struct HTTP_PENDING_REQUEST_TAG
+{
+    bool isPending;
+    bool isBatch; /*for events, the request carries everything in eventConfirmations instead of the head of waitingToSend*/
+    bool useSasObject; /*false when the request headers already carry the device's own SAS token*/
+    HTTPAPIEX_SAS_HANDLE sasObject;
+    HTTPAPI_REQUEST_TYPE requestType;
+    STRING_HANDLE relativePath;
+    HTTP_HEADERS_HANDLE requestHeaders;
+    BUFFER_HANDLE requestContent;
+    HTTP_HEADERS_HANDLE responseHeaders;
+    BUFFER_HANDLE responseContent;
+    time_t pollTime; /*for C2D polls, the time the poll was decided*/
+    unsigned int statusCode;
+    HTTPAPIEX_RESULT result;
+} HTTP_PENDING_REQUEST;
+
+/*a message disposition waiting in pendingDispositions for the next flush*/
+typedef struct HTTP_PENDING_DISPOSITION_TAG
+{
+    IOTHUBMESSAGE_DISPOSITION_RESULT action;
+    char* etagValue; /*identifies the message in the logs*/
+    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle;
+    IOTHUB_MESSAGE_HANDLE messageHandle; /*a reference to the message, handed to IoTHubClientCore_LL_MessageDispositionComplete with the outcome. NULL for the dispositions the transport sends on its own*/
+    HTTP_PENDING_REQUEST request;
+} HTTP_PENDING_DISPOSITION;
+
 typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
 {
     HTTPTRANSPORT_HANDLE_DATA* transportHandle;
@@ -73,12 +122,44 @@ typedef struct HTTPTRANSPORT_PERDEVICE_DATA_TAG
     bool DoWork_PullMessage;
     time_t lastPollTime;
     bool isFirstPoll;
+    unsigned int pollDelay; /*adaptive polling: seconds to wait after lastPollTime before the next poll*/
+    unsigned int pollBackoff; /*adaptive polling: upper bound of the next delay, doubles on every empty poll*/
 
     IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle;
     PDLIST_ENTRY waitingToSend;
     DLIST_ENTRY eventConfirmations; /*holds items for event confirmations*/
+    BUFFER_HANDLE eventBatchBuffer; /*holds the batched payload, reused from one batch to the next*/
+    HTTP_PENDING_REQUEST eventRequest;
+    HTTP_PENDING_REQUEST messageRequest;
 } HTTPTRANSPORT_PERDEVICE_DATA;
 
+/*executes the requests held by one element of the VECTOR handed to execute_requests_in_parallel*/
+typedef void(*HTTP_EXECUTE_ITEM)(HTTPAPIEX_HANDLE httpApiExHandle, void* item);
+
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+typedef struct HTTP_WORKER_TAG
+{
+    struct HTTP_WORKER_POOL_TAG* pool;
+    HTTPAPIEX_HANDLE httpApiExHandle; /*a HTTPAPIEX_HANDLE is not shared between threads, so every worker keeps its own connection*/
+    THREAD_HANDLE thread;
+} HTTP_WORKER;
+
+typedef struct HTTP_WORKER_POOL_TAG
+{
+    LOCK_HANDLE lock;
+    COND_HANDLE workAvailable;
+    COND_HANDLE workDone;
+    HTTP_WORKER* workers;
+    size_t workerCount;
+    VECTOR_HANDLE items; /*the devices or the dispositions of the pass being executed, NULL between passes*/
+    HTTP_EXECUTE_ITEM executeItem;
+    size_t itemCount;
+    size_t nextItem;
+    size_t completedItems;
+    int stop;
+} HTTP_WORKER_POOL;
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
 typedef struct MESSAGE_DISPOSITION_CONTEXT_TAG
 {
     HTTPTRANSPORT_HANDLE_DATA* handleData;
@@ -478,6 +559,15 @@ static bool create_deviceSasToken(HTTPTRANSPORT_PERDEVICE_DATA* handleData, cons
     return result;
 }
 
+static void destroy_eventBatchBuffer(HTTPTRANSPORT_PERDEVICE_DATA* handleData)
+{
+    if (handleData->eventBatchBuffer != NULL)
+    {
+        BUFFER_delete(handleData->eventBatchBuffer);
+        handleData->eventBatchBuffer = NULL;
+    }
+}
+
 /*
 * List queries  Find by handle and find by device name
 */
@@ -609,8 +699,13 @@ static IOTHUB_DEVICE_HANDLE IoTHubTransportHttp_Register(TRANSPORT_LL_HANDLE han
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_128: [ IoTHubTransportHttp_Register shall mark this device as unsubscribed. ]*/
                 result->DoWork_PullMessage = false;
                 result->isFirstPoll = true;
+                result->pollDelay = 0;
+                result->pollBackoff = 0;
                 result->waitingToSend = waitingToSend;
                 DList_InitializeListHead(&(result->eventConfirmations));
+                result->eventBatchBuffer = NULL;
+                result->eventRequest.isPending = false;
+                result->messageRequest.isPending = false;
                 result->transportHandle = (HTTPTRANSPORT_HANDLE_DATA *)handle;
             }
             else
@@ -647,6 +742,7 @@ static void destroy_perDeviceData(HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem)
     destroy_messageHTTPrequestHeaders(perDeviceItem);
     destroy_abandonHTTPrelativePathBegin(perDeviceItem);
     destroy_SASObject(perDeviceItem);
+    destroy_eventBatchBuffer(perDeviceItem);
 }
 
 static IOTHUB_DEVICE_HANDLE* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHandle)
@@ -670,39 +766,6 @@ static IOTHUB_DEVICE_HANDLE* get_perDeviceDataItem(IOTHUB_DEVICE_HANDLE deviceHa
     return listItem;
 }
 
-static void IoTHubTransportHttp_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
-{
-    if (deviceHandle == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_044: [ If deviceHandle is NULL, then IoTHubTransportHttp_Unregister shall do nothing. ]*/
-        LogError("Unregister a NULL device handle");
-    }
-    else
-    {
-        HTTPTRANSPORT_PERDEVICE_DATA* deviceHandleData = (HTTPTRANSPORT_PERDEVICE_DATA*)deviceHandle;
-        HTTPTRANSPORT_HANDLE_DATA* handleData = deviceHandleData->transportHandle;
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_045: [ IoTHubTransportHttp_Unregister shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(deviceHandle);
-        if (listItem == NULL)
-        {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_046: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
-            LogError("Device Handle [%p] not found in transport", deviceHandle);
-        }
-        else
-        {
-            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
-
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_047: [ IoTHubTransportHttp_Unregister shall free all the resources used in the device structure. ]*/
-            destroy_perDeviceData(perDeviceItem);
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_048: [ IoTHubTransportHttp_Unregister shall call singlylinkedlist_remove to remove device from devices list. ]*/
-            VECTOR_erase(handleData->perDeviceList, listItem, 1);
-            free(deviceHandleData);
-        }
-    }
-
-    return;
-}
-
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_005: [If config->upperConfig->protocolGatewayHostName is NULL, `IoTHubTransportHttp_Create` shall create an immutable string (further called hostname) containing `config->transportConfig->iotHubName + config->transportConfig->iotHubSuffix`.]  */
 /*Codes_SRS_TRANSPORTMULTITHTTP_20_001: [If config->upperConfig->protocolGatewayHostName is not NULL, IoTHubTransportHttp_Create shall use it as hostname] */
 static void destroy_hostName(HTTPTRANSPORT_HANDLE_DATA* handleData)
@@ -772,449 +835,1258 @@ static bool create_httpApiExHandle(HTTPTRANSPORT_HANDLE_DATA* handleData, const
     return result;
 }
 
-static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
-{
-    VECTOR_destroy(handleData->perDeviceList);
-    handleData->perDeviceList = NULL;
-}
-
-/*Codes_SRS_TRANSPORTMULTITHTTP_17_009: [ IoTHubTransportHttp_Create shall call singlylinkedlist_create to create a list of registered devices. ]*/
-static bool create_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
+/*executes a request prepared by prepareEvent or prepareMessages, it touches nothing but the request*/
+static void executeRequest(HTTPAPIEX_HANDLE httpApiExHandle, HTTP_PENDING_REQUEST* request)
 {
-    bool result;
-    handleData->perDeviceList = VECTOR_create(sizeof(IOTHUB_DEVICE_HANDLE));
-    if (handleData == NULL || handleData->perDeviceList == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_010: [ If creating the list fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]*/
-        result = false;
+    request->statusCode = 0;
+    if (request->useSasObject)
+    {
+        if ((request->result = HTTPAPIEX_SAS_ExecuteRequest(
+            request->sasObject,
+            httpApiExHandle,
+            request->requestType,
+            STRING_c_str(request->relativePath),
+            request->requestHeaders,
+            request->requestContent,
+            &(request->statusCode),
+            request->responseHeaders,
+            request->responseContent
+        )) != HTTPAPIEX_OK)
+        {
+            LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+        }
     }
     else
     {
-        result = true;
+        if ((request->result = HTTPAPIEX_ExecuteRequest(
+            httpApiExHandle,
+            request->requestType,
+            STRING_c_str(request->relativePath),
+            request->requestHeaders,
+            request->requestContent,
+            &(request->statusCode),
+            request->responseHeaders,
+            request->responseContent
+        )) != HTTPAPIEX_OK)
+        {
+            LogError("Unable to HTTPAPIEX_ExecuteRequest.");
+        }
     }
-    return result;
 }
 
-
-static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* config)
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/*the event and the C2D poll of one device go one after the other on the same connection, they share the device's sasObject*/
+static void executeDeviceRequests(HTTPAPIEX_HANDLE httpApiExHandle, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
 {
-    HTTPTRANSPORT_HANDLE_DATA* result;
-    if (config == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_001: [If parameter config is NULL, then IoTHubTransportHttp_Create shall return NULL.]*/
-        LogError("invalid arg (configuration is missing)");
-        result = NULL;
-    }
-    else if (config->upperConfig == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_002: [ If field transportConfig is NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
-        LogError("invalid arg (upperConfig is NULL)");
-        result = NULL;
-    }
-    else if (config->upperConfig->protocol == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
-        LogError("invalid arg (protocol is NULL)");
-        result = NULL;
-    }
-    else if (config->upperConfig->iotHubName == NULL)
+    if (deviceData->eventRequest.isPending)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
-        LogError("invalid arg (iotHubName is NULL)");
-        result = NULL;
+        executeRequest(httpApiExHandle, &(deviceData->eventRequest));
     }
-    else if (config->upperConfig->iotHubSuffix == NULL)
+    if (deviceData->messageRequest.isPending)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
-        LogError("invalid arg (iotHubSuffix is NULL)");
-        result = NULL;
+        executeRequest(httpApiExHandle, &(deviceData->messageRequest));
     }
-    else
+}
+
+static void executeDeviceItem(HTTPAPIEX_HANDLE httpApiExHandle, void* item)
+{
+    executeDeviceRequests(httpApiExHandle, *(HTTPTRANSPORT_PERDEVICE_DATA**)item);
+}
+
+/*takes the items of the current pass one at a time until none is left. Called with the pool lock taken, returns with it taken.*/
+static void execute_pending_items(HTTP_WORKER_POOL* pool, HTTPAPIEX_HANDLE httpApiExHandle)
+{
+    while (pool->nextItem < pool->itemCount)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_130: [ IoTHubTransportHttp_Create shall allocate memory for the handle. ]*/
-        result = (HTTPTRANSPORT_HANDLE_DATA*)malloc(sizeof(HTTPTRANSPORT_HANDLE_DATA));
-        if (result == NULL)
+        void* item = VECTOR_element(pool->items, pool->nextItem);
+        pool->nextItem++;
+        (void)Unlock(pool->lock);
+
+        pool->executeItem(httpApiExHandle, item);
+
+        while (Lock(pool->lock) != LOCK_OK)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_131: [ If allocation fails, IoTHubTransportHttp_Create shall fail and return NULL. ]*/
-            LogError("unable to malloc");
+            LogError("failed locking the HTTP worker pool, retrying");
+            ThreadAPI_Sleep(1);
         }
-        else
+        pool->completedItems++;
+        if (pool->completedItems == pool->itemCount)
         {
-            bool was_hostName_ok = create_hostName(result, config);
-            bool was_httpApiExHandle_ok = was_hostName_ok && create_httpApiExHandle(result, config);
-            bool was_perDeviceList_ok = was_httpApiExHandle_ok && create_perDeviceList(result);
-
-
-            if (was_perDeviceList_ok)
-            {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
-                result->doBatchedTransfers = false;
-                result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
-            }
-            else
-            {
-                if (was_httpApiExHandle_ok) destroy_httpApiExHandle(result);
-                if (was_hostName_ok) destroy_hostName(result);
-
-                free(result);
-                result = NULL;
-            }
+            (void)Condition_Post(pool->workDone);
         }
     }
-    return result;
 }
 
-static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
+static int http_worker_thread(void* threadArgument)
 {
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_012: [ IoTHubTransportHttp_Destroy shall do nothing is handle is NULL. ]*/
-    if (handle != NULL)
-    {
-        HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
-        IOTHUB_DEVICE_HANDLE* listItem;
-
-        size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+    HTTP_WORKER* worker = (HTTP_WORKER*)threadArgument;
+    HTTP_WORKER_POOL* pool = worker->pool;
 
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_013: [ Otherwise, IoTHubTransportHttp_Destroy shall free all the resources currently in use. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+    if (Lock(pool->lock) != LOCK_OK)
+    {
+        LogError("failed locking for http_worker_thread");
+    }
+    else
+    {
+        while (pool->stop == 0)
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA*)(*listItem);
-            destroy_perDeviceData(perDeviceItem);
-            free(perDeviceItem);
+            execute_pending_items(pool, worker->httpApiExHandle);
+            if ((pool->stop == 0) && (Condition_Wait(pool->workAvailable, pool->lock, 0) == COND_ERROR))
+            {
+                LogError("Condition_Wait failed");
+            }
         }
-
-        destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *)handle);
-        destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *)handle);
-        destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
-        free(handle);
+        (void)Unlock(pool->lock);
     }
+
+    ThreadAPI_Exit(0);
+    return 0;
 }
 
-static int IoTHubTransportHttp_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+/*executes the requests of all the items, the DoWork thread working as one more worker. Returns when all of them are done.*/
+static void execute_requests_in_parallel(HTTP_WORKER_POOL* pool, HTTPAPIEX_HANDLE httpApiExHandle, VECTOR_HANDLE items, HTTP_EXECUTE_ITEM executeItem)
 {
-    int result;
-    if (handle == NULL)
+    size_t itemCount = VECTOR_size(items);
+
+    if (Lock(pool->lock) != LOCK_OK)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_103: [ If parameter deviceHandle is NULL then IoTHubTransportHttp_Subscribe shall fail and return a non-zero value. ]*/
-        LogError("invalid arg passed to IoTHubTransportHttp_Subscribe");
-        result = __FAILURE__;
+        size_t i;
+        LogError("failed locking the HTTP worker pool, executing the requests one by one");
+        for (i = 0; i < itemCount; i++)
+        {
+            executeItem(httpApiExHandle, VECTOR_element(items, i));
+        }
     }
     else
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
+        size_t index;
 
-        if (listItem == NULL)
+        pool->items = items;
+        pool->executeItem = executeItem;
+        pool->itemCount = itemCount;
+        pool->nextItem = 0;
+        pool->completedItems = 0;
+        for (index = 0; (index < pool->workerCount) && (index < itemCount); index++)
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_105: [ If the device structure is not found, then this function shall fail and return a non-zero value. ]*/
-            LogError("did not find device in transport handle");
-            result = __FAILURE__;
+            (void)Condition_Post(pool->workAvailable);
         }
-        else
-        {
-            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem;
 
-            perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. ]*/
-            perDeviceItem->DoWork_PullMessage = true;
+        execute_pending_items(pool, httpApiExHandle);
+        while (pool->completedItems < pool->itemCount)
+        {
+            if (Condition_Wait(pool->workDone, pool->lock, 0) == COND_ERROR)
+            {
+                LogError("Condition_Wait failed");
+            }
         }
-        result = 0;
+
+        pool->items = NULL;
+        pool->executeItem = NULL;
+        pool->itemCount = 0;
+        pool->nextItem = 0;
+        pool->completedItems = 0;
+        (void)Unlock(pool->lock);
     }
-    return result;
 }
 
-static void IoTHubTransportHttp_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+/*stops and joins the worker threads, then closes their connections*/
+static void destroy_worker_pool(HTTP_WORKER_POOL* pool)
 {
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_107: [ If parameter deviceHandle is NULL then IoTHubTransportHttp_Unsubscribe shall fail do nothing. ]*/
-    if (handle != NULL)
+    size_t index;
+
+    if (pool->workerCount > 0)
     {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_108: [ IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
-        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_109: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
-        if (listItem != NULL)
+        if (Lock(pool->lock) != LOCK_OK)
         {
-            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_110: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork shall not execute HTTP requests. ]*/
-            perDeviceItem->DoWork_PullMessage = false;
+            LogError("unable to Lock - - will still proceed to try to end the threads without locking");
         }
-        else
+        pool->stop = 1;
+        for (index = 0; index < pool->workerCount; index++)
         {
-            LogError("Device not found to unsuscribe.");
+            (void)Condition_Post(pool->workAvailable);
+        }
+        (void)Unlock(pool->lock);
+
+        for (index = 0; index < pool->workerCount; index++)
+        {
+            int res;
+            if (ThreadAPI_Join(pool->workers[index].thread, &res) != THREADAPI_OK)
+            {
+                LogError("ThreadAPI_Join failed");
+            }
+            HTTPAPIEX_Destroy(pool->workers[index].httpApiExHandle);
         }
     }
-    else
-    {
-        LogError("Null handle passed to Unsuscribe.");
-    }
+
+    free(pool->workers);
+    Condition_Deinit(pool->workDone);
+    Condition_Deinit(pool->workAvailable);
+    Lock_Deinit(pool->lock);
+    free(pool);
 }
 
-static int IoTHubTransportHttp_Subscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+/*the options of httpApiExHandle are copied and released the way HTTPAPIEX keeps its own*/
+static void* cloneHttpApiExOption(const char* name, const void* value)
 {
-    /*Codes_SRS_TRANSPORTMULTITHTTP_02_003: [ IoTHubTransportHttp_Subscribe_DeviceTwin shall return a non-zero value. ]*/
-    (void)handle;
-    int result = __FAILURE__;
-    LogError("IoTHubTransportHttp_Subscribe_DeviceTwin Not supported");
-    return result;
+    const void* result;
+    if (HTTPAPI_CloneOption(name, value, &result) != HTTPAPI_OK)
+    {
+        LogError("unable to HTTPAPI_CloneOption \"%s\"", name);
+        result = NULL;
+    }
+    return (void*)result;
 }
 
-static void IoTHubTransportHttp_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+static void destroyHttpApiExOption(const char* name, const void* value)
 {
-    (void)handle;
-    /*Codes_SRS_TRANSPORTMULTITHTTP_02_004: [ IoTHubTransportHttp_Unsubscribe_DeviceTwin shall return ]*/
-    LogError("IoTHubTransportHttp_Unsubscribe_DeviceTwin Not supported");
+    (void)name;
+    free((void*)value);
 }
 
-static int IoTHubTransportHttp_Subscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+static int setHttpApiExOption(void* handle, const char* name, const void* value)
 {
-    (void)handle;
-    int result = __FAILURE__;
-    LogError("not implemented (yet)");
+    int result;
+    if (HTTPAPIEX_SetOption((HTTPAPIEX_HANDLE)handle, name, value) != HTTPAPIEX_OK)
+    {
+        LogError("unable to HTTPAPIEX_SetOption \"%s\"", name);
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
     return result;
 }
 
-static void IoTHubTransportHttp_Unsubscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+/*Codes_SRS_TRANSPORTMULTITHTTP_31_024: [ Until the workers are started, every option accepted by HTTPAPIEX_SetOption shall be saved with OptionHandler_AddOption. ]*/
+static void saveHttpApiExOption(HTTPTRANSPORT_HANDLE_DATA* handleData, const char* option, const void* value)
 {
-    (void)handle;
-    LogError("not implemented (yet)");
+    if (handleData->wereHttpOptionsLost)
+    {
+        /*no pool can be started anymore, nothing to keep*/
+    }
+    else if ((handleData->httpApiExOptions == NULL) &&
+        ((handleData->httpApiExOptions = OptionHandler_Create(cloneHttpApiExOption, destroyHttpApiExOption, setHttpApiExOption)) == NULL))
+    {
+        LogError("unable to OptionHandler_Create, http_max_concurrent_requests can no longer be more than 1");
+        handleData->wereHttpOptionsLost = true;
+    }
+    else if (OptionHandler_AddOption(handleData->httpApiExOptions, option, value) != OPTIONHANDLER_OK)
+    {
+        LogError("unable to OptionHandler_AddOption \"%s\", http_max_concurrent_requests can no longer be more than 1", option);
+        handleData->wereHttpOptionsLost = true;
+    }
 }
 
-static int IoTHubTransportHttp_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response)
+static HTTP_WORKER_POOL* create_worker_pool(HTTPTRANSPORT_HANDLE_DATA* handleData, size_t workerCount)
 {
-    (void)handle;
-    (void)methodId;
-    (void)response;
-    (void)response_size;
-    (void)status_response;
-    LogError("not implemented (yet)");
-    return __FAILURE__;
-}
+    HTTP_WORKER_POOL* result;
 
-/*produces a representation of the properties, if they exist*/
-/*if they do not exist, produces ""*/
-static int concat_Properties(STRING_HANDLE existing, MAP_HANDLE map, size_t* propertiesMessageSizeContribution)
-{
-    int result;
-    const char*const* keys;
-    const char*const* values;
-    size_t count;
-    if (Map_GetInternals(map, &keys, &values, &count) != MAP_OK)
+    if (workerCount > SIZE_MAX / sizeof(HTTP_WORKER))
     {
-        result = __FAILURE__;
-        LogError("error while Map_GetInternals");
+        LogError("invalid number of HTTP workers");
+        result = NULL;
+    }
+    else if ((result = (HTTP_WORKER_POOL*)malloc(sizeof(HTTP_WORKER_POOL))) == NULL)
+    {
+        LogError("failed allocating HTTP worker pool");
     }
     else
     {
+        (void)memset(result, 0, sizeof(HTTP_WORKER_POOL));
 
-        if (count == 0)
-        {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
-            /*no properties - do nothing with existing*/
-            result = 0;
-            *propertiesMessageSizeContribution = 0;
-        }
-        else
+        if (((result->lock = Lock_Init()) == NULL) ||
+            ((result->workAvailable = Condition_Init()) == NULL) ||
+            ((result->workDone = Condition_Init()) == NULL) ||
+            ((result->workers = (HTTP_WORKER*)malloc(workerCount * sizeof(HTTP_WORKER))) == NULL))
         {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
-            if (STRING_concat(existing, ",\"properties\":") != 0)
+            LogError("failed creating HTTP worker pool resources");
+            if (result->workDone != NULL)
             {
-                /*go ahead and return it*/
-                result = __FAILURE__;
-                LogError("failed STRING_concat");
+                Condition_Deinit(result->workDone);
             }
-            else if (appendMapToJSON(existing, keys, values, count) != 0)
+            if (result->workAvailable != NULL)
             {
-                result = __FAILURE__;
-                LogError("unable to append the properties");
+                Condition_Deinit(result->workAvailable);
             }
-            else
+            if (result->lock != NULL)
             {
-                /*all is fine*/
-                size_t i;
-                *propertiesMessageSizeContribution = 0;
-                for (i = 0; i < count; i++)
+                Lock_Deinit(result->lock);
+            }
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            size_t index;
+            for (index = 0; index < workerCount; index++)
+            {
+                HTTP_WORKER* worker = &(result->workers[index]);
+                worker->pool = result;
+                if ((worker->httpApiExHandle = HTTPAPIEX_Create(STRING_c_str(handleData->hostName))) == NULL)
+                {
+                    LogError("failed creating the connection of HTTP worker %lu", (unsigned long)index);
+                    break;
+                }
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_025: [ The saved options shall be set on the HTTPAPIEX_HANDLE of every worker with OptionHandler_FeedOptions before its thread starts. ]*/
+                else if ((handleData->httpApiExOptions != NULL) && (OptionHandler_FeedOptions(handleData->httpApiExOptions, worker->httpApiExHandle) != OPTIONHANDLER_OK))
+                {
+                    LogError("failed setting the options of HTTP worker %lu", (unsigned long)index);
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                    break;
+                }
+                else if (ThreadAPI_Create(&(worker->thread), http_worker_thread, worker) != THREADAPI_OK)
                 {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
-                    *propertiesMessageSizeContribution += (strlen(keys[i]) + strlen(values[i]) + MAXIMUM_PROPERTY_OVERHEAD);
+                    LogError("failed creating HTTP worker thread %lu", (unsigned long)index);
+                    HTTPAPIEX_Destroy(worker->httpApiExHandle);
+                    break;
                 }
-                result = 0;
+            }
+            result->workerCount = index;
+
+            if (index < workerCount)
+            {
+                destroy_worker_pool(result);
+                result = NULL;
             }
         }
     }
+
     return result;
 }
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
 
-/*produces a JSON representation of the map : {"a": "value_of_a","b":"value_of_b"}*/
-static int appendMapToJSON(STRING_HANDLE existing, const char* const* keys, const char* const* values, size_t count) /*under consideration: move to MAP module when it has more than 1 user*/
+/*builds the abandon/complete/reject request of the message, on success the request owns its relative path and headers until completeDispositionRequest*/
+static bool prepareDispositionRequest(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, IOTHUBMESSAGE_DISPOSITION_RESULT action, HTTP_PENDING_REQUEST* request)
 {
-    int result;
-    if (STRING_concat(existing, "{") != 0)
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_097: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
+    -requestType: POST
+    -relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"
+    - requestHttpHeadersHandle: an HTTP headers instance containing the following
+    Authorization: " "
+    If-Match: value of ETag
+    - requestContent: NULL
+    - statusCode: a pointer to unsigned int which might be examined for logging
+    - responseHeadearsHandle: NULL
+    - responseContent: NULL]*/
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_099: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
+    -requestType: DELETE
+    -relativePath: abandon relative path begin + value of ETag + "?api-version=2016-11-14"
+    - requestHttpHeadersHandle: an HTTP headers instance containing the following
+    Authorization: " "
+    If-Match: value of ETag
+    - requestContent: NULL
+    - statusCode: a pointer to unsigned int which might be used by logging
+    - responseHeadearsHandle: NULL
+    - responseContent: NULL]*/
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_101: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
+    -requestType: DELETE
+    -relativePath: abandon relative path begin + value of ETag +"?api-version=2016-11-14" + "&reject"
+    - requestHttpHeadersHandle: an HTTP headers instance containing the following
+    Authorization: " "
+    If-Match: value of ETag
+    - requestContent: NULL
+    - statusCode: a pointer to unsigned int which might be used by logging
+    - responseHeadearsHandle: NULL
+    - responseContent: NULL]*/
+
+    bool result;
+    STRING_HANDLE fullAbandonRelativePath = STRING_clone(deviceData->abandonHTTPrelativePathBegin);
+    if (fullAbandonRelativePath == NULL)
     {
-        /*go on and return it*/
-        LogError("STRING_construct failed");
-        result = __FAILURE__;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        LogError("unable to STRING_clone");
+        result = false;
     }
     else
     {
-        size_t i;
-        for (i = 0; i < count; i++)
+        STRING_HANDLE ETagUnquoted = STRING_construct_n(ETag + 1, strlen(ETag) - 2); /*skip first character which is '"' and the last one (which is also '"')*/
+        if (ETagUnquoted == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+            LogError("unable to STRING_construct_n");
+            result = false;
+        }
+        else
         {
             if (!(
-                (STRING_concat(existing, (i == 0) ? "\"" IOTHUB_APP_PREFIX : ",\"" IOTHUB_APP_PREFIX) == 0) &&
-                (STRING_concat(existing, keys[i]) == 0) &&
-                (STRING_concat(existing, "\":\"") == 0) &&
-                (STRING_concat(existing, values[i]) == 0) &&
-                (STRING_concat(existing, "\"") == 0)
+                (STRING_concat_with_STRING(fullAbandonRelativePath, ETagUnquoted) == 0) &&
+                (STRING_concat(fullAbandonRelativePath, (action == IOTHUBMESSAGE_ABANDONED) ? "/abandon" API_VERSION : ((action == IOTHUBMESSAGE_REJECTED) ? API_VERSION "&reject" : API_VERSION)) == 0)
                 ))
             {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
                 LogError("unable to STRING_concat");
-                break;
+                result = false;
+            }
+            else
+            {
+                HTTP_HEADERS_HANDLE abandonRequestHttpHeaders = HTTPHeaders_Alloc();
+                if (abandonRequestHttpHeaders == NULL)
+                {
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                    LogError("unable to HTTPHeaders_Alloc");
+                    result = false;
+                }
+                else
+                {
+                    if (!(
+                        (addUserAgentHeaderInfo(deviceData->iotHubClientHandle, abandonRequestHttpHeaders) == HTTP_HEADERS_OK) &&
+                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", " ") == HTTP_HEADERS_OK) &&
+                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "If-Match", ETag) == HTTP_HEADERS_OK)
+                        ))
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+                        LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
+                        result = false;
+                    }
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+                    else if ((deviceData->deviceSasToken != NULL) &&
+                        (HTTPHeaders_ReplaceHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK))
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+                        LogError("Unable to replace the old SAS Token.");
+                        result = false;
+                    }
+                    else
+                    {
+                        /*with a device SAS token the request goes out through HTTPAPIEX_ExecuteRequest, otherwise through HTTPAPIEX_SAS_ExecuteRequest*/
+                        request->isBatch = false;
+                        request->useSasObject = (deviceData->deviceSasToken == NULL);
+                        request->sasObject = deviceData->sasObject;
+                        request->requestType = (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE;
+                        request->relativePath = fullAbandonRelativePath; /*from now on owned by the request*/
+                        request->requestHeaders = abandonRequestHttpHeaders; /*from now on owned by the request*/
+                        request->requestContent = NULL;
+                        request->responseHeaders = NULL;
+                        request->responseContent = NULL;
+                        request->isPending = true;
+                        result = true;
+                    }
+                    if (!result)
+                    {
+                        HTTPHeaders_Free(abandonRequestHttpHeaders);
+                    }
+                }
             }
+            STRING_delete(ETagUnquoted);
         }
-
-        if (i < count)
+        if (!result)
         {
-            result = __FAILURE__;
-            /*error, let it go through*/
+            STRING_delete(fullAbandonRelativePath);
         }
-        else if (STRING_concat(existing, "}") != 0)
+    }
+    return result;
+}
+
+/*examines the outcome of a request built by prepareDispositionRequest and releases it*/
+static bool completeDispositionRequest(HTTP_PENDING_REQUEST* request)
+{
+    bool result;
+    request->isPending = false;
+
+    if (request->result != HTTPAPIEX_OK)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        result = false;
+    }
+    else if (request->statusCode != 204)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
+        LogError("unexpected status code returned %u (was expecting 204)", request->statusCode);
+        result = false;
+    }
+    else
+    {
+        /*all is fine*/
+        result = true;
+    }
+
+    HTTPHeaders_Free(request->requestHeaders);
+    STRING_delete(request->relativePath);
+    return result;
+}
+
+static void executeDispositionItem(HTTPAPIEX_HANDLE httpApiExHandle, void* item)
+{
+    /*the dispositions of one device run at the same time on several pool connections and all use the device's sasObject.
+    That is safe because HTTPAPIEX_SAS_ExecuteRequest only reads the sasObject; the token it makes goes in the request's own headers*/
+    executeRequest(httpApiExHandle, &(((HTTP_PENDING_DISPOSITION*)item)->request));
+}
+
+/*sends all the queued dispositions, over the worker pool when there is one, then reports the outcome of each to its client*/
+static void flush_dispositions(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    size_t dispositionCount = VECTOR_size(handleData->pendingDispositions);
+    if (dispositionCount > 0)
+    {
+        size_t i;
+
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_018: [ Queued dispositions shall be executed on up to "http_max_concurrent_requests" connections at the same time. ]*/
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+        if (handleData->workerPool != NULL)
         {
-            LogError("unable to STRING_concat");
-            result = __FAILURE__;
+            execute_requests_in_parallel(handleData->workerPool, handleData->httpApiExHandle, handleData->pendingDispositions, executeDispositionItem);
         }
         else
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
         {
-            /*all is fine*/
-            result = 0;
+            for (i = 0; i < dispositionCount; i++)
+            {
+                executeDispositionItem(handleData->httpApiExHandle, VECTOR_element(handleData->pendingDispositions, i));
+            }
+        }
+
+        for (i = 0; i < dispositionCount; i++)
+        {
+            HTTP_PENDING_DISPOSITION* disposition = (HTTP_PENDING_DISPOSITION*)VECTOR_element(handleData->pendingDispositions, i);
+            bool succeeded = completeDispositionRequest(&(disposition->request));
+            if (!succeeded)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_019: [ Every queued disposition that fails shall be logged with the ETag of its message. ]*/
+                LogError("HTTP Transport layer failed to report %s disposition of message %s", ENUM_TO_STRING(IOTHUBMESSAGE_DISPOSITION_RESULT, disposition->action), disposition->etagValue);
+            }
+            if (disposition->messageHandle != NULL)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_022: [ For every queued disposition of a message handed to the client, IoTHubClientCore_LL_MessageDispositionComplete shall be called with the message, the disposition and IOTHUB_CLIENT_OK when the request succeeded, IOTHUB_CLIENT_ERROR otherwise, then the message shall be released. ]*/
+                IoTHubClientCore_LL_MessageDispositionComplete(disposition->iotHubClientHandle, disposition->messageHandle, disposition->action, succeeded ? IOTHUB_CLIENT_OK : IOTHUB_CLIENT_ERROR);
+                IoTHubMessage_Destroy(disposition->messageHandle);
+            }
+            free(disposition->etagValue);
         }
+        VECTOR_clear(handleData->pendingDispositions);
+    }
+}
+
+static bool is_disposition_flush_due(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    bool result;
+    tickcounter_ms_t currentTime;
+
+    if (VECTOR_size(handleData->pendingDispositions) >= handleData->dispositionBatchSize)
+    {
+        result = true;
+    }
+    else if (handleData->dispositionTickCounter == NULL)
+    {
+        /*no window, what a DoWork pass queued is sent at its end*/
+        result = true;
+    }
+    else if (tickcounter_get_current_ms(handleData->dispositionTickCounter, &currentTime) != 0)
+    {
+        LogError("unable to tickcounter_get_current_ms, sending the queued dispositions now");
+        result = true;
+    }
+    else
+    {
+        result = (currentTime - handleData->firstDispositionTime >= (tickcounter_ms_t)handleData->dispositionBatchWindowMs);
     }
+
     return result;
 }
 
-/*makes the following string:{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-/*return NULL if there was a failure, or a non-NULL STRING_HANDLE that contains the intended data*/
-static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeContribution)
+/*queues the disposition of the message until the next flush, keeping a reference to messageHandle when it is not NULL. When it cannot be queued it is sent right away*/
+static bool queue_disposition(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, IOTHUBMESSAGE_DISPOSITION_RESULT action, IOTHUB_MESSAGE_HANDLE messageHandle)
 {
-    STRING_HANDLE result; /*temp wants to contain :{"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}*/
-    IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
-    IOTHUBMESSAGE_CONTENT_TYPE contentType = IoTHubMessage_GetContentType(message->messageHandle);
+    bool result;
+    HTTP_PENDING_DISPOSITION disposition;
 
-    switch (contentType)
+    disposition.action = action;
+    disposition.iotHubClientHandle = deviceData->iotHubClientHandle;
+    disposition.messageHandle = NULL;
+    if (mallocAndStrcpy_s(&disposition.etagValue, ETag) != 0)
     {
-    case IOTHUBMESSAGE_BYTEARRAY:
+        LogError("mallocAndStrcpy_s failed");
+        result = false;
+    }
+    else if (!prepareDispositionRequest(deviceData, ETag, action, &(disposition.request)))
     {
-        result = STRING_construct("{\"body\":\"");
-        if (result == NULL)
+        free(disposition.etagValue);
+        result = false;
+    }
+    else
+    {
+        if ((messageHandle != NULL) && (IoTHubMessage_Retain(messageHandle) != IOTHUB_MESSAGE_OK))
         {
-            LogError("unable to STRING_construct");
+            /*the disposition is still sent, only its outcome is not reported*/
+            LogError("unable to IoTHubMessage_Retain, the outcome of the %s disposition of message %s will only be logged", ENUM_TO_STRING(IOTHUBMESSAGE_DISPOSITION_RESULT, action), ETag);
         }
         else
         {
-            const unsigned char* source;
-            size_t size;
+            disposition.messageHandle = messageHandle;
+        }
 
-            if (IoTHubMessage_GetByteArray(message->messageHandle, &source, &size) != IOTHUB_MESSAGE_OK)
-            {
-                LogError("unable to get the data for the message.");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
+        if ((VECTOR_size(handleData->pendingDispositions) == 0) &&
+            (handleData->dispositionTickCounter != NULL) &&
+            (tickcounter_get_current_ms(handleData->dispositionTickCounter, &(handleData->firstDispositionTime)) != 0))
+        {
+            LogError("unable to tickcounter_get_current_ms");
+            handleData->firstDispositionTime = 0;
+        }
+
+        if (VECTOR_push_back(handleData->pendingDispositions, &disposition, 1) != 0)
+        {
+            LogError("unable to VECTOR_push_back, sending the disposition now");
+            executeRequest(handleData->httpApiExHandle, &(disposition.request));
+            result = completeDispositionRequest(&(disposition.request));
+            if (disposition.messageHandle != NULL)
             {
-                STRING_HANDLE encoded = Base64_Encode_Bytes(source, size);
-                if (encoded == NULL)
-                {
-                    LogError("unable to Base64_Encode_Bytes.");
-                    STRING_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, encoded) == 0) &&
-                        (STRING_concat(result, "\"") == 0) && /*\" because closing value*/
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
-                    {
-                        STRING_delete(result);
-                        result = NULL;
-                        LogError("unable to STRING_concat_with_STRING.");
-                    }
-                    else
-                    {
-                        /*all is fine... */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = size + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-                    }
-                    STRING_delete(encoded);
-                }
+                /*the outcome is the return value, like when dispositions are not batched*/
+                IoTHubMessage_Destroy(disposition.messageHandle);
             }
+            free(disposition.etagValue);
+        }
+        else
+        {
+            result = true;
         }
-        break;
     }
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
-    case IOTHUBMESSAGE_STRING:
+
+    return result;
+}
+
+/*messageHandle is the message handed to the client, NULL when the transport abandons a message on its own*/
+static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, IOTHUBMESSAGE_DISPOSITION_RESULT action, IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    bool result;
+
+    if (handleData->pendingDispositions != NULL)
     {
-        result = STRING_construct("{\"body\":");
-        if (result == NULL)
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_016: [ When "http_disposition_batch_size" is not 0, the "abandon", "complete" and "reject" requests shall be queued and reported as successful, their outcome being reported later by IoTHubClientCore_LL_MessageDispositionComplete. ]*/
+        result = queue_disposition(handleData, deviceData, ETag, action, messageHandle);
+    }
+    else
+    {
+        HTTP_PENDING_REQUEST request;
+        if (!prepareDispositionRequest(deviceData, ETag, action, &request))
         {
-            LogError("unable to STRING_construct");
+            result = false;
         }
         else
         {
-            const char* source = IoTHubMessage_GetString(message->messageHandle);
-            if (source == NULL)
+            executeRequest(handleData->httpApiExHandle, &request);
+            result = completeDispositionRequest(&request);
+        }
+    }
+
+    return result;
+}
+
+static void IoTHubTransportHttp_Unregister(IOTHUB_DEVICE_HANDLE deviceHandle)
+{
+    if (deviceHandle == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_044: [ If deviceHandle is NULL, then IoTHubTransportHttp_Unregister shall do nothing. ]*/
+        LogError("Unregister a NULL device handle");
+    }
+    else
+    {
+        HTTPTRANSPORT_PERDEVICE_DATA* deviceHandleData = (HTTPTRANSPORT_PERDEVICE_DATA*)deviceHandle;
+        HTTPTRANSPORT_HANDLE_DATA* handleData = deviceHandleData->transportHandle;
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_045: [ IoTHubTransportHttp_Unregister shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
+        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(deviceHandle);
+        if (listItem == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_046: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
+            LogError("Device Handle [%p] not found in transport", deviceHandle);
+        }
+        else
+        {
+            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_31_020: [ IoTHubTransportHttp_Unregister and IoTHubTransportHttp_Destroy shall first send all the queued dispositions. ]*/
+            if (handleData->pendingDispositions != NULL)
+            {
+                flush_dispositions(handleData);
+            }
+
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_047: [ IoTHubTransportHttp_Unregister shall free all the resources used in the device structure. ]*/
+            destroy_perDeviceData(perDeviceItem);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_048: [ IoTHubTransportHttp_Unregister shall call singlylinkedlist_remove to remove device from devices list. ]*/
+            VECTOR_erase(handleData->perDeviceList, listItem, 1);
+            free(deviceHandleData);
+        }
+    }
+
+    return;
+}
+
+static void destroy_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    VECTOR_destroy(handleData->perDeviceList);
+    handleData->perDeviceList = NULL;
+}
+
+/*Codes_SRS_TRANSPORTMULTITHTTP_17_009: [ IoTHubTransportHttp_Create shall call singlylinkedlist_create to create a list of registered devices. ]*/
+static bool create_perDeviceList(HTTPTRANSPORT_HANDLE_DATA* handleData)
+{
+    bool result;
+    handleData->perDeviceList = VECTOR_create(sizeof(IOTHUB_DEVICE_HANDLE));
+    if (handleData == NULL || handleData->perDeviceList == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_010: [ If creating the list fails, then IoTHubTransportHttp_Create shall fail and return NULL. ]*/
+        result = false;
+    }
+    else
+    {
+        result = true;
+    }
+    return result;
+}
+
+
+static TRANSPORT_LL_HANDLE IoTHubTransportHttp_Create(const IOTHUBTRANSPORT_CONFIG* config)
+{
+    HTTPTRANSPORT_HANDLE_DATA* result;
+    if (config == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_001: [If parameter config is NULL, then IoTHubTransportHttp_Create shall return NULL.]*/
+        LogError("invalid arg (configuration is missing)");
+        result = NULL;
+    }
+    else if (config->upperConfig == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_002: [ If field transportConfig is NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
+        LogError("invalid arg (upperConfig is NULL)");
+        result = NULL;
+    }
+    else if (config->upperConfig->protocol == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
+        LogError("invalid arg (protocol is NULL)");
+        result = NULL;
+    }
+    else if (config->upperConfig->iotHubName == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
+        LogError("invalid arg (iotHubName is NULL)");
+        result = NULL;
+    }
+    else if (config->upperConfig->iotHubSuffix == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_003: [ If fields protocol, iotHubName or iotHubSuffix in transportConfig are NULL, then IoTHubTransportHttp_Create shall return NULL. ]*/
+        LogError("invalid arg (iotHubSuffix is NULL)");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_130: [ IoTHubTransportHttp_Create shall allocate memory for the handle. ]*/
+        result = (HTTPTRANSPORT_HANDLE_DATA*)malloc(sizeof(HTTPTRANSPORT_HANDLE_DATA));
+        if (result == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_131: [ If allocation fails, IoTHubTransportHttp_Create shall fail and return NULL. ]*/
+            LogError("unable to malloc");
+        }
+        else
+        {
+            bool was_hostName_ok = create_hostName(result, config);
+            bool was_httpApiExHandle_ok = was_hostName_ok && create_httpApiExHandle(result, config);
+            bool was_perDeviceList_ok = was_httpApiExHandle_ok && create_perDeviceList(result);
+
+
+            if (was_perDeviceList_ok)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_011: [ Otherwise, IoTHubTransportHttp_Create shall succeed and return a non-NULL value. ]*/
+                result->doBatchedTransfers = false;
+                result->getMinimumPollingTime = DEFAULT_GETMINIMUMPOLLINGTIME;
+                result->adaptivePollingMinTime = 0;
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+                result->workerPool = NULL;
+                result->httpApiExOptions = NULL;
+                result->wereHttpOptionsLost = false;
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+                result->dispositionBatchSize = 0;
+                result->dispositionBatchWindowMs = 0;
+                result->pendingDispositions = NULL;
+                result->dispositionTickCounter = NULL;
+                result->firstDispositionTime = 0;
+            }
+            else
+            {
+                if (was_httpApiExHandle_ok) destroy_httpApiExHandle(result);
+                if (was_hostName_ok) destroy_hostName(result);
+
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+static void IoTHubTransportHttp_Destroy(TRANSPORT_LL_HANDLE handle)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_012: [ IoTHubTransportHttp_Destroy shall do nothing is handle is NULL. ]*/
+    if (handle != NULL)
+    {
+        HTTPTRANSPORT_HANDLE_DATA* handleData = (HTTPTRANSPORT_HANDLE_DATA*)handle;
+        IOTHUB_DEVICE_HANDLE* listItem;
+
+        size_t deviceListSize = VECTOR_size(handleData->perDeviceList);
+
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_020: [ IoTHubTransportHttp_Unregister and IoTHubTransportHttp_Destroy shall first send all the queued dispositions. ]*/
+        if (handleData->pendingDispositions != NULL)
+        {
+            flush_dispositions(handleData);
+            VECTOR_destroy(handleData->pendingDispositions);
+        }
+        if (handleData->dispositionTickCounter != NULL)
+        {
+            tickcounter_destroy(handleData->dispositionTickCounter);
+        }
+
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_013: [ Otherwise, IoTHubTransportHttp_Destroy shall free all the resources currently in use. ]*/
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+        if (handleData->workerPool != NULL)
+        {
+            destroy_worker_pool(handleData->workerPool);
+        }
+        if (handleData->httpApiExOptions != NULL)
+        {
+            OptionHandler_Destroy(handleData->httpApiExOptions);
+        }
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+        for (size_t i = 0; i < deviceListSize; i++)
+        {
+            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA*)(*listItem);
+            destroy_perDeviceData(perDeviceItem);
+            free(perDeviceItem);
+        }
+
+        destroy_hostName((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        destroy_httpApiExHandle((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        destroy_perDeviceList((HTTPTRANSPORT_HANDLE_DATA *)handle);
+        free(handle);
+    }
+}
+
+static int IoTHubTransportHttp_Subscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    int result;
+    if (handle == NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_103: [ If parameter deviceHandle is NULL then IoTHubTransportHttp_Subscribe shall fail and return a non-zero value. ]*/
+        LogError("invalid arg passed to IoTHubTransportHttp_Subscribe");
+        result = __FAILURE__;
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_104: [ IoTHubTransportHttp_Subscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
+        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
+
+        if (listItem == NULL)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_105: [ If the device structure is not found, then this function shall fail and return a non-zero value. ]*/
+            LogError("did not find device in transport handle");
+            result = __FAILURE__;
+        }
+        else
+        {
+            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem;
+
+            perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_106: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork should execute HTTP requests. ]*/
+            perDeviceItem->DoWork_PullMessage = true;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+static void IoTHubTransportHttp_Unsubscribe(IOTHUB_DEVICE_HANDLE handle)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_107: [ If parameter deviceHandle is NULL then IoTHubTransportHttp_Unsubscribe shall fail do nothing. ]*/
+    if (handle != NULL)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_108: [ IoTHubTransportHttp_Unsubscribe shall locate deviceHandle in the transport device list by calling list_find_if. ]*/
+        IOTHUB_DEVICE_HANDLE* listItem = get_perDeviceDataItem(handle);
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_109: [ If the device structure is not found, then this function shall fail and do nothing. ]*/
+        if (listItem != NULL)
+        {
+            HTTPTRANSPORT_PERDEVICE_DATA * perDeviceItem = (HTTPTRANSPORT_PERDEVICE_DATA *)(*listItem);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_110: [ Otherwise, IoTHubTransportHttp_Subscribe shall set the device so that subsequent calls to DoWork shall not execute HTTP requests. ]*/
+            perDeviceItem->DoWork_PullMessage = false;
+        }
+        else
+        {
+            LogError("Device not found to unsuscribe.");
+        }
+    }
+    else
+    {
+        LogError("Null handle passed to Unsuscribe.");
+    }
+}
+
+static int IoTHubTransportHttp_Subscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+{
+    /*Codes_SRS_TRANSPORTMULTITHTTP_02_003: [ IoTHubTransportHttp_Subscribe_DeviceTwin shall return a non-zero value. ]*/
+    (void)handle;
+    int result = __FAILURE__;
+    LogError("IoTHubTransportHttp_Subscribe_DeviceTwin Not supported");
+    return result;
+}
+
+static void IoTHubTransportHttp_Unsubscribe_DeviceTwin(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    /*Codes_SRS_TRANSPORTMULTITHTTP_02_004: [ IoTHubTransportHttp_Unsubscribe_DeviceTwin shall return ]*/
+    LogError("IoTHubTransportHttp_Unsubscribe_DeviceTwin Not supported");
+}
+
+static int IoTHubTransportHttp_Subscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    int result = __FAILURE__;
+    LogError("not implemented (yet)");
+    return result;
+}
+
+static void IoTHubTransportHttp_Unsubscribe_DeviceMethod(IOTHUB_DEVICE_HANDLE handle)
+{
+    (void)handle;
+    LogError("not implemented (yet)");
+}
+
+static int IoTHubTransportHttp_DeviceMethod_Response(IOTHUB_DEVICE_HANDLE handle, METHOD_HANDLE methodId, const unsigned char* response, size_t response_size, int status_response)
+{
+    (void)handle;
+    (void)methodId;
+    (void)response;
+    (void)response_size;
+    (void)status_response;
+    LogError("not implemented (yet)");
+    return __FAILURE__;
+}
+
+/*the batched payload is written directly into 1 buffer per device, the pieces below are the JSON around the encoded content*/
+#define EVENT_JSON_BODY_BEGIN "{\"body\":"
+#define EVENT_JSON_BASE64_ENCODED_FALSE ",\"base64Encoded\":false"
+#define EVENT_JSON_PROPERTIES_BEGIN ",\"properties\":{"
+#define EVENT_JSON_PROPERTY_NAME_BEGIN "\"" IOTHUB_APP_PREFIX
+#define EVENT_JSON_PROPERTY_NAME_END "\":\""
+#define EVENT_JSON_ITEM_END "},"
+#define EVENT_JSON_LITERAL_LENGTH(literal) (sizeof(literal) - 1)
+
+static const char base64Characters[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char hexCharacters[] = "0123456789ABCDEF";
+
+/*the content and the properties of 1 event, as they are in the IOTHUB_MESSAGE_HANDLE (nothing is copied)*/
+typedef struct EVENT_JSON_ITEM_TAG
+{
+    IOTHUBMESSAGE_CONTENT_TYPE contentType;
+    const unsigned char* content;
+    size_t contentSize;
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+} EVENT_JSON_ITEM;
+
+static size_t getBase64EncodedLength(size_t size)
+{
+    return 4 * ((size + 2) / 3);
+}
+
+/*produces the same encoding as Base64_Encode_Bytes, into destination*/
+static unsigned char* writeBase64(unsigned char* destination, const unsigned char* source, size_t size)
+{
+    size_t i;
+    for (i = 0; i + 2 < size; i += 3)
+    {
+        *destination++ = base64Characters[source[i] >> 2];
+        *destination++ = base64Characters[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Characters[((source[i + 1] & 0x0F) << 2) | (source[i + 2] >> 6)];
+        *destination++ = base64Characters[source[i + 2] & 0x3F];
+    }
+
+    if (size - i == 1)
+    {
+        *destination++ = base64Characters[source[i] >> 2];
+        *destination++ = base64Characters[(source[i] & 0x03) << 4];
+        *destination++ = '=';
+        *destination++ = '=';
+    }
+    else if (size - i == 2)
+    {
+        *destination++ = base64Characters[source[i] >> 2];
+        *destination++ = base64Characters[((source[i] & 0x03) << 4) | (source[i + 1] >> 4)];
+        *destination++ = base64Characters[(source[i + 1] & 0x0F) << 2];
+        *destination++ = '=';
+    }
+    return destination;
+}
+
+/*computes the length of the JSON string (quotes included) that STRING_new_JSON would produce*/
+static int getJSONStringLength(const unsigned char* source, size_t size, size_t* length)
+{
+    int result;
+    size_t i;
+    *length = size + 2;
+    for (i = 0; i < size; i++)
+    {
+        if (source[i] >= 128)
+        {
+            break;
+        }
+        else if (source[i] <= 0x1F)
+        {
+            *length += 5;
+        }
+        else if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
+        {
+            *length += 1;
+        }
+    }
+
+    if (i < size)
+    {
+        LogError("invalid character in the message string");
+        result = __FAILURE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+/*produces the same encoding as STRING_new_JSON, into destination*/
+static unsigned char* writeJSONString(unsigned char* destination, const unsigned char* source, size_t size)
+{
+    size_t i;
+    *destination++ = '"';
+    for (i = 0; i < size; i++)
+    {
+        if (source[i] <= 0x1F)
+        {
+            *destination++ = '\\';
+            *destination++ = 'u';
+            *destination++ = '0';
+            *destination++ = '0';
+            *destination++ = hexCharacters[source[i] >> 4];
+            *destination++ = hexCharacters[source[i] & 0x0F];
+        }
+        else
+        {
+            if ((source[i] == '"') || (source[i] == '\\') || (source[i] == '/'))
+            {
+                *destination++ = '\\';
+            }
+            *destination++ = source[i];
+        }
+    }
+    *destination++ = '"';
+    return destination;
+}
+
+static unsigned char* writeLiteral(unsigned char* destination, const char* source, size_t length)
+{
+    (void)memcpy(destination, source, length);
+    return destination + length;
+}
+
+static int getEventJSONItem(PDLIST_ENTRY item, EVENT_JSON_ITEM* jsonItem)
+{
+    int result;
+    IOTHUB_MESSAGE_LIST* message = containingRecord(item, IOTHUB_MESSAGE_LIST, entry);
+
+    jsonItem->contentType = IoTHubMessage_GetContentType(message->messageHandle);
+    switch (jsonItem->contentType)
+    {
+    case IOTHUBMESSAGE_BYTEARRAY:
+    {
+        if (IoTHubMessage_GetByteArray(message->messageHandle, &jsonItem->content, &jsonItem->contentSize) != IOTHUB_MESSAGE_OK)
+        {
+            LogError("unable to get the data for the message.");
+            result = __FAILURE__;
+        }
+        else
+        {
+            result = 0;
+        }
+        break;
+    }
+    case IOTHUBMESSAGE_STRING:
+    {
+        const char* source = IoTHubMessage_GetString(message->messageHandle);
+        if (source == NULL)
+        {
+            LogError("unable to IoTHubMessage_GetString");
+            result = __FAILURE__;
+        }
+        else
+        {
+            jsonItem->content = (const unsigned char*)source;
+            jsonItem->contentSize = strlen(source);
+            result = 0;
+        }
+        break;
+    }
+    default:
+    {
+        LogError("an unknown message type was encountered (%d)", jsonItem->contentType);
+        result = __FAILURE__;
+        break;
+    }
+    }
+
+    /*the properties are read where they are stored, IoTHubMessage_Properties would turn them into a MAP_HANDLE first*/
+    if ((result == 0) &&
+        (IoTHubMessage_GetProperties(message->messageHandle, &jsonItem->keys, &jsonItem->values, &jsonItem->count, NULL) != IOTHUB_MESSAGE_OK))
+    {
+        LogError("error while IoTHubMessage_GetProperties");
+        result = __FAILURE__;
+    }
+    return result;
+}
+
+/*computes how many bytes {"body":...[,"properties":{...}]}, takes in the payload and how much the event adds to the message size, without encoding anything*/
+static int measureEventJSONItem(const EVENT_JSON_ITEM* jsonItem, size_t* encodedSize, size_t* messageSizeContribution)
+{
+    int result;
+    size_t contentLength;
+
+    if (jsonItem->contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        /*"body":"base64 encoding of the message content"*/
+        contentLength = getBase64EncodedLength(jsonItem->contentSize) + 2;
+        result = 0;
+    }
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_057: [If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false}] */
+    else if (getJSONStringLength(jsonItem->content, jsonItem->contentSize, &contentLength) != 0)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        contentLength += EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_BASE64_ENCODED_FALSE);
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        size_t i;
+        *encodedSize = EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_BODY_BEGIN) + contentLength + EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_ITEM_END);
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
+        *messageSizeContribution = jsonItem->contentSize + MAXIMUM_PAYLOAD_OVERHEAD;
+
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_064: [If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload*/
+        if (jsonItem->count > 0)
+        {
+            /*,"properties":{ ... } with a ',' between the properties*/
+            *encodedSize += EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTIES_BEGIN) + jsonItem->count;
+            for (i = 0; i < jsonItem->count; i++)
+            {
+                size_t keyLength = strlen(jsonItem->keys[i]);
+                size_t valueLength = strlen(jsonItem->values[i]);
+                *encodedSize += EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTY_NAME_BEGIN) + keyLength + EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTY_NAME_END) + valueLength + 1;
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_063: [Every property name shall add to the message size the length of the property name + the length of the property value + 16 bytes.] */
+                *messageSizeContribution += keyLength + valueLength + MAXIMUM_PROPERTY_OVERHEAD;
+            }
+        }
+    }
+    return result;
+}
+
+/*writes {"body":"base64 encoding of the message content"[,"properties":{"a":"valueOfA"}]}, - the size of it was already computed by measureEventJSONItem*/
+static unsigned char* writeEventJSONItem(unsigned char* destination, const EVENT_JSON_ITEM* jsonItem)
+{
+    size_t i;
+    destination = writeLiteral(destination, EVENT_JSON_BODY_BEGIN, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_BODY_BEGIN));
+    if (jsonItem->contentType == IOTHUBMESSAGE_BYTEARRAY)
+    {
+        *destination++ = '"';
+        destination = writeBase64(destination, jsonItem->content, jsonItem->contentSize);
+        *destination++ = '"';
+    }
+    else
+    {
+        destination = writeJSONString(destination, jsonItem->content, jsonItem->contentSize);
+        destination = writeLiteral(destination, EVENT_JSON_BASE64_ENCODED_FALSE, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_BASE64_ENCODED_FALSE));
+    }
+
+    /*Codes_SRS_TRANSPORTMULTITHTTP_17_058: [If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2*/
+    if (jsonItem->count > 0)
+    {
+        destination = writeLiteral(destination, EVENT_JSON_PROPERTIES_BEGIN, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTIES_BEGIN));
+        for (i = 0; i < jsonItem->count; i++)
+        {
+            if (i > 0)
             {
-                LogError("unable to IoTHubMessage_GetString");
-                STRING_delete(result);
-                result = NULL;
-            }
-            else
-            {
-                STRING_HANDLE asJson = STRING_new_JSON(source);
-                if (asJson == NULL)
-                {
-                    LogError("unable to STRING_new_JSON");
-                    STRING_delete(result);
-                    result = NULL;
-                }
-                else
-                {
-                    size_t propertiesSize = 0;
-                    if (!(
-                        (STRING_concat_with_STRING(result, asJson) == 0) &&
-                        (STRING_concat(result, ",\"base64Encoded\":false") == 0) &&
-                        (concat_Properties(result, IoTHubMessage_Properties(message->messageHandle), &propertiesSize) == 0) &&
-                        (STRING_concat(result, "},") == 0) /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
-                        ))
-                    {
-                        LogError("unable to STRING_concat_with_STRING");
-                        STRING_delete(result);
-                        result = NULL;
-                    }
-                    else
-                    {
-                        /*result has the intended content*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_062: [The message size is computed from the length of the payload + 384.] */
-                        *messageSizeContribution = strlen(source) + MAXIMUM_PAYLOAD_OVERHEAD + propertiesSize;
-                    }
-                    STRING_delete(asJson);
-                }
+                *destination++ = ',';
             }
+            destination = writeLiteral(destination, EVENT_JSON_PROPERTY_NAME_BEGIN, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTY_NAME_BEGIN));
+            destination = writeLiteral(destination, jsonItem->keys[i], strlen(jsonItem->keys[i]));
+            destination = writeLiteral(destination, EVENT_JSON_PROPERTY_NAME_END, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_PROPERTY_NAME_END));
+            destination = writeLiteral(destination, jsonItem->values[i], strlen(jsonItem->values[i]));
+            *destination++ = '"';
         }
-        break;
+        *destination++ = '}';
     }
-    default:
+
+    /*the last comma shall be replaced by a ']' by DaCr's suggestion (which is awesome enough to receive credits in the source code)*/
+    return writeLiteral(destination, EVENT_JSON_ITEM_END, EVENT_JSON_LITERAL_LENGTH(EVENT_JSON_ITEM_END));
+}
+
+/*makes deviceData->eventBatchBuffer exactly size bytes long, reusing the memory it already has*/
+static int resizeEventBatchBuffer(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, size_t size)
+{
+    int result;
+    if ((deviceData->eventBatchBuffer == NULL) &&
+        ((deviceData->eventBatchBuffer = BUFFER_new()) == NULL))
     {
-        LogError("an unknown message type was encountered (%d)", contentType);
-        result = NULL; /*unknown message type*/
-        break;
+        LogError("unable to BUFFER_new");
+        result = __FAILURE__;
     }
+    else
+    {
+        size_t length = BUFFER_length(deviceData->eventBatchBuffer);
+        if (size > length)
+        {
+            result = BUFFER_enlarge(deviceData->eventBatchBuffer, size - length);
+        }
+        else if (size < length)
+        {
+            result = BUFFER_shrink(deviceData->eventBatchBuffer, length - size, false);
+        }
+        else
+        {
+            result = 0;
+        }
+
+        if (result != 0)
+        {
+            LogError("unable to resize the batch buffer to %lu bytes", (unsigned long)size);
+            result = __FAILURE__;
+        }
     }
     return result;
 }
 
+static void reversePutListBackIn(HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
+{
+    /*this function puts the batched events back at the head of waitingToSend, it reverses the effects of a not-able-to-send situation*/
+    DList_AppendTailList(deviceData->waitingToSend->Flink, &(deviceData->eventConfirmations));
+    DList_RemoveEntryList(&(deviceData->eventConfirmations));
+    DList_InitializeListHead(&(deviceData->eventConfirmations));
+    /*Codes_SRS_TRANSPORTMULTITHTTP_31_023: [ Events put back in waitingToSend shall be reported with IoTHubClientCore_LL_MessagesPutBack. ]*/
+    IoTHubClientCore_LL_MessagesPutBack(deviceData->iotHubClientHandle);
+}
+
 #define MAKE_PAYLOAD_RESULT_VALUES \
     MAKE_PAYLOAD_OK, /*returned when there is a payload to be later send by HTTP*/ \
     MAKE_PAYLOAD_NO_ITEMS, /*returned when there are no items to be send*/ \
@@ -1223,134 +2095,96 @@ static STRING_HANDLE make1EventJSONitem(PDLIST_ENTRY item, size_t *messageSizeCo
 
 DEFINE_ENUM(MAKE_PAYLOAD_RESULT, MAKE_PAYLOAD_RESULT_VALUES);
 
-/*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload*/
+/*this function assembles several {"body":"base64 encoding of the message content"," base64Encoded": true} into 1 payload, in deviceData->eventBatchBuffer*/
+/*the events are measured first, so the buffer is sized once and an event that does not fit is never encoded*/
 /*Codes_SRS_TRANSPORTMULTITHTTP_17_056: [IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...]]*/
-static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, STRING_HANDLE* payload)
+static MAKE_PAYLOAD_RESULT makePayload(HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
 {
     MAKE_PAYLOAD_RESULT result;
+    EVENT_JSON_ITEM jsonItem;
+    PDLIST_ENTRY actual;
     size_t allMessagesSize = 0;
-    *payload = STRING_construct("[");
-    if (*payload == NULL)
+    size_t payloadSize = 1; /*because the opening '['*/
+    size_t itemCount = 0;
+    bool doesNotFit = false;
+
+    for (actual = deviceData->waitingToSend->Flink; actual != deviceData->waitingToSend; actual = actual->Flink)
+    {
+        size_t encodedSize;
+        size_t messageSize;
+        if ((getEventJSONItem(actual, &jsonItem) != 0) ||
+            (measureEventJSONItem(&jsonItem, &encodedSize, &messageSize) != 0))
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
+            break;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
+        else if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
+        {
+            doesNotFit = true;
+            break;
+        }
+        else
+        {
+            allMessagesSize += messageSize;
+            payloadSize += encodedSize;
+            itemCount++;
+        }
+    }
+
+    if (itemCount == 0)
+    {
+        if (doesNotFit)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
+            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend);
+            DList_InsertTailList(&(deviceData->eventConfirmations), head);
+            result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
+        }
+        else
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
+            result = MAKE_PAYLOAD_ERROR;
+        }
+    }
+    else if (resizeEventBatchBuffer(deviceData, payloadSize) != 0)
     {
-        LogError("unable to STRING_construct");
+        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
         result = MAKE_PAYLOAD_ERROR;
     }
     else
     {
-        bool isFirst = true;
-        PDLIST_ENTRY actual;
-        bool keepGoing = true; /*keepGoing gets sometimes to false from within the loop*/
-                               /*either all the items enter the list or only some*/
+        unsigned char* destination = BUFFER_u_char(deviceData->eventBatchBuffer);
+        size_t i;
+
+        *destination++ = '[';
         result = MAKE_PAYLOAD_OK; /*optimistically initializing it*/
-        while (keepGoing && ((actual = deviceData->waitingToSend->Flink) != deviceData->waitingToSend))
+        for (i = 0; i < itemCount; i++)
         {
-            size_t messageSize;
-            STRING_HANDLE temp = make1EventJSONitem(actual, &messageSize);
-            if (isFirst)
-            {
-                isFirst = false;
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                if (temp == NULL) /*first item failed to create, nothing to send*/
-                {
-                    result = MAKE_PAYLOAD_ERROR;
-                    STRING_delete(*payload);
-                    *payload = NULL;
-                    keepGoing = false;
-                }
-                else
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_065: [If the oldest message in waitingToSend causes the message size to exceed the message size limit then it shall be removed from waitingToSend, and IoTHubClientCore_LL_SendComplete shall be called. Parameter PDLIST_ENTRY completed shall point to a list containing only the oldest item, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_BATCHSTATE_FAILED.]*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_061: [The message size shall be limited to 255KB - 1 byte.]*/
-                    if (messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        result = MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT;
-                        STRING_delete(*payload);
-                        *payload = NULL;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        if (STRING_concat_with_STRING(*payload, temp) != 0)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            result = MAKE_PAYLOAD_ERROR;
-                            STRING_delete(*payload);
-                            *payload = NULL;
-                            keepGoing = false;
-                        }
-                        else
-                        {
-                            /*first item was put nicely in the payload*/
-                            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                            DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                            allMessagesSize += messageSize;
-                        }
-                    }
-                    STRING_delete(temp);
-                }
-            }
-            else
+            PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend);
+            DList_InsertTailList(&(deviceData->eventConfirmations), head);
+            if (getEventJSONItem(head, &jsonItem) != 0)
             {
-                /*there is at least 1 item already in the payload*/
-                if (temp == NULL)
-                {
-                    /*there are multiple payloads encoded, the last one had an internal error, just go with those - closing the payload happens "after the loop"*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                    result = MAKE_PAYLOAD_OK;
-                    keepGoing = false;
-                }
-                else
-                {
-                    if (allMessagesSize + messageSize > MAXIMUM_MESSAGE_SIZE)
-                    {
-                        /*this item doesn't make it to the payload, but the payload is valid so far*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else if (STRING_concat_with_STRING(*payload, temp) != 0)
-                    {
-                        /*should still send what there is so far...*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_066: [If at any point during construction of the string there are errors, IoTHubTransportHttp_DoWork shall use the so far constructed string as payload.]*/
-                        result = MAKE_PAYLOAD_OK;
-                        keepGoing = false;
-                    }
-                    else
-                    {
-                        /*cool, the payload made it there, let's continue... */
-                        PDLIST_ENTRY head = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                        DList_InsertTailList(&(deviceData->eventConfirmations), head);
-                        allMessagesSize += messageSize;
-                    }
-                    STRING_delete(temp);
-                }
+                /*the message has not changed since it was measured, so this is not expected to happen*/
+                LogError("unable to read an event that was already measured");
+                reversePutListBackIn(deviceData);
+                result = MAKE_PAYLOAD_ERROR;
+                break;
             }
+            destination = writeEventJSONItem(destination, &jsonItem);
         }
 
-        /*closing the payload*/
         if (result == MAKE_PAYLOAD_OK)
         {
-            ((char*)STRING_c_str(*payload))[STRING_length(*payload) - 1] = ']'; /*TODO - do this in STRING_HANDLE*/
-        }
-        else
-        {
-            /*no need to close anything*/
+            /*closing the payload*/
+            destination[-1] = ']';
         }
     }
     return result;
 }
 
-static void reversePutListBackIn(PDLIST_ENTRY source, PDLIST_ENTRY destination)
-{
-    /*this function takes a list, and inserts it in another list. When done in the context of this file, it reverses the effects of a not-able-to-send situation*/
-    DList_AppendTailList(destination->Flink, source);
-    DList_RemoveEntryList(source);
-    DList_InitializeListHead(source);
-}
-
-static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+/*builds the event request of the device, when there is one deviceData->eventRequest.isPending is set and completeEvent takes it from there*/
+static void prepareEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
 {
 
     if (DList_IsListEmpty(deviceData->waitingToSend))
@@ -1371,67 +2205,22 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
             else
             {
                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_059: [It shall inspect the "waitingToSend" DLIST passed in config structure.] */
-                STRING_HANDLE payload;
-                switch (makePayload(deviceData, &payload))
+                switch (makePayload(deviceData))
                 {
                 case MAKE_PAYLOAD_OK:
                 {
                     /*Codes_SRS_TRANSPORTMULTITHTTP_17_068: [Once a final payload has been obtained, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters:] */
-                    BUFFER_HANDLE temp = BUFFER_new();
-                    if (temp == NULL)
-                    {
-                        LogError("unable to BUFFER_new");
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                        reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                    }
-                    else
-                    {
-                        if (BUFFER_build(temp, (const unsigned char*)STRING_c_str(payload), STRING_length(payload)) != 0)
-                        {
-                            LogError("unable to BUFFER_build");
-                            //items go back to waitingToSend
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_067: [If there is no valid payload, IoTHubTransportHttp_DoWork shall advance to the next activity.]*/
-                            reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                        }
-                        else
-                        {
-                            unsigned int statusCode;
-                            if (HTTPAPIEX_SAS_ExecuteRequest(
-                                deviceData->sasObject,
-                                handleData->httpApiExHandle,
-                                HTTPAPI_REQUEST_POST,
-                                STRING_c_str(deviceData->eventHTTPrelativePath),
-                                deviceData->eventHTTPrequestHeaders,
-                                temp,
-                                &statusCode,
-                                NULL,
-                                NULL
-                            ) != HTTPAPIEX_OK)
-                            {
-                                LogError("unable to HTTPAPIEX_ExecuteRequest");
-                                //items go back to waitingToSend
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                            }
-                            else
-                            {
-                                if (statusCode < 300)
-                                {
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
-                                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
-                                }
-                                else
-                                {
-                                    //items go back to waitingToSend
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                    LogError("unexpected HTTP status code (%u)", statusCode);
-                                    reversePutListBackIn(&(deviceData->eventConfirmations), deviceData->waitingToSend);
-                                }
-                            }
-                        }
-                        BUFFER_delete(temp);
-                    }
-                    STRING_delete(payload);
+                    HTTP_PENDING_REQUEST* request = &(deviceData->eventRequest);
+                    request->isBatch = true;
+                    request->useSasObject = true;
+                    request->sasObject = deviceData->sasObject;
+                    request->requestType = HTTPAPI_REQUEST_POST;
+                    request->relativePath = deviceData->eventHTTPrelativePath;
+                    request->requestHeaders = deviceData->eventHTTPrequestHeaders;
+                    request->requestContent = deviceData->eventBatchBuffer;
+                    request->responseHeaders = NULL;
+                    request->responseContent = NULL;
+                    request->isPending = true;
                     break;
                 }
                 case MAKE_PAYLOAD_FIRST_ITEM_DOES_NOT_FIT:
@@ -1640,254 +2429,106 @@ static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVI
                                         }
                                         else
                                         {
-                                            unsigned int statusCode = 0;
-                                            HTTPAPIEX_RESULT r;
-                                            if (deviceData->deviceSasToken != NULL)
+                                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+                                            if ((deviceData->deviceSasToken != NULL) &&
+                                                (HTTPHeaders_ReplaceHeaderNameValuePair(clonedEventHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK))
                                             {
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                                                if (HTTPHeaders_ReplaceHeaderNameValuePair(clonedEventHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                                                {
-                                                    r = HTTPAPIEX_ERROR;
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                                                    LogError("Unable to replace the old SAS Token.");
-                                                }
-
-                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
-                                                else if ((r = HTTPAPIEX_ExecuteRequest(
-                                                    handleData->httpApiExHandle,
-                                                    HTTPAPI_REQUEST_POST,
-                                                    STRING_c_str(deviceData->eventHTTPrelativePath),
-                                                    clonedEventHTTPrequestHeaders,
-                                                    toBeSend,
-                                                    &statusCode,
-                                                    NULL,
-                                                    NULL
-                                                )) != HTTPAPIEX_OK)
-                                                {
-                                                    LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                                                }
+                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+                                                LogError("Unable to replace the old SAS Token.");
                                             }
                                             else
                                             {
+                                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_003: [If a deviceSasToken exists, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_ExecuteRequest passing the following parameters] */
                                                 /*Codes_SRS_TRANSPORTMULTITHTTP_17_080: [If a deviceSasToken does not exist, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters] */
-                                                if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                                                    deviceData->sasObject,
-                                                    handleData->httpApiExHandle,
-                                                    HTTPAPI_REQUEST_POST,
-                                                    STRING_c_str(deviceData->eventHTTPrelativePath),
-                                                    clonedEventHTTPrequestHeaders,
-                                                    toBeSend,
-                                                    &statusCode,
-                                                    NULL,
-                                                    NULL
-                                                )) != HTTPAPIEX_OK)
-                                                {
-                                                    LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
-                                                }
-                                            }
-                                            if (r == HTTPAPIEX_OK)
-                                            {
-                                                if (statusCode < 300)
-                                                {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend.] */
-                                                    PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*actually this is the same as "actual", but now it is removed*/
-                                                    DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
-                                                    IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK); /*takes care of emptying the list too*/
-                                                }
-                                                else
-                                                {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_081: [If HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
-                                                    LogError("unexpected HTTP status code (%u)", statusCode);
-                                                }
+                                                HTTP_PENDING_REQUEST* request = &(deviceData->eventRequest);
+                                                request->isBatch = false;
+                                                request->useSasObject = (deviceData->deviceSasToken == NULL);
+                                                request->sasObject = deviceData->sasObject;
+                                                request->requestType = HTTPAPI_REQUEST_POST;
+                                                request->relativePath = deviceData->eventHTTPrelativePath;
+                                                request->requestHeaders = clonedEventHTTPrequestHeaders; /*from now on owned by the request*/
+                                                request->requestContent = toBeSend; /*from now on owned by the request*/
+                                                request->responseHeaders = NULL;
+                                                request->responseContent = NULL;
+                                                request->isPending = true;
                                             }
                                         }
-                                        BUFFER_delete(toBeSend);
+                                        if (!deviceData->eventRequest.isPending)
+                                        {
+                                            BUFFER_delete(toBeSend);
+                                        }
                                     }
                                 }
                             }
                         }
-                        HTTPHeaders_Free(clonedEventHTTPrequestHeaders);
-                    }
-                }
-            }
-        }
-    }
-}
-
-static bool abandonOrAcceptMessage(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, const char* ETag, IOTHUBMESSAGE_DISPOSITION_RESULT action)
-{
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_097: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
-    -requestType: POST
-    -relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"
-    - requestHttpHeadersHandle: an HTTP headers instance containing the following
-    Authorization: " "
-    If-Match: value of ETag
-    - requestContent: NULL
-    - statusCode: a pointer to unsigned int which might be examined for logging
-    - responseHeadearsHandle: NULL
-    - responseContent: NULL]*/
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_099: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
-    -requestType: DELETE
-    -relativePath: abandon relative path begin + value of ETag + "?api-version=2016-11-14"
-    - requestHttpHeadersHandle: an HTTP headers instance containing the following
-    Authorization: " "
-    If-Match: value of ETag
-    - requestContent: NULL
-    - statusCode: a pointer to unsigned int which might be used by logging
-    - responseHeadearsHandle: NULL
-    - responseContent: NULL]*/
-    /*Codes_SRS_TRANSPORTMULTITHTTP_17_101: [_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest with the following parameters:
-    -requestType: DELETE
-    -relativePath: abandon relative path begin + value of ETag +"?api-version=2016-11-14" + "&reject"
-    - requestHttpHeadersHandle: an HTTP headers instance containing the following
-    Authorization: " "
-    If-Match: value of ETag
-    - requestContent: NULL
-    - statusCode: a pointer to unsigned int which might be used by logging
-    - responseHeadearsHandle: NULL
-    - responseContent: NULL]*/
-
-    bool result;
-    STRING_HANDLE fullAbandonRelativePath = STRING_clone(deviceData->abandonHTTPrelativePathBegin);
-    if (fullAbandonRelativePath == NULL)
-    {
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-        LogError("unable to STRING_clone");
-        result = false;
-    }
-    else
-    {
-        STRING_HANDLE ETagUnquoted = STRING_construct_n(ETag + 1, strlen(ETag) - 2); /*skip first character which is '"' and the last one (which is also '"')*/
-        if (ETagUnquoted == NULL)
-        {
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-            /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-            LogError("unable to STRING_construct_n");
-            result = false;
-        }
-        else
-        {
-            if (!(
-                (STRING_concat_with_STRING(fullAbandonRelativePath, ETagUnquoted) == 0) &&
-                (STRING_concat(fullAbandonRelativePath, (action == IOTHUBMESSAGE_ABANDONED) ? "/abandon" API_VERSION : ((action == IOTHUBMESSAGE_REJECTED) ? API_VERSION "&reject" : API_VERSION)) == 0)
-                ))
-            {
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                LogError("unable to STRING_concat");
-                result = false;
-            }
-            else
-            {
-                HTTP_HEADERS_HANDLE abandonRequestHttpHeaders = HTTPHeaders_Alloc();
-                if (abandonRequestHttpHeaders == NULL)
-                {
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                    LogError("unable to HTTPHeaders_Alloc");
-                    result = false;
-                }
-                else
-                {
-                    if (!(
-                        (addUserAgentHeaderInfo(deviceData->iotHubClientHandle, abandonRequestHttpHeaders) == HTTP_HEADERS_OK) &&
-                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", " ") == HTTP_HEADERS_OK) &&
-                        (HTTPHeaders_AddHeaderNameValuePair(abandonRequestHttpHeaders, "If-Match", ETag) == HTTP_HEADERS_OK)
-                        ))
-                    {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                        LogError("unable to HTTPHeaders_AddHeaderNameValuePair");
-                        result = false;
-                    }
-                    else
-                    {
-                        unsigned int statusCode = 0;
-                        HTTPAPIEX_RESULT r;
-                        if (deviceData->deviceSasToken != NULL)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                            if (HTTPHeaders_ReplaceHeaderNameValuePair(abandonRequestHttpHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                            {
-                                r = HTTPAPIEX_ERROR;
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                                LogError("Unable to replace the old SAS Token.");
-                                result = false;
-                            }
-                            else if ((r = HTTPAPIEX_ExecuteRequest(
-                                handleData->httpApiExHandle,
-                                (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
-                                STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
-                                abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
-                                NULL,                                               /*- requestContent: NULL                                                                                                   */
-                                &statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
-                                NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
-                                NULL                                                /*- responseContent: NULL]                                                                                                 */
-                            )) != HTTPAPIEX_OK)
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                                result = false;
-                            }
-                        }
-                        else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                            deviceData->sasObject,
-                            handleData->httpApiExHandle,
-                            (action == IOTHUBMESSAGE_ABANDONED) ? HTTPAPI_REQUEST_POST : HTTPAPI_REQUEST_DELETE,                               /*-requestType: POST                                                                                                       */
-                            STRING_c_str(fullAbandonRelativePath),              /*-relativePath: abandon relative path begin (as created by _Create) + value of ETag + "/abandon?api-version=2016-11-14"   */
-                            abandonRequestHttpHeaders,                          /*- requestHttpHeadersHandle: an HTTP headers instance containing the following                                            */
-                            NULL,                                               /*- requestContent: NULL                                                                                                   */
-                            &statusCode,                                         /*- statusCode: a pointer to unsigned int which might be examined for logging                                              */
-                            NULL,                                               /*- responseHeadearsHandle: NULL                                                                                           */
-                            NULL                                                /*- responseContent: NULL]                                                                                                 */
-                        )) != HTTPAPIEX_OK)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                            LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
-                            result = false;
-                        }
-                        if (r == HTTPAPIEX_OK)
-                        {
-                            if (statusCode != 204)
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                LogError("unexpected status code returned %u (was expecting 204)", statusCode);
-                                result = false;
-                            }
-                            else
-                            {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_098: [Abandoning the message is considered successful if the HTTPAPIEX_SAS_ExecuteRequest doesn't fail and the statusCode is 204.]*/
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_100: [Accepting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_102: [Rejecting a message is successful when HTTPAPIEX_SAS_ExecuteRequest completes successfully and the status code is 204.] */
-                                /*all is fine*/
-                                result = true;
-                            }
-                        }
-                        else
+                        if (!deviceData->eventRequest.isPending)
                         {
-                            result = false;
+                            HTTPHeaders_Free(clonedEventHTTPrequestHeaders);
                         }
                     }
-                    HTTPHeaders_Free(abandonRequestHttpHeaders);
                 }
             }
-            STRING_delete(ETagUnquoted);
         }
-        STRING_delete(fullAbandonRelativePath);
     }
-    return result;
+}
+
+/*processes the outcome of the request built by prepareEvent, on the DoWork thread*/
+static void completeEvent(HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    HTTP_PENDING_REQUEST* request = &(deviceData->eventRequest);
+    request->isPending = false;
+
+    if (request->isBatch)
+    {
+        if (request->result != HTTPAPIEX_OK)
+        {
+            //items go back to waitingToSend
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+            reversePutListBackIn(deviceData);
+        }
+        else if (request->statusCode < 300)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_070: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list containing all the items batched, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The batched items shall be removed from waitingToSend.] */
+            IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK);
+        }
+        else
+        {
+            //items go back to waitingToSend
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_069: [if HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+            LogError("unexpected HTTP status code (%u)", request->statusCode);
+            reversePutListBackIn(deviceData);
+        }
+    }
+    else
+    {
+        if (request->result == HTTPAPIEX_OK)
+        {
+            if (request->statusCode < 300)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_082: [If HTTPAPIEX_SAS_ExecuteRequest does not fail and http status code <300 then IoTHubTransportHttp_DoWork shall call IoTHubClientCore_LL_SendComplete. Parameter PDLIST_ENTRY completed shall point to a list the item send, and parameter IOTHUB_CLIENT_CONFIRMATION_RESULT result shall be set to IOTHUB_CLIENT_CONFIRMATION_OK. The item shall be removed from waitingToSend.] */
+                PDLIST_ENTRY justSent = DList_RemoveHeadList(deviceData->waitingToSend); /*still the message the request was built from, new messages only go to the tail*/
+                DList_InsertTailList(&(deviceData->eventConfirmations), justSent);
+                IoTHubClientCore_LL_SendComplete(iotHubClientHandle, &(deviceData->eventConfirmations), IOTHUB_CLIENT_CONFIRMATION_OK); /*takes care of emptying the list too*/
+            }
+            else
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_081: [If HTTPAPIEX_SAS_ExecuteRequest fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried).] */
+                LogError("unexpected HTTP status code (%u)", request->statusCode);
+            }
+        }
+        BUFFER_delete(request->requestContent);
+        HTTPHeaders_Free(request->requestHeaders);
+    }
+}
+
+static void DoEvent(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    prepareEvent(handleData, deviceData, iotHubClientHandle);
+    if (deviceData->eventRequest.isPending)
+    {
+        executeRequest(handleData->httpApiExHandle, &(deviceData->eventRequest));
+        completeEvent(deviceData, iotHubClientHandle);
+    }
 }
 
 static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SendMessageDisposition(MESSAGE_CALLBACK_INFO* message_data, IOTHUBMESSAGE_DISPOSITION_RESULT disposition)
@@ -1926,7 +2567,7 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SendMessageDisposition(MESSAGE_C
                 }
                 else
                 {
-                    if (abandonOrAcceptMessage(tc->handleData, tc->deviceData, tc->etagValue, disposition))
+                    if (abandonOrAcceptMessage(tc->handleData, tc->deviceData, tc->etagValue, disposition, message_data->messageHandle))
                     {
                         result = IOTHUB_CLIENT_OK;
                     }
@@ -1998,7 +2639,8 @@ static MESSAGE_CALLBACK_INFO* MESSAGE_CALLBACK_INFO_Create(IOTHUB_MESSAGE_HANDLE
     return result;
 }
 
-static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+/*builds the C2D poll of the device, when there is one deviceData->messageRequest.isPending is set and completeMessages takes it from there*/
+static void prepareMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData)
 {
     /*Codes_SRS_TRANSPORTMULTITHTTP_17_083: [ If device is not subscribed then _DoWork shall advance to the next action. ] */
     if (deviceData->DoWork_PullMessage)
@@ -2006,8 +2648,10 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_123: [After client creation, the first GET shall be allowed no matter what the value of GetMinimumPollingTime.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_124: [If time is not available then all calls shall be treated as if they are the first one.] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_122: [A GET request that happens earlier than GetMinimumPollingTime shall be ignored.] */
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_011: [ When "http_adaptive_polling_min_time" is not 0, the delay of the device computed after its last poll shall be used instead of GetMinimumPollingTime. ]*/
         time_t timeNow = get_time(NULL);
-        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > handleData->getMinimumPollingTime);
+        unsigned int pollingTime = (handleData->adaptivePollingMinTime == 0) ? handleData->getMinimumPollingTime : deviceData->pollDelay;
+        bool isPollingAllowed = deviceData->isFirstPoll || (timeNow == (time_t)(-1)) || (get_difftime(timeNow, deviceData->lastPollTime) > pollingTime);
         if (isPollingAllowed)
         {
             HTTP_HEADERS_HANDLE responseHTTPHeaders = HTTPHeaders_Alloc();
@@ -2026,276 +2670,321 @@ static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERD
                 }
                 else
                 {
-                    unsigned int statusCode = 0;
-                    HTTPAPIEX_RESULT r;
-                    if (deviceData->deviceSasToken != NULL)
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
+                    if ((deviceData->deviceSasToken != NULL) &&
+                        (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK))
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_001: [if a deviceSasToken exists, HTTPHeaders_ReplaceHeaderNameValuePair shall be invoked with "Authorization" as its second argument and STRING_c_str (deviceSasToken) as its third argument.]*/
-                        if (HTTPHeaders_ReplaceHeaderNameValuePair(deviceData->messageHTTPrequestHeaders, "Authorization", STRING_c_str(deviceData->deviceSasToken)) != HTTP_HEADERS_OK)
-                        {
-                            r = HTTPAPIEX_ERROR;
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
-                            LogError("Unable to replace the old SAS Token.");
-                        }
-                        else if ((r = HTTPAPIEX_ExecuteRequest(
-                            handleData->httpApiExHandle,
-                            HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-                            STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-                            deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-                            NULL,                                                           /*requestContent: NULL*/
-                            &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-                            responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-                            responseContent                                                 /*responseContent: a new instance of buffer*/
-                        )) != HTTPAPIEX_OK)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                            LogError("Unable to HTTPAPIEX_ExecuteRequest.");
-                        }
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_03_002: [If the result of the invocation of HTTPHeaders_ReplaceHeaderNameValuePair is NOT HTTP_HEADERS_OK then fallthrough.]*/
+                        LogError("Unable to replace the old SAS Token.");
                     }
-
-                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
-                    requestType: GET
-                    relativePath: the message HTTP relative path
-                    requestHttpHeadersHandle: message HTTP request headers created by _Create
-                    requestContent: NULL
-                    statusCode: a pointer to unsigned int which shall be later examined
-                    responseHeadearsHandle: a new instance of HTTP headers
-                    responseContent: a new instance of buffer]
-                    */
-                    else if ((r = HTTPAPIEX_SAS_ExecuteRequest(
-                        deviceData->sasObject,
-                        handleData->httpApiExHandle,
-                        HTTPAPI_REQUEST_GET,                                            /*requestType: GET*/
-                        STRING_c_str(deviceData->messageHTTPrelativePath),         /*relativePath: the message HTTP relative path*/
-                        deviceData->messageHTTPrequestHeaders,                     /*requestHttpHeadersHandle: message HTTP request headers created by _Create*/
-                        NULL,                                                           /*requestContent: NULL*/
-                        &statusCode,                                                    /*statusCode: a pointer to unsigned int which shall be later examined*/
-                        responseHTTPHeaders,                                            /*responseHeadearsHandle: a new instance of HTTP headers*/
-                        responseContent                                                 /*responseContent: a new instance of buffer*/
-                    )) != HTTPAPIEX_OK)
+                    else
                     {
-                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_085: [If the call to HTTPAPIEX_SAS_ExecuteRequest did not executed successfully or building any part of the prerequisites of the call fails, then _DoWork shall advance to the next action in this description.] */
-                        LogError("unable to HTTPAPIEX_SAS_ExecuteRequest");
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_084: [Otherwise, IoTHubTransportHttp_DoWork shall call HTTPAPIEX_SAS_ExecuteRequest passing the following parameters
+                        requestType: GET
+                        relativePath: the message HTTP relative path
+                        requestHttpHeadersHandle: message HTTP request headers created by _Create
+                        requestContent: NULL
+                        statusCode: a pointer to unsigned int which shall be later examined
+                        responseHeadearsHandle: a new instance of HTTP headers
+                        responseContent: a new instance of buffer]
+                        */
+                        HTTP_PENDING_REQUEST* request = &(deviceData->messageRequest);
+                        request->isBatch = false;
+                        request->useSasObject = (deviceData->deviceSasToken == NULL);
+                        request->sasObject = deviceData->sasObject;
+                        request->requestType = HTTPAPI_REQUEST_GET;
+                        request->relativePath = deviceData->messageHTTPrelativePath;
+                        request->requestHeaders = deviceData->messageHTTPrequestHeaders;
+                        request->requestContent = NULL;
+                        request->responseHeaders = responseHTTPHeaders; /*from now on owned by the request*/
+                        request->responseContent = responseContent; /*from now on owned by the request*/
+                        request->pollTime = timeNow;
+                        request->isPending = true;
                     }
-                    if (r == HTTPAPIEX_OK)
+                    if (!deviceData->messageRequest.isPending)
                     {
-                        /*HTTP dialogue was succesfull*/
-                        if (timeNow == (time_t)(-1))
-                        {
-                            deviceData->isFirstPoll = true;
-                        }
-                        else
-                        {
-                            deviceData->isFirstPoll = false;
-                            deviceData->lastPollTime = timeNow;
-                        }
-                        if (statusCode == 204)
-                        {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-                            /*this is an expected status code, means "no commands", but logging that creates panic*/
+                        BUFFER_delete(responseContent);
+                    }
+                }
+                if (!deviceData->messageRequest.isPending)
+                {
+                    HTTPHeaders_Free(responseHTTPHeaders);
+                }
+            }
+        }
+        else
+        {
+            /*isPollingAllowed is false... */
+            /*do nothing "shall be ignored*/
+        }
+    }
+}
 
-                            /*do nothing, advance to next action*/
-                        }
-                        else if (statusCode != 200)
+/*adaptive polling: a device that just got a message is likely to get more soon, so it goes back to the shortest delay.
+Polls answered with 204 double the backoff up to GetMinimumPollingTime and the delay is drawn at random in its upper half, which
+keeps devices registered at the same time from polling in lockstep*/
+static void schedule_next_poll(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, bool wasMessageReceived)
+{
+    unsigned int minTime = handleData->adaptivePollingMinTime;
+    unsigned int maxTime = (handleData->getMinimumPollingTime > minTime) ? handleData->getMinimumPollingTime : minTime;
+
+    if (wasMessageReceived)
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_012: [ After a poll that returned a message, the next poll of the device shall happen "http_adaptive_polling_min_time" seconds later. ]*/
+        deviceData->pollBackoff = minTime;
+        deviceData->pollDelay = minTime;
+    }
+    else
+    {
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_013: [ After a poll that the service answered with 204 (no message) the backoff of the device shall double, without going under "http_adaptive_polling_min_time" nor over GetMinimumPollingTime, and the next poll shall happen a random number of seconds between half the backoff and the backoff later. ]*/
+        unsigned int backoff = (deviceData->pollBackoff > maxTime / 2) ? maxTime : deviceData->pollBackoff * 2;
+        unsigned int halfBackoff;
+        if (backoff < minTime)
+        {
+            backoff = minTime;
+        }
+        halfBackoff = backoff / 2;
+        deviceData->pollBackoff = backoff;
+        deviceData->pollDelay = halfBackoff + (unsigned int)rand() % (backoff - halfBackoff + 1);
+        if (deviceData->pollDelay < minTime)
+        {
+            deviceData->pollDelay = minTime;
+        }
+    }
+}
+
+/*processes the outcome of the poll built by prepareMessages, on the DoWork thread. Message dispositions are sent from here, on handleData->httpApiExHandle*/
+static void completeMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    HTTP_PENDING_REQUEST* request = &(deviceData->messageRequest);
+    request->isPending = false;
+
+    if (request->result == HTTPAPIEX_OK)
+    {
+        /*HTTP dialogue was succesfull*/
+        if (request->pollTime == (time_t)(-1))
+        {
+            deviceData->isFirstPoll = true;
+        }
+        else
+        {
+            deviceData->isFirstPoll = false;
+            deviceData->lastPollTime = request->pollTime;
+        }
+        if ((handleData->adaptivePollingMinTime != 0) &&
+            ((request->statusCode == 200) || (request->statusCode == 204)))
+        {
+            /*any other status code says nothing about the traffic of the device, the schedule stays as it was*/
+            schedule_next_poll(handleData, deviceData, request->statusCode == 200);
+        }
+        if (request->statusCode == 204)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+            /*this is an expected status code, means "no commands", but logging that creates panic*/
+
+            /*do nothing, advance to next action*/
+        }
+        else if (request->statusCode != 200)
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
+            LogError("expected status code was 200, but actually was received %u... moving on", request->statusCode);
+        }
+        else
+        {
+            /*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
+            const char* etagValue = HTTPHeaders_FindHeaderValue(request->responseHeaders, "ETag");
+            if (etagValue == NULL)
+            {
+                LogError("unable to find a received header called \"E-Tag\"");
+            }
+            else
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
+                size_t etagsize = strlen(etagValue);
+                if (
+                    (etagsize < 2) ||
+                    (etagValue[0] != '"') ||
+                    (etagValue[etagsize - 1] != '"')
+                    )
+                {
+                    LogError("ETag is not a valid quoted string");
+                }
+                else
+                {
+                    const unsigned char* resp_content;
+                    size_t resp_len;
+                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
+                    resp_content = BUFFER_u_char(request->responseContent);
+                    resp_len = BUFFER_length(request->responseContent);
+                    IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(resp_content, resp_len);
+                    if (receivedMessage == NULL)
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
+                        LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
+                        if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED, NULL))
                         {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_086: [If the HTTPAPIEX_SAS_ExecuteRequest executed successfully then status code shall be examined. Any status code different than 200 causes _DoWork to advance to the next action.] */
-                            LogError("expected status code was 200, but actually was received %u... moving on", statusCode);
+                            LogError("HTTP Transport layer failed to report ABANDON disposition");
                         }
-                        else
+                    }
+                    else
+                    {
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
+                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
+                        size_t nHeaders;
+                        if (HTTPHeaders_GetHeaderCount(request->responseHeaders, &nHeaders) != HTTP_HEADERS_OK)
                         {
-                            /*Codes_SRS_TRANSPORTMULTITHTTP_17_087: [If status code is 200, then _DoWork shall make a copy of the value of the "ETag" http header.]*/
-                            const char* etagValue = HTTPHeaders_FindHeaderValue(responseHTTPHeaders, "ETag");
-                            if (etagValue == NULL)
+                            LogError("unable to get the count of HTTP headers");
+                            if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED, NULL))
                             {
-                                LogError("unable to find a received header called \"E-Tag\"");
+                                LogError("HTTP Transport layer failed to report ABANDON disposition");
                             }
-                            else
+                        }
+                        else
+                        {
+                            size_t i;
+                            MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
+                            for (i = 0; i < nHeaders; i++)
                             {
-                                /*Codes_SRS_TRANSPORTMULTITHTTP_17_088: [If no such header is found or is invalid, then _DoWork shall advance to the next action.]*/
-                                size_t etagsize = strlen(etagValue);
-                                if (
-                                    (etagsize < 2) ||
-                                    (etagValue[0] != '"') ||
-                                    (etagValue[etagsize - 1] != '"')
-                                    )
+                                char* completeHeader;
+                                if (HTTPHeaders_GetHeader(request->responseHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
                                 {
-                                    LogError("ETag is not a valid quoted string");
+                                    break;
                                 }
                                 else
                                 {
-                                    const unsigned char* resp_content;
-                                    size_t resp_len;
-                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_089: [_DoWork shall assemble an IOTHUBMESSAGE_HANDLE from the received HTTP content (using the responseContent buffer).] */
-                                    resp_content = BUFFER_u_char(responseContent);
-                                    resp_len = BUFFER_length(responseContent);
-                                    IOTHUB_MESSAGE_HANDLE receivedMessage = IoTHubMessage_CreateFromByteArray(resp_content, resp_len);
-                                    if (receivedMessage == NULL)
+                                    if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
                                     {
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_092: [If assembling the message fails in any way, then _DoWork shall "abandon" the message.]*/
-                                        LogError("unable to IoTHubMessage_CreateFromByteArray, trying to abandon the message... ");
-                                        if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED))
+                                        /*looks like a property headers*/
+                                        /*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
+                                        char* whereIsColon = strchr(completeHeader, ':');
+                                        if (whereIsColon != NULL)
                                         {
-                                            LogError("HTTP Transport layer failed to report ABANDON disposition");
+                                            *whereIsColon = '\0'; /*cut it down*/
+                                            if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
+                                            {
+                                                free(completeHeader);
+                                                break;
+                                            }
                                         }
                                     }
-                                    else
+                                    else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
                                     {
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_090: [All the HTTP headers of the form iothub-app-name:somecontent shall be transformed in message properties {name, somecontent}.]*/
-                                        /*Codes_SRS_TRANSPORTMULTITHTTP_17_091: [The HTTP header of iothub-messageid shall be set in the MessageId.]*/
-                                        size_t nHeaders;
-                                        if (HTTPHeaders_GetHeaderCount(responseHTTPHeaders, &nHeaders) != HTTP_HEADERS_OK)
+                                        char* whereIsColon = strchr(completeHeader, ':');
+                                        if (whereIsColon != NULL)
                                         {
-                                            LogError("unable to get the count of HTTP headers");
-                                            if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED))
+                                            *whereIsColon = '\0'; /*cut it down*/
+                                            if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
                                             {
-                                                LogError("HTTP Transport layer failed to report ABANDON disposition");
+                                                free(completeHeader);
+                                                break;
                                             }
                                         }
-                                        else
+                                    }
+                                    else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
+                                    {
+                                        char* whereIsColon = strchr(completeHeader, ':');
+                                        if (whereIsColon != NULL)
                                         {
-                                            size_t i;
-                                            MAP_HANDLE properties = (nHeaders > 0) ? IoTHubMessage_Properties(receivedMessage) : NULL;
-                                            for (i = 0; i < nHeaders; i++)
+                                            *whereIsColon = '\0'; /*cut it down*/
+                                            if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
                                             {
-                                                char* completeHeader;
-                                                if (HTTPHeaders_GetHeader(responseHTTPHeaders, i, &completeHeader) != HTTP_HEADERS_OK)
-                                                {
-                                                    break;
-                                                }
-                                                else
-                                                {
-                                                    if (strncmp(IOTHUB_APP_PREFIX, completeHeader, strlen(IOTHUB_APP_PREFIX)) == 0)
-                                                    {
-                                                        /*looks like a property headers*/
-                                                        /*there's a guaranteed ':' in the completeHeader, by HTTP_HEADERS module*/
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (Map_AddOrUpdate(properties, completeHeader + strlen(IOTHUB_APP_PREFIX), whereIsColon + 2) != MAP_OK) /*whereIsColon+1 is a space because HTTPEHADERS outputs a ": " between name and value*/
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    else if (strncmp(IOTHUB_MESSAGE_ID, completeHeader, strlen(IOTHUB_MESSAGE_ID)) == 0)
-                                                    {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetMessageId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    else if (strncmp(IOTHUB_CORRELATION_ID, completeHeader, strlen(IOTHUB_CORRELATION_ID)) == 0)
-                                                    {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetCorrelationId(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    // Codes_SRS_TRANSPORTMULTITHTTP_09_003: [ The HTTP header value of `ContentType` shall be set in the `IoTHubMessage_SetContentTypeSystemProperty`. ] 
-                                                    else if (strncmp(IOTHUB_CONTENT_TYPE_C2D, completeHeader, strlen(IOTHUB_CONTENT_TYPE_C2D)) == 0)
-                                                    {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetContentTypeSystemProperty(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                LogError("Failed setting IoTHubMessage content-type");
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-                                                    // Codes_SRS_TRANSPORTMULTITHTTP_09_004: [ The HTTP header value of `ContentEncoding` shall be set in the `IoTHub_SetContentEncoding`. ] 
-                                                    else if (strncmp(IOTHUB_CONTENT_ENCODING_C2D, completeHeader, strlen(IOTHUB_CONTENT_ENCODING_C2D)) == 0)
-                                                    {
-                                                        char* whereIsColon = strchr(completeHeader, ':');
-                                                        if (whereIsColon != NULL)
-                                                        {
-                                                            *whereIsColon = '\0'; /*cut it down*/
-                                                            if (IoTHubMessage_SetContentEncodingSystemProperty(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
-                                                            {
-                                                                LogError("Failed setting IoTHubMessage content-encoding");
-                                                                free(completeHeader);
-                                                                break;
-                                                            }
-                                                        }
-                                                    }
-
-                                                    free(completeHeader);
-                                                }
+                                                free(completeHeader);
+                                                break;
                                             }
-
-                                            if (i < nHeaders)
+                                        }
+                                    }
+                                    // Codes_SRS_TRANSPORTMULTITHTTP_09_003: [ The HTTP header value of `ContentType` shall be set in the `IoTHubMessage_SetContentTypeSystemProperty`. ] 
+                                    else if (strncmp(IOTHUB_CONTENT_TYPE_C2D, completeHeader, strlen(IOTHUB_CONTENT_TYPE_C2D)) == 0)
+                                    {
+                                        char* whereIsColon = strchr(completeHeader, ':');
+                                        if (whereIsColon != NULL)
+                                        {
+                                            *whereIsColon = '\0'; /*cut it down*/
+                                            if (IoTHubMessage_SetContentTypeSystemProperty(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
                                             {
-                                                if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED))
-                                                {
-                                                    LogError("HTTP Transport layer failed to report ABANDON disposition");
-                                                }
+                                                LogError("Failed setting IoTHubMessage content-type");
+                                                free(completeHeader);
+                                                break;
                                             }
-                                            else
+                                        }
+                                    }
+                                    // Codes_SRS_TRANSPORTMULTITHTTP_09_004: [ The HTTP header value of `ContentEncoding` shall be set in the `IoTHub_SetContentEncoding`. ] 
+                                    else if (strncmp(IOTHUB_CONTENT_ENCODING_C2D, completeHeader, strlen(IOTHUB_CONTENT_ENCODING_C2D)) == 0)
+                                    {
+                                        char* whereIsColon = strchr(completeHeader, ':');
+                                        if (whereIsColon != NULL)
+                                        {
+                                            *whereIsColon = '\0'; /*cut it down*/
+                                            if (IoTHubMessage_SetContentEncodingSystemProperty(receivedMessage, whereIsColon + 2) != IOTHUB_MESSAGE_OK)
                                             {
-                                                MESSAGE_CALLBACK_INFO* messageData = MESSAGE_CALLBACK_INFO_Create(receivedMessage, handleData, deviceData, etagValue);
-                                                if (messageData == NULL)
-                                                {
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_10_006: [If assembling the transport context fails, _DoWork shall "abandon" the message.] */
-                                                    LogError("failed to assemble callback info");
-                                                    if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED))
-                                                    {
-                                                        LogError("HTTP Transport layer failed to report ABANDON disposition");
-                                                    }
-                                                }
-                                                else
-                                                {
-                                                    bool abandon;
-                                                    if (IoTHubClientCore_LL_MessageCallback(iotHubClientHandle, messageData))
-                                                    {
-                                                        abandon = false;
-                                                    }
-                                                    else
-                                                    {
-                                                        LogError("IoTHubClientCore_LL_MessageCallback failed");
-                                                        abandon = true;
-                                                    }
-
-                                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
-                                                    if (abandon)
-                                                    {
-                                                        (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
-                                                    }
-                                                }
+                                                LogError("Failed setting IoTHubMessage content-encoding");
+                                                free(completeHeader);
+                                                break;
                                             }
                                         }
-                                        IoTHubMessage_Destroy(receivedMessage);
+                                    }
+
+                                    free(completeHeader);
+                                }
+                            }
+
+                            if (i < nHeaders)
+                            {
+                                if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED, NULL))
+                                {
+                                    LogError("HTTP Transport layer failed to report ABANDON disposition");
+                                }
+                            }
+                            else
+                            {
+                                MESSAGE_CALLBACK_INFO* messageData = MESSAGE_CALLBACK_INFO_Create(receivedMessage, handleData, deviceData, etagValue);
+                                if (messageData == NULL)
+                                {
+                                    /*Codes_SRS_TRANSPORTMULTITHTTP_10_006: [If assembling the transport context fails, _DoWork shall "abandon" the message.] */
+                                    LogError("failed to assemble callback info");
+                                    if (!abandonOrAcceptMessage(handleData, deviceData, etagValue, IOTHUBMESSAGE_ABANDONED, NULL))
+                                    {
+                                        LogError("HTTP Transport layer failed to report ABANDON disposition");
+                                    }
+                                }
+                                else
+                                {
+                                    bool abandon;
+                                    if (IoTHubClientCore_LL_MessageCallback(iotHubClientHandle, messageData))
+                                    {
+                                        abandon = false;
+                                    }
+                                    else
+                                    {
+                                        LogError("IoTHubClientCore_LL_MessageCallback failed");
+                                        abandon = true;
+                                    }
+
+                                    /*Codes_SRS_TRANSPORTMULTITHTTP_17_096: [If IoTHubClientCore_LL_MessageCallback returns false then _DoWork shall "abandon" the message.] */
+                                    if (abandon)
+                                    {
+                                        (void)IoTHubTransportHttp_SendMessageDisposition(messageData, IOTHUBMESSAGE_ABANDONED);
                                     }
                                 }
                             }
                         }
+                        IoTHubMessage_Destroy(receivedMessage);
                     }
-                    BUFFER_delete(responseContent);
                 }
-                HTTPHeaders_Free(responseHTTPHeaders);
             }
         }
-        else
-        {
-            /*isPollingAllowed is false... */
-            /*do nothing "shall be ignored*/
-        }
+    }
+    BUFFER_delete(request->responseContent);
+    HTTPHeaders_Free(request->responseHeaders);
+}
+
+static void DoMessages(HTTPTRANSPORT_HANDLE_DATA* handleData, HTTPTRANSPORT_PERDEVICE_DATA* deviceData, IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle)
+{
+    prepareMessages(handleData, deviceData);
+    if (deviceData->messageRequest.isPending)
+    {
+        executeRequest(handleData->httpApiExHandle, &(deviceData->messageRequest));
+        completeMessages(handleData, deviceData, iotHubClientHandle);
     }
 }
 
@@ -2322,13 +3011,53 @@ static void IoTHubTransportHttp_DoWork(TRANSPORT_LL_HANDLE handle, IOTHUB_CLIENT
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_052: [ IoTHubTransportHttp_DoWork shall perform a round-robin loop through every deviceHandle in the transport device list, using the iotHubClientHandle field saved in the IOTHUB_DEVICE_HANDLE. ]*/
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_050: [ IoTHubTransportHttp_DoWork shall call loop through the device list. ] */
         /*Codes_SRS_TRANSPORTMULTITHTTP_17_051: [ IF the list is empty, then IoTHubTransportHttp_DoWork shall do nothing. ]*/
-        for (size_t i = 0; i < deviceListSize; i++)
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+        if (handleData->workerPool != NULL)
         {
-            listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
-            HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
-            DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
-            DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+            /*Codes_SRS_TRANSPORTMULTITHTTP_31_003: [ When "http_max_concurrent_requests" is more than 1, IoTHubTransportHttp_DoWork shall first prepare the event and C2D requests of every device, then execute them on up to "http_max_concurrent_requests" connections at the same time, then process their outcomes on the calling thread, device by device, in list order. ]*/
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                prepareEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                prepareMessages(handleData, perDeviceItem);
+            }
+
+            execute_requests_in_parallel(handleData->workerPool, handleData->httpApiExHandle, handleData->perDeviceList, executeDeviceItem);
+
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                if (perDeviceItem->eventRequest.isPending)
+                {
+                    completeEvent(perDeviceItem, perDeviceItem->iotHubClientHandle);
+                }
+                if (perDeviceItem->messageRequest.isPending)
+                {
+                    completeMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                }
+            }
+        }
+        else
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+        {
+            for (size_t i = 0; i < deviceListSize; i++)
+            {
+                listItem = (IOTHUB_DEVICE_HANDLE *)VECTOR_element(handleData->perDeviceList, i);
+                HTTPTRANSPORT_PERDEVICE_DATA* perDeviceItem = *(HTTPTRANSPORT_PERDEVICE_DATA**)(listItem);
+                DoEvent(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+                DoMessages(handleData, perDeviceItem, perDeviceItem->iotHubClientHandle);
+
+            }
+        }
 
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_017: [ At the end of IoTHubTransportHttp_DoWork the queued dispositions shall be sent when there are "http_disposition_batch_size" of them, or when the oldest was queued "http_disposition_batch_window_ms" milliseconds ago or more. ]*/
+        if ((handleData->pendingDispositions != NULL) &&
+            (VECTOR_size(handleData->pendingDispositions) > 0) &&
+            is_disposition_flush_due(handleData))
+        {
+            flush_dispositions(handleData);
         }
     }
     else
@@ -2413,6 +3142,134 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             handleData->getMinimumPollingTime = *(unsigned int*)value;
             result = IOTHUB_CLIENT_OK;
         }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_009: [ "http_adaptive_polling_min_time" ]*/
+        else if (strcmp(OPTION_HTTP_ADAPTIVE_POLLING_MIN_TIME, option) == 0)
+        {
+            handleData->adaptivePollingMinTime = *(const unsigned int*)value;
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_010: [ "http_poll_now" set to true shall make the next _DoWork poll every subscribed device no matter when it was last polled, and restart the backoff of the devices from "http_adaptive_polling_min_time". ]*/
+        else if (strcmp(OPTION_HTTP_POLL_NOW, option) == 0)
+        {
+            if (*(const bool*)value)
+            {
+                size_t deviceCount = VECTOR_size(handleData->perDeviceList);
+                size_t index;
+                for (index = 0; index < deviceCount; index++)
+                {
+                    HTTPTRANSPORT_PERDEVICE_DATA* deviceData = *(HTTPTRANSPORT_PERDEVICE_DATA**)VECTOR_element(handleData->perDeviceList, index);
+                    deviceData->isFirstPoll = true;
+                    deviceData->pollBackoff = 0;
+                }
+            }
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_014: [ "http_disposition_batch_size" ]*/
+        else if (strcmp(OPTION_HTTP_DISPOSITION_BATCH_SIZE, option) == 0)
+        {
+            size_t batchSize = *(const size_t*)value;
+            if (batchSize == 0)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_021: [ Setting "http_disposition_batch_size" to 0 shall send the queued dispositions and go back to sending every disposition as it comes. ]*/
+                if (handleData->pendingDispositions != NULL)
+                {
+                    flush_dispositions(handleData);
+                    VECTOR_destroy(handleData->pendingDispositions);
+                    handleData->pendingDispositions = NULL;
+                }
+                handleData->dispositionBatchSize = 0;
+                result = IOTHUB_CLIENT_OK;
+            }
+            else if ((handleData->pendingDispositions == NULL) &&
+                ((handleData->pendingDispositions = VECTOR_create(sizeof(HTTP_PENDING_DISPOSITION))) == NULL))
+            {
+                LogError("unable to VECTOR_create");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                handleData->dispositionBatchSize = batchSize;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_015: [ "http_disposition_batch_window_ms" ]*/
+        else if (strcmp(OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, option) == 0)
+        {
+            size_t windowMs = *(const size_t*)value;
+            if ((windowMs > 0) &&
+                (handleData->dispositionTickCounter == NULL) &&
+                ((handleData->dispositionTickCounter = tickcounter_create()) == NULL))
+            {
+                LogError("unable to tickcounter_create");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                if ((windowMs == 0) && (handleData->dispositionTickCounter != NULL))
+                {
+                    tickcounter_destroy(handleData->dispositionTickCounter);
+                    handleData->dispositionTickCounter = NULL;
+                }
+                handleData->dispositionBatchWindowMs = windowMs;
+                result = IOTHUB_CLIENT_OK;
+            }
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_001: [ "message_pool_size" shall be accepted and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_OK, the transport keeps no per message records of its own to pool. ] */
+        else if (strcmp(OPTION_MESSAGE_POOL_SIZE, option) == 0)
+        {
+            result = IOTHUB_CLIENT_OK;
+        }
+        /*Codes_SRS_TRANSPORTMULTITHTTP_31_002: [ "http_max_concurrent_requests" ]*/
+        else if (strcmp(OPTION_HTTP_MAX_CONCURRENT_REQUESTS, option) == 0)
+        {
+            size_t maxConcurrentRequests = *(const size_t*)value;
+            if (maxConcurrentRequests == 0)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_004: [ If the value of "http_max_concurrent_requests" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+                LogError("http_max_concurrent_requests cannot be 0");
+                result = IOTHUB_CLIENT_INVALID_ARG;
+            }
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+            else if ((handleData->workerPool != NULL) || handleData->wereHttpOptionsLost)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_005: [ If "http_max_concurrent_requests" was already set to more than 1, or an option passed to HTTPAPIEX_SetOption could not be saved, then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("http_max_concurrent_requests can only be set once, and not after an HTTP option could not be saved");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else if (maxConcurrentRequests == 1)
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+            /*Codes_SRS_TRANSPORTMULTITHTTP_31_006: [ Otherwise IoTHubTransportHttp_SetOption shall start "http_max_concurrent_requests" - 1 worker threads, each with its own HTTPAPIEX_HANDLE created by HTTPAPIEX_Create. ]*/
+            else if ((handleData->workerPool = create_worker_pool(handleData, maxConcurrentRequests - 1)) == NULL)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_007: [ If starting the workers fails, IoTHubTransportHttp_SetOption shall release what was started and return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("unable to create the HTTP worker pool");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+            else
+            {
+                /*the workers have their options now, the ones set from here on are passed to them directly*/
+                if (handleData->httpApiExOptions != NULL)
+                {
+                    OptionHandler_Destroy(handleData->httpApiExOptions);
+                    handleData->httpApiExOptions = NULL;
+                }
+                result = IOTHUB_CLIENT_OK;
+            }
+#else
+            else if (maxConcurrentRequests == 1)
+            {
+                result = IOTHUB_CLIENT_OK;
+            }
+            else
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_026: [ If the SDK was built with DONT_USE_HTTP_WORKER_THREADS, a value of "http_max_concurrent_requests" above 1 shall make IoTHubTransportHttp_SetOption return IOTHUB_CLIENT_ERROR. ]*/
+                LogError("http_max_concurrent_requests cannot be more than 1 when built with DONT_USE_HTTP_WORKER_THREADS");
+                result = IOTHUB_CLIENT_ERROR;
+            }
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+        }
         else
         {
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_126: [ "TrustedCerts"] */
@@ -2420,6 +3277,21 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportHttp_SetOption(TRANSPORT_LL_HANDLE ha
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_129: [ This option shall passed down to the lower layer by calling HTTPAPIEX_SetOption. ]*/
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_118: [Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code.] */
             HTTPAPIEX_RESULT HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->httpApiExHandle, option, value);
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+            if (handleData->workerPool != NULL)
+            {
+                /*Codes_SRS_TRANSPORTMULTITHTTP_31_008: [ The option shall also be passed to the HTTPAPIEX_HANDLE of every worker; the first failure is the one returned. ]*/
+                size_t index;
+                for (index = 0; (index < handleData->workerPool->workerCount) && (HTTPAPIEX_result == HTTPAPIEX_OK); index++)
+                {
+                    HTTPAPIEX_result = HTTPAPIEX_SetOption(handleData->workerPool->workers[index].httpApiExHandle, option, value);
+                }
+            }
+            else if (HTTPAPIEX_result == HTTPAPIEX_OK)
+            {
+                saveHttpApiExOption(handleData, option, value);
+            }
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
             /*Codes_SRS_TRANSPORTMULTITHTTP_17_119: [The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes:] */
             if (HTTPAPIEX_result == HTTPAPIEX_OK)
             {
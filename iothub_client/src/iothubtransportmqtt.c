@@ -127,6 +127,12 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_GetSendStatus(IOTHUB_DEVICE_HAND
     return IoTHubTransport_MQTT_Common_GetSendStatus(handle, iotHubClientStatus);
 }
 
+static int IoTHubTransportMqtt_GetTimeToNextDeadline(TRANSPORT_LL_HANDLE handle, tickcounter_ms_t* msToNextDeadline)
+{
+    /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_31_001: [ IoTHubTransportMqtt_GetTimeToNextDeadline shall get the time to the next deadline by calling into the IoTHubTransport_MQTT_Common_GetTimeToNextDeadline function. ] */
+    return IoTHubTransport_MQTT_Common_GetTimeToNextDeadline(handle, msToNextDeadline);
+}
+
 static IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
     /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_009: [ IoTHubTransportMqtt_SetOption shall set the options by calling into the IoTHubMqttAbstract_SetOption function. ] */
@@ -170,7 +176,8 @@ static TRANSPORT_PROVIDER myfunc =
     IoTHubTransportMqtt_Unsubscribe,                /*pfIoTHubTransport_Unsubscribe IoTHubTransport_Unsubscribe;*/
     IoTHubTransportMqtt_DoWork,                     /*pfIoTHubTransport_DoWork IoTHubTransport_DoWork;*/
     IoTHubTransportMqtt_SetRetryPolicy,             /*pfIoTHubTransport_DoWork IoTHubTransport_SetRetryPolicy;*/
-    IoTHubTransportMqtt_GetSendStatus               /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus;*/
+    IoTHubTransportMqtt_GetSendStatus,              /*pfIoTHubTransport_GetSendStatus IoTHubTransport_GetSendStatus;*/
+    IoTHubTransportMqtt_GetTimeToNextDeadline       /*pfIoTHubTransport_GetTimeToNextDeadline IoTHubTransport_GetTimeToNextDeadline;*/
 };
 
 /* Codes_SRS_IOTHUB_MQTT_TRANSPORT_07_022: [This function shall return a pointer to a structure of type TRANSPORT_PROVIDER */
@@ -171,6 +171,12 @@ static IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_WS_GetSendStatus(IOTHUB_DEVICE_H
     return IoTHubTransport_MQTT_Common_GetSendStatus(handle, iotHubClientStatus);
 }
 
+/* Codes_SRS_IOTHUB_MQTT_WEBSOCKET_TRANSPORT_31_001: [ IoTHubTransportMqtt_WS_GetTimeToNextDeadline shall get the time to the next deadline by calling into the IoTHubTransport_MQTT_Common_GetTimeToNextDeadline function. ] */
+static int IoTHubTransportMqtt_WS_GetTimeToNextDeadline(TRANSPORT_LL_HANDLE handle, tickcounter_ms_t* msToNextDeadline)
+{
+    return IoTHubTransport_MQTT_Common_GetTimeToNextDeadline(handle, msToNextDeadline);
+}
+
 /* Codes_SRS_IOTHUB_MQTT_WEBSOCKET_TRANSPORT_07_009: [ IoTHubTransportMqtt_WS_SetOption shall set the options by calling into the IoTHubMqttAbstract_SetOption function. ] */
 static IOTHUB_CLIENT_RESULT IoTHubTransportMqtt_WS_SetOption(TRANSPORT_LL_HANDLE handle, const char* option, const void* value)
 {
@@ -219,7 +225,8 @@ IoTHubTransport_Destroy = IoTHubTransportMqtt_WS_Destroy
 IoTHubTransport_Subscribe = IoTHubTransportMqtt_WS_Subscribe
 IoTHubTransport_Unsubscribe = IoTHubTransportMqtt_WS_Unsubscribe
 IoTHubTransport_DoWork = IoTHubTransportMqtt_WS_DoWork
-IoTHubTransport_SetOption = IoTHubTransportMqtt_WS_SetOption ] */
+IoTHubTransport_SetOption = IoTHubTransportMqtt_WS_SetOption
+IoTHubTransport_GetTimeToNextDeadline = IoTHubTransportMqtt_WS_GetTimeToNextDeadline ] */
 static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls = {
     IoTHubTransportMqtt_WS_SendMessageDisposition,
     IoTHubTransportMqtt_WS_Subscribe_DeviceMethod,
@@ -238,7 +245,8 @@ static TRANSPORT_PROVIDER thisTransportProvider_WebSocketsOverTls = {
     IoTHubTransportMqtt_WS_Unsubscribe,
     IoTHubTransportMqtt_WS_DoWork,
     IoTHubTransportMqtt_WS_SetRetryPolicy,
-    IoTHubTransportMqtt_WS_GetSendStatus
+    IoTHubTransportMqtt_WS_GetSendStatus,
+    IoTHubTransportMqtt_WS_GetTimeToNextDeadline
 };
 
 const TRANSPORT_PROVIDER* MQTT_WebSocket_Protocol(void)
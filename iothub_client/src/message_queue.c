@@ -3,25 +3,41 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "azure_c_shared_utility/optimize_size.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "azure_c_shared_utility/gballoc.h"
-#include "azure_c_shared_utility/agenttime.h" 
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
-#include "azure_c_shared_utility/singlylinkedlist.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
 
 typedef struct MESSAGE_QUEUE_TAG MESSAGE_QUEUE;
 
 #include "internal/message_queue.h"
 
 #define RESULT_OK 0
-#define INDEFINITE_TIME ((time_t)(-1))
+#define MILLISECONDS_PER_SECOND 1000
+#define IN_PROGRESS_INDEX_INITIAL_SIZE 16
 
 static const char* SAVED_OPTION_MAX_RETRY_COUNT = "SAVED_OPTION_MAX_RETRY_COUNT";
 static const char* SAVED_OPTION_MAX_ENQUEUE_TIME_SECS = "SAVED_OPTION_MAX_ENQUEUE_TIME_SECS";
 static const char* SAVED_OPTION_MAX_PROCESSING_TIME_SECS = "SAVED_OPTION_MAX_PROCESSING_TIME_SECS";
 
 
+typedef struct MESSAGE_QUEUE_ITEM_TAG
+{
+    MQ_MESSAGE_HANDLE message;
+    MESSAGE_PROCESSING_COMPLETED_CALLBACK on_message_processing_completed_callback;
+    void* user_context;
+    tickcounter_ms_t enqueue_time;
+    tickcounter_ms_t processing_start_time;
+    size_t number_of_attempts;
+    bool is_in_progress;
+    DLIST_ENTRY list_entry;                               // Entry in `pending` or `in_progress`.
+    DLIST_ENTRY enqueue_order_entry;                      // Entry in `enqueue_order`.
+    struct MESSAGE_QUEUE_ITEM_TAG* next_in_index;         // Next item in the same `in_progress_index` bucket.
+} MESSAGE_QUEUE_ITEM;
+
 struct MESSAGE_QUEUE_TAG
 {
     size_t max_message_enqueued_time_secs;
@@ -31,85 +47,155 @@ struct MESSAGE_QUEUE_TAG
     PROCESS_MESSAGE_CALLBACK on_process_message_callback;
     void* on_process_message_context;
 
-    SINGLYLINKEDLIST_HANDLE pending;
-    SINGLYLINKEDLIST_HANDLE in_progress;
-};
+    TICK_COUNTER_HANDLE tick_counter;
 
-typedef struct MESSAGE_QUEUE_ITEM_TAG
-{
-    MQ_MESSAGE_HANDLE message;
-    MESSAGE_PROCESSING_COMPLETED_CALLBACK on_message_processing_completed_callback;
-    void* user_context;
-    time_t enqueue_time;
-    time_t processing_start_time;
-    size_t number_of_attempts;
-} MESSAGE_QUEUE_ITEM;
+    DLIST_ENTRY pending;                                  // In the order the items will be processed.
+    DLIST_ENTRY in_progress;                              // Oldest processing start time first.
+    DLIST_ENTRY enqueue_order;                            // All items, oldest enqueue time first.
+
+    // In-progress items hashed by message pointer, so a completion finds its item without scanning `in_progress`.
+    MESSAGE_QUEUE_ITEM** in_progress_index;
+    size_t in_progress_index_size;
+    size_t in_progress_count;
+};
 
 
 
 // ---------- Helper Functions ---------- //
 
-static bool find_item_by_message_ptr(LIST_ITEM_HANDLE list_item, const void* match_context)
+static size_t get_in_progress_index_bucket(size_t index_size, MQ_MESSAGE_HANDLE message)
 {
-    MESSAGE_QUEUE_ITEM* current_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-    MQ_MESSAGE_HANDLE* target_item = (MQ_MESSAGE_HANDLE*)match_context;
+    uintptr_t key = (uintptr_t)message;
+
+    // Messages are heap pointers, so the lowest bits carry no information.
+    key = (key >> 4) ^ (key >> 12);
 
-    return (current_item->message == target_item);
+    return (size_t)key & (index_size - 1);
 }
 
-static void fire_message_callback(MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result, void* reason)
+static void index_in_progress_item(MESSAGE_QUEUE_ITEM** index, size_t index_size, MESSAGE_QUEUE_ITEM* mq_item)
 {
-    if (mq_item->on_message_processing_completed_callback != NULL)
+    MESSAGE_QUEUE_ITEM** slot = &index[get_in_progress_index_bucket(index_size, mq_item->message)];
+
+    // Appended, so a message queued more than once is completed in the order it started processing.
+    while (*slot != NULL)
     {
-        if (result == MESSAGE_QUEUE_RETRYABLE_ERROR)
+        slot = &(*slot)->next_in_index;
+    }
+
+    mq_item->next_in_index = NULL;
+    *slot = mq_item;
+}
+
+static void grow_in_progress_index(MESSAGE_QUEUE_HANDLE message_queue)
+{
+    size_t new_size = message_queue->in_progress_index_size * 2;
+    MESSAGE_QUEUE_ITEM** new_index;
+
+    if ((new_index = (MESSAGE_QUEUE_ITEM**)malloc(sizeof(MESSAGE_QUEUE_ITEM*) * new_size)) == NULL)
+    {
+        // Not fatal; the buckets just get longer.
+        LogError("failed growing the in-progress index (malloc failed)");
+    }
+    else
+    {
+        PDLIST_ENTRY entry;
+
+        memset(new_index, 0, sizeof(MESSAGE_QUEUE_ITEM*) * new_size);
+
+        // Rebuilt walking `in_progress`, so items of the same message keep their order.
+        for (entry = message_queue->in_progress.Flink; entry != &message_queue->in_progress; entry = entry->Flink)
         {
-            result = MESSAGE_QUEUE_ERROR;
+            index_in_progress_item(new_index, new_size, containingRecord(entry, MESSAGE_QUEUE_ITEM, list_entry));
         }
 
-        mq_item->on_message_processing_completed_callback(mq_item->message, result, reason, mq_item->user_context);
+        free(message_queue->in_progress_index);
+        message_queue->in_progress_index = new_index;
+        message_queue->in_progress_index_size = new_size;
     }
 }
 
-static bool should_retry_sending(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result)
+static void add_to_in_progress(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item)
 {
-    return (result == MESSAGE_QUEUE_RETRYABLE_ERROR && mq_item->number_of_attempts <= message_queue->max_retry_count);
+    DList_InsertTailList(&message_queue->in_progress, &mq_item->list_entry);
+    index_in_progress_item(message_queue->in_progress_index, message_queue->in_progress_index_size, mq_item);
+    mq_item->is_in_progress = true;
+    message_queue->in_progress_count++;
+
+    if (message_queue->in_progress_count > message_queue->in_progress_index_size)
+    {
+        grow_in_progress_index(message_queue);
+    }
 }
 
-static int retry_sending_message(MESSAGE_QUEUE_HANDLE message_queue, LIST_ITEM_HANDLE list_item)
+// @brief
+//     Unlinks `mq_item` from the list it is in (pending or in-progress), keeping its place in `enqueue_order`.
+static void remove_from_processing_list(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item)
 {
-    int result;
-    MESSAGE_QUEUE_ITEM* mq_item;
-    
-    mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
+    (void)DList_RemoveEntryList(&mq_item->list_entry);
 
-    if (singlylinkedlist_remove(message_queue->in_progress, list_item))
+    if (mq_item->is_in_progress)
     {
-        LogError("Failed removing message from in-progress list");
-        result = __FAILURE__;
+        MESSAGE_QUEUE_ITEM** slot = &message_queue->in_progress_index[get_in_progress_index_bucket(message_queue->in_progress_index_size, mq_item->message)];
+
+        while (*slot != NULL && *slot != mq_item)
+        {
+            slot = &(*slot)->next_in_index;
+        }
+
+        if (*slot != NULL)
+        {
+            *slot = mq_item->next_in_index;
+        }
+
+        mq_item->next_in_index = NULL;
+        mq_item->is_in_progress = false;
+        message_queue->in_progress_count--;
     }
-    else if (singlylinkedlist_add(message_queue->pending, (const void*)mq_item) == NULL)
+}
+
+static MESSAGE_QUEUE_ITEM* find_in_progress_item(MESSAGE_QUEUE_HANDLE message_queue, MQ_MESSAGE_HANDLE message)
+{
+    MESSAGE_QUEUE_ITEM* mq_item = message_queue->in_progress_index[get_in_progress_index_bucket(message_queue->in_progress_index_size, message)];
+
+    while (mq_item != NULL && mq_item->message != message)
     {
-        LogError("Failed moving message back to pending list");
-        result = __FAILURE__;
+        mq_item = mq_item->next_in_index;
     }
-    else
+
+    return mq_item;
+}
+
+static void fire_message_callback(MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result, void* reason)
+{
+    if (mq_item->on_message_processing_completed_callback != NULL)
     {
-        result = RESULT_OK;
+        if (result == MESSAGE_QUEUE_RETRYABLE_ERROR)
+        {
+            result = MESSAGE_QUEUE_ERROR;
+        }
+
+        mq_item->on_message_processing_completed_callback(mq_item->message, result, reason, mq_item->user_context);
     }
+}
 
-    return result;
+static bool should_retry_sending(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result)
+{
+    return (result == MESSAGE_QUEUE_RETRYABLE_ERROR && mq_item->number_of_attempts <= message_queue->max_retry_count);
 }
 
-static void dequeue_message_and_fire_callback(SINGLYLINKEDLIST_HANDLE list, LIST_ITEM_HANDLE list_item, MESSAGE_QUEUE_RESULT result, void* reason)
+static void retry_sending_message(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item)
 {
-    MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
+    remove_from_processing_list(message_queue, mq_item);
+    DList_InsertTailList(&message_queue->pending, &mq_item->list_entry);
+}
 
+static void dequeue_message_and_fire_callback(MESSAGE_QUEUE_HANDLE message_queue, MESSAGE_QUEUE_ITEM* mq_item, MESSAGE_QUEUE_RESULT result, void* reason)
+{
     // Codes_SRS_MESSAGE_QUEUE_09_045: [If `message` is present in `message_queue->in_progress`, it shall be removed]
-    if (singlylinkedlist_remove(list, list_item))
-    {
-        LogError("failed removing message from list (%p)", list);
-    }
-    
+    remove_from_processing_list(message_queue, mq_item);
+    (void)DList_RemoveEntryList(&mq_item->enqueue_order_entry);
+
     // Codes_SRS_MESSAGE_QUEUE_09_049: [Otherwise `mq_item->on_message_processing_completed_callback` shall be invoked passing `mq_item->message`, `result`, `reason` and `mq_item->user_context`]
     fire_message_callback(mq_item, result, reason);
 
@@ -126,111 +212,75 @@ static void on_process_message_completed_callback(MESSAGE_QUEUE_HANDLE message_q
     }
     else
     {
-        LIST_ITEM_HANDLE list_item;
-        
-        if ((list_item = singlylinkedlist_find(message_queue->in_progress, find_item_by_message_ptr, message)) == NULL)
+        MESSAGE_QUEUE_ITEM* mq_item;
+
+        // Codes_SRS_MESSAGE_QUEUE_31_001: [The `mq_item` of `message` shall be looked up in `message_queue->in_progress_index`, without scanning `message_queue->in_progress`]
+        if ((mq_item = find_in_progress_item(message_queue, message)) == NULL)
         {
             // Codes_SRS_MESSAGE_QUEUE_09_044: [If `message` is not present in `message_queue->in_progress`, it shall be ignored]
             LogError("on_process_message_completed_callback invoked for a message not in the in-progress list (%p)", message);
         }
+        // Codes_SRS_MESSAGE_QUEUE_09_047: [If `result` is MESSAGE_QUEUE_RETRYABLE_ERROR and `mq_item->number_of_attempts` is less than or equal `message_queue->max_retry_count`, the `message` shall be moved to `message_queue->pending` to be re-sent]
+        else if (should_retry_sending(message_queue, mq_item, result))
+        {
+            retry_sending_message(message_queue, mq_item);
+        }
         else
         {
-            MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-        
-            // Codes_SRS_MESSAGE_QUEUE_09_047: [If `result` is MESSAGE_QUEUE_RETRYABLE_ERROR and `mq_item->number_of_attempts` is less than or equal `message_queue->max_retry_count`, the `message` shall be moved to `message_queue->pending` to be re-sent]
             // Codes_SRS_MESSAGE_QUEUE_09_048: [If `result` is MESSAGE_QUEUE_RETRYABLE_ERROR and `mq_item->number_of_attempts` is greater than `message_queue->max_retry_count`, result shall be changed to MESSAGE_QUEUE_ERROR]
-            if (!should_retry_sending(message_queue, mq_item, result) || retry_sending_message(message_queue, list_item) != RESULT_OK)
-            {
-                dequeue_message_and_fire_callback(message_queue->in_progress, list_item, result, reason);
-            }
+            dequeue_message_and_fire_callback(message_queue, mq_item, result, reason);
         }
     }
 }
 
+static bool has_expired(tickcounter_ms_t current_time, tickcounter_ms_t start_time, size_t timeout_secs)
+{
+    return (current_time - start_time >= (tickcounter_ms_t)timeout_secs * MILLISECONDS_PER_SECOND);
+}
+
 static void process_timeouts(MESSAGE_QUEUE_HANDLE message_queue)
 {
-    time_t current_time;
+    tickcounter_ms_t current_time;
 
-    if ((current_time = get_time(NULL)) == INDEFINITE_TIME)
+    if (tickcounter_get_current_ms(message_queue->tick_counter, &current_time) != 0)
     {
-        LogError("failed processing timeouts (get_time failed)");
+        LogError("failed processing timeouts (tickcounter_get_current_ms failed)");
     }
     else
     {
         // Codes_SRS_MESSAGE_QUEUE_09_035: [If `message_queue->max_message_enqueued_time_secs` is greater than zero, `message_queue->in_progress` and `message_queue->pending` items shall be checked for timeout]
         if (message_queue->max_message_enqueued_time_secs > 0)
         {
-            LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(message_queue->pending);
-
-            while (list_item != NULL)
+            while (!DList_IsListEmpty(&message_queue->enqueue_order))
             {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
+                MESSAGE_QUEUE_ITEM* mq_item = containingRecord(message_queue->enqueue_order.Flink, MESSAGE_QUEUE_ITEM, enqueue_order_entry);
 
-                if (mq_item == NULL)
+                // Codes_SRS_MESSAGE_QUEUE_31_002: [Items shall be checked oldest enqueue time first, stopping at the first item not expired]
+                if (!has_expired(current_time, mq_item->enqueue_time, message_queue->max_message_enqueued_time_secs))
                 {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->enqueue_time) >= message_queue->max_message_enqueued_time_secs)
-                {
-                    // Codes_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
-                    dequeue_message_and_fire_callback(message_queue->pending, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
-                else
-                {
-                    // The pending list order is already based on enqueue time, so if one message is not expired, later ones won't be either.
                     break;
                 }
-            }
-
-            list_item = singlylinkedlist_get_head_item(message_queue->in_progress);
 
-            while (list_item != NULL)
-            {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
-
-                if (mq_item == NULL)
-                {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->enqueue_time) >= message_queue->max_message_enqueued_time_secs)
-                {
-                    // Codes_SRS_MESSAGE_QUEUE_09_038: [If any items are in `message_queue->in_progress` for `message_queue->max_message_processing_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
-                    dequeue_message_and_fire_callback(message_queue->in_progress, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
+                // Codes_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
+                dequeue_message_and_fire_callback(message_queue, mq_item, MESSAGE_QUEUE_TIMEOUT, NULL);
             }
         }
 
         // Codes_SRS_MESSAGE_QUEUE_09_037: [If `message_queue->max_message_processing_time_secs` is greater than zero, `message_queue->in_progress` items shall be checked for timeout]
         if (message_queue->max_message_processing_time_secs > 0)
         {
-            LIST_ITEM_HANDLE list_item = singlylinkedlist_get_head_item(message_queue->in_progress);
-
-            while (list_item != NULL)
+            while (!DList_IsListEmpty(&message_queue->in_progress))
             {
-                LIST_ITEM_HANDLE current_list_item = list_item;
-                MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(current_list_item);
-
-                list_item = singlylinkedlist_get_next_item(list_item);
+                MESSAGE_QUEUE_ITEM* mq_item = containingRecord(message_queue->in_progress.Flink, MESSAGE_QUEUE_ITEM, list_entry);
 
-                if (mq_item == NULL)
-                {
-                    LogError("failed processing timeouts (unexpected NULL pointer to MESSAGE_QUEUE_ITEM)");
-                }
-                else if (get_difftime(current_time, mq_item->processing_start_time) >= message_queue->max_message_processing_time_secs)
-                {
-                    dequeue_message_and_fire_callback(message_queue->in_progress, current_list_item, MESSAGE_QUEUE_TIMEOUT, NULL);
-                }
-                else
+                // Codes_SRS_MESSAGE_QUEUE_31_003: [In-progress items shall be checked oldest processing start time first, stopping at the first item not expired]
+                if (!has_expired(current_time, mq_item->processing_start_time, message_queue->max_message_processing_time_secs))
                 {
-                    // The in-progress list order is already based on start-processing time, so if one message is not expired, later ones won't be either.
                     break;
                 }
+
+                // Codes_SRS_MESSAGE_QUEUE_09_038: [If any items are in `message_queue->in_progress` for `message_queue->max_message_processing_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
+                dequeue_message_and_fire_callback(message_queue, mq_item, MESSAGE_QUEUE_TIMEOUT, NULL);
             }
         }
     }
@@ -238,60 +288,25 @@ static void process_timeouts(MESSAGE_QUEUE_HANDLE message_queue)
 
 static void process_pending_messages(MESSAGE_QUEUE_HANDLE message_queue)
 {
-    LIST_ITEM_HANDLE list_item;
-
-    while ((list_item = singlylinkedlist_get_head_item(message_queue->pending)) != NULL)
+    while (!DList_IsListEmpty(&message_queue->pending))
     {
-        MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-
-        if (mq_item == NULL)
-        {
-            LogError("internal error, failed to retrieve list node value");
-            break;
-        }
-        else if (singlylinkedlist_remove(message_queue->pending, list_item) != 0)
-        {
-            LogError("failed moving message out of pending list (%p)", mq_item->message);
+        MESSAGE_QUEUE_ITEM* mq_item = containingRecord(message_queue->pending.Flink, MESSAGE_QUEUE_ITEM, list_entry);
 
-            // Codes_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
-            if (mq_item->on_message_processing_completed_callback != NULL)
-            {
-                mq_item->on_message_processing_completed_callback(mq_item->message, MESSAGE_QUEUE_ERROR, NULL, mq_item->user_context);
-            }
-
-            // Not freeing since this would cause a memory A/V on the next call.
-
-            break; // Trying to avoid an infinite loop
-        }
-        // Codes_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using get_time()]
-        else if ((mq_item->processing_start_time = get_time(NULL)) == INDEFINITE_TIME)
+        // Codes_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using tickcounter_get_current_ms()]
+        if (tickcounter_get_current_ms(message_queue->tick_counter, &mq_item->processing_start_time) != 0)
         {
-            // Codes_SRS_MESSAGE_QUEUE_09_041: [If get_time() fails, `mq_item` shall be removed from `message_queue->in_progress`]
             LogError("failed setting message processing_start_time (%p)", mq_item->message);
 
+            // Codes_SRS_MESSAGE_QUEUE_09_041: [If tickcounter_get_current_ms() fails, `mq_item` shall be removed from `message_queue->pending`]
             // Codes_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
-            if (mq_item->on_message_processing_completed_callback != NULL)
-            {
-                mq_item->on_message_processing_completed_callback(mq_item->message, MESSAGE_QUEUE_ERROR, NULL, mq_item->user_context);
-            }
-
-            free(mq_item);
-        }
-        // Codes_SRS_MESSAGE_QUEUE_09_039: [Each `mq_item` in `message_queue->pending` shall be moved to `message_queue->in_progress`]
-        else if (singlylinkedlist_add(message_queue->in_progress, (const void*)mq_item) == NULL)
-        {
-            LogError("failed moving message to in-progress list (%p)", mq_item->message);
-
-            // Codes_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
-            if (mq_item->on_message_processing_completed_callback != NULL)
-            {
-                mq_item->on_message_processing_completed_callback(mq_item->message, MESSAGE_QUEUE_ERROR, NULL, mq_item->user_context);
-            }
-
-            free(mq_item);
+            dequeue_message_and_fire_callback(message_queue, mq_item, MESSAGE_QUEUE_ERROR, NULL);
         }
         else
         {
+            // Codes_SRS_MESSAGE_QUEUE_09_039: [Each `mq_item` in `message_queue->pending` shall be moved to `message_queue->in_progress`]
+            remove_from_processing_list(message_queue, mq_item);
+            add_to_in_progress(message_queue, mq_item);
+
             mq_item->number_of_attempts++;
 
             // Codes_SRS_MESSAGE_QUEUE_09_043: [If no failures occur, `message_queue->on_process_message_callback` shall be invoked passing `mq_item->message` and `on_process_message_completed_callback`]
@@ -358,64 +373,21 @@ void message_queue_remove_all(MESSAGE_QUEUE_HANDLE message_queue)
     // Codes_SRS_MESSAGE_QUEUE_09_026: [If `message_queue` is NULL, message_queue_retrieve_options shall return]
     if (message_queue != NULL)
     {
-        LIST_ITEM_HANDLE list_item;
-
         // Codes_SRS_MESSAGE_QUEUE_09_027: [Each `mq_item` in `message_queue->pending` and `message_queue->in_progress` lists shall be removed] 
-        while ((list_item = singlylinkedlist_get_head_item(message_queue->in_progress)) != NULL)
+        while (!DList_IsListEmpty(&message_queue->in_progress))
         {
             // Codes_SRS_MESSAGE_QUEUE_09_028: [`message_queue->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_CANCELLED for each `mq_item` removed]
             // Codes_SRS_MESSAGE_QUEUE_09_029: [Each `mq_item` shall be freed] 
-            dequeue_message_and_fire_callback(message_queue->in_progress, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
+            dequeue_message_and_fire_callback(message_queue, containingRecord(message_queue->in_progress.Flink, MESSAGE_QUEUE_ITEM, list_entry), MESSAGE_QUEUE_CANCELLED, NULL);
         }
 
-        while ((list_item = singlylinkedlist_get_head_item(message_queue->pending)) != NULL)
+        while (!DList_IsListEmpty(&message_queue->pending))
         {
             // Codes_SRS_MESSAGE_QUEUE_09_028: [`message_queue->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_CANCELLED for each `mq_item` removed]
             // Codes_SRS_MESSAGE_QUEUE_09_029: [Each `mq_item` shall be freed] 
-            dequeue_message_and_fire_callback(message_queue->pending, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
-        }
-    }
-}
-
-static int move_messages_between_lists(SINGLYLINKEDLIST_HANDLE from_list, SINGLYLINKEDLIST_HANDLE to_list)
-{
-    int result;
-    LIST_ITEM_HANDLE list_item;
-
-    result = RESULT_OK;
-
-    while ((list_item = singlylinkedlist_get_head_item(from_list)) != NULL)
-    {
-        if (singlylinkedlist_remove(from_list, list_item) != 0)
-        {
-            LogError("failed removing message from list");
-            result = __FAILURE__;
-        }
-        else
-        {
-            MESSAGE_QUEUE_ITEM* mq_item = (MESSAGE_QUEUE_ITEM*)singlylinkedlist_item_get_value(list_item);
-
-            if (singlylinkedlist_add(to_list, (const void*)mq_item) != 0)
-            {
-                LogError("failed moving message to list");
-
-                fire_message_callback(mq_item, MESSAGE_QUEUE_CANCELLED, NULL);
-
-                free(mq_item);
-
-                result = __FAILURE__;
-
-                break;
-            }
-            else
-            {
-                mq_item->number_of_attempts = 0;
-                mq_item->processing_start_time = INDEFINITE_TIME;
-            }
+            dequeue_message_and_fire_callback(message_queue, containingRecord(message_queue->pending.Flink, MESSAGE_QUEUE_ITEM, list_entry), MESSAGE_QUEUE_CANCELLED, NULL);
         }
     }
-
-    return result;
 }
 
 int message_queue_move_all_back_to_pending(MESSAGE_QUEUE_HANDLE message_queue)
@@ -429,47 +401,28 @@ int message_queue_move_all_back_to_pending(MESSAGE_QUEUE_HANDLE message_queue)
     }
     else
     {
-        SINGLYLINKEDLIST_HANDLE temp_list;
+        PDLIST_ENTRY entry;
 
-        if ((temp_list = singlylinkedlist_create()) == NULL)
-        {
-            LogError("failed creating temporary list");
-            result = __FAILURE__;
-        }
-        else
+        // Codes_SRS_MESSAGE_QUEUE_31_004: [Each `mq_item` in `message_queue->in_progress` shall be moved to the head of `message_queue->pending`, keeping their order]
+        while (!DList_IsListEmpty(&message_queue->in_progress))
         {
-            if (move_messages_between_lists(message_queue->in_progress, temp_list) != 0)
-            {
-                LogError("failed moving in-progress message to temporary list");
-                result = __FAILURE__;
-            }
-            else if (move_messages_between_lists(message_queue->pending, temp_list) != 0)
-            {
-                LogError("failed moving pending message to temporary list");
-                result = __FAILURE__;
-            }
-            else if (move_messages_between_lists(temp_list, message_queue->pending) != 0)
-            {
-                LogError("failed moving pending message to temporary list");
-                result = __FAILURE__;
-            }
-            else
-            {
-                result = RESULT_OK;
-            }
+            MESSAGE_QUEUE_ITEM* mq_item = containingRecord(message_queue->in_progress.Blink, MESSAGE_QUEUE_ITEM, list_entry);
 
-            if (result != RESULT_OK)
-            {
-                LIST_ITEM_HANDLE list_item;
+            // Completions arriving later for these messages are not found in the index, so they are ignored.
+            remove_from_processing_list(message_queue, mq_item);
+            DList_InsertHeadList(&message_queue->pending, &mq_item->list_entry);
+        }
 
-                while ((list_item = singlylinkedlist_get_head_item(temp_list)) != NULL)
-                {
-                    dequeue_message_and_fire_callback(temp_list, list_item, MESSAGE_QUEUE_CANCELLED, NULL);
-                }
-            }
+        // Codes_SRS_MESSAGE_QUEUE_31_005: [The number of attempts and processing start time of each `mq_item` shall be reset]
+        for (entry = message_queue->pending.Flink; entry != &message_queue->pending; entry = entry->Flink)
+        {
+            MESSAGE_QUEUE_ITEM* mq_item = containingRecord(entry, MESSAGE_QUEUE_ITEM, list_entry);
 
-			singlylinkedlist_destroy(temp_list);
+            mq_item->number_of_attempts = 0;
+            mq_item->processing_start_time = 0;
         }
+
+        result = RESULT_OK;
     }
 
     return result;
@@ -484,14 +437,14 @@ void message_queue_destroy(MESSAGE_QUEUE_HANDLE message_queue)
         message_queue_remove_all(message_queue);
 
         // Codes_SRS_MESSAGE_QUEUE_09_015: [message_queue_destroy shall free all memory allocated and pointed by `message_queue`]
-        if (message_queue->pending != NULL)
+        if (message_queue->in_progress_index != NULL)
         {
-            singlylinkedlist_destroy(message_queue->pending);
+            free(message_queue->in_progress_index);
         }
 
-        if (message_queue->in_progress != NULL)
+        if (message_queue->tick_counter != NULL)
         {
-            singlylinkedlist_destroy(message_queue->in_progress);
+            tickcounter_destroy(message_queue->tick_counter);
         }
         
         free(message_queue);
@@ -525,20 +478,25 @@ MESSAGE_QUEUE_HANDLE message_queue_create(MESSAGE_QUEUE_CONFIG* config)
     {
         memset(result, 0, sizeof(MESSAGE_QUEUE));
 
-        // Codes_SRS_MESSAGE_QUEUE_09_006: [`message_queue->pending` shall be set using singlylinkedlist_create()]
-        if ((result->pending = singlylinkedlist_create()) == NULL)
+        // Codes_SRS_MESSAGE_QUEUE_09_006: [`message_queue->pending`, `message_queue->in_progress` and `message_queue->enqueue_order` shall be initialized using DList_InitializeListHead()]
+        DList_InitializeListHead(&result->pending);
+        DList_InitializeListHead(&result->in_progress);
+        DList_InitializeListHead(&result->enqueue_order);
+
+        // Codes_SRS_MESSAGE_QUEUE_09_008: [`message_queue->tick_counter` shall be set using tickcounter_create()]
+        if ((result->tick_counter = tickcounter_create()) == NULL)
         {
-            // Codes_SRS_MESSAGE_QUEUE_09_007: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
-            LogError("failed allocating MESSAGE_QUEUE pending list");
+            // Codes_SRS_MESSAGE_QUEUE_09_009: [If tickcounter_create fails, message_queue_create shall fail and return NULL]
+            LogError("failed allocating MESSAGE_QUEUE tick counter");
             // Codes_SRS_MESSAGE_QUEUE_09_011: [If any failures occur, message_queue_create shall release all memory it has allocated]
             message_queue_destroy(result);
             result = NULL;
         }
-        // Codes_SRS_MESSAGE_QUEUE_09_008: [`message_queue->in_progress` shall be set using singlylinkedlist_create()]
-        else if ((result->in_progress = singlylinkedlist_create()) == NULL)
+        // Codes_SRS_MESSAGE_QUEUE_31_006: [`message_queue->in_progress_index` shall be allocated with IN_PROGRESS_INDEX_INITIAL_SIZE buckets]
+        else if ((result->in_progress_index = (MESSAGE_QUEUE_ITEM**)malloc(sizeof(MESSAGE_QUEUE_ITEM*) * IN_PROGRESS_INDEX_INITIAL_SIZE)) == NULL)
         {
-            // Codes_SRS_MESSAGE_QUEUE_09_009: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
-            LogError("failed allocating MESSAGE_QUEUE in-progress list");
+            // Codes_SRS_MESSAGE_QUEUE_31_007: [If `message_queue->in_progress_index` cannot be allocated, message_queue_create shall fail and return NULL]
+            LogError("failed allocating MESSAGE_QUEUE in-progress index");
             // Codes_SRS_MESSAGE_QUEUE_09_011: [If any failures occur, message_queue_create shall release all memory it has allocated]
             message_queue_destroy(result);
             result = NULL;
@@ -548,6 +506,8 @@ MESSAGE_QUEUE_HANDLE message_queue_create(MESSAGE_QUEUE_CONFIG* config)
             // Codes_SRS_MESSAGE_QUEUE_09_010: [All arguments in `config` shall be saved into `message_queue`]
             // Codes_SRS_MESSAGE_QUEUE_09_012: [If no failures occur, message_queue_create shall return the `message_queue` pointer]
 
+            memset(result->in_progress_index, 0, sizeof(MESSAGE_QUEUE_ITEM*) * IN_PROGRESS_INDEX_INITIAL_SIZE);
+            result->in_progress_index_size = IN_PROGRESS_INDEX_INITIAL_SIZE;
             result->max_message_enqueued_time_secs = config->max_message_enqueued_time_secs;
             result->max_message_processing_time_secs = config->max_message_processing_time_secs;
             result->max_retry_count = config->max_retry_count;
@@ -583,31 +543,26 @@ int message_queue_add(MESSAGE_QUEUE_HANDLE message_queue, MQ_MESSAGE_HANDLE mess
         {
             memset(mq_item, 0, sizeof(MESSAGE_QUEUE_ITEM));
 
-            // Codes_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using get_time()]
-            if ((mq_item->enqueue_time = get_time(NULL)) == INDEFINITE_TIME)
+            // Codes_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using tickcounter_get_current_ms()]
+            if (tickcounter_get_current_ms(message_queue->tick_counter, &mq_item->enqueue_time) != 0)
             {
-                // Codes_SRS_MESSAGE_QUEUE_09_020: [If get_time fails, message_queue_add shall fail and return non-zero]
+                // Codes_SRS_MESSAGE_QUEUE_09_020: [If tickcounter_get_current_ms fails, message_queue_add shall fail and return non-zero]
                 LogError("failed setting message enqueue time");
                 // Codes_SRS_MESSAGE_QUEUE_09_024: [If any failures occur, message_queue_add shall release all memory it has allocated]
                 free(mq_item);
                 result = __FAILURE__;
             }
-            // Codes_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to `message_queue->pending` list]
-            else if (singlylinkedlist_add(message_queue->pending, (const void*)mq_item) == NULL)
-            {
-                // Codes_SRS_MESSAGE_QUEUE_09_022: [`mq_item` fails to be added to `message_queue->pending`, message_queue_add shall fail and return non-zero]
-                LogError("failed enqueing message");
-                // Codes_SRS_MESSAGE_QUEUE_09_024: [If any failures occur, message_queue_add shall release all memory it has allocated]
-                free(mq_item);
-                result = __FAILURE__;
-            }
             else
             {
                 // Codes_SRS_MESSAGE_QUEUE_09_023: [`message` shall be saved into `mq_item->message`]
                 mq_item->message = message;
                 mq_item->on_message_processing_completed_callback = on_message_processing_completed_callback;
                 mq_item->user_context = user_context;
-                mq_item->processing_start_time = INDEFINITE_TIME;
+
+                // Codes_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to the tail of `message_queue->pending` and `message_queue->enqueue_order` lists]
+                DList_InsertTailList(&message_queue->pending, &mq_item->list_entry);
+                DList_InsertTailList(&message_queue->enqueue_order, &mq_item->enqueue_order_entry);
+
                 // Codes_SRS_MESSAGE_QUEUE_09_025: [If no failures occur, message_queue_add shall return 0]
                 result = RESULT_OK;
             }
@@ -631,7 +586,7 @@ int message_queue_is_empty(MESSAGE_QUEUE_HANDLE message_queue, bool* is_empty)
     {
         // Codes_SRS_MESSAGE_QUEUE_09_031: [If `message_queue->pending` and `message_queue->in_progress` are empty, `is_empty` shall be set to true]
         // Codes_SRS_MESSAGE_QUEUE_09_032: [Otherwise `is_empty` shall be set to false]
-        *is_empty = (singlylinkedlist_get_head_item(message_queue->pending) == NULL && singlylinkedlist_get_head_item(message_queue->in_progress) == NULL);
+        *is_empty = DList_IsListEmpty(&message_queue->enqueue_order) ? true : false;
         // Codes_SRS_MESSAGE_QUEUE_09_033: [If no failures occur, message_queue_is_empty shall return 0]
         result = RESULT_OK;
     }
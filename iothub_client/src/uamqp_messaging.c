@@ -19,6 +19,7 @@
 #include "azure_uamqp_c/message.h"
 #include "azure_uamqp_c/amqpvalue.h"
 #include "iothub_message.h"
+#include "internal/iothub_message_private.h"
 #ifndef RESULT_OK
 #define RESULT_OK 0
 #endif
@@ -281,6 +282,11 @@ static int add_fault_injection_properties(MESSAGE_HANDLE message_batch_container
     return result;
 }
 
+static bool is_fault_injection_message(const char* const* property_keys, size_t property_count)
+{
+    return ((property_count != 0) && (strcmp(property_keys[0], "AzIoTHub_FaultOperationType") == 0));
+}
+
 // To test AMQP fault injection, we currently must have the error properties be specified on the batch_container
 // (not one of the messages sent in this container).  As the SDK layer does not support options for configuring
 // this envelope (this is AMQP/batching specific), we will instead intercept fault messages and apply to the container.
@@ -288,7 +294,7 @@ static int override_fault_injection_properties_if_needed(MESSAGE_HANDLE message_
 {
     int result;
     
-    if ((property_count == 0) || (strcmp(property_keys[0], "AzIoTHub_FaultOperationType") != 0))
+    if (!is_fault_injection_message(property_keys, property_count))
     {
         *override_for_fault_injection = false;
         result = RESULT_OK;
@@ -305,21 +311,16 @@ static int override_fault_injection_properties_if_needed(MESSAGE_HANDLE message_
 // Codes_SRS_UAMQP_MESSAGING_31_117: [Get application message properties associated with the IOTHUB_MESSAGE_HANDLE to encode, returning the properties and their encoded length.]
 static int create_application_properties_to_encode(MESSAGE_HANDLE message_batch_container, IOTHUB_MESSAGE_HANDLE messageHandle, AMQP_VALUE *application_properties, size_t *application_properties_length)
 {
-    MAP_HANDLE properties_map;
     const char* const* property_keys;
     const char* const* property_values;
     size_t property_count = 0;
     AMQP_VALUE uamqp_properties_map = NULL;
     int result;
 
-    if ((properties_map = IoTHubMessage_Properties(messageHandle)) == NULL)
+    // Codes_SRS_UAMQP_MESSAGING_31_124: [The application properties shall be read with IoTHubMessage_GetProperties, which copies nothing.]
+    if (IoTHubMessage_GetProperties(messageHandle, &property_keys, &property_values, &property_count, NULL) != IOTHUB_MESSAGE_OK)
     {
-        LogError("Failed to get property map from IoTHub message.");
-        result = __FAILURE__;
-    }
-    else if (Map_GetInternals(properties_map, &property_keys, &property_values, &property_count) != 0)
-    {
-        LogError("Failed reading the incoming uAMQP message properties");
+        LogError("Failed to get the properties of the IoTHub message.");
         result = __FAILURE__;
     }
     else if (property_count > 0)
@@ -661,6 +662,33 @@ int message_create_uamqp_encoding_from_iothub_message(MESSAGE_HANDLE message_bat
     return result;
 }
 
+// Codes_SRS_UAMQP_MESSAGING_31_126: [message_has_fault_injection_properties shall return true if the first application property of message_handle is `AzIoTHub_FaultOperationType`, whose properties are applied to the batch container instead of being encoded.]
+// Codes_SRS_UAMQP_MESSAGING_31_127: [If message_handle is NULL or its properties cannot be read, message_has_fault_injection_properties shall return false.]
+bool message_has_fault_injection_properties(IOTHUB_MESSAGE_HANDLE message_handle)
+{
+    bool result;
+    const char* const* property_keys;
+    const char* const* property_values;
+    size_t property_count;
+
+    if (message_handle == NULL)
+    {
+        LogError("Invalid argument (message_handle is NULL)");
+        result = false;
+    }
+    else if (IoTHubMessage_GetProperties(message_handle, &property_keys, &property_values, &property_count, NULL) != IOTHUB_MESSAGE_OK)
+    {
+        LogError("Failed to get the properties of the IoTHub message.");
+        result = false;
+    }
+    else
+    {
+        result = is_fault_injection_message(property_keys, property_count);
+    }
+
+    return result;
+}
+
 static int readMessageIdFromuAQMPMessage(IOTHUB_MESSAGE_HANDLE iothub_message_handle, PROPERTIES_HANDLE uamqp_message_properties)
 {
     int result;
@@ -1104,11 +1132,11 @@ int message_create_IoTHubMessage_from_uamqp_message(MESSAGE_HANDLE uamqp_message
                 LogError("Failed to get the body of the uamqp message.");
                 result = __FAILURE__;
             }
-            // Codes_SRS_UAMQP_MESSAGING_09_006: [The IOTHUB_MESSAGE instance shall be created using IoTHubMessage_CreateFromByteArray(), passing the uAMQP body bytes as parameter.]
-            else if ((iothub_message = IoTHubMessage_CreateFromByteArray(binary_data.bytes, binary_data.length)) == NULL)
+            // Codes_SRS_UAMQP_MESSAGING_31_125: [The IOTHUB_MESSAGE instance shall be created using IoTHubMessage_CreateFromBorrowedByteArray(), pointing at the uAMQP body bytes, which stay valid as long as the uAMQP message.]
+            else if ((iothub_message = IoTHubMessage_CreateFromBorrowedByteArray(binary_data.bytes, binary_data.length)) == NULL)
             {
-                // Codes_SRS_UAMQP_MESSAGING_09_007: [If IoTHubMessage_CreateFromByteArray() fails, message_create_IoTHubMessage_from_uamqp_message shall fail and return immediately.]
-                LogError("Failed creating the IOTHUB_MESSAGE_HANDLE instance (IoTHubMessage_CreateFromByteArray failed).");
+                // Codes_SRS_UAMQP_MESSAGING_09_007: [If IoTHubMessage_CreateFromBorrowedByteArray() fails, message_create_IoTHubMessage_from_uamqp_message shall fail and return immediately.]
+                LogError("Failed creating the IOTHUB_MESSAGE_HANDLE instance (IoTHubMessage_CreateFromBorrowedByteArray failed).");
                 result = __FAILURE__;
             }
         }
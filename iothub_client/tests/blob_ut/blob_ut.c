@@ -30,8 +30,32 @@ static void my_gballoc_free(void* s)
 #include "azure_c_shared_utility/httpheaders.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/vector.h"
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #undef ENABLE_MOCKS
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    extern BUFFER_HANDLE real_BUFFER_new(void);
+    extern BUFFER_HANDLE real_BUFFER_create(const unsigned char* source, size_t size);
+    extern void real_BUFFER_delete(BUFFER_HANDLE handle);
+    extern unsigned char* real_BUFFER_u_char(BUFFER_HANDLE handle);
+    extern size_t real_BUFFER_length(BUFFER_HANDLE handle);
+    extern int real_BUFFER_enlarge(BUFFER_HANDLE handle, size_t enlargeSize);
+
+    extern VECTOR_HANDLE real_VECTOR_create(size_t elementSize);
+    extern void real_VECTOR_destroy(VECTOR_HANDLE handle);
+    extern int real_VECTOR_push_back(VECTOR_HANDLE handle, const void* elements, size_t numElements);
+    extern void* real_VECTOR_element(VECTOR_HANDLE handle, size_t index);
+    extern size_t real_VECTOR_size(VECTOR_HANDLE handle);
+#ifdef __cplusplus
+}
+#endif
+
 #include "internal/blob.h"
 #include "testrunnerswitcher.h"
 #include "umock_c.h"
@@ -109,6 +133,72 @@ static STRING_HANDLE my_Base64_Encode_Bytes(const unsigned char* source, size_t
     return (STRING_HANDLE)my_gballoc_malloc(1);
 }
 
+static STRING_HANDLE my_STRING_new(void)
+{
+    return my_STRING_construct("");
+}
+
+static BUFFER_HANDLE my_BUFFER_new(void)
+{
+    return (BUFFER_HANDLE)my_gballoc_malloc(1);
+}
+
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4401
+#define TEST_COND_HANDLE (COND_HANDLE)0x4402
+#define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4403
+
+/*the worker threads are not started, so every block is uploaded by the calling thread*/
+static THREADAPI_RESULT test_thread_create_result;
+static size_t test_threads_created;
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    (void)func;
+    (void)arg;
+    if (test_thread_create_result == THREADAPI_OK)
+    {
+        *threadHandle = TEST_THREAD_HANDLE;
+        test_threads_created++;
+    }
+    return test_thread_create_result;
+}
+
+/*answers the requests with the statuses queued in test_http_statuses, then with 201*/
+static size_t test_executed_requests;
+static size_t test_failing_requests; /*the first requests fail with HTTPAPIEX_ERROR*/
+static unsigned int test_http_statuses[4];
+static size_t test_http_status_count;
+static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTTPAPI_REQUEST_TYPE requestType, const char* relativePath, HTTP_HEADERS_HANDLE requestHttpHeadersHandle, BUFFER_HANDLE requestContent, unsigned int* statusCode, HTTP_HEADERS_HANDLE responseHttpHeadersHandle, BUFFER_HANDLE responseContent)
+{
+    HTTPAPIEX_RESULT result;
+    (void)handle;
+    (void)requestType;
+    (void)relativePath;
+    (void)requestHttpHeadersHandle;
+    (void)requestContent;
+    (void)responseHttpHeadersHandle;
+    (void)responseContent;
+
+    test_executed_requests++;
+    if (test_failing_requests > 0)
+    {
+        test_failing_requests--;
+        result = HTTPAPIEX_ERROR;
+    }
+    else if (test_http_status_count > 0)
+    {
+        *statusCode = test_http_statuses[0];
+        (void)memmove(test_http_statuses, test_http_statuses + 1, sizeof(test_http_statuses) - sizeof(test_http_statuses[0]));
+        test_http_status_count--;
+        result = HTTPAPIEX_OK;
+    }
+    else
+    {
+        *statusCode = 201;
+        result = HTTPAPIEX_OK;
+    }
+    return result;
+}
+
 TEST_DEFINE_ENUM_TYPE(BLOB_RESULT, BLOB_RESULT_VALUES);
 
 static TEST_MUTEX_HANDLE g_dllByDll;
@@ -236,6 +326,47 @@ static IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT FileUpload_GetFakeData_Callback
     return IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_OK;
 }
 
+/**
+ * BLOB_UPLOAD_CONTEXT_CHUNKS and FileUpload_GetChunks_Callback
+ * allow to simulate a user who hands chunkCount chunks
+ * of size chunkSize, all from the same buffer
+ */
+typedef struct BLOB_UPLOAD_CONTEXT_CHUNKS_TAG
+{
+    unsigned char data[100]; /* the chunks are read from here */
+    size_t chunkSize; /* size of the chunks, can be more than data when the data is not read */
+    size_t chunkCount; /* number of chunks wanted */
+    size_t chunksRead; /* number of chunks already handed out */
+    size_t abortAfterChunks; /* the callback aborts once this many chunks are read, if not 0 */
+}BLOB_UPLOAD_CONTEXT_CHUNKS;
+
+static IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT FileUpload_GetChunks_Callback(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, unsigned char const ** data, size_t* size, void* _uploadContext)
+{
+    BLOB_UPLOAD_CONTEXT_CHUNKS* uploadContext = (BLOB_UPLOAD_CONTEXT_CHUNKS*)_uploadContext;
+    IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT getDataResult = IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_OK;
+    (void)result;
+
+    if ((uploadContext->abortAfterChunks != 0) && (uploadContext->chunksRead == uploadContext->abortAfterChunks))
+    {
+        getDataResult = IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_ABORT;
+    }
+    else if (uploadContext->chunksRead >= uploadContext->chunkCount)
+    {
+        *data = NULL;
+        *size = 0;
+    }
+    else
+    {
+        uploadContext->chunksRead++;
+        *data = uploadContext->data;
+        *size = uploadContext->chunkSize;
+    }
+
+    return getDataResult;
+}
+
+static BLOB_UPLOAD_CONTEXT_CHUNKS chunksContext;
+
 BEGIN_TEST_SUITE(blob_ut)
 
 TEST_SUITE_INITIALIZE(TestSuiteInitialize)
@@ -279,6 +410,32 @@ TEST_SUITE_INITIALIZE(TestSuiteInitialize)
 
     REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(VECTOR_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_new, my_STRING_new);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_new, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, my_BUFFER_new);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_new, NULL);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, real_VECTOR_destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_push_back, real_VECTOR_push_back);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_element, real_VECTOR_element);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_size, real_VECTOR_size);
 
     REGISTER_TYPE(HTTPAPI_REQUEST_TYPE, HTTPAPI_REQUEST_TYPE);
     REGISTER_TYPE(HTTPAPIEX_RESULT, HTTPAPIEX_RESULT);
@@ -302,6 +459,12 @@ TEST_SUITE_CLEANUP(TestClassCleanup)
 static void reset_test_data()
 {
     memset(&context, 0, sizeof(context));
+    memset(&chunksContext, 0, sizeof(chunksContext));
+    test_thread_create_result = THREADAPI_OK;
+    test_threads_created = 0;
+    test_executed_requests = 0;
+    test_failing_requests = 0;
+    test_http_status_count = 0;
 }
 
 TEST_FUNCTION_INITIALIZE(Setup)
@@ -1628,4 +1791,291 @@ TEST_FUNCTION(Blob_UploadMultipleBlocksFromSasUri_returns_BLOB_ABORTED_when_call
     gballoc_free(fakeContext.fakeData);
 }
 
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/*Tests_SRS_BLOB_31_001: [ If SASURI, getDataCallbackEx, httpStatus or httpResponse is NULL, if maxConcurrentBlocks is 0 or more than 50000, or if blockSize is bigger than 4MB, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_with_NULL_SasUri_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = 1;
+    chunksContext.chunkCount = 1;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri(NULL, FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_001: [ If SASURI, getDataCallbackEx, httpStatus or httpResponse is NULL, if maxConcurrentBlocks is 0 or more than 50000, or if blockSize is bigger than 4MB, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_with_0_maxConcurrentBlocks_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = 1;
+    chunksContext.chunkCount = 1;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 0, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_001: [ If SASURI, getDataCallbackEx, httpStatus or httpResponse is NULL, if maxConcurrentBlocks is 0 or more than 50000, or if blockSize is bigger than 4MB, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_with_blockSize_over_4MB_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = 1;
+    chunksContext.chunkCount = 1;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, BLOCK_SIZE + 1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_002: [ If the hostname cannot be determined, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_when_SasUri_is_wrong_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = 1;
+    chunksContext.chunkCount = 1;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(size_t, 0, chunksContext.chunksRead);
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_003: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall create maxConcurrentBlocks connections to the hostname by calling HTTPAPIEX_Create, passing them certificates and proxyOptions, and start maxConcurrentBlocks - 1 worker threads, the calling thread being the last worker. ]*/
+/*Tests_SRS_BLOB_31_005: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall read the data from getDataCallbackEx on the calling thread, appending it to the current block for as long as the block does not exceed blockSize; with blockSize 0 every piece of data returned by getDataCallbackEx is a block. ]*/
+/*Tests_SRS_BLOB_31_009: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall read ahead at most 2 * maxConcurrentBlocks blocks that are not uploaded yet; when that many are pending, the calling thread shall upload the next queued block, or wait for a worker to finish one. ]*/
+/*Tests_SRS_BLOB_31_013: [ Once all the blocks are uploaded, Blob_UploadMultipleBlocksInParallelFromSasUri shall construct the XML block list with the block IDs in ascending order and PUT it to base relativePath + "&comp=blocklist" over the connection of the calling thread, passing httpStatus and httpResponse. ]*/
+/*Tests_SRS_BLOB_31_014: [ If HTTPAPIEX_ExecuteRequest fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_HTTP_ERROR, otherwise it shall succeed and return BLOB_OK. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_happy_path)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 10;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 3, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 2, test_threads_created);
+    ASSERT_ARE_EQUAL(size_t, 10, chunksContext.chunksRead);
+    ASSERT_ARE_EQUAL(size_t, 11, test_executed_requests); /*10 blocks and the block list*/
+    ASSERT_ARE_EQUAL(int, 201, httpResponse);
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_005: [ Blob_UploadMultipleBlocksInParallelFromSasUri shall read the data from getDataCallbackEx on the calling thread, appending it to the current block for as long as the block does not exceed blockSize; with blockSize 0 every piece of data returned by getDataCallbackEx is a block. ]*/
+/*Tests_SRS_BLOB_31_007: [ If the size of the data returned by getDataCallbackEx is 0 or if the data is NULL, then Blob_UploadMultipleBlocksInParallelFromSasUri shall stop reading, the data already read making the last block. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_puts_chunks_together_up_to_blockSize)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 10;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, real_BUFFER_new);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_create, real_BUFFER_create);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_delete, real_BUFFER_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_u_char, real_BUFFER_u_char);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, real_BUFFER_length);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_enlarge, real_BUFFER_enlarge);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 250);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 10, chunksContext.chunksRead);
+    ASSERT_ARE_EQUAL(size_t, 6, test_executed_requests); /*5 blocks of 200 bytes and the block list*/
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, my_BUFFER_new);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_create, my_BUFFER_create);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_delete, my_BUFFER_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_u_char, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_enlarge, NULL);
+}
+
+/*Tests_SRS_BLOB_31_011: [ If Blob_UploadBlock returns BLOB_HTTP_ERROR, or an HTTP status of 500 or more, the block shall be uploaded again, up to 3 attempts in total, waiting longer after each attempt. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_retries_a_block_when_storage_answers_5xx)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 2;
+    test_http_statuses[0] = 503;
+    test_http_statuses[1] = 500;
+    test_http_status_count = 2;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 5, test_executed_requests); /*3 attempts for the first block, 1 for the second and the block list*/
+    ASSERT_ARE_EQUAL(int, 201, httpResponse);
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_011: [ If Blob_UploadBlock returns BLOB_HTTP_ERROR, or an HTTP status of 500 or more, the block shall be uploaded again, up to 3 attempts in total, waiting longer after each attempt. ]*/
+/*Tests_SRS_BLOB_31_012: [ If a block still fails, no further block shall be taken and, once the blocks on the wire are done with, Blob_UploadMultipleBlocksInParallelFromSasUri shall return BLOB_OK with the HTTP status and response of that block when storage answered it, the result of Blob_UploadBlock otherwise. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_fails_when_a_block_fails_3_times)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 1;
+    test_failing_requests = 3;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_HTTP_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 3, test_executed_requests); /*no block list*/
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_012: [ If a block still fails, no further block shall be taken and, once the blocks on the wire are done with, Blob_UploadMultipleBlocksInParallelFromSasUri shall return BLOB_OK with the HTTP status and response of that block when storage answered it, the result of Blob_UploadBlock otherwise. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_succeeds_with_the_status_of_a_block_rejected_by_storage)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 1;
+    test_http_statuses[0] = 403;
+    test_http_status_count = 1;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_OK, result);
+    ASSERT_ARE_EQUAL(int, 403, httpResponse);
+    ASSERT_ARE_EQUAL(size_t, 1, test_executed_requests); /*4xx are not retried, no block list*/
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_006: [ If getDataCallbackEx returns IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_ABORT then Blob_UploadMultipleBlocksInParallelFromSasUri shall stop reading and return BLOB_ABORTED once the blocks on the wire are done with. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_returns_BLOB_ABORTED_when_callback_aborts_after_5_blocks)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 10;
+    chunksContext.abortAfterChunks = 5;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 4, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ABORTED, result);
+    ASSERT_ARE_EQUAL(size_t, 5, chunksContext.chunksRead);
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_008: [ If the size of the data returned by getDataCallbackEx is bigger than 4MB, or if there are more than 50000 blocks, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_when_chunk_is_over_4MB_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = BLOCK_SIZE + 1;
+    chunksContext.chunkCount = 1;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_008: [ If the size of the data returned by getDataCallbackEx is bigger than 4MB, or if there are more than 50000 blocks, then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_INVALID_ARG. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_when_blockCount_is_one_over_maximum_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = 1;
+    chunksContext.chunkCount = MAX_BLOCK_COUNT + 1;
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, my_HTTPAPIEX_ExecuteRequest);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(size_t, MAX_BLOCK_COUNT + 1, chunksContext.chunksRead);
+
+    ///cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_ExecuteRequest, NULL);
+}
+
+/*Tests_SRS_BLOB_31_004: [ If creating a connection or a worker thread fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_fails_when_ThreadAPI_Create_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 1;
+    test_thread_create_result = THREADAPI_ERROR;
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 0, chunksContext.chunksRead);
+
+    ///cleanup
+}
+
+/*Tests_SRS_BLOB_31_004: [ If creating a connection or a worker thread fails then Blob_UploadMultipleBlocksInParallelFromSasUri shall fail and return BLOB_ERROR. ]*/
+TEST_FUNCTION(Blob_UploadMultipleBlocksInParallelFromSasUri_fails_when_HTTPAPIEX_Create_fails)
+{
+    ///arrange
+    chunksContext.chunkSize = sizeof(chunksContext.data);
+    chunksContext.chunkCount = 1;
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create("h.h"))
+        .SetReturn(NULL);
+
+    ///act
+    BLOB_RESULT result = Blob_UploadMultipleBlocksInParallelFromSasUri("https://h.h/something?a=b", FileUpload_GetChunks_Callback, &chunksContext, &httpResponse, testValidBufferHandle, NULL, NULL, 2, 0);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BLOB_RESULT, BLOB_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 0, chunksContext.chunksRead);
+
+    ///cleanup
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
 END_TEST_SUITE(blob_ut);
@@ -0,0 +1,394 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+void* real_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void real_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_ingestion_queue.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+#define TEST_ITEM(index) ((void*)(uintptr_t)(0x100 + (index)))
+
+static INGESTION_QUEUE_HANDLE create_queue(size_t capacity)
+{
+    INGESTION_QUEUE_HANDLE queue = ingestion_queue_create(capacity);
+    ASSERT_IS_NOT_NULL(queue);
+    umock_c_reset_all_calls();
+    return queue;
+}
+
+BEGIN_TEST_SUITE(iothub_client_ingestion_queue_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(malloc, real_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(free, real_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_002: [ If capacity is 0 or greater than 2^30, ingestion_queue_create shall fail and return NULL. ]
+TEST_FUNCTION(ingestion_queue_create_zero_capacity_fails)
+{
+    // act
+    INGESTION_QUEUE_HANDLE queue = ingestion_queue_create(0);
+
+    // assert
+    ASSERT_IS_NULL(queue);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_002: [ If capacity is 0 or greater than 2^30, ingestion_queue_create shall fail and return NULL. ]
+TEST_FUNCTION(ingestion_queue_create_capacity_too_large_fails)
+{
+    // act
+    INGESTION_QUEUE_HANDLE queue = ingestion_queue_create(((size_t)1 << 30) + 1);
+
+    // assert
+    ASSERT_IS_NULL(queue);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_003: [ ingestion_queue_create shall allocate the queue and an array of cells whose size is capacity rounded up to the next power of 2. ]
+TEST_FUNCTION(ingestion_queue_create_succeed)
+{
+    // arrange
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    INGESTION_QUEUE_HANDLE queue = ingestion_queue_create(8);
+
+    // assert
+    ASSERT_IS_NOT_NULL(queue);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(ingestion_queue_is_empty(queue));
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_004: [ If any allocation fails, ingestion_queue_create shall fail and return NULL. ]
+TEST_FUNCTION(ingestion_queue_create_malloc_fails)
+{
+    // arrange
+    size_t index;
+    ASSERT_ARE_EQUAL(int, 0, umock_c_negative_tests_init());
+
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    umock_c_negative_tests_snapshot();
+
+    for (index = 0; index < umock_c_negative_tests_call_count(); index++)
+    {
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        // act
+        INGESTION_QUEUE_HANDLE queue = ingestion_queue_create(8);
+
+        // assert
+        ASSERT_IS_NULL(queue);
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_005: [ If queue or item is NULL, ingestion_queue_push shall fail and return a non-zero value. ]
+TEST_FUNCTION(ingestion_queue_push_NULL_queue_fails)
+{
+    // act
+    int result = ingestion_queue_push(NULL, TEST_ITEM(0));
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_005: [ If queue or item is NULL, ingestion_queue_push shall fail and return a non-zero value. ]
+TEST_FUNCTION(ingestion_queue_push_NULL_item_fails)
+{
+    // arrange
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+
+    // act
+    int result = ingestion_queue_push(queue, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(ingestion_queue_is_empty(queue));
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_006: [ ingestion_queue_push shall claim the next cell by atomically advancing the push index, without taking any lock. ]
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_008: [ ingestion_queue_push shall store item in the cell and then publish it to the consumer. ]
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_009: [ On success ingestion_queue_push shall return 0. ]
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_012: [ Otherwise ingestion_queue_pop shall return the oldest item and hand its cell back to the producers. ]
+TEST_FUNCTION(ingestion_queue_pop_returns_items_in_push_order)
+{
+    // arrange
+    size_t index;
+    INGESTION_QUEUE_HANDLE queue = create_queue(4);
+    for (index = 0; index < 3; index++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, ingestion_queue_push(queue, TEST_ITEM(index)));
+    }
+
+    // act & assert
+    ASSERT_IS_FALSE(ingestion_queue_is_empty(queue));
+    for (index = 0; index < 3; index++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM(index), ingestion_queue_pop(queue));
+    }
+    ASSERT_IS_TRUE(ingestion_queue_is_empty(queue));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_003: [ ingestion_queue_create shall allocate the queue and an array of cells whose size is capacity rounded up to the next power of 2. ]
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_007: [ If the queue is full, ingestion_queue_push shall fail and return a non-zero value. ]
+TEST_FUNCTION(ingestion_queue_push_full_fails)
+{
+    // arrange
+    size_t index;
+    INGESTION_QUEUE_HANDLE queue = create_queue(3);
+    for (index = 0; index < 4; index++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, ingestion_queue_push(queue, TEST_ITEM(index)));
+    }
+
+    // act
+    int result = ingestion_queue_push(queue, TEST_ITEM(4));
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM(0), ingestion_queue_pop(queue));
+    ASSERT_ARE_EQUAL(int, 0, ingestion_queue_push(queue, TEST_ITEM(4)));
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_012: [ Otherwise ingestion_queue_pop shall return the oldest item and hand its cell back to the producers. ]
+TEST_FUNCTION(ingestion_queue_wraps_around)
+{
+    // arrange
+    size_t index;
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+
+    // act & assert
+    for (index = 0; index < 11; index++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, ingestion_queue_push(queue, TEST_ITEM(index)));
+        ASSERT_ARE_EQUAL(void_ptr, TEST_ITEM(index), ingestion_queue_pop(queue));
+    }
+    ASSERT_IS_TRUE(ingestion_queue_is_empty(queue));
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_010: [ If queue is NULL, ingestion_queue_pop shall return NULL. ]
+TEST_FUNCTION(ingestion_queue_pop_NULL_queue_returns_NULL)
+{
+    // act
+    void* result = ingestion_queue_pop(NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_011: [ If the oldest cell has not been published yet, ingestion_queue_pop shall return NULL. ]
+TEST_FUNCTION(ingestion_queue_pop_empty_returns_NULL)
+{
+    // arrange
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+
+    // act
+    void* result = ingestion_queue_pop(queue);
+
+    // assert
+    ASSERT_IS_NULL(result);
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_013: [ If queue is NULL, ingestion_queue_is_empty shall return true. ]
+TEST_FUNCTION(ingestion_queue_is_empty_NULL_queue_returns_true)
+{
+    // act
+    bool result = ingestion_queue_is_empty(NULL);
+
+    // assert
+    ASSERT_IS_TRUE(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_017: [ If queue is NULL, ingestion_queue_set_consumer_waiting shall return. ]
+TEST_FUNCTION(ingestion_queue_set_consumer_waiting_NULL_queue)
+{
+    // act
+    ingestion_queue_set_consumer_waiting(NULL, true);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_019: [ If queue is NULL, ingestion_queue_is_consumer_waiting shall return false. ]
+TEST_FUNCTION(ingestion_queue_is_consumer_waiting_NULL_queue_returns_false)
+{
+    // act
+    bool result = ingestion_queue_is_consumer_waiting(NULL);
+
+    // assert
+    ASSERT_IS_FALSE(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_020: [ ingestion_queue_is_consumer_waiting shall issue a full memory fence and then return the last value stored by ingestion_queue_set_consumer_waiting. ]
+TEST_FUNCTION(ingestion_queue_is_consumer_waiting_is_false_after_create)
+{
+    // arrange
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+
+    // act
+    bool result = ingestion_queue_is_consumer_waiting(queue);
+
+    // assert
+    ASSERT_IS_FALSE(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_018: [ ingestion_queue_set_consumer_waiting shall store waiting and then issue a full memory fence. ]
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_020: [ ingestion_queue_is_consumer_waiting shall issue a full memory fence and then return the last value stored by ingestion_queue_set_consumer_waiting. ]
+TEST_FUNCTION(ingestion_queue_is_consumer_waiting_follows_set_consumer_waiting)
+{
+    // arrange
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+
+    // act
+    ingestion_queue_set_consumer_waiting(queue, true);
+    bool raised = ingestion_queue_is_consumer_waiting(queue);
+    ingestion_queue_set_consumer_waiting(queue, false);
+    bool lowered = ingestion_queue_is_consumer_waiting(queue);
+
+    // assert
+    ASSERT_IS_TRUE(raised);
+    ASSERT_IS_FALSE(lowered);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    ingestion_queue_destroy(queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_015: [ If queue is NULL, ingestion_queue_destroy shall return. ]
+TEST_FUNCTION(ingestion_queue_destroy_NULL_queue)
+{
+    // act
+    ingestion_queue_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_INGESTION_QUEUE_31_016: [ ingestion_queue_destroy shall free the cells and the queue. Items still queued are not touched. ]
+TEST_FUNCTION(ingestion_queue_destroy_succeed)
+{
+    // arrange
+    INGESTION_QUEUE_HANDLE queue = create_queue(2);
+    (void)ingestion_queue_push(queue, TEST_ITEM(0));
+
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    ingestion_queue_destroy(queue);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothub_client_ingestion_queue_ut)
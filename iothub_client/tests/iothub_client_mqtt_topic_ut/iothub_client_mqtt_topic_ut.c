@@ -0,0 +1,605 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#endif
+
+void* real_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void* real_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void real_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/urlencode.h"
+#include "iothub_message.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_mqtt_topic.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+static const IOTHUB_MESSAGE_HANDLE TEST_MESSAGE_HANDLE = (IOTHUB_MESSAGE_HANDLE)0x4242;
+static const char* TEST_EVENT_TOPIC = "devices/thisIsDeviceID/messages/events/";
+static const char* TEST_ENCODED_TEXT = "ENCODED";
+
+static const char* g_property_keys[2] = { "propKey1", "propKey2" };
+static const char* g_property_values[2] = { "propValue1", "propValue2" };
+static size_t g_property_count;
+static IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA g_diagnostic_data;
+
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetProperties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* const** keys, const char* const** values, size_t* count, size_t* keysAndValuesLength)
+{
+    size_t index;
+    (void)iotHubMessageHandle;
+    *keys = g_property_keys;
+    *values = g_property_values;
+    *count = g_property_count;
+    if (keysAndValuesLength != NULL)
+    {
+        *keysAndValuesLength = 0;
+        for (index = 0; index < g_property_count; index++)
+        {
+            *keysAndValuesLength += strlen(g_property_keys[index]) + strlen(g_property_values[index]);
+        }
+    }
+    return IOTHUB_MESSAGE_OK;
+}
+
+static STRING_HANDLE my_URL_EncodeString(const char* textEncode)
+{
+    (void)textEncode;
+    return (STRING_HANDLE)real_malloc(1);
+}
+
+static const char* my_STRING_c_str(STRING_HANDLE handle)
+{
+    (void)handle;
+    return TEST_ENCODED_TEXT;
+}
+
+static void my_STRING_delete(STRING_HANDLE handle)
+{
+    real_free(handle);
+}
+
+static void setup_encode_event_getters(const char* correlation_id, const char* message_id, const char* content_type, const char* content_encoding, const IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA* diagnostic_data)
+{
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetCorrelationId(TEST_MESSAGE_HANDLE)).SetReturn(correlation_id);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetMessageId(TEST_MESSAGE_HANDLE)).SetReturn(message_id);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentTypeSystemProperty(TEST_MESSAGE_HANDLE)).SetReturn(content_type);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentEncodingSystemProperty(TEST_MESSAGE_HANDLE)).SetReturn(content_encoding);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetDiagnosticPropertyData(TEST_MESSAGE_HANDLE)).SetReturn(diagnostic_data);
+}
+
+static void setup_url_encode(const char* text)
+{
+    STRICT_EXPECTED_CALL(URL_EncodeString(text));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+}
+
+static void assert_view(const char* expected, const MQTT_TOPIC_VIEW* view)
+{
+    ASSERT_ARE_EQUAL(size_t, strlen(expected), view->length);
+    ASSERT_IS_TRUE(memcmp(expected, view->start, view->length) == 0);
+}
+
+BEGIN_TEST_SUITE(iothub_client_mqtt_topic_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_bool_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(malloc, real_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(realloc, real_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(free, real_free);
+
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetProperties, my_IoTHubMessage_GetProperties);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_GetProperties, IOTHUB_MESSAGE_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetCorrelationId, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetMessageId, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentTypeSystemProperty, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetContentEncodingSystemProperty, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetDiagnosticPropertyData, NULL);
+
+    REGISTER_GLOBAL_MOCK_HOOK(URL_EncodeString, my_URL_EncodeString);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(URL_EncodeString, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_c_str, my_STRING_c_str);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_delete, my_STRING_delete);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    g_property_count = 0;
+    g_property_values[1] = "propValue2";
+    g_diagnostic_data.diagnosticId = NULL;
+    g_diagnostic_data.diagnosticCreationTimeUtc = NULL;
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_001: [ If topic_buffer, event_topic or message is NULL, mqtt_topic_encode_event shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_encode_event_NULL_topic_buffer_fails)
+{
+    // act
+    const char* result = mqtt_topic_encode_event(NULL, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_001: [ If topic_buffer, event_topic or message is NULL, mqtt_topic_encode_event shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_encode_event_NULL_message_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, NULL, false);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_IS_NULL(topic_buffer.buffer);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_002: [ mqtt_topic_encode_event shall read the application properties with IoTHubMessage_GetProperties, which copies nothing, and fail if that fails. ]
+TEST_FUNCTION(mqtt_topic_encode_event_GetProperties_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_008: [ Otherwise mqtt_topic_encode_event shall return the NULL terminated topic in topic_buffer. ]
+TEST_FUNCTION(mqtt_topic_encode_event_no_properties_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    setup_encode_event_getters(NULL, NULL, NULL, NULL, NULL);
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG));
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, TEST_EVENT_TOPIC, result);
+    ASSERT_ARE_EQUAL(void_ptr, topic_buffer.buffer, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_005: [ mqtt_topic_encode_event shall append the application properties as name=value pairs separated by '&', then $.cid, $.mid, $.ct and $.ce for the system properties that are set, then $.diagid and $.diagctx when the diagnostic data is set. ]
+TEST_FUNCTION(mqtt_topic_encode_event_all_properties_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    g_property_count = 2;
+    g_diagnostic_data.diagnosticId = (char*)"1234abcd";
+    g_diagnostic_data.diagnosticCreationTimeUtc = (char*)"1506054516.100";
+    setup_encode_event_getters("core_id", "msg_id", "application/json", "utf8", &g_diagnostic_data);
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG));
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr,
+        "devices/thisIsDeviceID/messages/events/propKey1=propValue1&propKey2=propValue2&%24.cid=core_id&%24.mid=msg_id&%24.ct=application/json&%24.ce=utf8&%24.diagid=1234abcd&%24.diagctx=creationtimeutc%3d1506054516.100",
+        result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_004: [ mqtt_topic_encode_event shall size topic_buffer once from the length of the topic and of the properties, reusing it as it is when it is large enough, and only grow it again for the characters URL encoding adds. ]
+TEST_FUNCTION(mqtt_topic_encode_event_reuses_topic_buffer)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    g_property_count = 2;
+    setup_encode_event_getters(NULL, NULL, NULL, NULL, NULL);
+    const char* first_topic = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+    ASSERT_IS_NOT_NULL(first_topic);
+    umock_c_reset_all_calls();
+
+    setup_encode_event_getters("core_id", NULL, NULL, NULL, NULL);
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, first_topic, result);
+    ASSERT_ARE_EQUAL(char_ptr, "devices/thisIsDeviceID/messages/events/propKey1=propValue1&propKey2=propValue2&%24.cid=core_id", result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_006: [ When urlencode is true, mqtt_topic_encode_event shall URL encode the names and values with URL_EncodeString, except for the ones only made of letters, digits, '-', '.' and '_', which are written as they are. ]
+TEST_FUNCTION(mqtt_topic_encode_event_urlencode_only_encodes_unsafe_values)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    g_property_count = 2;
+    g_property_values[1] = "prop value/2";
+    setup_encode_event_getters("core_id", NULL, "application/json", NULL, NULL);
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG));
+    setup_url_encode("prop value/2");
+    setup_url_encode("application/json");
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, true);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, "devices/thisIsDeviceID/messages/events/propKey1=propValue1&propKey2=ENCODED&%24.cid=core_id&%24.ct=ENCODED", result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_003: [ If only one of the diagnostic id and the diagnostic creation time is set, mqtt_topic_encode_event shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_encode_event_incomplete_diagnostic_data_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    g_diagnostic_data.diagnosticId = (char*)"1234abcd";
+    setup_encode_event_getters(NULL, NULL, NULL, NULL, &g_diagnostic_data);
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_007: [ If growing topic_buffer or URL encoding fails, mqtt_topic_encode_event shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_encode_event_fails_when_realloc_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    setup_encode_event_getters(NULL, NULL, NULL, NULL, NULL);
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, false);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_IS_NULL(topic_buffer.buffer);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_007: [ If growing topic_buffer or URL encoding fails, mqtt_topic_encode_event shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_encode_event_fails_when_URL_EncodeString_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    setup_encode_event_getters(NULL, NULL, "application/json", NULL, NULL);
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(URL_EncodeString("application/json"))
+        .SetReturn(NULL);
+
+    // act
+    const char* result = mqtt_topic_encode_event(&topic_buffer, TEST_EVENT_TOPIC, TEST_MESSAGE_HANDLE, true);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_009: [ If topic or topic_info is NULL, mqtt_topic_parse shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_parse_NULL_topic_fails)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse(NULL, &topic_info);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_009: [ If topic or topic_info is NULL, mqtt_topic_parse shall fail and return a non-zero value. ]
+TEST_FUNCTION(mqtt_topic_parse_NULL_topic_info_fails)
+{
+    // act
+    int result = mqtt_topic_parse("$iothub/twin/res/200/?$rid=2", NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_010: [ mqtt_topic_parse shall classify the topic from its prefix, $iothub/twin and $iothub/methods compared without regard to case, in a single pass and without allocating. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_011: [ For a twin topic whose third segment is PATCH, mqtt_topic_parse shall return MQTT_TOPIC_KIND_TWIN_PATCH; otherwise it shall return MQTT_TOPIC_KIND_TWIN_RESPONSE with the status of the fourth segment and the request id following ?$rid=, and fail when there is no fourth segment. ]
+TEST_FUNCTION(mqtt_topic_parse_twin_response_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("$IoTHub/Twin/res/204/?$rid=17&$version=3", &topic_info);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_KIND_TWIN_RESPONSE, topic_info.kind);
+    ASSERT_ARE_EQUAL(int, 204, topic_info.status_code);
+    assert_view("17", &topic_info.request_id);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_011: [ For a twin topic whose third segment is PATCH, mqtt_topic_parse shall return MQTT_TOPIC_KIND_TWIN_PATCH; otherwise it shall return MQTT_TOPIC_KIND_TWIN_RESPONSE with the status of the fourth segment and the request id following ?$rid=, and fail when there is no fourth segment. ]
+TEST_FUNCTION(mqtt_topic_parse_twin_patch_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("$iothub/twin/PATCH/properties/desired/?$version=5", &topic_info);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_KIND_TWIN_PATCH, topic_info.kind);
+    ASSERT_ARE_EQUAL(size_t, 0, topic_info.request_id.length);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_011: [ For a twin topic whose third segment is PATCH, mqtt_topic_parse shall return MQTT_TOPIC_KIND_TWIN_PATCH; otherwise it shall return MQTT_TOPIC_KIND_TWIN_RESPONSE with the status of the fourth segment and the request id following ?$rid=, and fail when there is no fourth segment. ]
+TEST_FUNCTION(mqtt_topic_parse_truncated_twin_topic_fails)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("$iothub/twin/res", &topic_info);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_012: [ For a method topic, mqtt_topic_parse shall return MQTT_TOPIC_KIND_METHOD_REQUEST with the method name of the fourth segment and the request id of the fifth, and fail unless the fifth segment starts with ?$rid=. ]
+TEST_FUNCTION(mqtt_topic_parse_method_request_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("$iothub/methods/POST/reboot_now/?$rid=a1", &topic_info);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_KIND_METHOD_REQUEST, topic_info.kind);
+    assert_view("reboot_now", &topic_info.method_name);
+    assert_view("a1", &topic_info.request_id);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_012: [ For a method topic, mqtt_topic_parse shall return MQTT_TOPIC_KIND_METHOD_REQUEST with the method name of the fourth segment and the request id of the fifth, and fail unless the fifth segment starts with ?$rid=. ]
+TEST_FUNCTION(mqtt_topic_parse_method_request_without_request_id_fails)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("$iothub/methods/POST/reboot_now/", &topic_info);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_013: [ Any other topic shall be MQTT_TOPIC_KIND_TELEMETRY, its properties being what follows /messages/devicebound/, or the last '/' when that is missing. ]
+TEST_FUNCTION(mqtt_topic_parse_telemetry_succeeds)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+
+    // act
+    int result = mqtt_topic_parse("devices/thisIsDeviceID/messages/devicebound/iothub-ack=Full&prop/Name=Value", &topic_info);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, MQTT_TOPIC_KIND_TELEMETRY, topic_info.kind);
+    assert_view("iothub-ack=Full&prop/Name=Value", &topic_info.properties);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_014: [ If properties, name or value is NULL, mqtt_topic_get_next_property shall return false. ]
+TEST_FUNCTION(mqtt_topic_get_next_property_NULL_properties_fails)
+{
+    // arrange
+    MQTT_TOPIC_VIEW name;
+    MQTT_TOPIC_VIEW value;
+
+    // act
+    bool result = mqtt_topic_get_next_property(NULL, &name, &value);
+
+    // assert
+    ASSERT_IS_FALSE(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_015: [ mqtt_topic_get_next_property shall point name and value at the next '&' separated name=value pair, move properties past it and return true, skipping the pairs without an '='. ]
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_016: [ Once no pair is left, mqtt_topic_get_next_property shall return false. ]
+TEST_FUNCTION(mqtt_topic_get_next_property_walks_all_pairs)
+{
+    // arrange
+    MQTT_TOPIC_INFO topic_info;
+    MQTT_TOPIC_VIEW name;
+    MQTT_TOPIC_VIEW value;
+    ASSERT_ARE_EQUAL(int, 0, mqtt_topic_parse("devices/d/messages/devicebound/a=1&%24.cid&b=&c=3", &topic_info));
+
+    // act
+    // assert
+    ASSERT_IS_TRUE(mqtt_topic_get_next_property(&topic_info.properties, &name, &value));
+    assert_view("a", &name);
+    assert_view("1", &value);
+    ASSERT_IS_TRUE(mqtt_topic_get_next_property(&topic_info.properties, &name, &value));
+    assert_view("b", &name);
+    assert_view("", &value);
+    ASSERT_IS_TRUE(mqtt_topic_get_next_property(&topic_info.properties, &name, &value));
+    assert_view("c", &name);
+    assert_view("3", &value);
+    ASSERT_IS_FALSE(mqtt_topic_get_next_property(&topic_info.properties, &name, &value));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_017: [ If topic_buffer is NULL, mqtt_topic_buffer_reserve shall fail and return NULL. ]
+TEST_FUNCTION(mqtt_topic_buffer_reserve_NULL_topic_buffer_fails)
+{
+    // act
+    char* result = mqtt_topic_buffer_reserve(NULL, 10);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_018: [ mqtt_topic_buffer_reserve shall grow topic_buffer to hold at least size bytes, only when it is smaller, and return its memory, or NULL if growing fails. ]
+TEST_FUNCTION(mqtt_topic_buffer_reserve_only_grows_when_needed)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG));
+
+    // act
+    char* first = mqtt_topic_buffer_reserve(&topic_buffer, 10);
+    char* second = mqtt_topic_buffer_reserve(&topic_buffer, 20);
+
+    // assert
+    ASSERT_IS_NOT_NULL(first);
+    ASSERT_ARE_EQUAL(void_ptr, first, second);
+    ASSERT_IS_TRUE(topic_buffer.capacity >= 20);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    mqtt_topic_buffer_deinit(&topic_buffer);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_018: [ mqtt_topic_buffer_reserve shall grow topic_buffer to hold at least size bytes, only when it is smaller, and return its memory, or NULL if growing fails. ]
+TEST_FUNCTION(mqtt_topic_buffer_reserve_realloc_fails)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    char* result = mqtt_topic_buffer_reserve(&topic_buffer, 10);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 0, topic_buffer.capacity);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_MQTT_TOPIC_31_019: [ mqtt_topic_buffer_deinit shall free the memory of topic_buffer and leave it empty. ]
+TEST_FUNCTION(mqtt_topic_buffer_deinit_frees_the_buffer)
+{
+    // arrange
+    MQTT_TOPIC_BUFFER topic_buffer = { NULL, 0 };
+    ASSERT_IS_NOT_NULL(mqtt_topic_buffer_reserve(&topic_buffer, 10));
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    mqtt_topic_buffer_deinit(&topic_buffer);
+
+    // assert
+    ASSERT_IS_NULL(topic_buffer.buffer);
+    ASSERT_ARE_EQUAL(size_t, 0, topic_buffer.capacity);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothub_client_mqtt_topic_ut)
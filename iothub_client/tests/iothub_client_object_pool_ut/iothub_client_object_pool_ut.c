@@ -0,0 +1,387 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+void* real_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void real_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_object_pool.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+typedef struct TEST_OBJECT_TAG
+{
+    uint64_t id;
+    void* context;
+    unsigned char payload[20];
+} TEST_OBJECT;
+
+#define TEST_RESERVED_COUNT 4
+
+static OBJECT_POOL_HANDLE create_pool(size_t reserved_count)
+{
+    OBJECT_POOL_HANDLE pool = object_pool_create(sizeof(TEST_OBJECT), reserved_count);
+    ASSERT_IS_NOT_NULL(pool);
+    umock_c_reset_all_calls();
+    return pool;
+}
+
+BEGIN_TEST_SUITE(iothub_client_object_pool_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(malloc, real_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(free, real_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_001: [ If object_size is 0, object_pool_create shall fail and return NULL. ]
+TEST_FUNCTION(object_pool_create_object_size_0_fails)
+{
+    // act
+    OBJECT_POOL_HANDLE pool = object_pool_create(0, TEST_RESERVED_COUNT);
+
+    // assert
+    ASSERT_IS_NULL(pool);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_002: [ object_pool_create shall allocate the pool and, if reserved_count is not 0, one slab of reserved_count objects. ]
+TEST_FUNCTION(object_pool_create_succeed)
+{
+    // arrange
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    OBJECT_POOL_HANDLE pool = object_pool_create(sizeof(TEST_OBJECT), TEST_RESERVED_COUNT);
+
+    // assert
+    ASSERT_IS_NOT_NULL(pool);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_002: [ object_pool_create shall allocate the pool and, if reserved_count is not 0, one slab of reserved_count objects. ]
+TEST_FUNCTION(object_pool_create_no_reservation_allocates_no_slab)
+{
+    // arrange
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    OBJECT_POOL_HANDLE pool = object_pool_create(sizeof(TEST_OBJECT), 0);
+
+    // assert
+    ASSERT_IS_NOT_NULL(pool);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_003: [ If any allocation fails, object_pool_create shall fail and return NULL. ]
+TEST_FUNCTION(object_pool_create_negative_tests)
+{
+    // arrange
+    size_t index;
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    umock_c_negative_tests_snapshot();
+
+    for (index = 0; index < umock_c_negative_tests_call_count(); index++)
+    {
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        // act
+        OBJECT_POOL_HANDLE pool = object_pool_create(sizeof(TEST_OBJECT), TEST_RESERVED_COUNT);
+
+        // assert
+        ASSERT_IS_NULL_WITH_MSG(pool, "object_pool_create unexpectedly succeeded");
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_004: [ If pool is NULL, object_pool_acquire shall return NULL. ]
+TEST_FUNCTION(object_pool_acquire_NULL_pool_fails)
+{
+    // act
+    void* object = object_pool_acquire(NULL);
+
+    // assert
+    ASSERT_IS_NULL(object);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_006: [ object_pool_acquire shall take an object off the free list and return it. ]
+TEST_FUNCTION(object_pool_acquire_reserved_objects_makes_no_heap_call)
+{
+    // arrange
+    TEST_OBJECT* objects[TEST_RESERVED_COUNT];
+    size_t index;
+    OBJECT_POOL_HANDLE pool = create_pool(TEST_RESERVED_COUNT);
+
+    // act
+    for (index = 0; index < TEST_RESERVED_COUNT; index++)
+    {
+        objects[index] = (TEST_OBJECT*)object_pool_acquire(pool);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    for (index = 0; index < TEST_RESERVED_COUNT; index++)
+    {
+        size_t other;
+        ASSERT_IS_NOT_NULL(objects[index]);
+        ASSERT_ARE_EQUAL(int, 0, (int)(((uintptr_t)objects[index]) % sizeof(uint64_t)));
+        for (other = 0; other < index; other++)
+        {
+            ASSERT_ARE_NOT_EQUAL(void_ptr, objects[other], objects[index]);
+        }
+        objects[index]->id = index;
+    }
+    for (index = 0; index < TEST_RESERVED_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(uint64_t, (uint64_t)index, objects[index]->id);
+    }
+
+    // cleanup
+    for (index = 0; index < TEST_RESERVED_COUNT; index++)
+    {
+        object_pool_release(pool, objects[index]);
+    }
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_005: [ If no object is free, object_pool_acquire shall allocate a new slab holding as many objects as the pool already owns (8 for the first slab), and return NULL if that fails. ]
+TEST_FUNCTION(object_pool_acquire_grows_when_empty)
+{
+    // arrange
+    TEST_OBJECT* objects[(2 * TEST_RESERVED_COUNT) + 1];
+    size_t index;
+    OBJECT_POOL_HANDLE pool = create_pool(TEST_RESERVED_COUNT);
+    for (index = 0; index < TEST_RESERVED_COUNT; index++)
+    {
+        objects[index] = (TEST_OBJECT*)object_pool_acquire(pool);
+    }
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    for (index = TEST_RESERVED_COUNT; index < (2 * TEST_RESERVED_COUNT); index++)
+    {
+        objects[index] = (TEST_OBJECT*)object_pool_acquire(pool);
+        ASSERT_IS_NOT_NULL(objects[index]);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    umock_c_reset_all_calls();
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    objects[2 * TEST_RESERVED_COUNT] = (TEST_OBJECT*)object_pool_acquire(pool);
+    ASSERT_IS_NOT_NULL(objects[2 * TEST_RESERVED_COUNT]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    for (index = 0; index <= (2 * TEST_RESERVED_COUNT); index++)
+    {
+        object_pool_release(pool, objects[index]);
+    }
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_005: [ If no object is free, object_pool_acquire shall allocate a new slab holding as many objects as the pool already owns (8 for the first slab), and return NULL if that fails. ]
+TEST_FUNCTION(object_pool_acquire_grow_fails)
+{
+    // arrange
+    OBJECT_POOL_HANDLE pool = create_pool(0);
+
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    void* object = object_pool_acquire(pool);
+
+    // assert
+    ASSERT_IS_NULL(object);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_007: [ If pool or object is NULL, object_pool_release shall do nothing. ]
+TEST_FUNCTION(object_pool_release_NULL_object_does_nothing)
+{
+    // arrange
+    OBJECT_POOL_HANDLE pool = create_pool(TEST_RESERVED_COUNT);
+
+    // act
+    object_pool_release(pool, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_008: [ object_pool_release shall put object back on the free list, without giving it back to the heap. ]
+TEST_FUNCTION(object_pool_release_reuses_the_object)
+{
+    // arrange
+    OBJECT_POOL_HANDLE pool = create_pool(1);
+    void* object = object_pool_acquire(pool);
+    void* reacquired;
+    umock_c_reset_all_calls();
+
+    // act
+    object_pool_release(pool, object);
+    reacquired = object_pool_acquire(pool);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, object, reacquired);
+
+    // cleanup
+    object_pool_release(pool, reacquired);
+    object_pool_destroy(pool);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_009: [ If pool is NULL, object_pool_destroy shall return. ]
+TEST_FUNCTION(object_pool_destroy_NULL_pool_does_nothing)
+{
+    // act
+    object_pool_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_011: [ object_pool_destroy shall free all the slabs and the pool. ]
+TEST_FUNCTION(object_pool_destroy_frees_all_slabs)
+{
+    // arrange
+    OBJECT_POOL_HANDLE pool = create_pool(1);
+    void* first = object_pool_acquire(pool);
+    void* second = object_pool_acquire(pool);
+    object_pool_release(pool, first);
+    object_pool_release(pool, second);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    object_pool_destroy(pool);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_OBJECT_POOL_31_010: [ If objects are still acquired, object_pool_destroy shall only free the pool once the last of them is released. ]
+TEST_FUNCTION(object_pool_destroy_deferred_until_last_release)
+{
+    // arrange
+    OBJECT_POOL_HANDLE pool = create_pool(TEST_RESERVED_COUNT);
+    void* first = object_pool_acquire(pool);
+    void* second = object_pool_acquire(pool);
+    umock_c_reset_all_calls();
+
+    // act
+    object_pool_destroy(pool);
+    object_pool_release(pool, first);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    object_pool_release(pool, second);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothub_client_object_pool_ut)
@@ -0,0 +1,350 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+void* real_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void real_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_packet_id_table.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+#define TEST_ITEM_COUNT 13
+
+static int g_items[TEST_ITEM_COUNT];
+
+static PACKET_ID_TABLE_HANDLE create_table(void)
+{
+    PACKET_ID_TABLE_HANDLE packet_id_table = packet_id_table_create();
+    ASSERT_IS_NOT_NULL(packet_id_table);
+    umock_c_reset_all_calls();
+    return packet_id_table;
+}
+
+BEGIN_TEST_SUITE(iothub_client_packet_id_table_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(malloc, real_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(free, real_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_001: [ packet_id_table_create shall allocate an empty packet id table, without any slot. ]
+TEST_FUNCTION(packet_id_table_create_succeed)
+{
+    // arrange
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    PACKET_ID_TABLE_HANDLE packet_id_table = packet_id_table_create();
+
+    // assert
+    ASSERT_IS_NOT_NULL(packet_id_table);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(packet_id_table_remove(packet_id_table, 1));
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_002: [ If the allocation fails, packet_id_table_create shall fail and return NULL. ]
+TEST_FUNCTION(packet_id_table_create_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    PACKET_ID_TABLE_HANDLE packet_id_table = packet_id_table_create();
+
+    // assert
+    ASSERT_IS_NULL(packet_id_table);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_003: [ If packet_id_table or item is NULL, packet_id_table_add shall fail and return a non-zero value. ]
+TEST_FUNCTION(packet_id_table_add_NULL_packet_id_table_fails)
+{
+    // act
+    int result = packet_id_table_add(NULL, 1, &g_items[0]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_003: [ If packet_id_table or item is NULL, packet_id_table_add shall fail and return a non-zero value. ]
+TEST_FUNCTION(packet_id_table_add_NULL_item_fails)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+
+    // act
+    int result = packet_id_table_add(packet_id_table, 1, NULL);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_005: [ When adding an item would fill more than 3/4 of the slots, packet_id_table_add shall double the number of slots, starting at 16. ]
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_007: [ packet_id_table_add shall store item under packet_id and return 0. ]
+TEST_FUNCTION(packet_id_table_add_grows_the_table_only_when_three_quarters_full)
+{
+    // arrange
+    size_t index;
+    int result = 0;
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    for (index = 0; index < TEST_ITEM_COUNT; index++)
+    {
+        result |= packet_id_table_add(packet_id_table, (uint16_t)(index + 1), &g_items[index]);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    for (index = 0; index < TEST_ITEM_COUNT; index++)
+    {
+        ASSERT_ARE_EQUAL(void_ptr, &g_items[index], packet_id_table_remove(packet_id_table, (uint16_t)(index + 1)));
+    }
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_006: [ If growing the table fails, packet_id_table_add shall fail and return a non-zero value, leaving the table unchanged. ]
+TEST_FUNCTION(packet_id_table_add_malloc_fails)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = packet_id_table_add(packet_id_table, 1, &g_items[0]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(packet_id_table_remove(packet_id_table, 1));
+    ASSERT_ARE_EQUAL(int, 0, packet_id_table_add(packet_id_table, 1, &g_items[0]));
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_004: [ If an item is already stored under packet_id, packet_id_table_add shall fail and return a non-zero value, leaving the table unchanged. ]
+TEST_FUNCTION(packet_id_table_add_packet_id_already_in_flight_fails)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+    (void)packet_id_table_add(packet_id_table, 7, &g_items[0]);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = packet_id_table_add(packet_id_table, 7, &g_items[1]);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[0], packet_id_table_remove(packet_id_table, 7));
+    ASSERT_IS_NULL(packet_id_table_remove(packet_id_table, 7));
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_008: [ If no item is stored under packet_id, packet_id_table_remove shall return NULL. ]
+TEST_FUNCTION(packet_id_table_remove_unknown_packet_id_returns_NULL)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+    (void)packet_id_table_add(packet_id_table, 1, &g_items[0]);
+    (void)packet_id_table_add(packet_id_table, 17, &g_items[1]);
+    umock_c_reset_all_calls();
+
+    // act
+    void* result = packet_id_table_remove(packet_id_table, 33);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+TEST_FUNCTION(packet_id_table_remove_NULL_packet_id_table_returns_NULL)
+{
+    // act
+    void* result = packet_id_table_remove(NULL, 1);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_009: [ Otherwise packet_id_table_remove shall remove the item stored under packet_id and return it, without leaving a deleted slot behind. ]
+TEST_FUNCTION(packet_id_table_remove_keeps_the_colliding_items_reachable)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+    (void)packet_id_table_add(packet_id_table, 1, &g_items[0]);
+    (void)packet_id_table_add(packet_id_table, 17, &g_items[1]);
+    (void)packet_id_table_add(packet_id_table, 2, &g_items[2]);
+    (void)packet_id_table_add(packet_id_table, 33, &g_items[3]);
+    umock_c_reset_all_calls();
+
+    // act
+    void* result = packet_id_table_remove(packet_id_table, 1);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[0], result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(packet_id_table_remove(packet_id_table, 1));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[3], packet_id_table_remove(packet_id_table, 33));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[2], packet_id_table_remove(packet_id_table, 2));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[1], packet_id_table_remove(packet_id_table, 17));
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_009: [ Otherwise packet_id_table_remove shall remove the item stored under packet_id and return it, without leaving a deleted slot behind. ]
+TEST_FUNCTION(packet_id_table_remove_keeps_the_items_wrapping_around_reachable)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+    (void)packet_id_table_add(packet_id_table, 15, &g_items[0]);
+    (void)packet_id_table_add(packet_id_table, 31, &g_items[1]);
+    (void)packet_id_table_add(packet_id_table, 16, &g_items[2]);
+    (void)packet_id_table_add(packet_id_table, 47, &g_items[3]);
+    umock_c_reset_all_calls();
+
+    // act
+    void* result = packet_id_table_remove(packet_id_table, 15);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[0], result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[2], packet_id_table_remove(packet_id_table, 16));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[3], packet_id_table_remove(packet_id_table, 47));
+    ASSERT_ARE_EQUAL(void_ptr, &g_items[1], packet_id_table_remove(packet_id_table, 31));
+
+    // cleanup
+    packet_id_table_destroy(packet_id_table);
+}
+
+TEST_FUNCTION(packet_id_table_destroy_NULL_packet_id_table)
+{
+    // act
+    packet_id_table_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_PACKET_ID_TABLE_31_010: [ packet_id_table_destroy shall free the slots and the table, the items themselves belong to their owners. ]
+TEST_FUNCTION(packet_id_table_destroy_succeed)
+{
+    // arrange
+    PACKET_ID_TABLE_HANDLE packet_id_table = create_table();
+    (void)packet_id_table_add(packet_id_table, 1, &g_items[0]);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    packet_id_table_destroy(packet_id_table);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+END_TEST_SUITE(iothub_client_packet_id_table_ut)
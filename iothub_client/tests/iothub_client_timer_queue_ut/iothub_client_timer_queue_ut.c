@@ -0,0 +1,446 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+void* real_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void* real_realloc(void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+void real_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umock_c_negative_tests.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "internal/iothub_client_timer_queue.h"
+
+static TEST_MUTEX_HANDLE g_testByTest;
+static TEST_MUTEX_HANDLE g_dllByDll;
+
+DEFINE_ENUM_STRINGS(UMOCK_C_ERROR_CODE, UMOCK_C_ERROR_CODE_VALUES)
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    char temp_str[256];
+    (void)snprintf(temp_str, sizeof(temp_str), "umock_c reported error :%s", ENUM_TO_STRING(UMOCK_C_ERROR_CODE, error_code));
+    ASSERT_FAIL(temp_str);
+}
+
+#define TEST_ENTRY_COUNT 17
+
+static TIMER_QUEUE_ENTRY g_entries[TEST_ENTRY_COUNT];
+
+static TIMER_QUEUE_HANDLE create_queue(void)
+{
+    size_t index;
+    TIMER_QUEUE_HANDLE timer_queue = timer_queue_create();
+    ASSERT_IS_NOT_NULL(timer_queue);
+    for (index = 0; index < TEST_ENTRY_COUNT; index++)
+    {
+        timer_queue_entry_init(&g_entries[index]);
+    }
+    umock_c_reset_all_calls();
+    return timer_queue;
+}
+
+BEGIN_TEST_SUITE(iothub_client_timer_queue_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+
+    int result = umocktypes_charptr_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+    result = umocktypes_stdint_register_types();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    REGISTER_GLOBAL_MOCK_HOOK(malloc, real_malloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(malloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(realloc, real_realloc);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(realloc, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(free, real_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest))
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_001: [ timer_queue_create shall allocate an empty timer queue. ]
+TEST_FUNCTION(timer_queue_create_succeed)
+{
+    // arrange
+    tickcounter_ms_t deadline;
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+
+    // act
+    TIMER_QUEUE_HANDLE timer_queue = timer_queue_create();
+
+    // assert
+    ASSERT_IS_NOT_NULL(timer_queue);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, timer_queue_get_next_deadline(timer_queue, &deadline));
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_002: [ If the allocation fails, timer_queue_create shall fail and return NULL. ]
+TEST_FUNCTION(timer_queue_create_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    TIMER_QUEUE_HANDLE timer_queue = timer_queue_create();
+
+    // assert
+    ASSERT_IS_NULL(timer_queue);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_003: [ timer_queue_entry_init shall mark entry as not queued. ]
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_008: [ If entry is not queued, timer_queue_remove shall do nothing. ]
+TEST_FUNCTION(timer_queue_remove_entry_not_queued_does_nothing)
+{
+    // arrange
+    tickcounter_ms_t deadline;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    (void)timer_queue_add(timer_queue, &g_entries[0], 10);
+    umock_c_reset_all_calls();
+
+    // act
+    timer_queue_remove(timer_queue, &g_entries[1]);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, timer_queue_get_next_deadline(timer_queue, &deadline));
+    ASSERT_ARE_EQUAL(uint64_t, 10, (uint64_t)deadline);
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_004: [ If timer_queue or entry is NULL, or if entry is already queued, timer_queue_add shall fail and return a non-zero value. ]
+TEST_FUNCTION(timer_queue_add_NULL_timer_queue_fails)
+{
+    // arrange
+    TIMER_QUEUE_ENTRY entry;
+    timer_queue_entry_init(&entry);
+
+    // act
+    int result = timer_queue_add(NULL, &entry, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_004: [ If timer_queue or entry is NULL, or if entry is already queued, timer_queue_add shall fail and return a non-zero value. ]
+TEST_FUNCTION(timer_queue_add_NULL_entry_fails)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+
+    // act
+    int result = timer_queue_add(timer_queue, NULL, 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_004: [ If timer_queue or entry is NULL, or if entry is already queued, timer_queue_add shall fail and return a non-zero value. ]
+TEST_FUNCTION(timer_queue_add_entry_already_queued_fails)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    (void)timer_queue_add(timer_queue, &g_entries[0], 10);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = timer_queue_add(timer_queue, &g_entries[0], 20);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(uint64_t, 10, (uint64_t)g_entries[0].deadline);
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_005: [ When the heap is full, timer_queue_add shall double its capacity, starting at 16 entries. ]
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_007: [ timer_queue_add shall store deadline in entry and insert entry in the heap in O(log n). ]
+TEST_FUNCTION(timer_queue_add_grows_the_heap_only_when_full)
+{
+    // arrange
+    size_t index;
+    int result = 0;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+
+    STRICT_EXPECTED_CALL(realloc(NULL, 16 * sizeof(TIMER_QUEUE_ENTRY*)));
+    STRICT_EXPECTED_CALL(realloc(IGNORED_PTR_ARG, 32 * sizeof(TIMER_QUEUE_ENTRY*)));
+
+    // act
+    for (index = 0; index < TEST_ENTRY_COUNT; index++)
+    {
+        result |= timer_queue_add(timer_queue, &g_entries[index], 100 - index);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(uint64_t, 100, (uint64_t)g_entries[0].deadline);
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_006: [ If growing the heap fails, timer_queue_add shall fail and return a non-zero value, leaving the queue unchanged. ]
+TEST_FUNCTION(timer_queue_add_realloc_fails)
+{
+    // arrange
+    tickcounter_ms_t deadline;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+
+    STRICT_EXPECTED_CALL(realloc(NULL, IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    // act
+    int result = timer_queue_add(timer_queue, &g_entries[0], 10);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, timer_queue_get_next_deadline(timer_queue, &deadline));
+    ASSERT_ARE_EQUAL(int, 0, timer_queue_add(timer_queue, &g_entries[0], 10));
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_010: [ If the earliest deadline is greater than now, or if the queue is empty, timer_queue_pop_expired shall return NULL without looking at any other entry. ]
+TEST_FUNCTION(timer_queue_pop_expired_empty_returns_NULL)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+
+    // act
+    TIMER_QUEUE_ENTRY* result = timer_queue_pop_expired(timer_queue, 1000);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_010: [ If the earliest deadline is greater than now, or if the queue is empty, timer_queue_pop_expired shall return NULL without looking at any other entry. ]
+TEST_FUNCTION(timer_queue_pop_expired_nothing_due_returns_NULL)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    (void)timer_queue_add(timer_queue, &g_entries[0], 20);
+    (void)timer_queue_add(timer_queue, &g_entries[1], 30);
+    umock_c_reset_all_calls();
+
+    // act
+    TIMER_QUEUE_ENTRY* result = timer_queue_pop_expired(timer_queue, 19);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_011: [ Otherwise timer_queue_pop_expired shall remove the entry with the earliest deadline, mark it as not queued and return it. ]
+TEST_FUNCTION(timer_queue_pop_expired_returns_entries_in_deadline_order)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    (void)timer_queue_add(timer_queue, &g_entries[0], 40);
+    (void)timer_queue_add(timer_queue, &g_entries[1], 10);
+    (void)timer_queue_add(timer_queue, &g_entries[2], 30);
+    (void)timer_queue_add(timer_queue, &g_entries[3], 20);
+    umock_c_reset_all_calls();
+
+    // act
+    TIMER_QUEUE_ENTRY* first = timer_queue_pop_expired(timer_queue, 30);
+    TIMER_QUEUE_ENTRY* second = timer_queue_pop_expired(timer_queue, 30);
+    TIMER_QUEUE_ENTRY* third = timer_queue_pop_expired(timer_queue, 30);
+    TIMER_QUEUE_ENTRY* fourth = timer_queue_pop_expired(timer_queue, 30);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[1], first);
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[3], second);
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[2], third);
+    ASSERT_IS_NULL(fourth);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, timer_queue_add(timer_queue, &g_entries[1], 50));
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_009: [ timer_queue_remove shall remove entry from the heap in O(log n) and mark it as not queued. ]
+TEST_FUNCTION(timer_queue_remove_keeps_the_other_entries_ordered)
+{
+    // arrange
+    size_t index;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    for (index = 0; index < 8; index++)
+    {
+        (void)timer_queue_add(timer_queue, &g_entries[index], (index * 7) % 8);
+    }
+    umock_c_reset_all_calls();
+
+    // act
+    timer_queue_remove(timer_queue, &g_entries[0]);
+    timer_queue_remove(timer_queue, &g_entries[3]);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[7], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[6], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[5], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[4], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[2], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(void_ptr, &g_entries[1], timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_IS_NULL(timer_queue_pop_expired(timer_queue, 100));
+    ASSERT_ARE_EQUAL(int, 0, timer_queue_add(timer_queue, &g_entries[0], 1));
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_012: [ If the queue is empty, timer_queue_get_next_deadline shall return a non-zero value. ]
+TEST_FUNCTION(timer_queue_get_next_deadline_empty_fails)
+{
+    // arrange
+    tickcounter_ms_t deadline;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+
+    // act
+    int result = timer_queue_get_next_deadline(timer_queue, &deadline);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_013: [ Otherwise timer_queue_get_next_deadline shall set deadline to the earliest deadline and return 0. ]
+TEST_FUNCTION(timer_queue_get_next_deadline_returns_the_earliest_deadline)
+{
+    // arrange
+    tickcounter_ms_t deadline;
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    (void)timer_queue_add(timer_queue, &g_entries[0], 30);
+    (void)timer_queue_add(timer_queue, &g_entries[1], 20);
+    (void)timer_queue_add(timer_queue, &g_entries[2], 25);
+    umock_c_reset_all_calls();
+
+    // act
+    int result = timer_queue_get_next_deadline(timer_queue, &deadline);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(uint64_t, 20, (uint64_t)deadline);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    timer_queue_destroy(timer_queue);
+}
+
+TEST_FUNCTION(timer_queue_destroy_NULL_timer_queue)
+{
+    // act
+    timer_queue_destroy(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+// Tests_SRS_IOTHUB_CLIENT_TIMER_QUEUE_31_014: [ timer_queue_destroy shall mark the entries still queued as not queued and free the queue, the entries themselves belong to their owners. ]
+TEST_FUNCTION(timer_queue_destroy_succeed)
+{
+    // arrange
+    TIMER_QUEUE_HANDLE timer_queue = create_queue();
+    TIMER_QUEUE_HANDLE other_timer_queue;
+    (void)timer_queue_add(timer_queue, &g_entries[0], 10);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
+
+    // act
+    timer_queue_destroy(timer_queue);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    other_timer_queue = timer_queue_create();
+    ASSERT_ARE_EQUAL(int, 0, timer_queue_add(other_timer_queue, &g_entries[0], 10));
+
+    // cleanup
+    timer_queue_destroy(other_timer_queue);
+}
+
+END_TEST_SUITE(iothub_client_timer_queue_ut)
@@ -4013,6 +4013,365 @@ TEST_FUNCTION(IoTHubClient_LL_UploadMultipleBlocksToBlob_deviceKey_with_timeout_
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/*Tests_SRS_IOTHUBCLIENT_LL_31_021: [ If blob_upload_concurrency is more than 1 or blob_upload_block_size is not 0, IoTHubClient_LL_UploadMultipleBlocksToBlob(Ex) shall call Blob_UploadMultipleBlocksInParallelFromSasUri with both values instead of Blob_UploadMultipleBlocksFromSasUri. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadMultipleBlocksToBlob_deviceKey_with_blob_upload_concurrency_happypath)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    unsigned char c = '3';
+    context.source = &c;
+    context.size = 1;
+    context.toUpload = 1;
+    size_t concurrency = 4;
+    size_t blockSize = 1024 * 1024;
+    (void)IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_CONCURRENCY, &concurrency);
+    (void)IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_BLOCK_SIZE, &blockSize);
+    umock_c_reset_all_calls();
+    
+    HTTPAPIEX_HANDLE iotHubHttpApiExHandle;
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
+    .CaptureReturn(&iotHubHttpApiExHandle)
+    .IgnoreArgument(1);
+    
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(IGNORED_PTR_ARG, OPTION_CURL_VERBOSE, IGNORED_PTR_ARG))
+    .ValidateArgumentValue_handle(&iotHubHttpApiExHandle)
+    .SetReturn(HTTPAPIEX_OK);
+    
+    STRING_HANDLE correlationId;
+    STRICT_EXPECTED_CALL(STRING_new())
+    .CaptureReturn(&correlationId);
+    
+    STRING_HANDLE sasUri;
+    STRICT_EXPECTED_CALL(STRING_new())
+    .CaptureReturn(&sasUri);
+    
+    HTTP_HEADERS_HANDLE iotHubHttpRequestHeaders1;
+    STRICT_EXPECTED_CALL(HTTPHeaders_Alloc())
+    .CaptureReturn(&iotHubHttpRequestHeaders1);
+    
+    {
+        STRING_HANDLE iotHubHttpRelativePath1;
+        STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
+        .CaptureReturn(&iotHubHttpRelativePath1);
+        
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*IGNORED_PTR_ARG is the deviceId, which stays nicely tucked in h (handle)*/
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        
+        STRICT_EXPECTED_CALL(STRING_concat(iotHubHttpRelativePath1, "/files"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(iotHubHttpRelativePath1, TEST_API_VERSION)) /*10*/
+        .IgnoreArgument(1);
+        
+        STRING_HANDLE blobJson;
+        STRICT_EXPECTED_CALL(STRING_construct("{ \"blobName\": \""))
+        .CaptureReturn(&blobJson);
+        STRICT_EXPECTED_CALL(STRING_concat(blobJson, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(blobJson, "\" }"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_length(blobJson))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_c_str(blobJson))
+        .IgnoreArgument(1);
+        
+        BUFFER_HANDLE jsonBuffer;
+        STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size()
+        .CaptureReturn(&jsonBuffer);
+        
+        BUFFER_HANDLE iotHubHttpMessageBodyResponse1;
+        STRICT_EXPECTED_CALL(BUFFER_new())
+        .CaptureReturn(&iotHubHttpMessageBodyResponse1);
+        
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Content-Type", "application/json")) /*10*/
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Accept", "application/json"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "User-Agent", "iothubclient/" TEST_IOTHUB_SDK_VERSION))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(iotHubHttpRequestHeaders1, "Authorization", "")) /*14*/
+        .IgnoreArgument(1);
+        
+        
+        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX)); /*this is starting to build the path that the SAS token authenticates*/
+        STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, "/devices/")) /*this is building the path that the SAS token authenticates*/
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(IGNORED_PTR_ARG, IGNORED_PTR_ARG)) /*this is building the path that the SAS token authenticates*/
+        .IgnoreArgument_s1()
+        .IgnoreArgument_s2();
+        STRICT_EXPECTED_CALL(STRING_new());/*this is needed for HTTPAPIEX_SAS_Create -it needs an empty STRING_HANDLE*/
+        
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest( /*20*/
+                                                          IGNORED_PTR_ARG,
+                                                          IGNORED_PTR_ARG,
+                                                          HTTPAPI_REQUEST_POST,
+                                                          IGNORED_PTR_ARG,
+                                                          IGNORED_PTR_ARG,
+                                                          jsonBuffer,
+                                                          IGNORED_PTR_ARG,
+                                                          NULL,
+                                                          IGNORED_PTR_ARG
+                                                          ))
+        .IgnoreArgument_sasHandle()
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestHttpHeadersHandle()
+        .IgnoreArgument_requestContent()
+        .IgnoreArgument_statusCode()
+        .IgnoreArgument_responseHeadersHandle()
+        .IgnoreArgument_responseContent()
+        .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
+        .IgnoreArgument(6)
+        ;
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the empty STRING_new*/
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)) /*the build the path that the SAS token authenticates*/
+        .IgnoreArgument_handle();
+        
+        unsigned char* iotHubHttpMessageBodyResponse1_unsigned_char = (unsigned char*)TEST_DEFAULT_STRING_VALUE;
+        size_t iotHubHttpMessageBodyResponse1_size;
+        STRICT_EXPECTED_CALL(BUFFER_u_char(iotHubHttpMessageBodyResponse1))
+        .CaptureReturn(&iotHubHttpMessageBodyResponse1_unsigned_char)
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(BUFFER_length(iotHubHttpMessageBodyResponse1))
+        .CaptureReturn(&iotHubHttpMessageBodyResponse1_size)
+        .IgnoreArgument(1);
+        
+        STRING_HANDLE iotHubHttpMessageBodyResponse1_as_STRING_HANDLE;
+        STRICT_EXPECTED_CALL(STRING_from_byte_array(iotHubHttpMessageBodyResponse1_unsigned_char, iotHubHttpMessageBodyResponse1_size))
+        .CaptureReturn(&iotHubHttpMessageBodyResponse1_as_STRING_HANDLE)
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        
+        const char* iotHubHttpMessageBodyResponse1_as_const_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(iotHubHttpMessageBodyResponse1_as_STRING_HANDLE))
+        .CaptureReturn(&iotHubHttpMessageBodyResponse1_as_const_char)
+        .IgnoreArgument(1);
+        
+        JSON_Value* allJson;
+        STRICT_EXPECTED_CALL(json_parse_string(iotHubHttpMessageBodyResponse1_as_const_char))
+        .CaptureReturn(&allJson)
+        .IgnoreArgument(1);
+        
+        JSON_Object* jsonObject;
+        STRICT_EXPECTED_CALL(json_value_get_object(allJson))
+        .CaptureReturn(&jsonObject)
+        .IgnoreArgument(1);
+        
+        const char* json_correlationId = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "correlationId")) /*30*/
+        .CaptureReturn(&json_correlationId)
+        .IgnoreArgument(1);
+        
+        STRICT_EXPECTED_CALL(STRING_copy(correlationId, json_correlationId))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        
+        const char* json_hostName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "hostName"))
+        .CaptureReturn(&json_hostName)
+        .IgnoreArgument(1);
+        
+        const char* json_containerName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "containerName"))
+        .CaptureReturn(&json_containerName)
+        .IgnoreArgument(1);
+        
+        const char* json_blobName = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "blobName"))
+        .CaptureReturn(&json_blobName)
+        .IgnoreArgument(1);
+        
+        const char* json_sasToken = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(json_object_get_string(jsonObject, "sasToken"))
+        .CaptureReturn(&json_sasToken)
+        .IgnoreArgument(1);
+        
+        STRICT_EXPECTED_CALL(STRING_copy(sasUri, "https://"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(URL_EncodeString(json_blobName))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_hostName))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, "/"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_containerName))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, "/")) /*40*/
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(sasUri, json_sasToken))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(json_value_free(allJson))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(iotHubHttpMessageBodyResponse1_as_STRING_HANDLE))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(BUFFER_delete(iotHubHttpMessageBodyResponse1))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(BUFFER_delete(jsonBuffer))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(blobJson))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(iotHubHttpRelativePath1))
+        .IgnoreArgument(1);
+    }
+    
+    {/*step2*/
+        STRICT_EXPECTED_CALL(BUFFER_new()); /*this is building the buffer that will contain the response from Blob_UploadMultipleBlocksInParallelFromSasUri*/
+        
+        const char* sasUri_as_const_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(sasUri))
+        .CaptureReturn(&sasUri_as_const_char)
+        .IgnoreArgument(1);
+        
+        STRICT_EXPECTED_CALL(Blob_UploadMultipleBlocksInParallelFromSasUri(sasUri_as_const_char, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL, IGNORED_PTR_ARG, 4, 1024 * 1024))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4)
+        .IgnoreArgument(5)
+        .CopyOutArgumentBuffer_httpStatus(&TwoHundred, sizeof(TwoHundred))
+        ;
+        /*some snprintfs happen here... */
+        STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG)) /*50*/
+        .IgnoreArgument_handle();
+        
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+        
+        STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        
+        STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument_source()
+        .IgnoreArgument_size()
+        ;
+    }
+    
+    {/*step3*/
+        
+        STRING_HANDLE uriResource;
+        STRICT_EXPECTED_CALL(STRING_construct(TEST_IOTHUBNAME "." TEST_IOTHUBSUFFIX))
+        .CaptureReturn(&uriResource);
+        
+        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/devices/"))
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(uriResource, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(uriResource, "/files/notifications"))
+        .IgnoreArgument(1);
+        
+        STRING_HANDLE relativePathNotification;
+        STRICT_EXPECTED_CALL(STRING_construct("/devices/"))
+        .CaptureReturn(&relativePathNotification);
+        
+        STRICT_EXPECTED_CALL(STRING_concat_with_STRING(relativePathNotification, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, "/files/notifications/")) /*60*/
+        .IgnoreArgument(1);
+        
+        const char* correlationId_as_char = TEST_DEFAULT_STRING_VALUE;
+        STRICT_EXPECTED_CALL(STRING_c_str(correlationId))
+        .CaptureReturn(&correlationId_as_char)
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, correlationId_as_char))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(STRING_concat(relativePathNotification, TEST_API_VERSION))
+        .IgnoreArgument(1);
+        
+        STRICT_EXPECTED_CALL(STRING_new());
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
+                                                          IGNORED_PTR_ARG,
+                                                          IGNORED_PTR_ARG,
+                                                          HTTPAPI_REQUEST_POST,
+                                                          IGNORED_PTR_ARG,
+                                                          IGNORED_PTR_ARG,
+                                                          NULL,
+                                                          IGNORED_PTR_ARG,
+                                                          NULL,
+                                                          IGNORED_PTR_ARG
+                                                          ))
+        .IgnoreArgument_sasHandle()
+        .IgnoreArgument_handle()
+        .IgnoreArgument_relativePath()
+        .IgnoreArgument_requestHttpHeadersHandle()
+        .IgnoreArgument_requestContent()
+        .IgnoreArgument_statusCode()
+        .IgnoreArgument_responseHeadersHandle()
+        .IgnoreArgument_responseContent()
+        .CopyOutArgumentBuffer_statusCode(&TwoHundred, sizeof(TwoHundred))
+        ;
+        STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+        
+        STRICT_EXPECTED_CALL(STRING_delete(relativePathNotification)) /*70*/
+        .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(STRING_delete(uriResource))
+        .IgnoreArgument(1);
+    }
+    
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+    .IgnoreArgument_handle();
+    
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+    .IgnoreArgument_ptr();
+    
+    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG))
+    .IgnoreArgument_handle();
+    
+    STRICT_EXPECTED_CALL(HTTPHeaders_Free(iotHubHttpRequestHeaders1))
+    .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(STRING_delete(sasUri))
+    .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(STRING_delete(correlationId))
+    .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(iotHubHttpApiExHandle))
+    .IgnoreArgument(1);
+    
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadMultipleBlocksToBlob_Impl(h, "text.txt", FileUpload_GetData_Callback, &context);
+    
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    
+    // Check parameters of the last call to getDataCallback
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_FILE_UPLOAD_RESULT, FILE_UPLOAD_OK, context.lastResult);
+    ASSERT_IS_NULL(context.lastData);
+    ASSERT_IS_NULL(context.lastSize);
+    
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
 TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_deviceKey_when_step1_httpStatusCode_is_400_fails)
 {
     ///arrange
@@ -5782,5 +6141,102 @@ TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_x509privatekey_fails_when_s
     IoTHubClient_LL_UploadToBlob_Destroy(h);
 }
 
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+/*Tests_SRS_IOTHUBCLIENT_LL_31_019: [ blob_upload_concurrency - value is a pointer to a size_t, the number of blocks uploaded at the same time. If it is 0 then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blob_upload_concurrency_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    size_t concurrency = 8;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_CONCURRENCY, &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+#else
+/*Tests_SRS_IOTHUBCLIENT_LL_31_031: [ If the SDK was built with DONT_USE_HTTP_WORKER_THREADS, a blob_upload_concurrency above 1 shall make IoTHubClient_LL_UploadToBlob_SetOption return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blob_upload_concurrency_over_1_fails_without_worker_threads)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    size_t concurrency = 8;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_CONCURRENCY, &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_019: [ blob_upload_concurrency - value is a pointer to a size_t, the number of blocks uploaded at the same time. If it is 0 then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blob_upload_concurrency_0_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    size_t concurrency = 0;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_CONCURRENCY, &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_020: [ blob_upload_block_size - value is a pointer to a size_t, the size of the blocks. If it is bigger than 4MB then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blob_upload_block_size_4MB_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    size_t blockSize = BLOCK_SIZE;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_BLOCK_SIZE, &blockSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_020: [ blob_upload_block_size - value is a pointer to a size_t, the size of the blocks. If it is bigger than 4MB then IoTHubClient_LL_UploadToBlob_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]*/
+TEST_FUNCTION(IoTHubClient_LL_UploadToBlob_SetOption_blob_upload_block_size_over_4MB_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_LL_UPLOADTOBLOB_HANDLE h = IoTHubClient_LL_UploadToBlob_Create(&TEST_CONFIG_DEVICE_KEY);
+    size_t blockSize = BLOCK_SIZE + 1;
+    umock_c_reset_all_calls();
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_LL_UploadToBlob_SetOption(h, OPTION_BLOB_UPLOAD_BLOCK_SIZE, &blockSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClient_LL_UploadToBlob_Destroy(h);
+}
+
 END_TEST_SUITE(iothubclient_ll_uploadtoblob_ut)
 #endif /*DONT_USE_UPLOADTOBLOB*/
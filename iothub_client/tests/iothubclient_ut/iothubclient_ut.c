@@ -112,6 +112,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CreateWithTransport, TEST_IOTHUB_CLIENT_CORE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_CreateFromDeviceAuth, TEST_IOTHUB_CLIENT_CORE_HANDLE);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SendEventAsync, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SendEventBatchAsync, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetSendStatus, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetMessageCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetConnectionStatusCallback, IOTHUB_CLIENT_OK);
@@ -124,6 +125,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetDeviceMethodCallback, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_SetDeviceMethodCallback_Ex, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_DeviceMethodResponse, IOTHUB_CLIENT_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_GetCallbackDispatchStatistics, IOTHUB_CLIENT_OK);
 #ifndef DONT_USE_UPLOADTOBLOB
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_UploadToBlobAsync, IOTHUB_CLIENT_OK);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_UploadMultipleBlocksToBlobAsync, IOTHUB_CLIENT_OK);
@@ -214,6 +216,20 @@ TEST_FUNCTION(IoTHubClient_SendEventAsync_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubClient_SendEventBatchAsync_Test)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    STRICT_EXPECTED_CALL(IoTHubClientCore_SendEventBatchAsync(TEST_IOTHUB_CLIENT_CORE_HANDLE, messages, 2, TEST_EVENT_CONFIRMATION_CALLBACK, NULL));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_SendEventBatchAsync(TEST_IOTHUB_CLIENT_HANDLE, messages, 2, TEST_EVENT_CONFIRMATION_CALLBACK, NULL);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(IoTHubClient_GetSendStatus_Test)
 {
     //arrange
@@ -374,6 +390,20 @@ TEST_FUNCTION(IoTHubClientCore_DeviceMethodResponse_Test)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
+TEST_FUNCTION(IoTHubClient_GetCallbackDispatchStatistics_Test)
+{
+    //arrange
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
+    STRICT_EXPECTED_CALL(IoTHubClientCore_GetCallbackDispatchStatistics(TEST_IOTHUB_CLIENT_CORE_HANDLE, &statistics));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClient_GetCallbackDispatchStatistics(TEST_IOTHUB_CLIENT_HANDLE, &statistics);
+
+    //assert
+    ASSERT_IS_TRUE(result == IOTHUB_CLIENT_OK);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 #ifndef DONT_USE_UPLOADTOBLOB
 
 TEST_FUNCTION(IoTHubClient_UploadToBlobAsync_Test)
@@ -45,6 +45,7 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 
 #include "iothub_client_version.h"
 #include "iothub_message.h"
+#include "internal/iothub_message_private.h"
 #include "internal/iothub_client_authorization.h"
 #include "internal/iothub_client_diagnostic.h"
 
@@ -79,6 +80,7 @@ MOCKABLE_FUNCTION(, void, FAKE_IoTHubTransport_Unsubscribe, IOTHUB_DEVICE_HANDLE
 MOCKABLE_FUNCTION(, void, FAKE_IoTHubTransport_DoWork, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_CORE_LL_HANDLE, iotHubClientHandle);
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_SetRetryPolicy, TRANSPORT_LL_HANDLE, handle, IOTHUB_CLIENT_RETRY_POLICY, retryPolicy, size_t, retryTimeoutLimitInSeconds);
 MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_GetSendStatus, IOTHUB_DEVICE_HANDLE, handle, IOTHUB_CLIENT_STATUS*, iotHubClientStatus);
+MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_GetTimeToNextDeadline, TRANSPORT_LL_HANDLE, handle, tickcounter_ms_t*, msToNextDeadline);
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_Subscribe_DeviceTwin, IOTHUB_DEVICE_HANDLE, handle);
 MOCKABLE_FUNCTION(, void, FAKE_IoTHubTransport_Unsubscribe_DeviceTwin, IOTHUB_DEVICE_HANDLE, handle);
 MOCKABLE_FUNCTION(, IOTHUB_CLIENT_RESULT, FAKE_IoTHubTransport_SendMessageDisposition, MESSAGE_CALLBACK_INFO*, messageData, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition);
@@ -87,6 +89,7 @@ MOCKABLE_FUNCTION(, IOTHUB_PROCESS_ITEM_RESULT, FAKE_IoTHubTransport_ProcessItem
 MOCKABLE_FUNCTION(, int, FAKE_IoTHubTransport_Subscribe_DeviceMethod, IOTHUB_DEVICE_HANDLE, handle);
 MOCKABLE_FUNCTION(, void, FAKE_IoTHubTransport_Unsubscribe_DeviceMethod, IOTHUB_DEVICE_HANDLE, handle);
 MOCKABLE_FUNCTION(, void, connectionStatusCallback, IOTHUB_CLIENT_CONNECTION_STATUS, result3, IOTHUB_CLIENT_CONNECTION_STATUS_REASON, reason, void*, userContextCallback);
+MOCKABLE_FUNCTION(, void, messageDispositionCallback, IOTHUB_MESSAGE_HANDLE, message, IOTHUBMESSAGE_DISPOSITION_RESULT, disposition, IOTHUB_CLIENT_RESULT, result, void*, userContextCallback);
 MOCKABLE_FUNCTION(, IOTHUBMESSAGE_DISPOSITION_RESULT, messageCallback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
 MOCKABLE_FUNCTION(, bool, messageCallbackEx, MESSAGE_CALLBACK_INFO*, messageData, void*, userContextCallback);
 MOCKABLE_FUNCTION(, void, eventConfirmationCallback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result2, void*, userContextCallback);
@@ -174,6 +177,7 @@ static const char* TEST_PROV_URI = "global.azure-devices-provisioning.net";
 static const char* TEST_METHOD_NAME = "method_name";
 static const char* TEST_CHAR = "TestChar";
 static tickcounter_ms_t g_current_ms = 0;
+static PDLIST_ENTRY g_waitingToSend = NULL;
 static const char* TEST_DEVICE_METHOD_RESPONSE = "{device:method, response:true}";
 
 const unsigned char TEST_REPORTED_STATE[] = { 0x01, 0x02, 0x03 };
@@ -378,7 +382,7 @@ static IOTHUB_DEVICE_HANDLE my_FAKE_IoTHubTransport_Register(TRANSPORT_LL_HANDLE
     (void)handle;
     (void)device;
     (void)iotHubClientHandle;
-    (void)waitingToSend;
+    g_waitingToSend = waitingToSend;
     return (IOTHUB_DEVICE_HANDLE)my_gballoc_malloc(1);
 }
 
@@ -459,6 +463,45 @@ static const TRANSPORT_PROVIDER* provideFAKE(void)
     return &FAKE_transport_provider;
 }
 
+/*same as FAKE_transport_provider, but reporting its deadlines*/
+static TRANSPORT_PROVIDER FAKE_transport_provider_with_deadlines =
+{
+    FAKE_IoTHubTransport_SendMessageDisposition,
+    FAKE_IoTHubTransport_Subscribe_DeviceMethod,
+    FAKE_IoTHubTransport_Unsubscribe_DeviceMethod,
+    FAKE_IoTHubTransport_DeviceMethod_Response,
+    FAKE_IoTHubTransport_Subscribe_DeviceTwin,
+    FAKE_IoTHubTransport_Unsubscribe_DeviceTwin,
+    FAKE_IoTHubTransport_ProcessItem,
+    FAKE_IoTHubTransport_GetHostname,
+    FAKE_IoTHubTransport_SetOption,
+    FAKE_IoTHubTransport_Create,
+    FAKE_IoTHubTransport_Destroy,
+    FAKE_IoTHubTransport_Register,
+    FAKE_IoTHubTransport_Unregister,
+    FAKE_IoTHubTransport_Subscribe,
+    FAKE_IoTHubTransport_Unsubscribe,
+    FAKE_IoTHubTransport_DoWork,
+    FAKE_IoTHubTransport_SetRetryPolicy,
+    FAKE_IoTHubTransport_GetSendStatus,
+    FAKE_IoTHubTransport_GetTimeToNextDeadline /*pfIoTHubTransport_GetTimeToNextDeadline IoTHubTransport_GetTimeToNextDeadline;*/
+};
+
+static const TRANSPORT_PROVIDER* provideFAKE_with_deadlines(void)
+{
+    return &FAKE_transport_provider_with_deadlines;
+}
+
+static const IOTHUB_CLIENT_CONFIG TEST_CONFIG_with_deadlines =
+{
+    provideFAKE_with_deadlines,
+    TEST_DEVICE_ID,
+    TEST_DEVICE_KEY,
+    TEST_DEVICE_SAS,
+    TEST_IOTHUBNAME,
+    TEST_IOTHUBSUFFIX,
+};
+
 #ifndef DONT_USE_UPLOADTOBLOB
 static void my_FileUpload_GetData_Callback(IOTHUB_CLIENT_FILE_UPLOAD_RESULT result, unsigned char const ** data, size_t* size, void* context)
 {
@@ -558,6 +601,7 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_DISPOSITION_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_PROCESS_ITEM_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_STATUS, int);
     REGISTER_UMOCK_ALIAS_TYPE(DEVICE_TWIN_UPDATE_STATE, int);
@@ -614,6 +658,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromString, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Clone, (IOTHUB_MESSAGE_HANDLE)0x44);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Clone, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_OwnContent, IOTHUB_MESSAGE_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_OwnContent, IOTHUB_MESSAGE_ERROR);
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubClient_Diagnostic_AddIfNecessary, 0);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClient_Diagnostic_AddIfNecessary, 100);
@@ -1903,6 +1949,189 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_fails)
     umock_c_negative_tests_deinit();
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_31_001: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall validate its arguments like IoTHubClientCore_LL_SendEventAsync. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(NULL, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)3);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_002: [ IoTHubClientCore_LL_SendEventAsync_TakeOwnership shall add eventMessageHandle itself to the DLIST waitingToSend, without cloning it. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_does_not_clone_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_003: [ If IoTHubClientCore_LL_SendEventAsync_TakeOwnership fails, eventMessageHandle shall still belong to the caller. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventAsync_TakeOwnership_fails_without_destroying_the_message)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, TEST_MESSAGE_HANDLE))
+        .SetReturn(100);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync_TakeOwnership(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0 or if any of the messages is NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(NULL, messages, 2, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_004: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if iotHubClientHandle or eventMessageHandles is NULL, if eventMessageCount is 0 or if any of the messages is NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_invalid_batch_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, NULL };
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result_NULL_array = IoTHubClientCore_LL_SendEventBatchAsync(handle, NULL, 2, test_event_confirmation_callback, (void*)1);
+    IOTHUB_CLIENT_RESULT result_zero_count = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 0, test_event_confirmation_callback, (void*)1);
+    IOTHUB_CLIENT_RESULT result_NULL_message = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_NULL_array);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_zero_count);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result_NULL_message);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_005: [ IoTHubClientCore_LL_SendEventBatchAsync shall fail and return IOTHUB_CLIENT_INVALID_ARG if eventConfirmationCallback is NULL and userContextCallback is not NULL. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_with_NULL_callback_and_non_NULL_context_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE };
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 1, NULL, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_006: [ IoTHubClientCore_LL_SendEventBatchAsync shall read the tick counter once and give all the messages of the batch the same timeout. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_31_007: [ IoTHubClientCore_LL_SendEventBatchAsync shall append all the messages to waitingToSend at once and in order, so that they reach the transport together. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_queues_all_the_messages_at_once)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    tickcounter_ms_t timeout = 1000;
+    size_t index;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &timeout);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    for (index = 0; index < 3; index++)
+    {
+        STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+        STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+        STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 3, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_008: [ If queuing any of the messages fails, IoTHubClientCore_LL_SendEventBatchAsync shall queue none of them and return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SendEventBatchAsync_queues_nothing_when_one_message_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventBatchAsync(handle, messages, 2, test_event_confirmation_callback, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_25_111: [IoTHubClientCore_LL_SetConnectionStatusCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetConnectionStatusCallback_with_NULL_iotHubClientHandle_fails)
 {
@@ -2089,7 +2318,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_Ex_Subscribe_fails)
 
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
         .IgnoreArgument_handle()
-        .SetReturn(__LINE__);
+        .SetReturn(100);
 
     ///act
     IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)1);
@@ -2203,6 +2432,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_1_items_with_callback_succee
     DList_InitializeListHead(&temp);
     IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->pool = NULL;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
@@ -2238,18 +2468,21 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_with_callback_succee
 
     IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->pool = NULL;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+    two->pool = NULL;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+    three->pool = NULL;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
     DList_InsertTailList(&temp, &(three->entry));
@@ -2298,18 +2531,21 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_with_callback__but_b
 
     IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->pool = NULL;
     one->callback = eventConfirmationCallback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+    two->pool = NULL;
     two->callback = eventConfirmationCallback;
     two->context = (void*)2;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+    three->pool = NULL;
     three->callback = eventConfirmationCallback;
     three->context = (void*)3;
     DList_InsertTailList(&temp, &(three->entry));
@@ -2463,6 +2699,77 @@ TEST_FUNCTION(IoTHubClientCore_LL_ConnectionStatusCallBack_with_NULL_callback_fa
     IoTHubClientCore_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_31_027: [ IoTHubClientCore_LL_SetMessageDispositionCallback shall return IOTHUB_CLIENT_INVALID_ARG if called with NULL parameter iotHubClientHandle. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageDispositionCallback_with_NULL_iotHubClientHandle_fails)
+{
+    ///arrange
+
+    ///act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageDispositionCallback(NULL, messageDispositionCallback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_028: [ IoTHubClientCore_LL_SetMessageDispositionCallback shall return IOTHUB_CLIENT_OK and save the callback and userContext as a member of the handle. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_31_025: [ IoTHubClientCore_LL_MessageDispositionComplete shall call the callback set with IoTHubClientCore_LL_SetMessageDispositionCallback passing the message, disposition, result and the saved userContextCallback. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_MessageDispositionComplete_calls_upper_layer_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageDispositionCallback(handle, messageDispositionCallback, (void*)11);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(messageDispositionCallback(TEST_MESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED, IOTHUB_CLIENT_ERROR, (void*)11));
+
+    ///act
+    IoTHubClientCore_LL_MessageDispositionComplete(handle, TEST_MESSAGE_HANDLE, IOTHUBMESSAGE_REJECTED, IOTHUB_CLIENT_ERROR);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_024: [ If parameter handle or message is NULL then IoTHubClientCore_LL_MessageDispositionComplete shall return. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_MessageDispositionComplete_with_NULL_parameter_fails)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageDispositionCallback(handle, messageDispositionCallback, (void*)11);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClientCore_LL_MessageDispositionComplete(handle, NULL, IOTHUBMESSAGE_ACCEPTED, IOTHUB_CLIENT_OK);
+    IoTHubClientCore_LL_MessageDispositionComplete(NULL, TEST_MESSAGE_HANDLE, IOTHUBMESSAGE_ACCEPTED, IOTHUB_CLIENT_OK);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_026: [ If no callback is set and result is not IOTHUB_CLIENT_OK, IoTHubClientCore_LL_MessageDispositionComplete shall log the failure. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_MessageDispositionComplete_without_callback_succeeds)
+{
+    ///arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    ///act
+    IoTHubClientCore_LL_MessageDispositionComplete(handle, TEST_MESSAGE_HANDLE, IOTHUBMESSAGE_ABANDONED, IOTHUB_CLIENT_ERROR);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_10_010: [If parameter messageCallback is NULL and the _SetMessageCallback had not been called to subscribe for messages, then IoTHubClientCore_LL_SetMessageCallback shall fail and return IOTHUB_CLIENT_ERROR.] */
 TEST_FUNCTION(IoTHubClientCore_LL_SetMessageCallback_with_NULL_before_subscribe_fails)
 {
@@ -2624,18 +2931,21 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_one_without_callback
 
     IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->pool = NULL;
     one->callback = test_event_confirmation_callback;
     one->context = (void*)1;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+    two->pool = NULL;
     two->callback = NULL;
     two->context = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+    three->pool = NULL;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
     DList_InsertTailList(&temp, &(three->entry));
@@ -2683,18 +2993,21 @@ TEST_FUNCTION(IoTHubClientCore_LL_SendComplete_with_3_items_one_with_callback_bu
 
     IOTHUB_MESSAGE_LIST* one = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     one->messageHandle = (IOTHUB_MESSAGE_HANDLE)1;
+    one->pool = NULL;
     one->callback = NULL;
     one->context = NULL;
     DList_InsertTailList(&temp, &(one->entry));
 
     IOTHUB_MESSAGE_LIST* two = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     two->messageHandle = (IOTHUB_MESSAGE_HANDLE)2;
+    two->pool = NULL;
     two->callback = NULL;
     two->context = NULL;
     DList_InsertTailList(&temp, &(two->entry));
 
     IOTHUB_MESSAGE_LIST* three = (IOTHUB_MESSAGE_LIST*)malloc(sizeof(IOTHUB_MESSAGE_LIST)); /*this is SendEvent wannabe*/
     three->messageHandle = (IOTHUB_MESSAGE_HANDLE)3;
+    three->pool = NULL;
     three->callback = test_event_confirmation_callback;
     three->context = (void*)3;
     DList_InsertTailList(&temp, &(three->entry));
@@ -2814,6 +3127,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallback_calls_cli
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
 
@@ -2838,6 +3152,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallback_calls_cli
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED))
         .SetReturn(IOTHUB_CLIENT_ERROR);
@@ -2863,6 +3178,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11));
 
     //act
@@ -2887,6 +3203,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11));
 
     //act
@@ -2911,6 +3228,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11))
         .SetReturn(false);
 
@@ -2935,6 +3253,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(messageCallbackEx(testMessage, (void*)11))
         .SetReturn(false);
 
@@ -2950,62 +3269,199 @@ TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_calls_c
     IoTHubClientCore_LL_Destroy(handle);
 }
 
-/*** IoTHubClientCore_LL_GetLastMessageReceiveTime ***/
-
-/* Tests_SRS_IoTHubClientCore_LL_09_001: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
-TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_InvalidClientHandleArg_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_31_017: [Unless the callback was set with IoTHubClientCore_LL_SetMessageViewCallback, IoTHubClientCore_LL_MessageCallback shall make the message own its payload with IoTHubMessage_OwnContent before invoking the callback, and return false if that fails.] */
+TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallback_OwnContent_fails_returns_false)
 {
-    // arrange
-    time_t lastMessageReceiveTime;
-
-    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, test_message_callback_async, (void*)11);
+    MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
     umock_c_reset_all_calls();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    //act
+    bool result = IoTHubClientCore_LL_MessageCallback(handle, testMessage);
+
+    //assert
+    ASSERT_IS_FALSE(result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    // Cleanup
-    IoTHubClientCore_LL_Destroy(iotHubClientHandle);
+    //cleanup
+    destroy_test_message_info(testMessage);
+    IoTHubClientCore_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_09_001: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
-TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_InvalidTimeRefArg_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_31_018: [If messageCallbackType is ASYNC, IoTHubClientCore_LL_MessageCallback shall make the message own its payload with IoTHubMessage_OwnContent before handing it over, since the message outlives the call, and return false if that fails.] */
+TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageCallbackEx_OwnContent_fails_returns_false)
 {
-    // arrange
-    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageCallback_Ex(handle, messageCallbackEx, (void*)11);
+    MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
     umock_c_reset_all_calls();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(iotHubClientHandle, NULL);
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    //act
+    bool result = IoTHubClientCore_LL_MessageCallback(handle, testMessage);
 
+    //assert
+    ASSERT_IS_FALSE(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    // Cleanup
-    IoTHubClientCore_LL_Destroy(iotHubClientHandle);
+    //cleanup
+    destroy_test_message_info(testMessage);
+    IoTHubClientCore_LL_Destroy(handle);
 }
 
-/* Tests_SRS_IoTHubClientCore_LL_09_002: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INDEFINITE_TIME - and not set 'lastMessageReceiveTime' - if it is unable to provide the time for the last commands] */
-TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_NoMessagesReceived_fails)
+/*Tests_SRS_IOTHUBCLIENT_LL_31_016: [IoTHubClientCore_LL_SetMessageViewCallback shall subscribe and unsubscribe like IoTHubClientCore_LL_SetMessageCallback, the messages it receives borrowing their payload from the transport until the callback returns.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageViewCallback_with_non_NULL_succeeds)
 {
-    // arrange
-    time_t lastMessageReceiveTime = (time_t)0;
-
-    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
     umock_c_reset_all_calls();
 
-    // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(iotHubClientHandle, &lastMessageReceiveTime);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Subscribe(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
-    // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
-    ASSERT_ARE_EQUAL(int, 0, (int)(lastMessageReceiveTime));
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageViewCallback(handle, test_message_callback_async, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_016: [IoTHubClientCore_LL_SetMessageViewCallback shall subscribe and unsubscribe like IoTHubClientCore_LL_SetMessageCallback, the messages it receives borrowing their payload from the transport until the callback returns.] */
+TEST_FUNCTION(IoTHubClientCore_LL_SetMessageViewCallback_with_NULL_iotHubClientHandle_fails)
+{
+    //arrange
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetMessageViewCallback(NULL, test_message_callback_async, (void*)1);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_017: [Unless the callback was set with IoTHubClientCore_LL_SetMessageViewCallback, IoTHubClientCore_LL_MessageCallback shall make the message own its payload with IoTHubMessage_OwnContent before invoking the callback, and return false if that fails.] */
+TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_with_messageViewCallback_does_not_copy_the_payload)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageViewCallback(handle, test_message_callback_async, (void*)11);
+    MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
+
+    //act
+    bool result = IoTHubClientCore_LL_MessageCallback(handle, testMessage);
+
+    //assert
+    ASSERT_IS_TRUE(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    destroy_test_message_info(testMessage);
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_016: [IoTHubClientCore_LL_SetMessageViewCallback shall subscribe and unsubscribe like IoTHubClientCore_LL_SetMessageCallback, the messages it receives borrowing their payload from the transport until the callback returns.] */
+TEST_FUNCTION(IoTHubClientCore_LL_MessageCallback_after_messageViewCallback_replaced_copies_the_payload)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetMessageViewCallback(handle, test_message_callback_async, (void*)11);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, NULL, NULL);
+    (void)IoTHubClientCore_LL_SetMessageCallback(handle, test_message_callback_async, (void*)11);
+    MESSAGE_CALLBACK_INFO* testMessage = make_test_message_info(TEST_MESSAGE_HANDLE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
+    STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
+
+    //act
+    bool result = IoTHubClientCore_LL_MessageCallback(handle, testMessage);
+
+    //assert
+    ASSERT_IS_TRUE(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    destroy_test_message_info(testMessage);
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*** IoTHubClientCore_LL_GetLastMessageReceiveTime ***/
+
+/* Tests_SRS_IoTHubClientCore_LL_09_001: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_InvalidClientHandleArg_fails)
+{
+    // arrange
+    time_t lastMessageReceiveTime;
+
+    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(NULL, &lastMessageReceiveTime);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    IoTHubClientCore_LL_Destroy(iotHubClientHandle);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_09_001: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG if any of the arguments is NULL] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_InvalidTimeRefArg_fails)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(iotHubClientHandle, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+
+    // Cleanup
+    IoTHubClientCore_LL_Destroy(iotHubClientHandle);
+}
+
+/* Tests_SRS_IoTHubClientCore_LL_09_002: [IoTHubClientCore_LL_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INDEFINITE_TIME - and not set 'lastMessageReceiveTime' - if it is unable to provide the time for the last commands] */
+TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_NoMessagesReceived_fails)
+{
+    // arrange
+    time_t lastMessageReceiveTime = (time_t)0;
+
+    IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_GetLastMessageReceiveTime(iotHubClientHandle, &lastMessageReceiveTime);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+    ASSERT_ARE_EQUAL(int, 0, (int)(lastMessageReceiveTime));
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // Cleanup
@@ -3024,6 +3480,7 @@ TEST_FUNCTION(IoTHubClientCore_LL_GetLastMessageReceiveTime_MessagesReceived_suc
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(get_time(NULL));
+    STRICT_EXPECTED_CALL(IoTHubMessage_OwnContent(testMessage->messageHandle));
     STRICT_EXPECTED_CALL(test_message_callback_async(testMessage->messageHandle, (void*)11));
     STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SendMessageDisposition(testMessage, IOTHUBMESSAGE_ACCEPTED));
 
@@ -3138,6 +3595,181 @@ TEST_FUNCTION(IoTHubClientCore_LL_GetSendStatus_HasEventToSend_Succeeds)
     IoTHubClientCore_LL_Destroy(handle);
 }
 
+/*** IoTHubClientCore_LL_GetNextDoWorkDelay ***/
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_NULL_handle_returns_1)
+{
+    // arrange
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(NULL, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 1, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_idle_returns_idle_delay)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_STATUS status;
+    IOTHUB_CLIENT_STATUS desire_status = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+
+    /*waitingToSend, iot_msg_queue and iot_ack_queue are empty*/
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_iotHubClientStatus(&desire_status, sizeof(status))
+        .SetReturn(IOTHUB_CLIENT_OK);
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(handle, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 100, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_transport_busy_without_deadlines_returns_1)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_STATUS status;
+    IOTHUB_CLIENT_STATUS desire_status = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+    /*waitingToSend, iot_msg_queue and iot_ack_queue are empty*/
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_iotHubClientStatus(&desire_status, sizeof(status))
+        .SetReturn(IOTHUB_CLIENT_OK);
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(handle, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 1, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_with_queued_event_without_deadlines_returns_1)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    umock_c_reset_all_calls();
+
+    /*waitingToSend is not empty, iot_msg_queue and iot_ack_queue are*/
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(handle, 100);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 1, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+static void test_get_next_do_work_delay_busy_with_transport_deadline(int deadlineResult, tickcounter_ms_t msToNextDeadline, unsigned int idleDelayInMs, unsigned int expectedDelay)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG_with_deadlines);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_STATUS status;
+    IOTHUB_CLIENT_STATUS desire_status = IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_iotHubClientStatus(&desire_status, sizeof(status))
+        .SetReturn(IOTHUB_CLIENT_OK);
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetTimeToNextDeadline(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_msToNextDeadline(&msToNextDeadline, sizeof(msToNextDeadline))
+        .SetReturn(deadlineResult);
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(handle, idleDelayInMs);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, (int)expectedDelay, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_transport_busy_waits_until_its_deadline)
+{
+    test_get_next_do_work_delay_busy_with_transport_deadline(0, 30, 100, 30);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_transport_busy_with_later_deadline_returns_idle_delay)
+{
+    test_get_next_do_work_delay_busy_with_transport_deadline(0, 300, 100, 100);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_transport_busy_without_armed_deadline_returns_idle_delay)
+{
+    test_get_next_do_work_delay_busy_with_transport_deadline(__FAILURE__, 30, 100, 100);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_transport_deadline_due_returns_1)
+{
+    test_get_next_do_work_delay_busy_with_transport_deadline(0, 0, 100, 1);
+}
+
+TEST_FUNCTION(IoTHubClientCore_LL_GetNextDoWorkDelay_with_queued_event_waits_until_it_times_out)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG_with_deadlines);
+    tickcounter_ms_t timeout = 1500;
+    tickcounter_ms_t noDeadline = 0;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &timeout);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    umock_c_reset_all_calls();
+
+    /*waitingToSend is not empty, iot_msg_queue and iot_ack_queue are*/
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetSendStatus(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_GetTimeToNextDeadline(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_msToNextDeadline(&noDeadline, sizeof(noDeadline))
+        .SetReturn(__FAILURE__);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG)); /*a second later, 500 ms are left*/
+
+    // act
+    unsigned int result = IoTHubClientCore_LL_GetNextDoWorkDelay(handle, 2000);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 500, (int)result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_034: [If iotHubClientHandle is NULL then IoTHubClientCore_LL_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetOption_with_NULL_handle_fails)
 {
@@ -3221,6 +3853,54 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_blob_upload_timeout_succeeds)
     
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_31_023: [ blob_upload_concurrency and blob_upload_block_size - IoTHubClientCore_LL_SetOption shall pass these options to IoTHubClient_UploadToBlob_SetOption and return its result. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_blob_upload_concurrency_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_SetOption(IGNORED_PTR_ARG, OPTION_BLOB_UPLOAD_CONCURRENCY, IGNORED_PTR_ARG))
+    .IgnoreArgument_handle()
+    .IgnoreArgument_value()
+    .SetReturn(IOTHUB_CLIENT_INDEFINITE_TIME);
+
+    //act
+    size_t concurrency = 4;
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_BLOB_UPLOAD_CONCURRENCY, &concurrency);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_023: [ blob_upload_concurrency and blob_upload_block_size - IoTHubClientCore_LL_SetOption shall pass these options to IoTHubClient_UploadToBlob_SetOption and return its result. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_blob_upload_block_size_succeeds)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_SetOption(IGNORED_PTR_ARG, OPTION_BLOB_UPLOAD_BLOCK_SIZE, IGNORED_PTR_ARG))
+    .IgnoreArgument_handle()
+    .IgnoreArgument_value()
+    .SetReturn(IOTHUB_CLIENT_INDEFINITE_TIME);
+
+    //act
+    size_t blockSize = 1024 * 1024;
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_BLOB_UPLOAD_BLOCK_SIZE, &blockSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INDEFINITE_TIME, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_30_011: [ IoTHubClientCore_LL_SetOption shall always pass unhandled options to Transport_SetOption. ]*/
 /*Tests_SRS_IoTHubClientCore_LL_30_012: [ If Transport_SetOption fails, IoTHubClientCore_LL_SetOption shall return that failure code. ]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetOption_fails_when_IoTHubTransport_SetOption_fails)
@@ -3302,6 +3982,91 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_fails_when_underlying_transport_fail
 }
 #endif
 
+/*Tests_SRS_IOTHUBCLIENT_LL_31_013: [ "message_pool_size" - IoTHubClientCore_LL_SetOption shall first pass the option to Transport_SetOption and return its failure code if it fails. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_pool_size_fails_when_transport_fails)
+{
+    //arrange
+    size_t poolSize = 4;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &poolSize))
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_012: [ When a message pool is set, the IOTHUB_MESSAGE_LIST entries shall be acquired from it instead of the heap and given back to it when the message completes. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_31_014: [ IoTHubClientCore_LL_SetOption shall replace the message pool by one reserving value entries, or by none when value is 0; entries already queued go back to the pool they came from. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_SetOption_message_pool_size_SendEventAsync_does_not_allocate)
+{
+    //arrange
+    size_t poolSize = 4;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_SetOption(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &poolSize));
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Diagnostic_AddIfNecessary(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_012: [ When a message pool is set, the IOTHUB_MESSAGE_LIST entries shall be acquired from it instead of the heap and given back to it when the message completes. ]*/
+/*Tests_SRS_IOTHUBCLIENT_LL_31_015: [ IoTHubClientCore_LL_Destroy shall destroy the message pool, which is only freed once a transport still holding entries gives them back. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_Destroy_gives_pooled_messages_back_to_the_pool)
+{
+    //arrange
+    size_t poolSize = 4;
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    (void)IoTHubClientCore_LL_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, (void*)1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Unregister(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, (void*)1));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveHeadList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(IGNORED_PTR_ARG));
+#ifndef DONT_USE_UPLOADTOBLOB
+    STRICT_EXPECTED_CALL(IoTHubClient_LL_UploadToBlob_Destroy(IGNORED_PTR_ARG));
+#endif
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubClientCore_LL_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_039: [ "messageTimeout" - once IoTHubClientCore_LL_SendEventAsync is called the message shall timeout after value miliseconds. Value is a pointer to a tickcounter_ms_t. ]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetOption_messageTimeout_to_zero_after_Create_succeeds)
 {
@@ -3730,6 +4495,169 @@ TEST_FUNCTION(IoTHubClientCore_LL_SetOption_2_messages_one_with_timeout_one_with
     IoTHubClientCore_LL_Destroy(handle);
 }
 
+/*Tests_SRS_IOTHUBCLIENT_LL_31_010: [ When the messages were queued in the order of their timeouts, DoTimeouts shall stop at the first message that has not timed out. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_messages_queued_in_timeout_order_only_times_out_the_expired_ones)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t one = 1;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &one);
+
+    /*send 2 messages that will expire at 11 and 21*/
+    tickcounter_ms_t ten = 10;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    tickcounter_ms_t twenty = 20;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &twenty, sizeof(twenty));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE_2);
+
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t timeIsNow = 12; /*only the first message timed out*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_011: [ After walking the whole list DoTimeouts shall remember whether the messages left in waitingToSend are in the order of their timeouts. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_messages_queued_out_of_timeout_order_times_out_the_later_one)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t ten = 10;
+    tickcounter_ms_t one = 1;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &ten);
+
+    /*the first message expires at 20, the second one - queued after a shorter timeout was set - expires at 11*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &one);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE_2);
+
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t timeIsNow = 12;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    tickcounter_ms_t laterTimeIsNow = 21;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &laterTimeIsNow, sizeof(laterTimeIsNow));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_030: [ IoTHubClientCore_LL_MessagesPutBack shall walk waitingToSend and remember the latest timeout of its messages and whether they are in the order of their timeouts. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_DoWork_message_put_back_at_the_head_does_not_hide_an_expired_one)
+{
+    //arrange
+    IOTHUB_CLIENT_CORE_LL_HANDLE handle = IoTHubClientCore_LL_Create(&TEST_CONFIG);
+    tickcounter_ms_t ten = 10;
+    tickcounter_ms_t one = 1;
+    PDLIST_ENTRY taken;
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &ten);
+
+    /*the first message expires at 20 and is taken by the transport*/
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE);
+    taken = real_DList_RemoveHeadList(g_waitingToSend);
+
+    /*the second one expires at 11 and is queued while waitingToSend is empty*/
+    (void)IoTHubClientCore_LL_SetOption(handle, "messageTimeout", &one);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &ten, sizeof(ten));
+    (void)IoTHubClientCore_LL_SendEventAsync(handle, TEST_DEVICEMESSAGE_HANDLE, test_event_confirmation_callback, (void*)TEST_DEVICEMESSAGE_HANDLE_2);
+
+    /*the transport could not send the first one and puts it back in front of the second one*/
+    real_DList_InsertHeadList(g_waitingToSend, taken);
+    IoTHubClientCore_LL_MessagesPutBack(handle);
+
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t timeIsNow = 12;
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .CopyOutArgumentBuffer(2, &timeIsNow, sizeof(timeIsNow));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, (void*)TEST_DEVICEMESSAGE_HANDLE_2));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(FAKE_IoTHubTransport_DoWork(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllCalls();
+
+    //act
+    IoTHubClientCore_LL_DoWork(handle);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubClientCore_LL_Destroy(handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_LL_31_029: [ If parameter handle is NULL then IoTHubClientCore_LL_MessagesPutBack shall return. ]*/
+TEST_FUNCTION(IoTHubClientCore_LL_MessagesPutBack_with_NULL_handle_does_nothing)
+{
+    ///arrange
+
+    ///act
+    IoTHubClientCore_LL_MessagesPutBack(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_IoTHubClientCore_LL_02_041: [ If more than value miliseconds have passed since the call to IoTHubClientCore_LL_SendEventAsync then the message callback shall be called with a status code of IOTHUB_CLIENT_CONFIRMATION_TIMEOUT. ]*/
 TEST_FUNCTION(IoTHubClientCore_LL_SetOption_messageTimeout_when_tickcounter_fails_in_do_work_no_timeout_callbacks_are_called) /*test wants to see that message that did not timeout yet do not have their callbacks called*/
 {
@@ -60,15 +60,18 @@ void* my_gballoc_realloc(void* ptr, size_t size)
 
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
 #include "iothub_client_core_ll.h"
 #include "internal/iothubtransport.h"
+#include "internal/iothub_client_ingestion_queue.h"
 #undef ENABLE_MOCKS
 
 #undef IOTHUB_CLIENT_CORE_H
 
 #include "iothub_client_core.h"
+#include "iothub_client_options.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -139,6 +142,7 @@ static IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_RESULT my_FileUpload_GetData_CallbackE
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 MOCKABLE_FUNCTION(, void, test_event_confirmation_callback, IOTHUB_CLIENT_CONFIRMATION_RESULT, result, void*, userContextCallback);
 MOCKABLE_FUNCTION(, IOTHUBMESSAGE_DISPOSITION_RESULT, test_message_confirmation_callback, IOTHUB_MESSAGE_HANDLE, message, void*, userContextCallback);
@@ -168,8 +172,10 @@ static TEST_MUTEX_HANDLE g_dllByDll;
 
 #ifdef __cplusplus
 extern "C" const size_t IoTHubClientCore_ThreadTerminationOffset;
+extern "C" const size_t IoTHubClientCore_CallbackDispatcherStopOffset;
 #else
 extern const size_t IoTHubClientCore_ThreadTerminationOffset;
+extern const size_t IoTHubClientCore_CallbackDispatcherStopOffset;
 #endif
 
 typedef struct LOCK_TEST_INFO_TAG
@@ -182,6 +188,7 @@ static LOCK_TEST_INFO g_transport_lock;
 static THREAD_START_FUNC g_thread_func;
 static void* g_thread_func_arg;
 static IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK g_eventConfirmationCallback;
+static size_t g_eventConfirmationCount; /*how many messages the fake LL layer confirms on destroy*/
 static IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK g_deviceTwinCallback;
 static IOTHUB_CLIENT_REPORTED_STATE_CALLBACK g_reportedStateCallback;
 static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK g_connectionStatusCallback;
@@ -191,6 +198,7 @@ static IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC_EX g_messageCallback_ex;
 
 
 static size_t g_how_thread_loops = 0;
+static void* g_dispatcher_thread_arg = NULL;
 static size_t g_thread_loop_count = 0;
 
 
@@ -206,6 +214,10 @@ static IOTHUB_CLIENT_DEVICE_CONFIG* TEST_CLIENT_DEVICE_CONFIG = (IOTHUB_CLIENT_D
 static METHOD_HANDLE TEST_METHOD_ID = (METHOD_HANDLE)0x111B;
 static STRING_HANDLE TEST_STRING_HANDLE = (STRING_HANDLE)0x111C;
 static BUFFER_HANDLE TEST_BUFFER_HANDLE = (BUFFER_HANDLE)0x111D;
+static COND_HANDLE TEST_COND_HANDLE = (COND_HANDLE)0x111E;
+static TICK_COUNTER_HANDLE TEST_TICK_COUNTER_HANDLE = (TICK_COUNTER_HANDLE)0x111F;
+static INGESTION_QUEUE_HANDLE TEST_INGESTION_QUEUE_HANDLE = (INGESTION_QUEUE_HANDLE)0x1120;
+static IOTHUB_MESSAGE_HANDLE TEST_CLONED_MESSAGE_HANDLE = (IOTHUB_MESSAGE_HANDLE)0x1121;
 
 static const char* TEST_CONNECTION_STRING = "Test_connection_string";
 static const char* TEST_DEVICE_ID = "theidofTheDevice";
@@ -217,6 +229,7 @@ static const char* TEST_METHOD_NAME = "method_name";
 static const char* TEST_IOTHUB_URI = "iothub_uri";
 static const unsigned char* TEST_DEVICE_METHOD_RESPONSE = (const unsigned char*)0x62;
 static size_t TEST_DEVICE_RESP_LENGTH = 1;
+static const unsigned int TEST_DO_WORK_FREQ_DEFAULT_MS = 1;
 static void* CALLBACK_CONTEXT = (void*)0x1210;
 
 #define REPORTED_STATE_STATUS_CODE      200
@@ -280,6 +293,64 @@ static void my_ThreadAPI_Sleep(unsigned int milliseconds)
     }
 }
 
+static COND_RESULT my_Condition_Wait(COND_HANDLE handle, LOCK_HANDLE lock, int timeout_milliseconds)
+{
+    (void)handle;
+    (void)lock;
+    (void)timeout_milliseconds;
+    if (g_dispatcher_thread_arg != NULL)
+    {
+        *(int*)(((char*)g_dispatcher_thread_arg) + IoTHubClientCore_CallbackDispatcherStopOffset) = 1; /*tell the dispatch thread to stop*/
+        return COND_OK;
+    }
+    g_thread_loop_count++;
+    if ((g_how_thread_loops > 0) && (g_how_thread_loops == g_thread_loop_count))
+    {
+        *(sig_atomic_t*)(((char*)g_thread_func_arg) + IoTHubClientCore_ThreadTerminationOffset) = 1; /*tell the thread to stop*/
+    }
+    return COND_TIMEOUT;
+}
+
+#define TEST_INGESTION_QUEUE_CAPACITY 4
+static void* g_ingested_items[TEST_INGESTION_QUEUE_CAPACITY];
+static size_t g_ingested_pushed;
+static size_t g_ingested_popped;
+
+static int my_ingestion_queue_push(INGESTION_QUEUE_HANDLE queue, void* item)
+{
+    int result;
+    (void)queue;
+    if (g_ingested_pushed == TEST_INGESTION_QUEUE_CAPACITY)
+    {
+        result = __FAILURE__;
+    }
+    else
+    {
+        g_ingested_items[g_ingested_pushed++] = item;
+        result = 0;
+    }
+    return result;
+}
+
+static void* my_ingestion_queue_pop(INGESTION_QUEUE_HANDLE queue)
+{
+    (void)queue;
+    return (g_ingested_popped < g_ingested_pushed) ? g_ingested_items[g_ingested_popped++] : NULL;
+}
+
+static bool my_ingestion_queue_is_empty(INGESTION_QUEUE_HANDLE queue)
+{
+    (void)queue;
+    return (g_ingested_popped == g_ingested_pushed);
+}
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
+{
+    (void)tick_counter;
+    *current_ms = 0;
+    return 0;
+}
+
 static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_GetSendStatus(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_CLIENT_STATUS *iotHubClientStatus)
 {
     (void)iotHubClientHandle;
@@ -292,6 +363,17 @@ static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_SendEventAsync(IOTHUB_CLIENT_
     (void)iotHubClientHandle;
     (void)eventMessageHandle;
     g_eventConfirmationCallback = eventConfirmationCallback;
+    g_eventConfirmationCount = 1;
+    g_userContextCallback = userContextCallback;
+    return IOTHUB_CLIENT_OK;
+}
+
+static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_SendEventBatchAsync(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClientHandle, IOTHUB_MESSAGE_HANDLE* eventMessageHandles, size_t eventMessageCount, IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK eventConfirmationCallback, void* userContextCallback)
+{
+    (void)iotHubClientHandle;
+    (void)eventMessageHandles;
+    g_eventConfirmationCallback = eventConfirmationCallback;
+    g_eventConfirmationCount = eventMessageCount;
     g_userContextCallback = userContextCallback;
     return IOTHUB_CLIENT_OK;
 }
@@ -361,7 +443,11 @@ static void my_IoTHubClient_LL_Destroy(IOTHUB_CLIENT_CORE_LL_HANDLE iotHubClient
     (void)iotHubClientHandle;
     if ((g_eventConfirmationCallback != NULL) && (g_userContextCallback)) /*no test ever set the user context to NULL, so we piggyback it*/
     {
-        g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, g_userContextCallback);
+        size_t i;
+        for (i = 0; i < g_eventConfirmationCount; i++)
+        {
+            g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY, g_userContextCallback);
+        }
     }
 }
 
@@ -434,6 +520,10 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_FILE_UPLOAD_GET_DATA_CALLBACK_EX, void*);
     REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(INGESTION_QUEUE_HANDLE, void*);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -451,6 +541,10 @@ TEST_SUITE_INITIALIZE(suite_init)
 #endif
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendEventAsync, my_IoTHubClientCore_LL_SendEventAsync);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClientCore_LL_SendEventAsync, IOTHUB_CLIENT_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendEventAsync_TakeOwnership, my_IoTHubClientCore_LL_SendEventAsync);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClientCore_LL_SendEventAsync_TakeOwnership, IOTHUB_CLIENT_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendEventBatchAsync, my_IoTHubClientCore_LL_SendEventBatchAsync);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClientCore_LL_SendEventBatchAsync, IOTHUB_CLIENT_ERROR);
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_GetSendStatus, my_IoTHubClientCore_LL_GetSendStatus);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubClientCore_LL_GetSendStatus, IOTHUB_CLIENT_ERROR);
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_GetLastMessageReceiveTime, my_IoTHubClientCore_LL_GetLastMessageReceiveTime);
@@ -504,6 +598,23 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(Unlock, my_Unlock);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Unlock, LOCK_ERROR);
 
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_HOOK(Condition_Wait, my_Condition_Wait);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubClientCore_LL_GetNextDoWorkDelay, 1);
+
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+
+    REGISTER_GLOBAL_MOCK_RETURN(ingestion_queue_create, TEST_INGESTION_QUEUE_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ingestion_queue_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(ingestion_queue_push, my_ingestion_queue_push);
+    REGISTER_GLOBAL_MOCK_HOOK(ingestion_queue_pop, my_ingestion_queue_pop);
+    REGISTER_GLOBAL_MOCK_HOOK(ingestion_queue_is_empty, my_ingestion_queue_is_empty);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_Clone, TEST_CLONED_MESSAGE_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Clone, NULL);
+
     REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Sleep, my_ThreadAPI_Sleep);
     REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Join, my_ThreadAPI_Join);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Join, THREADAPI_ERROR);
@@ -522,6 +633,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_clear, real_VECTOR_clear);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, real_VECTOR_destroy);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_size, real_VECTOR_size);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_front, real_VECTOR_front);
+    REGISTER_GLOBAL_MOCK_HOOK(VECTOR_erase, real_VECTOR_erase);
 
     REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_create, TEST_SLL_HANDLE);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_create, NULL);
@@ -548,8 +661,12 @@ static void reset_test_data()
     g_userContextCallback = NULL;
     g_how_thread_loops = 0;
     g_thread_loop_count = 0;
+    g_dispatcher_thread_arg = NULL;
+    g_ingested_pushed = 0;
+    g_ingested_popped = 0;
     
     g_eventConfirmationCallback = NULL;
+    g_eventConfirmationCount = 0;
     g_deviceTwinCallback = NULL;
     g_reportedStateCallback = NULL;
     g_connectionStatusCallback = NULL;
@@ -737,6 +854,7 @@ static void setup_iothubclient_uploadtoblobasync()
 // Initial time we loop through ScheduleWork, including DoWork and into the always run dispatch_user_callbacks functions.
 static void set_expected_calls_first_ScheduleWork_Thread_loop(size_t expected_callbacks_length)
 {
+    STRICT_EXPECTED_CALL(Condition_Init());
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
     STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
@@ -747,12 +865,22 @@ static void set_expected_calls_first_ScheduleWork_Thread_loop(size_t expected_ca
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 }
 
-// Final time we loop through ScheduleWork_Thread, from return of dispatch_user_callbacks/sleep to exiting out.
+// Waiting for work after a loop through ScheduleWork_Thread
+static void set_expected_calls_ScheduleWork_Thread_wait_for_work()
+{
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetNextDoWorkDelay(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_DO_WORK_FREQ_DEFAULT_MS));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+}
+
+// Final time we loop through ScheduleWork_Thread, from return of dispatch_user_callbacks/wait to exiting out.
 static void set_expected_calls_final_ScheduleWork_Thread_loop()
 {
-    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+    set_expected_calls_ScheduleWork_Thread_wait_for_work();
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
     STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
 }
 
@@ -1342,275 +1470,469 @@ TEST_FUNCTION(IoTHubClient_SendEventAsync_event_confirm_callback_succeed)
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-
-TEST_FUNCTION(IoTHubClientCore_GetSendStatus_iothub_handle_NULL_fail)
+/* Tests_SRS_IOTHUBCLIENT_31_001: [ If iotHubClientHandle is NULL, IoTHubClient_SendEventBatchAsync shall return IOTHUB_CLIENT_INVALID_ARG. ] */
+TEST_FUNCTION(IoTHubClient_SendEventBatchAsync_handle_NULL_fail)
 {
     // arrange
-    IOTHUB_CLIENT_STATUS iothub_status;
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(NULL, &iothub_status);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventBatchAsync(NULL, messages, 2, test_event_confirmation_callback, NULL);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    // cleanup
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClientCore_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
-/* Tests_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClientCore_GetSendStatus shall return the result of IoTHubClientCore_LL_GetSendStatus.] */
-/* Tests_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClientCore_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_GetSendStatus_lock_fail)
+/* Tests_SRS_IOTHUBCLIENT_31_002: [ IoTHubClient_SendEventBatchAsync shall start the worker thread if it was not previously started. ] */
+/* Tests_SRS_IOTHUBCLIENT_31_003: [ IoTHubClient_SendEventBatchAsync shall take the lock created in IoTHubClient_Create once for the whole batch. ] */
+/* Tests_SRS_IOTHUBCLIENT_31_005: [ IoTHubClient_SendEventBatchAsync shall allocate one context for the whole batch, released once every message of the batch has been confirmed. ] */
+/* Tests_SRS_IOTHUBCLIENT_31_006: [ IoTHubClient_SendEventBatchAsync shall call IoTHubClientCore_LL_SendEventBatchAsync and return its result. ] */
+TEST_FUNCTION(IoTHubClient_SendEventBatchAsync_succeed)
 {
     // arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    IOTHUB_CLIENT_STATUS iothub_status;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle().SetReturn(LOCK_ERROR);
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventBatchAsync(IGNORED_PTR_ARG, messages, 3, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(iothub_handle, &iothub_status);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventBatchAsync(iothub_handle, messages, 3, test_event_confirmation_callback, NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_022: [IoTHubClientCore_GetSendStatus shall call IoTHubClientCore_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameter iotHubClientStatus.] */
-/* Tests_SRS_IOTHUBCLIENT_01_033: [IoTHubClientCore_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
-TEST_FUNCTION(IoTHubClientCore_GetSendStatus_succeed)
+/* Tests_SRS_IOTHUBCLIENT_31_006: [ IoTHubClient_SendEventBatchAsync shall call IoTHubClientCore_LL_SendEventBatchAsync and return its result. ] */
+TEST_FUNCTION(IoTHubClient_SendEventBatchAsync_LL_fails_releases_the_batch_context)
 {
     // arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    IOTHUB_CLIENT_STATUS iothub_status;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetSendStatus(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &iothub_status));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventBatchAsync(IGNORED_PTR_ARG, messages, 2, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(iothub_handle, &iothub_status);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventBatchAsync(iothub_handle, messages, 2, test_event_confirmation_callback, NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_client_handle_NULL_fail)
+/* Tests_SRS_IOTHUBCLIENT_31_005: [ IoTHubClient_SendEventBatchAsync shall allocate one context for the whole batch, released once every message of the batch has been confirmed. ] */
+TEST_FUNCTION(IoTHubClient_SendEventBatchAsync_batch_context_released_with_the_last_confirmation)
 {
     // arrange
+    IOTHUB_MESSAGE_HANDLE messages[] = { TEST_MESSAGE_HANDLE, TEST_MESSAGE_HANDLE };
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SendEventBatchAsync(iothub_handle, messages, 2, test_event_confirmation_callback, (void*)0x42);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(NULL, test_message_confirmation_callback, NULL);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, g_userContextCallback);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT, g_userContextCallback);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
+    g_eventConfirmationCallback = NULL; /*both messages are confirmed, the LL layer does not hold the batch anymore*/
+    IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClientCore_SetMessageCallback shall start the worker thread if it was not previously started.] */
-/* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClientCore_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameters messageCallback and userContextCallback.] */
-/* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClientCore_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
-/* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClientCore_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
-/* Tests_SRS_IOTHUBCLIENT_25_087: [ `IoTHubClientCore_SetConnectionStatusCallback` shall be made thread-safe by using the lock created in `IoTHubClientCore_Create`. ] */
-/* Tests_SRS_IOTHUBCLIENT_25_086: [ When `IoTHubClientCore_LL_SetConnectionStatusCallback` is called, `IoTHubClientCore_SetConnectionStatusCallback` shall return the result of `IoTHubClientCore_LL_SetConnectionStatusCallback`.] */
-TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_succeed)
+TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingestion_queue_does_not_lock)
 {
     // arrange
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument_size();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_messageCallback()
-        .IgnoreArgument_userContextCallback();
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(ingestion_queue_push(TEST_INGESTION_QUEUE_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_is_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, g_ingested_pushed);
+    ASSERT_IS_NULL(g_eventConfirmationCallback);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
-/* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
-/* Tests_SRS_IOTHUBCLIENT_01_028: [If acquiring the lock fails, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_fail)
+TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingestion_queue_locks_to_wake_a_waiting_worker)
 {
     // arrange
-    int negativeTestsInitResult = umock_c_negative_tests_init();
-    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
-
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument_size();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_messageCallback()
-        .IgnoreArgument_userContextCallback();
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-
-    umock_c_negative_tests_snapshot();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(ingestion_queue_push(TEST_INGESTION_QUEUE_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_is_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE))
+        .SetReturn(true);
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    size_t count = umock_c_negative_tests_call_count();
-    for (size_t index = 0; index < count; index++)
-    {
-        if (index == 4)
-        {
-            continue;
-        }
-        else if (index == 2)
-        {
-            g_fail_my_gballoc_malloc = true;
-        }
-        else if (index == 3)
-        {
-            my_IoTHubClientCore_LL_SetMessageCallback_Ex_result = IOTHUB_CLIENT_ERROR;
-        }
-        else
-        {
-            g_fail_my_gballoc_malloc = false;
-            my_IoTHubClientCore_LL_SetMessageCallback_Ex_result = IOTHUB_CLIENT_OK;
-        }
-
-        umock_c_negative_tests_reset();
-        umock_c_negative_tests_fail_call(index);
-
-        char tmp_msg[64];
-        sprintf(tmp_msg, "IoTHubClientCore_SetMessageCallback failure in test %zu/%zu", index, count);
-        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
 
-        // assert
-        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, g_ingested_pushed);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
-    umock_c_negative_tests_deinit();
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClientCore_LL_SetMessageCallback_Ex is called, IoTHubClientCore_SetMessageCallback shall return the result of IoTHubClientCore_LL_SetMessageCallback_Ex.] */
-TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_fails_if_SetMessageCallback_Ex_fails)
+TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingestion_queue_clone_fail)
 {
     // arrange
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument_size();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetReturn(IOTHUB_CLIENT_ERROR);
-    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreArgument_ptr();
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE))
+        .SetReturn(NULL);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, g_ingested_pushed);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_client_handle_NULL_fail)
+TEST_FUNCTION(IoTHubClient_SendEventAsync_with_ingestion_queue_full_falls_back_to_lock)
 {
     // arrange
+    size_t index;
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
+    for (index = 0; index < TEST_INGESTION_QUEUE_CAPACITY; index++)
+    {
+        (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    }
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubMessage_Clone(TEST_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(ingestion_queue_push(TEST_INGESTION_QUEUE_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    for (index = 0; index < TEST_INGESTION_QUEUE_CAPACITY; index++)
+    {
+        /*the queued events go first*/
+        STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+        STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventAsync_TakeOwnership(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, NULL, NULL));
+        EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventAsync_TakeOwnership(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(NULL, test_connection_status_callback, NULL);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(g_eventConfirmationCallback);
 
     // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_succeed)
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_drains_ingestion_queue_before_DoWork)
 {
     // arrange
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
+    g_how_thread_loops = 1;
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument_size();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetConnectionStatusCallback(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_connectionStatusCallback()
-        .IgnoreArgument_userContextCallback();
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventAsync_TakeOwnership(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_set_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE, true));
+    STRICT_EXPECTED_CALL(ingestion_queue_is_empty(TEST_INGESTION_QUEUE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetNextDoWorkDelay(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_DO_WORK_FREQ_DEFAULT_MS));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(ingestion_queue_set_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE, false));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(iothub_handle, test_connection_status_callback, NULL);
+    g_thread_func(g_thread_func_arg);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(g_eventConfirmationCallback);
+    ASSERT_ARE_EQUAL(size_t, 1, g_ingested_popped);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_fail)
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_destroys_ingested_event_the_LL_layer_rejects)
 {
     // arrange
-    int negativeTestsInitResult = umock_c_negative_tests_init();
-    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
-
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    g_how_thread_loops = 1;
     umock_c_reset_all_calls();
 
-    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument_size();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetConnectionStatusCallback(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument_connectionStatusCallback()
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendEventAsync_TakeOwnership(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CLONED_MESSAGE_HANDLE, NULL, NULL))
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+    STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(TEST_CLONED_MESSAGE_HANDLE));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_pop(TEST_INGESTION_QUEUE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_set_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE, true));
+    STRICT_EXPECTED_CALL(ingestion_queue_is_empty(TEST_INGESTION_QUEUE_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetNextDoWorkDelay(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_DO_WORK_FREQ_DEFAULT_MS));
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(ingestion_queue_set_consumer_waiting(TEST_INGESTION_QUEUE_HANDLE, false));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
+
+    // act
+    g_thread_func(g_thread_func_arg);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_Destroy_hands_ingested_events_to_LL_before_destroying_it)
+{
+    // arrange
+    size_t queue_size = TEST_INGESTION_QUEUE_CAPACITY;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    umock_c_reset_all_calls();
+
+    // act
+    IoTHubClientCore_Destroy(iothub_handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(size_t, 1, g_ingested_popped);
+}
+
+
+TEST_FUNCTION(IoTHubClientCore_GetSendStatus_iothub_handle_NULL_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_STATUS iothub_status;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(NULL, &iothub_status);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_023: [If iotHubClientHandle is NULL, IoTHubClientCore_ GetSendStatus shall return IOTHUB_CLIENT_INVALID_ARG.] */
+/* Tests_SRS_IOTHUBCLIENT_01_024: [Otherwise, IoTHubClientCore_GetSendStatus shall return the result of IoTHubClientCore_LL_GetSendStatus.] */
+/* Tests_SRS_IOTHUBCLIENT_01_034: [If acquiring the lock fails, IoTHubClientCore_GetSendStatus shall return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_GetSendStatus_lock_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_STATUS iothub_status;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle().SetReturn(LOCK_ERROR);
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(iothub_handle, &iothub_status);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_022: [IoTHubClientCore_GetSendStatus shall call IoTHubClientCore_LL_GetSendStatus, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameter iotHubClientStatus.] */
+/* Tests_SRS_IOTHUBCLIENT_01_033: [IoTHubClientCore_GetSendStatus shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
+TEST_FUNCTION(IoTHubClientCore_GetSendStatus_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_STATUS iothub_status;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetSendStatus(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &iothub_status));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetSendStatus(iothub_handle, &iothub_status);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_client_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(NULL, test_message_confirmation_callback, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_014: [IoTHubClientCore_SetMessageCallback shall start the worker thread if it was not previously started.] */
+/* Tests_SRS_IOTHUBCLIENT_01_017: [IoTHubClientCore_SetMessageCallback shall call IoTHubClient_LL_SetMessageCallback, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameters messageCallback and userContextCallback.] */
+/* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClient_LL_SetMessageCallback is called, IoTHubClientCore_SetMessageCallback shall return the result of IoTHubClient_LL_SetMessageCallback.] */
+/* Tests_SRS_IOTHUBCLIENT_01_027: [IoTHubClientCore_SetMessageCallback shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
+/* Tests_SRS_IOTHUBCLIENT_25_087: [ `IoTHubClientCore_SetConnectionStatusCallback` shall be made thread-safe by using the lock created in `IoTHubClientCore_Create`. ] */
+/* Tests_SRS_IOTHUBCLIENT_25_086: [ When `IoTHubClientCore_LL_SetConnectionStatusCallback` is called, `IoTHubClientCore_SetConnectionStatusCallback` shall return the result of `IoTHubClientCore_LL_SetConnectionStatusCallback`.] */
+TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_messageCallback()
+        .IgnoreArgument_userContextCallback();
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_015: [If starting the thread fails, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+/* Tests_SRS_IOTHUBCLIENT_01_016: [If iotHubClientHandle is NULL, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_INVALID_ARG.] */
+/* Tests_SRS_IOTHUBCLIENT_01_028: [If acquiring the lock fails, IoTHubClientCore_SetMessageCallback shall return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_fail)
+{
+    // arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_messageCallback()
         .IgnoreArgument_userContextCallback();
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument_handle();
@@ -1631,20 +1953,20 @@ TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_fail)
         }
         else if (index == 3)
         {
-            my_IoTHubClient_LL_SetConnectionStatusCallback_result = IOTHUB_CLIENT_ERROR;
+            my_IoTHubClientCore_LL_SetMessageCallback_Ex_result = IOTHUB_CLIENT_ERROR;
         }
         else
         {
-            my_IoTHubClient_LL_SetConnectionStatusCallback_result = IOTHUB_CLIENT_OK;
             g_fail_my_gballoc_malloc = false;
+            my_IoTHubClientCore_LL_SetMessageCallback_Ex_result = IOTHUB_CLIENT_OK;
         }
 
         umock_c_negative_tests_reset();
         umock_c_negative_tests_fail_call(index);
 
-        char tmp_msg[128];
-        sprintf(tmp_msg, "IoTHubClient_SetConnectionStatusCallback failure in test %zu/%zu", index, count);
-        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(iothub_handle, test_connection_status_callback, NULL);
+        char tmp_msg[64];
+        sprintf(tmp_msg, "IoTHubClientCore_SetMessageCallback failure in test %zu/%zu", index, count);
+        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
 
         // assert
         ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
@@ -1655,15 +1977,44 @@ TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_fail)
     umock_c_negative_tests_deinit();
 }
 
-/* Tests_SRS_IOTHUBCLIENT_25_076: [ If `iotHubClientHandle` is `NULL`, `IoTHubClientCore_SetRetryPolicy` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
-TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_client_handle_fail)
+/* Tests_SRS_IOTHUBCLIENT_01_018: [When IoTHubClientCore_LL_SetMessageCallback_Ex is called, IoTHubClientCore_SetMessageCallback shall return the result of IoTHubClientCore_LL_SetMessageCallback_Ex.] */
+TEST_FUNCTION(IoTHubClientCore_SetMessageCallback_fails_if_SetMessageCallback_Ex_fails)
 {
     // arrange
-    IOTHUB_CLIENT_RETRY_POLICY retry_policy = IOTHUB_CLIENT_RETRY_RANDOM;
-    size_t retry_in_seconds = 10;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetMessageCallback_Ex(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetReturn(IOTHUB_CLIENT_ERROR);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument_ptr();
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetRetryPolicy(NULL, retry_policy, retry_in_seconds);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetMessageCallback(iothub_handle, test_message_confirmation_callback, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_client_handle_NULL_fail)
+{
+    // arrange
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(NULL, test_connection_status_callback, NULL);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
@@ -1672,26 +2023,25 @@ TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_client_handle_fail)
     // cleanup
 }
 
-/* Tests_SRS_IOTHUBCLIENT_25_078: [ When `IoTHubClientCore_LL_SetRetryPolicy` is called, `IoTHubClientCore_SetRetryPolicy` shall return the result of `IoTHubClientCore_LL_SetRetryPolicy`. ]*/
-TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_succeed)
+TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_succeed)
 {
     // arrange
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    IOTHUB_CLIENT_RETRY_POLICY retry_policy = IOTHUB_CLIENT_RETRY_RANDOM;
-    size_t retry_in_seconds = 10;
-
     EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
         .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, retry_policy, retry_in_seconds))
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetConnectionStatusCallback(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_connectionStatusCallback()
+        .IgnoreArgument_userContextCallback();
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument_handle();
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetRetryPolicy(iothub_handle, retry_policy, retry_in_seconds);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(iothub_handle, test_connection_status_callback, NULL);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
@@ -1701,314 +2051,879 @@ TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_succeed)
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_25_092: [ If `iotHubClientHandle` is `NULL`, `IoTHubClientCore_GetRetryPolicy` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
-TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_client_handle_NULL_fail)
+TEST_FUNCTION(IoTHubClientCore_SetConnectionStatusCallback_fail)
 {
     // arrange
-    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
-    size_t retry_in_seconds;
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument_size();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetConnectionStatusCallback(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument_connectionStatusCallback()
+        .IgnoreArgument_userContextCallback();
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    umock_c_negative_tests_snapshot();
+
+    // act
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        if (index == 4)
+        {
+            continue;
+        }
+        else if (index == 2)
+        {
+            g_fail_my_gballoc_malloc = true;
+        }
+        else if (index == 3)
+        {
+            my_IoTHubClient_LL_SetConnectionStatusCallback_result = IOTHUB_CLIENT_ERROR;
+        }
+        else
+        {
+            my_IoTHubClient_LL_SetConnectionStatusCallback_result = IOTHUB_CLIENT_OK;
+            g_fail_my_gballoc_malloc = false;
+        }
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        char tmp_msg[128];
+        sprintf(tmp_msg, "IoTHubClient_SetConnectionStatusCallback failure in test %zu/%zu", index, count);
+        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetConnectionStatusCallback(iothub_handle, test_connection_status_callback, NULL);
+
+        // assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
+    }
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+    umock_c_negative_tests_deinit();
+}
+
+/* Tests_SRS_IOTHUBCLIENT_25_076: [ If `iotHubClientHandle` is `NULL`, `IoTHubClientCore_SetRetryPolicy` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_client_handle_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_RETRY_POLICY retry_policy = IOTHUB_CLIENT_RETRY_RANDOM;
+    size_t retry_in_seconds = 10;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetRetryPolicy(NULL, retry_policy, retry_in_seconds);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_25_078: [ When `IoTHubClientCore_LL_SetRetryPolicy` is called, `IoTHubClientCore_SetRetryPolicy` shall return the result of `IoTHubClientCore_LL_SetRetryPolicy`. ]*/
+TEST_FUNCTION(IoTHubClientCore_SetRetryPolicy_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_RETRY_POLICY retry_policy = IOTHUB_CLIENT_RETRY_RANDOM;
+    size_t retry_in_seconds = 10;
+
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, retry_policy, retry_in_seconds))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetRetryPolicy(iothub_handle, retry_policy, retry_in_seconds);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_25_092: [ If `iotHubClientHandle` is `NULL`, `IoTHubClientCore_GetRetryPolicy` shall return `IOTHUB_CLIENT_INVALID_ARG`. ]*/
+TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_client_handle_NULL_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
+    size_t retry_in_seconds;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(NULL, &retry_policy, &retry_in_seconds);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_25_094: [ When `IoTHubClientCore_LL_GetRetryPolicy` is called, `IoTHubClientCore_GetRetryPolicy` shall return the result of `IoTHubClientCore_LL_GetRetryPolicy`.]*/
+TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
+    size_t retry_in_seconds;
+
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &retry_policy, &retry_in_seconds));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(iothub_handle, &retry_policy, &retry_in_seconds);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_fail)
+{
+    // arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
+    size_t retry_in_seconds;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &retry_policy, &retry_in_seconds));
+
+    umock_c_negative_tests_snapshot();
+
+    // act
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        char tmp_msg[64];
+        sprintf(tmp_msg, "IoTHubClientCore_CreateFromConnectionString failure in test %zu/%zu", index, count);
+        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(iothub_handle, &retry_policy, &retry_in_seconds);
+
+        // assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_020: [If iotHubClientHandle is NULL, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG.] */
+/* Tests_SRS_IOTHUBCLIENT_01_021: [Otherwise, IoTHubClientCore_GetLastMessageReceiveTime shall return the result of IoTHubClientCore_LL_GetLastMessageReceiveTime.] */
+/* Tests_SRS_IOTHUBCLIENT_01_036: [If acquiring the lock fails, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR.] */
+TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_client_handle_NULL_fail)
+{
+    // arrange
+    time_t recv_time;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(NULL, &recv_time);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/* Tests_SRS_IOTHUBCLIENT_01_019: [IoTHubClientCore_GetLastMessageReceiveTime shall call IoTHubClientCore_LL_GetLastMessageReceiveTime, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameter lastMessageReceiveTime.] */
+/* Tests_SRS_IOTHUBCLIENT_01_035: [IoTHubClientCore_GetLastMessageReceiveTime shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
+TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    time_t recv_time;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &recv_time));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(iothub_handle, &recv_time);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_failed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    time_t recv_time;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &recv_time));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    umock_c_negative_tests_snapshot();
+
+    // act
+    size_t calls_cannot_fail[] = { 2 };
+
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        if (should_skip_index(index, calls_cannot_fail, sizeof(calls_cannot_fail)/sizeof(calls_cannot_fail[0])) != 0)
+        {
+            continue;
+        }
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        char tmp_msg[64];
+        sprintf(tmp_msg, "IoTHubClientCore_GetLastMessageReceiveTime failure in test %zu/%zu", index, count);
+        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(iothub_handle, &recv_time);
+
+        // assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClientCore_SetOption_client_handle_NULL_fail)
+{
+    // arrange
+    const char* option_name = "option_name";
+    const void* option_value = (void*)0x0123;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(NULL, option_name, option_value);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+}
+
+/*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClientCore_SetOption_option_name_NULL_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    const void* option_value = (void*)0x0123;
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, NULL, option_value);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubClientCore_SetOption_option_value_NULL_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    const char* option_name = "option_name";
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClientCore_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
+/* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClientCore_SetOption shall be made thread-safe by using the lock created in IoTHubClientCore_Create. ] */
+TEST_FUNCTION(IoTHubClientCore_SetOption_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    const char* option_name = "option_name";
+    const void* option_value = (void*)0x0123;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetOption(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, option_name, option_value));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, option_value);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+/* Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClientCore_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.]*/
+/* Tests_SRS_IOTHUBCLIENT_01_042: [If acquiring the lock fails, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
+/* Tests_SRS_IOTHUBCLIENT_10_007: [IoTHubClientCore_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL. ]*/
+/* Tests_SRS_IOTHUBCLIENT_10_002: [If acquiring the lock fails, IoTHubClientCore_SetDeviceTwinCallback shall return IOTHUB_CLIENT_ERROR. ]*/
+/* Tests_SRS_IOTHUBCLIENT_10_004: [If starting the thread fails, IoTHubClientCore_SetDeviceTwinCallback shall return IOTHUB_CLIENT_ERROR. ]*/
+TEST_FUNCTION(IoTHubClientCore_SetOption_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    const char* option_name = "option_name";
+    const void* option_value = (void*)0x0123;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetOption(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, option_name, option_value));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument_handle();
+
+    umock_c_negative_tests_snapshot();
+
+    size_t calls_cannot_fail[] = { 2 };
+
+    // act
+    size_t count = umock_c_negative_tests_call_count();
+    for (size_t index = 0; index < count; index++)
+    {
+        if (should_skip_index(index, calls_cannot_fail, sizeof(calls_cannot_fail)/sizeof(calls_cannot_fail[0])) != 0)
+        {
+            continue;
+        }
+
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(index);
+
+        char tmp_msg[64];
+        sprintf(tmp_msg, "IoTHubClientCore_SetOption failure in test %zu/%zu", index, count);
+        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, option_value);
+
+        // assert
+        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
+    }
+
+    // cleanup
+    umock_c_negative_tests_deinit();
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetOption_do_work_freq_ms_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t do_work_freq_ms = 100;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_DO_WORK_FREQUENCY_IN_MS, &do_work_freq_ms);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetOption_do_work_freq_ms_zero_fail)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t do_work_freq_ms = 0;
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_DO_WORK_FREQUENCY_IN_MS, &do_work_freq_ms);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_waits_with_do_work_freq_ms_succeed)
+{
+    // arrange
+    tickcounter_ms_t do_work_freq_ms = 250;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_DO_WORK_FREQUENCY_IN_MS, &do_work_freq_ms);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    umock_c_reset_all_calls();
+    g_how_thread_loops = 1;
+
+    set_expected_calls_first_ScheduleWork_Thread_loop(0);
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetNextDoWorkDelay(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, 250))
+        .SetReturn(250);
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 250));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
+
+    // act
+    g_thread_func(g_thread_func_arg);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_Condition_Init_fails_polls_succeed)
+{
+    // arrange
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, NULL, NULL);
+    umock_c_reset_all_calls();
+    g_how_thread_loops = 1;
+
+    STRICT_EXPECTED_CALL(Condition_Init()).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG)).SetReturn(0);
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
+
+    // act
+    g_thread_func(g_thread_func_arg);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+static void set_expected_calls_create_callback_dispatcher(size_t thread_count)
+{
+    size_t index;
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    for (index = 0; index < 7; index++)
+    {
+        STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+    }
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    for (index = 0; index < thread_count; index++)
+    {
+        STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    }
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetOption_callback_dispatch_threads_succeed)
+{
+    // arrange
+    size_t thread_count = 2;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    set_expected_calls_create_callback_dispatcher(thread_count);
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
+
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
+}
+
+TEST_FUNCTION(IoTHubClientCore_SetOption_callback_dispatch_threads_twice_fail)
+{
+    // arrange
+    size_t thread_count = 1;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(NULL, &retry_policy, &retry_in_seconds);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_25_094: [ When `IoTHubClientCore_LL_GetRetryPolicy` is called, `IoTHubClientCore_GetRetryPolicy` shall return the result of `IoTHubClientCore_LL_GetRetryPolicy`.]*/
-TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_succeed)
+TEST_FUNCTION(IoTHubClientCore_SetOption_callback_dispatch_threads_create_thread_fail)
 {
     // arrange
+    size_t index;
+    size_t thread_count = 1;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
-    size_t retry_in_seconds;
-
-    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &retry_policy, &retry_in_seconds));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    set_expected_calls_create_callback_dispatcher(0);
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    for (index = 0; index < 7; index++)
+    {
+        STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    }
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(iothub_handle, &retry_policy, &retry_in_seconds);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_GetRetryPolicy_fail)
+TEST_FUNCTION(IoTHubClientCore_SetOption_event_ingestion_queue_size_succeed)
 {
     // arrange
-    int negativeTestsInitResult = umock_c_negative_tests_init();
-    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
-
+    size_t queue_size = 16;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    IOTHUB_CLIENT_RETRY_POLICY retry_policy;
-    size_t retry_in_seconds;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetRetryPolicy(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &retry_policy, &retry_in_seconds));
-
-    umock_c_negative_tests_snapshot();
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_create(queue_size));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    size_t count = umock_c_negative_tests_call_count();
-    for (size_t index = 0; index < count; index++)
-    {
-        umock_c_negative_tests_reset();
-        umock_c_negative_tests_fail_call(index);
-
-        char tmp_msg[64];
-        sprintf(tmp_msg, "IoTHubClientCore_CreateFromConnectionString failure in test %zu/%zu", index, count);
-        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetRetryPolicy(iothub_handle, &retry_policy, &retry_in_seconds);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
 
-        // assert
-        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
-    umock_c_negative_tests_deinit();
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_020: [If iotHubClientHandle is NULL, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_INVALID_ARG.] */
-/* Tests_SRS_IOTHUBCLIENT_01_021: [Otherwise, IoTHubClientCore_GetLastMessageReceiveTime shall return the result of IoTHubClientCore_LL_GetLastMessageReceiveTime.] */
-/* Tests_SRS_IOTHUBCLIENT_01_036: [If acquiring the lock fails, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR.] */
-TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_client_handle_NULL_fail)
+TEST_FUNCTION(IoTHubClientCore_SetOption_event_ingestion_queue_size_twice_fail)
 {
     // arrange
-    time_t recv_time;
+    size_t queue_size = 16;
+    IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(NULL, &recv_time);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
+    IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_01_019: [IoTHubClientCore_GetLastMessageReceiveTime shall call IoTHubClientCore_LL_GetLastMessageReceiveTime, while passing the IoTHubClient_LL handle created by IoTHubClientCore_Create and the parameter lastMessageReceiveTime.] */
-/* Tests_SRS_IOTHUBCLIENT_01_035: [IoTHubClientCore_GetLastMessageReceiveTime shall be made thread-safe by using the lock created in IoTHubClientCore_Create.] */
-TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_succeed)
+TEST_FUNCTION(IoTHubClientCore_SetOption_event_ingestion_queue_size_create_fail)
 {
     // arrange
+    size_t queue_size = 16;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    time_t recv_time;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &recv_time));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ingestion_queue_create(queue_size))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(iothub_handle, &recv_time);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_EVENT_INGESTION_QUEUE_SIZE, &queue_size);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-TEST_FUNCTION(IoTHubClientCore_GetLastMessageReceiveTime_failed)
+TEST_FUNCTION(IoTHubClientCore_SetOption_callback_dispatch_queue_size_zero_fail)
 {
     // arrange
+    size_t queue_size = 0;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
 
-    int negativeTestsInitResult = umock_c_negative_tests_init();
-    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
-
-    time_t recv_time;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_GetLastMessageReceiveTime(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &recv_time));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-
-    umock_c_negative_tests_snapshot();
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    size_t calls_cannot_fail[] = { 2 };
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_QUEUE_SIZE, &queue_size);
 
-    size_t count = umock_c_negative_tests_call_count();
-    for (size_t index = 0; index < count; index++)
-    {
-        if (should_skip_index(index, calls_cannot_fail, sizeof(calls_cannot_fail)/sizeof(calls_cannot_fail[0])) != 0)
-        {
-            continue;
-        }
-
-        umock_c_negative_tests_reset();
-        umock_c_negative_tests_fail_call(index);
-
-        char tmp_msg[64];
-        sprintf(tmp_msg, "IoTHubClientCore_GetLastMessageReceiveTime failure in test %zu/%zu", index, count);
-        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetLastMessageReceiveTime(iothub_handle, &recv_time);
-
-        // assert
-        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
-    umock_c_negative_tests_deinit();
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_02_034: [If parameter iotHubClientHandle is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClientCore_SetOption_client_handle_NULL_fail)
+TEST_FUNCTION(IoTHubClientCore_GetCallbackDispatchStatistics_handle_NULL_fail)
 {
     // arrange
-    const char* option_name = "option_name";
-    const void* option_value = (void*)0x0123;
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(NULL, option_name, option_value);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetCallbackDispatchStatistics(NULL, &statistics);
 
     // assert
     ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-
-    // cleanup
 }
 
-/*Tests_SRS_IOTHUBCLIENT_02_035: [If parameter optionName is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClientCore_SetOption_option_name_NULL_fail)
+TEST_FUNCTION(IoTHubClientCore_GetCallbackDispatchStatistics_no_dispatcher_succeed)
 {
     // arrange
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
     umock_c_reset_all_calls();
+    (void)memset(&statistics, 0xFF, sizeof(statistics));
 
-    const void* option_value = (void*)0x0123;
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, NULL, option_value);
+    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_GetCallbackDispatchStatistics(iothub_handle, &statistics);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.queueDepth);
+    ASSERT_ARE_EQUAL(uint64_t, 0, statistics.dispatchedCount);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/*Tests_SRS_IOTHUBCLIENT_02_036: [If parameter value is NULL then IoTHubClientCore_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.] */
-TEST_FUNCTION(IoTHubClientCore_SetOption_option_value_NULL_fail)
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_hands_callbacks_to_dispatcher_succeed)
 {
     // arrange
+    size_t thread_count = 1;
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, g_userContextCallback);
     umock_c_reset_all_calls();
+    g_how_thread_loops = 1;
 
-    const char* option_name = "option_name";
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(VECTOR_front(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    set_expected_calls_final_ScheduleWork_Thread_loop();
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, NULL);
+    g_thread_func(g_thread_func_arg);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_GetCallbackDispatchStatistics(iothub_handle, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.queueDepth);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.maxQueueDepth);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.heldBackCount);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClientCore_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.] */
-/* Tests_SRS_IOTHUBCLIENT_01_041: [ IoTHubClientCore_SetOption shall be made thread-safe by using the lock created in IoTHubClientCore_Create. ] */
-TEST_FUNCTION(IoTHubClientCore_SetOption_succeed)
+TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_dispatcher_queue_full_holds_back_callbacks)
 {
     // arrange
+    size_t thread_count = 1;
+    size_t queue_size = 1;
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
-    umock_c_reset_all_calls();
-
-    const char* option_name = "option_name";
-    const void* option_value = (void*)0x0123;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetOption(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, option_name, option_value));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_QUEUE_SIZE, &queue_size);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, g_userContextCallback);
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, g_userContextCallback);
+    g_how_thread_loops = 1;
 
     // act
-    IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, option_value);
+    g_thread_func(g_thread_func_arg);
 
     // assert
-    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_GetCallbackDispatchStatistics(iothub_handle, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.queueDepth);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.heldBackCount);
 
     // cleanup
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
-/* Tests_SRS_IOTHUBCLIENT_02_038: [If optionName doesn't match one of the options handled by this module then IoTHubClientCore_SetOption shall call IoTHubClientCore_LL_SetOption passing the same parameters and return what IoTHubClientCore_LL_SetOption returns.]*/
-/* Tests_SRS_IOTHUBCLIENT_01_042: [If acquiring the lock fails, IoTHubClientCore_GetLastMessageReceiveTime shall return IOTHUB_CLIENT_ERROR. ]*/
-/* Tests_SRS_IOTHUBCLIENT_10_007: [IoTHubClientCore_SetDeviceTwinCallback shall fail and return IOTHUB_CLIENT_INVALID_ARG if parameter iotHubClientHandle is NULL. ]*/
-/* Tests_SRS_IOTHUBCLIENT_10_002: [If acquiring the lock fails, IoTHubClientCore_SetDeviceTwinCallback shall return IOTHUB_CLIENT_ERROR. ]*/
-/* Tests_SRS_IOTHUBCLIENT_10_004: [If starting the thread fails, IoTHubClientCore_SetDeviceTwinCallback shall return IOTHUB_CLIENT_ERROR. ]*/
-TEST_FUNCTION(IoTHubClientCore_SetOption_fail)
+TEST_FUNCTION(IoTHubClient_callback_dispatch_thread_runs_callbacks_succeed)
 {
     // arrange
+    size_t index;
+    size_t thread_count = 1;
+    THREAD_START_FUNC dispatch_thread_func;
+    void* dispatch_thread_arg;
+    IOTHUB_CLIENT_CALLBACK_DISPATCH_STATISTICS statistics;
     IOTHUB_CLIENT_CORE_HANDLE iothub_handle = IoTHubClientCore_Create(TEST_CLIENT_CONFIG);
+    (void)IoTHubClientCore_SetOption(iothub_handle, OPTION_CALLBACK_DISPATCH_THREADS, &thread_count);
+    dispatch_thread_func = g_thread_func;
+    dispatch_thread_arg = g_thread_func_arg;
+    (void)IoTHubClientCore_SendEventAsync(iothub_handle, TEST_MESSAGE_HANDLE, test_event_confirmation_callback, NULL);
+    g_eventConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_OK, g_userContextCallback);
+    g_how_thread_loops = 1;
+    g_thread_func(g_thread_func_arg);
+    g_dispatcher_thread_arg = dispatch_thread_arg;
     umock_c_reset_all_calls();
 
-    int negativeTestsInitResult = umock_c_negative_tests_init();
-    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
-
-    const char* option_name = "option_name";
-    const void* option_value = (void*)0x0123;
-
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SetOption(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, option_name, option_value));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
-        .IgnoreArgument_handle();
-
-    umock_c_negative_tests_snapshot();
-
-    size_t calls_cannot_fail[] = { 2 };
-
-    // act
-    size_t count = umock_c_negative_tests_call_count();
-    for (size_t index = 0; index < count; index++)
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(test_event_confirmation_callback(IOTHUB_CLIENT_CONFIRMATION_OK, NULL));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    for (index = 0; index < 7; index++)
     {
-        if (should_skip_index(index, calls_cannot_fail, sizeof(calls_cannot_fail)/sizeof(calls_cannot_fail[0])) != 0)
-        {
-            continue;
-        }
-
-        umock_c_negative_tests_reset();
-        umock_c_negative_tests_fail_call(index);
+        STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    }
+    STRICT_EXPECTED_CALL(Condition_Wait(TEST_COND_HANDLE, IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
 
-        char tmp_msg[64];
-        sprintf(tmp_msg, "IoTHubClientCore_SetOption failure in test %zu/%zu", index, count);
-        IOTHUB_CLIENT_RESULT result = IoTHubClientCore_SetOption(iothub_handle, option_name, option_value);
+    // act
+    dispatch_thread_func(dispatch_thread_arg);
 
-        // assert
-        ASSERT_ARE_NOT_EQUAL_WITH_MSG(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result, tmp_msg);
-    }
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    g_dispatcher_thread_arg = NULL;
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubClientCore_GetCallbackDispatchStatistics(iothub_handle, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.queueDepth);
+    ASSERT_ARE_EQUAL(uint64_t, 1, statistics.dispatchedCount);
 
     // cleanup
-    umock_c_negative_tests_deinit();
     IoTHubClientCore_Destroy(iothub_handle);
 }
 
@@ -2976,15 +3891,13 @@ TEST_FUNCTION(IoTHubClient_ScheduleWork_Thread_method_callback_VECTOR_move_FAILS
     umock_c_reset_all_calls();
     g_how_thread_loops = 1;
 
+    STRICT_EXPECTED_CALL(Condition_Init());
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(IoTHubClientCore_LL_DoWork(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
     STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_SLL_HANDLE));
     STRICT_EXPECTED_CALL(VECTOR_move(IGNORED_PTR_ARG)).SetReturn(NULL);
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
-    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(ThreadAPI_Exit(0));
+    set_expected_calls_final_ScheduleWork_Thread_loop();
 
     // act
     g_thread_func(g_thread_func_arg);
@@ -27,10 +27,11 @@ static void my_gballoc_free(void* ptr)
     free(ptr);
 }
 
+#include "real_constbuffer.h"
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/optimize_size.h"
-#include "azure_c_shared_utility/buffer_.h"
+#include "azure_c_shared_utility/constbuffer.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/map.h"
@@ -38,25 +39,9 @@ static void my_gballoc_free(void* ptr)
 #undef ENABLE_MOCKS
 
 #include "iothub_message.h"
+#include "internal/iothub_message_private.h"
 #include "real_strings.h"
 
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-    extern BUFFER_HANDLE real_BUFFER_new(void);
-    extern void real_BUFFER_delete(BUFFER_HANDLE handle);
-    extern unsigned char* real_BUFFER_u_char(BUFFER_HANDLE handle);
-    extern size_t real_BUFFER_length(BUFFER_HANDLE handle);
-    extern int real_BUFFER_build(BUFFER_HANDLE handle, const unsigned char* source, size_t size);
-    extern int real_BUFFER_append_build(BUFFER_HANDLE handle, const unsigned char* source, size_t size);
-    extern BUFFER_HANDLE real_BUFFER_clone(BUFFER_HANDLE handle);
-    extern BUFFER_HANDLE real_BUFFER_create(const unsigned char* source, size_t size);
-
-#ifdef __cplusplus
-}
-#endif
-
 #define NUMBER_OF_CHAR      8
 
 static MAP_FILTER_CALLBACK g_mapFilterFunc;
@@ -74,6 +59,13 @@ static const char* TEST_CONTENT_ENCODING = "utf8";
 
 static const char* TEST_PROPERTY_KEY = "property_key";
 static const char* TEST_PROPERTY_VALUE = "property_value";
+static const char* TEST_PROPERTY_VALUE2 = "other_value";
+
+static const char* const TEST_MAP_KEY_ARRAY[] = { "map_key" };
+static const char* const TEST_MAP_VALUE_ARRAY[] = { "map_value" };
+static const char* const* TEST_MAP_KEYS = TEST_MAP_KEY_ARRAY;
+static const char* const* TEST_MAP_VALUES = TEST_MAP_VALUE_ARRAY;
+static size_t TEST_MAP_COUNT = 1;
 
 static IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA TEST_DIAGNOSTIC_DATA = { "12345678",  "1506054179"};
 static IOTHUB_MESSAGE_DIAGNOSTIC_PROPERTY_DATA TEST_DIAGNOSTIC_DATA2 = { "87654321", "1506054179.100" };
@@ -99,12 +91,6 @@ static MAP_HANDLE my_Map_Create(MAP_FILTER_CALLBACK mapFilterFunc)
     return (MAP_HANDLE)my_gballoc_malloc(1);
 }
 
-static MAP_HANDLE my_Map_Clone(MAP_HANDLE handle)
-{
-    (void)handle;
-    return (MAP_HANDLE)my_gballoc_malloc(1);
-}
-
 static void my_Map_Destroy(MAP_HANDLE handle)
 {
     my_gballoc_free(handle);
@@ -139,6 +125,7 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_UMOCK_ALIAS_TYPE(MAP_FILTER_CALLBACK, void*);
     REGISTER_UMOCK_ALIAS_TYPE(BUFFER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(CONSTBUFFER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(MAP_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(MAP_RESULT, int);
@@ -147,28 +134,25 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
 
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_new, real_BUFFER_new);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_new, NULL);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_create, real_BUFFER_create);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_create, NULL);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_delete, real_BUFFER_delete);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_build, real_BUFFER_build);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_build, __LINE__);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_u_char, real_BUFFER_u_char);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, real_BUFFER_length);
-    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_clone, real_BUFFER_clone);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_clone, NULL);
-
     REGISTER_STRING_GLOBAL_MOCK_HOOK;
 
+    REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_Create, real_CONSTBUFFER_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(CONSTBUFFER_Create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_Clone, real_CONSTBUFFER_Clone);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(CONSTBUFFER_Clone, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_GetContent, (const CONSTBUFFER* (*) (CONSTBUFFER_HANDLE constbufferHandle)) real_CONSTBUFFER_GetContent);
+    REGISTER_GLOBAL_MOCK_HOOK(CONSTBUFFER_Destroy, real_CONSTBUFFER_Destroy);
+
     REGISTER_GLOBAL_MOCK_HOOK(Map_Create, my_Map_Create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_Create, NULL);
-    REGISTER_GLOBAL_MOCK_HOOK(Map_Clone, my_Map_Clone);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_Clone, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(Map_Destroy, my_Map_Destroy);
     REGISTER_GLOBAL_MOCK_RETURN(Map_AddOrUpdate, MAP_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_AddOrUpdate, MAP_ERROR);
     REGISTER_GLOBAL_MOCK_RETURN(Map_ContainsKey, MAP_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_Add, MAP_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_Add, MAP_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(Map_GetInternals, MAP_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_GetInternals, MAP_ERROR);
 
     REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, my_mallocAndStrcpy_s);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __FAILURE__);
@@ -217,8 +201,8 @@ static int should_skip_index(size_t current_index, const size_t skip_array[], si
     return result;
 }
 
-/*Tests_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call BUFFER_create passing byteArray and size as parameters.]*/
-/*Tests_SRS_IOTHUBMESSAGE_02_023: [IoTHubMessage_CreateFromByteArray shall call Map_Create to create the message properties.]*/
+/*Tests_SRS_IOTHUBMESSAGE_02_022: [IoTHubMessage_CreateFromByteArray shall call CONSTBUFFER_Create passing byteArray and size as parameters.]*/
+/*Tests_SRS_IOTHUBMESSAGE_02_023: [IoTHubMessage_CreateFromByteArray shall create an empty property store for the message properties, without creating a map.]*/
 /*Tests_SRS_IOTHUBMESSAGE_02_025: [Otherwise, IoTHubMessage_CreateFromByteArray shall return a non-NULL handle.] */
 /*Tests_SRS_IOTHUBMESSAGE_02_026: [The type of the new message shall be IOTHUBMESSAGE_BYTEARRAY.] */
 /*Tests_SRS_IOTHUBMESSAGE_02_009: [Otherwise IoTHubMessage_GetContentType shall return the type of the message.] */
@@ -226,8 +210,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_happy_path)
 {
     // arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_create(c, 1));
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     //act
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
@@ -261,8 +245,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_succeeds_when_size_0_and_buffer_
 {
     // arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     //act
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(NULL, 0);
@@ -280,8 +264,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_succeeds_when_size_0_and_buffer_
 {
     //arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_create(IGNORED_PTR_ARG, 0)).IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     //act
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 0);
@@ -302,8 +286,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_fails)
 
     // arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_create(c, 1));
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     umock_c_negative_tests_snapshot();
 
@@ -327,8 +311,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromByteArray_fails)
     umock_c_negative_tests_deinit();
 }
 
-/*Tests_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call STRING_construct passing source as parameter.] */
-/*Tests_SRS_IOTHUBMESSAGE_02_028: [IoTHubMessage_CreateFromString shall call Map_Create to create the message properties.] */
+/*Tests_SRS_IOTHUBMESSAGE_02_027: [IoTHubMessage_CreateFromString shall call CONSTBUFFER_Create passing source and its length including the null terminator as parameters.] */
+/*Tests_SRS_IOTHUBMESSAGE_02_028: [IoTHubMessage_CreateFromString shall create an empty property store for the message properties, without creating a map.] */
 /*Tests_SRS_IOTHUBMESSAGE_02_031: [Otherwise, IoTHubMessage_CreateFromString shall return a non-NULL handle.] */
 /*Tests_SRS_IOTHUBMESSAGE_02_032: [The type of the new message shall be IOTHUBMESSAGE_STRING.] */
 /*Tests_SRS_IOTHUBMESSAGE_02_009: [Otherwise IoTHubMessage_GetContentType shall return the type of the message.] */
@@ -336,8 +320,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromString_happy_path)
 {
     //arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(STRING_construct("a"));
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 2));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     //act
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString("a");
@@ -374,8 +358,8 @@ TEST_FUNCTION(IoTHubMessage_CreateFromString_fails)
 
     // arrange
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(STRING_construct("a"));
-    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(IGNORED_PTR_ARG, 2));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     umock_c_negative_tests_snapshot();
 
@@ -403,6 +387,7 @@ TEST_FUNCTION(IoTHubMessage_Map_Filter_validate_Ascii_char_SUCCEED)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_Properties(h);
     umock_c_reset_all_calls();
 
     //act
@@ -420,6 +405,7 @@ TEST_FUNCTION(IoTHubMessage_Map_Filter_invalidate_Ascii_key_fail)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_Properties(h);
     umock_c_reset_all_calls();
 
     //act
@@ -437,6 +423,7 @@ TEST_FUNCTION(IoTHubMessage_Map_Filter_invalidate_Ascii_value_fail)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_Properties(h);
     umock_c_reset_all_calls();
 
     //act
@@ -471,8 +458,8 @@ TEST_FUNCTION(IoTHubMessage_Destroy_destroys_a_BYTEARRAY_IoTHubMEssage)
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
@@ -496,8 +483,8 @@ TEST_FUNCTION(IoTHubMessage_Destroy_destroys_a_STRING_IoTHubMessage)
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
@@ -514,8 +501,8 @@ TEST_FUNCTION(IoTHubMessage_Destroy_destroys_a_STRING_IoTHubMessage)
     //cleanup
 }
 
-/*Tests_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using BUFFER_u_char and it shall be copied in the buffer argument.]*/
-/*Tests_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using BUFFER_length and it shall be copied to the size argument.]*/
+/*Tests_SRS_IOTHUBMESSAGE_01_011: [The pointer shall be obtained by using CONSTBUFFER_GetContent and it shall be copied in the buffer argument.]*/
+/*Tests_SRS_IOTHUBMESSAGE_01_012: [The size of the associated data shall be obtained by using CONSTBUFFER_GetContent and it shall be copied to the size argument.]*/
 /*Tests_SRS_IOTHUBMESSAGE_02_033: [IoTHubMessage_GetByteArray shall return IOTHUBMESSAGE_OK when all oeprations complete succesfully.] */
 TEST_FUNCTION(IoTHubMessage_GetByteArray_happy_path)
 {
@@ -525,8 +512,7 @@ TEST_FUNCTION(IoTHubMessage_GetByteArray_happy_path)
     size_t size;
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(BUFFER_u_char(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_length(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
 
     //act
     IOTHUB_MESSAGE_RESULT r = IoTHubMessage_GetByteArray(h, &byteArray, &size);
@@ -598,8 +584,8 @@ TEST_FUNCTION(IoTHubMessage_GetByteArray_with_STRING_fails)
 }
 
 /*Tests_SRS_IOTHUBMESSAGE_03_001: [IoTHubMessage_Clone shall create a new IoT hub message with data content identical to that of the iotHubMessageHandle parameter.]*/
-/*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
-/*Tests_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
+/*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall share the content with iotHubMessageHandle by a call to CONSTBUFFER_Clone.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_001: [Otherwise IoTHubMessage_Clone shall share the properties with iotHubMessageHandle until either message modifies them.] */
 /*Tests_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
 TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_happy_path)
 {
@@ -608,8 +594,7 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_happy_path)
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
 
     //act
     IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
@@ -649,8 +634,7 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_fails)
     ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(BUFFER_clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
 
     umock_c_negative_tests_snapshot();
 
@@ -676,8 +660,8 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_BYTE_ARRAY_fails)
 }
 
 /*Tests_SRS_IOTHUBMESSAGE_03_001: [IoTHubMessage_Clone shall create a new IoT hub message with data content identical to that of the iotHubMessageHandle parameter.]*/
-/*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall clone the content by a call to BUFFER_clone or STRING_clone] */
-/*Tests_SRS_IOTHUBMESSAGE_02_005: [IoTHubMessage_Clone shall clone the properties map by using Map_Clone.] */
+/*Tests_SRS_IOTHUBMESSAGE_02_006: [IoTHubMessage_Clone shall share the content with iotHubMessageHandle by a call to CONSTBUFFER_Clone.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_001: [Otherwise IoTHubMessage_Clone shall share the properties with iotHubMessageHandle until either message modifies them.] */
 /*Tests_SRS_IOTHUBMESSAGE_03_002: [IoTHubMessage_Clone shall return upon success a non-NULL handle to the newly created IoT hub message.]*/
 TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_happy_path)
 {
@@ -686,8 +670,7 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_happy_path)
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
 
     ///act
     IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
@@ -712,8 +695,7 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_fails)
     ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
 
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(Map_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
 
     umock_c_negative_tests_snapshot();
 
@@ -738,13 +720,183 @@ TEST_FUNCTION(IoTHubMessage_Clone_with_STRING_fails)
     umock_c_negative_tests_deinit();
 }
 
+TEST_FUNCTION(IoTHubMessage_Clone_shares_the_content)
+{
+    //arrange
+    const unsigned char* source_bytes;
+    const unsigned char* clone_bytes;
+    size_t source_size;
+    size_t clone_size;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    //act
+    (void)IoTHubMessage_GetByteArray(h, &source_bytes, &source_size);
+    (void)IoTHubMessage_GetByteArray(r, &clone_bytes, &clone_size);
+
+    //assert
+    ASSERT_ARE_EQUAL(void_ptr, (void*)source_bytes, (void*)clone_bytes);
+    ASSERT_ARE_EQUAL(size_t, source_size, clone_size);
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_02_005: [If the properties map of iotHubMessageHandle has been returned by IoTHubMessage_Properties, IoTHubMessage_Clone shall copy the properties out of it into a property store of its own.] */
+TEST_FUNCTION(IoTHubMessage_Clone_after_Properties_copies_the_map)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_keys(&TEST_MAP_KEYS, sizeof(TEST_MAP_KEYS))
+        .CopyOutArgumentBuffer_values(&TEST_MAP_VALUES, sizeof(TEST_MAP_VALUES))
+        .CopyOutArgumentBuffer_count(&TEST_MAP_COUNT, sizeof(TEST_MAP_COUNT));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NOT_NULL(r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_MAP_VALUES[0], IoTHubMessage_GetProperty(r, TEST_MAP_KEYS[0]));
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_03_004: [IoTHubMessage_Clone shall return NULL if it fails for any reason.]*/
+TEST_FUNCTION(IoTHubMessage_Clone_after_Properties_fails_when_Map_GetInternals_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Clone(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(MAP_ERROR);
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NULL(r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_01_003: [IoTHubMessage_Destroy shall free all resources associated with iotHubMessageHandle.]  */
+TEST_FUNCTION(IoTHubMessage_Destroy_of_a_clone_keeps_the_shared_properties)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    IOTHUB_MESSAGE_HANDLE r;
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(r));
+
+    //act
+    IoTHubMessage_Destroy(r);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_002: [If the properties are shared with a clone, IoTHubMessage_Properties shall first make a private copy of them.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_005: [The first time it is called, IoTHubMessage_Properties shall create a map with Map_Create and move the properties into it with Map_Add; from then on the map holds the message properties.] */
+TEST_FUNCTION(IoTHubMessage_Properties_of_a_clone_copies_the_shared_properties)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    IOTHUB_MESSAGE_HANDLE r;
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_Add(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    MAP_HANDLE clone_map = IoTHubMessage_Properties(r);
+
+    //assert
+    ASSERT_IS_NOT_NULL(clone_map);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(void_ptr, IoTHubMessage_Properties(h), clone_map);
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_003: [If making the private copy fails, IoTHubMessage_Properties shall return NULL.] */
+TEST_FUNCTION(IoTHubMessage_Properties_of_a_clone_fails_when_the_copy_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    //act
+    MAP_HANDLE clone_map = IoTHubMessage_Properties(r);
+
+    //assert
+    ASSERT_IS_NULL(clone_map);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
 /*Tests_SRS_IOTHUBMESSAGE_02_002: [Otherwise, for any non-NULL iotHubMessageHandle it shall return a non-NULL MAP_HANDLE.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_005: [The first time it is called, IoTHubMessage_Properties shall create a map with Map_Create and move the properties into it with Map_Add; from then on the map holds the message properties.] */
 TEST_FUNCTION(IoTHubMessage_Properties_happy_path)
 {
     ///arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
     umock_c_reset_all_calls();
 
+    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+
     //act
     MAP_HANDLE r = IoTHubMessage_Properties(h);
 
@@ -756,6 +908,71 @@ TEST_FUNCTION(IoTHubMessage_Properties_happy_path)
     IoTHubMessage_Destroy(h);
 }
 
+/*Tests_SRS_IOTHUBMESSAGE_31_005: [The first time it is called, IoTHubMessage_Properties shall create a map with Map_Create and move the properties into it with Map_Add; from then on the map holds the message properties.] */
+TEST_FUNCTION(IoTHubMessage_Properties_twice_returns_the_same_map)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    MAP_HANDLE first = IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    //act
+    MAP_HANDLE second = IoTHubMessage_Properties(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(void_ptr, first, second);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_006: [If creating or filling the map fails, IoTHubMessage_Properties shall return NULL and leave the properties unchanged.] */
+TEST_FUNCTION(IoTHubMessage_Properties_fails_when_Map_Create_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG))
+        .SetReturn(NULL);
+
+    //act
+    MAP_HANDLE r = IoTHubMessage_Properties(h);
+
+    //assert
+    ASSERT_IS_NULL(r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_006: [If creating or filling the map fails, IoTHubMessage_Properties shall return NULL and leave the properties unchanged.] */
+TEST_FUNCTION(IoTHubMessage_Properties_fails_when_Map_Add_fails)
+{
+    ///arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Map_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Map_Add(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE))
+        .SetReturn(MAP_ERROR);
+    STRICT_EXPECTED_CALL(Map_Destroy(IGNORED_PTR_ARG));
+
+    //act
+    MAP_HANDLE r = IoTHubMessage_Properties(h);
+
+    //assert
+    ASSERT_IS_NULL(r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
 /*Tests_SRS_IOTHUBMESSAGE_02_001: [If iotHubMessageHandle is NULL then IoTHubMessage_Properties shall return NULL.] */
 TEST_FUNCTION(IoTHubMessage_Properties_with_NULL_handle_retuns_NULL)
 {
@@ -808,7 +1025,7 @@ TEST_FUNCTION(IoTHubMessage_GetString_happy_path)
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromString(TEST_STRING_VALUE);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_GetContent(IGNORED_PTR_ARG));
 
     //act
     const char* r = IoTHubMessage_GetString(h);
@@ -1642,108 +1859,270 @@ TEST_FUNCTION(IoTHubMessage_SetProperty_value_NULL_Fail)
     IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_SetProperty_Fail)
+/*Tests_SRS_IOTHUBMESSAGE_31_007: [If key or value contains a character outside of Ascii value 32 - 126, IoTHubMessage_SetProperty shall return IOTHUB_MESSAGE_ERROR. The check shall be done once, a machine word at a time.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_invalid_Ascii_key_Fail)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Map_AddOrUpdate(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG)).SetReturn(MAP_ERROR);
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_INVALID_MAP_KEY, TEST_PROPERTY_VALUE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(IoTHubMessage_GetProperty(h, TEST_INVALID_MAP_KEY));
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_007: [If key or value contains a character outside of Ascii value 32 - 126, IoTHubMessage_SetProperty shall return IOTHUB_MESSAGE_ERROR. The check shall be done once, a machine word at a time.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_invalid_Ascii_value_Fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
 
     //act
-    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_INVALID_MAP_VALUE);
 
     //assert
-    ASSERT_ARE_NOT_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_ERROR, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     //cleanup
     IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_SetProperty_Succeed)
+/*Tests_SRS_IOTHUBMESSAGE_31_010: [If storing the property fails, IoTHubMessage_SetProperty shall return IOTHUB_MESSAGE_ERROR and leave the properties unchanged.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_Fail)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(Map_AddOrUpdate(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
 
     //act
     IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
 
     //assert
-    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_NOT_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
 
     //cleanup
     IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_GetProperty_handle_NULL_Fail)
+/*Tests_SRS_IOTHUBMESSAGE_31_009: [Otherwise IoTHubMessage_SetProperty shall copy key and value in the property store, replacing the value if key is already there.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_Succeed)
 {
     //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
 
     //act
-    const char* result = IoTHubMessage_GetProperty(NULL, TEST_PROPERTY_KEY);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
 
     //assert
-    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
 
     //cleanup
+    IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_GetProperty_key_NULL_Fail)
+/*Tests_SRS_IOTHUBMESSAGE_31_009: [Otherwise IoTHubMessage_SetProperty shall copy key and value in the property store, replacing the value if key is already there.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_replaces_the_value_without_allocating)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    (void)IoTHubMessage_SetProperty(h, TEST_VALID_MAP_KEY, TEST_VALID_MAP_VALUE);
     umock_c_reset_all_calls();
 
     //act
-    const char* result = IoTHubMessage_GetProperty(h, NULL);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE2);
 
     //assert
-    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE2, IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_VALID_MAP_VALUE, IoTHubMessage_GetProperty(h, TEST_VALID_MAP_KEY));
 
     //cleanup
     IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_GetProperty_Succeed)
+/*Tests_SRS_IOTHUBMESSAGE_31_009: [Otherwise IoTHubMessage_SetProperty shall copy key and value in the property store, replacing the value if key is already there.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_keeps_all_the_properties_when_growing)
 {
     //arrange
+    char keys[40][16];
+    char values[40][32];
+    size_t index;
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
     umock_c_reset_all_calls();
 
-    bool key_exist = true;
-    STRICT_EXPECTED_CALL(Map_ContainsKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, IGNORED_PTR_ARG)).CopyOutArgumentBuffer_keyExists(&key_exist, sizeof(bool));
-    STRICT_EXPECTED_CALL(Map_GetValueFromKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY)).SetReturn(TEST_PROPERTY_VALUE);
-
     //act
-    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
+    for (index = 0; index < 40; index++)
+    {
+        (void)sprintf(keys[index], "key%lu", (unsigned long)index);
+        (void)sprintf(values[index], "value_of_key%lu", (unsigned long)index);
+        ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, IoTHubMessage_SetProperty(h, keys[index], values[index]));
+    }
 
     //assert
-    ASSERT_IS_NOT_NULL(result);
-    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, result);
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    for (index = 0; index < 40; index++)
+    {
+        ASSERT_ARE_EQUAL(char_ptr, values[index], IoTHubMessage_GetProperty(h, keys[index]));
+    }
 
     //cleanup
     IoTHubMessage_Destroy(h);
 }
 
-TEST_FUNCTION(IoTHubMessage_GetProperty_Fail)
+/*Tests_SRS_IOTHUBMESSAGE_31_008: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_SetProperty shall call Map_AddOrUpdate on it.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_after_Properties_Succeed)
 {
     //arrange
     IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
     umock_c_reset_all_calls();
 
-    bool key_exist = false;
-    STRICT_EXPECTED_CALL(Map_ContainsKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, IGNORED_PTR_ARG)).CopyOutArgumentBuffer_keyExists(&key_exist, sizeof(bool));
+    STRICT_EXPECTED_CALL(Map_AddOrUpdate(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE));
 
     //act
-    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_008: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_SetProperty shall call Map_AddOrUpdate on it.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_after_Properties_Fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Map_AddOrUpdate(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE)).SetReturn(MAP_ERROR);
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_004: [If the properties are shared with a clone, IoTHubMessage_SetProperty shall first make a private copy of them.] */
+TEST_FUNCTION(IoTHubMessage_SetProperty_on_a_clone_copies_the_shared_properties_once)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    IOTHUB_MESSAGE_HANDLE r;
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_MESSAGE_RESULT result1 = IoTHubMessage_SetProperty(r, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE2);
+    IOTHUB_MESSAGE_RESULT result2 = IoTHubMessage_SetProperty(r, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE2);
+    IOTHUB_MESSAGE_RESULT result3 = IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY));
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE2, IoTHubMessage_GetProperty(r, TEST_PROPERTY_KEY));
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubMessage_GetProperty_handle_NULL_Fail)
+{
+    //arrange
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(NULL, TEST_PROPERTY_KEY);
+
+    //assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+TEST_FUNCTION(IoTHubMessage_GetProperty_key_NULL_Fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(h, NULL);
+
+    //assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_011: [IoTHubMessage_GetProperty shall return the value of key in the property store, or NULL if there is none.] */
+TEST_FUNCTION(IoTHubMessage_GetProperty_Succeed)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
+
+    //assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_011: [IoTHubMessage_GetProperty shall return the value of key in the property store, or NULL if there is none.] */
+TEST_FUNCTION(IoTHubMessage_GetProperty_Fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_SetProperty(h, TEST_VALID_MAP_KEY, TEST_VALID_MAP_VALUE);
+    umock_c_reset_all_calls();
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
 
     //assert
     ASSERT_IS_NULL(result);
@@ -1753,4 +2132,427 @@ TEST_FUNCTION(IoTHubMessage_GetProperty_Fail)
     IoTHubMessage_Destroy(h);
 }
 
+TEST_FUNCTION(IoTHubMessage_GetProperty_after_Properties_Succeed)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    bool key_exist = true;
+    STRICT_EXPECTED_CALL(Map_ContainsKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, IGNORED_PTR_ARG)).CopyOutArgumentBuffer_keyExists(&key_exist, sizeof(bool));
+    STRICT_EXPECTED_CALL(Map_GetValueFromKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY)).SetReturn(TEST_PROPERTY_VALUE);
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
+
+    //assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+TEST_FUNCTION(IoTHubMessage_GetProperty_after_Properties_Fail)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    bool key_exist = false;
+    STRICT_EXPECTED_CALL(Map_ContainsKey(IGNORED_PTR_ARG, TEST_PROPERTY_KEY, IGNORED_PTR_ARG)).CopyOutArgumentBuffer_keyExists(&key_exist, sizeof(bool));
+
+    //act
+    const char* result = IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY);
+
+    //assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_012: [If iotHubMessageHandle, keys, values or count is NULL, IoTHubMessage_GetProperties shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_GetProperties_handle_NULL_Fail)
+{
+    //arrange
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_GetProperties(NULL, &keys, &values, &count, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_012: [If iotHubMessageHandle, keys, values or count is NULL, IoTHubMessage_GetProperties shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_GetProperties_NULL_args_Fail)
+{
+    //arrange
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT result1 = IoTHubMessage_GetProperties(h, NULL, &values, &count, NULL);
+    IOTHUB_MESSAGE_RESULT result2 = IoTHubMessage_GetProperties(h, &keys, NULL, &count, NULL);
+    IOTHUB_MESSAGE_RESULT result3 = IoTHubMessage_GetProperties(h, &keys, &values, NULL, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, result3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_013: [IoTHubMessage_GetProperties shall return the keys and values held by the property store without copying them, and without making a private copy of properties shared with a clone.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_014: [If keysAndValuesLength is not NULL, IoTHubMessage_GetProperties shall set it to the length of all the keys and values, terminators not included.] */
+TEST_FUNCTION(IoTHubMessage_GetProperties_of_a_clone_Succeed)
+{
+    //arrange
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+    size_t keysAndValuesLength;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    IOTHUB_MESSAGE_HANDLE r;
+    (void)IoTHubMessage_SetProperty(h, TEST_PROPERTY_KEY, TEST_PROPERTY_VALUE);
+    (void)IoTHubMessage_SetProperty(h, TEST_VALID_MAP_KEY, TEST_VALID_MAP_VALUE);
+    r = IoTHubMessage_Clone(h);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_GetProperties(r, &keys, &values, &count, &keysAndValuesLength);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 2, count);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_KEY, keys[0]);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_PROPERTY_VALUE, values[0]);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_VALID_MAP_KEY, keys[1]);
+    ASSERT_ARE_EQUAL(char_ptr, TEST_VALID_MAP_VALUE, values[1]);
+    ASSERT_ARE_EQUAL(size_t, strlen(TEST_PROPERTY_KEY) + strlen(TEST_PROPERTY_VALUE) + strlen(TEST_VALID_MAP_KEY) + strlen(TEST_VALID_MAP_VALUE), keysAndValuesLength);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)IoTHubMessage_GetProperty(h, TEST_PROPERTY_KEY), (void*)values[0]);
+
+    //cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_015: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_GetProperties shall read it with Map_GetInternals and return IOTHUB_MESSAGE_ERROR if that fails.] */
+TEST_FUNCTION(IoTHubMessage_GetProperties_after_Properties_Succeed)
+{
+    //arrange
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+    size_t keysAndValuesLength;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer_keys(&TEST_MAP_KEYS, sizeof(TEST_MAP_KEYS))
+        .CopyOutArgumentBuffer_values(&TEST_MAP_VALUES, sizeof(TEST_MAP_VALUES))
+        .CopyOutArgumentBuffer_count(&TEST_MAP_COUNT, sizeof(TEST_MAP_COUNT));
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_GetProperties(h, &keys, &values, &count, &keysAndValuesLength);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, TEST_MAP_COUNT, count);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_MAP_KEYS, (void*)keys);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_MAP_VALUES, (void*)values);
+    ASSERT_ARE_EQUAL(size_t, strlen(TEST_MAP_KEYS[0]) + strlen(TEST_MAP_VALUES[0]), keysAndValuesLength);
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_015: [If IoTHubMessage_Properties has handed out the properties map, IoTHubMessage_GetProperties shall read it with Map_GetInternals and return IOTHUB_MESSAGE_ERROR if that fails.] */
+TEST_FUNCTION(IoTHubMessage_GetProperties_after_Properties_Fail)
+{
+    //arrange
+    const char* const* keys;
+    const char* const* values;
+    size_t count;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Properties(h);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(MAP_ERROR);
+
+    //act
+    IOTHUB_MESSAGE_RESULT result = IoTHubMessage_GetProperties(h, &keys, &values, &count, NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_017: [IoTHubMessage_CreateFromBorrowedByteArray shall create a IOTHUBMESSAGE_BYTEARRAY message pointing at byteArray, without copying it, and an empty property store.] */
+TEST_FUNCTION(IoTHubMessage_CreateFromBorrowedByteArray_happy_path)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+
+    //assert
+    ASSERT_IS_NOT_NULL(h);
+    ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY, IoTHubMessage_GetContentType(h));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_016: [If byteArray is NULL and size is not 0, IoTHubMessage_CreateFromBorrowedByteArray shall fail and return NULL.] */
+TEST_FUNCTION(IoTHubMessage_CreateFromBorrowedByteArray_fails_when_size_non_zero_buffer_NULL)
+{
+    //act
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(NULL, 1);
+
+    //assert
+    ASSERT_IS_NULL(h);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_018: [If there are any errors then IoTHubMessage_CreateFromBorrowedByteArray shall return NULL.] */
+TEST_FUNCTION(IoTHubMessage_CreateFromBorrowedByteArray_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+
+    //assert
+    ASSERT_IS_NULL(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_020: [If the content of iotHubMessageHandle is borrowed, IoTHubMessage_GetByteArray shall return the borrowed byte array.] */
+TEST_FUNCTION(IoTHubMessage_GetByteArray_of_a_borrowed_message_returns_the_borrowed_bytes)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    const unsigned char* byteArray;
+    size_t size;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_GetByteArray(h, &byteArray, &size);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)c, (void*)byteArray);
+    ASSERT_ARE_EQUAL(size_t, 1, size);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_019: [If the content of iotHubMessageHandle is borrowed, IoTHubMessage_Clone shall copy it with CONSTBUFFER_Create instead.] */
+TEST_FUNCTION(IoTHubMessage_Clone_of_a_borrowed_message_copies_the_content)
+{
+    //arrange
+    const unsigned char* clone_bytes;
+    size_t clone_size;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1));
+
+    //act
+    IOTHUB_MESSAGE_HANDLE r = IoTHubMessage_Clone(h);
+
+    //assert
+    ASSERT_IS_NOT_NULL(r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    (void)IoTHubMessage_GetByteArray(r, &clone_bytes, &clone_size);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)c, (void*)clone_bytes);
+    ASSERT_ARE_EQUAL(uint8_t, c[0], clone_bytes[0]);
+
+    ///cleanup
+    IoTHubMessage_Destroy(r);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_021: [If iotHubMessageHandle is NULL, IoTHubMessage_OwnContent shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_OwnContent_NULL_handle_fails)
+{
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_OwnContent(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, r);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_022: [If the content of iotHubMessageHandle is not borrowed, IoTHubMessage_OwnContent shall do nothing and return IOTHUB_MESSAGE_OK.] */
+TEST_FUNCTION(IoTHubMessage_OwnContent_of_an_owned_message_does_nothing)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_OwnContent(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_023: [Otherwise IoTHubMessage_OwnContent shall copy the borrowed content with CONSTBUFFER_Create, so the message no longer refers to it, and return IOTHUB_MESSAGE_OK.] */
+TEST_FUNCTION(IoTHubMessage_OwnContent_copies_the_borrowed_content)
+{
+    //arrange
+    const unsigned char* byteArray;
+    size_t size;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1));
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_OwnContent(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    (void)IoTHubMessage_GetByteArray(h, &byteArray, &size);
+    ASSERT_ARE_NOT_EQUAL(void_ptr, (void*)c, (void*)byteArray);
+    ASSERT_ARE_EQUAL(size_t, 1, size);
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_024: [If copying the content fails, IoTHubMessage_OwnContent shall return IOTHUB_MESSAGE_ERROR and the content shall stay borrowed.] */
+TEST_FUNCTION(IoTHubMessage_OwnContent_fails_when_CONSTBUFFER_Create_fails)
+{
+    //arrange
+    const unsigned char* byteArray;
+    size_t size;
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_OwnContent(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_ERROR, r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    (void)IoTHubMessage_GetByteArray(h, &byteArray, &size);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)c, (void*)byteArray);
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_025: [If iotHubMessageHandle is NULL, IoTHubMessage_Retain shall return IOTHUB_MESSAGE_INVALID_ARG.] */
+TEST_FUNCTION(IoTHubMessage_Retain_NULL_handle_fails)
+{
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_Retain(NULL);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_INVALID_ARG, r);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_026: [IoTHubMessage_Retain shall make the message own its content as IoTHubMessage_OwnContent does, and return IOTHUB_MESSAGE_ERROR if that fails.] */
+/*Tests_SRS_IOTHUBMESSAGE_31_027: [IoTHubMessage_Retain shall add a reference to iotHubMessageHandle, released by one more call to IoTHubMessage_Destroy, and return IOTHUB_MESSAGE_OK.] */
+TEST_FUNCTION(IoTHubMessage_Retain_of_a_borrowed_message_copies_the_content_and_adds_a_reference)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1));
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_Retain(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_OK, r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_026: [IoTHubMessage_Retain shall make the message own its content as IoTHubMessage_OwnContent does, and return IOTHUB_MESSAGE_ERROR if that fails.] */
+TEST_FUNCTION(IoTHubMessage_Retain_fails_when_the_copy_fails)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromBorrowedByteArray(c, 1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(CONSTBUFFER_Create(c, 1))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_MESSAGE_RESULT r = IoTHubMessage_Retain(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_MESSAGE_RESULT, IOTHUB_MESSAGE_ERROR, r);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
+/*Tests_SRS_IOTHUBMESSAGE_31_028: [IoTHubMessage_Destroy shall only release a reference while references added by IoTHubMessage_Retain remain.] */
+TEST_FUNCTION(IoTHubMessage_Destroy_of_a_retained_message_only_releases_a_reference)
+{
+    //arrange
+    IOTHUB_MESSAGE_HANDLE h = IoTHubMessage_CreateFromByteArray(c, 1);
+    (void)IoTHubMessage_Retain(h);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubMessage_Destroy(h);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(IOTHUBMESSAGE_CONTENT_TYPE, IOTHUBMESSAGE_BYTEARRAY, IoTHubMessage_GetContentType(h));
+
+    ///cleanup
+    IoTHubMessage_Destroy(h);
+}
+
 END_TEST_SUITE(iothubmessage_ut)
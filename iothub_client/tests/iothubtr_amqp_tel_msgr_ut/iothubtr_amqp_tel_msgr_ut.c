@@ -1714,6 +1714,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(messagereceiver_open, TEST_messagereceiver_open);
     REGISTER_GLOBAL_MOCK_HOOK(message_create_uamqp_encoding_from_iothub_message, TEST_message_create_uamqp_encoding_from_iothub_message);
     REGISTER_GLOBAL_MOCK_HOOK(message_create_IoTHubMessage_from_uamqp_message, TEST_message_create_IoTHubMessage_from_uamqp_message);
+    REGISTER_GLOBAL_MOCK_RETURN(message_has_fault_injection_properties, false);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_add, TEST_singlylinkedlist_add);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_head_item, TEST_singlylinkedlist_get_head_item);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_remove, TEST_singlylinkedlist_remove);
@@ -1745,6 +1746,9 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_RETURN(link_set_max_message_size, 0);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(link_set_max_message_size, 1);
 
+    REGISTER_GLOBAL_MOCK_RETURN(link_set_max_link_credit, 0);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(link_set_max_link_credit, 1);
+
     REGISTER_GLOBAL_MOCK_RETURN(messagesender_create, TEST_MESSAGE_SENDER_HANDLE);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(messagesender_create, NULL);
     
@@ -2131,7 +2135,7 @@ TEST_FUNCTION(messenger_state_on_event_sender_state_changed_callback_OPEN)
     // act
     ASSERT_IS_NOT_NULL(saved_messagesender_create_on_message_sender_state_changed);
 
-    saved_messagesender_create_on_message_sender_state_changed((void*)handle, MESSAGE_SENDER_STATE_OPEN, MESSAGE_SENDER_STATE_IDLE);
+    saved_messagesender_create_on_message_sender_state_changed(saved_messagesender_create_context, MESSAGE_SENDER_STATE_OPEN, MESSAGE_SENDER_STATE_IDLE);
     crank_telemetry_messenger_do_work(handle, do_work_profile);
 
     // assert
@@ -2157,7 +2161,7 @@ TEST_FUNCTION(messenger_state_on_event_sender_state_changed_callback_ERROR)
     // act
     ASSERT_IS_NOT_NULL(saved_messagesender_create_on_message_sender_state_changed);
 
-    saved_messagesender_create_on_message_sender_state_changed((void*)handle, MESSAGE_SENDER_STATE_ERROR, MESSAGE_SENDER_STATE_IDLE);
+    saved_messagesender_create_on_message_sender_state_changed(saved_messagesender_create_context, MESSAGE_SENDER_STATE_ERROR, MESSAGE_SENDER_STATE_IDLE);
     crank_telemetry_messenger_do_work(handle, do_work_profile);
 
     // assert
@@ -2763,6 +2767,65 @@ TEST_FUNCTION(telemetry_messenger_do_work_send_events_messagesender_send_fails)
     telemetry_messenger_destroy(handle);
 }
 
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_203: [The AMQP encoding of a message shall be reused from the previous attempt to send it, unless its fault injection properties have to be applied to the batch container again.]
+TEST_FUNCTION(telemetry_messenger_do_work_send_events_after_restart_reuses_the_encoding)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+    time_t current_time = time(NULL);
+
+    ASSERT_ARE_EQUAL(int, 1, send_events(handle, 1));
+
+    BINARY_DATA encoded_message;
+    encoded_message.bytes = (const unsigned char*)malloc(1);
+    encoded_message.length = test_send_one_message_config.test_events[0].number_bytes_encoded;
+    TEST_amqp_data.bytes = encoded_message.bytes;
+
+    MESSENGER_DO_WORK_EXP_CALL_PROFILE *mdwp = get_msgr_do_work_exp_call_profile(TELEMETRY_MESSENGER_STATE_STARTED, false, false, 1, 0, current_time, DEFAULT_EVENT_SEND_TIMEOUT_SECS);
+    mdwp->send_pending_events_test_config = &test_send_one_message_config;
+    crank_telemetry_messenger_do_work(handle, mdwp);
+    TEST_amqp_data.bytes = NULL;
+
+    // the link goes down with the message in progress, which puts it back on the waiting list
+    umock_c_reset_all_calls();
+    set_expected_calls_for_telemetry_messenger_stop(0, 1, false);
+    ASSERT_ARE_EQUAL(int, 0, telemetry_messenger_stop(handle));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    saved_callback_list_count1 = 0; // the callback list of the task went with it
+
+    ASSERT_ARE_EQUAL(int, 0, telemetry_messenger_start(handle, TEST_SESSION_HANDLE));
+    mdwp = get_msgr_do_work_exp_call_profile(TELEMETRY_MESSENGER_STATE_STARTING, false, false, 0, 0, current_time, DEFAULT_EVENT_SEND_TIMEOUT_SECS);
+    mdwp->create_message_sender = true;
+    crank_telemetry_messenger_do_work(handle, mdwp);
+
+    uint64_t peer_max_message_size = test_send_one_message_config.peer_max_message_size + AMQP_BATCHING_RESERVE_SIZE;
+
+    umock_c_reset_all_calls();
+    set_expected_calls_for_process_event_send_timeouts(0, DEFAULT_EVENT_SEND_TIMEOUT_SECS, current_time);
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_WAIT_TO_SEND_LIST));
+    STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(singlylinkedlist_remove(TEST_WAIT_TO_SEND_LIST, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(link_get_peer_max_message_size(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &peer_max_message_size, sizeof(peer_max_message_size));
+    set_expected_calls_for_create_send_pending_events_state();
+    STRICT_EXPECTED_CALL(message_has_fault_injection_properties(TEST_IOTHUB_MESSAGE_HANDLE));
+    STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(message_add_body_amqp_data(IGNORED_PTR_ARG, encoded_message));
+    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_WAIT_TO_SEND_LIST));
+    set_expected_calls_for_send_batched_message_and_reset_state(current_time);
+
+    // act
+    telemetry_messenger_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    saved_messagesender_send_on_message_send_complete(saved_messagesender_send_callback_context, MESSAGE_SEND_OK);
+    telemetry_messenger_destroy(handle);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_016: [If `messenger_handle` is NULL, telemetry_messenger_subscribe_for_messages() shall fail and return __FAILURE__]  
 TEST_FUNCTION(telemetry_messenger_subscribe_for_messages_NULL_handle)
 {
@@ -3253,6 +3316,206 @@ TEST_FUNCTION(telemetry_messenger_set_option_EVENT_SEND_TIMEOUT_SECS)
     telemetry_messenger_destroy(handle);
 }
 
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_213: [If name matches TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, `value` shall be saved on `instance->event_sender_link_count`, to be used the next time the sender links are created]
+TEST_FUNCTION(telemetry_messenger_set_option_EVENT_SENDER_LINK_COUNT)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+
+    size_t value = TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT;
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_214: [If `value` is 0 or greater than TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT, telemetry_messenger_set_option shall fail and return a non-zero value]
+TEST_FUNCTION(telemetry_messenger_set_option_EVENT_SENDER_LINK_COUNT_out_of_range)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+
+    size_t zero_value = 0;
+    size_t too_large_value = TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT + 1;
+
+    // act
+    int result1 = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, &zero_value);
+    int result2 = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, &too_large_value);
+
+    // assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_215: [If name matches TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, `value` shall be saved on `instance->event_send_in_order`]
+TEST_FUNCTION(telemetry_messenger_set_option_EVENT_SEND_IN_ORDER)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+
+    bool value = true;
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_220: [If name matches TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, `value` shall be saved on `instance->c2d_prefetch_count`]
+TEST_FUNCTION(telemetry_messenger_set_option_C2D_PREFETCH_COUNT_no_receiver)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+
+    size_t value = 50;
+
+    umock_c_reset_all_calls();
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_221: [If `instance->receiver_link` exists and `value` is not 0, it shall be applied to the link using link_set_max_link_credit(), taking effect the next time the link credit is replenished]
+TEST_FUNCTION(telemetry_messenger_set_option_C2D_PREFETCH_COUNT_with_receiver)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, true);
+
+    size_t value = 50;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(link_set_max_link_credit(TEST_MESSAGE_RECEIVER_LINK_HANDLE, 50));
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_218: [If link_set_max_link_credit() fails, it shall be logged and ignored]
+TEST_FUNCTION(telemetry_messenger_set_option_C2D_PREFETCH_COUNT_link_set_max_link_credit_fails)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, true);
+
+    size_t value = 50;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(link_set_max_link_credit(TEST_MESSAGE_RECEIVER_LINK_HANDLE, 50)).SetReturn(1);
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_222: [If name matches TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, `value` shall be saved on `instance->c2d_adaptive_prefetch`]
+TEST_FUNCTION(telemetry_messenger_set_option_C2D_ADAPTIVE_PREFETCH)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, false);
+
+    bool value = true;
+
+    umock_c_reset_all_calls();
+
+    // act
+    int result = telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_31_219: [If `instance->c2d_adaptive_prefetch` is true, the link credit shall be resized every C2D_ADAPTIVE_CREDIT_SAMPLE_SECS to the rate C2D messages were settled at, times C2D_ADAPTIVE_CREDIT_BUFFER_SECS, kept between C2D_ADAPTIVE_CREDIT_MIN and the prefetch count (or C2D_ADAPTIVE_CREDIT_MAX if not set)]
+TEST_FUNCTION(telemetry_messenger_do_work_C2D_ADAPTIVE_PREFETCH_resizes_link_credit)
+{
+    // arrange
+    TELEMETRY_MESSENGER_CONFIG* config = get_messenger_config();
+    TELEMETRY_MESSENGER_HANDLE handle = create_and_start_messenger2(config, true);
+
+    bool value = true;
+    (void)telemetry_messenger_set_option(handle, TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, &value);
+
+    time_t sample_start_time = time(NULL);
+    time_t sample_end_time = add_seconds(sample_start_time, 5);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(sample_start_time);
+    set_expected_calls_for_process_event_send_timeouts(0, 0, sample_start_time);
+    set_expected_calls_for_message_do_work_send_pending_events(&test_send_zero_message_config, sample_start_time);
+    telemetry_messenger_do_work(handle);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    TELEMETRY_MESSENGER_MESSAGE_DISPOSITION_INFO disposition_info;
+    disposition_info.source = TEST_MESSAGE_RECEIVER_LINK_NAME_CHAR_PTR;
+    disposition_info.message_id = TEST_DELIVERY_NUMBER;
+
+    int i;
+    for (i = 0; i < 50; i++)
+    {
+        umock_c_reset_all_calls();
+        set_expected_calls_for_telemetry_messenger_send_message_disposition(&disposition_info, TELEMETRY_MESSENGER_DISPOSITION_RESULT_ACCEPTED);
+        ASSERT_ARE_EQUAL(int, 0, telemetry_messenger_send_message_disposition(handle, &disposition_info, TELEMETRY_MESSENGER_DISPOSITION_RESULT_ACCEPTED));
+    }
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(sample_end_time);
+    STRICT_EXPECTED_CALL(get_difftime(sample_end_time, sample_start_time)).SetReturn(5.0);
+    // 50 messages settled in 5 secs, times 2 secs of buffer.
+    STRICT_EXPECTED_CALL(link_set_max_link_credit(TEST_MESSAGE_RECEIVER_LINK_HANDLE, 20));
+    set_expected_calls_for_process_event_send_timeouts(0, 0, sample_end_time);
+    set_expected_calls_for_message_do_work_send_pending_events(&test_send_zero_message_config, sample_end_time);
+
+    // act
+    telemetry_messenger_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    telemetry_messenger_destroy(handle);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_169: [If name matches TELEMETRY_MESSENGER_OPTION_SAVED_OPTIONS, `value` shall be applied using OptionHandler_FeedOptions]
 TEST_FUNCTION(telemetry_messenger_set_option_SAVED_OPTIONS)
 {
@@ -3502,6 +3765,14 @@ static void set_expected_calls_for_telemetry_messenger_retrieve_options()
 
     STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS, IGNORED_PTR_ARG))
         .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
 }
 
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_MESSENGER_09_173: [If `messenger_handle` is NULL, telemetry_messenger_retrieve_options shall fail and return NULL]
@@ -1273,6 +1273,194 @@ TEST_FUNCTION(authentication_do_work_DEVICE_KEYS_sas_token_refresh)
     authentication_destroy(handle);
 }
 
+static AUTHENTICATION_HANDLE create_and_authenticate_with_refresh_limit(AUTHENTICATION_CONFIG* config, AUTHENTICATION_REFRESH_LIMIT* refresh_limit, time_t current_time)
+{
+    AUTHENTICATION_HANDLE handle;
+    AUTHENTICATION_DO_WORK_EXPECTED_STATE *exp_state;
+
+    config->sas_token_refresh_limit = refresh_limit;
+    handle = create_and_start_authentication(config);
+
+    exp_state = get_do_work_expected_state_struct();
+    exp_state->current_state = AUTHENTICATION_STATE_STARTING;
+    exp_state->sas_token_to_use = TEST_PRIMARY_DEVICE_KEY_STRING_HANDLE;
+
+    crank_authentication_do_work(config, handle, current_time, exp_state);
+    saved_cbs_put_token_on_operation_complete(saved_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, "all good");
+
+    return handle;
+}
+
+static void set_expected_calls_for_precompute_SAS_token()
+{
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE));
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(TEST_AUTHORIZATION_MODULE_HANDLE)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_SasToken(TEST_AUTHORIZATION_MODULE_HANDLE, IGNORED_PTR_ARG, IGNORED_NUM_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(TEST_DEVICES_PATH_STRING_HANDLE));
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_001: [If cbs_put_token() succeeds, the next SAS token refresh shall happen a random amount of time, up to SAS_TOKEN_REFRESH_MAX_JITTER_PERCENT of `instance->sas_token_refresh_time_secs`, earlier]
+TEST_FUNCTION(authentication_do_work_DEVICE_KEYS_sas_token_refresh_happens_jitter_earlier)
+{
+    // arrange
+    srand(1);
+    size_t jitter_secs = (size_t)rand() % (DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS / 100 * 10 + 1);
+    ASSERT_IS_TRUE_WITH_MSG(jitter_secs > 0, "seed gives no jitter");
+    srand(1);
+
+    time_t current_time = time(NULL);
+    time_t next_time = add_seconds(current_time, (int)(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS - jitter_secs));
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != next_time, "failed to compute 'next_time'");
+
+    AUTHENTICATION_CONFIG* config = get_auth_config(USE_DEVICE_KEYS);
+    AUTHENTICATION_HANDLE handle = create_and_authenticate_with_refresh_limit(config, NULL, current_time);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(IGNORED_PTR_ARG)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, current_time)).SetReturn((double)(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS - jitter_secs));
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE));
+    set_expected_calls_for_put_SAS_token_to_cbs(handle, next_time, TEST_GENERATED_SAS_TOKEN_STRING_HANDLE);
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(TEST_DEVICES_PATH_STRING_HANDLE));
+
+    // act
+    authentication_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    authentication_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_002: [If `instance->sas_token_refresh_limit` is set and has no refreshes left, the SAS token refresh shall be postponed to a later authentication_do_work() call]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_003: [If the SAS token refresh is postponed or due in less than the precompute lead time, the next SAS token shall be created and saved in `instance->precomputed_sas_token`]
+TEST_FUNCTION(authentication_do_work_DEVICE_KEYS_sas_token_refresh_postponed_by_limit)
+{
+    // arrange
+    AUTHENTICATION_REFRESH_LIMIT refresh_limit;
+    refresh_limit.max_refreshes_in_progress = 1;
+    refresh_limit.refreshes_in_progress = 1;
+
+    time_t current_time = time(NULL);
+    time_t next_time = add_seconds(current_time, DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != next_time, "failed to compute 'next_time'");
+
+    AUTHENTICATION_CONFIG* config = get_auth_config(USE_DEVICE_KEYS);
+    AUTHENTICATION_HANDLE handle = create_and_authenticate_with_refresh_limit(config, &refresh_limit, current_time);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(IGNORED_PTR_ARG)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, current_time)).SetReturn(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    set_expected_calls_for_precompute_SAS_token();
+    saved_cbs_put_token_on_operation_complete = NULL;
+
+    // act
+    authentication_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NULL(saved_cbs_put_token_on_operation_complete);
+    ASSERT_ARE_EQUAL(size_t, 1, refresh_limit.refreshes_in_progress);
+
+    // cleanup
+    authentication_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_004: [If a SAS token was precomputed, it shall be put to CBS instead of creating a new one]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_006: [The SAS token refresh taken from `instance->sas_token_refresh_limit` shall be given back when the refresh completes, fails or times out]
+TEST_FUNCTION(authentication_do_work_DEVICE_KEYS_sas_token_refresh_uses_precomputed_token)
+{
+    // arrange
+    AUTHENTICATION_REFRESH_LIMIT refresh_limit;
+    refresh_limit.max_refreshes_in_progress = 1;
+    refresh_limit.refreshes_in_progress = 1;
+
+    time_t current_time = time(NULL);
+    time_t next_time = add_seconds(current_time, DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != next_time, "failed to compute 'next_time'");
+
+    AUTHENTICATION_CONFIG* config = get_auth_config(USE_DEVICE_KEYS);
+    AUTHENTICATION_HANDLE handle = create_and_authenticate_with_refresh_limit(config, &refresh_limit, current_time);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(IGNORED_PTR_ARG)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, current_time)).SetReturn(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    set_expected_calls_for_precompute_SAS_token();
+    authentication_do_work(handle);
+
+    refresh_limit.refreshes_in_progress = 0;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(IGNORED_PTR_ARG)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, current_time)).SetReturn(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, next_time)).SetReturn(0);
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE));
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICES_PATH_STRING_HANDLE)).SetReturn(TEST_DEVICES_PATH);
+    STRICT_EXPECTED_CALL(cbs_put_token_async(TEST_CBS_HANDLE, SAS_TOKEN_TYPE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle));
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(TEST_DEVICES_PATH_STRING_HANDLE));
+
+    // act
+    authentication_do_work(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 1, refresh_limit.refreshes_in_progress);
+
+    saved_cbs_put_token_on_operation_complete(saved_cbs_put_token_context, CBS_OPERATION_RESULT_OK, 0, "all good");
+    ASSERT_ARE_EQUAL(size_t, 0, refresh_limit.refreshes_in_progress);
+
+    // cleanup
+    authentication_destroy(handle);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_31_005: [authentication_stop() shall give back the SAS token refresh taken from `instance->sas_token_refresh_limit`, if any, and destroy `instance->precomputed_sas_token`]
+TEST_FUNCTION(authentication_stop_during_sas_token_refresh_gives_back_refresh)
+{
+    // arrange
+    AUTHENTICATION_REFRESH_LIMIT refresh_limit;
+    refresh_limit.max_refreshes_in_progress = 1;
+    refresh_limit.refreshes_in_progress = 0;
+
+    time_t current_time = time(NULL);
+    time_t next_time = add_seconds(current_time, DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != next_time, "failed to compute 'next_time'");
+
+    AUTHENTICATION_CONFIG* config = get_auth_config(USE_DEVICE_KEYS);
+    AUTHENTICATION_HANDLE handle = create_and_authenticate_with_refresh_limit(config, &refresh_limit, current_time);
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubClient_Auth_Get_Credential_Type(IGNORED_PTR_ARG)).SetReturn(IOTHUB_CREDENTIAL_TYPE_DEVICE_KEY);
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(next_time);
+    STRICT_EXPECTED_CALL(get_difftime(next_time, current_time)).SetReturn(DEFAULT_SAS_TOKEN_REFRESH_TIME_SECS);
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE));
+    set_expected_calls_for_put_SAS_token_to_cbs(handle, next_time, TEST_GENERATED_SAS_TOKEN_STRING_HANDLE);
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_delete(TEST_DEVICES_PATH_STRING_HANDLE));
+    authentication_do_work(handle);
+    ASSERT_ARE_EQUAL(size_t, 1, refresh_limit.refreshes_in_progress);
+
+    umock_c_reset_all_calls();
+
+    // act
+    int result = authentication_stop(handle);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(size_t, 0, refresh_limit.refreshes_in_progress);
+
+    // cleanup
+    authentication_destroy(handle);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_021: [authentication_create() shall set `instance->cbs_request_timeout_secs` with the default value of UINT32_MAX]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_038: [If `instance->is_cbs_put_token_in_progress` is TRUE, authentication_do_work() shall only verify the authentication timeout]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_AUTH_09_043: [authentication_do_work() shall set `instance->is_cbs_put_token_in_progress` to TRUE]
@@ -45,7 +45,7 @@ extern "C"
 {
 #endif
     static int saved_malloc_returns_count = 0;
-    static void* saved_malloc_returns[20];
+    static void* saved_malloc_returns[64];
 
     static void* TEST_malloc(size_t size)
     {
@@ -115,6 +115,7 @@ extern "C"
 #undef ENABLE_MOCKS
 
 #include "internal/iothubtransport_amqp_common.h"
+#include "internal/iothubtransport_amqp_telemetry_messenger.h"
 
 TEST_DEFINE_ENUM_TYPE(AMQP_CONNECTION_STATE, AMQP_CONNECTION_STATE_VALUES);
 IMPLEMENT_UMOCK_C_ENUM_TYPE(AMQP_CONNECTION_STATE, AMQP_CONNECTION_STATE_VALUES);
@@ -160,7 +161,7 @@ extern "C"
 
     // singlylinkedlist
     static int saved_registered_devices_list_count;
-    static const void* saved_registered_devices_list[20];
+    static const void* saved_registered_devices_list[64];
 
     static bool TEST_singlylinkedlist_add_fail_return = false;
     static LIST_ITEM_HANDLE TEST_singlylinkedlist_add(SINGLYLINKEDLIST_HANDLE list, const void* item)
@@ -203,13 +204,6 @@ extern "C"
         return item_found == 1 ? 0 : 1;
     }
 
-    static LIST_ITEM_HANDLE TEST_singlylinkedlist_find(SINGLYLINKEDLIST_HANDLE list, LIST_MATCH_FUNCTION match_function, const void* match_context)
-    {
-        (void)list;
-        (void)match_function;
-        return (LIST_ITEM_HANDLE)match_context;
-    }
-
     static SINGLYLINKEDLIST_HANDLE TEST_singlylinkedlist_foreach_list;
     static LIST_ACTION_FUNCTION TEST_singlylinkedlist_foreach_action_function;
     static const void* TEST_singlylinkedlist_foreach_context;
@@ -375,6 +369,9 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 #define TEST_USER_REMOTE_IDLE_TIMEOUT_RATIO        0.875
 #define DEFAULT_RETRY_POLICY                      IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER
 #define DEFAULT_MAX_RETRY_TIME_IN_SECS            0
+#define DEVICE_INDEX_INITIAL_SIZE                 16
+#define DEVICE_IDLE_WORK_INTERVAL_SECS            1
+#define DEVICE_ACTIVITY_GRACE_PERIOD_SECS         2
 
 #define TEST_STRING_HANDLE                         (STRING_HANDLE)0x4240
 #define TEST_IOTHUBTRANSPORTAMQP_METHODS           ((IOTHUBTRANSPORT_AMQP_METHODS_HANDLE)0x4244)
@@ -446,6 +443,10 @@ static void set_expected_calls_for_Create(IOTHUBTRANSPORT_CONFIG* transport_conf
 
     STRICT_EXPECTED_CALL(singlylinkedlist_create())
         .SetReturn(TEST_REGISTERED_DEVICES_LIST);
+
+    EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
 }
 
 static void set_expected_calls_for_GetSendStatus(DEVICE_SEND_STATUS send_status)
@@ -461,16 +462,6 @@ static void set_expected_calls_for_GetHostname()
     STRICT_EXPECTED_CALL(STRING_clone(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE)).SetReturn(TEST_IOTHUB_HOST_FQDN_CLONE_STRING_HANDLE);
 }
 
-static void set_expected_calls_for_is_device_registered_ex(IOTHUB_DEVICE_CONFIG* device_config, IOTHUB_DEVICE_HANDLE registered_device)
-{
-    (void)device_config;
-
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn((LIST_ITEM_HANDLE)registered_device);
-}
-
 static MESSAGE_DISPOSITION_CONTEXT* TRANSPORT_CONTEXT_DATA_create2(IOTHUB_DEVICE_HANDLE device_handle)
 {
     MESSAGE_DISPOSITION_CONTEXT* result = (MESSAGE_DISPOSITION_CONTEXT*)malloc(sizeof(MESSAGE_DISPOSITION_CONTEXT));
@@ -531,20 +522,18 @@ static void set_expected_calls_for_SendMessageDisposition(IOTHUBMESSAGE_DISPOSIT
 }
 
 // @param registered_device
-//     provide the handle to the registered device if the expected call is supposed to return an item, 
-//     or NULL if the intent is to return "not registered".
+//     provide the handle to the registered device if the device is supposed to be found in the transport index, 
+//     or NULL if the intent is to return "not registered" (its id then does not match the one it was indexed with).
 static void set_expected_calls_for_is_device_registered(IOTHUB_DEVICE_CONFIG* device_config, IOTHUB_DEVICE_HANDLE registered_device)
 {
-    STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
-        .SetReturn(TEST_DEVICE_ID_CHAR_PTR);
+    (void)device_config;
 
-    set_expected_calls_for_is_device_registered_ex(device_config, registered_device);
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
+        .SetReturn(registered_device != NULL ? TEST_DEVICE_ID_CHAR_PTR : TEST_DEVICE_ID_2_CHAR_PTR);
 }
 
 static void set_expected_calls_for_Register(IOTHUB_DEVICE_CONFIG* device_config, bool is_using_cbs)
 {
-    set_expected_calls_for_is_device_registered_ex(device_config, NULL);
-
     // is_device_credential_acceptable
     // Nothing to expect.
 
@@ -557,8 +546,6 @@ static void set_expected_calls_for_Register(IOTHUB_DEVICE_CONFIG* device_config,
     STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE))
         .SetReturn(TEST_IOTHUB_HOST_FQDN_CHAR_PTR);
     EXPECTED_CALL(device_create(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_REGISTERED_DEVICES_LIST))
-        .SetReturn(NULL);
 
     STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE)).SetReturn(TEST_IOTHUB_HOST_FQDN_CHAR_PTR);
     EXPECTED_CALL(iothubtransportamqp_methods_create(TEST_IOTHUB_HOST_FQDN_CHAR_PTR, device_config->deviceId));
@@ -566,6 +553,14 @@ static void set_expected_calls_for_Register(IOTHUB_DEVICE_CONFIG* device_config,
     // replicate_device_options_to
     STRICT_EXPECTED_CALL(device_set_option(TEST_DEVICE_HANDLE, DEVICE_OPTION_EVENT_SEND_TIMEOUT_SECS, IGNORED_PTR_ARG))
         .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(device_set_option(TEST_DEVICE_HANDLE, DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(device_set_option(TEST_DEVICE_HANDLE, DEVICE_OPTION_EVENT_SEND_IN_ORDER, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(device_set_option(TEST_DEVICE_HANDLE, DEVICE_OPTION_C2D_PREFETCH_COUNT, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(device_set_option(TEST_DEVICE_HANDLE, DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH, IGNORED_PTR_ARG))
+        .IgnoreArgument(3);
 
     if (is_using_cbs)
     {
@@ -579,6 +574,7 @@ static void set_expected_calls_for_Register(IOTHUB_DEVICE_CONFIG* device_config,
 
     STRICT_EXPECTED_CALL(singlylinkedlist_add(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
 }
 
@@ -587,13 +583,9 @@ static void set_expected_calls_for_Unregister(IOTHUB_DEVICE_HANDLE iothub_device
     STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
         .SetReturn(TEST_DEVICE_ID_CHAR_PTR);
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(3)
-        .SetReturn((LIST_ITEM_HANDLE)iothub_device_handle);
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_remove(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG))
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(singlylinkedlist_remove(TEST_REGISTERED_DEVICES_LIST, (LIST_ITEM_HANDLE)iothub_device_handle));
 
     STRICT_EXPECTED_CALL(iothubtransportamqp_methods_destroy(TEST_IOTHUBTRANSPORTAMQP_METHODS));
 
@@ -690,6 +682,14 @@ static void set_expected_calls_for_Device_DoWork(PDLIST_ENTRY wts, int wts_lengt
     }
 
     STRICT_EXPECTED_CALL(device_do_work(TEST_DEVICE_HANDLE));
+
+    // has_pending_work
+    if (current_device_state == DEVICE_STATE_STARTED)
+    {
+        STRICT_EXPECTED_CALL(DList_IsListEmpty(wts))
+            .SetReturn(1);
+        set_expected_calls_for_GetSendStatus(DEVICE_SEND_STATUS_BUSY);
+    }
 }
 
 static void set_expected_calls_for_get_new_underlying_io_transport(bool feed_options)
@@ -707,8 +707,6 @@ static void set_expected_calls_for_get_new_underlying_io_transport(bool feed_opt
 
 static void set_expected_calls_for_DoWork2(PDLIST_ENTRY wts, int wts_length, DEVICE_STATE current_device_state, bool is_tls_io_acquired, bool feed_options, bool is_using_cbs, bool is_connection_created, bool is_connection_open, int number_of_registered_devices, time_t current_time, bool subscribe_for_methods)
 {
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_REGISTERED_DEVICES_LIST));
-
     if (!is_tls_io_acquired)
     {
         set_expected_calls_for_get_new_underlying_io_transport(feed_options);
@@ -724,11 +722,14 @@ static void set_expected_calls_for_DoWork2(PDLIST_ENTRY wts, int wts_length, DEV
     if (is_connection_open)
     {
         int i;
+
+        STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
+        // wake_up_idle_devices
+        EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+
         for (i = 0; i < number_of_registered_devices; i++)
         {
-            EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
             set_expected_calls_for_Device_DoWork(wts, wts_length, current_device_state, is_using_cbs, current_time, subscribe_for_methods);
-            EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
         }
     }
 
@@ -756,6 +757,7 @@ static void set_expected_calls_for_Destroy(int number_of_registered_devices, IOT
     }
     
     STRICT_EXPECTED_CALL(singlylinkedlist_destroy(TEST_REGISTERED_DEVICES_LIST));
+    EXPECTED_CALL(free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(amqp_connection_destroy(TEST_AMQP_CONNECTION_HANDLE));
     STRICT_EXPECTED_CALL(xio_destroy(TEST_UNDERLYING_IO_TRANSPORT));
     STRICT_EXPECTED_CALL(retry_control_destroy(TEST_RETRY_CONTROL_HANDLE));
@@ -1050,6 +1052,29 @@ static void destroy_transport(TRANSPORT_LL_HANDLE handle, IOTHUB_DEVICE_HANDLE r
     IoTHubTransport_AMQP_Common_Destroy(handle);
 }
 
+// @remarks
+//     Expects the single registered device to be started and without pending work, and leaves it in `idle_devices`
+//     as of TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS.
+static void crank_transport_until_device_is_idle(TRANSPORT_LL_HANDLE handle, PDLIST_ENTRY wts)
+{
+    DEVICE_SEND_STATUS send_status = DEVICE_SEND_STATUS_IDLE;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS);
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    set_expected_calls_for_send_pending_events(wts, 0);
+    STRICT_EXPECTED_CALL(device_do_work(TEST_DEVICE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(wts));
+    STRICT_EXPECTED_CALL(device_get_send_status(TEST_DEVICE_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &send_status, sizeof(DEVICE_SEND_STATUS));
+    EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(amqp_connection_do_work(TEST_AMQP_CONNECTION_HANDLE));
+
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+}
+
 // ---------- Test Initialization Helpers ---------- //
 static void register_umock_alias_types()
 {
@@ -1125,7 +1150,6 @@ static void register_global_mock_hooks()
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_remove, TEST_singlylinkedlist_remove);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_head_item, TEST_singlylinkedlist_get_head_item);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_next_item, TEST_singlylinkedlist_get_next_item);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_find, TEST_singlylinkedlist_find);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_foreach, TEST_singlylinkedlist_foreach);
     REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_item_get_value, TEST_singlylinkedlist_item_get_value);
 
@@ -1351,7 +1375,7 @@ TEST_FUNCTION(when_creating_the_methods_handler_fails_then_IoTHubTransport_AMQP_
     size_t n = umock_c_negative_tests_call_count();
     for (i = 0; i < n; i++)
     {
-        if (i == 0 || i == 2 || i == 3 || i == 4 || i == 6 || i == 8 || i == 9 || i == 16)
+        if (i == 1 || i == 2 || i == 3 || i == 5 || i == 7 || i == 18 || i == 19)
         {
             // These expected calls do not cause the API to fail.
             continue;
@@ -1388,7 +1412,7 @@ TEST_FUNCTION(IoTHubTransport_AMQP_Common_Unregister_destroys_the_methods_handle
 
     handle = create_transport();
 
-    device_config.deviceId = "blah";
+    device_config.deviceId = TEST_DEVICE_ID_CHAR_PTR;
     device_config.deviceKey = "cucu";
     device_config.deviceSasToken = NULL;
 
@@ -2016,6 +2040,12 @@ TEST_FUNCTION(Create_failure_checks)
     size_t i;
     for (i = 0; i < umock_c_negative_tests_call_count(); i++)
     {
+        if (i == 5 || i == 6)
+        {
+            // These expected calls do not cause the API to fail.
+            continue;
+        }
+
         // arrange
         char error_msg[64];
 
@@ -2172,20 +2202,76 @@ TEST_FUNCTION(Register_device_already_registered)
     TRANSPORT_LL_HANDLE handle = create_transport();
 
     IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE registered_device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG, device_config->deviceId))
-        .IgnoreArgument(2)
-        .SetReturn(TEST_LIST_ITEM_HANDLE);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
+        .SetReturn(TEST_DEVICE_ID_CHAR_PTR);
 
     // act
     IOTHUB_DEVICE_HANDLE device_handle = IoTHubTransport_AMQP_Common_Register(handle, device_config, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &TEST_waitingToSend);
 
     // assert
+    ASSERT_IS_NOT_NULL(registered_device_handle);
     ASSERT_IS_NULL(device_handle);
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
     // cleanup
-    destroy_transport(handle, device_handle, NULL);
+    destroy_transport(handle, registered_device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_006: [The device id shall be looked up in `instance->devices_by_id`, without scanning `instance->registered_devices`]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_007: [IoTHubTransport_AMQP_Common_Register shall add `amqp_device_instance` to `instance->devices_by_id`, `instance->devices_by_client` and `instance->ready_devices`]
+TEST_FUNCTION(Register_more_devices_than_index_size_succeeds)
+{
+    // arrange
+    const char* device_ids[DEVICE_INDEX_INITIAL_SIZE + 1] = {
+        "device00", "device01", "device02", "device03", "device04", "device05", "device06", "device07", "device08",
+        "device09", "device10", "device11", "device12", "device13", "device14", "device15", "device16" };
+    IOTHUB_DEVICE_HANDLE device_handles[DEVICE_INDEX_INITIAL_SIZE + 1];
+    size_t i;
+
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    for (i = 0; i < DEVICE_INDEX_INITIAL_SIZE + 1; i++)
+    {
+        IOTHUB_DEVICE_CONFIG* device_config = create_device_config(device_ids[i], true);
+
+        umock_c_reset_all_calls();
+        STRICT_EXPECTED_CALL(STRING_construct(device_ids[i]))
+            .SetReturn(TEST_DEVICE_ID_STRING_HANDLE);
+        device_handles[i] = IoTHubTransport_AMQP_Common_Register(handle, device_config, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &TEST_waitingToSend);
+        ASSERT_IS_NOT_NULL(device_handles[i]);
+    }
+
+    for (i = 0; i < DEVICE_INDEX_INITIAL_SIZE + 1; i++)
+    {
+        umock_c_reset_all_calls();
+        STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
+            .SetReturn(device_ids[i]);
+        STRICT_EXPECTED_CALL(device_subscribe_message(TEST_DEVICE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(2)
+            .IgnoreArgument(3);
+
+        // act
+        int result = IoTHubTransport_AMQP_Common_Subscribe(device_handles[i]);
+
+        // assert
+        ASSERT_ARE_EQUAL(int, 0, result);
+        ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    }
+
+    // cleanup
+    for (i = 0; i < DEVICE_INDEX_INITIAL_SIZE + 1; i++)
+    {
+        umock_c_reset_all_calls();
+        STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
+            .SetReturn(device_ids[i]);
+        IoTHubTransport_AMQP_Common_Unregister(device_handles[i]);
+    }
+
+    destroy_transport(handle, NULL, NULL);
 }
 
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_065: [IoTHubTransport_AMQP_Common_Register shall fail and return NULL if the device is not using an authentication mode compatible with the currently used by the transport.]
@@ -2204,10 +2290,6 @@ TEST_FUNCTION(Register_CBS_transport_X509_credentials)
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG, device_config2->deviceId))
-        .IgnoreArgument(2)
-        .SetReturn(NULL);
-
     // act
     IOTHUB_DEVICE_HANDLE device_handle2 = IoTHubTransport_AMQP_Common_Register(handle, device_config2, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &TEST_waitingToSend);
 
@@ -2236,10 +2318,6 @@ TEST_FUNCTION(Register_X509_transport_CBS_credentials)
 
     umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(TEST_REGISTERED_DEVICES_LIST, IGNORED_PTR_ARG, device_config2->deviceId))
-        .IgnoreArgument(2)
-        .SetReturn(NULL);
-
     // act
     IOTHUB_DEVICE_HANDLE device_handle2 = IoTHubTransport_AMQP_Common_Register(handle, device_config2, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, &TEST_waitingToSend);
 
@@ -2275,7 +2353,7 @@ TEST_FUNCTION(Register_failure_checks)
     size_t i, n = umock_c_negative_tests_call_count();
     for (i = 0; i < n; i++)
     {
-        if (i == 0 || i == 2 || i == 3 || i == 4 || i >= 6)
+        if (i == 1 || i == 2 || i == 3 || i >= 5)
         {
             // These expected calls do not cause the API to fail.
             continue;
@@ -2840,6 +2918,61 @@ TEST_FUNCTION(SetOption_log_trace)
     // cleanup
     destroy_transport(handle, device_handle, NULL);
 }
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_003: [If `option` is `event_sender_link_count` and `value` is 0 or greater than TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT, IoTHubTransport_AMQP_Common_SetOption shall return IOTHUB_CLIENT_INVALID_ARG.]
+TEST_FUNCTION(SetOption_event_sender_link_count_out_of_range)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    size_t zero_value = 0;
+    size_t too_large_value = TELEMETRY_MESSENGER_MAX_EVENT_SENDER_LINK_COUNT + 1;
+
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result1 = IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_EVENT_SENDER_LINK_COUNT, &zero_value);
+    IOTHUB_CLIENT_RESULT result2 = IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_EVENT_SENDER_LINK_COUNT, &too_large_value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_INVALID_ARG, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_002: [If `option` is `message_pool_size`, IoTHubTransport_AMQP_Common_SetOption shall return IOTHUB_CLIENT_OK, the transport keeps no records of its own to pool]
+TEST_FUNCTION(SetOption_message_pool_size_not_passed_to_xio)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    size_t value = 16;
+
+    umock_c_reset_all_calls();
+
+    // act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_AMQP_Common_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &value);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_105: [If `option` does not match one of the options handled by this module, it shall be passed to `instance->tls_io` using xio_setoption()]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_106: [If `instance->tls_io` is NULL, it shall be set invoking instance->underlying_io_transport_provider()]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_108: [When `instance->tls_io` is created, IoTHubTransport_AMQP_Common_SetOption shall apply `instance->saved_tls_options` with OptionHandler_FeedOptions()]
@@ -3779,6 +3912,7 @@ TEST_FUNCTION(IoTHubTransport_AMQP_Common_Destroy_frees_proxy_options)
     set_expected_calls_for_Unregister(device_handle);
 
     STRICT_EXPECTED_CALL(singlylinkedlist_destroy(TEST_REGISTERED_DEVICES_LIST));
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(retry_control_destroy(TEST_RETRY_CONTROL_HANDLE));
     STRICT_EXPECTED_CALL(STRING_delete(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
@@ -3821,8 +3955,7 @@ TEST_FUNCTION(Unregister_device_not_registered)
 
     umock_c_reset_all_calls();
     STRICT_EXPECTED_CALL(STRING_c_str(TEST_DEVICE_ID_STRING_HANDLE))
-        .SetReturn(TEST_DEVICE_ID_CHAR_PTR);
-    set_expected_calls_for_is_device_registered_ex(device_config, NULL);
+        .SetReturn(TEST_DEVICE_ID_2_CHAR_PTR);
 
     // act
     IoTHubTransport_AMQP_Common_Unregister(device_handle);
@@ -4012,6 +4145,152 @@ TEST_FUNCTION(DoWork_success)
     destroy_transport(handle, device_handle, NULL);
 }
 
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_012: [The device-specific do_work shall only be performed on the devices in `instance->ready_devices`]
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_014: [A device without pending work and without any activity for DEVICE_ACTIVITY_GRACE_PERIOD_SECS shall be moved to `instance->idle_devices`]
+TEST_FUNCTION(DoWork_idle_device_skipped)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+    crank_transport_until_device_is_idle(handle, &TEST_waitingToSend);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&TEST_waitingToSend));
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(amqp_connection_do_work(TEST_AMQP_CONNECTION_HANDLE));
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_011: [Devices in `instance->idle_devices` that have not had a device-specific do_work for DEVICE_IDLE_WORK_INTERVAL_SECS shall be moved to `instance->ready_devices`]
+TEST_FUNCTION(DoWork_idle_device_worked_after_idle_interval)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+    crank_transport_until_device_is_idle(handle, &TEST_waitingToSend);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    DEVICE_SEND_STATUS send_status = DEVICE_SEND_STATUS_IDLE;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS + DEVICE_IDLE_WORK_INTERVAL_SECS);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&TEST_waitingToSend));
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    set_expected_calls_for_send_pending_events(&TEST_waitingToSend, 0);
+    STRICT_EXPECTED_CALL(device_do_work(TEST_DEVICE_HANDLE));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&TEST_waitingToSend));
+    STRICT_EXPECTED_CALL(device_get_send_status(TEST_DEVICE_HANDLE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(2, &send_status, sizeof(DEVICE_SEND_STATUS));
+    EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(amqp_connection_do_work(TEST_AMQP_CONNECTION_HANDLE));
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_009: [If `iotHubClientHandle` is not NULL and its device is in `instance->idle_devices` with events in `waiting_to_send`, the device shall be moved to `instance->ready_devices`]
+TEST_FUNCTION(DoWork_idle_device_with_events_woken_by_client_handle)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+    crank_transport_until_device_is_idle(handle, &TEST_waitingToSend);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&TEST_waitingToSend)).SetReturn(0);
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    set_expected_calls_for_Device_DoWork(&TEST_waitingToSend, 0, DEVICE_STATE_STARTED, true, TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS, false);
+    STRICT_EXPECTED_CALL(amqp_connection_do_work(TEST_AMQP_CONNECTION_HANDLE));
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
+// Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_31_010: [If `iotHubClientHandle` is NULL, all devices in `instance->idle_devices` with events in `waiting_to_send` shall be moved to `instance->ready_devices`]
+TEST_FUNCTION(DoWork_NULL_client_handle_wakes_idle_devices_with_events)
+{
+    // arrange
+    initialize_test_variables();
+    TRANSPORT_LL_HANDLE handle = create_transport();
+
+    IOTHUB_DEVICE_CONFIG* device_config = create_device_config(TEST_DEVICE_ID_CHAR_PTR, true);
+    IOTHUB_DEVICE_HANDLE device_handle = register_device(handle, device_config, &TEST_waitingToSend, true);
+    ASSERT_IS_NOT_NULL(device_handle);
+
+    crank_transport_ready_after_create(handle, &TEST_waitingToSend, 0, false, true, 1, TEST_current_time, false);
+    crank_transport_until_device_is_idle(handle, &TEST_waitingToSend);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(&TEST_waitingToSend)).SetReturn(0);
+    EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+    set_expected_calls_for_Device_DoWork(&TEST_waitingToSend, 0, DEVICE_STATE_STARTED, true, TEST_current_time + DEVICE_ACTIVITY_GRACE_PERIOD_SECS, false);
+    STRICT_EXPECTED_CALL(amqp_connection_do_work(TEST_AMQP_CONNECTION_HANDLE));
+
+    // act
+    IoTHubTransport_AMQP_Common_DoWork(handle, NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    destroy_transport(handle, device_handle, NULL);
+}
+
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_115: [If the AMQP connection is closed by the service side, the connection retry logic shall be triggered]
 // Tests_SRS_IOTHUBTRANSPORT_AMQP_COMMON_09_126: [The connection retry shall be attempted only if retry_control_should_retry() returns RETRY_ACTION_NOW, or if it fails]
 TEST_FUNCTION(on_amqp_connection_state_changed_CLOSED_unexpectedly)
@@ -4082,7 +4361,6 @@ TEST_FUNCTION(DoWork_get_underlying_io_transport_provider_fails)
     ASSERT_IS_NOT_NULL(device_handle);
 
     umock_c_reset_all_calls();
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(TEST_REGISTERED_DEVICES_LIST));
     STRICT_EXPECTED_CALL(STRING_c_str(TEST_IOTHUB_HOST_FQDN_STRING_HANDLE))
         .SetReturn(TEST_IOTHUB_HOST_FQDN_CHAR_PTR);
     TEST_amqp_get_io_transport_result = NULL;
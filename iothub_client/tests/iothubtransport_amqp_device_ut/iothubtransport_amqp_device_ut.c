@@ -645,6 +645,22 @@ static void set_expected_calls_for_device_set_option(AMQP_DEVICE_HANDLE handle,
     {
         STRICT_EXPECTED_CALL(telemetry_messenger_set_option(TEST_TELEMETRY_MESSENGER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_TIMEOUT_SECS, option_value));
     }
+    else if (strcmp(DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, option_name) == 0)
+    {
+        STRICT_EXPECTED_CALL(telemetry_messenger_set_option(TEST_TELEMETRY_MESSENGER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SENDER_LINK_COUNT, option_value));
+    }
+    else if (strcmp(DEVICE_OPTION_EVENT_SEND_IN_ORDER, option_name) == 0)
+    {
+        STRICT_EXPECTED_CALL(telemetry_messenger_set_option(TEST_TELEMETRY_MESSENGER_HANDLE, TELEMETRY_MESSENGER_OPTION_EVENT_SEND_IN_ORDER, option_value));
+    }
+    else if (strcmp(DEVICE_OPTION_C2D_PREFETCH_COUNT, option_name) == 0)
+    {
+        STRICT_EXPECTED_CALL(telemetry_messenger_set_option(TEST_TELEMETRY_MESSENGER_HANDLE, TELEMETRY_MESSENGER_OPTION_C2D_PREFETCH_COUNT, option_value));
+    }
+    else if (strcmp(DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH, option_name) == 0)
+    {
+        STRICT_EXPECTED_CALL(telemetry_messenger_set_option(TEST_TELEMETRY_MESSENGER_HANDLE, TELEMETRY_MESSENGER_OPTION_C2D_ADAPTIVE_PREFETCH, option_value));
+    }
     else if (strcmp(DEVICE_OPTION_SAVED_MESSENGER_OPTIONS, option_name) == 0)
     {
         STRICT_EXPECTED_CALL(OptionHandler_FeedOptions((OPTIONHANDLER_HANDLE)option_value, TEST_TELEMETRY_MESSENGER_HANDLE));
@@ -1790,6 +1806,64 @@ TEST_FUNCTION(device_set_option_MSGR_succeeds)
     device_destroy(handle);
 }
 
+// Tests_SRS_DEVICE_09_086: [If `name` refers to messenger module, it shall be passed along with `value` to telemetry_messenger_set_option]
+TEST_FUNCTION(device_set_option_MSGR_event_sender_options_succeed)
+{
+    // arrange
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != TEST_current_time, "Failed setting TEST_current_time");
+
+    DEVICE_CONFIG* config = get_device_config(DEVICE_AUTH_MODE_CBS);
+    AMQP_DEVICE_HANDLE handle = create_and_start_device(config, TEST_current_time);
+
+    size_t link_count = 4;
+    bool in_order = true;
+
+    umock_c_reset_all_calls();
+    set_expected_calls_for_device_set_option(handle, config, DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, &link_count);
+    set_expected_calls_for_device_set_option(handle, config, DEVICE_OPTION_EVENT_SEND_IN_ORDER, &in_order);
+
+    // act
+    int result1 = device_set_option(handle, DEVICE_OPTION_EVENT_SENDER_LINK_COUNT, &link_count);
+    int result2 = device_set_option(handle, DEVICE_OPTION_EVENT_SEND_IN_ORDER, &in_order);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+
+    // cleanup
+    device_destroy(handle);
+}
+
+// Tests_SRS_DEVICE_09_086: [If `name` refers to messenger module, it shall be passed along with `value` to telemetry_messenger_set_option]
+TEST_FUNCTION(device_set_option_MSGR_c2d_prefetch_options_succeed)
+{
+    // arrange
+    ASSERT_IS_TRUE_WITH_MSG(INDEFINITE_TIME != TEST_current_time, "Failed setting TEST_current_time");
+
+    DEVICE_CONFIG* config = get_device_config(DEVICE_AUTH_MODE_CBS);
+    AMQP_DEVICE_HANDLE handle = create_and_start_device(config, TEST_current_time);
+
+    size_t prefetch_count = 100;
+    bool adaptive_prefetch = true;
+
+    umock_c_reset_all_calls();
+    set_expected_calls_for_device_set_option(handle, config, DEVICE_OPTION_C2D_PREFETCH_COUNT, &prefetch_count);
+    set_expected_calls_for_device_set_option(handle, config, DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH, &adaptive_prefetch);
+
+    // act
+    int result1 = device_set_option(handle, DEVICE_OPTION_C2D_PREFETCH_COUNT, &prefetch_count);
+    int result2 = device_set_option(handle, DEVICE_OPTION_C2D_ADAPTIVE_PREFETCH, &adaptive_prefetch);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+
+    // cleanup
+    device_destroy(handle);
+}
+
 // Tests_SRS_DEVICE_09_088: [If `name` is DEVICE_OPTION_SAVED_AUTH_OPTIONS but CBS authentication is not being used, device_set_option shall return a non-zero result]
 TEST_FUNCTION(device_set_option_X509_saved_auth_options)
 {
@@ -0,0 +1,6 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#define GBALLOC_H
+
+#include "../../src/iothub_client_packet_id_table.c"
@@ -5,10 +5,12 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cstdint>
+#include <csignal>
 #else
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <signal.h>
 #endif
 
 static void* my_gballoc_malloc(size_t size)
@@ -37,6 +39,7 @@ static void my_gballoc_free(void* ptr)
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
@@ -113,6 +116,7 @@ static const IOTHUB_CLIENT_CORE_HANDLE TEST_IOTHUB_CLIENT_CORE_HANDLE1 = (IOTHUB
 #define TEST_IOTHUB_CLIENT_CORE_HANDLE2 (IOTHUB_CLIENT_CORE_HANDLE)0xDEAF
 #define TEST_CLIENTS_LOCK_HANDLE (LOCK_HANDLE)0x4445
 #define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4442
+#define TEST_COND_HANDLE (COND_HANDLE)0x4443
 
 static const TRANSPORT_LL_HANDLE TEST_TRANSPORT_LL_HANDLE = (TRANSPORT_LL_HANDLE)0x112233;
 static const LOCK_HANDLE TEST_LOCK_HANDLE = (LOCK_HANDLE)0x4443;
@@ -133,6 +137,8 @@ static const VECTOR_HANDLE TEST_VECTOR_HANDLE = (VECTOR_HANDLE)0x4444;
 static const char* TEST_CHAR = "TestChar";
 static THREAD_START_FUNC threadFunc = NULL;
 static void* threadFuncArg = NULL;
+static THREAD_START_FUNC firstThreadFunc = NULL;
+static void* firstThreadFuncArg = NULL;
 static size_t g_num_of_calls = 0;
 static size_t g_how_many_dowork_calls = 0;
 static TRANSPORT_HANDLE g_transport_handle = NULL;
@@ -205,11 +211,23 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
     ASSERT_FAIL(temp_str);
 }
 
+#ifdef __cplusplus
+extern "C" const size_t IoTHubTransport_ThreadTerminationOffset;
+#else
+extern const size_t IoTHubTransport_ThreadTerminationOffset;
+#endif
+
 static size_t clientDoWork_calls = 0;
+static void* clientDoWork_last_client = NULL;
+static TRANSPORT_HANDLE clientDoWork_stop_transport = NULL;
 static void clientDoWork(void* clientHandle)
 {
-    (void)clientHandle;
+    clientDoWork_last_client = clientHandle;
     clientDoWork_calls++;
+    if (clientDoWork_stop_transport != NULL)
+    {
+        *(sig_atomic_t*)(((char*)clientDoWork_stop_transport) + IoTHubTransport_ThreadTerminationOffset) = 1; /*tell the threads to stop*/
+    }
 }
 
 static LOCK_HANDLE my_Lock_Init(void)
@@ -237,6 +255,11 @@ static void my_VECTOR_destroy(VECTOR_HANDLE handle)
 static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
 {
     *threadHandle = TEST_THREAD_HANDLE;
+    if (firstThreadFunc == NULL)
+    {
+        firstThreadFunc = func;
+        firstThreadFuncArg = arg;
+    }
     threadFunc = func;
     threadFuncArg = arg;
     return THREADAPI_OK;
@@ -289,6 +312,9 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(PREDICATE_FUNCTION, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CORE_LL_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
 
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(gballoc_malloc, NULL);
@@ -324,6 +350,11 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(ThreadAPI_Join, THREADAPI_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Join, THREADAPI_ERROR);
     REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Sleep, my_ThreadAPI_Sleep);
+
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Post, COND_OK);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Wait, COND_OK);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -343,8 +374,12 @@ TEST_FUNCTION_INITIALIZE(method_init)
     umock_c_reset_all_calls();
 
     clientDoWork_calls = 0;
+    clientDoWork_last_client = NULL;
+    clientDoWork_stop_transport = NULL;
     threadFunc = NULL;
     threadFuncArg = NULL;
+    firstThreadFunc = NULL;
+    firstThreadFuncArg = NULL;
     g_num_of_calls = 0;
     g_how_many_dowork_calls = 0;
     g_transport_handle = NULL;
@@ -902,4 +937,209 @@ TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_success)
     IoTHubTransport_Destroy(handle);
 }
 
+TEST_FUNCTION(IoTHubTransport_SetClientWorkerThreadCount_handle_NULL_fail)
+{
+    //arrange
+
+    //act
+    int result = IoTHubTransport_SetClientWorkerThreadCount(NULL, 2);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
+TEST_FUNCTION(IoTHubTransport_SetClientWorkerThreadCount_success)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    int result = IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+
+    //assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_SetClientWorkerThreadCount_worker_thread_running_fail)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    int result = IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_StartWorkerThread_with_client_workers_success)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, handle));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_StartWorkerThread_client_worker_create_fails)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+
+    //assert
+    ASSERT_ARE_NOT_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_client_worker_thread_services_client)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    clientDoWork_stop_transport = handle;
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_size(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_element(IGNORED_PTR_ARG, 0));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Exit(IGNORED_NUM_ARG));
+
+    //act
+    ASSERT_IS_NOT_NULL(firstThreadFunc);
+    firstThreadFunc(firstThreadFuncArg);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, clientDoWork_calls);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork_last_client);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_JoinWorkerThread_with_client_workers_frees_them_under_the_clients_lock)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    (void)IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransport_JoinWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransport_Destroy(handle);
+}
+
+TEST_FUNCTION(IoTHubTransport_Destroy_with_client_workers_deinits_the_client_idle_condition)
+{
+    //arrange
+    TRANSPORT_HANDLE handle = IoTHubTransport_Create(TEST_CONFIG.protocol, TEST_CONFIG.iotHubName, TEST_CONFIG.iotHubSuffix);
+    (void)IoTHubTransport_SetClientWorkerThreadCount(handle, 2);
+    (void)IoTHubTransport_StartWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1, clientDoWork);
+    if (IoTHubTransport_SignalEndWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1))
+    {
+        IoTHubTransport_JoinWorkerThread(handle, TEST_IOTHUB_CLIENT_CORE_HANDLE1);
+    }
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(FAKE_IoTHubTransport_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    IoTHubTransport_Destroy(handle);
+
+    //assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 END_TEST_SUITE(iothubtransport_ut)
@@ -44,7 +44,11 @@ static void my_gballoc_free(void* ptr)
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/vector_types_internal.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/condition.h"
+#include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/optionhandler.h"
 
 #include "iothub_client_options.h"
 #include "iothub_client_version.h"
@@ -67,6 +71,8 @@ extern "C" {
     extern int real_BUFFER_append_build(BUFFER_HANDLE handle, const unsigned char* source, size_t size);
     extern BUFFER_HANDLE real_BUFFER_clone(BUFFER_HANDLE handle);
     extern BUFFER_HANDLE real_BUFFER_create(const unsigned char* source, size_t size);
+    extern int real_BUFFER_enlarge(BUFFER_HANDLE handle, size_t enlargeSize);
+    extern int real_BUFFER_shrink(BUFFER_HANDLE handle, size_t decreaseSize, bool fromEnd);
 
     extern int real_mallocAndStrcpy_s(char** destination, const char* source);
     extern int real_size_tToString(char* destination, size_t destinationSize, size_t value);
@@ -133,6 +139,11 @@ IMPLEMENT_UMOCK_C_ENUM_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, IOTHUB_CLIENT_CON
 #define TEST_PROPERTY_A_VALUE "value_of_a"
 
 #define TEST_HTTPAPIEX_HANDLE (HTTPAPIEX_HANDLE)0x343
+#define TEST_LOCK_HANDLE (LOCK_HANDLE)0x4401
+#define TEST_COND_HANDLE (COND_HANDLE)0x4402
+#define TEST_THREAD_HANDLE (THREAD_HANDLE)0x4403
+#define TEST_OPTIONHANDLER_HANDLE (OPTIONHANDLER_HANDLE)0x4404
+#define TEST_TICK_COUNTER_HANDLE (TICK_COUNTER_HANDLE)0x4404
 
 //static const bool thisIsTrue = true;
 //static const bool thisIsFalse = false;
@@ -522,6 +533,52 @@ static void my_HTTPAPIEX_Destroy(HTTPAPIEX_HANDLE handle)
     my_gballoc_free(handle);
 }
 
+/*the worker threads are not started, so every request of a DoWork pass is executed by the DoWork thread*/
+static THREADAPI_RESULT my_ThreadAPI_Create(THREAD_HANDLE* threadHandle, THREAD_START_FUNC func, void* arg)
+{
+    (void)func;
+    (void)arg;
+    *threadHandle = TEST_THREAD_HANDLE;
+    return THREADAPI_OK;
+}
+
+static time_t test_time_now;
+static time_t my_get_time(time_t* currentTime)
+{
+    (void)currentTime;
+    return test_time_now;
+}
+
+static double my_get_difftime(time_t stopTime, time_t startTime)
+{
+    return (double)(stopTime - startTime);
+}
+
+static tickcounter_ms_t test_current_ms;
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tickCounter, tickcounter_ms_t* currentMs)
+{
+    (void)tickCounter;
+    *currentMs = test_current_ms;
+    return 0;
+}
+
+static size_t executed_requests;
+static unsigned int test_sas_status_code; /*returned by HTTPAPIEX_SAS_ExecuteRequest*/
+static size_t my_IoTHubClientCore_LL_SendComplete_calls;
+static size_t executed_requests_at_first_SendComplete;
+
+static void my_IoTHubClientCore_LL_SendComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, PDLIST_ENTRY completed, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    (void)handle;
+    (void)completed;
+    (void)result;
+    if (my_IoTHubClientCore_LL_SendComplete_calls == 0)
+    {
+        executed_requests_at_first_SendComplete = executed_requests;
+    }
+    my_IoTHubClientCore_LL_SendComplete_calls++;
+}
+
 static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_GetOption(IOTHUB_CLIENT_CORE_LL_HANDLE handle, const char* option, void** value)
 {
     (void)handle;
@@ -539,6 +596,19 @@ static bool my_IoTHubClientCore_LL_MessageCallback(IOTHUB_CLIENT_CORE_LL_HANDLE
     return my_IoTHubClientCore_LL_MessageCallback_return_value;
 }
 
+static size_t my_IoTHubClientCore_LL_MessageDispositionComplete_calls;
+static IOTHUB_MESSAGE_HANDLE my_IoTHubClientCore_LL_MessageDispositionComplete_message;
+static IOTHUBMESSAGE_DISPOSITION_RESULT my_IoTHubClientCore_LL_MessageDispositionComplete_disposition;
+static IOTHUB_CLIENT_RESULT my_IoTHubClientCore_LL_MessageDispositionComplete_result;
+static void my_IoTHubClientCore_LL_MessageDispositionComplete(IOTHUB_CLIENT_CORE_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message, IOTHUBMESSAGE_DISPOSITION_RESULT disposition, IOTHUB_CLIENT_RESULT result)
+{
+    (void)handle;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_calls++;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_message = message;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_disposition = disposition;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_result = result;
+}
+
 static HTTP_HEADERS_HANDLE my_HTTPHeaders_Alloc(void)
 {
     return (HTTP_HEADERS_HANDLE)my_gballoc_malloc(1);
@@ -572,6 +642,7 @@ static HTTPAPIEX_RESULT my_HTTPAPIEX_ExecuteRequest(HTTPAPIEX_HANDLE handle, HTT
     (void)responseHttpHeadersHandle;
     (void)responseContent;
     *statusCode = 204;
+    executed_requests++;
     if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
     {
         real_BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
@@ -590,7 +661,8 @@ static HTTPAPIEX_RESULT my_HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sas
     (void)responseHeadersHandle;
     (void)requestContent;
     (void)responseContent;
-    *statusCode = 204;
+    *statusCode = test_sas_status_code;
+    executed_requests++;
     if (last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest != NULL)
     {
         real_BUFFER_delete(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
@@ -599,6 +671,16 @@ static HTTPAPIEX_RESULT my_HTTPAPIEX_SAS_ExecuteRequest(HTTPAPIEX_SAS_HANDLE sas
     return HTTPAPIEX_OK;
 }
 
+/*the references added by IoTHubMessage_Retain, released one by one by IoTHubMessage_Destroy before the message is freed*/
+static IOTHUB_MESSAGE_HANDLE retained_messages[8];
+static size_t retained_message_count;
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_Retain(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
+{
+    ASSERT_IS_TRUE(retained_message_count < sizeof(retained_messages) / sizeof(retained_messages[0]));
+    retained_messages[retained_message_count++] = iotHubMessageHandle;
+    return IOTHUB_MESSAGE_OK;
+}
+
 static IOTHUB_MESSAGE_HANDLE my_IoTHubMessage_CreateFromByteArray(const unsigned char* byteArray, size_t size)
 {
     (void)byteArray;
@@ -608,6 +690,16 @@ static IOTHUB_MESSAGE_HANDLE my_IoTHubMessage_CreateFromByteArray(const unsigned
 
 static void my_IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle)
 {
+    size_t i;
+    for (i = 0; i < retained_message_count; i++)
+    {
+        if (retained_messages[i] == iotHubMessageHandle)
+        {
+            retained_messages[i] = retained_messages[--retained_message_count];
+            return;
+        }
+    }
+
     if (iotHubMessageHandle != TEST_IOTHUB_MESSAGE_HANDLE_1 &&
         iotHubMessageHandle != TEST_IOTHUB_MESSAGE_HANDLE_2 &&
         iotHubMessageHandle != TEST_IOTHUB_MESSAGE_HANDLE_3 &&
@@ -840,6 +932,14 @@ static MAP_RESULT my_Map_GetInternals(MAP_HANDLE handle, const char*const** keys
     return MAP_OK;
 }
 
+static IOTHUB_MESSAGE_RESULT my_IoTHubMessage_GetProperties(IOTHUB_MESSAGE_HANDLE iotHubMessageHandle, const char* const** keys, const char* const** values, size_t* count, size_t* keysAndValuesLength)
+{
+    (void)keysAndValuesLength;
+    /*the message's properties are the ones my_IoTHubMessage_Properties hands out as a map*/
+    (void)my_Map_GetInternals(my_IoTHubMessage_Properties(iotHubMessageHandle), keys, values, count);
+    return IOTHUB_MESSAGE_OK;
+}
+
 static void setupCreateHappyPathAlloc(bool deallocateCreated)
 {
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
@@ -1140,6 +1240,22 @@ TEST_SUITE_INITIALIZE(suite_init)
 
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_CLIENT_CONFIRMATION_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_DISPOSITION_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(IOTHUBMESSAGE_CONTENT_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(COND_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREAD_START_FUNC, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(time_t, int64_t);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_RESULT, int);
+    REGISTER_UMOCK_ALIAS_TYPE(pfCloneOption, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(pfDestroyOption, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(pfSetOption, void*);
     /*REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(IOTHUB_MESSAGE_HANDLE, void*);*/
@@ -1159,6 +1275,10 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_length, real_BUFFER_length);
     REGISTER_GLOBAL_MOCK_HOOK(BUFFER_clone, real_BUFFER_clone);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_clone, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_enlarge, real_BUFFER_enlarge);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_enlarge, __LINE__);
+    REGISTER_GLOBAL_MOCK_HOOK(BUFFER_shrink, real_BUFFER_shrink);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(BUFFER_shrink, __LINE__);
 
     REGISTER_STRING_GLOBAL_MOCK_HOOK;
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_new, NULL);
@@ -1175,10 +1295,29 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_copy_n, __FAILURE__);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_empty, __FAILURE__);
 
+    REGISTER_GLOBAL_MOCK_HOOK(mallocAndStrcpy_s, real_mallocAndStrcpy_s);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(mallocAndStrcpy_s, __FAILURE__);
+
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_Create, my_HTTPAPIEX_Create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPAPIEX_Create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_Destroy, my_HTTPAPIEX_Destroy);
 
+    REGISTER_GLOBAL_MOCK_RETURN(Lock_Init, TEST_LOCK_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Lock_Init, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(Condition_Init, TEST_COND_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(Condition_Init, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(ThreadAPI_Create, my_ThreadAPI_Create);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(ThreadAPI_Create, THREADAPI_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_RETURN(OptionHandler_Create, TEST_OPTIONHANDLER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(OptionHandler_Create, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(OptionHandler_AddOption, OPTIONHANDLER_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(OptionHandler_AddOption, OPTIONHANDLER_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(OptionHandler_FeedOptions, OPTIONHANDLER_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(OptionHandler_FeedOptions, OPTIONHANDLER_ERROR);
+
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_create, real_VECTOR_create);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(VECTOR_create, NULL);
     REGISTER_GLOBAL_MOCK_HOOK(VECTOR_destroy, real_VECTOR_destroy);
@@ -1211,6 +1350,9 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_SetCorrelationId, IOTHUB_MESSAGE_ERROR);
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Destroy, my_IoTHubMessage_Destroy);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Retain, my_IoTHubMessage_Retain);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Retain, IOTHUB_MESSAGE_ERROR);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_MessageDispositionComplete, my_IoTHubClientCore_LL_MessageDispositionComplete);
     REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_Properties, my_IoTHubMessage_Properties);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_Properties, NULL);
 
@@ -1244,6 +1386,8 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(HTTPHeaders_ReplaceHeaderNameValuePair, HTTP_HEADERS_ERROR);
 
     REGISTER_GLOBAL_MOCK_HOOK(Map_GetInternals, my_Map_GetInternals);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubMessage_GetProperties, my_IoTHubMessage_GetProperties);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_GetProperties, IOTHUB_MESSAGE_ERROR);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_GetInternals, MAP_ERROR);
 
     REGISTER_GLOBAL_MOCK_HOOK(HTTPAPIEX_SAS_Destroy, my_HTTPAPIEX_SAS_Destroy);
@@ -1303,7 +1447,15 @@ TEST_SUITE_CLEANUP(suite_cleanup)
 static void reset_test_data()
 {
     last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest = NULL;
+    executed_requests = 0;
+    test_sas_status_code = 204;
+    retained_message_count = 0;
+    test_current_ms = 0;
+    my_IoTHubClientCore_LL_SendComplete_calls = 0;
+    executed_requests_at_first_SendComplete = 0;
     my_IoTHubClientCore_LL_MessageCallback_messageData = NULL;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_calls = 0;
+    my_IoTHubClientCore_LL_MessageDispositionComplete_message = NULL;
 }
 
 TEST_FUNCTION_INITIALIZE(method_init)
@@ -3562,6 +3714,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", TEST_STRING_DATA));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)); /*the unquoted ETag*/
 
     STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)); /*because abandon relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
@@ -3580,7 +3733,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_and
 
     STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
 
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
@@ -3666,6 +3818,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_asy
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "User-Agent", TEST_STRING_DATA));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "Authorization", TEST_BLANK_SAS_TOKEN));
     STRICT_EXPECTED_CALL(HTTPHeaders_AddHeaderNameValuePair(IGNORED_PTR_ARG, "If-Match", TEST_ETAG_VALUE));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)); /*the unquoted ETag*/
     STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)); /*because relativePath is a STRING_HANDLE*/
     STRICT_EXPECTED_CALL(HTTPAPIEX_SAS_ExecuteRequest(
         IGNORED_PTR_ARG,                                    /*sasObject handle                                             */
@@ -3683,7 +3836,6 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_happy_path_with_empty_waitingToSend_asy
 
     STRICT_EXPECTED_CALL(HTTPHeaders_Free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG));
 
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
@@ -8023,6 +8175,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_item_happy_path_succeeds)
 }
 
 //Tests_SRS_TRANSPORTMULTITHTTP_17_081: [ If HTTPAPIEX_SAS_ExecuteRequest2 fails or the http status code >=300 then IoTHubTransportHttp_DoWork shall not do any other action (it is assumed at the next _DoWork it shall be retried). ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_023: [ Events put back in waitingToSend shall be reported with IoTHubClientCore_LL_MessagesPutBack. ]
 TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_http_status_is_404)
 {
     //arrange
@@ -8132,6 +8285,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_ht
     STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_MessagesPutBack(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
 
     ENABLE_BATCHING();
 
@@ -8256,6 +8410,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_HT
     STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_MessagesPutBack(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
 
     ENABLE_BATCHING();
 
@@ -8364,6 +8519,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
     STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_MessagesPutBack(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
 
     ENABLE_BATCHING();
 
@@ -8460,6 +8616,7 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_1_event_items_puts_it_back_when_BU
     STRICT_EXPECTED_CALL(DList_AppendTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG)).IgnoreAllArguments();
     STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_MessagesPutBack(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE));
 
     ENABLE_BATCHING();
 
@@ -10672,8 +10829,28 @@ TEST_FUNCTION(IoTHubTransportHttp_SetOption_with_NULL_value_fails)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+//Tests_SRS_TRANSPORTMULTITHTTP_31_001: [ "message_pool_size" shall be accepted and IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_OK, the transport keeps no per message records of its own to pool. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_message_pool_size_is_not_passed_to_HTTPAPIEX)
+{
+    //arrange
+    size_t poolSize = 16;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_MESSAGE_POOL_SIZE, &poolSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 //Tests_SRS_TRANSPORTMULTITHTTP_17_119: [ The following table translates HTTPAPIEX return codes to IOTHUB_CLIENT_RESULT return codes: ]
 //Tests_SRS_TRANSPORTMULTITHTTP_17_118: [ Otherwise, IoTHubTransport_Http shall call HTTPAPIEX_SetOption with the same parameters and return the translated code. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_024: [ Until the workers are started, every option accepted by HTTPAPIEX_SetOption shall be saved with OptionHandler_AddOption. ]
 TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
 {
     //arrange
@@ -10682,6 +10859,10 @@ TEST_FUNCTION(IoTHubTransportHttp_SetOption_succeeds_when_HTTPAPIEX_succeeds)
     umock_c_reset_all_calls();
 
     STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+    STRICT_EXPECTED_CALL(OptionHandler_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, "someOption", (void*)42));
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
 
     //act
     auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
@@ -13962,7 +14143,8 @@ TEST_FUNCTION(IoTHubTransportHttp_DoWork_SetCustomContentType_SetContentEncoding
     STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
     STRICT_EXPECTED_CALL(IoTHubMessage_Clone(IGNORED_PTR_ARG)).SetReturn(TEST_IOTHUB_MESSAGE_HANDLE_8);
     STRICT_EXPECTED_CALL(mallocAndStrcpy_s(IGNORED_NUM_ARG, IGNORED_NUM_ARG))
-        .CopyOutArgumentBuffer_destination(&real_ETAG, sizeof(&real_ETAG));
+        .CopyOutArgumentBuffer_destination(&real_ETAG, sizeof(&real_ETAG))
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(IoTHubClientCore_LL_MessageCallback(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(IoTHubMessage_Destroy(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(BUFFER_delete(IGNORED_PTR_ARG));
@@ -14357,5 +14539,822 @@ TEST_FUNCTION(IoTHubTransportHttp_Subscribe_DeviceTwin_returns)
     IoTHubTransportHttp_Destroy(handle);
 }
 
+static void assert_batched_payload(const char* expected)
+{
+    ASSERT_IS_NOT_NULL(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest);
+    ASSERT_ARE_EQUAL(size_t, strlen(expected), real_BUFFER_length(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest));
+    ASSERT_ARE_EQUAL(int, 0, memcmp(expected, real_BUFFER_u_char(last_BUFFER_HANDLE_to_HTTPAPIEX_ExecuteRequest), strlen(expected)));
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_056: [ IoTHubTransportHttp_DoWork shall build the following string:[{"body":"base64 encoding of the message1 content"},{"body":"base64 encoding of the message2 content"}...] ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2} ]
+//Tests_SRS_TRANSPORTMULTITHTTP_17_064: [ If IoTHubMessage does not have properties, then "properties":{...} shall be missing from the payload. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_writes_all_event_items_into_1_reused_buffer)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    assert_batched_payload("[{\"body\":\"MQ==\"},{\"body\":\"MTIzNDU2\",\"properties\":{\"iothub-app-" TEST_RED_KEY "\":\"" TEST_RED_VALUE "\"}}]");
+    DList_InsertTailList(&(waitingToSend), &(message2.entry));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(IoTHubClientCore_LL_SendComplete(TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, IGNORED_PTR_ARG, IOTHUB_CLIENT_CONFIRMATION_OK));
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    assert_batched_payload("[{\"body\":\"MjI=\"}]");
+    ASSERT_ARE_EQUAL(char_ptr, "", umock_c_get_expected_calls());
+    /*the buffer of the first batch is reused*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "BUFFER_new"));
+    ASSERT_IS_TRUE(real_DList_IsListEmpty(&waitingToSend));
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_058: [ If IoTHubMessage has properties, then they shall be serialized at the same level as "body" using the following pattern: "properties":{"iothub-app-name1":"value1","iothub-app-name2":"value2} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_reads_properties_without_a_map)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message6.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    assert_batched_payload("[{\"body\":\"MTIzNDU2\",\"properties\":{\"iothub-app-" TEST_RED_KEY "\":\"" TEST_RED_VALUE "\"}}]");
+    ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "IoTHubMessage_GetProperties"));
+    /*IoTHubMessage_Properties would convert the message's properties into a MAP_HANDLE*/
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "IoTHubMessage_Properties"));
+    ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "Map_GetInternals"));
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_057: [ If a messages to be send has type IOTHUBMESSAGE_STRING, then its serialization shall be {"body":"JSON encoding of the string", "base64Encoded":false} ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_writes_string_event_item_as_JSON)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message10.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+    umock_c_reset_all_calls();
+
+    /*once to measure the event, once to write it*/
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(message10.messageHandle))
+        .SetReturn(IOTHUBMESSAGE_STRING);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(message10.messageHandle))
+        .SetReturn(string10);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetContentType(message10.messageHandle))
+        .SetReturn(IOTHUBMESSAGE_STRING);
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetString(message10.messageHandle))
+        .SetReturn(string10);
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    assert_batched_payload("[{\"body\":\"thisgoestoJ\\\\s\\/\\/on\\\"ToBeEn\\u000D\\u000A\\u0008coded\",\"base64Encoded\":false}]");
+    ASSERT_ARE_EQUAL(char_ptr, "", umock_c_get_expected_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_17_061: [ The message size shall be limited to 255KB - 1 byte. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_batched_stops_at_the_event_item_that_does_not_fit)
+{
+    //arrange
+    bool batching = true;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend), &(message5.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    assert_batched_payload("[{\"body\":\"MQ==\"}]");
+    ASSERT_ARE_EQUAL(void_ptr, &(message5.entry), waitingToSend.Flink);
+    ASSERT_ARE_EQUAL(void_ptr, &(message5.entry), waitingToSend.Blink);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+//Tests_SRS_TRANSPORTMULTITHTTP_31_002: [ "http_max_concurrent_requests" ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_006: [ Otherwise IoTHubTransportHttp_SetOption shall start "http_max_concurrent_requests" - 1 worker threads, each with its own HTTPAPIEX_HANDLE created by HTTPAPIEX_Create. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_starts_workers_with_their_own_connection)
+{
+    //arrange
+    size_t maxConcurrentRequests = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+#else
+//Tests_SRS_TRANSPORTMULTITHTTP_31_002: [ "http_max_concurrent_requests" ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_026: [ If the SDK was built with DONT_USE_HTTP_WORKER_THREADS, a value of "http_max_concurrent_requests" above 1 shall make IoTHubTransportHttp_SetOption return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_2_fails_without_worker_threads)
+{
+    //arrange
+    size_t maxConcurrentRequests = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_1_starts_no_worker)
+{
+    //arrange
+    size_t maxConcurrentRequests = 1;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_004: [ If the value of "http_max_concurrent_requests" is 0 then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_INVALID_ARG. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_0_fails)
+{
+    //arrange
+    size_t maxConcurrentRequests = 0;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+#ifndef DONT_USE_HTTP_WORKER_THREADS
+//Tests_SRS_TRANSPORTMULTITHTTP_31_025: [ The saved options shall be set on the HTTPAPIEX_HANDLE of every worker with OptionHandler_FeedOptions before its thread starts. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_after_an_HTTPAPIEX_option_sets_it_on_every_worker)
+{
+    //arrange
+    size_t maxConcurrentRequests = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_FeedOptions(TEST_OPTIONHANDLER_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_FeedOptions(TEST_OPTIONHANDLER_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_Destroy(TEST_OPTIONHANDLER_HANDLE));
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_007: [ If starting the workers fails, IoTHubTransportHttp_SetOption shall release what was started and return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_fails_when_an_HTTPAPIEX_option_cannot_be_set_on_a_worker)
+{
+    //arrange
+    size_t maxConcurrentRequests = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_FeedOptions(TEST_OPTIONHANDLER_HANDLE, IGNORED_PTR_ARG))
+        .SetReturn(OPTIONHANDLER_ERROR);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_005: [ If "http_max_concurrent_requests" was already set to more than 1, or an option passed to HTTPAPIEX_SetOption could not be saved, then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_after_an_HTTPAPIEX_option_could_not_be_saved_fails)
+{
+    //arrange
+    size_t maxConcurrentRequests = 4;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(TEST_HTTPAPIEX_HANDLE, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(OptionHandler_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(OptionHandler_AddOption(TEST_OPTIONHANDLER_HANDLE, "someOption", (void*)42))
+        .SetReturn(OPTIONHANDLER_ERROR);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42));
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_005: [ If "http_max_concurrent_requests" was already set to more than 1, or an option passed to HTTPAPIEX_SetOption could not be saved, then IoTHubTransportHttp_SetOption shall return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_twice_fails)
+{
+    //arrange
+    size_t maxConcurrentRequests = 2;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+    umock_c_reset_all_calls();
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_007: [ If starting the workers fails, IoTHubTransportHttp_SetOption shall release what was started and return IOTHUB_CLIENT_ERROR. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_max_concurrent_requests_stops_the_started_workers_when_1_fails)
+{
+    //arrange
+    size_t maxConcurrentRequests = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(Lock_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(Condition_Init());
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Create(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_ERROR);
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Lock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Post(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Unlock(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(ThreadAPI_Join(TEST_THREAD_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_Destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Condition_Deinit(TEST_COND_HANDLE));
+    STRICT_EXPECTED_CALL(Lock_Deinit(TEST_LOCK_HANDLE));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_008: [ The option shall also be passed to the HTTPAPIEX_HANDLE of every worker; the first failure is the one returned. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_passes_HTTPAPIEX_options_to_every_worker)
+{
+    //arrange
+    size_t maxConcurrentRequests = 3;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(IGNORED_PTR_ARG, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(IGNORED_PTR_ARG, "someOption", (void*)42));
+    STRICT_EXPECTED_CALL(HTTPAPIEX_SetOption(IGNORED_PTR_ARG, "someOption", (void*)42))
+        .SetReturn(HTTPAPIEX_INVALID_ARG);
+
+    //act
+    auto result = IoTHubTransportHttp_SetOption(handle, "someOption", (void*)42);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_INVALID_ARG, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_003: [ When "http_max_concurrent_requests" is more than 1, IoTHubTransportHttp_DoWork shall first prepare the event and C2D requests of every device, then execute them on up to "http_max_concurrent_requests" connections at the same time, then process their outcomes on the calling thread, device by device, in list order. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_http_max_concurrent_requests_executes_all_devices_before_completing_any)
+{
+    //arrange
+    bool batching = true;
+    size_t maxConcurrentRequests = 2;
+    DList_InsertTailList(&(waitingToSend), &(message1.entry));
+    DList_InsertTailList(&(waitingToSend2), &(message2.entry));
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_MAX_CONCURRENT_REQUESTS, &maxConcurrentRequests);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Register(handle, &TEST_DEVICE_2, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE2, TEST_CONFIG2.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_BATCHING, &batching);
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendComplete, my_IoTHubClientCore_LL_SendComplete);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests);
+    ASSERT_ARE_EQUAL(size_t, 2, my_IoTHubClientCore_LL_SendComplete_calls);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests_at_first_SendComplete);
+    ASSERT_IS_TRUE(real_DList_IsListEmpty(&waitingToSend));
+    ASSERT_IS_TRUE(real_DList_IsListEmpty(&waitingToSend2));
+
+    //cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(IoTHubClientCore_LL_SendComplete, NULL);
+    IoTHubTransportHttp_Destroy(handle);
+}
+#endif /*DONT_USE_HTTP_WORKER_THREADS*/
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_009: [ "http_adaptive_polling_min_time" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_adaptive_polling_min_time_succeeds)
+{
+    //arrange
+    unsigned int minTime = 10;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_ADAPTIVE_POLLING_MIN_TIME, &minTime);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_011: [ When "http_adaptive_polling_min_time" is not 0, the delay of the device computed after its last poll shall be used instead of GetMinimumPollingTime. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_013: [ After a poll that the service answered with 204 (no message) the backoff of the device shall double, without going under "http_adaptive_polling_min_time" nor over GetMinimumPollingTime, and the next poll shall happen a random number of seconds between half the backoff and the backoff later. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_adaptive_polling_backs_off_after_empty_polls)
+{
+    //arrange
+    unsigned int minTime = 10;
+    unsigned int maxTime = 40;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &maxTime);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_ADAPTIVE_POLLING_MIN_TIME, &minTime);
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, my_get_time);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, my_get_difftime);
+    test_time_now = 100;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    umock_c_reset_all_calls();
+
+    //act
+    test_time_now = 110; /*the first backoff is the minimum, so this is not later than the delay*/
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_at_110 = executed_requests;
+    test_time_now = 111;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_at_111 = executed_requests;
+    test_time_now = 120; /*the backoff doubled to 20, the delay is at least 10*/
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_at_120 = executed_requests;
+    test_time_now = 132;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests_at_110);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests_at_111);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests_at_120);
+    ASSERT_ARE_EQUAL(size_t, 3, executed_requests);
+
+    //cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, NULL);
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_013: [ After a poll that the service answered with 204 (no message) the backoff of the device shall double, without going under "http_adaptive_polling_min_time" nor over GetMinimumPollingTime, and the next poll shall happen a random number of seconds between half the backoff and the backoff later. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_adaptive_polling_failed_polls_do_not_back_off)
+{
+    //arrange
+    unsigned int minTime = 10;
+    unsigned int maxTime = 40;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_MIN_POLLING_TIME, &maxTime);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_ADAPTIVE_POLLING_MIN_TIME, &minTime);
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, my_get_time);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, my_get_difftime);
+    test_time_now = 100;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    test_sas_status_code = 500;
+    umock_c_reset_all_calls();
+
+    //act
+    test_time_now = 111; /*polls happen once more than the delay (10) has passed*/
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    test_time_now = 122; /*the 500 left the delay at the minimum*/
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    test_time_now = 133;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 4, executed_requests);
+
+    //cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, NULL);
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_010: [ "http_poll_now" set to true shall make the next _DoWork poll every subscribed device no matter when it was last polled, and restart the backoff of the devices from "http_adaptive_polling_min_time". ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_poll_now_polls_on_the_next_DoWork)
+{
+    //arrange
+    bool pollNow = true;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_Subscribe(devHandle);
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, my_get_time);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, my_get_difftime);
+    test_time_now = 100;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    test_time_now = 101;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_before_poll_now = executed_requests;
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_POLL_NOW, &pollNow);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests_before_poll_now);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests);
+
+    //cleanup
+    REGISTER_GLOBAL_MOCK_HOOK(get_time, NULL);
+    REGISTER_GLOBAL_MOCK_HOOK(get_difftime, NULL);
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_014: [ "http_disposition_batch_size" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_disposition_batch_size_succeeds)
+{
+    //arrange
+    size_t batchSize = 16;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG));
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_014: [ "http_disposition_batch_size" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_disposition_batch_size_fails_when_VECTOR_create_fails)
+{
+    //arrange
+    size_t batchSize = 16;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(VECTOR_create(IGNORED_NUM_ARG))
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_015: [ "http_disposition_batch_window_ms" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_disposition_batch_window_ms_creates_a_tickcounter)
+{
+    //arrange
+    size_t windowMs = 500;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_create());
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, &windowMs);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_015: [ "http_disposition_batch_window_ms" ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_disposition_batch_window_ms_fails_when_tickcounter_create_fails)
+{
+    //arrange
+    size_t windowMs = 500;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(tickcounter_create())
+        .SetReturn(NULL);
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, &windowMs);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_016: [ When "http_disposition_batch_size" is not 0, the "abandon", "complete" and "reject" requests shall be queued and reported as successful, their outcome being reported later by IoTHubClientCore_LL_MessageDispositionComplete. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_017: [ At the end of IoTHubTransportHttp_DoWork the queued dispositions shall be sent when there are "http_disposition_batch_size" of them, or when the oldest was queued "http_disposition_batch_window_ms" milliseconds ago or more. ]
+TEST_FUNCTION(IoTHubTransportHttp_SendMessageDisposition_with_http_disposition_batch_size_sends_at_the_end_of_DoWork)
+{
+    //arrange
+    size_t batchSize = 16;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    MESSAGE_CALLBACK_INFO* test_message = make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SendMessageDisposition(test_message, IOTHUBMESSAGE_ACCEPTED);
+    size_t executed_requests_before_DoWork = executed_requests;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 0, executed_requests_before_DoWork);
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_017: [ At the end of IoTHubTransportHttp_DoWork the queued dispositions shall be sent when there are "http_disposition_batch_size" of them, or when the oldest was queued "http_disposition_batch_window_ms" milliseconds ago or more. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_with_http_disposition_batch_window_ms_waits_for_the_count_or_the_window)
+{
+    //arrange
+    size_t batchSize = 2;
+    size_t windowMs = 1000;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, &windowMs);
+    umock_c_reset_all_calls();
+
+    //act
+    test_current_ms = 100;
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_ACCEPTED);
+    test_current_ms = 600;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_with_1_queued = executed_requests;
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_REJECTED);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_with_2_queued = executed_requests;
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_ABANDONED);
+    test_current_ms = 1599;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_before_the_window = executed_requests;
+    test_current_ms = 1600;
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, executed_requests_with_1_queued);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests_with_2_queued);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests_before_the_window);
+    ASSERT_ARE_EQUAL(size_t, 3, executed_requests);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_020: [ IoTHubTransportHttp_Unregister and IoTHubTransportHttp_Destroy shall first send all the queued dispositions. ]
+TEST_FUNCTION(IoTHubTransportHttp_Unregister_sends_the_queued_dispositions)
+{
+    //arrange
+    size_t batchSize = 16;
+    size_t windowMs = 1000;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, &windowMs);
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_ACCEPTED);
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+    size_t executed_requests_before_Unregister = executed_requests;
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_Unregister(devHandle);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, executed_requests_before_Unregister);
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_021: [ Setting "http_disposition_batch_size" to 0 shall send the queued dispositions and go back to sending every disposition as it comes. ]
+TEST_FUNCTION(IoTHubTransportHttp_SetOption_http_disposition_batch_size_0_sends_the_queued_dispositions)
+{
+    //arrange
+    size_t batchSize = 16;
+    size_t noBatch = 0;
+    size_t windowMs = 1000;
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_WINDOW_MS, &windowMs);
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_ACCEPTED);
+    umock_c_reset_all_calls();
+
+    //act
+    IOTHUB_CLIENT_RESULT result = IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &noBatch);
+    size_t executed_requests_after_SetOption = executed_requests;
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data((IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1), handle, devHandle), IOTHUBMESSAGE_ACCEPTED);
+
+    //assert
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, result);
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests_after_SetOption);
+    ASSERT_ARE_EQUAL(size_t, 2, executed_requests);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_022: [ For every queued disposition of a message handed to the client, IoTHubClientCore_LL_MessageDispositionComplete shall be called with the message, the disposition and IOTHUB_CLIENT_OK when the request succeeded, IOTHUB_CLIENT_ERROR otherwise, then the message shall be released. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_reports_the_outcome_of_the_queued_dispositions)
+{
+    //arrange
+    size_t batchSize = 16;
+    IOTHUB_MESSAGE_HANDLE message = (IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data(message, handle, devHandle), IOTHUBMESSAGE_ACCEPTED);
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 1, executed_requests);
+    ASSERT_ARE_EQUAL(size_t, 0, retained_message_count);
+    ASSERT_ARE_EQUAL(size_t, 1, my_IoTHubClientCore_LL_MessageDispositionComplete_calls);
+    ASSERT_ARE_EQUAL(void_ptr, message, my_IoTHubClientCore_LL_MessageDispositionComplete_message);
+    ASSERT_ARE_EQUAL(int, IOTHUBMESSAGE_ACCEPTED, my_IoTHubClientCore_LL_MessageDispositionComplete_disposition);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_OK, my_IoTHubClientCore_LL_MessageDispositionComplete_result);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
+//Tests_SRS_TRANSPORTMULTITHTTP_31_019: [ Every queued disposition that fails shall be logged with the ETag of its message. ]
+//Tests_SRS_TRANSPORTMULTITHTTP_31_022: [ For every queued disposition of a message handed to the client, IoTHubClientCore_LL_MessageDispositionComplete shall be called with the message, the disposition and IOTHUB_CLIENT_OK when the request succeeded, IOTHUB_CLIENT_ERROR otherwise, then the message shall be released. ]
+TEST_FUNCTION(IoTHubTransportHttp_DoWork_reports_a_queued_disposition_that_failed)
+{
+    //arrange
+    size_t batchSize = 16;
+    IOTHUB_MESSAGE_HANDLE message = (IOTHUB_MESSAGE_HANDLE)my_gballoc_malloc(1);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportHttp_Create(&TEST_CONFIG);
+    IOTHUB_DEVICE_HANDLE devHandle = IoTHubTransportHttp_Register(handle, &TEST_DEVICE_1, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE, TEST_CONFIG.waitingToSend);
+    (void)IoTHubTransportHttp_SetOption(handle, OPTION_HTTP_DISPOSITION_BATCH_SIZE, &batchSize);
+    (void)IoTHubTransportHttp_SendMessageDisposition(make_transport_context_data(message, handle, devHandle), IOTHUBMESSAGE_REJECTED);
+    test_sas_status_code = 412;
+    umock_c_reset_all_calls();
+
+    //act
+    IoTHubTransportHttp_DoWork(handle, TEST_IOTHUB_CLIENT_CORE_LL_HANDLE);
+
+    //assert
+    ASSERT_ARE_EQUAL(size_t, 0, retained_message_count);
+    ASSERT_ARE_EQUAL(size_t, 1, my_IoTHubClientCore_LL_MessageDispositionComplete_calls);
+    ASSERT_ARE_EQUAL(void_ptr, message, my_IoTHubClientCore_LL_MessageDispositionComplete_message);
+    ASSERT_ARE_EQUAL(int, IOTHUBMESSAGE_REJECTED, my_IoTHubClientCore_LL_MessageDispositionComplete_disposition);
+    ASSERT_ARE_EQUAL(IOTHUB_CLIENT_RESULT, IOTHUB_CLIENT_ERROR, my_IoTHubClientCore_LL_MessageDispositionComplete_result);
+
+    //cleanup
+    IoTHubTransportHttp_Destroy(handle);
+}
+
 END_TEST_SUITE(iothubtransporthttp_ut)
 
@@ -97,6 +97,7 @@ static pfIoTHubTransport_Unsubscribe                IoTHubTransportMqtt_Unsubscr
 static pfIoTHubTransport_DoWork                     IoTHubTransportMqtt_DoWork;
 static pfIoTHubTransport_SetRetryPolicy             IoTHubTransportMqtt_SetRetryPolicy;
 static pfIoTHubTransport_GetSendStatus              IoTHubTransportMqtt_GetSendStatus;
+static pfIoTHubTransport_GetTimeToNextDeadline      IoTHubTransportMqtt_GetTimeToNextDeadline;
 static pfIoTHubTransport_Subscribe_DeviceTwin       IoTHubTransportMqtt_Subscribe_DeviceTwin;
 static pfIoTHubTransport_Unsubscribe_DeviceTwin     IoTHubTransportMqtt_Unsubscribe_DeviceTwin;
 static pfIoTHubTransport_Subscribe_DeviceMethod     IoTHubTransportMqtt_Subscribe_DeviceMethod;
@@ -335,6 +336,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     IoTHubTransportMqtt_DoWork = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_DoWork;
     IoTHubTransportMqtt_SetRetryPolicy = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_SetRetryPolicy;
     IoTHubTransportMqtt_GetSendStatus = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_GetSendStatus;
+    IoTHubTransportMqtt_GetTimeToNextDeadline = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_GetTimeToNextDeadline;
     IoTHubTransportMqtt_Subscribe_DeviceTwin = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_Subscribe_DeviceTwin;
     IoTHubTransportMqtt_Unsubscribe_DeviceTwin = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_Unsubscribe_DeviceTwin;
     IoTHubTransportMqtt_Subscribe_DeviceMethod = ((TRANSPORT_PROVIDER*)MQTT_Protocol())->IoTHubTransport_Subscribe_DeviceMethod;
@@ -709,6 +711,29 @@ TEST_FUNCTION(IoTHubTransportMqtt_GetSendStatus_success)
     //cleanup
 }
 
+/* Tests_SRS_IOTHUB_MQTT_TRANSPORT_31_001: [ IoTHubTransportMqtt_GetTimeToNextDeadline shall get the time to the next deadline by calling into the IoTHubTransport_MQTT_Common_GetTimeToNextDeadline function. ] */
+TEST_FUNCTION(IoTHubTransportMqtt_GetTimeToNextDeadline_success)
+{
+    // arrange
+    IOTHUBTRANSPORT_CONFIG config = { 0 };
+    SetupIothubTransportConfig(&config, TEST_DEVICE_ID, TEST_DEVICE_KEY, TEST_IOTHUB_NAME, TEST_IOTHUB_SUFFIX, TEST_PROTOCOL_GATEWAY_HOSTNAME);
+    TRANSPORT_LL_HANDLE handle = IoTHubTransportMqtt_Create(&config);
+    umock_c_reset_all_calls();
+
+    tickcounter_ms_t msToNextDeadline;
+
+    // act
+    STRICT_EXPECTED_CALL(IoTHubTransport_MQTT_Common_GetTimeToNextDeadline(handle, &msToNextDeadline));
+
+    int result = IoTHubTransportMqtt_GetTimeToNextDeadline(handle, &msToNextDeadline);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //cleanup
+}
+
 /* Tests_SRS_IOTHUB_MQTT_TRANSPORT_07_009: [ IoTHubTransportMqtt_SetOption shall set the options by calling into the IoTHubMqttAbstract_SetOption function. ] */
 TEST_FUNCTION(IoTHubTransportMqtt_SetOption_success)
 {
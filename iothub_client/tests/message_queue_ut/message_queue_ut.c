@@ -41,12 +41,29 @@ void real_free(void* ptr)
 #define ENABLE_MOCKS
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/optionhandler.h"
-#include "azure_c_shared_utility/agenttime.h" 
-#include "azure_c_shared_utility/singlylinkedlist.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/doublylinkedlist.h"
 #undef ENABLE_MOCKS
 
 #include "internal/message_queue.h"
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    extern void real_DList_InitializeListHead(PDLIST_ENTRY listHead);
+    extern int real_DList_IsListEmpty(const PDLIST_ENTRY listHead);
+    extern void real_DList_InsertTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_InsertHeadList(PDLIST_ENTRY listHead, PDLIST_ENTRY listEntry);
+    extern void real_DList_AppendTailList(PDLIST_ENTRY listHead, PDLIST_ENTRY ListToAppend);
+    extern int real_DList_RemoveEntryList(PDLIST_ENTRY listEntry);
+    extern PDLIST_ENTRY real_DList_RemoveHeadList(PDLIST_ENTRY listHead);
+
+#ifdef __cplusplus
+}
+#endif
+
 static TEST_MUTEX_HANDLE g_testByTest;
 static TEST_MUTEX_HANDLE g_dllByDll;
 
@@ -62,7 +79,6 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 
 // Data definitions
 
-#define INDEFINITE_TIME                     ((time_t)-1)
 #define TEST_OPTIONHANDLER_HANDLE           (OPTIONHANDLER_HANDLE)0x7771
 #define TEST_PROCESS_MESSAGE_CONTEXT        (void*)0x7772
 #define TEST_PROCESS_COMPLETE_CONTEXT       (void*)0x7773
@@ -70,32 +86,33 @@ static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 #define USE_DEFAULT_CONFIG                  NULL
 #define TEST_SOME_OTHER_MESSAGE             (MQ_MESSAGE_HANDLE)0x7777
 #define TEST_MQ_MESSAGE_HANDLE_2            (MQ_MESSAGE_HANDLE)0x7778
-#define TEST_LIST_ITEM_HANDLE               (LIST_ITEM_HANDLE)0x7779
-#define TEST_LIST_ITEM_VALUE                (void*)0x7780
 #define TEST_REASON                         (void*)0x7781
+#define TEST_TICK_COUNTER_HANDLE            (TICK_COUNTER_HANDLE)0x7782
+#define TEST_BASE_MQ_MESSAGE_COUNT          20
+#define TEST_IN_PROGRESS_INDEX_INITIAL_SIZE 16
 
 
-static MQ_MESSAGE_HANDLE TEST_BASE_MQ_MESSAGE_HANDLE[10];
-static time_t TEST_current_time;
+static MQ_MESSAGE_HANDLE TEST_BASE_MQ_MESSAGE_HANDLE[TEST_BASE_MQ_MESSAGE_COUNT];
+static tickcounter_ms_t TEST_current_ms;
 
-
-typedef struct TEST_MESSAGE_EXPIRATION_PROFILE_TAG
+// Helpers
+static int should_skip_index(size_t current_index, const size_t skip_array[], size_t length)
 {
-    double max_message_enqueued_time_secs;
-    double max_message_processing_time_secs;
-    size_t* expired_pending_messages;
-    size_t expired_pending_messages_size;
-    size_t* expired_enqueued_in_progress_messages;
-    size_t expired_enqueued_in_progress_messages_size;
-    size_t* expired_in_progress_messages;
-    size_t expired_in_progress_messages_size;
-} TEST_MESSAGE_EXPIRATION_PROFILE;
-
-static TEST_MESSAGE_EXPIRATION_PROFILE TEST_test_message_expiration_profile;
+    int result = 0;
+    size_t index;
+    for (index = 0; index < length; index++)
+    {
+        if (current_index == skip_array[index])
+        {
+            result = __LINE__;
+            break;
+        }
+    }
+    return result;
+}
 
-// Helpers
 static int saved_malloc_returns_count = 0;
-static void* saved_malloc_returns[20];
+static void* saved_malloc_returns[64];
 
 static void* TEST_malloc(size_t size)
 {
@@ -130,40 +147,11 @@ static OPTIONHANDLER_RESULT TEST_OptionHandler_AddOption(OPTIONHANDLER_HANDLE ha
     return TEST_OptionHandler_AddOption_result;
 }
 
-#ifdef __cplusplus
-extern "C"
-{
-#endif
-
-    SINGLYLINKEDLIST_HANDLE real_singlylinkedlist_create(void);
-    void real_singlylinkedlist_destroy(SINGLYLINKEDLIST_HANDLE list);
-    LIST_ITEM_HANDLE real_singlylinkedlist_add(SINGLYLINKEDLIST_HANDLE list, const void* item);
-    int real_singlylinkedlist_remove(SINGLYLINKEDLIST_HANDLE list, LIST_ITEM_HANDLE item_handle);
-    LIST_ITEM_HANDLE real_singlylinkedlist_get_head_item(SINGLYLINKEDLIST_HANDLE list);
-    LIST_ITEM_HANDLE real_singlylinkedlist_get_next_item(LIST_ITEM_HANDLE item_handle);
-    LIST_ITEM_HANDLE real_singlylinkedlist_find(SINGLYLINKEDLIST_HANDLE list, LIST_MATCH_FUNCTION match_function, const void* match_context);
-    const void* real_singlylinkedlist_item_get_value(LIST_ITEM_HANDLE item_handle);
-
-#ifdef __cplusplus
-}
-#endif
-
-static time_t add_seconds(time_t base_time, int seconds)
+static int TEST_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* current_ms)
 {
-    time_t new_time;
-    struct tm *bd_new_time;
-
-    if ((bd_new_time = localtime(&base_time)) == NULL)
-    {
-        new_time = INDEFINITE_TIME;
-    }
-    else
-    {
-        bd_new_time->tm_sec += seconds;
-        new_time = mktime(bd_new_time);
-    }
-
-    return new_time;
+    (void)tick_counter;
+    *current_ms = TEST_current_ms;
+    return 0;
 }
 
 static MESSAGE_QUEUE_HANDLE TEST_on_process_message_callback_message_queue;
@@ -225,45 +213,29 @@ static MESSAGE_QUEUE_CONFIG* get_message_queue_config()
 static void set_message_queue_create_expected_calls()
 {
     STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_create());
-    STRICT_EXPECTED_CALL(singlylinkedlist_create());
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InitializeListHead(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_create());
+    STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
 }
 
 static void set_dequeue_message_and_fire_callback_expected_calls()
 {
-    STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
 }
 
-static void set_retry_sending_message_expected_calls()
+static void set_on_message_processing_completed_callback_expected_calls(bool is_in_progress, bool should_retry)
 {
-    STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-}
-
-static void set_on_message_processing_completed_callback_expected_calls(int number_of_messages, int message_order_in_list, bool should_retry)
-{
-    int i;
-
-    STRICT_EXPECTED_CALL(singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-
-    for (i = 0; i < number_of_messages; i++)
-    {
-        // Invoked by singlylinkedlist_find.
-        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-
-        if (i == message_order_in_list) break;
-    }
-
-    if (i == message_order_in_list)
+    // The item is found through the in-progress index, so a message not in progress causes no calls.
+    if (is_in_progress)
     {
-        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-
         if (should_retry)
         {
-            set_retry_sending_message_expected_calls();
+            STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+            STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
         }
         else
         {
@@ -272,50 +244,49 @@ static void set_on_message_processing_completed_callback_expected_calls(int numb
     }
 }
 
-static void set_message_queue_remove_all_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
+static void set_remove_all_from_list_expected_calls(size_t number_of_messages)
 {
     size_t i;
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
-    for (i = 0; i < number_of_messages_pending; i++)
+    for (i = 0; i < number_of_messages; i++)
     {
+        STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
         set_dequeue_message_and_fire_callback_expected_calls();
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
     }
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+}
 
-    for (i = 0; i < number_of_messages_in_progress; i++)
-    {
-        set_dequeue_message_and_fire_callback_expected_calls();
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-    }
+static void set_message_queue_remove_all_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
+{
+    set_remove_all_from_list_expected_calls(number_of_messages_in_progress);
+    set_remove_all_from_list_expected_calls(number_of_messages_pending);
 }
 
 static void set_message_queue_destroy_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
 {
     set_message_queue_remove_all_expected_calls(number_of_messages_pending, number_of_messages_in_progress);
 
-    STRICT_EXPECTED_CALL(singlylinkedlist_destroy(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(singlylinkedlist_destroy(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_destroy(TEST_TICK_COUNTER_HANDLE));
     STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
 }
 
-static void set_message_queue_add_expected_calls(time_t current_time)
+static void set_message_queue_add_expected_calls()
 {
     STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
-    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
-    STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 }
 
-static void add_messages(MESSAGE_QUEUE_HANDLE mq, size_t number_of_messages, time_t current_time)
+static void add_messages(MESSAGE_QUEUE_HANDLE mq, size_t first_message, size_t number_of_messages)
 {
     size_t i;
-    for (i = 0; i < number_of_messages; i++)
+    for (i = first_message; i < first_message + number_of_messages; i++)
     {
         umock_c_reset_all_calls();
-        set_message_queue_add_expected_calls(current_time);
+        set_message_queue_add_expected_calls();
         int result = message_queue_add(mq, TEST_BASE_MQ_MESSAGE_HANDLE[i], TEST_on_message_processing_completed_callback, TEST_USER_CONTEXT);
         ASSERT_ARE_EQUAL_WITH_MSG(int, 0, result, "failed adding message to queue");
     }
@@ -334,141 +305,72 @@ static MESSAGE_QUEUE_HANDLE create_message_queue(MESSAGE_QUEUE_CONFIG* config)
     return message_queue_create(config);
 }
 
-static void set_process_timeouts_expected_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time,
-    size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
-    TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile
-    )
+static void set_process_timeouts_expected_calls(bool is_timeout_set, size_t number_of_expired_messages)
 {
-    (void)mq;
-    STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
 
-    if (expiration_profile->max_message_enqueued_time_secs > 0)
+    // Tests set at most one of the two timeouts, and expiry stops at the first item not expired.
+    if (is_timeout_set)
     {
-        size_t i, j;
+        size_t i;
 
-        // pending messages, max queued time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
-        for (i = 0, j = 0; i < number_of_messages_pending; i++)
+        for (i = 0; i < number_of_expired_messages; i++)
         {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_pending_messages_size && i == expiration_profile->expired_pending_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_enqueued_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                number_of_messages_pending--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-                break;
-            }
-        }
-
-        // in progress messages, max queued time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
-        for (i = 0, j = 0; i < number_of_messages_in_progress; i++)
-        {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_enqueued_in_progress_messages_size && i == expiration_profile->expired_enqueued_in_progress_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_enqueued_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                //set_dequeue_message_and_fire_callback_expected_calls(number_of_messages_in_progress, expiration_profile->expired_enqueued_in_progress_messages[j] - i, false);
-                number_of_messages_in_progress--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-            }
+            STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+            set_dequeue_message_and_fire_callback_expected_calls();
         }
-    }
-
-    if (expiration_profile->max_message_processing_time_secs > 0)
-    {
-        size_t i, j;
-
-        // in progress messages, max in progress time
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
 
-        for (i = 0, j = 0; i < number_of_messages_in_progress; i++)
-        {
-            STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-            STRICT_EXPECTED_CALL(singlylinkedlist_get_next_item(IGNORED_PTR_ARG));
-
-            if (j < expiration_profile->expired_in_progress_messages_size && i == expiration_profile->expired_in_progress_messages[j])
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(expiration_profile->max_message_processing_time_secs + 1);
-                set_dequeue_message_and_fire_callback_expected_calls();
-                number_of_messages_in_progress--;
-                j++;
-            }
-            else
-            {
-                STRICT_EXPECTED_CALL(get_difftime(IGNORED_NUM_ARG, IGNORED_NUM_ARG)).SetReturn(0);
-                break;
-            }
-        }
+        STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
     }
 }
 
-static void set_process_pending_messages_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time, size_t number_of_messages_pending)
+static void set_process_pending_messages_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
 {
-    (void)mq;
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-
     size_t i;
 
     for (i = 0; i < number_of_messages_pending; i++)
     {
-        STRICT_EXPECTED_CALL(singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        STRICT_EXPECTED_CALL(get_time(NULL)).SetReturn(current_time);
-        STRICT_EXPECTED_CALL(singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-        
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(tickcounter_get_current_ms(TEST_TICK_COUNTER_HANDLE, IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InsertTailList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+        // The in-progress index doubles once it holds more items than buckets.
+        if (number_of_messages_in_progress + i == TEST_IN_PROGRESS_INDEX_INITIAL_SIZE)
+        {
+            STRICT_EXPECTED_CALL(malloc(IGNORED_NUM_ARG));
+            STRICT_EXPECTED_CALL(free(IGNORED_PTR_ARG));
+        }
     }
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 }
 
-static void set_message_queue_do_work_expected_calls(MESSAGE_QUEUE_HANDLE mq, time_t current_time, 
-    size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
-    TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile)
+static void set_message_queue_do_work_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
 {
-    set_process_timeouts_expected_calls(mq, current_time, number_of_messages_pending, number_of_messages_in_progress, expiration_profile);
-    set_process_pending_messages_calls(mq, current_time, number_of_messages_pending);
+    set_process_timeouts_expected_calls(false, 0);
+    set_process_pending_messages_calls(number_of_messages_pending, number_of_messages_in_progress);
 }
 
-static void crank_message_queue(MESSAGE_QUEUE_HANDLE mq, time_t current_time, 
-    size_t number_of_messages_pending, size_t number_of_messages_in_progress, 
-    TEST_MESSAGE_EXPIRATION_PROFILE* expiration_profile)
+static void crank_message_queue(MESSAGE_QUEUE_HANDLE mq, size_t number_of_messages_pending, size_t number_of_messages_in_progress)
 {
-    if (expiration_profile == NULL)
-    {
-        expiration_profile = &TEST_test_message_expiration_profile;
-    }
-
     umock_c_reset_all_calls();
-    set_message_queue_do_work_expected_calls(mq, current_time, number_of_messages_pending, number_of_messages_in_progress, expiration_profile);
+    set_message_queue_do_work_expected_calls(number_of_messages_pending, number_of_messages_in_progress);
     message_queue_do_work(mq);
 }
 
-static void set_message_queue_is_empty_expected_calls(size_t number_of_messages_pending, size_t number_of_messages_in_progress)
+static void set_message_queue_move_all_back_to_pending_expected_calls(size_t number_of_messages_in_progress)
 {
-    (void)number_of_messages_in_progress;
-    
-    STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+    size_t i;
 
-    if (number_of_messages_pending == 0) // this statement will only be evaluated if the first boolean check (in code) succeeds.
+    for (i = 0; i < number_of_messages_in_progress; i++)
     {
-        STRICT_EXPECTED_CALL(singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_RemoveEntryList(IGNORED_PTR_ARG));
+        STRICT_EXPECTED_CALL(DList_InsertHeadList(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     }
+
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 }
 
 static void set_message_queue_retrieve_options_expected_calls()
@@ -481,7 +383,7 @@ static void set_message_queue_retrieve_options_expected_calls()
 
 static void reset_test_data()
 {    
-    TEST_current_time = time(NULL);
+    TEST_current_ms = 1000;
 
     saved_malloc_returns_count = 0;
     memset(saved_malloc_returns, 0, sizeof(saved_malloc_returns));
@@ -502,29 +404,19 @@ static void reset_test_data()
     TEST_on_message_processing_completed_callback_CANCELLED_result_count = 0;
     TEST_on_message_processing_completed_callback_ERROR_result_count = 0;
     TEST_on_message_processing_completed_callback_TIMEOUT_result_count = 0;
-
-    TEST_test_message_expiration_profile.expired_enqueued_in_progress_messages = NULL;
-    TEST_test_message_expiration_profile.expired_enqueued_in_progress_messages_size = 0;
-    TEST_test_message_expiration_profile.expired_in_progress_messages = NULL;
-    TEST_test_message_expiration_profile.expired_in_progress_messages_size = 0;
-    TEST_test_message_expiration_profile.expired_pending_messages = NULL;
-    TEST_test_message_expiration_profile.expired_pending_messages_size = 0;
-    TEST_test_message_expiration_profile.max_message_enqueued_time_secs = 0;
-    TEST_test_message_expiration_profile.max_message_processing_time_secs = 0;
 }
 
 static void register_umock_alias_types() 
 {
-    REGISTER_UMOCK_ALIAS_TYPE(time_t, long long);
     REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(OPTIONHANDLER_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(pfCloneOption, void*);
     REGISTER_UMOCK_ALIAS_TYPE(pfDestroyOption, void*);
     REGISTER_UMOCK_ALIAS_TYPE(pfSetOption, void*);
-    REGISTER_UMOCK_ALIAS_TYPE(SINGLYLINKEDLIST_HANDLE, void*);
-    REGISTER_UMOCK_ALIAS_TYPE(LIST_ITEM_HANDLE, void*);
-    REGISTER_UMOCK_ALIAS_TYPE(LIST_MATCH_FUNCTION, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
     REGISTER_UMOCK_ALIAS_TYPE(MQ_MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(PDLIST_ENTRY, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const PDLIST_ENTRY, void*);
 }
 
 static void register_global_mock_hooks()
@@ -532,14 +424,15 @@ static void register_global_mock_hooks()
     REGISTER_GLOBAL_MOCK_HOOK(malloc, TEST_malloc);
     REGISTER_GLOBAL_MOCK_HOOK(free, TEST_free);
     REGISTER_GLOBAL_MOCK_HOOK(OptionHandler_AddOption, TEST_OptionHandler_AddOption);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_create, real_singlylinkedlist_create);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_destroy, real_singlylinkedlist_destroy);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_add, real_singlylinkedlist_add);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_remove, real_singlylinkedlist_remove);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_head_item, real_singlylinkedlist_get_head_item);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_get_next_item, real_singlylinkedlist_get_next_item);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_find, real_singlylinkedlist_find);
-    REGISTER_GLOBAL_MOCK_HOOK(singlylinkedlist_item_get_value, real_singlylinkedlist_item_get_value);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, TEST_tickcounter_get_current_ms);
+
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InitializeListHead, real_DList_InitializeListHead);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_IsListEmpty, real_DList_IsListEmpty);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertTailList, real_DList_InsertTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_InsertHeadList, real_DList_InsertHeadList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_AppendTailList, real_DList_AppendTailList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveEntryList, real_DList_RemoveEntryList);
+    REGISTER_GLOBAL_MOCK_HOOK(DList_RemoveHeadList, real_DList_RemoveHeadList);
 }
 
 static void register_global_mock_returns() 
@@ -553,19 +446,10 @@ static void register_global_mock_returns()
     REGISTER_GLOBAL_MOCK_RETURN(OptionHandler_FeedOptions, OPTIONHANDLER_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(OptionHandler_FeedOptions, OPTIONHANDLER_ERROR);
 
-    REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_add, TEST_LIST_ITEM_HANDLE);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_add, NULL);
-
-    REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_remove, 0);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_remove, 1);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, TEST_TICK_COUNTER_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_create, NULL);
 
-    REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_get_head_item, TEST_LIST_ITEM_HANDLE);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_get_head_item, NULL);
-
-    REGISTER_GLOBAL_MOCK_RETURN(singlylinkedlist_item_get_value, TEST_LIST_ITEM_VALUE);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(singlylinkedlist_item_get_value, NULL);
-
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(get_time, INDEFINITE_TIME);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(tickcounter_get_current_ms, 1);
 }
 
 
@@ -594,7 +478,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     register_global_mock_returns();
     register_global_mock_hooks();
     
-    for (i = 0; i < 10; i++)
+    for (i = 0; i < TEST_BASE_MQ_MESSAGE_COUNT; i++)
     {
         TEST_BASE_MQ_MESSAGE_HANDLE[i] = (MQ_MESSAGE_HANDLE)real_malloc(sizeof(char));
         ASSERT_IS_NOT_NULL_WITH_MSG(TEST_BASE_MQ_MESSAGE_HANDLE[i], "Failed setting up TEST_BASE_MQ_MESSAGE_HANDLE");
@@ -610,7 +494,7 @@ TEST_SUITE_CLEANUP(TestClassCleanup)
     TEST_MUTEX_DESTROY(g_testByTest);
     TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
     
-    for (i = 0; i < 10; i++)
+    for (i = 0; i < TEST_BASE_MQ_MESSAGE_COUNT; i++)
     {
         real_free(TEST_BASE_MQ_MESSAGE_HANDLE[i]);
     }
@@ -672,8 +556,8 @@ TEST_FUNCTION(create_NULL_on_process_message_callback)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_005: [If `instance` cannot be allocated, message_queue_create shall fail and return NULL]
-// Tests_SRS_MESSAGE_QUEUE_09_007: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
-// Tests_SRS_MESSAGE_QUEUE_09_009: [If singlylinkedlist_create fails, message_queue_create shall fail and return NULL]
+// Tests_SRS_MESSAGE_QUEUE_09_009: [If tickcounter_create fails, message_queue_create shall fail and return NULL]
+// Tests_SRS_MESSAGE_QUEUE_31_007: [If `message_queue->in_progress_index` cannot be allocated, message_queue_create shall fail and return NULL]
 // Tests_SRS_MESSAGE_QUEUE_09_011: [If any failures occur, message_queue_create shall release all memory it has allocated]
 TEST_FUNCTION(create_failure_checks)
 {
@@ -684,9 +568,17 @@ TEST_FUNCTION(create_failure_checks)
     set_message_queue_create_expected_calls();
     umock_c_negative_tests_snapshot();
 
+    // DList_InitializeListHead cannot fail.
+    size_t calls_cannot_fail[] = { 1, 2, 3 };
+
     size_t i;
     for (i = 0; i < umock_c_negative_tests_call_count(); i++)
     {
+        if (should_skip_index(i, calls_cannot_fail, sizeof(calls_cannot_fail) / sizeof(calls_cannot_fail[0])) != 0)
+        {
+            continue;
+        }
+
         // arrange
         char error_msg[64];
         sprintf(error_msg, "On failed call %zu", i);
@@ -708,8 +600,9 @@ TEST_FUNCTION(create_failure_checks)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_004: [Memory shall be allocated for the MESSAGE_QUEUE data structure (aka `message_queue`)]
-// Tests_SRS_MESSAGE_QUEUE_09_006: [`message_queue->pending` shall be set using singlylinkedlist_create()]
-// Tests_SRS_MESSAGE_QUEUE_09_008: [`message_queue->in_progress` shall be set using singlylinkedlist_create()]
+// Tests_SRS_MESSAGE_QUEUE_09_006: [`message_queue->pending`, `message_queue->in_progress` and `message_queue->enqueue_order` shall be initialized using DList_InitializeListHead()]
+// Tests_SRS_MESSAGE_QUEUE_09_008: [`message_queue->tick_counter` shall be set using tickcounter_create()]
+// Tests_SRS_MESSAGE_QUEUE_31_006: [`message_queue->in_progress_index` shall be allocated with IN_PROGRESS_INDEX_INITIAL_SIZE buckets]
 // Tests_SRS_MESSAGE_QUEUE_09_010: [All arguments in `config` shall be saved into `message_queue`]
 // Tests_SRS_MESSAGE_QUEUE_09_012: [If no failures occur, message_queue_create shall return the `message_queue` pointer]
 TEST_FUNCTION(create_success)
@@ -753,9 +646,9 @@ TEST_FUNCTION(destroy_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
-    add_messages(mq, 1, TEST_current_time);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
+    add_messages(mq, 1, 1);
 
     umock_c_reset_all_calls();
     set_message_queue_destroy_expected_calls(1, 1);
@@ -792,9 +685,9 @@ TEST_FUNCTION(remove_all_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
-    add_messages(mq, 1, TEST_current_time);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
+    add_messages(mq, 1, 1);
 
     umock_c_reset_all_calls();
     set_message_queue_remove_all_expected_calls(1, 1);
@@ -846,8 +739,8 @@ TEST_FUNCTION(add_NULL_message_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_017: [message_queue_add shall allocate a structure (aka `mq_item`) to save the `message`]
-// Tests_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using get_time()]
-// Tests_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to `message_queue->pending` list]
+// Tests_SRS_MESSAGE_QUEUE_09_019: [`mq_item->enqueue_time` shall be set using tickcounter_get_current_ms()]
+// Tests_SRS_MESSAGE_QUEUE_09_021: [`mq_item` shall be added to the tail of `message_queue->pending` and `message_queue->enqueue_order` lists]
 // Tests_SRS_MESSAGE_QUEUE_09_023: [`message` shall be saved into `mq_item->message`]
 // Tests_SRS_MESSAGE_QUEUE_09_025: [If no failures occur, message_queue_add shall return 0]
 TEST_FUNCTION(add_success)
@@ -856,7 +749,7 @@ TEST_FUNCTION(add_success)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
     umock_c_reset_all_calls();
-    set_message_queue_add_expected_calls(TEST_current_time);
+    set_message_queue_add_expected_calls();
 
     // act
     int result = message_queue_add(mq, TEST_BASE_MQ_MESSAGE_HANDLE[0], TEST_on_message_processing_completed_callback, TEST_USER_CONTEXT);
@@ -870,8 +763,7 @@ TEST_FUNCTION(add_success)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_018: [If `mq_item` cannot be allocated, message_queue_add shall fail and return non-zero]
-// Tests_SRS_MESSAGE_QUEUE_09_020: [If get_time fails, message_queue_add shall fail and return non-zero]
-// Tests_SRS_MESSAGE_QUEUE_09_022: [`mq_item` fails to be added to `message_queue->pending`, message_queue_add shall fail and return non-zero]
+// Tests_SRS_MESSAGE_QUEUE_09_020: [If tickcounter_get_current_ms fails, message_queue_add shall fail and return non-zero]
 // Tests_SRS_MESSAGE_QUEUE_09_024: [If any failures occur, message_queue_add shall release all memory it has allocated]
 TEST_FUNCTION(add_failure_checks)
 {
@@ -880,12 +772,20 @@ TEST_FUNCTION(add_failure_checks)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
     umock_c_reset_all_calls();
-    set_message_queue_add_expected_calls(TEST_current_time);
+    set_message_queue_add_expected_calls();
     umock_c_negative_tests_snapshot();
 
+    // DList_InsertTailList cannot fail.
+    size_t calls_cannot_fail[] = { 2, 3 };
+
     size_t i;
     for (i = 0; i < umock_c_negative_tests_call_count(); i++)
     {
+        if (should_skip_index(i, calls_cannot_fail, sizeof(calls_cannot_fail) / sizeof(calls_cannot_fail[0])) != 0)
+        {
+            continue;
+        }
+
         // arrange
         char error_msg[64];
         sprintf(error_msg, "On failed call %zu", i);
@@ -950,7 +850,7 @@ TEST_FUNCTION(is_empty_0_pending_0_in_progress_success)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
     umock_c_reset_all_calls();
-    set_message_queue_is_empty_expected_calls(0, 0);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 
     // act
     bool is_empty;
@@ -972,10 +872,10 @@ TEST_FUNCTION(is_empty_1_pending_0_in_progress_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
+    add_messages(mq, 0, 1);
 
     umock_c_reset_all_calls();
-    set_message_queue_is_empty_expected_calls(1, 0);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 
     // act
     bool is_empty;
@@ -997,11 +897,11 @@ TEST_FUNCTION(is_empty_0_pending_1_in_progress_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     umock_c_reset_all_calls();
-    set_message_queue_is_empty_expected_calls(0, 1);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 
     // act
     bool is_empty;
@@ -1023,12 +923,12 @@ TEST_FUNCTION(is_empty_1_pending_1_in_progress_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
-    add_messages(mq, 1, TEST_current_time);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
+    add_messages(mq, 1, 1);
 
     umock_c_reset_all_calls();
-    set_message_queue_is_empty_expected_calls(1, 1);
+    STRICT_EXPECTED_CALL(DList_IsListEmpty(IGNORED_PTR_ARG));
 
     // act
     bool is_empty;
@@ -1059,17 +959,17 @@ TEST_FUNCTION(do_work_NULL_handle)
 }
 
 // Tests_SRS_MESSAGE_QUEUE_09_039: [Each `mq_item` in `message_queue->pending` shall be moved to `message_queue->in_progress`]
-// Tests_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using get_time()]
+// Tests_SRS_MESSAGE_QUEUE_09_040: [`mq_item->processing_start_time` shall be set using tickcounter_get_current_ms()]
 // Tests_SRS_MESSAGE_QUEUE_09_043: [If no failures occur, `message_queue->on_process_message_callback` shall be invoked passing `mq_item->message` and `on_process_message_completed_callback`]
 TEST_FUNCTION(do_work_NO_EXPIRATION_success)
 {
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
+    add_messages(mq, 0, 1);
 
     umock_c_reset_all_calls();
-    set_message_queue_do_work_expected_calls(mq, TEST_current_time, 1, 0, &TEST_test_message_expiration_profile);
+    set_message_queue_do_work_expected_calls(1, 0);
 
     // act
     message_queue_do_work(mq);
@@ -1084,7 +984,7 @@ TEST_FUNCTION(do_work_NO_EXPIRATION_success)
     message_queue_destroy(mq);
 }
 
-// Tests_SRS_MESSAGE_QUEUE_09_041: [If get_time() fails, `mq_item` shall be removed from `message_queue->in_progress`]
+// Tests_SRS_MESSAGE_QUEUE_09_041: [If tickcounter_get_current_ms() fails, `mq_item` shall be removed from `message_queue->pending`]
 // Tests_SRS_MESSAGE_QUEUE_09_042: [If any failures occur, `mq_item->on_message_processing_completed_callback` shall be invoked with MESSAGE_QUEUE_ERROR and `mq_item` freed]
 TEST_FUNCTION(do_work_NO_EXPIRATION_failure_checks)
 {
@@ -1092,47 +992,42 @@ TEST_FUNCTION(do_work_NO_EXPIRATION_failure_checks)
     ASSERT_ARE_EQUAL(int, 0, umock_c_negative_tests_init());
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    size_t i, j;
-    for (i = 0, j = 1; i < j; i++)
-    {
-        if (i == 6)
-        {
-            continue;
-        }
+    // Only the two tickcounter_get_current_ms calls can fail; the DList calls around them cannot.
+    size_t calls_that_can_fail[] = { 0, 2 };
 
+    size_t i;
+    for (i = 0; i < sizeof(calls_that_can_fail) / sizeof(calls_that_can_fail[0]); i++)
+    {
         // arrange
+        TEST_on_process_message_callback_message = NULL;
         TEST_on_message_processing_completed_callback_message = NULL;
-        TEST_on_message_processing_completed_callback_result = MESSAGE_QUEUE_TIMEOUT;
 
         char error_msg[64];
-        sprintf(error_msg, "On failed call %zu", i);
+        sprintf(error_msg, "On failed call %zu", calls_that_can_fail[i]);
 
-        if (i >= 3 && i != 4)
-        {
-            add_messages(mq, 1, TEST_current_time);
-        }
+        add_messages(mq, i, 1);
 
         umock_c_reset_all_calls();
-        set_message_queue_do_work_expected_calls(mq, TEST_current_time, 1, 0, &TEST_test_message_expiration_profile);
+        set_message_queue_do_work_expected_calls(1, i);
         umock_c_negative_tests_snapshot();
 
-        j = umock_c_negative_tests_call_count();
-
         umock_c_negative_tests_reset();
-        umock_c_negative_tests_fail_call(i);
+        umock_c_negative_tests_fail_call(calls_that_can_fail[i]);
 
         // act
         message_queue_do_work(mq);
 
         // assert
-        if (i == 1 || i == 2)
+        if (i == 0)
         {
-            ASSERT_IS_NULL_WITH_MSG(TEST_on_process_message_callback_message, error_msg);
+            // Failing to read the time only skips the timeout checks.
+            ASSERT_ARE_EQUAL_WITH_MSG(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[i], TEST_on_process_message_callback_message, error_msg);
             ASSERT_IS_NULL_WITH_MSG(TEST_on_message_processing_completed_callback_message, error_msg);
         }
-        else if (i >= 3)
+        else
         {
-            ASSERT_IS_NOT_NULL_WITH_MSG(TEST_on_message_processing_completed_callback_message, error_msg);
+            ASSERT_IS_NULL_WITH_MSG(TEST_on_process_message_callback_message, error_msg);
+            ASSERT_ARE_EQUAL_WITH_MSG(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[i], TEST_on_message_processing_completed_callback_message, error_msg);
             ASSERT_ARE_EQUAL_WITH_MSG(int, (int)MESSAGE_QUEUE_ERROR, (int)TEST_on_message_processing_completed_callback_result, error_msg);
         }
 
@@ -1334,8 +1229,8 @@ TEST_FUNCTION(on_message_processing_completed_callback_NULL_message)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     umock_c_reset_all_calls();
 
@@ -1360,8 +1255,8 @@ TEST_FUNCTION(on_message_processing_completed_callback_NULL_message_queue)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     umock_c_reset_all_calls();
 
@@ -1386,11 +1281,11 @@ TEST_FUNCTION(on_message_processing_completed_callback_MESSAGE_not_present)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     umock_c_reset_all_calls();
-    set_on_message_processing_completed_callback_expected_calls(1, -1, false);
+    set_on_message_processing_completed_callback_expected_calls(false, false);
 
     // act
     TEST_on_process_message_callback_on_process_message_completed_callback(mq, TEST_SOME_OTHER_MESSAGE, MESSAGE_QUEUE_SUCCESS, TEST_REASON);
@@ -1415,14 +1310,14 @@ TEST_FUNCTION(on_message_processing_completed_callback_success)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
     ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_BASE_MQ_MESSAGE_HANDLE[0], (void*)TEST_on_process_message_callback_message);
     ASSERT_IS_NOT_NULL(TEST_on_process_message_callback_on_process_message_completed_callback);
     ASSERT_ARE_EQUAL(void_ptr, (void*)TEST_USER_CONTEXT, (void*)TEST_on_process_message_callback_context);
 
     umock_c_reset_all_calls();
-    set_on_message_processing_completed_callback_expected_calls(1, 0, false);
+    set_on_message_processing_completed_callback_expected_calls(true, false);
 
     // act
     TEST_on_process_message_callback_on_process_message_completed_callback(mq, TEST_on_process_message_callback_message, MESSAGE_QUEUE_SUCCESS, TEST_REASON);
@@ -1447,15 +1342,15 @@ TEST_FUNCTION(on_message_processing_completed_callback_RETRYABLE_ERROR)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
     (void)message_queue_set_max_retry_count(mq, 2);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     umock_c_reset_all_calls();
-    set_on_message_processing_completed_callback_expected_calls(1, 0, true);
-    set_message_queue_do_work_expected_calls(mq, TEST_current_time, 1, 0, &TEST_test_message_expiration_profile);
-    set_on_message_processing_completed_callback_expected_calls(1, 0, true);
-    set_message_queue_do_work_expected_calls(mq, TEST_current_time, 1, 0, &TEST_test_message_expiration_profile);
-    set_on_message_processing_completed_callback_expected_calls(1, 0, false);
+    set_on_message_processing_completed_callback_expected_calls(true, true);
+    set_message_queue_do_work_expected_calls(1, 0);
+    set_on_message_processing_completed_callback_expected_calls(true, true);
+    set_message_queue_do_work_expected_calls(1, 0);
+    set_on_message_processing_completed_callback_expected_calls(true, false);
 
     // act
     TEST_on_process_message_callback_on_process_message_completed_callback(mq, 
@@ -1479,6 +1374,136 @@ TEST_FUNCTION(on_message_processing_completed_callback_RETRYABLE_ERROR)
     message_queue_destroy(mq);
 }
 
+// Tests_SRS_MESSAGE_QUEUE_31_001: [The `mq_item` of `message` shall be looked up in `message_queue->in_progress_index`, without scanning `message_queue->in_progress`]
+TEST_FUNCTION(on_message_processing_completed_callback_out_of_order_success)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    add_messages(mq, 0, 3);
+    crank_message_queue(mq, 3, 0);
+    PROCESS_MESSAGE_COMPLETED_CALLBACK on_process_message_completed_callback = TEST_on_process_message_callback_on_process_message_completed_callback;
+
+    umock_c_reset_all_calls();
+    set_on_message_processing_completed_callback_expected_calls(true, false);
+
+    // act
+    on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[1], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_SUCCESS_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[1], TEST_on_message_processing_completed_callback_message);
+
+    // The same message completed again is no longer in progress.
+    umock_c_reset_all_calls();
+    set_on_message_processing_completed_callback_expected_calls(false, false);
+    on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[1], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_SUCCESS_result_count);
+
+    umock_c_reset_all_calls();
+    set_on_message_processing_completed_callback_expected_calls(true, false);
+    set_on_message_processing_completed_callback_expected_calls(true, false);
+    on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[2], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+    on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[0], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 3, (int)TEST_on_message_processing_completed_callback_SUCCESS_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[0], TEST_on_message_processing_completed_callback_message);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
+// Tests_SRS_MESSAGE_QUEUE_31_001: [The `mq_item` of `message` shall be looked up in `message_queue->in_progress_index`, without scanning `message_queue->in_progress`]
+TEST_FUNCTION(on_message_processing_completed_callback_after_index_growth_success)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    add_messages(mq, 0, TEST_BASE_MQ_MESSAGE_COUNT);
+    crank_message_queue(mq, TEST_BASE_MQ_MESSAGE_COUNT, 0);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    PROCESS_MESSAGE_COMPLETED_CALLBACK on_process_message_completed_callback = TEST_on_process_message_callback_on_process_message_completed_callback;
+
+    umock_c_reset_all_calls();
+
+    size_t i;
+    for (i = 0; i < TEST_BASE_MQ_MESSAGE_COUNT; i++)
+    {
+        set_on_message_processing_completed_callback_expected_calls(true, false);
+    }
+
+    // act
+    for (i = TEST_BASE_MQ_MESSAGE_COUNT; i > 0; i--)
+    {
+        on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[i - 1], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+    }
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, TEST_BASE_MQ_MESSAGE_COUNT, (int)TEST_on_message_processing_completed_callback_SUCCESS_result_count);
+
+    bool is_empty;
+    ASSERT_ARE_EQUAL(int, 0, message_queue_is_empty(mq, &is_empty));
+    ASSERT_IS_TRUE(is_empty);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
+TEST_FUNCTION(move_all_back_to_pending_NULL_handle)
+{
+    // arrange
+    umock_c_reset_all_calls();
+
+    // act
+    int result = message_queue_move_all_back_to_pending(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
+    // cleanup
+}
+
+// Tests_SRS_MESSAGE_QUEUE_31_004: [Each `mq_item` in `message_queue->in_progress` shall be moved to the head of `message_queue->pending`, keeping their order]
+// Tests_SRS_MESSAGE_QUEUE_31_005: [The number of attempts and processing start time of each `mq_item` shall be reset]
+TEST_FUNCTION(move_all_back_to_pending_success)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    add_messages(mq, 0, 2);
+    crank_message_queue(mq, 2, 0);
+    add_messages(mq, 2, 1);
+    PROCESS_MESSAGE_COMPLETED_CALLBACK on_process_message_completed_callback = TEST_on_process_message_callback_on_process_message_completed_callback;
+
+    umock_c_reset_all_calls();
+    set_message_queue_move_all_back_to_pending_expected_calls(2);
+
+    // act
+    int result = message_queue_move_all_back_to_pending(mq);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // A late completion of a message moved back is ignored.
+    umock_c_reset_all_calls();
+    set_on_message_processing_completed_callback_expected_calls(false, false);
+    on_process_message_completed_callback(mq, TEST_BASE_MQ_MESSAGE_HANDLE[0], MESSAGE_QUEUE_SUCCESS, TEST_REASON);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, (int)TEST_on_message_processing_completed_callback_SUCCESS_result_count);
+
+    crank_message_queue(mq, 3, 0);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[2], TEST_on_process_message_callback_message);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
 // Tests_SRS_MESSAGE_QUEUE_09_035: [If `message_queue->max_message_enqueued_time_secs` is greater than zero, `message_queue->in_progress` and `message_queue->pending` items shall be checked for timeout]
 // Tests_SRS_MESSAGE_QUEUE_09_036: [If any items are in `message_queue` lists for `message_queue->max_message_enqueued_time_secs` or more, they shall be removed and `message_queue->on_message_processing_completed_callback` invoked with MESSAGE_QUEUE_TIMEOUT]
 TEST_FUNCTION(do_work_pending_queue_timeout)
@@ -1487,24 +1512,13 @@ TEST_FUNCTION(do_work_pending_queue_timeout)
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
     (void)message_queue_set_max_message_enqueued_time_secs(mq, 10);
 
-    add_messages(mq, 1, TEST_current_time);
-
-    time_t t1 = add_seconds(TEST_current_time, 10);
+    add_messages(mq, 0, 1);
 
-    TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 10;
-    exp_prof.max_message_processing_time_secs = 0;
-    size_t expired_pending_messages[] = { 0 };
-    exp_prof.expired_pending_messages = expired_pending_messages;
-    exp_prof.expired_pending_messages_size = 1;
-    exp_prof.expired_in_progress_messages = NULL;
-    exp_prof.expired_in_progress_messages_size = 0;
-    exp_prof.expired_enqueued_in_progress_messages = NULL;
-    exp_prof.expired_enqueued_in_progress_messages_size = 0;
+    TEST_current_ms += 10 * 1000;
 
     umock_c_reset_all_calls();
-    set_process_timeouts_expected_calls(mq, t1, 1, 0, &exp_prof);
-    set_process_pending_messages_calls(mq, t1, 0);
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 0);
 
     // act
     message_queue_do_work(mq);
@@ -1527,27 +1541,16 @@ TEST_FUNCTION(do_work_in_progress_processing_timeout)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     (void)message_queue_set_max_message_processing_time_secs(mq, 10);
 
-    time_t t1 = add_seconds(TEST_current_time, 10);
-
-    TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 0;
-    exp_prof.max_message_processing_time_secs = 10;
-    exp_prof.expired_pending_messages = NULL;
-    exp_prof.expired_pending_messages_size = 0;
-    size_t expired_in_progress_messages[] = { 0 };
-    exp_prof.expired_in_progress_messages = expired_in_progress_messages;
-    exp_prof.expired_in_progress_messages_size = 1;
-    exp_prof.expired_enqueued_in_progress_messages = NULL;
-    exp_prof.expired_enqueued_in_progress_messages_size = 0;
+    TEST_current_ms += 10 * 1000;
 
     umock_c_reset_all_calls();
-    set_process_timeouts_expected_calls(mq, t1, 0, 1, &exp_prof);
-    set_process_pending_messages_calls(mq, t1, 0);
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 0);
 
     // act
     message_queue_do_work(mq);
@@ -1570,27 +1573,16 @@ TEST_FUNCTION(do_work_in_progress_queue_timeout)
     // arrange
     MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
 
-    add_messages(mq, 1, TEST_current_time);
-    crank_message_queue(mq, TEST_current_time, 1, 0, NULL);
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
 
     (void)message_queue_set_max_message_enqueued_time_secs(mq, 10);
 
-    time_t t1 = add_seconds(TEST_current_time, 10);
-
-    TEST_MESSAGE_EXPIRATION_PROFILE exp_prof;
-    exp_prof.max_message_enqueued_time_secs = 10;
-    exp_prof.max_message_processing_time_secs = 0;
-    exp_prof.expired_pending_messages = NULL;
-    exp_prof.expired_pending_messages_size = 0;
-    exp_prof.expired_in_progress_messages = NULL;
-    exp_prof.expired_in_progress_messages_size = 0;
-    size_t expired_enqueued_in_progress_messages[] = { 0 };
-    exp_prof.expired_enqueued_in_progress_messages = expired_enqueued_in_progress_messages;
-    exp_prof.expired_enqueued_in_progress_messages_size = 1;
+    TEST_current_ms += 10 * 1000;
 
     umock_c_reset_all_calls();
-    set_process_timeouts_expected_calls(mq, t1, 0, 1, &exp_prof);
-    set_process_pending_messages_calls(mq, t1, 0);
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 0);
 
     // act
     message_queue_do_work(mq);
@@ -1606,4 +1598,86 @@ TEST_FUNCTION(do_work_in_progress_queue_timeout)
     message_queue_destroy(mq);
 }
 
+// Tests_SRS_MESSAGE_QUEUE_31_002: [Items shall be checked oldest enqueue time first, stopping at the first item not expired]
+TEST_FUNCTION(do_work_queue_timeout_stops_at_first_not_expired)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
+    TEST_current_ms += 5 * 1000;
+    add_messages(mq, 1, 1);
+    crank_message_queue(mq, 1, 1);
+    TEST_current_ms += 5 * 1000;
+
+    (void)message_queue_set_max_message_enqueued_time_secs(mq, 10);
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 1);
+
+    // act
+    message_queue_do_work(mq);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[0], TEST_on_message_processing_completed_callback_message);
+
+    // One millisecond short of the timeout, the remaining message is kept.
+    TEST_current_ms += 5 * 1000 - 1;
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(true, 0);
+    set_process_pending_messages_calls(0, 1);
+    message_queue_do_work(mq);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
+// Tests_SRS_MESSAGE_QUEUE_31_003: [In-progress items shall be checked oldest processing start time first, stopping at the first item not expired]
+TEST_FUNCTION(do_work_processing_timeout_stops_at_first_not_expired)
+{
+    // arrange
+    MESSAGE_QUEUE_HANDLE mq = create_message_queue(USE_DEFAULT_CONFIG);
+
+    add_messages(mq, 0, 1);
+    crank_message_queue(mq, 1, 0);
+    TEST_current_ms += 5 * 1000;
+    add_messages(mq, 1, 1);
+    crank_message_queue(mq, 1, 1);
+    TEST_current_ms += 10 * 1000 - 1;
+
+    (void)message_queue_set_max_message_processing_time_secs(mq, 10);
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 1);
+
+    // act
+    message_queue_do_work(mq);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 1, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[0], TEST_on_message_processing_completed_callback_message);
+
+    TEST_current_ms += 1;
+
+    umock_c_reset_all_calls();
+    set_process_timeouts_expected_calls(true, 1);
+    set_process_pending_messages_calls(0, 0);
+    message_queue_do_work(mq);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 2, (int)TEST_on_message_processing_completed_callback_TIMEOUT_result_count);
+    ASSERT_ARE_EQUAL(void_ptr, TEST_BASE_MQ_MESSAGE_HANDLE[1], TEST_on_message_processing_completed_callback_message);
+
+    // cleanup
+    message_queue_destroy(mq);
+}
+
 END_TEST_SUITE(message_queue_ut)
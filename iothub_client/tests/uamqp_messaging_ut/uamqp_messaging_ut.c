@@ -63,6 +63,7 @@ static void TEST_free(void* ptr)
 #include "azure_c_shared_utility/uuid.h"
 
 #include "iothub_message.h"
+#include "internal/iothub_message_private.h"
 #include "azure_uamqp_c/amqp_definitions_application_properties.h"
 #include "azure_uamqp_c/amqp_definitions_data.h"
 #include "azure_uamqp_c/message.h"
@@ -258,8 +259,7 @@ static void set_exp_calls_for_create_encoded_application_properties(size_t numbe
 {
     size_t encoding_size = TEST_AMQP_ENCODING_SIZE;
 
-    STRICT_EXPECTED_CALL(IoTHubMessage_Properties(TEST_IOTHUB_MESSAGE_HANDLE)); //16
-    STRICT_EXPECTED_CALL(Map_GetInternals(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL)) //16
         .CopyOutArgumentBuffer(2, &TEST_MAP_KEYS, sizeof(TEST_MAP_KEYS))
         .CopyOutArgumentBuffer(3, &TEST_MAP_VALUES, sizeof(TEST_MAP_VALUES))
         .CopyOutArgumentBuffer(4, &number_of_app_properties, sizeof(number_of_app_properties));
@@ -363,7 +363,7 @@ static void set_exp_calls_for_message_create_IoTHubMessage_from_uamqp_message(
     STRICT_EXPECTED_CALL(message_get_body_amqp_data_in_place(TEST_MESSAGE_HANDLE, 0, IGNORED_PTR_ARG))
         .IgnoreArgument(3)
         .CopyOutArgumentBuffer_amqp_data(&test_binary_data, sizeof (BINARY_DATA));
-    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(IoTHubMessage_CreateFromBorrowedByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG)).IgnoreAllArguments();
 
     // readPropertiesFromuAMQPMessage
     STRICT_EXPECTED_CALL(message_get_properties(TEST_MESSAGE_HANDLE, IGNORED_PTR_ARG))
@@ -573,6 +573,8 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(amqpvalue_encode, 1);
 
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_GetInternals, MAP_ERROR);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetProperties, IOTHUB_MESSAGE_OK);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_GetProperties, IOTHUB_MESSAGE_ERROR);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(amqpvalue_set_map_value, 1);
 
     REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_GetString, TEST_STRING);
@@ -607,8 +609,8 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_RETURN(Map_AddOrUpdate, MAP_OK);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(Map_AddOrUpdate, MAP_ERROR);
     
-    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromByteArray, TEST_IOTHUB_MESSAGE_HANDLE);
-    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_CreateFromByteArray, NULL);
+    REGISTER_GLOBAL_MOCK_RETURN(IoTHubMessage_CreateFromBorrowedByteArray, TEST_IOTHUB_MESSAGE_HANDLE);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(IoTHubMessage_CreateFromBorrowedByteArray, NULL);
         
     REGISTER_GLOBAL_MOCK_RETURN(message_get_body_type, 0);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(message_get_body_type, 1);
@@ -722,6 +724,7 @@ TEST_FUNCTION_CLEANUP(TestMethodCleanup)
 // Tests_SRS_UAMQP_MESSAGING_31_115: [If optional content-encoding is present in the message, encode it into the AMQP message.  Errors stop processing on this message.]
 // Tests_SRS_UAMQP_MESSAGING_31_116: [Gets message properties associated with the IOTHUB_MESSAGE_HANDLE to encode, returning the properties and their encoded length.  Errors stop processing on this message.]
 // Tests_SRS_UAMQP_MESSAGING_31_117: [Get application message properties associated with the IOTHUB_MESSAGE_HANDLE to encode, returning the properties and their encoded length.  Errors stop processing on this message.]
+// Tests_SRS_UAMQP_MESSAGING_31_124: [The application properties shall be read with IoTHubMessage_GetProperties, which copies nothing.]
 // Tests_SRS_UAMQP_MESSAGING_32_001: [If optional diagnostic properties are present in the iot hub message, encode them into the AMQP message as annotation properties. Errors stop processing on this message.]
 TEST_FUNCTION(message_create_uamqp_encoding_from_iothub_message_bytearray_success)
 {
@@ -911,20 +914,20 @@ TEST_FUNCTION(message_create_from_iothub_message_BYTEARRAY_return_errors_fails)
             (i == 4) || // amqpvalue_destroy
             (i == 8) || // amqpvalue_destroy
             (i == 15) || // properties_destroy
+            (i == 21) || // amqpvalue_destroy
             (i == 22) || // amqpvalue_destroy
-            (i == 23) || // amqpvalue_destroy
-            (i == 26) || // amqpvalue_destroy
-            (i == 27) || //IoTHubMessage_GetDiagnosticPropertyData is optional
+            (i == 25) || // amqpvalue_destroy
+            (i == 26) || //IoTHubMessage_GetDiagnosticPropertyData is optional
+            (i == 31) || // amqpvalue_destroy
             (i == 32) || // amqpvalue_destroy
-            (i == 33) || // amqpvalue_destroy
+            (i == 37) || // amqpvalue_destroy
             (i == 38) || // amqpvalue_destroy
-            (i == 39) || // amqpvalue_destroy
-            (i == 42) || // free
-            (i == 43) || // amqpvalue_destroy
+            (i == 41) || // free
+            (i == 42) || // amqpvalue_destroy
+            (i == 52) || // amqpvalue_destroy
             (i == 53) || // amqpvalue_destroy
             (i == 54) || // amqpvalue_destroy
-            (i == 55) || // amqpvalue_destroy
-            (i == 56) // amqpvalue_destroy
+            (i == 55) // amqpvalue_destroy
             )
         {
             continue; // these lines have functions that do not return anything (void).
@@ -974,20 +977,20 @@ TEST_FUNCTION(message_create_from_iothub_message_STRING_return_errors_fails)
             (i == 4) || // amqpvalue_destroy
             (i == 8) || // amqpvalue_destroy
             (i == 15) || // properties_destroy
+            (i == 21) || // amqpvalue_destroy
             (i == 22) || // amqpvalue_destroy
-            (i == 23) || // amqpvalue_destroy
-            (i == 26) || // amqpvalue_destroy
-            (i == 27) || //IoTHubMessage_GetDiagnosticPropertyData is optional
+            (i == 25) || // amqpvalue_destroy
+            (i == 26) || //IoTHubMessage_GetDiagnosticPropertyData is optional
+            (i == 31) || // amqpvalue_destroy
             (i == 32) || // amqpvalue_destroy
-            (i == 33) || // amqpvalue_destroy
+            (i == 37) || // amqpvalue_destroy
             (i == 38) || // amqpvalue_destroy
-            (i == 39) || // amqpvalue_destroy
-            (i == 42) || // free
-            (i == 43) || // amqpvalue_destroy
+            (i == 41) || // free
+            (i == 42) || // amqpvalue_destroy
+            (i == 52) || // amqpvalue_destroy
             (i == 53) || // amqpvalue_destroy
             (i == 54) || // amqpvalue_destroy
-            (i == 55) || // amqpvalue_destroy
-            (i == 56) // amqpvalue_destroy
+            (i == 55) // amqpvalue_destroy
            )
         {
             continue; // these lines have functions that do not return anything (void).
@@ -1012,7 +1015,7 @@ TEST_FUNCTION(message_create_from_iothub_message_STRING_return_errors_fails)
 // Tests_SRS_UAMQP_MESSAGING_09_001: [The body type of the uAMQP message shall be retrieved using message_get_body_type().]
 // Tests_SRS_UAMQP_MESSAGING_09_003: [If the uAMQP message body type is MESSAGE_BODY_TYPE_DATA, the body data shall be treated as binary data.]
 // Tests_SRS_UAMQP_MESSAGING_09_004: [The uAMQP message body data shall be retrieved using message_get_body_amqp_data_in_place().]
-// Tests_SRS_UAMQP_MESSAGING_09_006: [The IOTHUB_MESSAGE instance shall be created using IoTHubMessage_CreateFromByteArray(), passing the uAMQP body bytes as parameter.]
+// Tests_SRS_UAMQP_MESSAGING_31_125: [The IOTHUB_MESSAGE instance shall be created using IoTHubMessage_CreateFromBorrowedByteArray(), pointing at the uAMQP body bytes, which stay valid as long as the uAMQP message.]
 // Tests_SRS_UAMQP_MESSAGING_09_008: [The uAMQP message properties shall be retrieved using message_get_properties().]
 // Tests_SRS_UAMQP_MESSAGING_09_010: [The message-id property shall be read from the uAMQP message by calling properties_get_message_id.]
 // Tests_SRS_UAMQP_MESSAGING_09_012: [The type of the message-id property value shall be obtained using amqpvalue_get_type().]
@@ -1189,5 +1192,79 @@ TEST_FUNCTION(message_create_IoTHubMessage_from_uamqp_message_no_content_encodin
     // cleanup
 }
 
+// Tests_SRS_UAMQP_MESSAGING_31_126: [message_has_fault_injection_properties shall return true if the first application property of message_handle is `AzIoTHub_FaultOperationType`, whose properties are applied to the batch container instead of being encoded.]
+TEST_FUNCTION(message_has_fault_injection_properties_regular_message_returns_false)
+{
+    // arrange
+    size_t number_of_app_properties = 2;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+        .CopyOutArgumentBuffer(2, &TEST_MAP_KEYS, sizeof(TEST_MAP_KEYS))
+        .CopyOutArgumentBuffer(3, &TEST_MAP_VALUES, sizeof(TEST_MAP_VALUES))
+        .CopyOutArgumentBuffer(4, &number_of_app_properties, sizeof(number_of_app_properties));
+
+    // act
+    bool result = message_has_fault_injection_properties(TEST_IOTHUB_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(result);
+}
+
+// Tests_SRS_UAMQP_MESSAGING_31_126: [message_has_fault_injection_properties shall return true if the first application property of message_handle is `AzIoTHub_FaultOperationType`, whose properties are applied to the batch container instead of being encoded.]
+TEST_FUNCTION(message_has_fault_injection_properties_fault_message_returns_true)
+{
+    // arrange
+    const char* fault_keys[] = { "AzIoTHub_FaultOperationType", "AzIoTHub_FaultOperationCloseReason" };
+    const char* fault_values[] = { "KillAmqpConnection", "boom" };
+    const char* const* keys = fault_keys;
+    const char* const* values = fault_values;
+    size_t number_of_app_properties = 2;
+
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+        .CopyOutArgumentBuffer(2, &keys, sizeof(keys))
+        .CopyOutArgumentBuffer(3, &values, sizeof(values))
+        .CopyOutArgumentBuffer(4, &number_of_app_properties, sizeof(number_of_app_properties));
+
+    // act
+    bool result = message_has_fault_injection_properties(TEST_IOTHUB_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_TRUE(result);
+}
+
+// Tests_SRS_UAMQP_MESSAGING_31_127: [If message_handle is NULL or its properties cannot be read, message_has_fault_injection_properties shall return false.]
+TEST_FUNCTION(message_has_fault_injection_properties_NULL_handle_returns_false)
+{
+    // arrange
+    umock_c_reset_all_calls();
+
+    // act
+    bool result = message_has_fault_injection_properties(NULL);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(result);
+}
+
+// Tests_SRS_UAMQP_MESSAGING_31_127: [If message_handle is NULL or its properties cannot be read, message_has_fault_injection_properties shall return false.]
+TEST_FUNCTION(message_has_fault_injection_properties_GetProperties_fails_returns_false)
+{
+    // arrange
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(IoTHubMessage_GetProperties(TEST_IOTHUB_MESSAGE_HANDLE, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
+        .SetReturn(IOTHUB_MESSAGE_ERROR);
+
+    // act
+    bool result = message_has_fault_injection_properties(TEST_IOTHUB_MESSAGE_HANDLE);
+
+    // assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_FALSE(result);
+}
+
 END_TEST_SUITE(uamqp_messaging_ut)
 